@@ -38,6 +38,7 @@ CHECK_INCLUDE_FILES(grp.h HAVE_GRP_H)
 CHECK_INCLUDE_FILES(inttypes.h HAVE_INTTYPES_H)
 CHECK_INCLUDE_FILES(libutil.h HAVE_LIBUTIL_H)
 CHECK_INCLUDE_FILES(limits.h HAVE_LIMITS_H)
+CHECK_INCLUDE_FILES(linux/io_uring.h HAVE_LINUX_IO_URING_H)
 CHECK_INCLUDE_FILES(memory.h HAVE_MEMORY_H)
 CHECK_INCLUDE_FILES(mtio.h HAVE_MTIO_H)
 CHECK_INCLUDE_FILES(pwd.h HAVE_PWD_H)
@@ -69,6 +69,28 @@ if (${LZO2_FOUND})
    endif()
 endif()
 
+BareosFindLibraryAndHeaders("zstd" "zstd.h")
+if (${ZSTD_FOUND})
+   # ZSTD_compress2() and the advanced parameter API are stable since 1.4.0
+   file(STRINGS ${ZSTD_INCLUDE_DIRS}/zstd.h ZSTD_VERSION_STRINGS
+        REGEX "^#define ZSTD_VERSION_(MAJOR|MINOR|RELEASE) +[0-9]+")
+   string(REGEX REPLACE ".*MAJOR +([0-9]+).*" "\\1" ZSTD_VERSION_MAJOR
+          "${ZSTD_VERSION_STRINGS}")
+   string(REGEX REPLACE ".*MINOR +([0-9]+).*" "\\1" ZSTD_VERSION_MINOR
+          "${ZSTD_VERSION_STRINGS}")
+   string(REGEX REPLACE ".*RELEASE +([0-9]+).*" "\\1" ZSTD_VERSION_RELEASE
+          "${ZSTD_VERSION_STRINGS}")
+   set(ZSTD_VERSION
+       "${ZSTD_VERSION_MAJOR}.${ZSTD_VERSION_MINOR}.${ZSTD_VERSION_RELEASE}")
+   message(STATUS "  ZSTD_VERSION=${ZSTD_VERSION}")
+   if (ZSTD_VERSION VERSION_LESS "1.4.0")
+      message(FATAL_ERROR "zstd ${ZSTD_VERSION} found in ${ZSTD_INCLUDE_DIRS}, "
+                          "at least zstd 1.4.0 is required. Install a newer "
+                          "zstd or point ZSTD_INCLUDE_DIRS and ZSTD_LIBRARIES "
+                          "to one.")
+   endif()
+endif()
+
 #MESSAGE(FATAL_ERROR "exit")
 INCLUDE(BareosFindLibrary)
 
@@ -1093,6 +1093,9 @@ echo "This is a meta package to install a full bareos system" > %{buildroot}%{_d
 %{_sbindir}/bareos-sd
 %{script_dir}/disk-changer
 %{plugin_dir}/autoxflate-sd.so
+%{backend_dir}/libbareossd-chunked*.so
+%{backend_dir}/libbareossd-chunkdir*.so
+%{backend_dir}/libbareossd-dedup*.so
 %{_mandir}/man8/bareos-sd.8.gz
 %if 0%{?systemd_support}
 %{_unitdir}/bareos-sd.service
@@ -1125,7 +1128,6 @@ echo "This is a meta package to install a full bareos system" > %{buildroot}%{_d
 %if 0%{?droplet}
 %files storage-droplet
 %defattr(-, root, root)
-%{backend_dir}/libbareossd-chunked*.so
 %{backend_dir}/libbareossd-droplet*.so
 %attr(0640, %{director_daemon_user},%{daemon_group}) %{_sysconfdir}/%{name}/bareos-dir.d/storage/S3_Object.conf.example
 %attr(0640, %{storage_daemon_user},%{daemon_group})  %{_sysconfdir}/%{name}/bareos-sd.d/device/S3_ObjectStorage.conf.example
@@ -0,0 +1,17 @@
+#!/bin/sh
+
+DEST=${1:-bareos-com-release.key}
+
+if [ -z "" ]; then
+    echo "OBS_DISTRIBUTION not defined, skipped."
+    exit 0
+fi
+
+# use bareos.org Release.key,
+# as it is identical with the bareos.com key and we do not require a authentication.
+URL_BRANCH="http://download.bareos.org/bareos/release///Release.key"
+URL_MASTER="http://download.bareos.org/bareos/experimental/nightly//Release.key"
+
+wget -O "$DEST" "$URL_BRANCH" || wget -O "$DEST" "$URL_MASTER"
+exit $?
+
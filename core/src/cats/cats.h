@@ -182,6 +182,9 @@ struct VolumeParameters {
   uint64_t EndAddr = 0;                /**< End address */
   int32_t InChanger = 0;               /**< InChanger flag */
   uint64_t JobBytes = 0;               /**< job bytes */
+  uint32_t VolSessionId = 0;           /**< Session of referenced blocks */
+  uint32_t VolSessionTime = 0;         /**< Session of referenced blocks */
+  int32_t FileIndexOffset = 0;         /**< Added to their FileIndexes */
   // uint32_t Copy;                     /**< identical copy */
   // uint32_t Stripe;                   /**< RAIT strip number */
 };
@@ -563,7 +566,7 @@ class pathid_cache;
 /**
  * Current database version number for all drivers
  */
-#define BDB_VERSION 2171
+#define BDB_VERSION 2172
 
 #ifdef _BDB_PRIV_INTERFACE_
 /*
@@ -207,6 +207,9 @@ CREATE TABLE JobMedia (
    EndBlock INTEGER UNSIGNED DEFAULT 0,
    JobBytes NUMERIC(20) DEFAULT 0,
    VolIndex INTEGER UNSIGNED DEFAULT 0,
+   VolSessionId INTEGER UNSIGNED DEFAULT 0,
+   VolSessionTime INTEGER UNSIGNED DEFAULT 0,
+   FileIndexOffset INTEGER DEFAULT 0,
    PRIMARY KEY(JobMediaId),
    INDEX (JobId, MediaId)
 );
@@ -460,5 +463,5 @@ INSERT INTO Status (JobStatus,JobStatusLong,Severity) VALUES
 -- Initialize Version
 --   DELETE should not be required,
 --   but prevents errors if create script is called multiple times
-DELETE FROM Version WHERE VersionId<=2171;
-INSERT INTO Version (VersionId) VALUES (2171);
+DELETE FROM Version WHERE VersionId<=2172;
+INSERT INTO Version (VersionId) VALUES (2172);
@@ -144,6 +144,9 @@ CREATE TABLE JobMedia
     EndBlock          BIGINT      DEFAULT 0,
     JobBytes          NUMERIC(20) DEFAULT 0,
     VolIndex          INTEGER     DEFAULT 0,
+    VolSessionId      INTEGER     DEFAULT 0,
+    VolSessionTime    INTEGER     DEFAULT 0,
+    FileIndexOffset   INTEGER     DEFAULT 0,
     PRIMARY KEY (jobmediaid)
 );
 
@@ -484,7 +487,7 @@ INSERT INTO Status (JobStatus,JobStatusLong,Severity) VALUES
 -- Initialize Version
 --   DELETE should not be required,
 --   but prevents errors if create script is called multiple times
-DELETE FROM Version WHERE VersionId<=2171;
-INSERT INTO Version (VersionId) VALUES (2171);
+DELETE FROM Version WHERE VersionId<=2172;
+INSERT INTO Version (VersionId) VALUES (2172);
 
 -- Make sure we have appropriate permissions
@@ -0,0 +1,18 @@
+-- update db schema from 2171 to 2172
+
+-- JobMedia entries of a reference Virtual Full point into
+-- blocks written by other jobs. They carry the session of those
+-- blocks and the offset added to their FileIndexes.
+
+BEGIN; -- Necessary for Bareos core
+
+ALTER TABLE JobMedia ADD COLUMN VolSessionId INTEGER DEFAULT 0;
+ALTER TABLE JobMedia ADD COLUMN VolSessionTime INTEGER DEFAULT 0;
+ALTER TABLE JobMedia ADD COLUMN FileIndexOffset INTEGER DEFAULT 0;
+
+UPDATE Version SET VersionId = 2172;
+COMMIT;
+
+set client_min_messages = fatal;
+
+ANALYSE;
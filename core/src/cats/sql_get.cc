@@ -403,7 +403,8 @@ int BareosDb::GetJobVolumeParameters(JobControlRecord* jcr,
        "SELECT VolumeName,MediaType,FirstIndex,LastIndex,StartFile,"
        "JobMedia.EndFile,StartBlock,JobMedia.EndBlock,"
        "Slot,StorageId,InChanger,"
-       "JobBytes"
+       "JobBytes,JobMedia.VolSessionId,JobMedia.VolSessionTime,"
+       "FileIndexOffset"
        " FROM JobMedia,Media WHERE JobMedia.JobId=%s"
        " AND JobMedia.MediaId=Media.MediaId ORDER BY VolIndex,JobMediaId",
        edit_int64(JobId, ed1));
@@ -446,6 +447,9 @@ int BareosDb::GetJobVolumeParameters(JobControlRecord* jcr,
           StorageId = str_to_uint64(row[9]);
           Vols[i].InChanger = str_to_uint64(row[10]);
           Vols[i].JobBytes = str_to_uint64(row[11]);
+          Vols[i].VolSessionId = str_to_uint64(row[12]);
+          Vols[i].VolSessionTime = str_to_uint64(row[13]);
+          Vols[i].FileIndexOffset = str_to_int64(row[14]);
 
           Vols[i].StartAddr = (((uint64_t)StartFile) << 32) | StartBlock;
           Vols[i].EndAddr = (((uint64_t)EndFile) << 32) | EndBlock;
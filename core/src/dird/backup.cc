@@ -907,12 +907,18 @@ void UpdateBootstrapFile(JobControlRecord* jcr)
         if (VolParams[i].Slot > 0) {
           fprintf(fd, "Slot=%d\n", VolParams[i].Slot);
         }
-        fprintf(fd, "VolSessionId=%u\n", jcr->VolSessionId);
-        fprintf(fd, "VolSessionTime=%u\n", jcr->VolSessionTime);
+        if (VolParams[i].VolSessionId) {
+          fprintf(fd, "VolSessionId=%u\n", VolParams[i].VolSessionId);
+          fprintf(fd, "VolSessionTime=%u\n", VolParams[i].VolSessionTime);
+        } else {
+          fprintf(fd, "VolSessionId=%u\n", jcr->VolSessionId);
+          fprintf(fd, "VolSessionTime=%u\n", jcr->VolSessionTime);
+        }
         fprintf(fd, "VolAddr=%s-%s\n", edit_uint64(VolParams[i].StartAddr, ed1),
                 edit_uint64(VolParams[i].EndAddr, ed2));
-        fprintf(fd, "FileIndex=%d-%d\n", VolParams[i].FirstIndex,
-                VolParams[i].LastIndex);
+        fprintf(fd, "FileIndex=%d-%d\n",
+                VolParams[i].FirstIndex - VolParams[i].FileIndexOffset,
+                VolParams[i].LastIndex - VolParams[i].FileIndexOffset);
       }
       if (VolParams) { free(VolParams); }
       if (got_pipe) {
@@ -158,11 +158,16 @@ static void PrintBsrItem(std::string& buffer, const char* fmt, ...)
  *
  * We are called here once for each JobMedia record
  * for each Volume.
+ *
+ * A JobMedia record of a reference Virtual Full points into blocks
+ * of another job, its FileIndexes were shifted by FileIndexOffset.
+ * The bsr has to select the FileIndexes found on the volume.
  */
 uint32_t write_findex(RestoreBootstrapRecordFileIndex* fi,
                       int32_t FirstIndex,
                       int32_t LastIndex,
-                      std::string& buffer)
+                      std::string& buffer,
+                      int32_t FileIndexOffset)
 {
   auto count = uint32_t{0};
   auto bsrItems = std::string{};
@@ -173,8 +178,8 @@ uint32_t write_findex(RestoreBootstrapRecordFileIndex* fi,
     if ((first >= FirstIndex && first <= LastIndex) ||
         (last >= FirstIndex && last <= LastIndex) ||
         (first < FirstIndex && last > LastIndex)) {
-      first = std::max(first, FirstIndex);
-      last = std::min(last, LastIndex);
+      first = std::max(first, FirstIndex) - FileIndexOffset;
+      last = std::min(last, LastIndex) - FileIndexOffset;
 
       if (first == last) {
         bsrItems += "FileIndex=" + std::to_string(first) + "\n";
@@ -443,14 +448,25 @@ static uint32_t write_bsr_item(RestoreBootstrapRecord* bsr,
       PrintBsrItem(buffer, "Slot=%d\n", bsr->VolParams[i].Slot);
     }
 
-    PrintBsrItem(buffer, "VolSessionId=%u\n", bsr->VolSessionId);
-    PrintBsrItem(buffer, "VolSessionTime=%u\n", bsr->VolSessionTime);
+    /*
+     * JobMedia records referencing blocks of another job carry its session.
+     */
+    if (bsr->VolParams[i].VolSessionId) {
+      PrintBsrItem(buffer, "VolSessionId=%u\n",
+                   bsr->VolParams[i].VolSessionId);
+      PrintBsrItem(buffer, "VolSessionTime=%u\n",
+                   bsr->VolParams[i].VolSessionTime);
+    } else {
+      PrintBsrItem(buffer, "VolSessionId=%u\n", bsr->VolSessionId);
+      PrintBsrItem(buffer, "VolSessionTime=%u\n", bsr->VolSessionTime);
+    }
     PrintBsrItem(buffer, "VolAddr=%s-%s\n",
                  edit_uint64(bsr->VolParams[i].StartAddr, ed1),
                  edit_uint64(bsr->VolParams[i].EndAddr, ed2));
 
     count = write_findex(bsr->fi.get(), bsr->VolParams[i].FirstIndex,
-                         bsr->VolParams[i].LastIndex, buffer);
+                         bsr->VolParams[i].LastIndex, buffer,
+                         bsr->VolParams[i].FileIndexOffset);
     if (count) { PrintBsrItem(buffer, "Count=%u\n", count); }
 
     total_count += count;
@@ -112,7 +112,8 @@ void CloseBootstrapFile(bootstrap_info& info);
 uint32_t write_findex(RestoreBootstrapRecordFileIndex* fi,
                       int32_t FirstIndex,
                       int32_t LastIndex,
-                      std::string& buffer);
+                      std::string& buffer,
+                      int32_t FileIndexOffset = 0);
 
 } /* namespace directordaemon */
 #endif  // BAREOS_DIRD_BSR_H_
@@ -40,6 +40,7 @@
 #include "dird/jcr_private.h"
 #include "dird/sd_cmds.h"
 #include "findlib/find.h"
+#include "lib/attribute_spool.h"
 #include "lib/berrno.h"
 #include "lib/edit.h"
 #include "lib/util.h"
@@ -708,9 +709,7 @@ bail_out:
 bool DespoolAttributesFromFile(JobControlRecord* jcr, const char* file)
 {
   bool retval = false;
-  int32_t pktsiz;
-  size_t nbytes;
-  ssize_t size = 0;
+  int status;
   int32_t message_length; /* message length */
   int spool_fd = -1;
   POOLMEM* msg = GetPoolMemory(PM_MESSAGE);
@@ -733,33 +732,21 @@ bool DespoolAttributesFromFile(JobControlRecord* jcr, const char* file)
   posix_fadvise(spool_fd, 0, 0, POSIX_FADV_WILLNEED);
 #endif
 
-  while ((nbytes = read(spool_fd, (char*)&pktsiz, sizeof(int32_t))) ==
-         sizeof(int32_t)) {
-    size += sizeof(int32_t);
-    message_length = ntohl(pktsiz);
+  {
+    AttributeSpoolReader reader(spool_fd);
 
-    if (message_length > 0) {
-      /*
-       * check for message_length + \0
-       */
-      if ((message_length + 1) > (int32_t)SizeofPoolMemory(msg)) {
-        msg = ReallocPoolMemory(msg, message_length + 1);
+    while ((status = reader.Next(msg, message_length)) > 0) {
+      if (!jcr->IsJobCanceled()) {
+        UpdateAttribute(jcr, msg, message_length);
+        if (jcr->IsJobCanceled()) { goto bail_out; }
       }
-      nbytes = read(spool_fd, msg, message_length);
-      if (nbytes != (size_t)message_length) {
-        BErrNo be;
-        Dmsg2(400, "nbytes=%d message_length=%d\n", nbytes, message_length);
-        Qmsg1(jcr, M_FATAL, 0, _("read attr spool error. ERR=%s\n"),
-              be.bstrerror());
-        goto bail_out;
-      }
-      msg[nbytes] = '\0';
-      size += nbytes;
     }
 
-    if (!jcr->IsJobCanceled()) {
-      UpdateAttribute(jcr, msg, message_length);
-      if (jcr->IsJobCanceled()) { goto bail_out; }
+    if (status < 0) {
+      BErrNo be;
+      Qmsg1(jcr, M_FATAL, 0, _("read attr spool error. ERR=%s\n"),
+            be.bstrerror());
+      goto bail_out;
     }
   }
 
@@ -448,6 +448,8 @@ ResourceItem job_items[] = {
      "If \"AlwaysIncrementalMaxFullAge\" is set, during consolidations only incremental backups will be considered while the Full Backup remains to reduce the amount of data being consolidated. Only if the Full Backup is older than \"AlwaysIncrementalMaxFullAge\", the Full Backup will be part of the consolidation to avoid the Full Backup becoming too old ." },
   { "MaxFullConsolidations", CFG_TYPE_PINT32, ITEM(res_job, MaxFullConsolidations), 0, CFG_ITEM_DEFAULT, "0", "16.2.4-",
      "If \"AlwaysIncrementalMaxFullAge\" is configured, do not run more than \"MaxFullConsolidations\" consolidation jobs that include the Full backup."},
+  { "ConsolidateByReference", CFG_TYPE_BOOL, ITEM(res_job, ConsolidateByReference), 0, CFG_ITEM_DEFAULT, "false", "19.2.0-",
+     "Build Virtual Full backups in the catalog only, referencing the data of the consolidated jobs on their volumes instead of copying it. Intended for disk based volumes." },
   {nullptr, 0, 0, nullptr, 0, 0, nullptr, nullptr, nullptr}
 };
 
@@ -2122,6 +2124,13 @@ bool FilesetResource::PrintConfig(PoolMem& buff,
                     break;
                 }
                 break;
+              case 's':
+                if (B_ISDIGIT(p[1]) && B_ISDIGIT(p[2])) {
+                  Mmsg(temp, "ZSTD%d\n", (p[1] - '0') * 10 + (p[2] - '0'));
+                  PmStrcat(cfg_str, temp.c_str());
+                  p += 2;
+                }
+                break;
               default:
                 Emsg1(M_ERROR, 0,
                       _("Unknown compression include/exclude option: %c\n"),
@@ -529,6 +529,7 @@ class JobResource : public BareosResource {
   bool IgnoreDuplicateJobChecking = false; /**< Ignore Duplicate Job Checking */
   bool SaveFileHist = false; /**< Ability to disable File history saving for certain protocols */
   bool AlwaysIncremental = false; /**< Always incremental with regular consolidation */
+  bool ConsolidateByReference = false; /**< Virtual Full references the consolidated data */
 
   runtime_job_status_t* rjs = nullptr; /**< Runtime Job Status */
 
@@ -169,6 +169,26 @@ static struct s_fs_opt FS_options[] = {
     {"lzfast", INC_KW_COMPRESSION, "Zff"},
     {"lz4", INC_KW_COMPRESSION, "Zf4"},
     {"lz4hc", INC_KW_COMPRESSION, "Zfh"},
+    {"zstd", INC_KW_COMPRESSION, "Zs03"},
+    {"zstd1", INC_KW_COMPRESSION, "Zs01"},
+    {"zstd2", INC_KW_COMPRESSION, "Zs02"},
+    {"zstd3", INC_KW_COMPRESSION, "Zs03"},
+    {"zstd4", INC_KW_COMPRESSION, "Zs04"},
+    {"zstd5", INC_KW_COMPRESSION, "Zs05"},
+    {"zstd6", INC_KW_COMPRESSION, "Zs06"},
+    {"zstd7", INC_KW_COMPRESSION, "Zs07"},
+    {"zstd8", INC_KW_COMPRESSION, "Zs08"},
+    {"zstd9", INC_KW_COMPRESSION, "Zs09"},
+    {"zstd10", INC_KW_COMPRESSION, "Zs10"},
+    {"zstd11", INC_KW_COMPRESSION, "Zs11"},
+    {"zstd12", INC_KW_COMPRESSION, "Zs12"},
+    {"zstd13", INC_KW_COMPRESSION, "Zs13"},
+    {"zstd14", INC_KW_COMPRESSION, "Zs14"},
+    {"zstd15", INC_KW_COMPRESSION, "Zs15"},
+    {"zstd16", INC_KW_COMPRESSION, "Zs16"},
+    {"zstd17", INC_KW_COMPRESSION, "Zs17"},
+    {"zstd18", INC_KW_COMPRESSION, "Zs18"},
+    {"zstd19", INC_KW_COMPRESSION, "Zs19"},
     {"blowfish", INC_KW_ENCRYPTION, "Eb"},
     {"3des", INC_KW_ENCRYPTION, "E3"},
     {"aes128", INC_KW_ENCRYPTION, "Ea1"},
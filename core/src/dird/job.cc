@@ -1867,6 +1867,26 @@ void CreateClones(JobControlRecord* jcr)
   }
 }
 
+static int AddFileIndexHandler(void* ctx, int num_fields, char** row)
+{
+  RestoreBootstrapRecordFileIndex* fi = (RestoreBootstrapRecordFileIndex*)ctx;
+
+  fi->Add(str_to_int64(row[0]));
+  return 0;
+}
+
+/**
+ * A job consolidated by reference has JobMedia records pointing to blocks
+ * of other jobs, its FileIndexes are not numbered 1 to JobFiles.
+ */
+static bool IsConsolidatedByReference(RestoreBootstrapRecord* bsr)
+{
+  for (int i = 0; i < bsr->VolCount; i++) {
+    if (bsr->VolParams[i].VolSessionId) { return true; }
+  }
+  return false;
+}
+
 /**
  * Given: a JobId in jcr->impl_->previous_jr.JobId,
  *  this subroutine writes a bsr file to restore that job.
@@ -1887,8 +1907,22 @@ int CreateRestoreBootstrapFile(JobControlRecord* jcr)
     files = -1;
     goto bail_out;
   }
-  for (uint32_t fi = 1; fi <= jcr->impl->previous_jr.JobFiles; fi++) {
-    rx.bsr->fi->Add(fi);
+  if (IsConsolidatedByReference(rx.bsr.get())) {
+    char ed1[50];
+    PoolMem query(PM_MESSAGE);
+
+    Mmsg(query, "SELECT FileIndex FROM File WHERE JobId=%s AND FileIndex>0",
+         edit_uint64(rx.bsr->JobId, ed1));
+    if (!jcr->db->SqlQuery(query.c_str(), AddFileIndexHandler,
+                           rx.bsr->fi.get())) {
+      Jmsg(jcr, M_FATAL, 0, "%s", jcr->db->strerror());
+      files = -1;
+      goto bail_out;
+    }
+  } else {
+    for (uint32_t fi = 1; fi <= jcr->impl->previous_jr.JobFiles; fi++) {
+      rx.bsr->fi->Add(fi);
+    }
   }
   jcr->impl->ExpectedFiles = WriteBsrFile(ua, rx);
   if (jcr->impl->ExpectedFiles == 0) {
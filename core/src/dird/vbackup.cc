@@ -38,6 +38,7 @@
 
 #include "include/bareos.h"
 #include "dird.h"
+#include "cats/sql.h"
 #include "dird/dird_globals.h"
 #include "dird/backup.h"
 #include "dird/bsr.h"
@@ -54,6 +55,10 @@
 #include "lib/util.h"
 #include "include/make_unique.h"
 
+#include <algorithm>
+#include <string>
+#include <vector>
+
 namespace directordaemon {
 
 static const int dbglevel = 10;
@@ -161,6 +166,98 @@ bool DoNativeVbackupInit(JobControlRecord* jcr)
   return true;
 }
 
+/**
+ * Consolidate by letting the Storage daemon read the records of the
+ * consolidated jobs and write them to a new volume.
+ */
+static bool ConsolidateOnStorageDaemon(JobControlRecord* jcr, char* jobids)
+{
+  BareosSocket* sd;
+
+  if (!CreateBootstrapFile(jcr, jobids)) {
+    Jmsg(jcr, M_FATAL, 0, _("Could not create bootstrap file\n"));
+    return false;
+  }
+
+  /*
+   * Open a message channel connection with the Storage
+   * daemon.
+   */
+  Dmsg0(110, "Open connection with storage daemon\n");
+  jcr->setJobStatus(JS_WaitSD);
+
+  /*
+   * Start conversation with Storage daemon
+   */
+  if (!ConnectToStorageDaemon(jcr, 10, me->SDConnectTimeout, true)) {
+    return false;
+  }
+  sd = jcr->store_bsock;
+
+  /*
+   * Now start a job with the Storage daemon
+   */
+  if (!StartStorageDaemonJob(jcr, jcr->impl->res.read_storage_list,
+                             jcr->impl->res.write_storage_list,
+                             /* send_bsr */ true)) {
+    return false;
+  }
+  Dmsg0(100, "Storage daemon connection OK\n");
+
+  /*
+   * We re-update the job start record so that the start
+   * time is set after the run before job.  This avoids
+   * that any files created by the run before job will
+   * be saved twice.  They will be backed up in the current
+   * job, but not in the next one unless they are changed.
+   * Without this, they will be backed up in this job and
+   * in the next job run because in that case, their date
+   * is after the start of this run.
+   */
+  jcr->start_time = time(NULL);
+  jcr->impl->jr.StartTime = jcr->start_time;
+  jcr->impl->jr.JobTDate = jcr->start_time;
+  jcr->setJobStatus(JS_Running);
+
+  /*
+   * Update job start record
+   */
+  if (!jcr->db->UpdateJobStartRecord(jcr, &jcr->impl->jr)) {
+    Jmsg(jcr, M_FATAL, 0, "%s", jcr->db->strerror());
+    return false;
+  }
+
+  /*
+   * Declare the job started to start the MaxRunTime check
+   */
+  jcr->setJobStarted();
+
+  /*
+   * Start the job prior to starting the message thread below
+   * to avoid two threads from using the BareosSocket structure at
+   * the same time.
+   */
+  if (!sd->fsend("run")) { return false; }
+
+  /*
+   * Now start a Storage daemon message thread
+   */
+  if (!StartStorageDaemonMessageThread(jcr)) { return false; }
+
+  jcr->setJobStatus(JS_Running);
+
+  /*
+   * Pickup Job termination data
+   * Note, the SD stores in jcr->JobFiles/ReadBytes/JobBytes/JobErrors
+   */
+  WaitForStorageDaemonTermination(jcr);
+  jcr->setJobStatus(jcr->impl->SDJobStatus);
+  jcr->db_batch->WriteBatchFileRecords(
+      jcr); /* used by bulk batch file insert */
+
+  return jcr->is_JobStatus(JS_Terminated);
+}
+
 /**
  * Do a virtual backup, which consolidates all previous backups into a sort of
  * synthetic Full.
@@ -171,7 +268,6 @@ bool DoNativeVbackupInit(JobControlRecord* jcr)
 bool DoNativeVbackup(JobControlRecord* jcr)
 {
   char* p;
-  BareosSocket* sd;
   char* jobids;
   char ed1[100];
   int JobLevel_of_first_job;
@@ -276,88 +372,12 @@ bool DoNativeVbackup(JobControlRecord* jcr)
     goto bail_out;
   }
 
-  if (!CreateBootstrapFile(jcr, jobids)) {
-    Jmsg(jcr, M_FATAL, 0, _("Could not create bootstrap file\n"));
+  if (jcr->impl->res.job->ConsolidateByReference) {
+    if (!ConsolidateByReference(jcr, jobids)) { goto bail_out; }
+  } else if (!ConsolidateOnStorageDaemon(jcr, jobids)) {
     goto bail_out;
   }
 
-  /*
-   * Open a message channel connection with the Storage
-   * daemon.
-   */
-  Dmsg0(110, "Open connection with storage daemon\n");
-  jcr->setJobStatus(JS_WaitSD);
-
-  /*
-   * Start conversation with Storage daemon
-   */
-  if (!ConnectToStorageDaemon(jcr, 10, me->SDConnectTimeout, true)) {
-    goto bail_out;
-  }
-  sd = jcr->store_bsock;
-
-  /*
-   * Now start a job with the Storage daemon
-   */
-  if (!StartStorageDaemonJob(jcr, jcr->impl->res.read_storage_list,
-                             jcr->impl->res.write_storage_list,
-                             /* send_bsr */ true)) {
-    goto bail_out;
-  }
-  Dmsg0(100, "Storage daemon connection OK\n");
-
-  /*
-   * We re-update the job start record so that the start
-   * time is set after the run before job.  This avoids
-   * that any files created by the run before job will
-   * be saved twice.  They will be backed up in the current
-   * job, but not in the next one unless they are changed.
-   * Without this, they will be backed up in this job and
-   * in the next job run because in that case, their date
-   * is after the start of this run.
-   */
-  jcr->start_time = time(NULL);
-  jcr->impl->jr.StartTime = jcr->start_time;
-  jcr->impl->jr.JobTDate = jcr->start_time;
-  jcr->setJobStatus(JS_Running);
-
-  /*
-   * Update job start record
-   */
-  if (!jcr->db->UpdateJobStartRecord(jcr, &jcr->impl->jr)) {
-    Jmsg(jcr, M_FATAL, 0, "%s", jcr->db->strerror());
-    goto bail_out;
-  }
-
-  /*
-   * Declare the job started to start the MaxRunTime check
-   */
-  jcr->setJobStarted();
-
-  /*
-   * Start the job prior to starting the message thread below
-   * to avoid two threads from using the BareosSocket structure at
-   * the same time.
-   */
-  if (!sd->fsend("run")) { goto bail_out; }
-
-  /*
-   * Now start a Storage daemon message thread
-   */
-  if (!StartStorageDaemonMessageThread(jcr)) { goto bail_out; }
-
-  jcr->setJobStatus(JS_Running);
-
-  /*
-   * Pickup Job termination data
-   * Note, the SD stores in jcr->JobFiles/ReadBytes/JobBytes/JobErrors
-   */
-  WaitForStorageDaemonTermination(jcr);
-  jcr->setJobStatus(jcr->impl->SDJobStatus);
-  jcr->db_batch->WriteBatchFileRecords(
-      jcr); /* used by bulk batch file insert */
-  if (!jcr->is_JobStatus(JS_Terminated)) { goto bail_out; }
-
   NativeVbackupCleanup(jcr, jcr->JobStatus, JobLevel_of_first_job);
 
   /*
@@ -538,4 +558,232 @@ static bool CreateBootstrapFile(JobControlRecord* jcr, char* jobids)
   rx.bsr.reset(nullptr);
   return jcr->impl->ExpectedFiles != 0;
 }
+
+/**
+ * Copy the File records of the selected files of a consolidated job to
+ * this job, shifting their FileIndexes by offset. The FileIndex ranges
+ * are handed to the database in batches to keep the statements small.
+ */
+bool CopyFileRecords(
+    JobControlRecord* jcr,
+    JobId_t JobId,
+    const std::vector<std::pair<int32_t, int32_t>>& ranges,
+    int32_t offset)
+{
+  static const size_t max_ranges_per_query = 500;
+  char ed1[50], ed2[50];
+  PoolMem query(PM_MESSAGE);
+
+  for (size_t i = 0; i < ranges.size(); i += max_ranges_per_query) {
+    std::string fileindexes;
+
+    for (size_t j = i; j < std::min(ranges.size(), i + max_ranges_per_query);
+         j++) {
+      if (!fileindexes.empty()) { fileindexes += " OR "; }
+      fileindexes += "FileIndex BETWEEN " + std::to_string(ranges[j].first) +
+                     " AND " + std::to_string(ranges[j].second);
+    }
+
+    Mmsg(query,
+         "INSERT INTO File (FileIndex,JobId,PathId,Name,DeltaSeq,MarkId,"
+         "Fhinfo,Fhnode,LStat,MD5) "
+         "SELECT FileIndex+%d,%s,PathId,Name,DeltaSeq,MarkId,"
+         "Fhinfo,Fhnode,LStat,MD5 FROM File WHERE JobId=%s AND (%s)",
+         offset, edit_uint64(jcr->JobId, ed1), edit_uint64(JobId, ed2),
+         fileindexes.c_str());
+    if (!jcr->db->SqlQuery(query.c_str())) {
+      Jmsg(jcr, M_FATAL, 0, "%s", jcr->db->strerror());
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * Create JobMedia records for this job pointing to the blocks of a
+ * consolidated job that hold selected files. Blocks holding only files
+ * that were superseded by later jobs are not referenced, so their volumes
+ * can be recycled once the consolidated jobs are gone.
+ *
+ * The records keep the session the blocks were written with and the
+ * offset between the FileIndexes of this job and the ones on the volume.
+ * Blocks the consolidated job itself only references already carry both.
+ */
+bool CreateReferenceJobMedia(
+    JobControlRecord* jcr,
+    RestoreBootstrapRecord* bsr,
+    const std::vector<std::pair<int32_t, int32_t>>& ranges,
+    int32_t offset,
+    uint32_t& VolIndex)
+{
+  char ed1[50], ed2[50], ed3[50];
+  PoolMem query(PM_MESSAGE);
+
+  for (int i = 0; i < bsr->VolCount; i++) {
+    VolumeParameters* vol = &bsr->VolParams[i];
+    int32_t FirstIndex = 0, LastIndex = 0;
+    MediaDbRecord mr;
+
+    for (auto& range : ranges) {
+      if (range.second < (int32_t)vol->FirstIndex ||
+          range.first > (int32_t)vol->LastIndex) {
+        continue;
+      }
+      if (!FirstIndex) {
+        FirstIndex = std::max(range.first, (int32_t)vol->FirstIndex);
+      }
+      LastIndex = std::min(range.second, (int32_t)vol->LastIndex);
+    }
+    if (!FirstIndex) { continue; }
+
+    bstrncpy(mr.VolumeName, vol->VolumeName, sizeof(mr.VolumeName));
+    if (!jcr->db->GetMediaRecord(jcr, &mr)) {
+      Jmsg(jcr, M_FATAL, 0, _("Error getting Media record for Volume \"%s\": "
+                              "ERR=%s\n"),
+           vol->VolumeName, jcr->db->strerror());
+      return false;
+    }
+
+    Mmsg(query,
+         "INSERT INTO JobMedia (JobId,MediaId,FirstIndex,LastIndex,"
+         "StartFile,EndFile,StartBlock,EndBlock,JobBytes,VolIndex,"
+         "VolSessionId,VolSessionTime,FileIndexOffset) "
+         "VALUES (%s,%s,%d,%d,%u,%u,%u,%u,%s,%u,%u,%u,%d)",
+         edit_uint64(jcr->JobId, ed1), edit_int64(mr.MediaId, ed2),
+         FirstIndex + offset, LastIndex + offset,
+         (uint32_t)(vol->StartAddr >> 32), (uint32_t)(vol->EndAddr >> 32),
+         (uint32_t)vol->StartAddr, (uint32_t)vol->EndAddr,
+         edit_uint64(vol->JobBytes, ed3), ++VolIndex,
+         vol->VolSessionId ? vol->VolSessionId : bsr->VolSessionId,
+         vol->VolSessionId ? vol->VolSessionTime : bsr->VolSessionTime,
+         vol->FileIndexOffset + offset);
+    if (!jcr->db->SqlQuery(query.c_str())) {
+      Jmsg(jcr, M_FATAL, 0, "%s", jcr->db->strerror());
+      return false;
+    }
+
+    jcr->impl->SDJobBytes += vol->JobBytes;
+  }
+
+  return true;
+}
+
+/**
+ * Consolidate without reading or writing any data: the new job is built
+ * in the catalog only, from the File records of the selected files and
+ * JobMedia records pointing to the blocks of the consolidated jobs.
+ *
+ * Each consolidated job gets its own FileIndex range in the new job, its
+ * FileIndexes are shifted past the highest one of the jobs before it.
+ */
+bool ConsolidateByReference(JobControlRecord* jcr, char* jobids)
+{
+  RestoreContext rx;
+  RestoreBootstrapRecord* bsr;
+  UaContext* ua;
+  char* p;
+  JobId_t JobId;
+  int32_t offset = 0;
+  uint32_t VolIndex = 0;
+  db_int64_ctx ctx;
+  char ed1[50];
+  PoolMem query(PM_MESSAGE);
+
+  rx.bsr = std::make_unique<RestoreBootstrapRecord>();
+
+  if (!jcr->db->OpenBatchConnection(jcr)) {
+    Jmsg0(jcr, M_FATAL, 0, "Can't get batch sql connexion");
+    return false;
+  }
+
+  if (!jcr->db_batch->GetFileList(jcr, jobids, false /* don't use md5 */,
+                                  true /* use delta */, InsertBootstrapHandler,
+                                  (void*)rx.bsr.get())) {
+    Jmsg(jcr, M_FATAL, 0, "%s", jcr->db_batch->strerror());
+    return false;
+  }
+
+  if (!rx.bsr->JobId) {
+    Jmsg(jcr, M_FATAL, 0, _("No files found to consolidate.\n"));
+    return false;
+  }
+
+  ua = new_ua_context(jcr);
+  if (!AddVolumeInformationToBsr(ua, rx.bsr.get())) {
+    FreeUaContext(ua);
+    return false;
+  }
+  FreeUaContext(ua);
+
+  jcr->start_time = time(NULL);
+  jcr->impl->jr.StartTime = jcr->start_time;
+  jcr->impl->jr.JobTDate = jcr->start_time;
+  jcr->setJobStatus(JS_Running);
+  if (!jcr->db->UpdateJobStartRecord(jcr, &jcr->impl->jr)) {
+    Jmsg(jcr, M_FATAL, 0, "%s", jcr->db->strerror());
+    return false;
+  }
+  jcr->setJobStarted();
+
+  for (p = jobids; GetNextJobidFromList(&p, &JobId) > 0;) {
+    int32_t HighestIndex = 0;
+
+    for (bsr = rx.bsr.get(); bsr; bsr = bsr->next.get()) {
+      if (bsr->JobId == JobId) { break; }
+    }
+    if (!bsr || !bsr->VolCount) { continue; }
+
+    for (int i = 0; i < bsr->VolCount; i++) {
+      HighestIndex =
+          std::max(HighestIndex, (int32_t)bsr->VolParams[i].LastIndex);
+    }
+    if (HighestIndex > INT32_MAX - offset) {
+      Jmsg(jcr, M_FATAL, 0,
+           _("FileIndexes of JobId %d exceed the range of a consolidation by "
+             "reference, use a normal consolidation.\n"),
+           JobId);
+      goto bail_out;
+    }
+
+    auto ranges = bsr->fi->GetRanges();
+    if (!CopyFileRecords(jcr, JobId, ranges, offset) ||
+        !CreateReferenceJobMedia(jcr, bsr, ranges, offset, VolIndex)) {
+      goto bail_out;
+    }
+    offset += HighestIndex;
+  }
+
+  /*
+   * Count the File records that were actually copied.
+   */
+  Mmsg(query, "SELECT COUNT(*) FROM File WHERE JobId=%s",
+       edit_uint64(jcr->JobId, ed1));
+  if (!jcr->db->SqlQuery(query.c_str(), db_int64_handler, (void*)&ctx)) {
+    Jmsg(jcr, M_FATAL, 0, "%s", jcr->db->strerror());
+    goto bail_out;
+  }
+  jcr->impl->SDJobFiles = ctx.value;
+
+  jcr->impl->ExpectedFiles = jcr->impl->SDJobFiles;
+  jcr->impl->SDJobStatus = JS_Terminated;
+  jcr->setJobStatus(JS_Terminated);
+  Jmsg(jcr, M_INFO, 0,
+       _("Consolidated %d files by reference, no data was copied.\n"),
+       jcr->impl->SDJobFiles);
+
+  return true;
+
+bail_out:
+  /*
+   * Do not leave a partial job behind that keeps volumes in use.
+   */
+  Mmsg(query, "DELETE FROM File WHERE JobId=%s", edit_uint64(jcr->JobId, ed1));
+  jcr->db->SqlQuery(query.c_str());
+  Mmsg(query, "DELETE FROM JobMedia WHERE JobId=%s",
+       edit_uint64(jcr->JobId, ed1));
+  jcr->db->SqlQuery(query.c_str());
+
+  return false;
+}
 } /* namespace directordaemon */
@@ -21,13 +21,29 @@
 #ifndef BAREOS_DIRD_VBACKUP_H_
 #define BAREOS_DIRD_VBACKUP_H_
 
+#include <utility>
+#include <vector>
+
 namespace directordaemon {
 
+struct RestoreBootstrapRecord;
+
 bool DoNativeVbackupInit(JobControlRecord* jcr);
 bool DoNativeVbackup(JobControlRecord* jcr);
 void NativeVbackupCleanup(JobControlRecord* jcr,
                           int TermCode,
                           int JobLevel = L_FULL);
+bool ConsolidateByReference(JobControlRecord* jcr, char* jobids);
+bool CopyFileRecords(JobControlRecord* jcr,
+                     JobId_t JobId,
+                     const std::vector<std::pair<int32_t, int32_t>>& ranges,
+                     int32_t offset);
+bool CreateReferenceJobMedia(
+    JobControlRecord* jcr,
+    RestoreBootstrapRecord* bsr,
+    const std::vector<std::pair<int32_t, int32_t>>& ranges,
+    int32_t offset,
+    uint32_t& VolIndex);
 
 } /* namespace directordaemon */
 #endif  // BAREOS_DIRD_VBACKUP_H_
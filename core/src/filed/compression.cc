@@ -40,6 +40,10 @@
 
 #include "fastlz/fastlzlib.h"
 
+#if defined(HAVE_ZSTD)
+#include <zstd.h>
+#endif
+
 namespace filedaemon {
 
 /**
@@ -221,6 +225,27 @@ bool SetupCompressionContext(b_ctx& bctx)
         bctx.ch.level = bctx.ff_pkt->Compress_level;
         break;
       }
+#if defined(HAVE_ZSTD)
+      case COMPRESS_ZSTD: {
+        size_t zstat;
+
+        /*
+         * Set zstd compression level - must be done per file
+         */
+        zstat = ZSTD_CCtx_setParameter(
+            (ZSTD_CCtx*)bctx.jcr->compress.workset.pZSTD,
+            ZSTD_c_compressionLevel, bctx.ff_pkt->Compress_level);
+        if (ZSTD_isError(zstat)) {
+          Jmsg(bctx.jcr, M_FATAL, 0,
+               _("Compression ZSTD_CCtx_setParameter error: %s\n"),
+               ZSTD_getErrorName(zstat));
+          bctx.jcr->setJobStatus(JS_ErrorTerminated);
+          goto bail_out;
+        }
+        bctx.ch.level = bctx.ff_pkt->Compress_level;
+        break;
+      }
+#endif
       default:
         break;
     }
@@ -659,6 +659,16 @@ static int SetOptions(findFOPTS* fo, const char* opts)
             fo->Compress_algo = COMPRESS_FZ4H;
             fo->Compress_level = 1; /* not used with FZ4H */
           }
+        } else if (*p == 's') {
+          /*
+           * ZSTD with a two digit compression level.
+           */
+          if (B_ISDIGIT(p[1]) && B_ISDIGIT(p[2])) {
+            SetBit(FO_COMPRESS, fo->flags);
+            fo->Compress_algo = COMPRESS_ZSTD;
+            fo->Compress_level = (p[1] - '0') * 10 + (p[2] - '0');
+            p += 2;
+          }
         }
         break;
       case 'z': /* Min, max or approx size or size range */
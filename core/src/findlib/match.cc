@@ -342,6 +342,16 @@ void AddFnameToIncludeList(FindFilesPacket* ff, int prefixed, const char* fname)
               inc->algo = COMPRESS_FZ4H;
               inc->level = 1; /* Not used with libfzlib */
             }
+          } else if (*rp == 's') {
+            /*
+             * ZSTD with a two digit compression level.
+             */
+            if (B_ISDIGIT(rp[1]) && B_ISDIGIT(rp[2])) {
+              SetBit(FO_COMPRESS, inc->options);
+              inc->algo = COMPRESS_ZSTD;
+              inc->level = (rp[1] - '0') * 10 + (rp[2] - '0');
+              rp += 2;
+            }
           }
           Dmsg2(200, "Compression alg=%d level=%d\n", inc->algo, inc->level);
           break;
@@ -36,6 +36,10 @@ struct CompressionContext {
 #endif
 #ifdef HAVE_LZO
     void* pLZO{nullptr}; /**< LZO compression session data */
+#endif
+#ifdef HAVE_ZSTD
+    void* pZSTD{nullptr}; /**< ZSTD compression context */
+    void* pZSTDD{nullptr}; /**< ZSTD decompression context */
 #endif
     void* pZFAST{nullptr}; /**< FASTLZ compression session data */
   } workset;
@@ -0,0 +1,1271 @@
+// clang-format off
+
+// Define if building universal (internal helper macro)
+/* #undef AC_APPLE_UNIVERSAL_BUILD */
+
+// Define to 1 if the `closedir' function returns void instead of `int'
+/* #undef CLOSEDIR_VOID */
+
+// Where are Bareos config files stored
+#define CONFDIR "/usr/local/etc/bareos"
+
+/* Define to one of `_getb67', `GETB67', `getb67' for Cray-2 and Cray-YMP
+ * systems. This function is required for `alloca.c' support on those systems */
+/* #undef CRAY_STACKSEG_END */
+
+// Define to 1 if using `alloca.c'
+/* #undef C_ALLOCA */
+
+// Define to 1 if you want the Developer mode enabled
+/* #undef DEVELOPER */
+
+/* Define to 1 if translation of program messages to the user's native
+ * language is requested */
+#define ENABLE_NLS 1
+
+// Define to 1 if you have AIX3 statfs to get filesystem type
+/* #undef FSTYPE_AIX_STATFS */
+
+// Define to 1 if you have Ultrix getmnt to get filesystem type
+/* #undef FSTYPE_GETMNT */
+
+// Define to 1 if you have 4.3BSD getmntent to get filesystem type
+#define FSTYPE_MNTENT 1
+
+// Define to 1 if you have 4.4BSD and OSF1 statfs to get filesystem type
+/* #undef FSTYPE_STATFS */
+
+// Define to 1 if you have SVR4 statvfs to get filesystem type
+/* #undef FSTYPE_STATVFS */
+
+// Define to 1 if you have SVR3.2 statfs to get filesystem type
+/* #undef FSTYPE_USG_STATFS */
+
+// Define to 1 for pthread_attr_get_np() instead of pthread_getattr_np()
+/* #undef HAVE_PTHREAD_ATTR_GET_NP */
+
+// Define to 1 if pthread_*_np() are in a seperate header
+/* #undef HAVE_PTHREAD_NP_H */
+
+// Define to 1 if you want Normal acl support
+/* #undef HAVE_ACL */
+
+// Define to 1 if you want PAM support
+/* #undef HAVE_PAM */
+
+// Defines if your system have the ACL_TYPE_DEFAULT_DIR acl type
+/* #undef HAVE_ACL_TYPE_DEFAULT_DIR */
+
+// Defines if your system have the ACL_TYPE_EXTENDED acl type
+/* #undef HAVE_ACL_TYPE_EXTENDED */
+
+// Defines if your system have the ACL_TYPE_NFS4 acl type
+/* #undef HAVE_ACL_TYPE_NFS4 */
+
+// Set if addrtosymstr exists
+/* #undef HAVE_ADDRTOSYMSTR */
+
+// Define to 1 if you have the `add_proplist_entry' function
+/* #undef HAVE_ADD_PROPLIST_ENTRY */
+
+// Define to 1 if your system has AFS support
+/* #undef HAVE_AFS */
+
+// Andrew FileSystem ACL support
+/* #undef HAVE_AFS_ACL */
+
+// Define to 1 if you have the <afs/afsint.h> header file
+/* #undef HAVE_AFS_AFSINT_H */
+
+// Define to 1 if you have the <afs/venus.h> header file
+/* #undef HAVE_AFS_VENUS_H */
+
+// Define to 1 if you are running AIX
+/* #undef HAVE_AIX_OS */
+
+// Define to 1 if you have `alloca', as a function or macro
+#define HAVE_ALLOCA 1
+
+// Define to 1 if you have <alloca.h> and it should be used (not on Ultrix)
+#define HAVE_ALLOCA_H 1
+
+// Define to 1 if you have the <argz.h> header file
+/* #undef HAVE_ARGZ_H */
+
+// Define to 1 if you have the <arpa/nameser.h> header file
+#define HAVE_ARPA_NAMESER_H 1
+
+// Define to 1 if you have the `asprintf' function
+/* #undef HAVE_ASPRINTF */
+
+// Define to 1 if you have the <assert.h> header file
+#define HAVE_ASSERT_H 1
+
+// Define to 1 if you have the <attr.h> header file
+/* #undef HAVE_ATTR_H */
+
+// Define to 1 if you have the `backtrace' function
+#define HAVE_BACKTRACE 1
+
+// Define to 1 if you have the `backtrace_symbols' function
+#define HAVE_BACKTRACE_SYMBOLS 1
+
+// Define to 1 if bat Qt4 GUI support should be enabled
+/* #undef HAVE_BAT */
+
+// Define to 1 if you have the `bcopy' function
+#define HAVE_BCOPY 1
+
+// Big Endian
+/* #undef HAVE_BIG_ENDIAN */
+
+// Define to 1 if you are running BSDI
+/* #undef HAVE_BSDI_OS */
+
+// Define to 1 if you have 4.2BSD signals
+/* #undef HAVE_BSD_SIGNALS */
+
+// Define to 1 if you have the <camlib.h> header file
+/* #undef HAVE_CAMLIB_H */
+
+// Define to 1 if you have the <cam/scsi/scsi_message.h> header file
+/* #undef HAVE_CAM_SCSI_SCSI_MESSAGE_H */
+
+// Define to 1 if you have cephfs lib
+/* #undef HAVE_CEPHFS */
+
+// Define to 1 if you have cephfs/ceph_stat_x.h header
+/* #undef HAVE_CEPHFS_CEPH_STATX_H */
+
+/* Define to 1 if you have the MacOS X function CFLocaleCopyCurrent in the
+   CoreFoundation framework */
+/* #undef HAVE_CFLOCALECOPYCURRENT */
+
+/* Define to 1 if you have the MacOS X function CFPreferencesCopyAppValue in
+   the CoreFoundation framework */
+/* #undef HAVE_CFPREFERENCESCOPYAPPVALUE */
+
+// Define to 1 if you have the `chflags' function
+/* #undef HAVE_CHFLAGS */
+
+// Define to 1 if you have the `closefrom' function
+#define HAVE_CLOSEFROM 1
+
+// Define to 1 if you have compressBound
+#define HAVE_COMPRESS_BOUND 1
+
+// Define to 1 if cplus_demangle exists in libdemangle
+/* #undef HAVE_CPLUS_DEMANGLE */
+
+// Define to 1 if encryption support should be enabled
+#define HAVE_CRYPTO 1
+
+// Define to 1 if you have the <curses.h> header file
+#define HAVE_CURSES_H 1
+
+// Define to 1 if you have the <cxxabi.h> header file
+#define HAVE_CXXABI_H 1
+
+// Define to 1 if you use CYGWIN
+/* #undef HAVE_CYGWIN */
+
+// Define to 1 if you are running OSX
+/* #undef HAVE_DARWIN_OS */
+
+// Define if the GNU dcgettext() function is already present or preinstalled
+#define HAVE_DCGETTEXT 1
+
+// Define to 1 if you have the declaration of `cygwin_conv_path', and to 0 if you don't
+/* #undef HAVE_DECL_CYGWIN_CONV_PATH */
+
+// Define to 1 if you have the declaration of `feof_unlocked', and to 0 if you don't
+/* #undef HAVE_DECL_FEOF_UNLOCKED */
+
+// Define to 1 if you have the declaration of `fgets_unlocked', and to 0 if you don't
+/* #undef HAVE_DECL_FGETS_UNLOCKED */
+
+// Define to 1 if you have the declaration of `getc_unlocked', and to 0 if you don't
+/* #undef HAVE_DECL_GETC_UNLOCKED */
+
+// Define to 1 if you have the declaration of `tzname', and to 0 if you don't
+/* #undef HAVE_DECL_TZNAME */
+
+// Define to 1 if you have the declaration of `_snprintf', and to 0 if you don't
+/* #undef HAVE_DECL__SNPRINTF */
+
+// Define to 1 if you have the declaration of `_snwprintf', and to 0 if you don't
+/* #undef HAVE_DECL__SNWPRINTF */
+
+// Define to 1 if you have the <demangle.h> header file
+/* #undef HAVE_DEMANGLE_H */
+
+// Define to 1 if you have the <dev/scsipi/scsipi_all.h> header file
+/* #undef HAVE_DEV_SCSIPI_SCSIPI_ALL_H */
+
+// Define to 1 if you have the <dirent.h> header file, and it defines `DIR'
+#define HAVE_DIRENT_H 1
+
+// Define if you have the GNU dld library
+/* #undef HAVE_DLD */
+
+// Define to 1 if you have the `dlerror' function
+#define HAVE_DLERROR 1
+
+// Define to 1 if you have the <dlfcn.h> header file
+#define HAVE_DLFCN_H 1
+
+// Define to 1 if you have the <dl.h> header file
+/* #undef HAVE_DL_H */
+
+// Define to 1 if you don't have `vprintf' but do have `_doprnt.'
+/* #undef HAVE_DOPRNT */
+
+// Define if you have the _dyld_func_lookup function
+/* #undef HAVE_DYLD */
+
+// Define to 1 if dynamic loading of catalog backends is enabled
+#define HAVE_DYNAMIC_CATS_BACKENDS 1
+
+// Define to 1 if dynamic loading of storage backends is enabled
+#define HAVE_DYNAMIC_SD_BACKENDS 1
+
+// Define to 1 if you have elasto lib
+/* #undef HAVE_ELASTO */
+
+// Set if you have an Embedded MySQL Database
+/* #undef HAVE_EMBEDDED_MYSQL */
+
+// Define to 1 if OpenSSL library has ENGINE_load_pk11 available
+/* #undef HAVE_ENGINE_LOAD_PK11 */
+
+// Define to 1 if you have the <execinfo.h> header file
+#define HAVE_EXECINFO_H 1
+
+// Define to 1 if you have the `extattr_get_file' function
+/* #undef HAVE_EXTATTR_GET_FILE */
+
+// Define to 1 if you have the `extattr_get_link' function
+/* #undef HAVE_EXTATTR_GET_LINK */
+
+// Define to 1 if you have the `extattr_list_file' function
+/* #undef HAVE_EXTATTR_LIST_FILE */
+
+// Define to 1 if you have the `extattr_list_link' function
+/* #undef HAVE_EXTATTR_LIST_LINK */
+
+// Define to 1 if you have the `extattr_namespace_to_string' function
+/* #undef HAVE_EXTATTR_NAMESPACE_TO_STRING */
+
+// Define to 1 if you have the `extattr_set_file' function
+/* #undef HAVE_EXTATTR_SET_FILE */
+
+// Define to 1 if you have the `extattr_set_link' function
+/* #undef HAVE_EXTATTR_SET_LINK */
+
+// Define to 1 if you have the `extattr_string_to_namespace' function
+/* #undef HAVE_EXTATTR_STRING_TO_NAMESPACE */
+
+// Define to 1 if you want Extended acl support
+/* #undef HAVE_EXTENDED_ACL */
+
+// Define to 1 if you have the `fchdir' function
+#define HAVE_FCHDIR 1
+
+// Define to 1 if you have the `fchmod' function
+#define HAVE_FCHMOD 1
+
+// Define to 1 if you have the `fchown' function
+#define HAVE_FCHOWN 1
+
+// Define to 1 if you have the `fchownat' function
+#define HAVE_FCHOWNAT 1
+
+// Define to 1 if you have the fcntl F_CLOSEM flag
+/* #undef HAVE_FCNTL_F_CLOSEM */
+
+// Define to 1 if you have the <fcntl.h> header file
+#define HAVE_FCNTL_H 1
+
+// Define to 1 if you have the `fdatasync' function
+#define HAVE_FDATASYNC 1
+
+// Define to 1 if you have the `fork' function
+#define HAVE_FORK 1
+
+// Define to 1 if you are running FreeBSD
+/* #undef HAVE_FREEBSD_OS */
+
+// Define to 1 if you have the `fseeko' function
+#define HAVE_FSEEKO 1
+
+// Define to 1 if you have the `fstatat' function
+/* #undef HAVE_FSTATAT */
+
+// Define to 1 if you have the `futimens' function
+#define HAVE_FUTIMENS 1
+
+// Define to 1 if you have the `futimes' function
+#define HAVE_FUTIMES 1
+
+// Define to 1 if you have the `futimesat' function
+#define HAVE_FUTIMESAT 1
+
+// Define to 1 if you have the `fwprintf' function
+/* #undef HAVE_FWPRINTF */
+
+// Define to 1 if you have the `gai_strerror' function
+#define HAVE_GAI_STRERROR 1
+
+// Define to 1 if you use gcc
+#define HAVE_GCC 1
+
+// Define to 1 if you have the `getaddrinfo' function
+#define HAVE_GETADDRINFO 1
+
+// Define to 1 if you have the `getcwd' function
+#define HAVE_GETCWD 1
+
+// Define to 1 if you have the `getea' function
+/* #undef HAVE_GETEA */
+
+// Define to 1 if you have the `getegid' function
+/* #undef HAVE_GETEGID */
+
+// Define to 1 if you have the `geteuid' function
+/* #undef HAVE_GETEUID */
+
+// Define to 1 if you have the `getgid' function
+/* #undef HAVE_GETGID */
+
+// Define to 1 if you have the `gethostbyname2' function
+#define HAVE_GETHOSTBYNAME2 1
+
+// Define to 1 if you have the `gethostbyname_r' function
+#define HAVE_GETHOSTBYNAME_R 1
+
+// Define to 1 if you have the `gethostid' function
+#define HAVE_GETHOSTID 1
+
+// Define to 1 if you have the `gethostname' function
+#define HAVE_GETHOSTNAME 1
+
+// Define to 1 if you have the `getmntent' function
+#define HAVE_GETMNTENT 1
+
+// Define to 1 if you have the `getmntinfo' function
+/* #undef HAVE_GETMNTINFO */
+
+// Define to 1 if you have the `getpagesize' function
+#define HAVE_GETPAGESIZE 1
+
+// Define to 1 if you have the `getpid' function
+#define HAVE_GETPID 1
+
+// Define to 1 if you have the `getproplist' function
+/* #undef HAVE_GETPROPLIST */
+
+// Define if the GNU gettext() function is already present or preinstalled
+#define HAVE_GETTEXT 1
+
+// Define to 1 if you have the `gettimeofday' function
+#define HAVE_GETTIMEOFDAY 1
+
+// Define to 1 if you have the `getuid' function
+/* #undef HAVE_GETUID */
+
+// Define to 1 if you have the `getxattr' function
+#define HAVE_GETXATTR 1
+
+// Define to 1 if you have the `get_proplist_entry' function
+/* #undef HAVE_GET_PROPLIST_ENTRY */
+
+// Define to 1 if you have gfapi lib
+/* #undef HAVE_GFAPI */
+
+// Define to 1 if the `glfs_ftruncate' function has four arguments
+/* #undef GLFS_FTRUNCATE_HAS_FOUR_ARGS */
+
+// Define to 1 if you have the `glfs_readdirplus' function
+/* #undef HAVE_GLFS_READDIRPLUS */
+
+// Define to 1 if you have the `glob' function
+#define HAVE_GLOB 1
+
+// Define to 1 if you have the <glob.h> header file
+#define HAVE_GLOB_H 1
+
+// Define to 1 if you have the <grp.h> header file
+#define HAVE_GRP_H 1
+
+// Define to 1 if you are running HPUX
+/* #undef HAVE_HPUX_OS */
+
+// Define to 1 if you are running GNU Hurd
+/* #undef HAVE_HURD_OS */
+
+// Define to 1 if you have the `iconv()' function
+/* #undef HAVE_ICONV */
+
+// Define to 1 if you have the `inet_ntop' function
+#define HAVE_INET_NTOP 1
+
+// Define to 1 if you have the `inet_pton' function
+#define HAVE_INET_PTON 1
+
+// Define to 1 if you have int64_t
+#define HAVE_INT64_T 1
+
+// Define to 1 if you have intmax_t
+#define HAVE_INTMAX_T 1
+
+// Define to 1 if the system has the type `intptr_t'
+#define HAVE_INTPTR_T 1
+
+// Define to 1 if you have the <inttypes.h> header file
+#define HAVE_INTTYPES_H 1
+
+// Define if <inttypes.h> exists, doesn't clash with <sys/types.h>, and declares uintmax_t
+/* #undef HAVE_INTTYPES_H_WITH_UINTMAX */
+
+// Define to 1 if you have intxx_t
+#define HAVE_INTXX_T 1
+
+// Define to 1 if ioctl request is unsigned long int
+/* #undef HAVE_IOCTL_ULINT_REQUEST */
+
+// Define to 1 if IPv6 support should be enabled
+#define HAVE_IPV6 1
+
+// Define to 1 if you are running IRIX
+/* #undef HAVE_IRIX_OS */
+
+// Define HAVE_IS_TRIVIALLY_COPYABLE if compiler has type trait is_trivially_copyable
+#define HAVE_IS_TRIVIALLY_COPYABLE
+
+// Define to 1 if you have jansson lib
+/* #undef HAVE_JANSSON */
+
+// Define if you have <langinfo.h> and nl_langinfo(CODESET)
+/* #undef HAVE_LANGINFO_CODESET */
+
+// Define to 1 if you have the `lchmod' function
+#define HAVE_LCHMOD 1
+
+// Define to 1 if you have the `lchown' function
+#define HAVE_LCHOWN 1
+
+// Define if your <locale.h> file defines LC_MESSAGES
+/* #undef HAVE_LC_MESSAGES */
+
+// Define to 1 if you have the `lgetea' function
+/* #undef HAVE_LGETEA */
+
+// Define to 1 if you have the `lgetxattr' function
+#define HAVE_LGETXATTR 1
+
+// Define to 1 if you have libcap
+/* #undef HAVE_LIBCAP */
+
+// Define to 1 if you have the <libc.h> header file
+/* #undef HAVE_LIBC_H */
+
+// Define if you have the libdl library or equivalent
+#define HAVE_LIBDL 1
+
+// Define if libdlloader will be built on this platform
+/* #undef HAVE_LIBDLLOADER */
+
+// Define to 1 if you have the `sun' library (-lsun)
+/* #undef HAVE_LIBSUN */
+
+// Define to 1 if you have the `util' library (-lutil)
+#define HAVE_LIBUTIL 1
+
+// Define to 1 if you have the <libutil.h> header file
+/* #undef HAVE_LIBUTIL_H */
+
+// Set to enable libwrap support
+/* #undef HAVE_LIBWRAP */
+
+// Define to 1 if you have zlib
+#define HAVE_LIBZ 1
+
+// Define to 1 if you have the <limits.h> header file
+#define HAVE_LIMITS_H 1
+
+// Define to 1 if you have the <linux/io_uring.h> header file
+#define HAVE_LINUX_IO_URING_H 1
+
+// Define to 1 if you are running Linux
+#define HAVE_LINUX_OS 1
+
+// Define to 1 if you have the `listea' function
+/* #undef HAVE_LISTEA */
+
+// Define to 1 if you have the `listxattr' function
+#define HAVE_LISTXATTR 1
+
+// Little Endian
+#define HAVE_LITTLE_ENDIAN 1
+
+// Define to 1 if you have the `llistea' function
+/* #undef HAVE_LLISTEA */
+
+// Define to 1 if you have the `llistxattr' function
+#define HAVE_LLISTXATTR 1
+
+// Define to 1 if LMDB support should be enabled
+#define HAVE_LMDB 1
+
+// Define to 1 if you have the <locale.h> header file
+/* #undef HAVE_LOCALE_H */
+
+// Define to 1 if you have the `localtime_r' function
+#define HAVE_LOCALTIME_R 1
+
+// Define if you have the 'long double' type
+/* #undef HAVE_LONG_DOUBLE */
+
+// Define if you have the 'long long' type
+/* #undef HAVE_LONG_LONG */
+
+// Low level SCSI Interface support
+/* #undef HAVE_LOWLEVEL_SCSI_INTERFACE */
+
+// Define to 1 if you have the `lsetea' function
+/* #undef HAVE_LSETEA */
+
+// Define to 1 if you have the `lsetxattr' function
+#define HAVE_LSETXATTR 1
+
+// Define to 1 if you have the `lstat' function
+#define HAVE_LSTAT 1
+
+// Define to 1 if you have the `lutimes' function
+#define HAVE_LUTIMES 1
+
+// Define to 1 if you have lzo lib
+/* #undef HAVE_LZO */
+
+// Define to 1 if you have the zstd lib
+/* #undef HAVE_ZSTD */
+
+// Define to 1 if you have the <lzo/lzo1x.h> header file
+/* #undef HAVE_LZO_LZO1X_H */
+
+// Define to 1 if you have the <lzo/lzoconf.h> header file
+/* #undef HAVE_LZO_LZOCONF_H */
+
+// Define to 1 if you have the <malloc.h> header file
+/* #undef HAVE_MALLOC_H */
+
+// Define to 1 if you have the `malloc_trim' function
+#define HAVE_MALLOC_TRIM 1
+
+// Define to 1 if you have the <memory.h> header file
+#define HAVE_MEMORY_H 1
+
+// Define to 1 if you have the `mempcpy' function
+/* #undef HAVE_MEMPCPY */
+
+// Define to 1 if you have a working `mmap' system call
+/* #undef HAVE_MMAP */
+
+// Define to 1 if you have the <mtio.h> header file
+/* #undef HAVE_MTIO_H */
+
+// Define to 1 if you have the `munmap' function
+/* #undef HAVE_MUNMAP */
+
+// Set if you have an MySQL Database
+/* #undef HAVE_MYSQL */
+
+// Set if have mysql_thread_safe
+#define HAVE_MYSQL_THREAD_SAFE 1
+
+// Define to 1 if you have the `nanosleep' function
+#define HAVE_NANOSLEEP 1
+
+// Define to 1 if you have the <ndir.h> header file, and it defines `DIR'
+/* #undef HAVE_NDIR_H */
+
+// Define to 1 if NDMP support should be enabled
+#define HAVE_NDMP 1
+
+// Define to 1 if you are running NetBSD
+/* #undef HAVE_NETBSD_OS */
+
+// Define to 1 if you have the `nl_langinfo' function
+#define HAVE_NL_LANGINFO 1
+
+// Define to 1 if you have the <nl_types.h> header file
+/* #undef HAVE_NL_TYPES_H */
+
+// Define to 1 to when walkcontext does not work
+/* #undef HAVE_NON_WORKING_WALKCONTEXT */
+
+// Define to 1 if you have the `nvlist_next_nvpair' function
+/* #undef HAVE_NVLIST_NEXT_NVPAIR */
+
+// Define to 1 if you have libdroplet lib
+/* #undef HAVE_DROPLET */
+
+// Define to 1 to use the old sockopt option
+/* #undef HAVE_OLD_SOCKOPT */
+
+// Define to 1 if you have the `openat' function
+#define HAVE_OPENAT 1
+
+// Define to 1 if you are running OpenBSD
+/* #undef HAVE_OPENBSD_OS */
+
+// Define to 1 if OpenSSL library is available
+#define HAVE_OPENSSL 1
+
+// Define to 1 if the OpenSSL library is export-contrained to 128bit ciphers
+/* #undef HAVE_OPENSSL_EXPORT_LIBRARY */
+
+// Define to 1 if you are running Tru64
+/* #undef HAVE_OSF1_OS */
+
+// Define to 1 if you have the `poll' function
+#define HAVE_POLL 1
+
+// Define to 1 if you have the <poll.h> header file
+#define HAVE_POLL_H 1
+
+// Define to 1 if you have the `posix_fadvise' function
+#define HAVE_POSIX_FADVISE 1
+
+// Define if your printf() function supports format strings with positions
+/* #undef HAVE_POSIX_PRINTF */
+
+// Define to 1 if you have POSIX signals
+#define HAVE_POSIX_SIGNALS 1
+
+// Set if you have an PostgreSQL Database
+#define HAVE_POSTGRESQL 1
+
+// Set if PostgreSQL DB batch insert code enabled
+#define HAVE_POSTGRESQL_BATCH_FILE_INSERT 1
+
+// Set if have PQisthreadsafe
+#define HAVE_PQISTHREADSAFE 1
+
+// Set if have PQputCopyData
+#define HAVE_PQ_COPY 1
+
+// Define to 1 if you have the `prctl' function
+#define HAVE_PRCTL 1
+
+// Define to 1 if you have the `putenv' function
+#define HAVE_PUTENV 1
+
+// Define to 1 if you have the <pwd.h> header file
+#define HAVE_PWD_H 1
+
+// Define to 1 if python support should be enabled
+#define HAVE_PYTHON 1
+
+// Define to 1 if you have rados lib
+/* #undef HAVE_RADOS */
+
+// Define to 1 if you have support for RADOS namespaces
+/* #undef HAVE_RADOS_NAMESPACES */
+
+// Define to 1 if you have support for RADOS NObject List API
+/* #undef HAVE_RADOS_NOBJECTS_LIST */
+
+// Define to 1 if you have radosstriper lib
+/* #undef HAVE_RADOS_STRIPER */
+
+// Define to 1 if you have the `readdir_r' function
+#define HAVE_READDIR_R 1
+
+// Define to 1 if readline support should be enabled
+#define HAVE_READLINE 1
+
+// Define to 1 if you have the <regex.h> header file
+#define HAVE_REGEX_H 1
+
+// Define to 1 if sa_len field exists in struct sockaddr
+/* #undef HAVE_SA_LEN */
+
+// Define to 1 if you have the <scsi/scsi.h> header file
+#define HAVE_SCSI_SCSI_H 1
+
+// Define to 1 if you have the <scsi/sg.h> header file
+#define HAVE_SCSI_SG_H 1
+
+// Define to 1 if you have the `select' function
+#define HAVE_SELECT 1
+
+// Define to 1 if you have the `setea' function
+/* #undef HAVE_SETEA */
+
+// Define to 1 if you have the `setenv' function
+#define HAVE_SETENV 1
+
+// Define to 1 if you have the <setjmp.h> header file
+#define HAVE_SETJMP_H 1
+
+// Define to 1 if you have the `setlocale' function
+#define HAVE_SETLOCALE 1
+
+// Define to 1 if you have the `setpgid' function
+#define HAVE_SETPGID 1
+
+// Define to 1 if you have the `setpgrp' function
+#define HAVE_SETPGRP 1
+
+// Define to 1 if you have the `setproplist' function
+/* #undef HAVE_SETPROPLIST */
+
+// Define to 1 if you have the `setreuid' function
+#define HAVE_SETREUID 1
+
+// Define to 1 if you have the `setsid' function
+#define HAVE_SETSID 1
+
+// Define to 1 if you have the `setxattr' function
+#define HAVE_SETXATTR 1
+
+// Define to 1 if you are running SGI OS
+/* #undef HAVE_SGI_OS */
+
+// Define to 1 if the SHA-2 family of digest algorithms is available
+#define HAVE_SHA2 1
+
+// Define if you have the shl_load function
+/* #undef HAVE_SHL_LOAD */
+
+// Define to 1 if you have the `signal' function
+#define HAVE_SIGNAL 1
+
+// Define to 1 if you have the `sizeof_proplist_entry' function
+/* #undef HAVE_SIZEOF_PROPLIST_ENTRY */
+
+// Define to 1 if you have the `snprintf' function
+#define HAVE_SNPRINTF 1
+
+// Define to 1 if socklen_t exists
+#define HAVE_SOCKLEN_T 4
+
+// Set if you have an SQLite3 Database
+/* #undef HAVE_SQLITE3 */
+
+// Define to 1 if you have the `sqlite3_threadsafe' function
+#define HAVE_SQLITE3_THREADSAFE 1
+
+// Define to 1 if sql pooling is enabled
+/* #undef HAVE_SQL_POOLING */
+
+// Define to 1 if you have the <stdarg.h> header file
+#define HAVE_STDARG_H 1
+
+// Define to 1 if you have the <stddef.h> header file
+#define HAVE_STDDEF_H 1
+
+// Define to 1 if you have the <stdint.h> header file
+#define HAVE_STDINT_H 1
+
+/* Define if <stdint.h> exists, doesn't clash with <sys/types.h>, and declares
+   uintmax_t */
+/* #undef HAVE_STDINT_H_WITH_UINTMAX */
+
+// Define to 1 if you have the <stdlib.h> header file
+#define HAVE_STDLIB_H 1
+
+// Define to 1 if you have the `stpcpy' function
+#define HAVE_STPCPY 1
+
+// Define to 1 if you have the `strcasecmp' function
+#define HAVE_STRCASECMP 1
+
+// Define to 1 if you have the `strdup' function
+/* #undef HAVE_STRDUP */
+
+// Define to 1 if you have the `strerror' function
+#define HAVE_STRERROR 1
+
+// Define to 1 if you have the `strerror_r' function
+#define HAVE_STRERROR_R 1
+
+// Define to 1 if you have the `strftime' function
+#define HAVE_STRFTIME 1
+
+// Define to 1 if you have the <strings.h> header file
+#define HAVE_STRINGS_H 1
+
+// Define to 1 if you have the <string.h> header file
+#define HAVE_STRING_H 1
+
+// Define to 1 if you have the `strncmp' function
+#define HAVE_STRNCMP 1
+
+// Define to 1 if you have the `strncpy' function
+#define HAVE_STRNCPY 1
+
+// Define to 1 if you have the `strtoll' function
+#define HAVE_STRTOLL 1
+
+// Define to 1 if you have the `strtoul' function
+/* #undef HAVE_STRTOUL */
+
+// Define to 1 if `st_blksize' is a member of `struct stat'
+#define HAVE_STRUCT_STAT_ST_BLKSIZE 1
+
+// Define to 1 if `st_blocks' is a member of `struct stat'
+#define HAVE_STRUCT_STAT_ST_BLOCKS 1
+
+// Define to 1 if `st_rdev' is a member of `struct stat'
+#define HAVE_STRUCT_STAT_ST_RDEV 1
+
+// Define to 1 if `tm_zone' is a member of `struct tm'
+#define HAVE_STRUCT_TM_TM_ZONE 1
+
+/* Define to 1 if your `struct stat' has `st_blksize'. Deprecated, use
+   `HAVE_STRUCT_STAT_ST_BLKSIZE' instead */
+#define HAVE_ST_BLKSIZE 1
+
+/* Define to 1 if your `struct stat' has `st_blocks'. Deprecated, use
+   `HAVE_STRUCT_STAT_ST_BLOCKS' instead */
+#define HAVE_ST_BLOCKS 1
+
+/* Define to 1 if your `struct stat' has `st_rdev'. Deprecated, use
+   `HAVE_STRUCT_STAT_ST_RDEV' instead */
+#define HAVE_ST_RDEV 1
+
+// Define to 1 if you are running Solaris
+/* #undef HAVE_SUN_OS */
+
+// Define to 1 if systemd support should be enabled
+#define HAVE_SYSTEMD 1
+
+// Define to 1 if you have the <sys/acl.h> header file
+/* #undef HAVE_SYS_ACL_H */
+
+// Define to 1 if you have the <sys/attr.h> header file
+/* #undef HAVE_SYS_ATTR_H */
+
+// Define to 1 if you have the <sys/bitypes.h> header file
+#define HAVE_SYS_BITYPES_H 1
+
+// Define to 1 if you have the <sys/byteorder.h> header file
+/* #undef HAVE_SYS_BYTEORDER_H */
+
+// Define to 1 if you have the <sys/capability.h> header file
+/* #undef HAVE_SYS_CAPABILITY_H */
+
+// Define to 1 if you have the <sys/dir.h> header file, and it defines `DIR'
+#define HAVE_SYS_DIR_H 1
+
+// Define to 1 if you have the <sys/dl.h> header file
+/* #undef HAVE_SYS_DL_H */
+
+// Define to 1 if you have the <sys/ea.h> header file
+/* #undef HAVE_SYS_EA_H */
+
+// Define to 1 if you have the <sys/extattr.h> header file
+/* #undef HAVE_SYS_EXTATTR_H */
+
+// Define to 1 if you have the <sys/ioctl.h> header file
+#define HAVE_SYS_IOCTL_H 1
+
+// Define to 1 if you have the <sys/mman.h> header file
+#undef HAVE_SYS_MMAN_H
+
+// Define to 1 if you have the <sys/mtio.h> header file
+#define HAVE_SYS_MTIO_H 1
+
+// Define to 1 if you have the <sys/ndir.h> header file, and it defines `DIR'
+/* #undef HAVE_SYS_NDIR_H */
+
+// Define to 1 if you have the <sys/nvpair.h> header file
+/* #undef HAVE_SYS_NVPAIR_H */
+
+// Define to 1 if you have the <sys/param.h> header file
+/* #undef HAVE_SYS_PARAM_H */
+
+// Define to 1 if you have the <sys/poll.h> header file
+#define HAVE_SYS_POLL_H 1
+
+// Define to 1 if you have the <sys/prctl.h> header file
+#define HAVE_SYS_PRCTL_H 1
+
+// Define to 1 if you have the <sys/proplist.h> header file
+/* #undef HAVE_SYS_PROPLIST_H */
+
+// Define to 1 if you have the <sys/scsi/impl/uscsi.h> header file
+/* #undef HAVE_SYS_SCSI_IMPL_USCSI_H */
+
+// Define to 1 if you have the <sys/select.h> header file
+#define HAVE_SYS_SELECT_H 1
+
+// Define to 1 if you have the <sys/socket.h> header file
+#define HAVE_SYS_SOCKET_H 1
+
+// Define to 1 if you have the <sys/sockio.h> header file
+/* #undef HAVE_SYS_SOCKIO_H */
+
+// Define to 1 if you have the <sys/statvfs.h> header file
+#define HAVE_SYS_STATVFS_H 1
+
+// Define to 1 if you have the <sys/stat.h> header file
+#define HAVE_SYS_STAT_H 1
+
+// Define to 1 if you have the <sys/tape.h> header file
+/* #undef HAVE_SYS_TAPE_H */
+
+// Define to 1 if you have the <sys/time.h> header file
+#define HAVE_SYS_TIME_H 1
+
+// Define to 1 if you have the <sys/types.h> header file
+#define HAVE_SYS_TYPES_H 1
+
+// Define to 1 if you have <sys/wait.h> that is POSIX.1 compatible
+#define HAVE_SYS_WAIT_H 1
+
+// Define to 1 if you have the <sys/xattr.h> header file
+#define HAVE_SYS_XATTR_H 1
+
+// Define to 1 if you have the `tcgetattr' function
+#define HAVE_TCGETATTR 1
+
+// Define to 1 if you have the <termcap.h> header file
+#define HAVE_TERMCAP_H 1
+
+// Define to 1 if you have the <termios.h> header file
+#define HAVE_TERMIOS_H 1
+
+// Define to 1 if you have the <term.h> header file
+#define HAVE_TERM_H 1
+
+// Define to 1 if TLS support should be enabled
+#define HAVE_TLS 1
+
+/* Define to 1 if your `struct tm' has `tm_zone'. Deprecated, use
+   `HAVE_STRUCT_TM_TM_ZONE' instead */
+#define HAVE_TM_ZONE 1
+
+// Define to 1 if tray-monitor Qt4 GUI support should be enabled
+/* #undef HAVE_TRAYMONITOR */
+
+// Define to 1 if you have the `tsearch' function
+/* #undef HAVE_TSEARCH */
+
+// Define to 1 if compiler has typeof
+/* #undef HAVE_TYPEOF */
+
+/* Define to 1 if you don't have `tm_zone' but do have the external array
+   `tzname' */
+/* #undef HAVE_TZNAME */
+
+// Define to 1 if you have the <ucontext.h> header file
+#define HAVE_UCONTEXT_H 1
+
+// Define if you have the 'uintmax_t' type in <stdint.h> or <inttypes.h>
+/* #undef HAVE_UINTMAX_T */
+
+// Define to 1 if the system has the type `uintptr_t'
+#define HAVE_UINTPTR_T 1
+
+// Define to 1 if you have uintxx_t
+/* #undef HAVE_UINTXX_T */
+
+// Define to 1 if you have the <umem.h> header file
+/* #undef HAVE_UMEM_H */
+
+// Define to 1 if you have the <unistd.h> header file
+#define HAVE_UNISTD_H 1
+
+// Define to 1 if you have the `unlinkat' function
+#define HAVE_UNLINKAT 1
+
+// Define if you have the 'unsigned long long' type
+/* #undef HAVE_UNSIGNED_LONG_LONG */
+
+// Define to 1 if you have the <scsi/uscsi_all.h> header file
+/* #undef HAVE_USCSI_ALL_H */
+
+// Define to 1 if you have SVR3 signals
+/* #undef HAVE_USG_SIGHOLD */
+
+// Define to 1 if you have the `utimes' function
+#define HAVE_UTIMES 1
+
+// Define to 1 if you have the <utime.h> header file
+#define HAVE_UTIME_H 1
+
+// Define to 1 if you have u_int
+#define HAVE_U_INT 1
+
+// Define to 1 if you have u_int64_t
+#define HAVE_U_INT64_T 1
+
+// Define to 1 if you have u_intmax_t
+/* #undef HAVE_U_INTMAX_T */
+
+// Define to 1 if you have u_intxx_t
+#define HAVE_U_INTXX_T 1
+
+// Define to 1 if you have the <varargs.h> header file
+/* #undef HAVE_VARARGS_H */
+
+// Set if va_copy exists
+#define HAVE_VA_COPY 1
+
+// Define to 1 if you have the `vfprintf' function
+#define HAVE_VFPRINTF 1
+
+// Define to 1 if you have the `vprintf' function
+#define HAVE_VPRINTF 1
+
+// Define to 1 if you have the `vsnprintf' function
+#define HAVE_VSNPRINTF 1
+
+// Define if you have the 'wchar_t' type
+/* #undef HAVE_WCHAR_T */
+
+// Define to 1 if you have the `wcslen' function
+/* #undef HAVE_WCSLEN */
+
+// Define if you have the 'wint_t' type
+/* #undef HAVE_WINT_T */
+
+// Extended Attributes support
+#define HAVE_XATTR 1
+
+// Define to 1 if you have the <zlib.h> header file
+#define HAVE_ZLIB_H 1
+
+// Define to 1 if you have the `__argz_count' function
+/* #undef HAVE___ARGZ_COUNT */
+
+// Define to 1 if you have the `__argz_next' function
+/* #undef HAVE___ARGZ_NEXT */
+
+// Define to 1 if you have the `__argz_stringify' function
+/* #undef HAVE___ARGZ_STRINGIFY */
+
+// Define to 1 if you have the `__fsetlocking' function
+/* #undef HAVE___FSETLOCKING */
+
+// Define as const if the declaration of iconv() needs const
+/* #undef ICONV_CONST */
+
+// Define if integer division by zero raises signal SIGFPE
+/* #undef INTDIV0_RAISES_SIGFPE */
+
+// Define to 1 if things are build using the Open Build Service (OBS)
+/* #undef IS_BUILD_ON_OBS */
+
+// Where are shared libs stored
+/* #undef LIBDIR */
+
+// Where are locale files stored
+#define LOCALEDIR "share/locale"
+
+// Define to the sub-directory where libtool stores uninstalled libraries
+/* #undef LT_OBJDIR */
+
+// Define to 1 if `major', `minor', and `makedev' are declared in <mkdev.h>
+/* #undef MAJOR_IN_MKDEV */
+
+// Define to 1 if `major', `minor', and `makedev' are declared in <sysmacros.h>
+/* #undef MAJOR_IN_SYSMACROS */
+
+// Define to 1 if your C compiler doesn't accept -c and -o together
+/* #undef NO_MINUS_C_MINUS_O */
+
+// Define to the address where bug reports for this package should be sent
+#define PACKAGE_BUGREPORT ""
+
+// Define to the full name of this package
+#define PACKAGE_NAME "bareos"
+
+// Define to the full name and version of this package
+#define PACKAGE_STRING "bareos 19.1.2"
+
+// Define to the one symbol short name of this package
+#define PACKAGE_TARNAME ""
+
+// Define to the home page for this package
+#define PACKAGE_URL ""
+
+// Define to the version of this package
+#define PACKAGE_VERSION "19.1.2"
+
+// Define if <inttypes.h> exists and defines unusable PRI* macros
+/* #undef PRI_MACROS_BROKEN */
+
+// Define if you need function prototypes
+#define PROTOTYPES 1
+
+// Define as the return type of signal handlers (`int' or `void')
+#define RETSIGTYPE void
+
+// Define to 1 if the `setpgrp' function takes no argument
+#define SETPGRP_VOID 1
+
+// The size of `char', as computed by sizeof
+#define SIZEOF_CHAR 1
+
+// The size of `int', as computed by sizeof
+#define SIZEOF_INT 4
+
+// The size of `int *', as computed by sizeof
+#define SIZEOF_INT_P 8
+
+// The size of `long int', as computed by sizeof
+#define SIZEOF_LONG_INT 8
+
+// The size of `long long int', as computed by sizeof
+#define SIZEOF_LONG_LONG_INT 8
+
+// The size of `short int', as computed by sizeof
+#define SIZEOF_SHORT_INT 2
+
+/* Define as the maximum value of type 'size_t', if the system doesn't define
+   it */
+/* #undef SIZE_MAX */
+
+// Define to 1 if you want Smartalloc enabled
+/* #undef SMARTALLOC */
+
+/* If using the C implementation of alloca, define if you know the
+   direction of stack growth for your system; otherwise it will be
+   automatically deduced at runtime
+	STACK_DIRECTION > 0 => grows toward higher addresses
+	STACK_DIRECTION < 0 => grows toward lower addresses
+	STACK_DIRECTION = 0 => direction of growth unknown */
+/* #undef STACK_DIRECTION */
+
+// Define to 1 if the `S_IS*' macros in <sys/stat.h> do not work properly
+/* #undef STAT_MACROS_BROKEN */
+
+// Define to 1 if you have the ANSI C header files
+#define STDC_HEADERS 1
+
+// Where are system config files stored
+#define SYSCONFDIR "/usr/local/etc"
+
+// Define to 1 if you can safely include both <sys/time.h> and <time.h>
+/* #undef TIME_WITH_SYS_TIME */
+
+// Define to 1 if your <sys/time.h> declares `struct tm'
+/* #undef TM_IN_SYS_TIME */
+
+// Define to 1 if DB batch insert code enabled
+#define USE_BATCH_FILE_INSERT 1
+
+// Define to 1 to use the thr_setconcurrency function
+/* #undef USE_THR_SETCONCURRENCY */
+
+/* Define WORDS_BIGENDIAN to 1 if your processor stores words with the most
+   significant byte first (like Motorola and SPARC, unlike Intel) */
+#if defined AC_APPLE_UNIVERSAL_BUILD
+# if defined __BIG_ENDIAN__
+#  define WORDS_BIGENDIAN 1
+# endif
+#else
+# ifndef WORDS_BIGENDIAN
+#  undef WORDS_BIGENDIAN
+# endif
+#endif
+
+// Define to 1 if the X Window System is missing or not being used
+/* #undef X_DISPLAY_MISSING */
+
+// Number of bits in a file offset, on hosts where this is settable
+#define _FILE_OFFSET_BITS 64
+
+// Needed on HP-UX/g++ systems to support long long ints (int64)
+/* #undef _INCLUDE_LONGLONG */
+
+// Define to make fseeko etc. visible, on some hosts
+#define _LARGEFILE_SOURCE 1
+
+// Define for large files, on AIX-style hosts
+#define _LARGE_FILES 1
+
+// Directory for backend files
+#define _PATH_BAREOS_BACKENDDIR "/usr/local/lib/bareos/backends"
+
+// Directory for PID files
+#define _PATH_BAREOS_PIDDIR "/var/lib/bareos"
+
+// Directory for daemon files
+#define _PATH_BAREOS_WORKINGDIR "/var/lib/bareos"
+
+// Define to empty if `const' does not conform to ANSI C
+/* #undef const */
+
+// Define to `long' if <sys/types.h> does not define
+/* #undef daddr_t */
+
+// Define to `unsigned long' if <sys/types.h> does not define
+/* #undef dev_t */
+
+// Define to `int' if <sys/types.h> doesn't define
+/* #undef gid_t */
+
+/* Define to `__inline__' or `__inline' if that's what the C compiler
+   calls it, or to nothing if 'inline' is not supported under any name.  */
+#ifndef __cplusplus
+# undef inline
+#endif
+
+// Define to `unsigned long' if <sys/types.h> does not define
+/* #undef ino_t */
+
+/* Define to the type of a signed integer type wide enough to hold a pointer,
+   if such a type exists, and if the system does not define it */
+/* #undef intptr_t */
+
+// Set to correct scanf value for long long int
+#define lld "lld"
+
+// Set to correct scanf value for long long unsigned int
+#define llu "llu"
+
+// Define to `int' if <sys/types.h> does not define
+/* #undef major_t */
+
+// Define to `int' if <sys/types.h> does not define
+/* #undef minor_t */
+
+// Define to `int' if <sys/types.h> does not define
+/* #undef mode_t */
+
+// Define to `long int' if <sys/types.h> does not define
+/* #undef off_t */
+
+// Define to `int' if <sys/types.h> does not define
+/* #undef pid_t */
+
+/* Define as the type of the result of subtracting two pointers, if the system
+   doesn't define it */
+/* #undef ptrdiff_t */
+
+// Define to empty if the C compiler doesn't support this keyword
+/* #undef signed */
+
+// Define to `unsigned int' if <sys/types.h> does not define
+/* #undef size_t */
+
+// Define to `int' if <sys/types.h> does not define
+/* #undef ssize_t */
+
+// Define to `int' if <sys/types.h> doesn't define
+/* #undef uid_t */
+
+/* Define to unsigned long or unsigned long long if <stdint.h> and
+   <inttypes.h> don't define */
+/* #undef uintmax_t */
+
+/* Define to the type of an unsigned integer type wide enough to hold a
+   pointer, if such a type exists, and if the system does not define it */
+/* #undef uintptr_t */
+
+    // clang-format on
@@ -0,0 +1,40 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2000-2010 Free Software Foundation Europe e.V.
+   Copyright (C) 2011-2012 Planets Communications B.V.
+   Copyright (C) 2013-2013 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Define Host machine
+ */
+#define HOST_OS "Linux-6.18.44-fc-v139"
+#define BAREOS "Bareos"
+#define DISTNAME "debian"
+#define DISTVER "Debian GNU/Linux 12 (bookworm)"
+#define HELPDIR "default_for_htmldir"
+
+#define FD_DEFAULT_PORT "9102"
+#define SD_DEFAULT_PORT "9103"
+#define DIR_DEFAULT_PORT "9101"
+#define NDMP_DEFAULT_PORT "10000"
+
+#define OBS_PROJECT ""
+#define OBS_DISTRIBUTION ""
+#define OBS_ARCH ""
+#define OBS_SRCMD5 ""
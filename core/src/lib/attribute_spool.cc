@@ -0,0 +1,292 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation, which is
+   listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Reading and writing of LZ4 framed attribute spool files.
+ */
+
+#include "include/bareos.h"
+#include "lib/attribute_spool.h"
+#include "fastlz/lz4.h"
+
+static const uint32_t frame_header_length = 3 * sizeof(int32_t);
+
+/*
+ * Upper limit for a single frame, protects the reader against garbage.
+ */
+static const uint32_t max_frame_length = 1024 * 1024 * 1024;
+
+static bool WriteFully(int fd, const char* buf, size_t len)
+{
+  ssize_t status;
+
+  while (len > 0) {
+    status = write(fd, buf, len);
+    if (status < 0) {
+      if (errno == EINTR) { continue; }
+      return false;
+    }
+    if (status == 0) {
+      errno = ENOSPC;
+      return false;
+    }
+    buf += status;
+    len -= status;
+  }
+
+  return true;
+}
+
+/*
+ * Returns the number of bytes read which is only less than len at the
+ * end of the file or -1 on error.
+ */
+static ssize_t ReadFully(int fd, char* buf, size_t len)
+{
+  ssize_t status;
+  size_t total = 0;
+
+  while (total < len) {
+    status = read(fd, buf + total, len - total);
+    if (status < 0) {
+      if (errno == EINTR) { continue; }
+      return -1;
+    }
+    if (status == 0) { break; }
+    total += status;
+  }
+
+  return total;
+}
+
+AttributeSpoolWriter::AttributeSpoolWriter(int fd, uint32_t frame_size)
+    : fd_(fd)
+    , frame_size_(frame_size)
+    , frame_(GetPoolMemory(PM_MESSAGE))
+    , compressed_(GetPoolMemory(PM_MESSAGE))
+{
+}
+
+AttributeSpoolWriter::~AttributeSpoolWriter()
+{
+  FreePoolMemory(frame_);
+  FreePoolMemory(compressed_);
+}
+
+/**
+ * Add a message to the current frame, the frame is written to the
+ * file once it is full. A message larger than the frame size gets
+ * a frame of its own.
+ */
+bool AttributeSpoolWriter::Append(const char* msg, int32_t message_length)
+{
+  int32_t pktsiz;
+  uint32_t packet_length = sizeof(int32_t);
+
+  if (message_length > 0) { packet_length += message_length; }
+
+  if (frame_len_ > 0 && frame_len_ + packet_length > frame_size_) {
+    if (!Flush()) { return false; }
+  }
+
+  frame_ = CheckPoolMemorySize(frame_, frame_len_ + packet_length);
+  pktsiz = htonl(message_length);
+  memcpy(frame_ + frame_len_, &pktsiz, sizeof(int32_t));
+  if (message_length > 0) {
+    memcpy(frame_ + frame_len_ + sizeof(int32_t), msg, message_length);
+  }
+  frame_len_ += packet_length;
+  raw_bytes_ += packet_length;
+
+  if (frame_len_ >= frame_size_) { return Flush(); }
+
+  return true;
+}
+
+/**
+ * Compress the current frame and write it to the spool file.
+ */
+bool AttributeSpoolWriter::Flush()
+{
+  int bound, comp_len;
+  int32_t header[3];
+
+  if (frame_len_ == 0) { return true; }
+
+  bound = LZ4_compressBound(frame_len_);
+  compressed_ = CheckPoolMemorySize(compressed_, frame_header_length + bound);
+  comp_len = LZ4_compress_limitedOutput(
+      frame_, compressed_ + frame_header_length, frame_len_, bound);
+  if (comp_len <= 0) {
+    errno = EINVAL;
+    return false;
+  }
+
+  header[0] = htonl(kAttributeSpoolFrameMagic);
+  header[1] = htonl(frame_len_);
+  header[2] = htonl(comp_len);
+  memcpy(compressed_, header, frame_header_length);
+
+  if (!WriteFully(fd_, compressed_, frame_header_length + comp_len)) {
+    return false;
+  }
+  Dmsg2(400, "Wrote attribute spool frame raw=%u compressed=%d\n", frame_len_,
+        comp_len);
+  frame_len_ = 0;
+
+  return true;
+}
+
+/**
+ * Forget about all data, used after the spool file was truncated.
+ */
+void AttributeSpoolWriter::Reset()
+{
+  frame_len_ = 0;
+  raw_bytes_ = 0;
+}
+
+AttributeSpoolReader::AttributeSpoolReader(int fd)
+    : fd_(fd)
+    , frame_(GetPoolMemory(PM_MESSAGE))
+    , compressed_(GetPoolMemory(PM_MESSAGE))
+{
+}
+
+AttributeSpoolReader::~AttributeSpoolReader()
+{
+  FreePoolMemory(frame_);
+  FreePoolMemory(compressed_);
+}
+
+/**
+ * Read the remainder of a frame whose magic was already read
+ * and decompress it.
+ */
+bool AttributeSpoolReader::ReadFrame()
+{
+  int32_t header[2];
+  uint32_t raw_len, comp_len;
+  int status;
+
+  if (ReadFully(fd_, (char*)header, sizeof(header)) != sizeof(header)) {
+    if (errno == 0) { errno = EINVAL; }
+    return false;
+  }
+  raw_len = ntohl(header[0]);
+  comp_len = ntohl(header[1]);
+  if (raw_len > max_frame_length || comp_len > max_frame_length) {
+    errno = EINVAL;
+    return false;
+  }
+
+  compressed_ = CheckPoolMemorySize(compressed_, comp_len);
+  if (ReadFully(fd_, compressed_, comp_len) != (ssize_t)comp_len) {
+    if (errno == 0) { errno = EINVAL; }
+    return false;
+  }
+
+  frame_ = CheckPoolMemorySize(frame_, raw_len);
+  status = LZ4_decompress_safe(compressed_, frame_, comp_len, raw_len);
+  if (status < 0 || (uint32_t)status != raw_len) {
+    errno = EINVAL;
+    return false;
+  }
+  frame_len_ = raw_len;
+  frame_pos_ = 0;
+
+  return true;
+}
+
+int AttributeSpoolReader::NextFromFrame(POOLMEM*& msg, int32_t& message_length)
+{
+  int32_t pktsiz;
+
+  if (frame_len_ - frame_pos_ < sizeof(int32_t)) {
+    errno = EINVAL;
+    return -1;
+  }
+  memcpy(&pktsiz, frame_ + frame_pos_, sizeof(int32_t));
+  frame_pos_ += sizeof(int32_t);
+  message_length = ntohl(pktsiz);
+
+  if (message_length > 0) {
+    if ((uint32_t)message_length > frame_len_ - frame_pos_) {
+      errno = EINVAL;
+      return -1;
+    }
+    msg = CheckPoolMemorySize(msg, message_length + 1);
+    memcpy(msg, frame_ + frame_pos_, message_length);
+    msg[message_length] = '\0';
+    frame_pos_ += message_length;
+    raw_bytes_ += message_length;
+  }
+  raw_bytes_ += sizeof(int32_t);
+
+  return 1;
+}
+
+/**
+ * Get the next message from the spool file.
+ *
+ * Returns:  1 when a message was returned in msg and message_length
+ *           0 at the end of the spool file
+ *          -1 on error with errno set
+ */
+int AttributeSpoolReader::Next(POOLMEM*& msg, int32_t& message_length)
+{
+  int32_t pktsiz;
+  ssize_t nbytes;
+
+  errno = 0;
+  while (frame_pos_ >= frame_len_) {
+    nbytes = ReadFully(fd_, (char*)&pktsiz, sizeof(int32_t));
+    if (nbytes == 0) { return 0; }
+    if (nbytes != sizeof(int32_t)) {
+      if (errno == 0) { errno = EINVAL; }
+      return -1;
+    }
+
+    message_length = ntohl(pktsiz);
+    if (message_length == kAttributeSpoolFrameMagic) {
+      if (!ReadFrame()) { return -1; }
+      continue;
+    }
+
+    /*
+     * A plain message as written by older versions.
+     */
+    if (message_length > 0) {
+      msg = CheckPoolMemorySize(msg, message_length + 1);
+      if (ReadFully(fd_, msg, message_length) != message_length) {
+        if (errno == 0) { errno = EINVAL; }
+        return -1;
+      }
+      msg[message_length] = '\0';
+      raw_bytes_ += message_length;
+    }
+    raw_bytes_ += sizeof(int32_t);
+
+    return 1;
+  }
+
+  return NextFromFrame(msg, message_length);
+}
@@ -0,0 +1,97 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation, which is
+   listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Reading and writing of attribute spool files.
+ *
+ * An attribute spool file holds the messages the Storage daemon would
+ * otherwise have sent to the Director, each one prefixed by its length in
+ * network byte order just like on the wire. The messages are collected into
+ * frames which are LZ4 compressed before they are written to the file:
+ *
+ *   int32_t  magic       kAttributeSpoolFrameMagic
+ *   uint32_t raw_len     length of the uncompressed frame
+ *   uint32_t comp_len    length of the compressed data that follows
+ *
+ * All header fields are in network byte order. A reader also accepts the
+ * plain uncompressed messages written by older Storage daemons.
+ */
+
+#ifndef BAREOS_LIB_ATTRIBUTE_SPOOL_H_
+#define BAREOS_LIB_ATTRIBUTE_SPOOL_H_ 1
+
+/*
+ * Never a valid message length nor one of the BNET signals.
+ */
+static const int32_t kAttributeSpoolFrameMagic = (int32_t)0xB1A54F01;
+
+/*
+ * Uncompressed size after which a frame is compressed and written.
+ */
+static const uint32_t kAttributeSpoolFrameSize = 256 * 1024;
+
+class AttributeSpoolWriter {
+ public:
+  explicit AttributeSpoolWriter(int fd,
+                                uint32_t frame_size = kAttributeSpoolFrameSize);
+  ~AttributeSpoolWriter();
+
+  bool Append(const char* msg, int32_t message_length);
+  bool Flush();
+  void Reset();
+  uint64_t RawBytes() const { return raw_bytes_; }
+
+  AttributeSpoolWriter(const AttributeSpoolWriter& other) = delete;
+  AttributeSpoolWriter& operator=(const AttributeSpoolWriter& rhs) = delete;
+
+ private:
+  int fd_;
+  uint32_t frame_size_;
+  POOLMEM* frame_;
+  uint32_t frame_len_ = 0;
+  POOLMEM* compressed_;
+  uint64_t raw_bytes_ = 0; /**< Uncompressed bytes appended since Reset() */
+};
+
+class AttributeSpoolReader {
+ public:
+  explicit AttributeSpoolReader(int fd);
+  ~AttributeSpoolReader();
+
+  int Next(POOLMEM*& msg, int32_t& message_length);
+  uint64_t RawBytes() const { return raw_bytes_; }
+
+  AttributeSpoolReader(const AttributeSpoolReader& other) = delete;
+  AttributeSpoolReader& operator=(const AttributeSpoolReader& rhs) = delete;
+
+ private:
+  int fd_;
+  POOLMEM* frame_;
+  uint32_t frame_len_ = 0;
+  uint32_t frame_pos_ = 0;
+  POOLMEM* compressed_;
+  uint64_t raw_bytes_ = 0; /**< Uncompressed bytes returned so far */
+
+  bool ReadFrame();
+  int NextFromFrame(POOLMEM*& msg, int32_t& message_length);
+};
+
+#endif /* BAREOS_LIB_ATTRIBUTE_SPOOL_H_ */
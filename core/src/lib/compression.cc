@@ -44,6 +44,10 @@
 #include <lzo/lzo1x.h>
 #endif
 
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
 #include "fastlz/fastlzlib.h"
 
 #ifdef HAVE_LIBZ
@@ -66,6 +70,8 @@ const char* cmprs_algo_to_text(uint32_t compression_algorithm)
       return "LZ4";
     case COMPRESS_FZ4H:
       return "LZ4HC";
+    case COMPRESS_ZSTD:
+      return "ZSTD";
     default:
       return "Unknown";
   }
@@ -113,6 +119,7 @@ static inline void NonCompatibleCompressionAlgorithm(
 }
 
 bool SetupCompressionBuffers(JobControlRecord* jcr,
+                             CompressionContext* compress,
                              bool compatible,
                              uint32_t compression_algorithm,
                              uint32_t* compress_buf_size)
@@ -152,7 +159,7 @@ bool SetupCompressionBuffers(JobControlRecord* jcr,
       /*
        * See if this compression algorithm is already setup.
        */
-      if (jcr->compress.workset.pZLIB) { return true; }
+      if (compress->workset.pZLIB) { return true; }
 
       pZlibStream = (z_stream*)malloc(sizeof(z_stream));
       memset(pZlibStream, 0, sizeof(z_stream));
@@ -162,7 +169,7 @@ bool SetupCompressionBuffers(JobControlRecord* jcr,
       pZlibStream->state = Z_NULL;
 
       if (deflateInit(pZlibStream, Z_DEFAULT_COMPRESSION) == Z_OK) {
-        jcr->compress.workset.pZLIB = pZlibStream;
+        compress->workset.pZLIB = pZlibStream;
       } else {
         Jmsg(jcr, M_FATAL, 0, _("Failed to initialize ZLIB compression\n"));
         free(pZlibStream);
@@ -193,13 +200,13 @@ bool SetupCompressionBuffers(JobControlRecord* jcr,
       /*
        * See if this compression algorithm is already setup.
        */
-      if (jcr->compress.workset.pLZO) { return true; }
+      if (compress->workset.pLZO) { return true; }
 
       pLzoMem = (lzo_voidp)malloc(LZO1X_1_MEM_COMPRESS);
       memset(pLzoMem, 0, LZO1X_1_MEM_COMPRESS);
 
       if (lzo_init() == LZO_E_OK) {
-        jcr->compress.workset.pLZO = pLzoMem;
+        compress->workset.pLZO = pLzoMem;
       } else {
         Jmsg(jcr, M_FATAL, 0, _("Failed to initialize LZO compression\n"));
         free(pLzoMem);
@@ -243,7 +250,7 @@ bool SetupCompressionBuffers(JobControlRecord* jcr,
       /*
        * See if this compression algorithm is already setup.
        */
-      if (jcr->compress.workset.pZFAST) { return true; }
+      if (compress->workset.pZFAST) { return true; }
 
       pZfastStream = (zfast_stream*)malloc(sizeof(zfast_stream));
       memset(pZfastStream, 0, sizeof(zfast_stream));
@@ -253,7 +260,7 @@ bool SetupCompressionBuffers(JobControlRecord* jcr,
       pZfastStream->state = Z_NULL;
 
       if ((zstat = fastlzlibCompressInit(pZfastStream, level)) == Z_OK) {
-        jcr->compress.workset.pZFAST = pZfastStream;
+        compress->workset.pZFAST = pZfastStream;
       } else {
         Jmsg(jcr, M_FATAL, 0, _("Failed to initialize FASTLZ compression\n"));
         free(pZfastStream);
@@ -261,6 +268,42 @@ bool SetupCompressionBuffers(JobControlRecord* jcr,
       }
       break;
     }
+#ifdef HAVE_ZSTD
+    case COMPRESS_ZSTD: {
+      ZSTD_CCtx* pZstdCtx;
+
+      if (compatible) {
+        NonCompatibleCompressionAlgorithm(jcr, compression_algorithm);
+        return false;
+      }
+
+      /*
+       * ZSTD_compressBound() gives the worst case size of compressing a
+       * buffer of x bytes in a single frame.
+       *
+       * The ZSTD compression context is initialized here to minimize the
+       * "per file" load, the compression level is set per file.
+       */
+      wanted_compress_buf_size = ZSTD_compressBound(jcr->buf_size) +
+                                 (int)sizeof(comp_stream_header);
+      if (wanted_compress_buf_size > *compress_buf_size) {
+        *compress_buf_size = wanted_compress_buf_size;
+      }
+
+      /*
+       * See if this compression algorithm is already setup.
+       */
+      if (compress->workset.pZSTD) { return true; }
+
+      pZstdCtx = ZSTD_createCCtx();
+      if (!pZstdCtx) {
+        Jmsg(jcr, M_FATAL, 0, _("Failed to initialize ZSTD compression\n"));
+        return false;
+      }
+      compress->workset.pZSTD = pZstdCtx;
+      break;
+    }
+#endif
     default:
       UnknownCompressionAlgorithm(jcr, compression_algorithm);
       return false;
@@ -270,6 +313,7 @@ bool SetupCompressionBuffers(JobControlRecord* jcr,
 }
 
 bool SetupDecompressionBuffers(JobControlRecord* jcr,
+                               CompressionContext* compress,
                                uint32_t* decompress_buf_size)
 {
   uint32_t compress_buf_size;
@@ -285,7 +329,7 @@ bool SetupDecompressionBuffers(JobControlRecord* jcr,
       compress_buf_size + 12 + ((compress_buf_size + 999) / 1000) + 100;
 
 #ifdef HAVE_LZO
-  if (!jcr->compress.inflate_buffer && lzo_init() != LZO_E_OK) {
+  if (!compress->inflate_buffer && lzo_init() != LZO_E_OK) {
     Jmsg(jcr, M_FATAL, 0, _("LZO init failed\n"));
     return false;
   }
@@ -296,6 +340,7 @@ bool SetupDecompressionBuffers(JobControlRecord* jcr,
 
 #ifdef HAVE_LIBZ
 static bool compress_with_zlib(JobControlRecord* jcr,
+                               CompressionContext* compress,
                                char* rbuf,
                                uint32_t rsize,
                                unsigned char* cbuf,
@@ -307,7 +352,7 @@ static bool compress_with_zlib(JobControlRecord* jcr,
 
   Dmsg3(400, "cbuf=0x%x rbuf=0x%x len=%u\n", cbuf, rbuf, rsize);
 
-  pZlibStream = (z_stream*)jcr->compress.workset.pZLIB;
+  pZlibStream = (z_stream*)compress->workset.pZLIB;
   pZlibStream->next_in = (Bytef*)rbuf;
   pZlibStream->avail_in = rsize;
   pZlibStream->next_out = (Bytef*)cbuf;
@@ -339,6 +384,7 @@ static bool compress_with_zlib(JobControlRecord* jcr,
 
 #ifdef HAVE_LZO
 static bool compress_with_lzo(JobControlRecord* jcr,
+                              CompressionContext* compress,
                               char* rbuf,
                               uint32_t rsize,
                               unsigned char* cbuf,
@@ -351,7 +397,7 @@ static bool compress_with_lzo(JobControlRecord* jcr,
   Dmsg3(400, "cbuf=0x%x rbuf=0x%x len=%u\n", cbuf, rbuf, rsize);
 
   lzores = lzo1x_1_compress((const unsigned char*)rbuf, rsize, cbuf, &len,
-                            jcr->compress.workset.pLZO);
+                            compress->workset.pLZO);
   *compress_len = len;
 
   if (lzores != LZO_E_OK || *compress_len > max_compress_len) {
@@ -371,6 +417,7 @@ static bool compress_with_lzo(JobControlRecord* jcr,
 #endif
 
 static bool compress_with_fastlz(JobControlRecord* jcr,
+                                 CompressionContext* compress,
                                  char* rbuf,
                                  uint32_t rsize,
                                  unsigned char* cbuf,
@@ -382,7 +429,7 @@ static bool compress_with_fastlz(JobControlRecord* jcr,
 
   Dmsg3(400, "cbuf=0x%x rbuf=0x%x len=%u\n", cbuf, rbuf, rsize);
 
-  pZfastStream = (zfast_stream*)jcr->compress.workset.pZFAST;
+  pZfastStream = (zfast_stream*)compress->workset.pZFAST;
   pZfastStream->next_in = (Bytef*)rbuf;
   pZfastStream->avail_in = rsize;
   pZfastStream->next_out = (Bytef*)cbuf;
@@ -413,7 +460,39 @@ static bool compress_with_fastlz(JobControlRecord* jcr,
   return true;
 }
 
+#ifdef HAVE_ZSTD
+static bool compress_with_zstd(JobControlRecord* jcr,
+                               CompressionContext* compress,
+                               char* rbuf,
+                               uint32_t rsize,
+                               unsigned char* cbuf,
+                               uint32_t max_compress_len,
+                               uint32_t* compress_len)
+{
+  size_t zstat;
+
+  Dmsg3(400, "cbuf=0x%x rbuf=0x%x len=%u\n", cbuf, rbuf, rsize);
+
+  zstat = ZSTD_compress2((ZSTD_CCtx*)compress->workset.pZSTD, cbuf,
+                         max_compress_len, rbuf, rsize);
+  if (ZSTD_isError(zstat)) {
+    Jmsg(jcr, M_FATAL, 0, _("Compression ZSTD error: %s\n"),
+         ZSTD_getErrorName(zstat));
+    jcr->setJobStatus(JS_ErrorTerminated);
+    return false;
+  }
+
+  *compress_len = zstat;
+
+  Dmsg2(400, "ZSTD compressed len=%d uncompressed len=%d\n", *compress_len,
+        rsize);
+
+  return true;
+}
+#endif
+
 bool CompressData(JobControlRecord* jcr,
+                  CompressionContext* compress,
                   uint32_t compression_algorithm,
                   char* rbuf,
                   uint32_t rsize,
@@ -425,9 +504,9 @@ bool CompressData(JobControlRecord* jcr,
   switch (compression_algorithm) {
 #ifdef HAVE_LIBZ
     case COMPRESS_GZIP:
-      if (jcr->compress.workset.pZLIB) {
-        if (!compress_with_zlib(jcr, rbuf, rsize, cbuf, max_compress_len,
-                                compress_len)) {
+      if (compress->workset.pZLIB) {
+        if (!compress_with_zlib(jcr, compress, rbuf, rsize, cbuf,
+                                max_compress_len, compress_len)) {
           return false;
         }
       }
@@ -435,9 +514,9 @@ bool CompressData(JobControlRecord* jcr,
 #endif
 #ifdef HAVE_LZO
     case COMPRESS_LZO1X:
-      if (jcr->compress.workset.pLZO) {
-        if (!compress_with_lzo(jcr, rbuf, rsize, cbuf, max_compress_len,
-                               compress_len)) {
+      if (compress->workset.pLZO) {
+        if (!compress_with_lzo(jcr, compress, rbuf, rsize, cbuf,
+                               max_compress_len, compress_len)) {
           return false;
         }
       }
@@ -446,13 +525,23 @@ bool CompressData(JobControlRecord* jcr,
     case COMPRESS_FZFZ:
     case COMPRESS_FZ4L:
     case COMPRESS_FZ4H:
-      if (jcr->compress.workset.pZFAST) {
-        if (!compress_with_fastlz(jcr, rbuf, rsize, cbuf, max_compress_len,
-                                  compress_len)) {
+      if (compress->workset.pZFAST) {
+        if (!compress_with_fastlz(jcr, compress, rbuf, rsize, cbuf,
+                                  max_compress_len, compress_len)) {
+          return false;
+        }
+      }
+      break;
+#ifdef HAVE_ZSTD
+    case COMPRESS_ZSTD:
+      if (compress->workset.pZSTD) {
+        if (!compress_with_zstd(jcr, compress, rbuf, rsize, cbuf,
+                                max_compress_len, compress_len)) {
           return false;
         }
       }
       break;
+#endif
     default:
       break;
   }
@@ -462,6 +551,7 @@ bool CompressData(JobControlRecord* jcr,
 
 #ifdef HAVE_LIBZ
 static bool decompress_with_zlib(JobControlRecord* jcr,
+                                 CompressionContext* compress,
                                  const char* last_fname,
                                  char** data,
                                  uint32_t* length,
@@ -481,11 +571,11 @@ static bool decompress_with_zlib(JobControlRecord* jcr,
    * be used in Bareos.
    */
   if (sparse && want_data_stream) {
-    wbuf = jcr->compress.inflate_buffer + OFFSET_FADDR_SIZE;
-    compress_len = jcr->compress.inflate_buffer_size - OFFSET_FADDR_SIZE;
+    wbuf = compress->inflate_buffer + OFFSET_FADDR_SIZE;
+    compress_len = compress->inflate_buffer_size - OFFSET_FADDR_SIZE;
   } else {
-    wbuf = jcr->compress.inflate_buffer;
-    compress_len = jcr->compress.inflate_buffer_size;
+    wbuf = compress->inflate_buffer;
+    compress_len = compress->inflate_buffer_size;
   }
 
   /*
@@ -507,18 +597,18 @@ static bool decompress_with_zlib(JobControlRecord* jcr,
     /*
      * The buffer size is too small, try with a bigger one
      */
-    jcr->compress.inflate_buffer_size =
-        jcr->compress.inflate_buffer_size +
-        (jcr->compress.inflate_buffer_size >> 1);
-    jcr->compress.inflate_buffer = CheckPoolMemorySize(
-        jcr->compress.inflate_buffer, jcr->compress.inflate_buffer_size);
+    compress->inflate_buffer_size =
+        compress->inflate_buffer_size +
+        (compress->inflate_buffer_size >> 1);
+    compress->inflate_buffer = CheckPoolMemorySize(
+        compress->inflate_buffer, compress->inflate_buffer_size);
 
     if (sparse && want_data_stream) {
-      wbuf = jcr->compress.inflate_buffer + OFFSET_FADDR_SIZE;
-      compress_len = jcr->compress.inflate_buffer_size - OFFSET_FADDR_SIZE;
+      wbuf = compress->inflate_buffer + OFFSET_FADDR_SIZE;
+      compress_len = compress->inflate_buffer_size - OFFSET_FADDR_SIZE;
     } else {
-      wbuf = jcr->compress.inflate_buffer;
-      compress_len = jcr->compress.inflate_buffer_size;
+      wbuf = compress->inflate_buffer;
+      compress_len = compress->inflate_buffer_size;
     }
     Dmsg2(400, "Comp_len=%d message_length=%d\n", compress_len, *length);
   }
@@ -534,10 +624,10 @@ static bool decompress_with_zlib(JobControlRecord* jcr,
    * was a sparse stream.
    */
   if (sparse && want_data_stream) {
-    memcpy(jcr->compress.inflate_buffer, *data, OFFSET_FADDR_SIZE);
+    memcpy(compress->inflate_buffer, *data, OFFSET_FADDR_SIZE);
   }
 
-  *data = jcr->compress.inflate_buffer;
+  *data = compress->inflate_buffer;
   *length = compress_len;
 
   Dmsg2(400, "Write uncompressed %d bytes, total before write=%s\n",
@@ -548,6 +638,7 @@ static bool decompress_with_zlib(JobControlRecord* jcr,
 #endif
 #ifdef HAVE_LZO
 static bool decompress_with_lzo(JobControlRecord* jcr,
+                                CompressionContext* compress,
                                 const char* last_fname,
                                 char** data,
                                 uint32_t* length,
@@ -561,14 +652,14 @@ static bool decompress_with_lzo(JobControlRecord* jcr,
   int status, real_compress_len;
 
   if (sparse && want_data_stream) {
-    compress_len = jcr->compress.inflate_buffer_size - OFFSET_FADDR_SIZE;
+    compress_len = compress->inflate_buffer_size - OFFSET_FADDR_SIZE;
     cbuf = (const unsigned char*)*data + OFFSET_FADDR_SIZE +
            sizeof(comp_stream_header);
-    wbuf = (unsigned char*)jcr->compress.inflate_buffer + OFFSET_FADDR_SIZE;
+    wbuf = (unsigned char*)compress->inflate_buffer + OFFSET_FADDR_SIZE;
   } else {
-    compress_len = jcr->compress.inflate_buffer_size;
+    compress_len = compress->inflate_buffer_size;
     cbuf = (const unsigned char*)*data + sizeof(comp_stream_header);
-    wbuf = (unsigned char*)jcr->compress.inflate_buffer;
+    wbuf = (unsigned char*)compress->inflate_buffer;
   }
 
   real_compress_len = *length - sizeof(comp_stream_header);
@@ -579,18 +670,18 @@ static bool decompress_with_lzo(JobControlRecord* jcr,
     /*
      * The buffer size is too small, try with a bigger one
      */
-    jcr->compress.inflate_buffer_size =
-        jcr->compress.inflate_buffer_size +
-        (jcr->compress.inflate_buffer_size >> 1);
-    jcr->compress.inflate_buffer = CheckPoolMemorySize(
-        jcr->compress.inflate_buffer, jcr->compress.inflate_buffer_size);
+    compress->inflate_buffer_size =
+        compress->inflate_buffer_size +
+        (compress->inflate_buffer_size >> 1);
+    compress->inflate_buffer = CheckPoolMemorySize(
+        compress->inflate_buffer, compress->inflate_buffer_size);
 
     if (sparse && want_data_stream) {
-      compress_len = jcr->compress.inflate_buffer_size - OFFSET_FADDR_SIZE;
-      wbuf = (unsigned char*)jcr->compress.inflate_buffer + OFFSET_FADDR_SIZE;
+      compress_len = compress->inflate_buffer_size - OFFSET_FADDR_SIZE;
+      wbuf = (unsigned char*)compress->inflate_buffer + OFFSET_FADDR_SIZE;
     } else {
-      compress_len = jcr->compress.inflate_buffer_size;
-      wbuf = (unsigned char*)jcr->compress.inflate_buffer;
+      compress_len = compress->inflate_buffer_size;
+      wbuf = (unsigned char*)compress->inflate_buffer;
     }
     Dmsg2(400, "Comp_len=%d message_length=%d\n", compress_len, *length);
   }
@@ -606,10 +697,10 @@ static bool decompress_with_lzo(JobControlRecord* jcr,
    * was a sparse stream.
    */
   if (sparse && want_data_stream) {
-    memcpy(jcr->compress.inflate_buffer, *data, OFFSET_FADDR_SIZE);
+    memcpy(compress->inflate_buffer, *data, OFFSET_FADDR_SIZE);
   }
 
-  *data = jcr->compress.inflate_buffer;
+  *data = compress->inflate_buffer;
   *length = compress_len;
 
   Dmsg2(400, "Write uncompressed %d bytes, total before write=%s\n",
@@ -620,6 +711,7 @@ static bool decompress_with_lzo(JobControlRecord* jcr,
 #endif
 
 static bool decompress_with_fastlz(JobControlRecord* jcr,
+                                   CompressionContext* compress,
                                    const char* last_fname,
                                    char** data,
                                    uint32_t* length,
@@ -648,12 +740,12 @@ static bool decompress_with_fastlz(JobControlRecord* jcr,
   stream.next_in = (Bytef*)*data + sizeof(comp_stream_header);
   stream.avail_in = (uInt)*length - sizeof(comp_stream_header);
   if (sparse && want_data_stream) {
-    stream.next_out = (Bytef*)jcr->compress.inflate_buffer + OFFSET_FADDR_SIZE;
+    stream.next_out = (Bytef*)compress->inflate_buffer + OFFSET_FADDR_SIZE;
     stream.avail_out =
-        (uInt)jcr->compress.inflate_buffer_size - OFFSET_FADDR_SIZE;
+        (uInt)compress->inflate_buffer_size - OFFSET_FADDR_SIZE;
   } else {
-    stream.next_out = (Bytef*)jcr->compress.inflate_buffer;
-    stream.avail_out = (uInt)jcr->compress.inflate_buffer_size;
+    stream.next_out = (Bytef*)compress->inflate_buffer;
+    stream.avail_out = (uInt)compress->inflate_buffer_size;
   }
 
   Dmsg2(400, "Comp_len=%d message_length=%d\n", stream.avail_in, *length);
@@ -671,19 +763,19 @@ static bool decompress_with_fastlz(JobControlRecord* jcr,
         /*
          * The buffer size is too small, try with a bigger one
          */
-        jcr->compress.inflate_buffer_size =
-            jcr->compress.inflate_buffer_size +
-            (jcr->compress.inflate_buffer_size >> 1);
-        jcr->compress.inflate_buffer = CheckPoolMemorySize(
-            jcr->compress.inflate_buffer, jcr->compress.inflate_buffer_size);
+        compress->inflate_buffer_size =
+            compress->inflate_buffer_size +
+            (compress->inflate_buffer_size >> 1);
+        compress->inflate_buffer = CheckPoolMemorySize(
+            compress->inflate_buffer, compress->inflate_buffer_size);
         if (sparse && want_data_stream) {
           stream.next_out =
-              (Bytef*)jcr->compress.inflate_buffer + OFFSET_FADDR_SIZE;
+              (Bytef*)compress->inflate_buffer + OFFSET_FADDR_SIZE;
           stream.avail_out =
-              (uInt)jcr->compress.inflate_buffer_size - OFFSET_FADDR_SIZE;
+              (uInt)compress->inflate_buffer_size - OFFSET_FADDR_SIZE;
         } else {
-          stream.next_out = (Bytef*)jcr->compress.inflate_buffer;
-          stream.avail_out = (uInt)jcr->compress.inflate_buffer_size;
+          stream.next_out = (Bytef*)compress->inflate_buffer;
+          stream.avail_out = (uInt)compress->inflate_buffer_size;
         }
         continue;
       case Z_OK:
@@ -700,10 +792,10 @@ static bool decompress_with_fastlz(JobControlRecord* jcr,
    * was a sparse stream.
    */
   if (sparse && want_data_stream) {
-    memcpy(jcr->compress.inflate_buffer, *data, OFFSET_FADDR_SIZE);
+    memcpy(compress->inflate_buffer, *data, OFFSET_FADDR_SIZE);
   }
 
-  *data = jcr->compress.inflate_buffer;
+  *data = compress->inflate_buffer;
   *length = stream.total_out;
   Dmsg2(400, "Write uncompressed %d bytes, total before write=%s\n", *length,
         edit_uint64(jcr->JobBytes, ec1));
@@ -719,7 +811,86 @@ cleanup:
   return false;
 }
 
+#ifdef HAVE_ZSTD
+static bool decompress_with_zstd(JobControlRecord* jcr,
+                                 CompressionContext* compress,
+                                 const char* last_fname,
+                                 char** data,
+                                 uint32_t* length,
+                                 bool sparse,
+                                 bool want_data_stream)
+{
+  char ec1[50]; /* Buffer printing huge values */
+  const char* cbuf;
+  char* wbuf;
+  uint32_t real_compress_len, offset;
+  unsigned long long content_size;
+  size_t zstat;
+
+  if (!compress->workset.pZSTDD) {
+    compress->workset.pZSTDD = ZSTD_createDCtx();
+    if (!compress->workset.pZSTDD) {
+      Qmsg(jcr, M_ERROR, 0, _("Failed to initialize ZSTD decompression\n"));
+      return false;
+    }
+  }
+
+  cbuf = *data + sizeof(comp_stream_header);
+  real_compress_len = *length - sizeof(comp_stream_header);
+  offset = (sparse && want_data_stream) ? OFFSET_FADDR_SIZE : 0;
+
+  /*
+   * The frame header holds the size of the uncompressed data so the
+   * inflate buffer can be grown in advance when a record was compressed
+   * with a bigger buffer size than we use.
+   */
+  content_size = ZSTD_getFrameContentSize(cbuf, real_compress_len);
+  if (content_size == ZSTD_CONTENTSIZE_ERROR) {
+    Qmsg(jcr, M_ERROR, 0,
+         _("ZSTD uncompression error on file %s. ERR=Invalid frame\n"),
+         last_fname);
+    return false;
+  }
+  if (content_size != ZSTD_CONTENTSIZE_UNKNOWN &&
+      content_size + offset > compress->inflate_buffer_size) {
+    compress->inflate_buffer_size = content_size + offset;
+    compress->inflate_buffer = CheckPoolMemorySize(
+        compress->inflate_buffer, compress->inflate_buffer_size);
+  }
+  wbuf = compress->inflate_buffer + offset;
+
+  Dmsg2(400, "Comp_len=%d message_length=%d\n",
+        compress->inflate_buffer_size - offset, *length);
+
+  zstat = ZSTD_decompressDCtx((ZSTD_DCtx*)compress->workset.pZSTDD, wbuf,
+                              compress->inflate_buffer_size - offset, cbuf,
+                              real_compress_len);
+  if (ZSTD_isError(zstat)) {
+    Qmsg(jcr, M_ERROR, 0, _("ZSTD uncompression error on file %s. ERR=%s\n"),
+         last_fname, ZSTD_getErrorName(zstat));
+    return false;
+  }
+
+  /*
+   * We return a decompressed data stream with the fileoffset encoded when this
+   * was a sparse stream.
+   */
+  if (sparse && want_data_stream) {
+    memcpy(compress->inflate_buffer, *data, OFFSET_FADDR_SIZE);
+  }
+
+  *data = compress->inflate_buffer;
+  *length = zstat;
+
+  Dmsg2(400, "Write uncompressed %d bytes, total before write=%s\n", *length,
+        edit_uint64(jcr->JobBytes, ec1));
+
+  return true;
+}
+#endif
+
 bool DecompressData(JobControlRecord* jcr,
+                    CompressionContext* compress,
                     const char* last_fname,
                     int32_t stream,
                     char** data,
@@ -781,22 +952,23 @@ bool DecompressData(JobControlRecord* jcr,
         case COMPRESS_GZIP:
           switch (stream) {
             case STREAM_SPARSE_COMPRESSED_DATA:
-              return decompress_with_zlib(jcr, last_fname, data, length, true,
-                                          true, want_data_stream);
+              return decompress_with_zlib(jcr, compress, last_fname, data,
+                                          length, true, true, want_data_stream);
             default:
-              return decompress_with_zlib(jcr, last_fname, data, length, false,
-                                          true, want_data_stream);
+              return decompress_with_zlib(jcr, compress, last_fname, data,
+                                          length, false, true,
+                                          want_data_stream);
           }
 #endif
 #ifdef HAVE_LZO
         case COMPRESS_LZO1X:
           switch (stream) {
             case STREAM_SPARSE_COMPRESSED_DATA:
-              return decompress_with_lzo(jcr, last_fname, data, length, true,
-                                         want_data_stream);
+              return decompress_with_lzo(jcr, compress, last_fname, data,
+                                         length, true, want_data_stream);
             default:
-              return decompress_with_lzo(jcr, last_fname, data, length, false,
-                                         want_data_stream);
+              return decompress_with_lzo(jcr, compress, last_fname, data,
+                                         length, false, want_data_stream);
           }
 #endif
         case COMPRESS_FZFZ:
@@ -804,13 +976,25 @@ bool DecompressData(JobControlRecord* jcr,
         case COMPRESS_FZ4H:
           switch (stream) {
             case STREAM_SPARSE_COMPRESSED_DATA:
-              return decompress_with_fastlz(jcr, last_fname, data, length,
-                                            comp_magic, true, want_data_stream);
+              return decompress_with_fastlz(jcr, compress, last_fname, data,
+                                            length, comp_magic, true,
+                                            want_data_stream);
             default:
-              return decompress_with_fastlz(jcr, last_fname, data, length,
-                                            comp_magic, false,
+              return decompress_with_fastlz(jcr, compress, last_fname, data,
+                                            length, comp_magic, false,
                                             want_data_stream);
           }
+#ifdef HAVE_ZSTD
+        case COMPRESS_ZSTD:
+          switch (stream) {
+            case STREAM_SPARSE_COMPRESSED_DATA:
+              return decompress_with_zstd(jcr, compress, last_fname, data,
+                                          length, true, want_data_stream);
+            default:
+              return decompress_with_zstd(jcr, compress, last_fname, data,
+                                          length, false, want_data_stream);
+          }
+#endif
         default:
           Qmsg(jcr, M_ERROR, 0,
                _("Compression algorithm 0x%x found, but not supported!\n"),
@@ -823,11 +1007,11 @@ bool DecompressData(JobControlRecord* jcr,
 #ifdef HAVE_LIBZ
       switch (stream) {
         case STREAM_SPARSE_GZIP_DATA:
-          return decompress_with_zlib(jcr, last_fname, data, length, true,
-                                      false, want_data_stream);
+          return decompress_with_zlib(jcr, compress, last_fname, data, length,
+                                      true, false, want_data_stream);
         default:
-          return decompress_with_zlib(jcr, last_fname, data, length, false,
-                                      false, want_data_stream);
+          return decompress_with_zlib(jcr, compress, last_fname, data, length,
+                                      false, false, want_data_stream);
       }
 #else
       Qmsg(jcr, M_ERROR, 0,
@@ -837,38 +1021,93 @@ bool DecompressData(JobControlRecord* jcr,
   }
 }
 
-void CleanupCompression(JobControlRecord* jcr)
+void CleanupCompression(CompressionContext* compress)
 {
-  if (jcr->compress.deflate_buffer) {
-    FreePoolMemory(jcr->compress.deflate_buffer);
-    jcr->compress.deflate_buffer = NULL;
+  if (compress->deflate_buffer) {
+    FreePoolMemory(compress->deflate_buffer);
+    compress->deflate_buffer = NULL;
   }
 
-  if (jcr->compress.inflate_buffer) {
-    FreePoolMemory(jcr->compress.inflate_buffer);
-    jcr->compress.inflate_buffer = NULL;
+  if (compress->inflate_buffer) {
+    FreePoolMemory(compress->inflate_buffer);
+    compress->inflate_buffer = NULL;
   }
 
 #ifdef HAVE_LIBZ
-  if (jcr->compress.workset.pZLIB) {
+  if (compress->workset.pZLIB) {
     /*
      * Free the zlib stream
      */
-    deflateEnd((z_stream*)jcr->compress.workset.pZLIB);
-    free(jcr->compress.workset.pZLIB);
-    jcr->compress.workset.pZLIB = NULL;
+    deflateEnd((z_stream*)compress->workset.pZLIB);
+    free(compress->workset.pZLIB);
+    compress->workset.pZLIB = NULL;
   }
 #endif
 
 #ifdef HAVE_LZO
-  if (jcr->compress.workset.pLZO) {
-    free(jcr->compress.workset.pLZO);
-    jcr->compress.workset.pLZO = NULL;
+  if (compress->workset.pLZO) {
+    free(compress->workset.pLZO);
+    compress->workset.pLZO = NULL;
   }
 #endif
 
-  if (jcr->compress.workset.pZFAST) {
-    free(jcr->compress.workset.pZFAST);
-    jcr->compress.workset.pZFAST = NULL;
+  if (compress->workset.pZFAST) {
+    free(compress->workset.pZFAST);
+    compress->workset.pZFAST = NULL;
+  }
+
+#ifdef HAVE_ZSTD
+  if (compress->workset.pZSTD) {
+    ZSTD_freeCCtx((ZSTD_CCtx*)compress->workset.pZSTD);
+    compress->workset.pZSTD = NULL;
   }
+
+  if (compress->workset.pZSTDD) {
+    ZSTD_freeDCtx((ZSTD_DCtx*)compress->workset.pZSTDD);
+    compress->workset.pZSTDD = NULL;
+  }
+#endif
+}
+
+bool SetupCompressionBuffers(JobControlRecord* jcr,
+                             bool compatible,
+                             uint32_t compression_algorithm,
+                             uint32_t* compress_buf_size)
+{
+  return SetupCompressionBuffers(jcr, &jcr->compress, compatible,
+                                 compression_algorithm, compress_buf_size);
+}
+
+bool SetupDecompressionBuffers(JobControlRecord* jcr,
+                               uint32_t* decompress_buf_size)
+{
+  return SetupDecompressionBuffers(jcr, &jcr->compress, decompress_buf_size);
+}
+
+bool CompressData(JobControlRecord* jcr,
+                  uint32_t compression_algorithm,
+                  char* rbuf,
+                  uint32_t rsize,
+                  unsigned char* cbuf,
+                  uint32_t max_compress_len,
+                  uint32_t* compress_len)
+{
+  return CompressData(jcr, &jcr->compress, compression_algorithm, rbuf, rsize,
+                      cbuf, max_compress_len, compress_len);
+}
+
+bool DecompressData(JobControlRecord* jcr,
+                    const char* last_fname,
+                    int32_t stream,
+                    char** data,
+                    uint32_t* length,
+                    bool want_data_stream)
+{
+  return DecompressData(jcr, &jcr->compress, last_fname, stream, data, length,
+                        want_data_stream);
+}
+
+void CleanupCompression(JobControlRecord* jcr)
+{
+  CleanupCompression(&jcr->compress);
 }
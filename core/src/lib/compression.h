@@ -21,6 +21,8 @@
 #ifndef BAREOS_LIB_COMPRESSION_H_
 #define BAREOS_LIB_COMPRESSION_H_
 
+struct CompressionContext;
+
 const char* cmprs_algo_to_text(uint32_t compression_algorithm);
 bool SetupCompressionBuffers(JobControlRecord* jcr,
                              bool compatible,
@@ -43,4 +45,34 @@ bool DecompressData(JobControlRecord* jcr,
                     bool want_data_stream);
 void CleanupCompression(JobControlRecord* jcr);
 
+/*
+ * Variants working on a separate compression context, so more threads of a
+ * job can compress or decompress at the same time. The jcr is only used for
+ * its buffer size and for messages.
+ */
+bool SetupCompressionBuffers(JobControlRecord* jcr,
+                             CompressionContext* compress,
+                             bool compatible,
+                             uint32_t compression_algorithm,
+                             uint32_t* compress_buf_size);
+bool SetupDecompressionBuffers(JobControlRecord* jcr,
+                               CompressionContext* compress,
+                               uint32_t* decompress_buf_size);
+bool CompressData(JobControlRecord* jcr,
+                  CompressionContext* compress,
+                  uint32_t compression_algorithm,
+                  char* rbuf,
+                  uint32_t rsize,
+                  unsigned char* cbuf,
+                  uint32_t max_compress_len,
+                  uint32_t* compress_len);
+bool DecompressData(JobControlRecord* jcr,
+                    CompressionContext* compress,
+                    const char* last_fname,
+                    int32_t stream,
+                    char** data,
+                    uint32_t* length,
+                    bool want_data_stream);
+void CleanupCompression(CompressionContext* compress);
+
 #endif  // BAREOS_LIB_COMPRESSION_H_
@@ -295,6 +295,18 @@ storagedaemon::BootStrapRecord* parse_bsr(JobControlRecord* jcr, char* fname)
     FreeBsr(root_bsr);
     root_bsr = NULL;
   }
+  for (bsr = root_bsr; bsr; bsr = bsr->next) {
+    storagedaemon::BsrFileIndex *findex = bsr->FileIndex, *reversed = NULL;
+
+    while (findex) {
+      storagedaemon::BsrFileIndex* next = findex->next;
+
+      findex->next = reversed;
+      reversed = findex;
+      findex = next;
+    }
+    bsr->FileIndex = reversed;
+  }
   if (root_bsr) {
     root_bsr->use_fast_rejection = IsFastRejectionOk(root_bsr);
     root_bsr->use_positioning = IsPositioningOk(root_bsr);
@@ -482,18 +494,11 @@ static storagedaemon::BootStrapRecord* store_findex(
     findex->findex2 = lc->u2.pint32_val;
 
     /*
-     * Add it to the end of the chain
+     * Add it to the front of the chain, a bsr can have a huge number
+     * of FileIndex entries. parse_bsr() restores the order at the end.
      */
-    if (!bsr->FileIndex) {
-      bsr->FileIndex = findex;
-    } else {
-      /*
-       * Add to end of chain
-       */
-      storagedaemon::BsrFileIndex* bs = bsr->FileIndex;
-      for (; bs->next; bs = bs->next) {}
-      bs->next = findex;
-    }
+    findex->next = bsr->FileIndex;
+    bsr->FileIndex = findex;
     token = LexGetToken(lc, BCT_ALL);
     if (token != BCT_COMMA) { break; }
   }
@@ -980,9 +985,11 @@ void DumpBsr(storagedaemon::BootStrapRecord* bsr, bool recurse)
  */
 static inline void FreeBsrItem(storagedaemon::BootStrapRecord* bsr)
 {
-  if (bsr) {
-    FreeBsrItem(bsr->next);
+  while (bsr) {
+    storagedaemon::BootStrapRecord* next = bsr->next;
+
     free(bsr);
+    bsr = next;
   }
 }
 
@@ -1009,6 +1016,7 @@ static inline void RemoveBsr(storagedaemon::BootStrapRecord* bsr)
     free(bsr->fileregex_re);
   }
   if (bsr->attr) { FreeAttr(bsr->attr); }
+  if (bsr->compiled) { delete bsr->compiled; }
   if (bsr->next) { bsr->next->prev = bsr->prev; }
   if (bsr->prev) { bsr->prev->next = bsr->next; }
   free(bsr);
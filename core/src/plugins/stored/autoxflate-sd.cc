@@ -35,6 +35,16 @@
 
 #include "fastlz/fastlzlib.h"
 
+#if defined(HAVE_ZSTD)
+#include <zstd.h>
+#endif
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 using namespace storagedaemon;
 
 #define PLUGIN_LICENSE "Bareos AGPLv3"
@@ -58,6 +68,7 @@ using namespace storagedaemon;
 #define COMPRESSOR_NAME_FZLZ (char*)"FASTLZ"
 #define COMPRESSOR_NAME_FZ4L (char*)"LZ4"
 #define COMPRESSOR_NAME_FZ4H (char*)"LZ4HC"
+#define COMPRESSOR_NAME_ZSTD (char*)"ZSTD"
 #define COMPRESSOR_NAME_UNSET (char*)"unknown"
 
 /**
@@ -72,11 +83,27 @@ static bRC handleJobEnd(bpContext* ctx);
 static bRC setup_record_translation(bpContext* ctx, void* value);
 static bRC handle_read_translation(bpContext* ctx, void* value);
 static bRC handle_write_translation(bpContext* ctx, void* value);
+static bRC handle_flush_translation(bpContext* ctx, void* value);
 
 static bool SetupAutoDeflation(bpContext* ctx, DeviceControlRecord* dcr);
 static bool SetupAutoInflation(bpContext* ctx, DeviceControlRecord* dcr);
+static bool SetupDeflation(bpContext* ctx,
+                           DeviceControlRecord* dcr,
+                           CompressionContext* compress,
+                           const char** compressorname);
+static bool SetupInflation(bpContext* ctx,
+                           DeviceControlRecord* dcr,
+                           CompressionContext* compress);
 static bool AutoDeflateRecord(bpContext* ctx, DeviceControlRecord* dcr);
 static bool AutoInflateRecord(bpContext* ctx, DeviceControlRecord* dcr);
+static DeviceRecord* DeflateRecord(bpContext* ctx,
+                                   DeviceControlRecord* dcr,
+                                   CompressionContext* compress,
+                                   DeviceRecord* rec);
+static DeviceRecord* InflateRecord(bpContext* ctx,
+                                   DeviceControlRecord* dcr,
+                                   CompressionContext* compress,
+                                   DeviceRecord* rec);
 
 /**
  * Is the SD in compatible mode or not.
@@ -105,6 +132,8 @@ static psdFuncs pluginFuncs = {sizeof(pluginFuncs), SD_PLUGIN_INTERFACE_VERSION,
                                getPluginValue, setPluginValue,
                                handlePluginEvent};
 
+class TranslationPool;
+
 /**
  * Plugin private context
  */
@@ -116,6 +145,62 @@ struct plugin_ctx {
   uint64_t deflate_bytes_out;
   uint64_t inflate_bytes_in;
   uint64_t inflate_bytes_out;
+
+  /*
+   * Workers translating the records written by this job, when configured.
+   */
+  TranslationPool* pool;
+};
+
+/**
+ * Pool of worker threads translating the records written by a job.
+ *
+ * Every record handed to the write translation while the pool is busy is
+ * queued in order. Records that need to be deflated or inflated are
+ * translated by the workers out of order, each worker using its own
+ * compression context. The core fetches the records back in their original
+ * order with the bsdEventFlushRecordTranslation event and writes them to the
+ * block. When too many records are queued the job thread waits for the
+ * oldest one to be translated.
+ */
+class TranslationPool {
+ public:
+  TranslationPool(bpContext* ctx, DeviceControlRecord* dcr);
+  ~TranslationPool();
+
+  bool Start(int nr_workers);
+  bool Empty();
+  void Submit(DeviceRecord* rec, bool translate);
+  DeviceRecord* Next(bool drain);
+
+ private:
+  static const size_t kItemsPerWorker = 8;
+
+  struct Item {
+    DeviceRecord* rec = nullptr;    /* Copy of the record written by the job */
+    DeviceRecord* result = nullptr; /* Translated record if any */
+    bool translate = false;         /* Needs to be translated by a worker */
+    bool inflated = false;          /* Result got inflated not deflated */
+    bool done = false;              /* Ready to be written */
+  };
+
+  struct Worker {
+    std::thread thread;
+    CompressionContext compress;
+  };
+
+  bpContext* ctx_;
+  DeviceControlRecord* dcr_;
+  size_t max_items_ = 0;
+  std::mutex mutex_;
+  std::condition_variable work_; /* Workers wait for records to translate */
+  std::condition_variable done_; /* Job thread waits for the oldest record */
+  std::deque<Item*> items_;      /* All queued records in original order */
+  std::deque<Item*> todo_;       /* Records waiting for a worker */
+  bool stopping_ = false;
+  std::vector<Worker*> workers_;
+
+  void Work(Worker* worker);
 };
 
 static int const debuglevel = 200;
@@ -186,11 +271,13 @@ static bRC newPlugin(bpContext* ctx)
    * bsdEventSetupRecordTranslation - Setup the buffers for doing record
    * translation. bsdEventReadRecordTranslation - Perform read-side record
    * translation. bsdEventWriteRecordTranslation - Perform write-side record
-   * translantion.
+   * translantion. bsdEventFlushRecordTranslation - Hand back the records
+   * translated by the worker threads.
    */
   bfuncs->registerBareosEvents(
-      ctx, 4, bsdEventJobEnd, bsdEventSetupRecordTranslation,
-      bsdEventReadRecordTranslation, bsdEventWriteRecordTranslation);
+      ctx, 5, bsdEventJobEnd, bsdEventSetupRecordTranslation,
+      bsdEventReadRecordTranslation, bsdEventWriteRecordTranslation,
+      bsdEventFlushRecordTranslation);
 
   return bRC_OK;
 }
@@ -211,19 +298,40 @@ static bRC freePlugin(bpContext* ctx)
     return bRC_Error;
   }
 
-  if (p_ctx) { free(p_ctx); }
+  if (p_ctx) {
+    if (p_ctx->pool) { delete p_ctx->pool; }
+    free(p_ctx);
+  }
   ctx->pContext = NULL;
 
   return bRC_OK;
 }
 
 /**
- * Return some plugin value (none defined)
+ * Return some plugin value, records are only translated in the directions
+ * enabled with AutoDeflate and AutoInflate.
  */
 static bRC getPluginValue(bpContext* ctx, psdVariable var, void* value)
 {
   Dmsg(ctx, debuglevel, "autoxflate-sd: getPluginValue var=%d\n", var);
 
+  switch (var) {
+    case psdVarRecordTranslation: {
+      psdRecordTranslation* query = (psdRecordTranslation*)value;
+      uint32_t direction = (query->reading) ? IO_DIRECTION_IN
+                                            : IO_DIRECTION_OUT;
+
+      query->translates = query->dcr &&
+                          (query->dcr->autodeflate == direction ||
+                           query->dcr->autodeflate == IO_DIRECTION_INOUT ||
+                           query->dcr->autoinflate == direction ||
+                           query->dcr->autoinflate == IO_DIRECTION_INOUT);
+      break;
+    }
+    default:
+      break;
+  }
+
   return bRC_OK;
 }
 
@@ -249,6 +357,8 @@ static bRC handlePluginEvent(bpContext* ctx, bsdEvent* event, void* value)
       return handle_read_translation(ctx, value);
     case bsdEventWriteRecordTranslation:
       return handle_write_translation(ctx, value);
+    case bsdEventFlushRecordTranslation:
+      return handle_flush_translation(ctx, value);
     case bsdEventJobEnd:
       return handleJobEnd(ctx);
     default:
@@ -269,6 +379,15 @@ static bRC handleJobEnd(bpContext* ctx)
 
   if (!p_ctx) { goto bail_out; }
 
+  /*
+   * All records were handed back before the end of the job so this only
+   * stops the workers.
+   */
+  if (p_ctx->pool) {
+    delete p_ctx->pool;
+    p_ctx->pool = NULL;
+  }
+
   if (p_ctx->inflate_bytes_in) {
     Dmsg(ctx, debuglevel, "autoxflate-sd: inflate ratio: %lld/%lld = %0.2f%%\n",
          p_ctx->inflate_bytes_out, p_ctx->inflate_bytes_in,
@@ -290,9 +409,71 @@ bail_out:
   return bRC_OK;
 }
 
+/**
+ * We only do autocompression for the following stream types:
+ *
+ * - STREAM_FILE_DATA
+ * - STREAM_WIN32_DATA
+ * - STREAM_SPARSE_DATA
+ */
+static inline bool IsDeflatableStream(int32_t stream)
+{
+  switch (stream) {
+    case STREAM_FILE_DATA:
+    case STREAM_WIN32_DATA:
+    case STREAM_SPARSE_DATA:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/**
+ * We only do auto inflation for the following stream types:
+ *
+ * - STREAM_COMPRESSED_DATA
+ * - STREAM_WIN32_COMPRESSED_DATA
+ * - STREAM_SPARSE_COMPRESSED_DATA
+ */
+static inline bool IsInflatableStream(int32_t stream)
+{
+  switch (stream) {
+    case STREAM_COMPRESSED_DATA:
+    case STREAM_WIN32_COMPRESSED_DATA:
+    case STREAM_SPARSE_COMPRESSED_DATA:
+      return true;
+    default:
+      return false;
+  }
+}
+
+static inline bool InflateOnWrite(DeviceControlRecord* dcr)
+{
+  return dcr->autoinflate == IO_DIRECTION_OUT ||
+         dcr->autoinflate == IO_DIRECTION_INOUT;
+}
+
+static inline bool DeflateOnWrite(DeviceControlRecord* dcr)
+{
+  return dcr->autodeflate == IO_DIRECTION_OUT ||
+         dcr->autodeflate == IO_DIRECTION_INOUT;
+}
+
+/**
+ * See if a record written by the job gets translated, this mirrors the
+ * choices made by handle_write_translation().
+ */
+static inline bool NeedsWriteTranslation(DeviceControlRecord* dcr,
+                                         DeviceRecord* rec)
+{
+  return (InflateOnWrite(dcr) && IsInflatableStream(rec->maskedStream)) ||
+         (DeflateOnWrite(dcr) && IsDeflatableStream(rec->maskedStream));
+}
+
 static bRC setup_record_translation(bpContext* ctx, void* value)
 {
   DeviceControlRecord* dcr;
+  struct plugin_ctx* p_ctx = (struct plugin_ctx*)ctx->pContext;
   bool did_setup = false;
   const char* inflate_in = SETTING_UNSET;
   const char* inflate_out = SETTING_UNSET;
@@ -390,6 +571,26 @@ static bRC setup_record_translation(bpContext* ctx, void* value)
          dcr->dev_name, inflate_out, deflate_out, inflate_in, deflate_in);
   }
 
+  /*
+   * Translate the records written by the job with a pool of workers when
+   * configured and the core can take the records back later.
+   */
+  if (p_ctx && !p_ctx->pool && dcr->device->autoxflate_workers > 0 &&
+      dcr->deferred_record_written &&
+      (InflateOnWrite(dcr) || DeflateOnWrite(dcr))) {
+    TranslationPool* pool = new TranslationPool(ctx, dcr);
+
+    if (pool->Start(dcr->device->autoxflate_workers)) {
+      p_ctx->pool = pool;
+      Jmsg(ctx, M_INFO,
+           _("autoxflate-sd: %d worker threads translate the records written "
+             "to %s\n"),
+           dcr->device->autoxflate_workers, dcr->dev_name);
+    } else {
+      delete pool;
+    }
+  }
+
   return bRC_OK;
 }
 
@@ -433,7 +634,9 @@ static bRC handle_read_translation(bpContext* ctx, void* value)
 static bRC handle_write_translation(bpContext* ctx, void* value)
 {
   DeviceControlRecord* dcr;
+  DeviceRecord* rec;
   bool swap_record = false;
+  struct plugin_ctx* p_ctx = (struct plugin_ctx*)ctx->pContext;
 
   /*
    * Unpack the arguments passed in.
@@ -441,6 +644,27 @@ static bRC handle_write_translation(bpContext* ctx, void* value)
   dcr = (DeviceControlRecord*)value;
   if (!dcr) { return bRC_Error; }
 
+  /*
+   * When the workers are translating records every record is queued to keep
+   * the original order. Records we don't translate are written directly
+   * when nothing is queued.
+   */
+  if (p_ctx && p_ctx->pool) {
+    rec = (dcr->after_rec) ? dcr->after_rec : dcr->before_rec;
+
+    bool translate = NeedsWriteTranslation(dcr, rec);
+    if (translate || !p_ctx->pool->Empty()) {
+      p_ctx->pool->Submit(rec, translate);
+      if (dcr->after_rec) {
+        bfuncs->FreeRecord(dcr->after_rec);
+        dcr->after_rec = NULL;
+      }
+      dcr->record_deferred = true;
+    }
+
+    return bRC_OK;
+  }
+
   /*
    * See if we need to perform auto deflation/inflation of streams.
    */
@@ -467,19 +691,61 @@ static bRC handle_write_translation(bpContext* ctx, void* value)
   return bRC_OK;
 }
 
+/**
+ * Hand back the next record translated by the workers in the order they were
+ * written, see DeviceControlRecord::WriteDeferredRecords().
+ */
+static bRC handle_flush_translation(bpContext* ctx, void* value)
+{
+  DeviceControlRecord* dcr;
+  struct plugin_ctx* p_ctx = (struct plugin_ctx*)ctx->pContext;
+
+  /*
+   * Unpack the arguments passed in.
+   */
+  dcr = (DeviceControlRecord*)value;
+  if (!dcr) { return bRC_Error; }
+
+  if (p_ctx && p_ctx->pool) {
+    dcr->after_rec = p_ctx->pool->Next(dcr->drain_deferred);
+  }
+
+  return bRC_OK;
+}
+
 /**
  * Setup deflate for auto deflate of data streams.
  */
 static bool SetupAutoDeflation(bpContext* ctx, DeviceControlRecord* dcr)
 {
   JobControlRecord* jcr = dcr->jcr;
-  bool retval = false;
-  uint32_t compress_buf_size = 0;
   const char* compressorname = COMPRESSOR_NAME_UNSET;
 
   if (jcr->buf_size == 0) { jcr->buf_size = DEFAULT_NETWORK_BUFFER_SIZE; }
 
-  if (!SetupCompressionBuffers(jcr, sd_enabled_compatible,
+  if (!SetupDeflation(ctx, dcr, &jcr->compress, &compressorname)) {
+    return false;
+  }
+
+  Jmsg(ctx, M_INFO, _("autoxflate-sd: Compressor on device %s is %s\n"),
+       dcr->dev_name, compressorname);
+
+  return true;
+}
+
+/**
+ * Setup the compression buffers and compressor of a compression context.
+ */
+static bool SetupDeflation(bpContext* ctx,
+                           DeviceControlRecord* dcr,
+                           CompressionContext* compress,
+                           const char** compressorname)
+{
+  JobControlRecord* jcr = dcr->jcr;
+  bool retval = false;
+  uint32_t compress_buf_size = 0;
+
+  if (!SetupCompressionBuffers(jcr, compress, sd_enabled_compatible,
                                dcr->device->autodeflate_algorithm,
                                &compress_buf_size)) {
     goto bail_out;
@@ -489,25 +755,25 @@ static bool SetupAutoDeflation(bpContext* ctx, DeviceControlRecord* dcr)
    * See if we need to create a new compression buffer or make sure the existing
    * is big enough.
    */
-  if (!jcr->compress.deflate_buffer) {
-    jcr->compress.deflate_buffer = GetMemory(compress_buf_size);
-    jcr->compress.deflate_buffer_size = compress_buf_size;
+  if (!compress->deflate_buffer) {
+    compress->deflate_buffer = GetMemory(compress_buf_size);
+    compress->deflate_buffer_size = compress_buf_size;
   } else {
-    if (compress_buf_size > jcr->compress.deflate_buffer_size) {
-      jcr->compress.deflate_buffer =
-          ReallocPoolMemory(jcr->compress.deflate_buffer, compress_buf_size);
-      jcr->compress.deflate_buffer_size = compress_buf_size;
+    if (compress_buf_size > compress->deflate_buffer_size) {
+      compress->deflate_buffer =
+          ReallocPoolMemory(compress->deflate_buffer, compress_buf_size);
+      compress->deflate_buffer_size = compress_buf_size;
     }
   }
 
   switch (dcr->device->autodeflate_algorithm) {
 #if defined(HAVE_LIBZ)
     case COMPRESS_GZIP: {
-      compressorname = COMPRESSOR_NAME_GZIP;
+      *compressorname = COMPRESSOR_NAME_GZIP;
       int zstat;
       z_stream* pZlibStream;
 
-      pZlibStream = (z_stream*)jcr->compress.workset.pZLIB;
+      pZlibStream = (z_stream*)compress->workset.pZLIB;
       if ((zstat = deflateParams(pZlibStream, dcr->device->autodeflate_level,
                                  Z_DEFAULT_STRATEGY)) != Z_OK) {
         Jmsg(ctx, M_FATAL,
@@ -520,15 +786,15 @@ static bool SetupAutoDeflation(bpContext* ctx, DeviceControlRecord* dcr)
 #endif
 #if defined(HAVE_LZO)
     case COMPRESS_LZO1X:
-      compressorname = COMPRESSOR_NAME_LZO;
+      *compressorname = COMPRESSOR_NAME_LZO;
       break;
 #endif
     case COMPRESS_FZFZ:
-      compressorname = COMPRESSOR_NAME_FZLZ;
+      *compressorname = COMPRESSOR_NAME_FZLZ;
     case COMPRESS_FZ4L:
-      compressorname = COMPRESSOR_NAME_FZ4L;
+      *compressorname = COMPRESSOR_NAME_FZ4L;
     case COMPRESS_FZ4H: {
-      compressorname = COMPRESSOR_NAME_FZ4H;
+      *compressorname = COMPRESSOR_NAME_FZ4H;
       int zstat;
       zfast_stream* pZfastStream;
       zfast_stream_compressor compressor = COMPRESSOR_FASTLZ;
@@ -540,7 +806,7 @@ static bool SetupAutoDeflation(bpContext* ctx, DeviceControlRecord* dcr)
           break;
       }
 
-      pZfastStream = (zfast_stream*)jcr->compress.workset.pZFAST;
+      pZfastStream = (zfast_stream*)compress->workset.pZFAST;
       if ((zstat = fastlzlibSetCompressor(pZfastStream, compressor)) != Z_OK) {
         Jmsg(ctx, M_FATAL,
              _("autoxflate-sd: Compression fastlzlibSetCompressor error: %d\n"),
@@ -550,12 +816,29 @@ static bool SetupAutoDeflation(bpContext* ctx, DeviceControlRecord* dcr)
       }
       break;
     }
+#if defined(HAVE_ZSTD)
+    case COMPRESS_ZSTD: {
+      *compressorname = COMPRESSOR_NAME_ZSTD;
+      size_t zstat;
+
+      zstat = ZSTD_CCtx_setParameter((ZSTD_CCtx*)compress->workset.pZSTD,
+                                     ZSTD_c_compressionLevel,
+                                     dcr->device->autodeflate_level);
+      if (ZSTD_isError(zstat)) {
+        Jmsg(ctx, M_FATAL,
+             _("autoxflate-sd: Compression ZSTD_CCtx_setParameter error: "
+               "%s\n"),
+             ZSTD_getErrorName(zstat));
+        jcr->setJobStatus(JS_ErrorTerminated);
+        goto bail_out;
+      }
+      break;
+    }
+#endif
     default:
       break;
   }
 
-  Jmsg(ctx, M_INFO, _("autoxflate-sd: Compressor on device %s is %s\n"),
-       dcr->dev_name, compressorname);
   retval = true;
 
 bail_out:
@@ -568,24 +851,35 @@ bail_out:
 static bool SetupAutoInflation(bpContext* ctx, DeviceControlRecord* dcr)
 {
   JobControlRecord* jcr = dcr->jcr;
-  uint32_t decompress_buf_size;
 
   if (jcr->buf_size == 0) { jcr->buf_size = DEFAULT_NETWORK_BUFFER_SIZE; }
 
-  SetupDecompressionBuffers(jcr, &decompress_buf_size);
+  return SetupInflation(ctx, dcr, &jcr->compress);
+}
+
+/**
+ * Setup the decompression buffer of a compression context.
+ */
+static bool SetupInflation(bpContext* ctx,
+                           DeviceControlRecord* dcr,
+                           CompressionContext* compress)
+{
+  uint32_t decompress_buf_size;
+
+  SetupDecompressionBuffers(dcr->jcr, compress, &decompress_buf_size);
   if (decompress_buf_size > 0) {
     /*
      * See if we need to create a new compression buffer or make sure the
      * existing is big enough.
      */
-    if (!jcr->compress.inflate_buffer) {
-      jcr->compress.inflate_buffer = GetMemory(decompress_buf_size);
-      jcr->compress.inflate_buffer_size = decompress_buf_size;
+    if (!compress->inflate_buffer) {
+      compress->inflate_buffer = GetMemory(decompress_buf_size);
+      compress->inflate_buffer_size = decompress_buf_size;
     } else {
-      if (decompress_buf_size > jcr->compress.inflate_buffer_size) {
-        jcr->compress.inflate_buffer = ReallocPoolMemory(
-            jcr->compress.inflate_buffer, decompress_buf_size);
-        jcr->compress.inflate_buffer_size = decompress_buf_size;
+      if (decompress_buf_size > compress->inflate_buffer_size) {
+        compress->inflate_buffer =
+            ReallocPoolMemory(compress->inflate_buffer, decompress_buf_size);
+        compress->inflate_buffer_size = decompress_buf_size;
       }
     }
   } else {
@@ -601,14 +895,10 @@ static bool SetupAutoInflation(bpContext* ctx, DeviceControlRecord* dcr)
  */
 static bool AutoDeflateRecord(bpContext* ctx, DeviceControlRecord* dcr)
 {
-  ser_declare;
   bool retval = false;
-  comp_stream_header ch;
   DeviceRecord *rec, *nrec;
   struct plugin_ctx* p_ctx;
-  unsigned char* data = NULL;
   bool intermediate_value = false;
-  unsigned int max_compression_length = 0;
 
   p_ctx = (struct plugin_ctx*)ctx->pContext;
   if (!p_ctx) { goto bail_out; }
@@ -627,21 +917,39 @@ static bool AutoDeflateRecord(bpContext* ctx, DeviceControlRecord* dcr)
     rec = dcr->before_rec;
   }
 
+  if (!IsDeflatableStream(rec->maskedStream)) { goto bail_out; }
+
+  nrec = DeflateRecord(ctx, dcr, &dcr->jcr->compress, rec);
+  if (!nrec) { goto bail_out; }
+
+  p_ctx->deflate_bytes_in += rec->data_len;
+  p_ctx->deflate_bytes_out += nrec->data_len;
+
   /*
-   * We only do autocompression for the following stream types:
-   *
-   * - STREAM_FILE_DATA
-   * - STREAM_WIN32_DATA
-   * - STREAM_SPARSE_DATA
+   * If the input is just an intermediate value free it now.
    */
-  switch (rec->maskedStream) {
-    case STREAM_FILE_DATA:
-    case STREAM_WIN32_DATA:
-    case STREAM_SPARSE_DATA:
-      break;
-    default:
-      goto bail_out;
-  }
+  if (intermediate_value) { bfuncs->FreeRecord(dcr->after_rec); }
+  dcr->after_rec = nrec;
+  retval = true;
+
+bail_out:
+  return retval;
+}
+
+/**
+ * Compress a record using the given compression context. The data of the
+ * returned record points to the deflate buffer of that context.
+ */
+static DeviceRecord* DeflateRecord(bpContext* ctx,
+                                   DeviceControlRecord* dcr,
+                                   CompressionContext* compress,
+                                   DeviceRecord* rec)
+{
+  ser_declare;
+  comp_stream_header ch;
+  DeviceRecord* nrec;
+  unsigned char* data = NULL;
+  unsigned int max_compression_length = 0;
 
   /*
    * Clone the data from the original DeviceRecord to the converted one.
@@ -656,18 +964,18 @@ static bool AutoDeflateRecord(bpContext* ctx, DeviceControlRecord* dcr)
    * Setup the converted DeviceRecord to point with its data buffer to the
    * compression buffer.
    */
-  nrec->data = dcr->jcr->compress.deflate_buffer;
+  nrec->data = compress->deflate_buffer;
   switch (rec->maskedStream) {
     case STREAM_FILE_DATA:
     case STREAM_WIN32_DATA:
       data = (unsigned char*)nrec->data + sizeof(comp_stream_header);
       max_compression_length =
-          dcr->jcr->compress.deflate_buffer_size - sizeof(comp_stream_header);
+          compress->deflate_buffer_size - sizeof(comp_stream_header);
       break;
     case STREAM_SPARSE_DATA:
       data = (unsigned char*)nrec->data + OFFSET_FADDR_SIZE +
              sizeof(comp_stream_header);
-      max_compression_length = dcr->jcr->compress.deflate_buffer_size -
+      max_compression_length = compress->deflate_buffer_size -
                                OFFSET_FADDR_SIZE - sizeof(comp_stream_header);
       break;
   }
@@ -675,11 +983,11 @@ static bool AutoDeflateRecord(bpContext* ctx, DeviceControlRecord* dcr)
   /*
    * Compress the data using the configured compression algorithm.
    */
-  if (!CompressData(dcr->jcr, dcr->device->autodeflate_algorithm, rec->data,
-                    rec->data_len, data, max_compression_length,
+  if (!CompressData(dcr->jcr, compress, dcr->device->autodeflate_algorithm,
+                    rec->data, rec->data_len, data, max_compression_length,
                     &nrec->data_len)) {
     bfuncs->FreeRecord(nrec);
-    goto bail_out;
+    return NULL;
   }
 
   /*
@@ -741,18 +1049,7 @@ static bool AutoDeflateRecord(bpContext* ctx, DeviceControlRecord* dcr)
        "%ld\n",
        rec->maskedStream, nrec->maskedStream, rec->data_len, nrec->data_len);
 
-  p_ctx->deflate_bytes_in += rec->data_len;
-  p_ctx->deflate_bytes_out += nrec->data_len;
-
-  /*
-   * If the input is just an intermediate value free it now.
-   */
-  if (intermediate_value) { bfuncs->FreeRecord(dcr->after_rec); }
-  dcr->after_rec = nrec;
-  retval = true;
-
-bail_out:
-  return retval;
+  return nrec;
 }
 
 /**
@@ -783,21 +1080,35 @@ static bool AutoInflateRecord(bpContext* ctx, DeviceControlRecord* dcr)
     rec = dcr->before_rec;
   }
 
+  if (!IsInflatableStream(rec->maskedStream)) { goto bail_out; }
+
+  nrec = InflateRecord(ctx, dcr, &dcr->jcr->compress, rec);
+  if (!nrec) { goto bail_out; }
+
+  p_ctx->inflate_bytes_in += rec->data_len;
+  p_ctx->inflate_bytes_out += nrec->data_len;
+
   /*
-   * We only do auto inflation for the following stream types:
-   *
-   * - STREAM_COMPRESSED_DATA
-   * - STREAM_WIN32_COMPRESSED_DATA
-   * - STREAM_SPARSE_COMPRESSED_DATA
+   * If the input is just an intermediate value free it now.
    */
-  switch (rec->maskedStream) {
-    case STREAM_COMPRESSED_DATA:
-    case STREAM_WIN32_COMPRESSED_DATA:
-    case STREAM_SPARSE_COMPRESSED_DATA:
-      break;
-    default:
-      goto bail_out;
-  }
+  if (intermediate_value) { bfuncs->FreeRecord(dcr->after_rec); }
+  dcr->after_rec = nrec;
+  retval = true;
+
+bail_out:
+  return retval;
+}
+
+/**
+ * Uncompress a record using the given compression context. The data of the
+ * returned record points to the inflate buffer of that context.
+ */
+static DeviceRecord* InflateRecord(bpContext* ctx,
+                                   DeviceControlRecord* dcr,
+                                   CompressionContext* compress,
+                                   DeviceRecord* rec)
+{
+  DeviceRecord* nrec;
 
   /*
    * Clone the data from the original DeviceRecord to the converted one.
@@ -817,10 +1128,10 @@ static bool AutoInflateRecord(bpContext* ctx, DeviceControlRecord* dcr)
   nrec->data = rec->data;
   nrec->data_len = rec->data_len;
 
-  if (!DecompressData(dcr->jcr, "Unknown", rec->maskedStream, &nrec->data,
-                      &nrec->data_len, true)) {
+  if (!DecompressData(dcr->jcr, compress, "Unknown", rec->maskedStream,
+                      &nrec->data, &nrec->data_len, true)) {
     bfuncs->FreeRecord(nrec);
-    goto bail_out;
+    return NULL;
   }
 
   /*
@@ -848,16 +1159,180 @@ static bool AutoInflateRecord(bpContext* ctx, DeviceControlRecord* dcr)
        "%ld\n",
        rec->maskedStream, nrec->maskedStream, rec->data_len, nrec->data_len);
 
-  p_ctx->inflate_bytes_in += rec->data_len;
-  p_ctx->inflate_bytes_out += nrec->data_len;
+  return nrec;
+}
 
-  /*
-   * If the input is just an intermediate value free it now.
-   */
-  if (intermediate_value) { bfuncs->FreeRecord(dcr->after_rec); }
-  dcr->after_rec = nrec;
-  retval = true;
+TranslationPool::TranslationPool(bpContext* ctx, DeviceControlRecord* dcr)
+    : ctx_(ctx), dcr_(dcr)
+{
+}
 
-bail_out:
-  return retval;
+TranslationPool::~TranslationPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  work_.notify_all();
+
+  for (Worker* worker : workers_) {
+    if (worker->thread.joinable()) { worker->thread.join(); }
+    CleanupCompression(&worker->compress);
+    delete worker;
+  }
+
+  for (Item* item : items_) {
+    bfuncs->FreeRecord(item->rec);
+    if (item->result) { bfuncs->FreeRecord(item->result); }
+    delete item;
+  }
+}
+
+/**
+ * Setup a compression context for every worker and start them.
+ */
+bool TranslationPool::Start(int nr_workers)
+{
+  const char* compressorname = COMPRESSOR_NAME_UNSET;
+
+  for (int i = 0; i < nr_workers; i++) {
+    Worker* worker = new Worker;
+
+    workers_.push_back(worker);
+    if (DeflateOnWrite(dcr_) &&
+        !SetupDeflation(ctx_, dcr_, &worker->compress, &compressorname)) {
+      return false;
+    }
+    if (InflateOnWrite(dcr_) &&
+        !SetupInflation(ctx_, dcr_, &worker->compress)) {
+      return false;
+    }
+  }
+
+  max_items_ = kItemsPerWorker * nr_workers;
+  for (Worker* worker : workers_) {
+    worker->thread = std::thread(&TranslationPool::Work, this, worker);
+  }
+
+  return true;
+}
+
+bool TranslationPool::Empty()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  return items_.empty();
+}
+
+/**
+ * Queue a copy of a record, the original is reused by the core as soon as
+ * the write translation returns.
+ */
+void TranslationPool::Submit(DeviceRecord* rec, bool translate)
+{
+  Item* item = new Item;
+
+  item->rec = bfuncs->new_record(true);
+  bfuncs->CopyRecordState(item->rec, rec);
+  item->rec->Stream = rec->Stream;
+  item->rec->maskedStream = rec->maskedStream;
+  item->rec->data = CheckPoolMemorySize(item->rec->data, rec->data_len);
+  memcpy(item->rec->data, rec->data, rec->data_len);
+  item->rec->data_len = rec->data_len;
+  item->translate = translate;
+  item->done = !translate;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  items_.push_back(item);
+  if (translate) {
+    todo_.push_back(item);
+    work_.notify_one();
+  }
+}
+
+/**
+ * Return the oldest queued record when it is translated. With drain set, or
+ * when the queue is full, wait for it.
+ */
+DeviceRecord* TranslationPool::Next(bool drain)
+{
+  Item* item;
+  DeviceRecord* rec;
+  struct plugin_ctx* p_ctx = (struct plugin_ctx*)ctx_->pContext;
+
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    if (items_.empty()) { return NULL; }
+    if (drain || items_.size() >= max_items_) {
+      done_.wait(lock, [this] { return items_.front()->done; });
+    } else if (!items_.front()->done) {
+      return NULL;
+    }
+
+    item = items_.front();
+    items_.pop_front();
+  }
+
+  if (item->result) {
+    if (item->inflated) {
+      p_ctx->inflate_bytes_in += item->rec->data_len;
+      p_ctx->inflate_bytes_out += item->result->data_len;
+    } else {
+      p_ctx->deflate_bytes_in += item->rec->data_len;
+      p_ctx->deflate_bytes_out += item->result->data_len;
+    }
+    bfuncs->FreeRecord(item->rec);
+    rec = item->result;
+  } else {
+    rec = item->rec;
+  }
+  delete item;
+
+  return rec;
+}
+
+void TranslationPool::Work(Worker* worker)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  while (true) {
+    work_.wait(lock, [this] { return !todo_.empty() || stopping_; });
+    if (stopping_) { break; }
+
+    Item* item = todo_.front();
+    todo_.pop_front();
+    lock.unlock();
+
+    /*
+     * Same order as handle_write_translation(), a record that fails to
+     * translate is written as is.
+     */
+    DeviceRecord* nrec = NULL;
+    if (InflateOnWrite(dcr_) && IsInflatableStream(item->rec->maskedStream)) {
+      nrec = InflateRecord(ctx_, dcr_, &worker->compress, item->rec);
+      item->inflated = (nrec != NULL);
+    }
+    if (!nrec && DeflateOnWrite(dcr_) &&
+        IsDeflatableStream(item->rec->maskedStream)) {
+      nrec = DeflateRecord(ctx_, dcr_, &worker->compress, item->rec);
+    }
+
+    /*
+     * The data points into the compression buffers of this worker which
+     * are reused for the next record.
+     */
+    if (nrec) {
+      POOLMEM* data = GetMemory(nrec->data_len);
+
+      memcpy(data, nrec->data, nrec->data_len);
+      nrec->data = data;
+      nrec->own_mempool = true;
+    }
+
+    lock.lock();
+    item->result = nrec;
+    item->done = true;
+    if (item == items_.front()) { done_.notify_one(); }
+  }
 }
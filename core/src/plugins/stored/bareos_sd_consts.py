@@ -101,5 +101,6 @@ bsdEventType = dict(
     bsdEventDeviceRelease=21,
     bsdEventNewPluginOptions=22,
     bsdEventChangerLock=23,
-    bsdEventChangerUnlock=24
+    bsdEventChangerUnlock=24,
+    bsdEventFlushRecordTranslation=25
 )
@@ -602,6 +602,7 @@ bool ReleaseDevice(DeviceControlRecord* dcr)
     dev->num_writers--;
     Dmsg1(100, "There are %d writers in ReleaseDevice\n", dev->num_writers);
     if (dev->IsLabeled()) {
+      BlockIndexEndSession(dcr);
       Dmsg2(200, "dir_create_jobmedia. Release vol=%s dev=%s\n",
             dev->getVolCatName(), dev->print_name());
       if (!dev->AtWeot() && !dcr->DirCreateJobmediaRecord(false)) {
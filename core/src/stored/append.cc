@@ -31,6 +31,7 @@
 #include "stored/stored.h"
 #include "stored/acquire.h"
 #include "stored/append.h"
+#include "stored/append_writer.h"
 #include "stored/fd_cmds.h"
 #include "stored/jcr_private.h"
 #include "stored/label.h"
@@ -41,6 +42,9 @@
 #include "lib/bsock.h"
 #include "lib/berrno.h"
 #include "lib/berrno.h"
+#include "include/make_unique.h"
+
+#include <algorithm>
 
 namespace storagedaemon {
 
@@ -49,10 +53,173 @@ static char OK_data[] = "3000 OK data\n";
 static char OK_append[] = "3000 OK append data\n";
 static char OK_replicate[] = "3000 OK replicate data\n";
 
+/* Header sent by a storage daemon replicating whole blocks */
+static char ReplicateBlocks[] = "blocks";
+
 /* Forward referenced functions */
+static bool UpdateFileAttributes(JobControlRecord* jcr, DeviceRecord* rec);
 
 void PossibleIncompleteJob(JobControlRecord* jcr, int32_t last_file_index) {}
 
+/**
+ * We make sure the file_index is advancing sequentially.
+ * An incomplete job can start the file_index at any number.
+ * otherwise, it must start at 1.
+ */
+static inline bool FileIndexIsSequential(JobControlRecord* jcr,
+                                         int32_t file_index,
+                                         int32_t last_file_index)
+{
+  if (jcr->rerunning && file_index > 0 && last_file_index == 0) {
+    return true;
+  }
+
+  return file_index > 0 && (file_index == last_file_index ||
+                            file_index == last_file_index + 1);
+}
+
+static inline bool IsAttributesStream(int32_t maskedStream)
+{
+  return maskedStream == STREAM_UNIX_ATTRIBUTES ||
+         maskedStream == STREAM_UNIX_ATTRIBUTES_EX ||
+         maskedStream == STREAM_RESTORE_OBJECT ||
+         CryptoDigestStreamType(maskedStream) != CRYPTO_DIGEST_NONE;
+}
+
+/**
+ * Append the blocks replicated by another storage daemon. Each message
+ * holds the records of a block as record fragments, which are packed into
+ * our blocks as they are. Only the attributes are put together again to
+ * send them to the Director.
+ */
+static bool AppendReplicatedBlocks(JobControlRecord* jcr,
+                                   DeviceControlRecord* dcr,
+                                   BareosSocket* bs,
+                                   const char* what,
+                                   int32_t* last_file_index)
+{
+  int32_t n = 0, maskedStream;
+  bool ok = true;
+  Device* dev = dcr->dev;
+  DeviceRecord* attr = new_record();
+  bool attr_pending = false;
+  FragmentPacker packer;
+  RecordFragment frag;
+  SharedPayload* payload;
+  const char* buf;
+  uint32_t len;
+
+  while (ok && (n = BgetMsg(bs)) > 0 && !jcr->IsJobCanceled()) {
+    buf = bs->msg;
+    len = bs->message_length;
+
+    /*
+     * Let the blocks reference the message buffer like for single records.
+     */
+    payload = NULL;
+    if (dev->HasCap(CAP_WRITEV) && !dcr->spooling) {
+      payload = NewSharedPayload(bs->msg);
+    }
+
+    while (ok && ParseRecordFragment(&buf, &len, BLOCK_VER, &frag)) {
+      if (!FileIndexIsSequential(jcr, frag.FileIndex, *last_file_index)) {
+        Jmsg3(jcr, M_FATAL, 0,
+              _("FI=%d from %s not positive or sequential=%d\n"),
+              frag.FileIndex, what, *last_file_index);
+        PossibleIncompleteJob(jcr, *last_file_index);
+        ok = false;
+        break;
+      }
+      if (frag.FileIndex != *last_file_index) {
+        jcr->JobFiles = frag.FileIndex;
+        *last_file_index = frag.FileIndex;
+      }
+
+      frag.VolSessionId = jcr->VolSessionId;
+      frag.VolSessionTime = jcr->VolSessionTime;
+      frag.payload = payload;
+
+      /*
+       * Collect the attributes, they may be split over several blocks.
+       */
+      maskedStream =
+          ((frag.Stream < 0) ? -frag.Stream : frag.Stream) & STREAMMASK_TYPE;
+      if (IsAttributesStream(maskedStream)) {
+        if (frag.Stream >= 0) {
+          attr->VolSessionId = frag.VolSessionId;
+          attr->VolSessionTime = frag.VolSessionTime;
+          attr->FileIndex = frag.FileIndex;
+          attr->Stream = frag.Stream;
+          attr->maskedStream = maskedStream;
+          attr->data_len = 0;
+          attr_pending = true;
+        }
+        if (attr_pending) {
+          attr->data =
+              CheckPoolMemorySize(attr->data, attr->data_len + frag.data_len);
+          memcpy(attr->data + attr->data_len, frag.data, frag.data_len);
+          attr->data_len += frag.data_len;
+        }
+      }
+
+      Dmsg4(850, "before write fragment FI=%d Strm=%d rem=%d len=%d\n",
+            frag.FileIndex, frag.Stream, frag.remainder, frag.data_len);
+
+      if (attr_pending && !frag.IsPartial()) {
+        attr_pending = false;
+        ok = dcr->WriteRecordFragment(&packer, &frag);
+        if (ok) { SendAttrsToDir(jcr, attr); }
+      } else {
+        ok = dcr->WriteRecordFragment(&packer, &frag);
+      }
+    }
+
+    if (payload && ReleaseSharedPayload(payload)) {
+      bs->msg = GetPoolMemory(PM_BSOCK);
+    }
+
+    if (!ok) {
+      Dmsg2(90, "Got WriteBlockToDev error on device %s. %s\n",
+            dcr->dev->print_name(), dcr->dev->bstrerror());
+    }
+  }
+  Dmsg2(650, "End read blocks with %s. Stat=%d\n", what, n);
+
+  FreeRecord(attr);
+
+  if (ok && bs->IsError()) {
+    if (!jcr->IsJobCanceled()) {
+      Dmsg2(350, "Network read error from %s. ERR=%s\n", what,
+            bs->bstrerror());
+      Jmsg2(jcr, M_FATAL, 0, _("Network error reading from %s. ERR=%s\n"),
+            what, bs->bstrerror());
+      PossibleIncompleteJob(jcr, *last_file_index);
+    }
+    ok = false;
+  }
+
+  return ok;
+}
+
+/**
+ * Number of blocks the append writer buffers, a streaming buffer is
+ * given in bytes and holds as many blocks of the maximum size as fit.
+ */
+static int NumberOfAppendBuffers(DeviceControlRecord* dcr)
+{
+  uint64_t nr_buffers = dcr->device->append_buffers;
+  uint32_t block_size;
+
+  if (dcr->device->streaming_buffer_size > 0) {
+    block_size = dcr->dev->max_block_size ? dcr->dev->max_block_size
+                                          : DEFAULT_BLOCK_SIZE;
+    nr_buffers =
+        std::max(nr_buffers, dcr->device->streaming_buffer_size / block_size);
+  }
+
+  return (int)nr_buffers;
+}
+
 /**
  * Append Data sent from File daemon
  */
@@ -65,6 +232,8 @@ bool DoAppendData(JobControlRecord* jcr, BareosSocket* bs, const char* what)
   Device* dev;
   POOLMEM* rec_data;
   char ec[50];
+  std::unique_ptr<AppendWriter> append_writer;
+  int nr_buffers;
 
   if (!dcr) {
     Jmsg0(jcr, M_FATAL, 0, _("DeviceControlRecord is NULL!!!\n"));
@@ -86,6 +255,11 @@ bool DoAppendData(JobControlRecord* jcr, BareosSocket* bs, const char* what)
 
   if (!AcquireDeviceForAppend(dcr)) { goto bail_out; }
 
+  /*
+   * Plugins may translate records asynchronously, the attributes of the
+   * records they hand back later are sent once the record is written.
+   */
+  dcr->deferred_record_written = SendAttrsToDir;
   if (GeneratePluginEvent(jcr, bsdEventSetupRecordTranslation, dcr) != bRC_OK) {
     goto bail_out;
   }
@@ -132,6 +306,25 @@ bool DoAppendData(JobControlRecord* jcr, BareosSocket* bs, const char* what)
     ok = false;
   }
 
+  /*
+   * When configured let a separate thread write the filled blocks to the
+   * device so we can keep on reading from the network in the meantime.
+   */
+  nr_buffers = NumberOfAppendBuffers(dcr);
+  if (ok && nr_buffers > 0) {
+    append_writer = std::make_unique<AppendWriter>(
+        dcr, nr_buffers,
+        [jcr](DeviceRecord* rec) { return UpdateFileAttributes(jcr, rec); });
+    if (append_writer->Start()) {
+      /*
+       * Error messages can now be sent to the Director by both threads.
+       */
+      jcr->dir_bsock->SetLocking();
+    } else {
+      append_writer.reset();
+    }
+  }
+
   /*
    * Get Data from daemon, write to device.  To clarify what is
    * going on here.  We expect:
@@ -172,6 +365,16 @@ bool DoAppendData(JobControlRecord* jcr, BareosSocket* bs, const char* what)
       break;
     }
 
+    /*
+     * A storage daemon replicating whole blocks sends them all after a
+     * single header.
+     */
+    if (bs == jcr->store_bsock && jcr->impl->replicate_blocks &&
+        bstrcmp(bs->msg, ReplicateBlocks)) {
+      ok = AppendReplicatedBlocks(jcr, dcr, bs, what, &last_file_index);
+      continue;
+    }
+
     if (sscanf(bs->msg, "%ld %ld", &file_index, &stream) != 2) {
       Jmsg2(jcr, M_FATAL, 0, _("Malformed data header from %s: %s\n"), what,
             bs->msg);
@@ -182,25 +385,15 @@ bool DoAppendData(JobControlRecord* jcr, BareosSocket* bs, const char* what)
 
     Dmsg2(890, "<filed: Header FilInx=%d stream=%d\n", file_index, stream);
 
-    /*
-     * We make sure the file_index is advancing sequentially.
-     * An incomplete job can start the file_index at any number.
-     * otherwise, it must start at 1.
-     */
-    if (jcr->rerunning && file_index > 0 && last_file_index == 0) {
-      goto fi_checked;
-    }
-    if (file_index > 0 &&
-        (file_index == last_file_index || file_index == last_file_index + 1)) {
-      goto fi_checked;
+    if (!FileIndexIsSequential(jcr, file_index, last_file_index)) {
+      Jmsg3(jcr, M_FATAL, 0,
+            _("FI=%d from %s not positive or sequential=%d\n"), file_index,
+            what, last_file_index);
+      PossibleIncompleteJob(jcr, last_file_index);
+      ok = false;
+      break;
     }
-    Jmsg3(jcr, M_FATAL, 0, _("FI=%d from %s not positive or sequential=%d\n"),
-          file_index, what, last_file_index);
-    PossibleIncompleteJob(jcr, last_file_index);
-    ok = false;
-    break;
 
-  fi_checked:
     if (file_index != last_file_index) {
       jcr->JobFiles = file_index;
       last_file_index = file_index;
@@ -221,19 +414,36 @@ bool DoAppendData(JobControlRecord* jcr, BareosSocket* bs, const char* what)
       dcr->rec->data_len = bs->message_length;
       dcr->rec->data = bs->msg; /* use message buffer */
 
+      /*
+       * On devices which can write a block from an iovec the blocks
+       * reference the message buffer instead of copying the data. If they
+       * do the buffer is handed over to them and we continue with a fresh
+       * one.
+       */
+      if (dev->HasCap(CAP_WRITEV) && !dcr->spooling) {
+        dcr->rec->payload = NewSharedPayload(bs->msg);
+      }
+
       Dmsg4(850, "before writ_rec FI=%d SessId=%d Strm=%s len=%d\n",
             dcr->rec->FileIndex, dcr->rec->VolSessionId,
             stream_to_ascii(buf1, dcr->rec->Stream, dcr->rec->FileIndex),
             dcr->rec->data_len);
 
       ok = dcr->WriteRecord();
+      if (ok && !dcr->record_deferred) { SendAttrsToDir(jcr, dcr->rec); }
+
+      if (dcr->rec->payload) {
+        if (ReleaseSharedPayload(dcr->rec->payload)) {
+          bs->msg = GetPoolMemory(PM_BSOCK);
+        }
+        dcr->rec->payload = NULL;
+      }
+
       if (!ok) {
         Dmsg2(90, "Got WriteBlockToDev error on device %s. %s\n",
               dcr->dev->print_name(), dcr->dev->bstrerror());
         break;
       }
-
-      SendAttrsToDir(jcr, dcr->rec);
       Dmsg0(650, "Enter bnet_get\n");
     }
     Dmsg2(650, "End read loop with %s. Stat=%d\n", what, n);
@@ -256,6 +466,30 @@ bool DoAppendData(JobControlRecord* jcr, BareosSocket* bs, const char* what)
     }
   }
 
+  /*
+   * Write the records still queued for asynchronous translation.
+   */
+  if (ok && !dcr->WriteDeferredRecords(true)) {
+    if (!jcr->IsJobCanceled()) {
+      Jmsg2(jcr, M_FATAL, 0, _("Fatal append error on device %s: ERR=%s\n"),
+            dev->print_name(), dev->bstrerror());
+      PossibleIncompleteJob(jcr, last_file_index);
+    }
+    ok = false;
+  }
+
+  /*
+   * Wait for the writer thread to write all filled blocks.
+   */
+  if (append_writer && !append_writer->Stop()) {
+    if (ok && !jcr->IsJobCanceled()) {
+      Jmsg2(jcr, M_FATAL, 0, _("Fatal append error on device %s: ERR=%s\n"),
+            dev->print_name(), dev->bstrerror());
+      PossibleIncompleteJob(jcr, last_file_index);
+    }
+    ok = false;
+  }
+
   /*
    * Create Job status for end of session label
    */
@@ -338,6 +572,19 @@ bool DoAppendData(JobControlRecord* jcr, BareosSocket* bs, const char* what)
        job_elapsed / 3600, job_elapsed % 3600 / 60, job_elapsed % 60,
        edit_uint64_with_suffix(jcr->JobBytes / job_elapsed, ec));
 
+  if (append_writer) {
+    char ed1[50], ed2[50];
+
+    Jmsg(jcr, M_INFO, 0,
+         _("Append buffers=%d, network receive stalled %s ms waiting for the "
+           "device, device writes stalled %s ms waiting for data, device ran "
+           "out of data %u times\n"),
+         nr_buffers,
+         edit_uint64_with_commas(append_writer->ReceiverStallTime() / 1000, ed1),
+         edit_uint64_with_commas(append_writer->WriterStallTime() / 1000, ed2),
+         append_writer->Underruns());
+  }
+
   if ((!ok || jcr->IsJobCanceled()) && !jcr->is_JobStatus(JS_Incomplete)) {
     DiscardAttributeSpool(jcr);
   } else {
@@ -359,24 +606,33 @@ bail_out:
  */
 bool SendAttrsToDir(JobControlRecord* jcr, DeviceRecord* rec)
 {
-  if (rec->maskedStream == STREAM_UNIX_ATTRIBUTES ||
-      rec->maskedStream == STREAM_UNIX_ATTRIBUTES_EX ||
-      rec->maskedStream == STREAM_RESTORE_OBJECT ||
-      CryptoDigestStreamType(rec->maskedStream) != CRYPTO_DIGEST_NONE) {
+  if (IsAttributesStream(rec->maskedStream)) {
     if (!jcr->impl->no_attributes) {
-      BareosSocket* dir = jcr->dir_bsock;
-      if (AreAttributesSpooled(jcr)) { dir->SetSpooling(); }
-      Dmsg0(850, "Send attributes to dir.\n");
-      if (!jcr->impl->dcr->DirUpdateFileAttributes(rec)) {
-        Jmsg(jcr, M_FATAL, 0, _("Error updating file attributes. ERR=%s\n"),
-             dir->bstrerror());
-        dir->ClearSpooling();
-        return false;
+      /*
+       * When blocks are written asynchronously the attributes are sent
+       * once the writer thread has written the data.
+       */
+      if (jcr->impl->dcr->append_writer) {
+        return jcr->impl->dcr->append_writer->QueueAttributes(rec);
       }
-      dir->ClearSpooling();
+      return UpdateFileAttributes(jcr, rec);
     }
   }
   return true;
 }
 
+static bool UpdateFileAttributes(JobControlRecord* jcr, DeviceRecord* rec)
+{
+  BareosSocket* dir = jcr->dir_bsock;
+
+  Dmsg0(850, "Send attributes to dir.\n");
+  if (!jcr->impl->dcr->DirUpdateFileAttributes(rec)) {
+    Jmsg(jcr, M_FATAL, 0, _("Error updating file attributes. ERR=%s\n"),
+         dir->bstrerror());
+    return false;
+  }
+
+  return true;
+}
+
 } /* namespace storagedaemon */
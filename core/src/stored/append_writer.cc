@@ -0,0 +1,399 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Asynchronous block writer used by the append path of the Storage daemon.
+ *
+ * The receiving thread fills the block of the AppendBuffer it currently owns
+ * and hands it over to the writer thread via the full_buffers_ queue. The
+ * writer thread swaps the full block into dcr->block, returns the buffer
+ * (which now holds the previous, empty dcr->block) via the free_buffers_ queue
+ * and then writes the block using the normal WriteBlockToDevice() code. So
+ * while the writer thread is active it is the only one using dcr->block and
+ * the only one talking to the Director about the volume.
+ *
+ * The attributes that belong to a block are handed back to the receiving
+ * thread once that block is written, which sends them to the Director the
+ * next time it queues attributes or a block. The socket of the Director and
+ * its attribute spooling state so stay with the thread owning them, and a
+ * failure to send attributes fails the job like it does without the writer.
+ */
+
+#include "include/bareos.h"
+#include "stored/stored.h"
+#include "stored/append_writer.h"
+#include "include/jcr.h"
+#include "lib/berrno.h"
+#include "lib/thread_specific_data.h"
+
+#include <algorithm>
+
+namespace storagedaemon {
+
+WatermarkGate::WatermarkGate(int high, int low)
+{
+  high_ = (high < 1) ? 1 : high;
+  low_ = (low < 0) ? 0 : (low >= high_) ? high_ - 1 : low;
+}
+
+WatermarkGate::~WatermarkGate()
+{
+  pthread_cond_destroy(&drain_);
+  pthread_mutex_destroy(&mutex_);
+}
+
+/**
+ * A full block was queued for the writer thread.
+ */
+void WatermarkGate::Added()
+{
+  P(mutex_);
+  queued_++;
+  if (!draining_ && queued_ >= high_) {
+    draining_ = true;
+    pthread_cond_signal(&drain_);
+  }
+  V(mutex_);
+}
+
+/**
+ * Wait until the writer thread may write the next block.
+ */
+void WatermarkGate::WaitForDrain()
+{
+  P(mutex_);
+  while (!draining_ && !finishing_) { pthread_cond_wait(&drain_, &mutex_); }
+  V(mutex_);
+}
+
+/**
+ * The writer thread is done with a block.
+ */
+void WatermarkGate::Written()
+{
+  P(mutex_);
+  queued_--;
+  if (draining_ && !finishing_ && queued_ <= low_) {
+    draining_ = false;
+    underruns_++;
+  }
+  V(mutex_);
+}
+
+/**
+ * No more blocks are coming, write everything that is queued.
+ */
+void WatermarkGate::Finish()
+{
+  P(mutex_);
+  finishing_ = true;
+  pthread_cond_signal(&drain_);
+  V(mutex_);
+}
+
+/*
+ * Without a streaming buffer every queued block is written right away. The
+ * receiving thread queues a block before it waits for a free one, so at most
+ * all blocks can be queued and a higher watermark would never be reached.
+ */
+static int HighWatermark(DeviceControlRecord* dcr, int nr_buffers)
+{
+  uint32_t percent = dcr->device->streaming_buffer_high_watermark;
+
+  if (dcr->device->streaming_buffer_size == 0) { return 1; }
+  return nr_buffers * std::min(percent, 100U) / 100;
+}
+
+static int LowWatermark(DeviceControlRecord* dcr, int nr_buffers)
+{
+  uint32_t percent = dcr->device->streaming_buffer_low_watermark;
+
+  if (dcr->device->streaming_buffer_size == 0) { return 0; }
+  return nr_buffers * std::min(percent, 100U) / 100;
+}
+
+AppendWriter::AppendWriter(DeviceControlRecord* dcr,
+                           int nr_buffers,
+                           AttributesCallback send_attributes)
+    : dcr_(dcr)
+    , send_attributes_(send_attributes)
+    , buffers_(nr_buffers)
+    , free_buffers_(nr_buffers)
+    , full_buffers_(nr_buffers)
+    , gate_(HighWatermark(dcr, nr_buffers), LowWatermark(dcr, nr_buffers))
+{
+  for (auto& buffer : buffers_) { buffer.block = new_block(dcr_->dev); }
+}
+
+AppendWriter::~AppendWriter()
+{
+  Stop();
+
+  for (auto rec : written_attributes_) { FreeRecord(rec); }
+  for (auto& buffer : buffers_) {
+    for (auto rec : buffer.attributes) { FreeRecord(rec); }
+    if (buffer.block) { FreeBlock(buffer.block); }
+  }
+  pthread_mutex_destroy(&written_mutex_);
+}
+
+/**
+ * Start the writer thread. From now on records must be written using
+ * WriteRecord() and the dcr->block may not be touched until Stop().
+ */
+bool AppendWriter::Start()
+{
+  int status;
+
+  fill_buffer_ = &buffers_[0];
+  for (size_t i = 1; i < buffers_.size(); i++) {
+    free_buffers_.enqueue(&buffers_[i]);
+  }
+
+  if ((status = pthread_create(&thread_id_, NULL, writer_thread, this)) != 0) {
+    BErrNo be;
+    Jmsg1(dcr_->jcr, M_WARNING, 0,
+          _("Cannot create append writer thread: ERR=%s\n"),
+          be.bstrerror(status));
+    return false;
+  }
+
+  running_ = true;
+  dcr_->append_writer = this;
+  Dmsg4(100,
+        "Started append writer with %d buffers (watermarks %d/%d) on device "
+        "%s\n",
+        (int)buffers_.size(), gate_.High(), gate_.Low(),
+        dcr_->dev->print_name());
+
+  return true;
+}
+
+/**
+ * Wait for the writer thread to write all full blocks and make the
+ * partially filled block the dcr->block again so the end of session
+ * label and the final flush are done synchronously by the caller.
+ */
+bool AppendWriter::Stop()
+{
+  if (!running_) { return !failed_; }
+
+  gate_.Finish();
+  full_buffers_.flush();
+  pthread_join(thread_id_, NULL);
+  running_ = false;
+  dcr_->append_writer = NULL;
+
+  fill_buffer_->block->BlockNumber = dcr_->block->BlockNumber;
+  std::swap(dcr_->block, fill_buffer_->block);
+  if (!SendWrittenAttributes()) {
+    for (auto rec : fill_buffer_->attributes) { FreeRecord(rec); }
+    fill_buffer_->attributes.clear();
+  } else if (!SendAttributes(fill_buffer_->attributes)) {
+    failed_ = true;
+  }
+
+  dcr_->dev->streaming_underruns += gate_.Underruns();
+  Dmsg4(100,
+        "Stopped append writer on device %s receiver stall=%lld "
+        "writer stall=%lld usec underruns=%u\n",
+        dcr_->dev->print_name(), receiver_stall_, writer_stall_,
+        gate_.Underruns());
+
+  return !failed_;
+}
+
+/**
+ * Write a record into the blocks owned by the receiving thread,
+ * handing over each block that fills up to the writer thread.
+ */
+bool AppendWriter::WriteRecord(DeviceRecord* rec)
+{
+  while (!WriteRecordToBlock(fill_buffer_->block, rec)) {
+    Dmsg2(850, "!WriteRecordToBlock data_len=%d rem=%d\n", rec->data_len,
+          rec->remainder);
+    if (!SubmitFillBuffer()) { return false; }
+  }
+
+  return !failed_;
+}
+
+/**
+ * Same as WriteRecord() for a record fragment copied from another volume.
+ */
+bool AppendWriter::WriteRecordFragment(FragmentPacker* packer,
+                                       RecordFragment* frag)
+{
+  while (!packer->Pack(fill_buffer_->block, frag)) {
+    Dmsg2(850, "!Pack data_len=%d rem=%d\n", frag->data_len, frag->remainder);
+    if (!SubmitFillBuffer()) { return false; }
+  }
+
+  return !failed_;
+}
+
+/**
+ * Remember the attributes of a record written by WriteRecord() or
+ * WriteRecordFragment(). They are sent to the Director once the block
+ * holding the end of the record is written. Returns false when sending
+ * earlier attributes or writing a block failed.
+ */
+bool AppendWriter::QueueAttributes(DeviceRecord* rec)
+{
+  if (!SendWrittenAttributes()) { return false; }
+
+  DeviceRecord* attr = new_record();
+
+  attr->VolSessionId = rec->VolSessionId;
+  attr->VolSessionTime = rec->VolSessionTime;
+  attr->FileIndex = rec->FileIndex;
+  attr->Stream = rec->Stream;
+  attr->maskedStream = rec->maskedStream;
+  attr->data = CheckPoolMemorySize(attr->data, rec->data_len);
+  memcpy(attr->data, rec->data, rec->data_len);
+  attr->data_len = rec->data_len;
+  fill_buffer_->attributes.push_back(attr);
+
+  return !failed_;
+}
+
+bool AppendWriter::SubmitFillBuffer()
+{
+  btime_t start, stall;
+
+  if (!SendWrittenAttributes()) { return false; }
+
+  full_buffers_.enqueue(fill_buffer_);
+  gate_.Added();
+
+  start = GetCurrentBtime();
+  fill_buffer_ = (AppendBuffer*)free_buffers_.dequeue();
+  stall = GetCurrentBtime() - start;
+  receiver_stall_ += stall;
+  dcr_->dev->latencies.Record(DeviceLatencyKind::kQueueWait, stall);
+
+  return fill_buffer_ && !failed_;
+}
+
+bool AppendWriter::SendAttributes(std::vector<DeviceRecord*>& attributes)
+{
+  bool retval = true;
+
+  for (auto rec : attributes) {
+    if (retval && !send_attributes_(rec)) { retval = false; }
+    FreeRecord(rec);
+  }
+  attributes.clear();
+
+  return retval;
+}
+
+/**
+ * Send the attributes of the blocks written so far, called by the
+ * receiving thread.
+ */
+bool AppendWriter::SendWrittenAttributes()
+{
+  std::vector<DeviceRecord*> attributes;
+
+  P(written_mutex_);
+  attributes.swap(written_attributes_);
+  V(written_mutex_);
+
+  if (failed_) {
+    for (auto rec : attributes) { FreeRecord(rec); }
+    return false;
+  }
+
+  if (!SendAttributes(attributes)) {
+    Dmsg0(90, "Sending attributes of written blocks failed\n");
+    failed_ = true;
+    return false;
+  }
+
+  return true;
+}
+
+void AppendWriter::WriteBuffers()
+{
+  btime_t start;
+  AppendBuffer* buffer;
+  std::vector<DeviceRecord*> attributes;
+
+  while (1) {
+    start = GetCurrentBtime();
+    gate_.WaitForDrain();
+    buffer = (AppendBuffer*)full_buffers_.dequeue();
+    writer_stall_ += GetCurrentBtime() - start;
+    if (!buffer) { break; }
+
+    /*
+     * After a failure we only recycle the buffers so the receiving
+     * thread never blocks forever waiting for a free buffer.
+     */
+    if (failed_) {
+      for (auto rec : buffer->attributes) { FreeRecord(rec); }
+      buffer->attributes.clear();
+      EmptyBlock(buffer->block);
+      free_buffers_.enqueue(buffer);
+      gate_.Written();
+      continue;
+    }
+
+    /*
+     * Keep the block numbering continuous and take ownership of the full
+     * block, the buffer gets our old (empty) block in exchange.
+     */
+    buffer->block->BlockNumber = dcr_->block->BlockNumber;
+    std::swap(dcr_->block, buffer->block);
+    attributes.swap(buffer->attributes);
+    free_buffers_.enqueue(buffer);
+
+    if (!dcr_->WriteBlockToDevice()) {
+      Dmsg2(90, "Got WriteBlockToDev error on device %s. %s\n",
+            dcr_->dev->print_name(), dcr_->dev->bstrerror());
+      failed_ = true;
+      for (auto rec : attributes) { FreeRecord(rec); }
+      attributes.clear();
+      gate_.Written();
+      continue;
+    }
+
+    P(written_mutex_);
+    written_attributes_.insert(written_attributes_.end(), attributes.begin(),
+                               attributes.end());
+    V(written_mutex_);
+    attributes.clear();
+    gate_.Written();
+  }
+}
+
+void* AppendWriter::writer_thread(void* data)
+{
+  AppendWriter* writer = (AppendWriter*)data;
+
+  SetJcrInThreadSpecificData(writer->dcr_->jcr);
+  writer->WriteBuffers();
+
+  return NULL;
+}
+
+} /* namespace storagedaemon */
@@ -0,0 +1,132 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Asynchronous block writer used by the append path of the Storage daemon.
+ *
+ * The thread receiving data from the File daemon fills DeviceBlocks while a
+ * dedicated writer thread writes the previously filled blocks to the device.
+ * The number of blocks in flight is configured with the "Append Buffers"
+ * directive of the Device resource, or derived from the "Streaming Buffer
+ * Size" directive which also makes the writer thread wait for a high
+ * watermark of full blocks before it starts writing.
+ */
+
+#ifndef BAREOS_STORED_APPEND_WRITER_H_
+#define BAREOS_STORED_APPEND_WRITER_H_
+
+#include "lib/cbuf.h"
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+namespace storagedaemon {
+
+class DeviceControlRecord;
+struct DeviceBlock;
+struct DeviceRecord;
+struct RecordFragment;
+class FragmentPacker;
+
+/*
+ * Decides when the writer thread writes. Writing starts once the high
+ * watermark of queued blocks is reached and goes on until the queue has
+ * drained down to the low watermark, so a device like a tape drive gets
+ * the data in bursts at full speed instead of at the rate of a slow client.
+ * Every time writing stops before the end of the job the device runs out of
+ * data, which is counted as an underrun.
+ */
+class WatermarkGate {
+ public:
+  WatermarkGate(int high, int low);
+  ~WatermarkGate();
+
+  void Added();
+  void WaitForDrain();
+  void Written();
+  void Finish();
+
+  int High() const { return high_; }
+  int Low() const { return low_; }
+  uint32_t Underruns() const { return underruns_; }
+
+ private:
+  pthread_mutex_t mutex_ = PTHREAD_MUTEX_INITIALIZER;
+  pthread_cond_t drain_ = PTHREAD_COND_INITIALIZER;
+  int high_;
+  int low_;
+  int queued_ = 0;
+  bool draining_ = false;
+  bool finishing_ = false;
+  std::atomic<uint32_t> underruns_{0};
+};
+
+class AppendWriter {
+ public:
+  using AttributesCallback = std::function<bool(DeviceRecord* rec)>;
+
+  AppendWriter(DeviceControlRecord* dcr,
+               int nr_buffers,
+               AttributesCallback send_attributes);
+  ~AppendWriter();
+
+  bool Start();
+  bool Stop();
+  bool WriteRecord(DeviceRecord* rec);
+  bool WriteRecordFragment(FragmentPacker* packer, RecordFragment* frag);
+  bool QueueAttributes(DeviceRecord* rec);
+  bool Failed() const { return failed_; }
+  btime_t ReceiverStallTime() const { return receiver_stall_; }
+  btime_t WriterStallTime() const { return writer_stall_; }
+  uint32_t Underruns() const { return gate_.Underruns(); }
+
+ private:
+  struct AppendBuffer {
+    DeviceBlock* block = nullptr;
+    std::vector<DeviceRecord*> attributes;
+  };
+
+  DeviceControlRecord* dcr_ = nullptr;
+  AttributesCallback send_attributes_;
+  std::vector<AppendBuffer> buffers_;
+  CircularBuffer free_buffers_;
+  CircularBuffer full_buffers_;
+  WatermarkGate gate_;
+  AppendBuffer* fill_buffer_ = nullptr; /**< Owned by the receiving thread */
+  pthread_mutex_t written_mutex_ = PTHREAD_MUTEX_INITIALIZER;
+  std::vector<DeviceRecord*> written_attributes_; /**< Of written blocks */
+  pthread_t thread_id_;
+  bool running_ = false;
+  std::atomic<bool> failed_{false};
+  btime_t receiver_stall_ = 0; /**< Time spent waiting for a free block */
+  btime_t writer_stall_ = 0;   /**< Time spent waiting for a full block */
+
+  static void* writer_thread(void* data);
+  void WriteBuffers();
+  bool SubmitFillBuffer();
+  bool SendAttributes(std::vector<DeviceRecord*>& attributes);
+  bool SendWrittenAttributes();
+};
+
+} /* namespace storagedaemon */
+
+#endif /* BAREOS_STORED_APPEND_WRITER_H_ */
@@ -32,11 +32,13 @@
 #include "include/bareos.h"
 #include "stored/stored.h"
 #include "stored/stored_globals.h"
+#include "stored/jcr_private.h"
 
 #include "include/jcr.h"
 #include "lib/crypto_cache.h"
 #include "stored/wait.h"
 #include "stored/dev.h"
+#include "stored/spool.h"
 #include "lib/edit.h"
 #include "lib/util.h"
 #include "lib/berrno.h"
@@ -75,6 +77,22 @@ static char OK_media[] =
     " MinBlocksize=%lu MaxBlocksize=%lu\n";
 static char OK_create[] = "1000 OK CreateJobMedia\n";
 
+/**
+ * The readers of a job talk to the Director over clones of the socket of
+ * the job, so a request and the reading of its reply must not be mixed
+ * with the ones of another reader. The same goes for the receiving and
+ * the append writer thread of a backup job, which share the socket.
+ */
+static inline void LockDirector(JobControlRecord* jcr)
+{
+  jcr->impl->dir_mutex->lock();
+}
+
+static inline void UnlockDirector(JobControlRecord* jcr)
+{
+  jcr->impl->dir_mutex->unlock();
+}
+
 /**
  * Common routine for:
  *   DirGetVolumeInfo()
@@ -172,6 +190,7 @@ bool StorageDaemonDeviceControlRecord::DirGetVolumeInfo(
   BareosSocket* dir = jcr->dir_bsock;
 
   P(vol_info_mutex);
+  LockDirector(jcr);
   setVolCatName(VolumeName);
   BashSpaces(getVolCatName());
   dir->fsend(Get_Vol_Info, jcr->Job, getVolCatName(),
@@ -179,6 +198,7 @@ bool StorageDaemonDeviceControlRecord::DirGetVolumeInfo(
   Dmsg1(debuglevel, ">dird %s", dir->msg);
   UnbashSpaces(getVolCatName());
   ok = DoGetVolumeInfo(this);
+  UnlockDirector(jcr);
   V(vol_info_mutex);
 
   return ok;
@@ -211,6 +231,7 @@ bool StorageDaemonDeviceControlRecord::DirFindNextAppendableVolume()
    */
   LockVolumes();
   P(vol_info_mutex);
+  LockDirector(jcr);
   ClearFoundInUse();
 
   PmStrcpy(unwanted_volumes, "");
@@ -262,6 +283,7 @@ bool StorageDaemonDeviceControlRecord::DirFindNextAppendableVolume()
   VolumeName[0] = 0;
 
 get_out:
+  UnlockDirector(jcr);
   V(vol_info_mutex);
   UnlockVolumes();
 
@@ -299,6 +321,7 @@ bool StorageDaemonDeviceControlRecord::DirUpdateVolumeInfo(
    * Lock during Volume update
    */
   P(vol_info_mutex);
+  LockDirector(jcr);
   Dmsg1(debuglevel, "Update cat VolBytes=%lld\n", vol->VolCatBytes);
 
   /*
@@ -344,6 +367,7 @@ bool StorageDaemonDeviceControlRecord::DirUpdateVolumeInfo(
   }
 
 bail_out:
+  UnlockDirector(jcr);
   V(vol_info_mutex);
   return ok;
 }
@@ -372,6 +396,8 @@ bool StorageDaemonDeviceControlRecord::DirCreateJobmediaRecord(bool zero)
   if (!WroteVol) { return true; /* nothing written to tape */ }
 
   WroteVol = false;
+
+  LockDirector(jcr);
   if (zero) {
     /*
      * Send dummy place holder to avoid purging
@@ -386,6 +412,7 @@ bool StorageDaemonDeviceControlRecord::DirCreateJobmediaRecord(bool zero)
   Dmsg1(debuglevel, ">dird %s", dir->msg);
 
   if (dir->recv() <= 0) {
+    UnlockDirector(jcr);
     Dmsg0(debuglevel, "create_jobmedia error BnetRecv\n");
     Jmsg(jcr, M_FATAL, 0, _("Error creating JobMedia record: ERR=%s\n"),
          dir->bstrerror());
@@ -396,8 +423,10 @@ bool StorageDaemonDeviceControlRecord::DirCreateJobmediaRecord(bool zero)
   if (!bstrcmp(dir->msg, OK_create)) {
     Dmsg1(debuglevel, "Bad response from Dir: %s\n", dir->msg);
     Jmsg(jcr, M_FATAL, 0, _("Error creating JobMedia record: %s\n"), dir->msg);
+    UnlockDirector(jcr);
     return false;
   }
+  UnlockDirector(jcr);
 
   return true;
 }
@@ -424,12 +453,14 @@ bool StorageDaemonDeviceControlRecord::DirUpdateFileAttributes(
     DeviceRecord* record)
 {
   BareosSocket* dir = jcr->dir_bsock;
+  bool retval;
   ser_declare;
 
 #ifdef NO_ATTRIBUTES_TEST
   return true;
 #endif
 
+  LockDirector(jcr);
   dir->msg = CheckPoolMemorySize(
       dir->msg, sizeof(FileAttributes) + MAX_NAME_LENGTH +
                     sizeof(DeviceRecord) + record->data_len + 1);
@@ -446,7 +477,14 @@ bool StorageDaemonDeviceControlRecord::DirUpdateFileAttributes(
   dir->message_length = SerLength(dir->msg);
   Dmsg1(1800, ">dird %s", dir->msg); /* Attributes */
 
-  return dir->send();
+  if (AreAttributesSpooled(jcr)) {
+    retval = SpoolAttributes(jcr, dir->msg, dir->message_length);
+  } else {
+    retval = dir->send();
+  }
+  UnlockDirector(jcr);
+
+  return retval;
 }
 
 /**
@@ -0,0 +1,656 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Dedup friendly layout of file volumes.
+ */
+
+#include "include/bareos.h"
+#include "stored/stored.h"
+#include "stored/crc32/crc32.h"
+#include "lib/berrno.h"
+#include "aligned_volume.h"
+
+#include <algorithm>
+
+namespace storagedaemon {
+
+/*
+ * Layout of the metadata file:
+ *
+ * - A volume header with an id, the version and the alignment.
+ * - For every block an entry header, followed by the bytes of the block
+ *   kept in the metadata file. The entry header holds the length of the
+ *   block, the number of bytes following, the offset and length of the
+ *   block's payload in the data file and a checksum of the bytes following.
+ */
+#define ALIGNED_VOLUME_ID "BareosAlignedVol"
+#define ALIGNED_VOLUME_ID_LENGTH 16
+#define ALIGNED_VOLUME_VERSION 1
+#define ALIGNED_VOLUME_HEADER_LENGTH 32
+#define ALIGNED_ENTRY_HEADER_LENGTH 24
+
+#define ALIGNED_METADATA_FILE "metadata"
+#define ALIGNED_DATA_FILE "data"
+
+static inline uint64_t AlignUp(uint64_t offset, uint32_t alignment)
+{
+  return ((offset + alignment - 1) / alignment) * alignment;
+}
+
+static bool ReadFully(int fd, char* buffer, size_t count, uint64_t offset)
+{
+  while (count > 0) {
+    ssize_t n = pread(fd, buffer, count, offset);
+
+    if (n <= 0) {
+      if (n == 0) { errno = EIO; }
+      return false;
+    }
+    buffer += n;
+    count -= n;
+    offset += n;
+  }
+
+  return true;
+}
+
+static bool WriteFully(int fd, const char* buffer, size_t count, uint64_t offset)
+{
+  while (count > 0) {
+    ssize_t n = pwrite(fd, buffer, count, offset);
+
+    if (n <= 0) {
+      if (n == 0) { errno = ENOSPC; }
+      return false;
+    }
+    buffer += n;
+    count -= n;
+    offset += n;
+  }
+
+  return true;
+}
+
+/**
+ * An aligned volume is a directory with a metadata file in it.
+ */
+bool AlignedVolume::IsAlignedVolume(const char* pathname)
+{
+  struct stat st;
+  PoolMem metadata(PM_FNAME);
+
+  if (stat(pathname, &st) != 0 || !S_ISDIR(st.st_mode)) { return false; }
+
+  Mmsg(metadata, "%s/%s", pathname, ALIGNED_METADATA_FILE);
+  return stat(metadata.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+AlignedVolume::~AlignedVolume() { Close(); }
+
+bool AlignedVolume::OpenFiles(int flags)
+{
+  PoolMem fname(PM_FNAME);
+
+  /*
+   * We need to read the metadata file to append to it.
+   */
+  if ((flags & O_ACCMODE) != O_RDONLY) { flags = (flags & ~O_ACCMODE) | O_RDWR; }
+  flags &= ~(O_EXCL | O_TRUNC);
+
+  Mmsg(fname, "%s/%s", path_.c_str(), ALIGNED_METADATA_FILE);
+  if ((meta_fd_ = ::open(fname.c_str(), flags | O_BINARY, mode_)) < 0) {
+    return false;
+  }
+
+  Mmsg(fname, "%s/%s", path_.c_str(), ALIGNED_DATA_FILE);
+  if ((data_fd_ = ::open(fname.c_str(), flags | O_BINARY, mode_)) < 0) {
+    int saved_errno = errno;
+
+    ::close(meta_fd_);
+    meta_fd_ = -1;
+    errno = saved_errno;
+    return false;
+  }
+
+  return true;
+}
+
+bool AlignedVolume::CreateHeader()
+{
+  ser_declare;
+  char header[ALIGNED_VOLUME_HEADER_LENGTH];
+
+  memset(header, 0, sizeof(header));
+  SerBegin(header, ALIGNED_VOLUME_HEADER_LENGTH);
+  SerBytes(ALIGNED_VOLUME_ID, ALIGNED_VOLUME_ID_LENGTH);
+  ser_uint32(ALIGNED_VOLUME_VERSION);
+  ser_uint32(alignment_);
+
+  if (!WriteFully(meta_fd_, header, sizeof(header), 0)) { return false; }
+  meta_end_ = ALIGNED_VOLUME_HEADER_LENGTH;
+
+  return true;
+}
+
+/**
+ * Read the volume header and build the index of all blocks. A partially
+ * written entry at the end, e.g. after a crash, is dropped.
+ */
+bool AlignedVolume::LoadIndex()
+{
+  ser_declare;
+  char header[ALIGNED_VOLUME_HEADER_LENGTH];
+  char id[ALIGNED_VOLUME_ID_LENGTH];
+  uint32_t version;
+  struct stat meta_st, data_st;
+  boffset_t offset = 0;
+
+  if (fstat(meta_fd_, &meta_st) != 0 || fstat(data_fd_, &data_st) != 0) {
+    return false;
+  }
+
+  if (!ReadFully(meta_fd_, header, sizeof(header), 0)) { return false; }
+  UnserBegin(header, ALIGNED_VOLUME_HEADER_LENGTH);
+  UnserBytes(id, ALIGNED_VOLUME_ID_LENGTH);
+  unser_uint32(version);
+  unser_uint32(alignment_);
+  if (memcmp(id, ALIGNED_VOLUME_ID, ALIGNED_VOLUME_ID_LENGTH) != 0 ||
+      version != ALIGNED_VOLUME_VERSION || alignment_ == 0) {
+    Dmsg1(100, "%s is not an aligned volume\n", path_.c_str());
+    errno = EINVAL;
+    return false;
+  }
+
+  meta_end_ = ALIGNED_VOLUME_HEADER_LENGTH;
+  data_end_ = 0;
+  while (meta_end_ + ALIGNED_ENTRY_HEADER_LENGTH <= (uint64_t)meta_st.st_size) {
+    char entry[ALIGNED_ENTRY_HEADER_LENGTH];
+    BlockEntry block;
+
+    if (!ReadFully(meta_fd_, entry, sizeof(entry), meta_end_)) { return false; }
+    UnserBegin(entry, ALIGNED_ENTRY_HEADER_LENGTH);
+    unser_uint32(block.len);
+    unser_uint32(block.meta_len);
+    unser_uint64(block.data_offset);
+    unser_uint32(block.data_len);
+
+    /*
+     * The checksum is verified when the block gets read.
+     */
+    if (meta_end_ + ALIGNED_ENTRY_HEADER_LENGTH + block.meta_len >
+            (uint64_t)meta_st.st_size ||
+        block.data_offset + block.data_len > (uint64_t)data_st.st_size) {
+      Dmsg2(100, "Dropping incomplete block at %llu of volume %s\n",
+            (unsigned long long)offset, path_.c_str());
+      break;
+    }
+
+    block.offset = offset;
+    block.meta_pos = meta_end_;
+    blocks_.push_back(block);
+
+    offset += block.len;
+    meta_end_ += ALIGNED_ENTRY_HEADER_LENGTH + block.meta_len;
+    data_end_ = block.data_offset + block.data_len;
+  }
+
+  if ((flags_ & O_ACCMODE) != O_RDONLY &&
+      meta_end_ < (uint64_t)meta_st.st_size) {
+    if (ftruncate(meta_fd_, meta_end_) != 0) { return false; }
+  }
+
+  return true;
+}
+
+int AlignedVolume::Open(const char* pathname,
+                        int flags,
+                        int mode,
+                        uint32_t alignment)
+{
+  struct stat st;
+
+  Close();
+  path_ = pathname;
+  flags_ = flags;
+  mode_ = mode;
+  alignment_ = alignment;
+
+  if (stat(pathname, &st) != 0) {
+    if (errno != ENOENT || !(flags & O_CREAT) || alignment == 0) { return -1; }
+
+    /*
+     * Give the directory search permission where the files get read
+     * permission.
+     */
+    if (mkdir(pathname, mode | ((mode & 0444) >> 2)) != 0) { return -1; }
+  } else if (!S_ISDIR(st.st_mode)) {
+    errno = ENOTDIR;
+    return -1;
+  }
+
+  if (!OpenFiles(flags)) { return -1; }
+
+  if (fstat(meta_fd_, &st) != 0) { goto bail_out; }
+  if (st.st_size == 0) {
+    if ((flags & O_ACCMODE) != O_RDONLY) {
+      if (alignment_ == 0) {
+        errno = EINVAL;
+        goto bail_out;
+      }
+      if (!CreateHeader()) { goto bail_out; }
+    }
+  } else if (!LoadIndex()) {
+    goto bail_out;
+  }
+
+  Dmsg4(100, "Opened aligned volume %s alignment=%u blocks=%llu data=%llu\n",
+        path_.c_str(), alignment_, (unsigned long long)blocks_.size(),
+        (unsigned long long)data_end_);
+
+  return meta_fd_;
+
+bail_out:
+  int saved_errno = errno;
+
+  Close();
+  errno = saved_errno;
+  return -1;
+}
+
+int AlignedVolume::Close()
+{
+  int status = 0;
+
+  if (meta_fd_ >= 0 && ::close(meta_fd_) != 0) { status = -1; }
+  if (data_fd_ >= 0 && ::close(data_fd_) != 0) { status = -1; }
+  meta_fd_ = -1;
+  data_fd_ = -1;
+  pos_ = 0;
+  meta_end_ = 0;
+  data_end_ = 0;
+  blocks_.clear();
+  cached_block_ = -1;
+
+  return status;
+}
+
+boffset_t AlignedVolume::VolumeSize() const
+{
+  if (blocks_.empty()) { return 0; }
+
+  return blocks_.back().offset + blocks_.back().len;
+}
+
+/**
+ * Find the block holding the byte at offset.
+ */
+ssize_t AlignedVolume::FindBlock(boffset_t offset) const
+{
+  auto it = std::upper_bound(
+      blocks_.begin(), blocks_.end(), offset,
+      [](boffset_t value, const BlockEntry& block) {
+        return value < block.offset;
+      });
+
+  if (it == blocks_.begin()) { return -1; }
+  --it;
+  if (offset >= it->offset + (boffset_t)it->len) { return -1; }
+
+  return it - blocks_.begin();
+}
+
+/**
+ * Split a block in the parts kept in the metadata file and the payloads
+ * going to the data file, calling fill for each part in block order.
+ *
+ * Reading reassembles the block with the same walk, fill then copies each
+ * part into the block before it gets looked at. Payloads of records smaller
+ * than the alignment stay in the metadata file, every other record starts
+ * at an aligned offset in the data file. The continuation of a record
+ * split over blocks always goes to the data file right after the previous
+ * part so file data keeps its alignment.
+ *
+ * Returns the end of the payloads in the data file.
+ */
+uint64_t AlignedVolume::WalkBlock(
+    char* block,
+    uint32_t len,
+    uint64_t data_offset,
+    const std::function<void(const Segment&)>& fill) const
+{
+  ser_declare;
+  uint32_t pos = 0;
+  uint32_t limit;
+  uint64_t data_pos = data_offset;
+
+  auto emit = [&](bool in_data, uint32_t n) {
+    Segment segment = {in_data, pos, n, data_pos};
+
+    fill(segment);
+    pos += n;
+    if (in_data) { data_pos += n; }
+  };
+
+  /*
+   * Only blocks in the current format get split, anything else is kept
+   * in the metadata file as is.
+   */
+  limit = MIN(len, BLKHDR2_LENGTH);
+  emit(false, limit);
+  if (limit == BLKHDR2_LENGTH &&
+      memcmp(block + BLKHDR_CS_LENGTH + 2 * sizeof(uint32_t), BLKHDR2_ID,
+             BLKHDR_ID_LENGTH) == 0) {
+    uint32_t block_len;
+
+    UnserBegin(block + BLKHDR_CS_LENGTH, sizeof(uint32_t));
+    unser_uint32(block_len);
+    if (block_len >= BLKHDR2_LENGTH && block_len <= len) { limit = block_len; }
+  }
+
+  while (pos + RECHDR2_LENGTH <= limit) {
+    int32_t Stream;
+    uint32_t data_bytes, n;
+
+    /*
+     * Skip the FileIndex, only the Stream and the length matter.
+     */
+    emit(false, RECHDR2_LENGTH);
+    UnserBegin(block + pos - RECHDR2_LENGTH + sizeof(int32_t),
+               RECHDR2_LENGTH - sizeof(int32_t));
+    unser_int32(Stream);
+    unser_uint32(data_bytes);
+
+    n = MIN(data_bytes, limit - pos);
+    if (n == 0) { continue; }
+
+    if (Stream < 0) {
+      emit(true, n);
+    } else if (data_bytes >= alignment_) {
+      data_pos = AlignUp(data_pos, alignment_);
+      emit(true, n);
+    } else {
+      emit(false, n);
+    }
+  }
+
+  if (pos < len) { emit(false, len - pos); }
+
+  return data_pos;
+}
+
+/**
+ * Reassemble a block from the metadata and data file.
+ */
+bool AlignedVolume::ReadBlock(size_t index)
+{
+  const BlockEntry& block = blocks_[index];
+  uint32_t meta_used = 0;
+  uint32_t checksum;
+  bool ok = true;
+  ser_declare;
+
+  if (cached_block_ == (ssize_t)index) { return true; }
+
+  meta_buf_.resize(ALIGNED_ENTRY_HEADER_LENGTH + block.meta_len);
+  data_buf_.resize(block.data_len);
+  if (!ReadFully(meta_fd_, meta_buf_.data(), meta_buf_.size(),
+                 block.meta_pos) ||
+      !ReadFully(data_fd_, data_buf_.data(), data_buf_.size(),
+                 block.data_offset)) {
+    return false;
+  }
+
+  UnserBegin(meta_buf_.data() + ALIGNED_ENTRY_HEADER_LENGTH - sizeof(uint32_t),
+             sizeof(uint32_t));
+  unser_uint32(checksum);
+  if (checksum != crc32_fast(meta_buf_.data() + ALIGNED_ENTRY_HEADER_LENGTH,
+                             block.meta_len)) {
+    Dmsg2(100, "Checksum error in metadata of block at %llu of volume %s\n",
+          (unsigned long long)block.offset, path_.c_str());
+    errno = EIO;
+    return false;
+  }
+
+  block_buf_.resize(block.len);
+  WalkBlock(block_buf_.data(), block.len, block.data_offset,
+            [&](const Segment& segment) {
+              char* dest = block_buf_.data() + segment.pos;
+
+              if (segment.in_data) {
+                uint64_t offset = segment.data_pos - block.data_offset;
+
+                if (offset + segment.len > block.data_len) {
+                  memset(dest, 0, segment.len);
+                  ok = false;
+                  return;
+                }
+                memcpy(dest, data_buf_.data() + offset, segment.len);
+              } else {
+                if (meta_used + segment.len > block.meta_len) {
+                  memset(dest, 0, segment.len);
+                  ok = false;
+                  return;
+                }
+                memcpy(dest,
+                       meta_buf_.data() + ALIGNED_ENTRY_HEADER_LENGTH +
+                           meta_used,
+                       segment.len);
+                meta_used += segment.len;
+              }
+            });
+
+  if (!ok || meta_used != block.meta_len) {
+    Dmsg2(100, "Inconsistent block at %llu of volume %s\n",
+          (unsigned long long)block.offset, path_.c_str());
+    errno = EIO;
+    return false;
+  }
+
+  cached_block_ = index;
+  return true;
+}
+
+ssize_t AlignedVolume::Read(void* buffer, size_t count)
+{
+  char* dest = (char*)buffer;
+  size_t done = 0;
+
+  while (done < count) {
+    ssize_t index = FindBlock(pos_);
+    uint32_t offset, n;
+
+    if (index < 0) { break; }
+    if (!ReadBlock(index)) {
+      if (done > 0) { break; }
+      return -1;
+    }
+
+    offset = pos_ - blocks_[index].offset;
+    n = MIN(count - done, blocks_[index].len - offset);
+    memcpy(dest + done, block_buf_.data() + offset, n);
+    done += n;
+    pos_ += n;
+  }
+
+  return done;
+}
+
+/**
+ * Forget all blocks from index on, writing never leaves a hole.
+ */
+void AlignedVolume::DropBlocksFrom(size_t index)
+{
+  meta_end_ = blocks_[index].meta_pos;
+  data_end_ = blocks_[index].data_offset;
+  blocks_.resize(index);
+  cached_block_ = -1;
+
+  if (ftruncate(meta_fd_, meta_end_) != 0 ||
+      ftruncate(data_fd_, data_end_) != 0) {
+    BErrNo be;
+
+    Dmsg2(100, "Unable to truncate aligned volume %s. ERR=%s\n",
+          path_.c_str(), be.bstrerror());
+  }
+}
+
+/**
+ * Write one block, blocks are only written at the end of the volume or
+ * overwrite the volume from the start of an existing block on.
+ */
+ssize_t AlignedVolume::Write(const void* buffer, size_t count)
+{
+  char* block = (char*)buffer;
+  std::vector<Segment> segments;
+  BlockEntry entry;
+  uint32_t checksum;
+  ser_declare;
+
+  if (count == 0) { return 0; }
+  if (count > MAX_BLOCK_LENGTH) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (pos_ != VolumeSize()) {
+    ssize_t index = FindBlock(pos_);
+
+    if (index < 0 || blocks_[index].offset != pos_) {
+      errno = EINVAL;
+      return -1;
+    }
+    DropBlocksFrom(index);
+  }
+
+  entry.offset = pos_;
+  entry.meta_pos = meta_end_;
+  entry.data_offset = data_end_;
+  entry.len = count;
+  entry.data_len =
+      WalkBlock(block, count, data_end_, [&segments](const Segment& segment) {
+        segments.push_back(segment);
+      }) -
+      data_end_;
+
+  /*
+   * Gaps between the payloads are written as zeros.
+   */
+  meta_buf_.resize(ALIGNED_ENTRY_HEADER_LENGTH);
+  data_buf_.assign(entry.data_len, 0);
+  for (const Segment& segment : segments) {
+    if (segment.in_data) {
+      memcpy(data_buf_.data() + (segment.data_pos - entry.data_offset),
+             block + segment.pos, segment.len);
+    } else {
+      meta_buf_.insert(meta_buf_.end(), block + segment.pos,
+                       block + segment.pos + segment.len);
+    }
+  }
+  entry.meta_len = meta_buf_.size() - ALIGNED_ENTRY_HEADER_LENGTH;
+  checksum =
+      crc32_fast(meta_buf_.data() + ALIGNED_ENTRY_HEADER_LENGTH, entry.meta_len);
+
+  SerBegin(meta_buf_.data(), ALIGNED_ENTRY_HEADER_LENGTH);
+  ser_uint32(entry.len);
+  ser_uint32(entry.meta_len);
+  ser_uint64(entry.data_offset);
+  ser_uint32(entry.data_len);
+  ser_uint32(checksum);
+
+  /*
+   * The payloads are written first, a block is only found on reopening
+   * the volume when its entry made it to the metadata file.
+   */
+  if (!WriteFully(data_fd_, data_buf_.data(), data_buf_.size(),
+                  entry.data_offset) ||
+      !WriteFully(meta_fd_, meta_buf_.data(), meta_buf_.size(),
+                  entry.meta_pos)) {
+    return -1;
+  }
+
+  blocks_.push_back(entry);
+  meta_end_ += meta_buf_.size();
+  data_end_ += entry.data_len;
+  pos_ += count;
+
+  return count;
+}
+
+boffset_t AlignedVolume::Seek(boffset_t offset, int whence)
+{
+  boffset_t pos;
+
+  switch (whence) {
+    case SEEK_SET:
+      pos = offset;
+      break;
+    case SEEK_CUR:
+      pos = pos_ + offset;
+      break;
+    case SEEK_END:
+      pos = VolumeSize() + offset;
+      break;
+    default:
+      errno = EINVAL;
+      return -1;
+  }
+
+  if (pos < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  pos_ = pos;
+  return pos;
+}
+
+/**
+ * Empty the volume keeping its alignment. With secure erase the files get
+ * erased and recreated.
+ */
+bool AlignedVolume::Truncate(JobControlRecord* jcr, bool secure_erase)
+{
+  if (secure_erase) {
+    PoolMem fname(PM_FNAME);
+
+    ::close(meta_fd_);
+    ::close(data_fd_);
+    meta_fd_ = data_fd_ = -1;
+
+    Mmsg(fname, "%s/%s", path_.c_str(), ALIGNED_METADATA_FILE);
+    SecureErase(jcr, fname.c_str());
+    Mmsg(fname, "%s/%s", path_.c_str(), ALIGNED_DATA_FILE);
+    SecureErase(jcr, fname.c_str());
+
+    if (!OpenFiles(O_CREAT | O_RDWR)) { return false; }
+  } else if (ftruncate(meta_fd_, 0) != 0 || ftruncate(data_fd_, 0) != 0) {
+    return false;
+  }
+
+  pos_ = 0;
+  data_end_ = 0;
+  blocks_.clear();
+  cached_block_ = -1;
+
+  return CreateHeader();
+}
+
+} /* namespace storagedaemon */
@@ -0,0 +1,116 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Dedup friendly layout of file volumes.
+ *
+ * An aligned volume is a directory holding two files. The data file gets
+ * the payload of all larger records, each record starting at a multiple of
+ * the alignment. The metadata file gets the block and record headers, the
+ * payload of small records and an index entry per block. Reading
+ * reassembles the blocks so the rest of the storage daemon sees the same
+ * byte stream as with a plain file volume.
+ */
+
+#ifndef BAREOS_STORED_BACKENDS_ALIGNED_VOLUME_H_
+#define BAREOS_STORED_BACKENDS_ALIGNED_VOLUME_H_
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace storagedaemon {
+
+class AlignedVolume {
+ public:
+  AlignedVolume() = default;
+  ~AlignedVolume();
+
+  static bool IsAlignedVolume(const char* pathname);
+
+  /*
+   * Open or, with O_CREAT, create the volume. The alignment is only used
+   * for a new volume, existing volumes keep the one they were created with.
+   * Returns the file descriptor of the metadata file or -1 with errno set.
+   */
+  int Open(const char* pathname, int flags, int mode, uint32_t alignment);
+  int Close();
+  ssize_t Read(void* buffer, size_t count);
+  ssize_t Write(const void* buffer, size_t count);
+  boffset_t Seek(boffset_t offset, int whence);
+  bool Truncate(JobControlRecord* jcr, bool secure_erase);
+
+  int Fd() const { return meta_fd_; }
+
+  uint32_t Alignment() const { return alignment_; }
+  uint64_t DataBytes() const { return data_end_; }
+
+ private:
+  struct BlockEntry {
+    boffset_t offset;     /* Offset of the block in the volume */
+    uint64_t meta_pos;    /* Offset of the entry in the metadata file */
+    uint64_t data_offset; /* Offset of the first payload in the data file */
+    uint32_t len;         /* Length of the block */
+    uint32_t meta_len;    /* Bytes of the block kept in the metadata file */
+    uint32_t data_len;    /* Bytes used in the data file including padding */
+  };
+
+  struct Segment {
+    bool in_data;      /* Stored in the data file or the metadata file */
+    uint32_t pos;      /* Offset in the block */
+    uint32_t len;      /* Length of the segment */
+    uint64_t data_pos; /* Offset in the data file */
+  };
+
+  std::string path_;
+  int flags_ = 0;
+  int mode_ = 0;
+  int meta_fd_ = -1;
+  int data_fd_ = -1;
+  uint32_t alignment_ = 0;
+  boffset_t pos_ = 0;
+  uint64_t meta_end_ = 0;
+  uint64_t data_end_ = 0;
+  std::vector<BlockEntry> blocks_;
+
+  /*
+   * Last block reassembled for reading.
+   */
+  ssize_t cached_block_ = -1;
+  std::vector<char> block_buf_;
+  std::vector<char> meta_buf_;
+  std::vector<char> data_buf_;
+
+  bool OpenFiles(int flags);
+  bool CreateHeader();
+  bool LoadIndex();
+  boffset_t VolumeSize() const;
+  ssize_t FindBlock(boffset_t offset) const;
+  bool ReadBlock(size_t index);
+  void DropBlocksFrom(size_t index);
+  uint64_t WalkBlock(char* block,
+                     uint32_t len,
+                     uint64_t data_offset,
+                     const std::function<void(const Segment&)>& fill) const;
+};
+
+} /* namespace storagedaemon */
+
+#endif /* BAREOS_STORED_BACKENDS_ALIGNED_VOLUME_H_ */
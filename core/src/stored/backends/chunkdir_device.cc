@@ -0,0 +1,636 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Chunked volumes stored as files in a local directory. Each volume is a
+ * sub-directory of the Archive Device holding its chunks as files named
+ * 0000-9999, the same layout the droplet backend uses in a bucket.
+ *
+ * As it needs no external service it is used to measure and tune the
+ * chunked device (io-threads, chunksize, retries) by injecting latency,
+ * bandwidth limits and upload failures, and as a fast staging tier.
+ *
+ * Stacking is the following:
+ *
+ *   chunkdir_device::
+ *         |
+ *         v
+ *   chunked_device::
+ *         |
+ *         v
+ *       Device::
+ *
+ */
+/**
+ * @file
+ * Local directory chunked device abstraction.
+ */
+
+#include "include/bareos.h"
+#include "stored/stored.h"
+#include "chunked_device.h"
+#include "chunkdir_device.h"
+#include "lib/berrno.h"
+#include "lib/edit.h"
+
+namespace storagedaemon {
+
+/**
+ * Options that can be specified for this device type.
+ */
+enum device_option_type
+{
+  argument_none = 0,
+  argument_chunksize,
+  argument_iothreads,
+  argument_ioslots,
+  argument_retries,
+  argument_mmap,
+  argument_prefetch,
+  argument_latency,
+  argument_bandwidth,
+  argument_failevery
+};
+
+struct device_option {
+  const char* name;
+  enum device_option_type type;
+  int compare_size;
+};
+
+static device_option device_options[] = {
+    {"chunksize=", argument_chunksize, 10},
+    {"iothreads=", argument_iothreads, 10},
+    {"ioslots=", argument_ioslots, 8},
+    {"retries=", argument_retries, 8},
+    {"mmap", argument_mmap, 4},
+    {"prefetch=", argument_prefetch, 9},
+    {"latency=", argument_latency, 8},
+    {"bandwidth=", argument_bandwidth, 10},
+    {"failevery=", argument_failevery, 10},
+    {NULL, argument_none}};
+
+/*
+ * A chunk file name is the chunk number in 4 digits.
+ */
+static inline bool IsChunkName(const char* name)
+{
+  return strlen(name) == 4 && B_ISDIGIT(name[0]) && B_ISDIGIT(name[1]) &&
+         B_ISDIGIT(name[2]) && B_ISDIGIT(name[3]);
+}
+
+void chunkdir_device::ChunkDir(const char* volname, PoolMem& dir)
+{
+  Mmsg(dir, "%s/%s", dev_name, volname);
+}
+
+void chunkdir_device::ChunkName(const char* volname,
+                                uint16_t chunk,
+                                PoolMem& name)
+{
+  Mmsg(name, "%s/%s/%04d", dev_name, volname, chunk);
+}
+
+/*
+ * Simulate the round trip and transfer time of a remote backing store.
+ */
+void chunkdir_device::InjectDelay(uint32_t len)
+{
+  uint64_t usecs;
+
+  usecs = (uint64_t)latency_ * 1000;
+  if (bandwidth_) { usecs += ((uint64_t)len * 1000000) / bandwidth_; }
+
+  if (usecs) { Bmicrosleep(usecs / 1000000, usecs % 1000000); }
+}
+
+/*
+ * See if this chunk upload should fail, so the retry logic can be tested.
+ */
+bool chunkdir_device::InjectFailure()
+{
+  bool retval;
+
+  if (!fail_every_) { return false; }
+
+  P(flushes_lock_);
+  retval = (++flushes_ % fail_every_) == 0;
+  V(flushes_lock_);
+
+  return retval;
+}
+
+/**
+ * Checks if the Archive Device directory is usable.
+ *
+ * Returns true  - if the directory can be accessed
+ *         false - otherwise
+ */
+bool chunkdir_device::CheckRemote()
+{
+  struct stat st;
+
+  if (!initialize()) { return false; }
+
+  if (stat(dev_name, &st) != 0 || !S_ISDIR(st.st_mode) ||
+      access(dev_name, R_OK | W_OK | X_OK) != 0) {
+    Dmsg1(100, "CheckRemote(%s): failed\n", prt_name);
+    return false;
+  }
+
+  Dmsg1(100, "CheckRemote(%s): ok\n", prt_name);
+
+  return true;
+}
+
+bool chunkdir_device::remote_chunked_volume_exists()
+{
+  struct stat st;
+  PoolMem chunk_dir(PM_FNAME);
+
+  if (!CheckRemote()) { return false; }
+
+  ChunkDir(getVolCatName(), chunk_dir);
+  if (stat(chunk_dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+    Dmsg1(100, "remote_chunked_volume %s exists\n", chunk_dir.c_str());
+    return true;
+  }
+
+  Dmsg1(100, "remote_chunked_volume %s does not exists\n", chunk_dir.c_str());
+
+  return false;
+}
+
+/*
+ * Internal method for flushing a chunk to the backing store.
+ * This does the real work either by being called from a
+ * io-thread or directly blocking the device.
+ */
+bool chunkdir_device::FlushRemoteChunk(chunk_io_request* request)
+{
+  int fd = -1;
+  bool retval = false;
+  struct stat st;
+  const char* buffer;
+  uint32_t len;
+  ssize_t status;
+  PoolMem chunk_dir(PM_FNAME), chunk_name(PM_FNAME), temp_name(PM_FNAME);
+
+  ChunkDir(request->volname, chunk_dir);
+  ChunkName(request->volname, request->chunk, chunk_name);
+  Mmsg(temp_name, "%s.tmp", chunk_name.c_str());
+
+  /*
+   * Set that we are uploading the chunk.
+   */
+  if (!SetInflightChunk(request)) { return false; }
+
+  Dmsg1(100, "Flushing chunk %s\n", chunk_name.c_str());
+
+  InjectDelay(request->wbuflen);
+  if (InjectFailure()) {
+    Mmsg1(errmsg, _("Injected failure flushing chunk %s\n"),
+          chunk_name.c_str());
+    dev_errno = EIO;
+    goto bail_out;
+  }
+
+  /*
+   * Only replace the chunk when we have more data than the existing one, see
+   * droplet_device::FlushRemoteChunk() for why there can be several flushes
+   * of the same chunk.
+   */
+  if (stat(chunk_name.c_str(), &st) == 0) {
+    if (st.st_size > request->wbuflen) {
+      retval = true;
+      goto bail_out;
+    }
+  } else if (mkdir(chunk_dir.c_str(), 0750) != 0 && errno != EEXIST) {
+    BErrNo be;
+
+    Mmsg2(errmsg, _("Failed to create directory %s: ERR=%s\n"),
+          chunk_dir.c_str(), be.bstrerror());
+    dev_errno = be.code();
+    goto bail_out;
+  }
+
+  /*
+   * Write the chunk to a temporary file and rename it, so nobody ever reads
+   * a partially written chunk.
+   */
+  fd = ::open(temp_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0640);
+  if (fd < 0) {
+    BErrNo be;
+
+    Mmsg2(errmsg, _("Failed to create %s: ERR=%s\n"), temp_name.c_str(),
+          be.bstrerror());
+    dev_errno = be.code();
+    goto bail_out;
+  }
+
+  buffer = request->buffer;
+  len = request->wbuflen;
+  while (len > 0) {
+    status = ::write(fd, buffer, len);
+    if (status < 0 && errno == EINTR) { continue; }
+    if (status <= 0) {
+      BErrNo be;
+
+      Mmsg2(errmsg, _("Failed to write %s: ERR=%s\n"), temp_name.c_str(),
+            be.bstrerror());
+      dev_errno = (status < 0) ? be.code() : ENOSPC;
+      goto bail_out;
+    }
+    buffer += status;
+    len -= status;
+  }
+
+  if (fsync(fd) != 0 || ::close(fd) != 0) {
+    BErrNo be;
+
+    fd = -1;
+    Mmsg2(errmsg, _("Failed to flush %s: ERR=%s\n"), temp_name.c_str(),
+          be.bstrerror());
+    dev_errno = be.code();
+    goto bail_out;
+  }
+  fd = -1;
+
+  if (rename(temp_name.c_str(), chunk_name.c_str()) != 0) {
+    BErrNo be;
+
+    Mmsg3(errmsg, _("Failed to rename %s to %s: ERR=%s\n"), temp_name.c_str(),
+          chunk_name.c_str(), be.bstrerror());
+    dev_errno = be.code();
+    goto bail_out;
+  }
+
+  retval = true;
+
+bail_out:
+  if (!retval) {
+    if (fd >= 0) { ::close(fd); }
+    unlink(temp_name.c_str());
+  }
+
+  /*
+   * Clear that we are uploading the chunk.
+   */
+  ClearInflightChunk(request);
+
+  return retval;
+}
+
+/*
+ * Internal method for reading a chunk from the backing store.
+ */
+bool chunkdir_device::ReadRemoteChunk(chunk_io_request* request)
+{
+  int fd;
+  bool retval = false;
+  struct stat st;
+  char* buffer;
+  uint32_t len;
+  ssize_t status;
+  PoolMem chunk_name(PM_FNAME);
+
+  ChunkName(request->volname, request->chunk, chunk_name);
+  Dmsg1(100, "Reading chunk %s\n", chunk_name.c_str());
+
+  fd = ::open(chunk_name.c_str(), O_RDONLY | O_BINARY);
+  if (fd < 0) {
+    Mmsg1(errmsg, _("Failed to open %s doesn't exist\n"), chunk_name.c_str());
+    Dmsg1(100, "%s", errmsg);
+    dev_errno = EIO;
+    InjectDelay(0);
+    return false;
+  }
+
+  if (fstat(fd, &st) != 0) {
+    BErrNo be;
+
+    Mmsg2(errmsg, _("Failed to stat %s: ERR=%s\n"), chunk_name.c_str(),
+          be.bstrerror());
+    dev_errno = be.code();
+    goto bail_out;
+  }
+
+  if (st.st_size > request->wbuflen) {
+    Mmsg3(
+        errmsg,
+        _("Failed to read %s (%ld) to big to fit in chunksize of %ld bytes\n"),
+        chunk_name.c_str(), st.st_size, request->wbuflen);
+    Dmsg1(100, "%s", errmsg);
+    dev_errno = EINVAL;
+    goto bail_out;
+  }
+
+  InjectDelay(st.st_size);
+
+  buffer = request->buffer;
+  len = st.st_size;
+  while (len > 0) {
+    status = ::read(fd, buffer, len);
+    if (status < 0 && errno == EINTR) { continue; }
+    if (status <= 0) {
+      BErrNo be;
+
+      Mmsg2(errmsg, _("Failed to read %s: ERR=%s\n"), chunk_name.c_str(),
+            (status < 0) ? be.bstrerror() : _("short read"));
+      dev_errno = EIO;
+      goto bail_out;
+    }
+    buffer += status;
+    len -= status;
+  }
+  *request->rbuflen = st.st_size;
+
+  retval = true;
+
+bail_out:
+  ::close(fd);
+
+  return retval;
+}
+
+/*
+ * Internal method for truncating a chunked volume on the backing store.
+ */
+bool chunkdir_device::TruncateRemoteChunkedVolume(DeviceControlRecord* dcr)
+{
+  DIR* dp;
+  struct dirent* entry;
+  bool retval = true;
+  PoolMem chunk_dir(PM_FNAME), chunk_name(PM_FNAME);
+
+  Dmsg1(100, "truncate_remote_chunked_volume(%s) start.\n", getVolCatName());
+
+  ChunkDir(getVolCatName(), chunk_dir);
+  InjectDelay(0);
+  if (!(dp = opendir(chunk_dir.c_str()))) {
+    BErrNo be;
+
+    if (be.code() == ENOENT) { return true; }
+    Mmsg2(errmsg, _("Failed to open directory %s: ERR=%s\n"),
+          chunk_dir.c_str(), be.bstrerror());
+    dev_errno = be.code();
+    return false;
+  }
+
+  while ((entry = readdir(dp))) {
+    if (!IsChunkName(entry->d_name)) { continue; }
+
+    Mmsg(chunk_name, "%s/%s", chunk_dir.c_str(), entry->d_name);
+    if (unlink(chunk_name.c_str()) != 0) {
+      BErrNo be;
+
+      Mmsg2(errmsg, _("Failed to remove chunk %s: ERR=%s\n"),
+            chunk_name.c_str(), be.bstrerror());
+      dev_errno = be.code();
+      retval = false;
+      break;
+    }
+  }
+  closedir(dp);
+
+  Dmsg1(100, "truncate_remote_chunked_volume(%s) finished.\n", getVolCatName());
+
+  return retval;
+}
+
+bool chunkdir_device::d_flush(DeviceControlRecord* dcr)
+{
+  return WaitUntilChunksWritten();
+};
+
+/*
+ * Parse the device options.
+ */
+bool chunkdir_device::initialize()
+{
+  bool done;
+  uint64_t value;
+  char *bp, *next_option;
+
+  if (initialized_) { return true; }
+
+  if (dev_options) {
+    configstring_ = strdup(dev_options);
+
+    bp = configstring_;
+    while (bp) {
+      next_option = strchr(bp, ',');
+      if (next_option) { *next_option++ = '\0'; }
+
+      done = false;
+      for (int i = 0; !done && device_options[i].name; i++) {
+        /*
+         * Try to find a matching device option.
+         */
+        if (bstrncasecmp(bp, device_options[i].name,
+                         device_options[i].compare_size)) {
+          switch (device_options[i].type) {
+            case argument_chunksize:
+              size_to_uint64(bp + device_options[i].compare_size, &value);
+              chunk_size_ = value;
+              done = true;
+              break;
+            case argument_iothreads:
+              size_to_uint64(bp + device_options[i].compare_size, &value);
+              io_threads_ = value & 0xFF;
+              done = true;
+              break;
+            case argument_ioslots:
+              size_to_uint64(bp + device_options[i].compare_size, &value);
+              io_slots_ = value & 0xFF;
+              done = true;
+              break;
+            case argument_retries:
+              size_to_uint64(bp + device_options[i].compare_size, &value);
+              retries_ = value & 0xFF;
+              done = true;
+              break;
+            case argument_mmap:
+              use_mmap_ = true;
+              done = true;
+              break;
+            case argument_prefetch:
+              size_to_uint64(bp + device_options[i].compare_size, &value);
+              prefetch_chunks_ = value & 0xFF;
+              done = true;
+              break;
+            case argument_latency:
+              latency_ = str_to_uint32(bp + device_options[i].compare_size);
+              done = true;
+              break;
+            case argument_bandwidth:
+              size_to_uint64(bp + device_options[i].compare_size, &value);
+              bandwidth_ = value;
+              done = true;
+              break;
+            case argument_failevery:
+              fail_every_ = str_to_uint32(bp + device_options[i].compare_size);
+              done = true;
+              break;
+            default:
+              break;
+          }
+        }
+      }
+
+      if (!done) {
+        Mmsg1(errmsg, _("Unable to parse device option: %s\n"), bp);
+        Emsg0(M_FATAL, 0, errmsg);
+        return false;
+      }
+
+      bp = next_option;
+    }
+  }
+
+  initialized_ = true;
+
+  return true;
+}
+
+int chunkdir_device::d_open(const char* pathname, int flags, int mode)
+{
+  if (!initialize()) { return -1; }
+
+  return SetupChunk(pathname, flags, mode);
+}
+
+ssize_t chunkdir_device::d_read(int fd, void* buffer, size_t count)
+{
+  return ReadChunked(fd, buffer, count);
+}
+
+ssize_t chunkdir_device::d_write(int fd, const void* buffer, size_t count)
+{
+  return WriteChunked(fd, buffer, count);
+}
+
+int chunkdir_device::d_close(int fd) { return CloseChunk(); }
+
+int chunkdir_device::d_ioctl(int fd, ioctl_req_t request, char* op)
+{
+  return -1;
+}
+
+/**
+ * Sum up the sizes of the chunks of a volume.
+ */
+ssize_t chunkdir_device::chunked_remote_volume_size()
+{
+  struct stat st;
+  ssize_t volumesize = 0;
+  PoolMem chunk_name(PM_FNAME);
+
+  Dmsg1(100, "get chunked_remote_volume_size(%s)\n", getVolCatName());
+
+  InjectDelay(0);
+  for (int i = 0; i < MAX_CHUNKS; i++) {
+    ChunkName(getVolCatName(), i, chunk_name);
+    if (stat(chunk_name.c_str(), &st) != 0) { break; }
+    volumesize += st.st_size;
+  }
+
+  Dmsg2(100, "Size of volume %s: %lld\n", getVolCatName(), volumesize);
+
+  return volumesize;
+}
+
+boffset_t chunkdir_device::d_lseek(DeviceControlRecord* dcr,
+                                   boffset_t offset,
+                                   int whence)
+{
+  switch (whence) {
+    case SEEK_SET:
+      offset_ = offset;
+      break;
+    case SEEK_CUR:
+      offset_ += offset;
+      break;
+    case SEEK_END: {
+      ssize_t volumesize;
+
+      volumesize = ChunkedVolumeSize();
+
+      Dmsg1(100, "Current volumesize: %lld\n", volumesize);
+
+      if (volumesize >= 0) {
+        offset_ = volumesize + offset;
+      } else {
+        return -1;
+      }
+      break;
+    }
+    default:
+      return -1;
+  }
+
+  if (!LoadChunk()) { return -1; }
+
+  return offset_;
+}
+
+bool chunkdir_device::d_truncate(DeviceControlRecord* dcr)
+{
+  return TruncateChunkedVolume(dcr);
+}
+
+chunkdir_device::~chunkdir_device()
+{
+  if (configstring_) { free(configstring_); }
+  pthread_mutex_destroy(&flushes_lock_);
+}
+
+chunkdir_device::chunkdir_device()
+{
+  configstring_ = NULL;
+  initialized_ = false;
+  latency_ = 0;
+  bandwidth_ = 0;
+  fail_every_ = 0;
+  flushes_ = 0;
+  pthread_mutex_init(&flushes_lock_, NULL);
+}
+
+#ifdef HAVE_DYNAMIC_SD_BACKENDS
+extern "C" Device* backend_instantiate(JobControlRecord* jcr, int device_type)
+{
+  Device* dev = NULL;
+
+  switch (device_type) {
+    case B_CHUNKDIR_DEV:
+      dev = new chunkdir_device;
+      break;
+    default:
+      Jmsg(jcr, M_FATAL, 0, _("Request for unknown devicetype: %d\n"),
+           device_type);
+      break;
+  }
+
+  return dev;
+}
+
+extern "C" void flush_backend(void) {}
+#endif
+} /* namespace storagedaemon */
@@ -0,0 +1,86 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Chunked volumes stored as files in a local directory.
+ */
+
+#ifndef BAREOS_STORED_BACKENDS_CHUNKDIR_DEVICE_H_
+#define BAREOS_STORED_BACKENDS_CHUNKDIR_DEVICE_H_
+
+namespace storagedaemon {
+
+class chunkdir_device : public chunked_device {
+ private:
+  /*
+   * Private Members
+   */
+  char* configstring_;
+  bool initialized_;
+  uint32_t latency_;    /* Injected latency per chunk in milliseconds */
+  uint64_t bandwidth_;  /* Injected bandwidth limit in bytes per second */
+  uint32_t fail_every_; /* Let every n-th chunk upload fail */
+  uint32_t flushes_;    /* Number of chunk uploads tried */
+  pthread_mutex_t flushes_lock_;
+
+  /*
+   * Private Methods
+   */
+  bool initialize();
+  void ChunkDir(const char* volname, PoolMem& dir);
+  void ChunkName(const char* volname, uint16_t chunk, PoolMem& name);
+  void InjectDelay(uint32_t len);
+  bool InjectFailure();
+
+  /*
+   * Interface from chunked_device
+   */
+  bool CheckRemote() override;
+  bool remote_chunked_volume_exists() override;
+  bool FlushRemoteChunk(chunk_io_request* request) override;
+  bool ReadRemoteChunk(chunk_io_request* request) override;
+  ssize_t chunked_remote_volume_size() override;
+  bool TruncateRemoteChunkedVolume(DeviceControlRecord* dcr) override;
+
+ public:
+  /*
+   * Public Methods
+   */
+  chunkdir_device();
+  ~chunkdir_device();
+
+  /*
+   * Interface from Device
+   */
+  int d_close(int fd) override;
+  int d_open(const char* pathname, int flags, int mode) override;
+  int d_ioctl(int fd, ioctl_req_t request, char* mt = NULL) override;
+  boffset_t d_lseek(DeviceControlRecord* dcr,
+                    boffset_t offset,
+                    int whence) override;
+  ssize_t d_read(int fd, void* buffer, size_t count) override;
+  ssize_t d_write(int fd, const void* buffer, size_t count) override;
+  bool d_truncate(DeviceControlRecord* dcr) override;
+  bool d_flush(DeviceControlRecord* dcr) override;
+};
+
+} /* namespace storagedaemon */
+
+#endif /* BAREOS_STORED_BACKENDS_CHUNKDIR_DEVICE_H_ */
@@ -27,8 +27,6 @@
 
 #include "include/bareos.h"
 #include "lib/edit.h"
-
-#if defined(HAVE_DROPLET)
 #include "stored/stored.h"
 #include "chunked_device.h"
 
@@ -39,6 +37,7 @@
 #endif
 
 #include "stored/stored_globals.h"
+#include "stored/chunk_cache.h"
 
 namespace storagedaemon {
 
@@ -72,6 +71,11 @@ static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
  * ChunkedVolumeSize() - Get the current size of a volume.
  * LoadChunk() - Make sure we have the right chunk in memory.
  *
+ * When reading, the io-threads also read ahead the next prefetch_chunks_
+ * chunks into spare chunk buffers, see PrefetchChunks(). Chunks read from
+ * the backing store are kept in the chunk cache shared by all devices when
+ * one is configured, see ReadCachedChunk().
+ *
  * It also demands that the inheriting class implements the
  * following methods:
  *
@@ -341,30 +345,13 @@ int chunked_device::NrInflightChunks()
 }
 
 /*
- * Call back function for comparing two chunk_io_requests.
+ * Build the key on which chunk_io_requests are ordered and merged,
+ * which is the volume name followed by the chunk number.
  */
-static int CompareChunkIoRequest(void* item1, void* item2)
+static inline void ChunkIoRequestKey(chunk_io_request* request,
+                                     storagedaemon::ocbuf_key& key)
 {
-  storagedaemon::ocbuf_item* ocbuf1 = (storagedaemon::ocbuf_item*)item1;
-  storagedaemon::ocbuf_item* ocbuf2 = (storagedaemon::ocbuf_item*)item2;
-  chunk_io_request* chunk1 = (chunk_io_request*)ocbuf1->data;
-  chunk_io_request* chunk2 = (chunk_io_request*)ocbuf2->data;
-
-  /*
-   * Same volume name ?
-   */
-  if (bstrcmp(chunk1->volname, chunk2->volname)) {
-    /*
-     * Compare on chunk number.
-     */
-    if (chunk1->chunk == chunk2->chunk) {
-      return 0;
-    } else {
-      return (chunk1->chunk < chunk2->chunk) ? -1 : 1;
-    }
-  } else {
-    return strcmp(chunk1->volname, chunk2->volname);
-  }
+  storagedaemon::MakeOcbufKey(key, request->volname, request->chunk);
 }
 
 /*
@@ -399,6 +386,7 @@ static void UpdateChunkIoRequest(void* item1, void* item2)
 bool chunked_device::EnqueueChunk(chunk_io_request* request)
 {
   chunk_io_request *new_request, *enqueued_request;
+  storagedaemon::ocbuf_key key;
 
   Dmsg2(100, "Enqueueing chunk %d of volume %s\n", request->chunk,
         request->volname);
@@ -424,9 +412,10 @@ bool chunked_device::EnqueueChunk(chunk_io_request* request)
    * This returns either the same request as we passed
    * in or the previous flush request for the same chunk.
    */
+  ChunkIoRequestKey(new_request, key);
   enqueued_request = (chunk_io_request*)cb_->enqueue(
-      new_request, sizeof(chunk_io_request), CompareChunkIoRequest,
-      UpdateChunkIoRequest, false, /* use_reserved_slot */
+      new_request, sizeof(chunk_io_request), key, UpdateChunkIoRequest,
+      false, /* use_reserved_slot */
       false /* no_signal */);
 
   /*
@@ -484,12 +473,20 @@ bool chunked_device::DequeueChunk()
         &ts, DEFAULT_RECHECK_INTERVAL);
     if (!new_request) { return false; }
 
+    if (new_request->prefetch) {
+      ReadPrefetchChunk(new_request);
+      goto bail_out;
+    }
+
     Dmsg3(100, "Flushing chunk %d of volume %s by thread %s\n",
           new_request->chunk, new_request->volname,
           edit_pthread(pthread_self(), ed1, sizeof(ed1)));
 
-    if (!FlushRemoteChunk(new_request)) {
+    if (FlushRemoteChunk(new_request)) {
+      InvalidateCachedChunk(new_request);
+    } else {
       chunk_io_request* enqueued_request;
+      storagedaemon::ocbuf_key key;
 
       /*
        * See if we have a maximum number of retries to upload chunks to the
@@ -528,9 +525,10 @@ bool chunked_device::DequeueChunk()
        * This returns either the same request as we passed
        * in or the previous flush request for the same chunk.
        */
+      ChunkIoRequestKey(new_request, key);
       enqueued_request = (chunk_io_request*)cb_->enqueue(
-          new_request, sizeof(chunk_io_request), CompareChunkIoRequest,
-          UpdateChunkIoRequest, true, /* use_reserved_slot */
+          new_request, sizeof(chunk_io_request), key, UpdateChunkIoRequest,
+          true, /* use_reserved_slot */
           true /* no_signal */);
       /*
        * See if the enqueue succeeded.
@@ -584,10 +582,16 @@ bool chunked_device::FlushChunk(bool release_chunk, bool move_to_next_chunk)
   request.wbuflen = current_chunk_->buflen;
   request.release = release_chunk;
 
+  /*
+   * Cached copies of the chunk are outdated from now on.
+   */
+  InvalidateCachedChunk(&request);
+
   if (io_threads_) {
     retval = EnqueueChunk(&request);
   } else {
     retval = FlushRemoteChunk(&request);
+    if (retval) { InvalidateCachedChunk(&request); }
   }
 
   /*
@@ -639,17 +643,56 @@ bool chunked_device::ReadChunk()
   current_chunk_->end_offset =
       current_chunk_->start_offset + (current_chunk_->chunk_size - 1);
 
-  if (!ReadRemoteChunk(&request)) {
-    /*
-     * If the chunk doesn't exist on the backing store it has a size of 0 bytes.
-     */
-    current_chunk_->buflen = 0;
-    return false;
+  /*
+   * See if an io-thread already read the chunk for us.
+   */
+  if (!TakePrefetchedChunk(request.chunk)) {
+    if (!ReadCachedChunk(&request)) {
+      /*
+       * If the chunk doesn't exist on the backing store it has a size of 0
+       * bytes.
+       */
+      current_chunk_->buflen = 0;
+      return false;
+    }
+  }
+
+  PrefetchChunks(request.chunk);
+
+  return true;
+}
+
+/*
+ * Read a chunk using the chunk cache when there is one, chunks not in the
+ * cache are read from the backing store and added to it.
+ */
+bool chunked_device::ReadCachedChunk(chunk_io_request* request)
+{
+  uint64_t generation;
+  ChunkCache* cache = GetChunkCache();
+
+  if (!cache) { return ReadRemoteChunk(request); }
+
+  if (cache->Get(request->volname, request->chunk, request->buffer,
+                 request->wbuflen, request->rbuflen)) {
+    return true;
   }
 
+  generation = cache->Generation();
+  if (!ReadRemoteChunk(request)) { return false; }
+  cache->Put(request->volname, request->chunk, request->buffer,
+             *request->rbuflen, generation);
+
   return true;
 }
 
+void chunked_device::InvalidateCachedChunk(chunk_io_request* request)
+{
+  ChunkCache* cache = GetChunkCache();
+
+  if (cache) { cache->Invalidate(request->volname, request->chunk); }
+}
+
 /*
  * Setup a chunked volume for reading or writing.
  * return:
@@ -659,6 +702,7 @@ bool chunked_device::ReadChunk()
 int chunked_device::SetupChunk(const char* pathname, int flags, int mode)
 {
   int retval = -1;
+
   /*
    * If device is (re)opened and we are put into readonly mode because
    * of problems flushing chunks to the backing store we return EROFS
@@ -699,6 +743,11 @@ int chunked_device::SetupChunk(const char* pathname, int flags, int mode)
     current_chunk_->end_offset = -1;
   }
 
+  /*
+   * Anything read ahead belongs to the previous open.
+   */
+  StopPrefetch();
+
   if (flags & O_RDWR) { current_chunk_->writing = true; }
 
   current_chunk_->chunk_setup = false;
@@ -1029,6 +1078,8 @@ int chunked_device::CloseChunk()
 {
   int retval = -1;
 
+  StopPrefetch();
+
   if (current_chunk_->opened) {
     if (current_chunk_->need_flushing) {
       if (FlushChunk(true /* release */, false /* move_to_next_chunk */)) {
@@ -1075,6 +1126,9 @@ bool chunked_device::TruncateChunkedVolume(DeviceControlRecord* dcr)
   if (current_chunk_->opened) {
     if (!TruncateRemoteChunkedVolume(dcr)) { return false; }
 
+    ChunkCache* cache = GetChunkCache();
+    if (cache) { cache->InvalidateVolume(current_volname_); }
+
     /*
      * Reinitialize the initial chunk.
      */
@@ -1100,6 +1154,11 @@ static int CompareVolumeName(void* item1, void* item2)
   const char* volname = (const char*)item2;
   chunk_io_request* request = (chunk_io_request*)item1;
 
+  /*
+   * Reads ahead don't hold any data of the volume.
+   */
+  if (request->prefetch) { return -1; }
+
   return strcmp(request->volname, volname);
 }
 
@@ -1294,7 +1353,8 @@ static int CloneIoRequest(void* item1, void* item2)
   chunk_io_request* src = (chunk_io_request*)item1;
   chunk_io_request* dst = (chunk_io_request*)item2;
 
-  if (bstrcmp(src->volname, dst->volname) && src->chunk == dst->chunk) {
+  if (!src->prefetch && bstrcmp(src->volname, dst->volname) &&
+      src->chunk == dst->chunk) {
     memcpy(dst->buffer, src->buffer, src->wbuflen);
     *dst->rbuflen = src->wbuflen;
 
@@ -1431,14 +1491,230 @@ bail_out:
   return true;
 }
 
+/*
+ * Queue reads of the chunks following chunk for the io-threads, so they are
+ * in memory by the time ReadChunked() gets there. We never read beyond the
+ * last address the restore wants or a chunk that could not be read, as that
+ * is most likely the end of the volume.
+ */
+void chunked_device::PrefetchChunks(uint16_t chunk)
+{
+  int i, nr_requests = 0;
+  uint32_t block_size;
+  uint64_t last_chunk;
+  chunk_io_request* requests[UINT8_MAX];
+  chunk_prefetch *slot, *free_slot;
+
+  if (!prefetch_chunks_ || !io_threads_ || current_chunk_->writing) { return; }
+
+  if (!io_threads_started_) {
+    if (!StartIoThreads()) { return; }
+  }
+
+  /*
+   * Never read ahead chunks of the volume that still need to be uploaded.
+   */
+  if (NrInflightChunks() > 0) { return; }
+  if (!cb_->empty()) {
+    chunk_io_request* request;
+
+    request = (chunk_io_request*)cb_->peek(storagedaemon::PEEK_FIRST,
+                                           current_volname_, CompareVolumeName);
+    if (request) {
+      free(request);
+      return;
+    }
+  }
+
+  last_chunk = MAX_CHUNKS - 1;
+  if (read_end_addr) {
+    block_size = max_block_size ? max_block_size : DEFAULT_BLOCK_SIZE;
+    last_chunk = MIN(last_chunk,
+                     (read_end_addr + block_size) / current_chunk_->chunk_size);
+  }
+
+  P(prefetch_lock_);
+  if (!prefetch_) {
+    prefetch_ =
+        (chunk_prefetch*)calloc(prefetch_chunks_, sizeof(chunk_prefetch));
+  }
+
+  /*
+   * Chunks outside the new read ahead window are no longer wanted.
+   */
+  for (i = 0; i < prefetch_chunks_; i++) {
+    slot = &prefetch_[i];
+    if (slot->state != PREFETCH_DONE && slot->state != PREFETCH_FAILED) {
+      continue;
+    }
+    if (slot->chunk <= chunk || slot->chunk > chunk + prefetch_chunks_) {
+      slot->state = PREFETCH_FREE;
+    }
+  }
+
+  for (uint64_t next = chunk + 1;
+       next <= last_chunk && next <= (uint64_t)chunk + prefetch_chunks_;
+       next++) {
+    slot = NULL;
+    free_slot = NULL;
+    for (i = 0; i < prefetch_chunks_; i++) {
+      if (prefetch_[i].state == PREFETCH_FREE) {
+        if (!free_slot) { free_slot = &prefetch_[i]; }
+      } else if (prefetch_[i].chunk == next) {
+        slot = &prefetch_[i];
+        break;
+      }
+    }
+
+    if (slot) {
+      if (slot->state == PREFETCH_FAILED) { break; }
+      continue;
+    }
+
+    if (!free_slot) { break; }
+
+    if (!free_slot->buffer) { free_slot->buffer = allocate_chunkbuffer(); }
+    free_slot->chunk = next;
+    free_slot->state = PREFETCH_PENDING;
+    free_slot->buflen = 0;
+
+    requests[nr_requests] =
+        (chunk_io_request*)malloc(sizeof(chunk_io_request));
+    memset(requests[nr_requests], 0, sizeof(chunk_io_request));
+    requests[nr_requests]->volname = strdup(current_volname_);
+    requests[nr_requests]->chunk = next;
+    requests[nr_requests]->buffer = free_slot->buffer;
+    requests[nr_requests]->wbuflen = current_chunk_->chunk_size;
+    requests[nr_requests]->prefetch = free_slot;
+    nr_requests++;
+  }
+  V(prefetch_lock_);
+
+  /*
+   * Hand the reads to the io-threads, not holding the prefetch lock as the
+   * enqueue may have to wait for them.
+   */
+  for (i = 0; i < nr_requests; i++) {
+    storagedaemon::ocbuf_key key;
+    chunk_io_request* enqueued_request;
+
+    Dmsg2(100, "Reading ahead chunk %d of volume %s\n", requests[i]->chunk,
+          requests[i]->volname);
+
+    ChunkIoRequestKey(requests[i], key);
+    enqueued_request = (chunk_io_request*)cb_->enqueue(
+        requests[i], sizeof(chunk_io_request), key, UpdateChunkIoRequest,
+        false, /* use_reserved_slot */
+        false /* no_signal */);
+    if (enqueued_request != requests[i]) {
+      P(prefetch_lock_);
+      requests[i]->prefetch->state = PREFETCH_FAILED;
+      pthread_cond_broadcast(&prefetch_done_);
+      V(prefetch_lock_);
+      FreeChunkIoRequest(requests[i]);
+    }
+  }
+}
+
+/*
+ * Read ahead a chunk, called by an io-thread.
+ */
+void chunked_device::ReadPrefetchChunk(chunk_io_request* request)
+{
+  char ed1[50];
+  uint32_t buflen = 0;
+  bool ok;
+
+  Dmsg3(100, "Reading ahead chunk %d of volume %s by thread %s\n",
+        request->chunk, request->volname,
+        edit_pthread(pthread_self(), ed1, sizeof(ed1)));
+
+  request->rbuflen = &buflen;
+  ok = ReadCachedChunk(request);
+
+  P(prefetch_lock_);
+  request->prefetch->buflen = buflen;
+  request->prefetch->state = (ok) ? PREFETCH_DONE : PREFETCH_FAILED;
+  pthread_cond_broadcast(&prefetch_done_);
+  V(prefetch_lock_);
+}
+
+/*
+ * See if a chunk was read ahead and if so make it the current chunk, the
+ * buffer of the current chunk becomes a spare buffer for reading ahead.
+ */
+bool chunked_device::TakePrefetchedChunk(uint16_t chunk)
+{
+  bool retval = false;
+  char* buffer;
+
+  if (!prefetch_) { return false; }
+
+  P(prefetch_lock_);
+  for (int i = 0; i < prefetch_chunks_; i++) {
+    chunk_prefetch* slot = &prefetch_[i];
+
+    if (slot->state == PREFETCH_FREE || slot->chunk != chunk) { continue; }
+
+    while (slot->state == PREFETCH_PENDING) {
+      pthread_cond_wait(&prefetch_done_, &prefetch_lock_);
+    }
+
+    /*
+     * When the read ahead failed the caller reads the chunk itself so the
+     * error is handled as usual.
+     */
+    if (slot->state == PREFETCH_DONE) {
+      buffer = current_chunk_->buffer;
+      current_chunk_->buffer = slot->buffer;
+      current_chunk_->buflen = slot->buflen;
+      slot->buffer = buffer;
+      retval = true;
+    }
+    slot->state = PREFETCH_FREE;
+    break;
+  }
+  V(prefetch_lock_);
+
+  return retval;
+}
+
+/*
+ * Wait for all outstanding reads ahead and release their buffers.
+ */
+void chunked_device::StopPrefetch()
+{
+  if (!prefetch_) { return; }
+
+  P(prefetch_lock_);
+  for (int i = 0; i < prefetch_chunks_; i++) {
+    chunk_prefetch* slot = &prefetch_[i];
+
+    while (slot->state == PREFETCH_PENDING) {
+      pthread_cond_wait(&prefetch_done_, &prefetch_lock_);
+    }
+    slot->state = PREFETCH_FREE;
+    if (slot->buffer) {
+      FreeChunkbuffer(slot->buffer);
+      slot->buffer = NULL;
+    }
+  }
+  V(prefetch_lock_);
+}
+
 static int ListIoRequest(void* request, void* data)
 {
   chunk_io_request* io_request = (chunk_io_request*)request;
   bsdDevStatTrig* dst = (bsdDevStatTrig*)data;
   PoolMem status(PM_MESSAGE);
 
-  status.bsprintf("   /%s/%04d - %ld (try=%d)\n", io_request->volname,
-                  io_request->chunk, io_request->wbuflen, io_request->tries);
+  if (io_request->prefetch) {
+    status.bsprintf("   /%s/%04d - read ahead\n", io_request->volname,
+                    io_request->chunk);
+  } else {
+    status.bsprintf("   /%s/%04d - %ld (try=%d)\n", io_request->volname,
+                    io_request->chunk, io_request->wbuflen, io_request->tries);
+  }
   dst->status_length = PmStrcat(dst->status, status.c_str());
 
   return 0;
@@ -1452,6 +1728,7 @@ bool chunked_device::DeviceStatus(bsdDevStatTrig* dst)
   bool pending = false;
   int inflight_chunks = 0;
   PoolMem inflights(PM_MESSAGE);
+  ChunkCache* cache;
 
   dst->status_length = 0;
   if (CheckRemote()) {
@@ -1487,6 +1764,25 @@ bool chunked_device::DeviceStatus(bsdDevStatTrig* dst)
         PmStrcat(dst->status, _("No pending IO flush requests.\n"));
   }
 
+  cache = GetChunkCache();
+  if (cache) {
+    ChunkCacheStatistics statistics;
+    char ed1[50], ed2[50], ed3[50], ed4[50], ed5[50], ed6[50], ed7[50];
+
+    cache->GetStatistics(statistics);
+    inflights.bsprintf(
+        _("Chunk cache: %s hits (%s from disk), %s misses, %s evictions\n"
+          "   %s chunks (%s bytes) in memory, %s chunks on disk\n"),
+        edit_uint64_with_commas(statistics.hits + statistics.disk_hits, ed1),
+        edit_uint64_with_commas(statistics.disk_hits, ed2),
+        edit_uint64_with_commas(statistics.misses, ed3),
+        edit_uint64_with_commas(statistics.evictions, ed4),
+        edit_uint64_with_commas(statistics.memory_chunks, ed5),
+        edit_uint64_with_commas(statistics.memory_bytes, ed6),
+        edit_uint64_with_commas(statistics.disk_chunks, ed7));
+    dst->status_length = PmStrcat(dst->status, inflights.c_str());
+  }
+
   return (dst->status_length > 0);
 }
 
@@ -1503,7 +1799,10 @@ chunked_device::~chunked_device()
       do {
         request = (chunk_io_request*)cb_->dequeue();
         if (request) {
-          request->release = true;
+          /*
+           * The buffer of a read ahead is freed with the prefetch slots.
+           */
+          request->release = !request->prefetch;
           FreeChunkIoRequest(request);
         }
       } while (!cb_->empty());
@@ -1513,6 +1812,14 @@ chunked_device::~chunked_device()
     cb_ = NULL;
   }
 
+  if (prefetch_) {
+    for (int i = 0; i < prefetch_chunks_; i++) {
+      if (prefetch_[i].buffer) { FreeChunkbuffer(prefetch_[i].buffer); }
+    }
+    free(prefetch_);
+    prefetch_ = NULL;
+  }
+
   if (current_chunk_) {
     if (current_chunk_->buffer) { FreeChunkbuffer(current_chunk_->buffer); }
     free(current_chunk_);
@@ -1520,6 +1827,9 @@ chunked_device::~chunked_device()
   }
 
   if (current_volname_) { free(current_volname_); }
+
+  pthread_cond_destroy(&prefetch_done_);
+  pthread_mutex_destroy(&prefetch_lock_);
 }
 
 chunked_device::chunked_device()
@@ -1529,6 +1839,8 @@ chunked_device::chunked_device()
   io_threads_ = 0;
   io_slots_ = 0;
   retries_ = 0;
+  prefetch_chunks_ = 0;
+  prefetch_ = NULL;
   chunk_size_ = 0;
   io_threads_started_ = false;
   end_of_media_ = false;
@@ -1538,8 +1850,8 @@ chunked_device::chunked_device()
   chunk_size_ = 0;
   offset_ = 0;
   use_mmap_ = false;
+  pthread_mutex_init(&prefetch_lock_, NULL);
+  pthread_cond_init(&prefetch_done_, NULL);
 }
 
 } /* namespace storagedaemon */
-
-#endif /* HAVE_DROPLET */
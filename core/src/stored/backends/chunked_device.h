@@ -76,6 +76,24 @@ struct thread_handle {
   pthread_t thread_id;   /* Actual threadid */
 };
 
+/*
+ * State of a chunk being read ahead.
+ */
+enum chunk_prefetch_state
+{
+  PREFETCH_FREE = 0, /* Slot unused, buffer may be kept as a spare */
+  PREFETCH_PENDING,  /* Queued for or being read by an io-thread */
+  PREFETCH_DONE,     /* Chunk read into the buffer */
+  PREFETCH_FAILED    /* Chunk could not be read */
+};
+
+struct chunk_prefetch {
+  uint16_t chunk;             /* Chunk number */
+  chunk_prefetch_state state; /* See PREFETCH_* chunk_prefetch_state enum */
+  char* buffer;               /* Data */
+  uint32_t buflen;            /* Size of the actual valid data in the chunk */
+};
+
 struct chunk_io_request {
   const char* volname; /* VolumeName */
   uint16_t chunk;      /* Chunk number */
@@ -84,6 +102,7 @@ struct chunk_io_request {
   uint32_t* rbuflen;   /* Size of the actual valid data in the chunk (Read) */
   uint8_t tries; /* Number of times the flush was tried to the backing store */
   bool release;  /* Should we release the data to which the buffer points ? */
+  chunk_prefetch* prefetch; /* Read ahead of a chunk, NULL for a flush */
 };
 
 struct chunk_descriptor {
@@ -112,6 +131,9 @@ class chunked_device : public Device {
   ordered_circbuf* cb_;
   alist* thread_ids_;
   chunk_descriptor* current_chunk_;
+  chunk_prefetch* prefetch_;
+  pthread_mutex_t prefetch_lock_;
+  pthread_cond_t prefetch_done_;
 
   /*
    * Private Methods
@@ -124,6 +146,12 @@ class chunked_device : public Device {
   bool EnqueueChunk(chunk_io_request* request);
   bool FlushChunk(bool release_chunk, bool move_to_next_chunk);
   bool ReadChunk();
+  bool ReadCachedChunk(chunk_io_request* request);
+  void InvalidateCachedChunk(chunk_io_request* request);
+  void PrefetchChunks(uint16_t chunk);
+  bool TakePrefetchedChunk(uint16_t chunk);
+  void ReadPrefetchChunk(chunk_io_request* request);
+  void StopPrefetch();
   bool is_written();
 
  protected:
@@ -133,6 +161,7 @@ class chunked_device : public Device {
   uint8_t io_threads_;
   uint8_t io_slots_;
   uint8_t retries_;
+  uint8_t prefetch_chunks_;
   uint64_t chunk_size_;
   boffset_t offset_;
   bool use_mmap_;
@@ -171,20 +200,20 @@ class chunked_device : public Device {
   virtual ~chunked_device();
 
   bool DequeueChunk();
-  bool DeviceStatus(bsdDevStatTrig* dst);
+  bool DeviceStatus(bsdDevStatTrig* dst) override;
 
   /*
    * Interface from Device
    */
-  virtual int d_close(int fd) = 0;
-  virtual int d_open(const char* pathname, int flags, int mode) = 0;
-  virtual int d_ioctl(int fd, ioctl_req_t request, char* mt = NULL) = 0;
-  virtual boffset_t d_lseek(DeviceControlRecord* dcr,
-                            boffset_t offset,
-                            int whence) = 0;
-  virtual ssize_t d_read(int fd, void* buffer, size_t count) = 0;
-  virtual ssize_t d_write(int fd, const void* buffer, size_t count) = 0;
-  virtual bool d_truncate(DeviceControlRecord* dcr) = 0;
+  int d_close(int fd) override = 0;
+  int d_open(const char* pathname, int flags, int mode) override = 0;
+  int d_ioctl(int fd, ioctl_req_t request, char* mt = NULL) override = 0;
+  boffset_t d_lseek(DeviceControlRecord* dcr,
+                    boffset_t offset,
+                    int whence) override = 0;
+  ssize_t d_read(int fd, void* buffer, size_t count) override = 0;
+  ssize_t d_write(int fd, const void* buffer, size_t count) override = 0;
+  bool d_truncate(DeviceControlRecord* dcr) override = 0;
 };
 
 } /* namespace storagedaemon */
@@ -0,0 +1,322 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Deduplicating file device. Volumes are files in the Archive Device
+ * directory like with a plain file device, but the payload of file data
+ * records is cut into content defined chunks and every unique chunk is
+ * only kept once in a chunk store shared by all volumes. As blocks are
+ * reassembled on reading everything above the device, including
+ * ReadRecords(), sees the plain volume contents.
+ *
+ * Stacking is the following:
+ *
+ *   dedup_device::
+ *         |
+ *         v
+ *   DedupVolume:: -> DedupStore::
+ *         |
+ *         v
+ *       Device::
+ *
+ */
+/**
+ * @file
+ * Deduplicating file device abstraction.
+ */
+
+#include "include/bareos.h"
+#include "stored/stored.h"
+#include "stored/stored_globals.h"
+#include "dedup_device.h"
+#include "dedup_store.h"
+#include "dedup_volume.h"
+#include "lib/berrno.h"
+#include "lib/edit.h"
+
+namespace storagedaemon {
+
+#define DEFAULT_DEDUP_CHUNK_SIZE (8 * 1024)
+#define DEFAULT_DEDUP_STORE ".dedup"
+
+/**
+ * Options that can be specified for this device type.
+ */
+enum device_option_type
+{
+  argument_none = 0,
+  argument_store,
+  argument_chunksize
+};
+
+struct device_option {
+  const char* name;
+  enum device_option_type type;
+  int compare_size;
+};
+
+static device_option device_options[] = {{"store=", argument_store, 6},
+                                         {"chunksize=", argument_chunksize, 10},
+                                         {NULL, argument_none}};
+
+/**
+ * Parse the device options, e.g. "store=/var/lib/bareos/dedup,chunksize=16k"
+ * keeps the chunks in the given directory and cuts chunks of 16 KiB on
+ * average.
+ */
+bool dedup_device::ParseDeviceOptions()
+{
+  char *bp, *next_option, *options;
+  bool done, retval = true;
+
+  options_parsed_ = true;
+  if (dev_options) {
+    options = strdup(dev_options);
+    bp = options;
+    while (bp) {
+      next_option = strchr(bp, ',');
+      if (next_option) { *next_option++ = '\0'; }
+
+      done = false;
+      for (int i = 0; !done && device_options[i].name; i++) {
+        /*
+         * Try to find a matching device option.
+         */
+        if (bstrncasecmp(bp, device_options[i].name,
+                         device_options[i].compare_size)) {
+          switch (device_options[i].type) {
+            case argument_store:
+              if (*(bp + device_options[i].compare_size)) {
+                if (store_directory_) { free(store_directory_); }
+                store_directory_ =
+                    strdup(bp + device_options[i].compare_size);
+                done = true;
+              }
+              break;
+            case argument_chunksize: {
+              uint64_t chunk_size;
+
+              /*
+               * The average chunk size must be a power of two.
+               */
+              if (size_to_uint64(bp + device_options[i].compare_size,
+                                 &chunk_size) &&
+                  chunk_size >= 1024 && chunk_size <= 1024 * 1024 &&
+                  (chunk_size & (chunk_size - 1)) == 0) {
+                chunk_size_ = chunk_size;
+                done = true;
+              }
+              break;
+            }
+            default:
+              break;
+          }
+        }
+      }
+
+      if (!done) {
+        Mmsg1(errmsg, _("Unable to parse device option: %s\n"), bp);
+        Emsg0(M_FATAL, 0, errmsg);
+        retval = false;
+        break;
+      }
+
+      bp = next_option;
+    }
+    free(options);
+  }
+
+  if (!store_directory_) {
+    PoolMem directory(PM_FNAME);
+
+    Mmsg(directory, "%s/%s", dev_name, DEFAULT_DEDUP_STORE);
+    store_directory_ = strdup(directory.c_str());
+  }
+
+  return retval;
+}
+
+int dedup_device::d_open(const char* pathname, int flags, int mode)
+{
+  if (!options_parsed_ && !ParseDeviceOptions()) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (!store_ && !(store_ = DedupStore::Open(store_directory_))) {
+    errno = EIO;
+    return -1;
+  }
+
+  volume_.reset(new DedupVolume(store_, chunk_size_));
+  return volume_->Open(pathname, flags, mode);
+}
+
+ssize_t dedup_device::d_read(int fd, void* buffer, size_t count)
+{
+  if (!volume_) {
+    errno = EBADF;
+    return -1;
+  }
+
+  return volume_->Read(buffer, count);
+}
+
+ssize_t dedup_device::d_write(int fd, const void* buffer, size_t count)
+{
+  if (!volume_) {
+    errno = EBADF;
+    return -1;
+  }
+
+  return volume_->Write(buffer, count);
+}
+
+/*
+ * The chunks go to stable storage before the volume referring to them.
+ */
+bool dedup_device::SyncVolume()
+{
+  if (!store_->Sync() || fdatasync(volume_->Fd()) != 0) {
+    BErrNo be;
+
+    dev_errno = errno;
+    Mmsg2(errmsg, _("Unable to sync device %s. ERR=%s\n"), prt_name,
+          be.bstrerror());
+    return false;
+  }
+
+  return true;
+}
+
+int dedup_device::d_close(int fd)
+{
+  int status = 0;
+
+  if (volume_) {
+    if ((volume_->Fd() >= 0 && !SyncVolume()) || volume_->Close() != 0) {
+      status = -1;
+    }
+    volume_.reset();
+  }
+
+  return status;
+}
+
+int dedup_device::d_ioctl(int fd, ioctl_req_t request, char* op) { return -1; }
+
+boffset_t dedup_device::d_lseek(DeviceControlRecord* dcr,
+                                boffset_t offset,
+                                int whence)
+{
+  if (!volume_) {
+    errno = EBADF;
+    return -1;
+  }
+
+  return volume_->Seek(offset, whence);
+}
+
+/**
+ * Make all data written so far persistent, called after writing the volume
+ * label and at the end of a job.
+ */
+bool dedup_device::d_flush(DeviceControlRecord* dcr)
+{
+  if (!volume_ || volume_->Fd() < 0) { return true; }
+
+  return SyncVolume();
+}
+
+/**
+ * Empty the volume, the chunks it referred to stay in the store.
+ */
+bool dedup_device::d_truncate(DeviceControlRecord* dcr)
+{
+  bool secure_erase = me && me->secure_erase_cmdline;
+
+  if (!volume_ ||
+      !volume_->Truncate(dcr ? dcr->jcr : NULL, secure_erase)) {
+    BErrNo be;
+
+    Mmsg2(errmsg, _("Unable to truncate device %s. ERR=%s\n"), prt_name,
+          be.bstrerror());
+    return false;
+  }
+  fd_ = volume_->Fd();
+
+  return true;
+}
+
+bool dedup_device::DeviceStatus(bsdDevStatTrig* dst)
+{
+  DedupStatistics statistics;
+  PoolMem status(PM_MESSAGE);
+  char ed1[50], ed2[50];
+
+  if (!store_) {
+    dst->status_length =
+        PmStrcpy(dst->status, _("Dedup store is not opened.\n"));
+    return true;
+  }
+
+  store_->GetStatistics(statistics);
+  status.bsprintf(_("Dedup store %s: %s chunks, %s bytes\n"),
+                  store_->Directory(), edit_uint64(statistics.chunks, ed1),
+                  edit_uint64(statistics.bytes, ed2));
+  dst->status_length = PmStrcpy(dst->status, status.c_str());
+  status.bsprintf(_("Deduplicated: %s chunks, %s bytes\n"),
+                  edit_uint64(statistics.dedup_chunks, ed1),
+                  edit_uint64(statistics.dedup_bytes, ed2));
+  dst->status_length = PmStrcat(dst->status, status.c_str());
+
+  return true;
+}
+
+dedup_device::dedup_device() { chunk_size_ = DEFAULT_DEDUP_CHUNK_SIZE; }
+
+dedup_device::~dedup_device()
+{
+  volume_.reset();
+  if (store_) { DedupStore::Release(store_); }
+  if (store_directory_) { free(store_directory_); }
+}
+
+#ifdef HAVE_DYNAMIC_SD_BACKENDS
+extern "C" Device* backend_instantiate(JobControlRecord* jcr, int device_type)
+{
+  Device* dev = NULL;
+
+  switch (device_type) {
+    case B_DEDUP_DEV:
+      dev = new dedup_device;
+      break;
+    default:
+      Jmsg(jcr, M_FATAL, 0, _("Request for unknown devicetype: %d\n"),
+           device_type);
+      break;
+  }
+
+  return dev;
+}
+
+extern "C" void flush_backend(void) {}
+#endif
+} /* namespace storagedaemon */
@@ -0,0 +1,68 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Deduplicating file device.
+ */
+
+#ifndef BAREOS_STORED_BACKENDS_DEDUP_DEVICE_H_
+#define BAREOS_STORED_BACKENDS_DEDUP_DEVICE_H_
+
+#include <memory>
+
+namespace storagedaemon {
+
+class DedupStore;
+class DedupVolume;
+
+class dedup_device : public Device {
+ public:
+  dedup_device();
+  ~dedup_device();
+
+  /*
+   * Interface from Device
+   */
+  int d_close(int) override;
+  int d_open(const char* pathname, int flags, int mode) override;
+  int d_ioctl(int fd, ioctl_req_t request, char* mt = NULL) override;
+  boffset_t d_lseek(DeviceControlRecord* dcr,
+                    boffset_t offset,
+                    int whence) override;
+  ssize_t d_read(int fd, void* buffer, size_t count) override;
+  ssize_t d_write(int fd, const void* buffer, size_t count) override;
+  bool d_truncate(DeviceControlRecord* dcr) override;
+  bool d_flush(DeviceControlRecord* dcr) override;
+  bool DeviceStatus(bsdDevStatTrig* dst) override;
+
+ private:
+  bool options_parsed_ = false;
+  char* store_directory_ = nullptr; /**< Directory of the chunk store */
+  uint32_t chunk_size_;             /**< Average chunk size */
+  DedupStore* store_ = nullptr;
+  std::unique_ptr<DedupVolume> volume_;
+
+  bool ParseDeviceOptions();
+  bool SyncVolume();
+};
+
+} /* namespace storagedaemon */
+
+#endif /* BAREOS_STORED_BACKENDS_DEDUP_DEVICE_H_ */
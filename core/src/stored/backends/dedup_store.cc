@@ -0,0 +1,376 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Chunk store of the dedup device.
+ */
+
+#include "include/bareos.h"
+#include "stored/stored.h"
+#include "lib/berrno.h"
+#include "dedup_store.h"
+
+namespace storagedaemon {
+
+#define DEDUP_CHUNK_FILE "chunks"
+#define DEDUP_INDEX_VALUE_LENGTH 12
+
+/*
+ * Commit the index after this many new chunks, a crash loses at most the
+ * chunks written since the last commit.
+ */
+#define DEDUP_COMMIT_INTERVAL 1024
+
+/*
+ * Maximum size of the index, the file only grows as far as it is used.
+ */
+#define DEDUP_INDEX_MAPSIZE                                 \
+  (sizeof(size_t) > 4 ? (size_t)64 * 1024 * 1024 * 1024 \
+                      : (size_t)1024 * 1024 * 1024)
+
+static pthread_mutex_t stores_lock = PTHREAD_MUTEX_INITIALIZER;
+static std::map<std::string, DedupStore*> stores;
+
+/**
+ * Get the store for a directory, creating it on first use. LMDB does not
+ * allow to open the same environment twice in one process so all devices
+ * using the same directory share one instance.
+ */
+DedupStore* DedupStore::Open(const char* directory)
+{
+  DedupStore* store;
+
+  P(stores_lock);
+  auto it = stores.find(directory);
+  if (it != stores.end()) {
+    store = it->second;
+  } else {
+    store = new DedupStore(directory);
+    if (!store->Init()) {
+      int saved_errno = errno;
+
+      delete store;
+      V(stores_lock);
+      errno = saved_errno;
+      return nullptr;
+    }
+    stores[directory] = store;
+  }
+  store->refcnt_++;
+  V(stores_lock);
+
+  return store;
+}
+
+void DedupStore::Release(DedupStore* store)
+{
+  P(stores_lock);
+  if (--store->refcnt_ == 0) {
+    stores.erase(store->directory_);
+    delete store;
+  }
+  V(stores_lock);
+}
+
+DedupStore::DedupStore(const char* directory) : directory_(directory)
+{
+  pthread_mutex_init(&lock_, NULL);
+}
+
+DedupStore::~DedupStore()
+{
+  if (env_) {
+    CommitPending();
+    mdb_env_close(env_);
+  }
+  if (chunk_fd_ >= 0) { ::close(chunk_fd_); }
+  pthread_mutex_destroy(&lock_);
+}
+
+bool DedupStore::Init()
+{
+  int result;
+  struct stat st;
+  MDB_txn* txn;
+  MDB_stat mst;
+  PoolMem fname(PM_FNAME);
+
+  if (mkdir(directory_.c_str(), 0750) != 0 && errno != EEXIST) {
+    BErrNo be;
+
+    Emsg2(M_ERROR, 0, _("Unable to create dedup store %s. ERR=%s\n"),
+          directory_.c_str(), be.bstrerror());
+    return false;
+  }
+
+  Mmsg(fname, "%s/%s", directory_.c_str(), DEDUP_CHUNK_FILE);
+  if ((chunk_fd_ = ::open(fname.c_str(), O_CREAT | O_RDWR | O_BINARY, 0640)) <
+          0 ||
+      fstat(chunk_fd_, &st) != 0) {
+    BErrNo be;
+
+    Emsg2(M_ERROR, 0, _("Unable to open chunk file %s. ERR=%s\n"),
+          fname.c_str(), be.bstrerror());
+    return false;
+  }
+  chunk_end_ = st.st_size;
+
+  /*
+   * Only one storage daemon uses a store and all access is serialized by
+   * our own lock, so no LMDB lock file is needed.
+   */
+  if ((result = mdb_env_create(&env_)) != 0 ||
+      (result = mdb_env_set_mapsize(env_, DEDUP_INDEX_MAPSIZE)) != 0 ||
+      (result = mdb_env_open(env_, directory_.c_str(), MDB_NOLOCK, 0640)) !=
+          0) {
+    Emsg2(M_ERROR, 0, _("Unable to open dedup index in %s: %s\n"),
+          directory_.c_str(), mdb_strerror(result));
+    if (env_) {
+      mdb_env_close(env_);
+      env_ = nullptr;
+    }
+    errno = EIO;
+    return false;
+  }
+
+  if ((result = mdb_txn_begin(env_, NULL, 0, &txn)) != 0) {
+    Emsg1(M_ERROR, 0, _("Unable to start a write transaction: %s\n"),
+          mdb_strerror(result));
+    errno = EIO;
+    return false;
+  }
+
+  if ((result = mdb_dbi_open(txn, NULL, MDB_CREATE, &dbi_)) != 0 ||
+      (result = mdb_stat(txn, dbi_, &mst)) != 0) {
+    Emsg1(M_ERROR, 0, _("Unable to open LMDB internal database: %s\n"),
+          mdb_strerror(result));
+    mdb_txn_abort(txn);
+    errno = EIO;
+    return false;
+  }
+
+  if ((result = mdb_txn_commit(txn)) != 0) {
+    Emsg1(M_ERROR, 0, _("Unable to commit transaction: %s\n"),
+          mdb_strerror(result));
+    errno = EIO;
+    return false;
+  }
+
+  statistics_.chunks = mst.ms_entries;
+  statistics_.bytes = chunk_end_;
+
+  Dmsg3(100, "Opened dedup store %s chunks=%llu bytes=%llu\n",
+        directory_.c_str(), (unsigned long long)statistics_.chunks,
+        (unsigned long long)statistics_.bytes);
+
+  return true;
+}
+
+/*
+ * Find a chunk either in the chunks not yet committed or in the index.
+ * Called with the lock held.
+ */
+bool DedupStore::Lookup(const uint8_t* hash, ChunkLocation& location)
+{
+  int result;
+  MDB_txn* txn;
+  MDB_val key, data;
+  ser_declare;
+
+  auto it = pending_.find(std::string((const char*)hash, DEDUP_HASH_LENGTH));
+  if (it != pending_.end()) {
+    location = it->second;
+    return true;
+  }
+
+  if (mdb_txn_begin(env_, NULL, MDB_RDONLY, &txn) != 0) { return false; }
+
+  key.mv_data = (void*)hash;
+  key.mv_size = DEDUP_HASH_LENGTH;
+  result = mdb_get(txn, dbi_, &key, &data);
+  if (result == 0 && data.mv_size == DEDUP_INDEX_VALUE_LENGTH) {
+    UnserBegin(data.mv_data, DEDUP_INDEX_VALUE_LENGTH);
+    unser_uint64(location.offset);
+    unser_uint32(location.len);
+  }
+  mdb_txn_abort(txn);
+
+  return result == 0;
+}
+
+/*
+ * Add the chunks written since the last commit to the index. The chunk file
+ * is synced first so the index never refers to data that is not on disk.
+ * Called with the lock held.
+ */
+bool DedupStore::CommitPending()
+{
+  int result;
+  MDB_txn* txn;
+
+  if (pending_.empty()) { return true; }
+
+  if (fdatasync(chunk_fd_) != 0) {
+    BErrNo be;
+
+    Emsg2(M_ERROR, 0, _("Unable to sync chunk file in %s. ERR=%s\n"),
+          directory_.c_str(), be.bstrerror());
+    return false;
+  }
+
+  if ((result = mdb_txn_begin(env_, NULL, 0, &txn)) != 0) {
+    Emsg1(M_ERROR, 0, _("Unable to start a write transaction: %s\n"),
+          mdb_strerror(result));
+    return false;
+  }
+
+  for (const auto& chunk : pending_) {
+    char value[DEDUP_INDEX_VALUE_LENGTH];
+    MDB_val key, data;
+    ser_declare;
+
+    SerBegin(value, DEDUP_INDEX_VALUE_LENGTH);
+    ser_uint64(chunk.second.offset);
+    ser_uint32(chunk.second.len);
+
+    key.mv_data = (void*)chunk.first.data();
+    key.mv_size = chunk.first.size();
+    data.mv_data = value;
+    data.mv_size = DEDUP_INDEX_VALUE_LENGTH;
+    result = mdb_put(txn, dbi_, &key, &data, MDB_NOOVERWRITE);
+    if (result != 0 && result != MDB_KEYEXIST) {
+      Emsg2(M_ERROR, 0, _("Unable to update dedup index in %s: %s\n"),
+            directory_.c_str(), mdb_strerror(result));
+      mdb_txn_abort(txn);
+      return false;
+    }
+  }
+
+  if ((result = mdb_txn_commit(txn)) != 0) {
+    Emsg2(M_ERROR, 0, _("Unable to commit dedup index in %s: %s\n"),
+          directory_.c_str(), mdb_strerror(result));
+    return false;
+  }
+  pending_.clear();
+
+  return true;
+}
+
+/**
+ * Store a chunk unless a chunk with the same hash is already stored.
+ */
+bool DedupStore::Put(const uint8_t* hash, const char* data, uint32_t len)
+{
+  ChunkLocation location;
+  uint64_t offset;
+  uint32_t left = len;
+  bool retval = false;
+
+  P(lock_);
+  if (Lookup(hash, location)) {
+    statistics_.dedup_chunks++;
+    statistics_.dedup_bytes += len;
+    retval = true;
+    goto bail_out;
+  }
+
+  offset = chunk_end_;
+  while (left > 0) {
+    ssize_t n = pwrite(chunk_fd_, data + (len - left), left,
+                       offset + (len - left));
+
+    if (n <= 0) {
+      if (n == 0) { errno = ENOSPC; }
+      goto bail_out;
+    }
+    left -= n;
+  }
+
+  location.offset = offset;
+  location.len = len;
+  pending_[std::string((const char*)hash, DEDUP_HASH_LENGTH)] = location;
+  chunk_end_ += len;
+  statistics_.chunks++;
+  statistics_.bytes += len;
+
+  retval = pending_.size() < DEDUP_COMMIT_INTERVAL || CommitPending();
+  if (!retval) { errno = EIO; }
+
+bail_out:
+  V(lock_);
+  return retval;
+}
+
+/**
+ * Read a chunk, the length must match the length it was stored with.
+ */
+bool DedupStore::Get(const uint8_t* hash, char* buffer, uint32_t len)
+{
+  ChunkLocation location;
+  uint32_t done = 0;
+  bool found;
+
+  P(lock_);
+  found = Lookup(hash, location);
+  V(lock_);
+
+  if (!found || location.len != len) {
+    Dmsg1(100, "Chunk missing in dedup store %s\n", directory_.c_str());
+    errno = EIO;
+    return false;
+  }
+
+  while (done < len) {
+    ssize_t n = pread(chunk_fd_, buffer + done, len - done,
+                      location.offset + done);
+
+    if (n <= 0) {
+      if (n == 0) { errno = EIO; }
+      return false;
+    }
+    done += n;
+  }
+
+  return true;
+}
+
+/**
+ * Make all chunks stored so far persistent.
+ */
+bool DedupStore::Sync()
+{
+  bool retval;
+
+  P(lock_);
+  retval = CommitPending();
+  V(lock_);
+
+  if (!retval) { errno = EIO; }
+  return retval;
+}
+
+void DedupStore::GetStatistics(DedupStatistics& statistics)
+{
+  P(lock_);
+  statistics = statistics_;
+  V(lock_);
+}
+
+} /* namespace storagedaemon */
@@ -0,0 +1,93 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Chunk store of the dedup device.
+ *
+ * Every unique chunk is appended once to a chunk file, an LMDB database
+ * maps the SHA256 hash of a chunk to its offset and length in that file.
+ */
+
+#ifndef BAREOS_STORED_BACKENDS_DEDUP_STORE_H_
+#define BAREOS_STORED_BACKENDS_DEDUP_STORE_H_
+
+#include "lmdb/lmdb.h"
+
+#include <map>
+#include <string>
+
+namespace storagedaemon {
+
+#define DEDUP_HASH_LENGTH 32
+
+struct DedupStatistics {
+  uint64_t chunks = 0;        /**< Unique chunks in the store */
+  uint64_t bytes = 0;         /**< Bytes of the unique chunks */
+  uint64_t dedup_chunks = 0;  /**< Chunks found in the store when writing */
+  uint64_t dedup_bytes = 0;   /**< Bytes not stored again when writing */
+};
+
+/*
+ * A store is shared by all devices using the same directory, Open() hands
+ * out a reference to the one instance per directory and Release() drops it.
+ * All methods are thread safe.
+ */
+class DedupStore {
+ public:
+  static DedupStore* Open(const char* directory);
+  static void Release(DedupStore* store);
+
+  bool Put(const uint8_t* hash, const char* data, uint32_t len);
+  bool Get(const uint8_t* hash, char* buffer, uint32_t len);
+  bool Sync();
+  void GetStatistics(DedupStatistics& statistics);
+  const char* Directory() const { return directory_.c_str(); }
+
+ private:
+  struct ChunkLocation {
+    uint64_t offset;
+    uint32_t len;
+  };
+
+  std::string directory_;
+  int refcnt_ = 0;
+  int chunk_fd_ = -1;
+  uint64_t chunk_end_ = 0;
+  MDB_env* env_ = nullptr;
+  MDB_dbi dbi_ = 0;
+  pthread_mutex_t lock_;
+  DedupStatistics statistics_;
+
+  /*
+   * Chunks appended since the last commit of the index.
+   */
+  std::map<std::string, ChunkLocation> pending_;
+
+  explicit DedupStore(const char* directory);
+  ~DedupStore();
+
+  bool Init();
+  bool Lookup(const uint8_t* hash, ChunkLocation& location);
+  bool CommitPending();
+};
+
+} /* namespace storagedaemon */
+
+#endif /* BAREOS_STORED_BACKENDS_DEDUP_STORE_H_ */
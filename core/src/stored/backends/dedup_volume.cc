@@ -0,0 +1,709 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Volumes of the dedup device.
+ */
+
+#include "include/bareos.h"
+#include "stored/stored.h"
+#include "stored/crc32/crc32.h"
+#include "lib/berrno.h"
+#include "dedup_store.h"
+#include "dedup_volume.h"
+
+#include <algorithm>
+
+namespace storagedaemon {
+
+/*
+ * Layout of the volume file:
+ *
+ * - A volume header with an id and the version.
+ * - For every block an entry header, followed by the bytes of the block
+ *   kept in the volume file, a reference for every chunk in the store and
+ *   the payload after the last chunk boundary. The entry header holds the
+ *   length of the block, the number of bytes kept, the number of references,
+ *   the length of the payload after the last chunk boundary and a checksum
+ *   of everything following.
+ *
+ * A reference is the hash and the length of the chunk and the number of
+ * bytes at its start that belong to the previous blocks. Chunks span block
+ * boundaries so the same data stored in differently filled blocks still
+ * results in the same chunks. The payload after the last chunk boundary of
+ * a block is kept in the volume file and also becomes the start of the
+ * first chunk of the next block.
+ */
+#define DEDUP_VOLUME_ID "BareosDedupVol\0\0"
+#define DEDUP_VOLUME_ID_LENGTH 16
+#define DEDUP_VOLUME_VERSION 1
+#define DEDUP_VOLUME_HEADER_LENGTH 32
+#define DEDUP_ENTRY_HEADER_LENGTH 20
+#define DEDUP_REF_LENGTH (DEDUP_HASH_LENGTH + 8)
+
+static bool ReadFully(int fd, char* buffer, size_t count, uint64_t offset)
+{
+  while (count > 0) {
+    ssize_t n = pread(fd, buffer, count, offset);
+
+    if (n <= 0) {
+      if (n == 0) { errno = EIO; }
+      return false;
+    }
+    buffer += n;
+    count -= n;
+    offset += n;
+  }
+
+  return true;
+}
+
+static bool WriteFully(int fd, const char* buffer, size_t count, uint64_t offset)
+{
+  while (count > 0) {
+    ssize_t n = pwrite(fd, buffer, count, offset);
+
+    if (n <= 0) {
+      if (n == 0) { errno = ENOSPC; }
+      return false;
+    }
+    buffer += n;
+    count -= n;
+    offset += n;
+  }
+
+  return true;
+}
+
+/*
+ * Random values for the gear hash, generated with splitmix64 so they are
+ * the same on every platform and chunk boundaries never change.
+ */
+static uint64_t gear_table[256];
+
+static void InitGearTable()
+{
+  uint64_t seed = 0x42617265;
+
+  for (int i = 0; i < 256; i++) {
+    uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    gear_table[i] = z ^ (z >> 31);
+  }
+}
+
+DedupChunker::DedupChunker(uint32_t average_size)
+{
+  static pthread_once_t gear_table_once = PTHREAD_ONCE_INIT;
+  int bits = 0;
+
+  pthread_once(&gear_table_once, InitGearTable);
+
+  while ((1U << (bits + 1)) <= average_size) { bits++; }
+
+  /*
+   * The upper bits of the hash depend on the most bytes.
+   */
+  mask_ = bits ? ~((~(uint64_t)0) >> bits) : 0;
+  min_size_ = MAX(average_size / 4, 64);
+  max_size_ = average_size * 8;
+}
+
+uint32_t DedupChunker::NextChunk(const char* data,
+                                 uint32_t len,
+                                 bool* cut) const
+{
+  const uint8_t* p = (const uint8_t*)data;
+  uint32_t limit = MIN(len, max_size_);
+  uint64_t hash = 0;
+
+  *cut = len >= max_size_;
+  if (limit <= min_size_) { return limit; }
+
+  /*
+   * No cut before the minimum size, bytes before it still get hashed so
+   * the hash at the first possible cut point covers a full window.
+   */
+  for (uint32_t i = min_size_ - 64; i < min_size_; i++) {
+    hash = (hash << 1) + gear_table[p[i]];
+  }
+  for (uint32_t i = min_size_; i < limit; i++) {
+    hash = (hash << 1) + gear_table[p[i]];
+    if ((hash & mask_) == 0) {
+      *cut = true;
+      return i + 1;
+    }
+  }
+
+  return limit;
+}
+
+DedupVolume::DedupVolume(DedupStore* store, uint32_t average_chunk_size)
+    : store_(store), chunker_(average_chunk_size)
+{
+}
+
+DedupVolume::~DedupVolume() { Close(); }
+
+bool DedupVolume::CreateHeader()
+{
+  ser_declare;
+  char header[DEDUP_VOLUME_HEADER_LENGTH];
+
+  memset(header, 0, sizeof(header));
+  SerBegin(header, DEDUP_VOLUME_HEADER_LENGTH);
+  SerBytes(DEDUP_VOLUME_ID, DEDUP_VOLUME_ID_LENGTH);
+  ser_uint32(DEDUP_VOLUME_VERSION);
+
+  if (!WriteFully(fd_, header, sizeof(header), 0)) { return false; }
+  end_ = DEDUP_VOLUME_HEADER_LENGTH;
+
+  return true;
+}
+
+/**
+ * Read the volume header and build the index of all blocks. A partially
+ * written entry at the end, e.g. after a crash, is dropped.
+ */
+bool DedupVolume::LoadIndex()
+{
+  ser_declare;
+  char header[DEDUP_VOLUME_HEADER_LENGTH];
+  char id[DEDUP_VOLUME_ID_LENGTH];
+  uint32_t version;
+  struct stat st;
+  boffset_t offset = 0;
+
+  if (fstat(fd_, &st) != 0) { return false; }
+
+  if (!ReadFully(fd_, header, sizeof(header), 0)) { return false; }
+  UnserBegin(header, DEDUP_VOLUME_HEADER_LENGTH);
+  UnserBytes(id, DEDUP_VOLUME_ID_LENGTH);
+  unser_uint32(version);
+  if (memcmp(id, DEDUP_VOLUME_ID, DEDUP_VOLUME_ID_LENGTH) != 0 ||
+      version != DEDUP_VOLUME_VERSION) {
+    Dmsg1(100, "%s is not a dedup volume\n", path_.c_str());
+    errno = EINVAL;
+    return false;
+  }
+
+  end_ = DEDUP_VOLUME_HEADER_LENGTH;
+  while (end_ + DEDUP_ENTRY_HEADER_LENGTH <= (uint64_t)st.st_size) {
+    char entry[DEDUP_ENTRY_HEADER_LENGTH];
+    BlockEntry block;
+    uint64_t entry_len;
+
+    if (!ReadFully(fd_, entry, sizeof(entry), end_)) { return false; }
+    UnserBegin(entry, DEDUP_ENTRY_HEADER_LENGTH);
+    unser_uint32(block.len);
+    unser_uint32(block.meta_len);
+    unser_uint32(block.nrefs);
+    unser_uint32(block.tail_len);
+
+    /*
+     * The checksum is verified when the block gets read.
+     */
+    entry_len = DEDUP_ENTRY_HEADER_LENGTH + (uint64_t)block.meta_len +
+                (uint64_t)block.nrefs * DEDUP_REF_LENGTH + block.tail_len;
+    if (end_ + entry_len > (uint64_t)st.st_size) {
+      Dmsg2(100, "Dropping incomplete block at %llu of volume %s\n",
+            (unsigned long long)offset, path_.c_str());
+      break;
+    }
+
+    block.offset = offset;
+    block.pos = end_;
+    blocks_.push_back(block);
+
+    offset += block.len;
+    end_ += entry_len;
+  }
+
+  if ((flags_ & O_ACCMODE) != O_RDONLY && end_ < (uint64_t)st.st_size) {
+    if (ftruncate(fd_, end_) != 0) { return false; }
+  }
+
+  return true;
+}
+
+int DedupVolume::Open(const char* pathname, int flags, int mode)
+{
+  struct stat st;
+
+  Close();
+  path_ = pathname;
+  flags_ = flags;
+  mode_ = mode;
+
+  /*
+   * We need to read the volume file to append to it.
+   */
+  if ((flags & O_ACCMODE) != O_RDONLY) { flags = (flags & ~O_ACCMODE) | O_RDWR; }
+  flags &= ~(O_EXCL | O_TRUNC);
+
+  if ((fd_ = ::open(pathname, flags | O_BINARY, mode)) < 0) { return -1; }
+
+  if (fstat(fd_, &st) != 0) { goto bail_out; }
+  if (st.st_size == 0) {
+    if ((flags & O_ACCMODE) != O_RDONLY && !CreateHeader()) { goto bail_out; }
+  } else if (!LoadIndex()) {
+    goto bail_out;
+  }
+
+  Dmsg2(100, "Opened dedup volume %s blocks=%llu\n", path_.c_str(),
+        (unsigned long long)blocks_.size());
+
+  return fd_;
+
+bail_out:
+  int saved_errno = errno;
+
+  Close();
+  errno = saved_errno;
+  return -1;
+}
+
+int DedupVolume::Close()
+{
+  int status = 0;
+
+  if (fd_ >= 0 && ::close(fd_) != 0) { status = -1; }
+  fd_ = -1;
+  pos_ = 0;
+  end_ = 0;
+  blocks_.clear();
+  tail_.clear();
+  cached_block_ = -1;
+
+  return status;
+}
+
+boffset_t DedupVolume::VolumeSize() const
+{
+  if (blocks_.empty()) { return 0; }
+
+  return blocks_.back().offset + blocks_.back().len;
+}
+
+/**
+ * Find the block holding the byte at offset.
+ */
+ssize_t DedupVolume::FindBlock(boffset_t offset) const
+{
+  auto it = std::upper_bound(
+      blocks_.begin(), blocks_.end(), offset,
+      [](boffset_t value, const BlockEntry& block) {
+        return value < block.offset;
+      });
+
+  if (it == blocks_.begin()) { return -1; }
+  --it;
+  if (offset >= it->offset + (boffset_t)it->len) { return -1; }
+
+  return it - blocks_.begin();
+}
+
+/**
+ * Split a block in the parts kept in the volume file and the payloads going
+ * to the store, calling fill for each part in block order.
+ *
+ * Reading reassembles the block with the same walk, fill then copies each
+ * part into the block before it gets looked at. Payloads of records smaller
+ * than the minimum chunk size stay in the volume file. All payloads going
+ * to the store are chunked as one stream so the record headers in between
+ * do not influence the chunk boundaries.
+ */
+void DedupVolume::WalkBlock(
+    char* block,
+    uint32_t len,
+    const std::function<void(const Segment&)>& fill) const
+{
+  ser_declare;
+  uint32_t pos = 0;
+  uint32_t limit;
+
+  auto emit = [&](bool in_store, uint32_t n) {
+    Segment segment = {in_store, pos, n};
+
+    fill(segment);
+    pos += n;
+  };
+
+  /*
+   * Only blocks in the current format get split, anything else is kept
+   * in the volume file as is.
+   */
+  limit = MIN(len, BLKHDR2_LENGTH);
+  emit(false, limit);
+  if (limit == BLKHDR2_LENGTH &&
+      memcmp(block + BLKHDR_CS_LENGTH + 2 * sizeof(uint32_t), BLKHDR2_ID,
+             BLKHDR_ID_LENGTH) == 0) {
+    uint32_t block_len;
+
+    UnserBegin(block + BLKHDR_CS_LENGTH, sizeof(uint32_t));
+    unser_uint32(block_len);
+    if (block_len >= BLKHDR2_LENGTH && block_len <= len) { limit = block_len; }
+  }
+
+  while (pos + RECHDR2_LENGTH <= limit) {
+    int32_t Stream;
+    uint32_t data_bytes, n;
+
+    /*
+     * Skip the FileIndex, only the Stream and the length matter.
+     */
+    emit(false, RECHDR2_LENGTH);
+    UnserBegin(block + pos - RECHDR2_LENGTH + sizeof(int32_t),
+               RECHDR2_LENGTH - sizeof(int32_t));
+    unser_int32(Stream);
+    unser_uint32(data_bytes);
+
+    n = MIN(data_bytes, limit - pos);
+    if (n == 0) { continue; }
+
+    emit(Stream < 0 || data_bytes >= chunker_.MinSize(), n);
+  }
+
+  if (pos < len) { emit(false, len - pos); }
+}
+
+/**
+ * Reassemble a block from the volume file and the store.
+ */
+bool DedupVolume::ReadBlock(size_t index)
+{
+  const BlockEntry& block = blocks_[index];
+  const char* refs;
+  uint32_t meta_used = 0, data_used = 0, data_len = 0;
+  uint32_t checksum;
+  bool ok = true;
+  ser_declare;
+
+  if (cached_block_ == (ssize_t)index) { return true; }
+
+  entry_buf_.resize(DEDUP_ENTRY_HEADER_LENGTH + block.meta_len +
+                    (size_t)block.nrefs * DEDUP_REF_LENGTH + block.tail_len);
+  if (!ReadFully(fd_, entry_buf_.data(), entry_buf_.size(), block.pos)) {
+    return false;
+  }
+
+  UnserBegin(entry_buf_.data() + DEDUP_ENTRY_HEADER_LENGTH - sizeof(uint32_t),
+             sizeof(uint32_t));
+  unser_uint32(checksum);
+  if (checksum != crc32_fast(entry_buf_.data() + DEDUP_ENTRY_HEADER_LENGTH,
+                             entry_buf_.size() - DEDUP_ENTRY_HEADER_LENGTH)) {
+    Dmsg2(100, "Checksum error in block at %llu of volume %s\n",
+          (unsigned long long)block.offset, path_.c_str());
+    errno = EIO;
+    return false;
+  }
+
+  /*
+   * Fetch all chunks of the block from the store, skipping the bytes that
+   * belong to the previous blocks, followed by the payload kept after the
+   * last chunk boundary.
+   */
+  refs = entry_buf_.data() + DEDUP_ENTRY_HEADER_LENGTH + block.meta_len;
+  data_buf_.resize(block.len);
+  for (uint32_t i = 0; i < block.nrefs; i++) {
+    const char* ref = refs + (size_t)i * DEDUP_REF_LENGTH;
+    uint32_t chunk_len, skip;
+
+    UnserBegin(ref + DEDUP_HASH_LENGTH, 2 * sizeof(uint32_t));
+    unser_uint32(chunk_len);
+    unser_uint32(skip);
+    chunk_buf_.resize(chunk_len);
+    if (skip > chunk_len || data_len + chunk_len - skip > block.len ||
+        !store_->Get((const uint8_t*)ref, chunk_buf_.data(), chunk_len)) {
+      Dmsg2(100, "Unable to get chunk of block at %llu of volume %s\n",
+            (unsigned long long)block.offset, path_.c_str());
+      errno = EIO;
+      return false;
+    }
+    memcpy(data_buf_.data() + data_len, chunk_buf_.data() + skip,
+           chunk_len - skip);
+    data_len += chunk_len - skip;
+  }
+
+  if (data_len + block.tail_len > block.len) {
+    errno = EIO;
+    return false;
+  }
+  memcpy(data_buf_.data() + data_len,
+         refs + (size_t)block.nrefs * DEDUP_REF_LENGTH, block.tail_len);
+  data_len += block.tail_len;
+
+  block_buf_.resize(block.len);
+  WalkBlock(block_buf_.data(), block.len, [&](const Segment& segment) {
+    char* dest = block_buf_.data() + segment.pos;
+
+    if (segment.in_store) {
+      if (data_used + segment.len > data_len) {
+        memset(dest, 0, segment.len);
+        ok = false;
+        return;
+      }
+      memcpy(dest, data_buf_.data() + data_used, segment.len);
+      data_used += segment.len;
+    } else {
+      if (meta_used + segment.len > block.meta_len) {
+        memset(dest, 0, segment.len);
+        ok = false;
+        return;
+      }
+      memcpy(dest, entry_buf_.data() + DEDUP_ENTRY_HEADER_LENGTH + meta_used,
+             segment.len);
+      meta_used += segment.len;
+    }
+  });
+
+  if (!ok || meta_used != block.meta_len || data_used != data_len) {
+    Dmsg2(100, "Inconsistent block at %llu of volume %s\n",
+          (unsigned long long)block.offset, path_.c_str());
+    errno = EIO;
+    return false;
+  }
+
+  cached_block_ = index;
+  return true;
+}
+
+ssize_t DedupVolume::Read(void* buffer, size_t count)
+{
+  char* dest = (char*)buffer;
+  size_t done = 0;
+
+  while (done < count) {
+    ssize_t index = FindBlock(pos_);
+    uint32_t offset, n;
+
+    if (index < 0) { break; }
+    if (!ReadBlock(index)) {
+      if (done > 0) { break; }
+      return -1;
+    }
+
+    offset = pos_ - blocks_[index].offset;
+    n = MIN(count - done, blocks_[index].len - offset);
+    memcpy(dest + done, block_buf_.data() + offset, n);
+    done += n;
+    pos_ += n;
+  }
+
+  return done;
+}
+
+/**
+ * Forget all blocks from index on, writing never leaves a hole. The chunks
+ * of the dropped blocks stay in the store.
+ */
+void DedupVolume::DropBlocksFrom(size_t index)
+{
+  end_ = blocks_[index].pos;
+  blocks_.resize(index);
+  tail_.clear();
+  cached_block_ = -1;
+
+  if (ftruncate(fd_, end_) != 0) {
+    BErrNo be;
+
+    Dmsg2(100, "Unable to truncate dedup volume %s. ERR=%s\n", path_.c_str(),
+          be.bstrerror());
+  }
+}
+
+/**
+ * Write one block, blocks are only written at the end of the volume or
+ * overwrite the volume from the start of an existing block on.
+ */
+ssize_t DedupVolume::Write(const void* buffer, size_t count)
+{
+  char* block = (char*)buffer;
+  BlockEntry entry;
+  uint32_t checksum, data_len, pos, tail_pos;
+  ser_declare;
+
+  if (count == 0) { return 0; }
+  if (count > MAX_BLOCK_LENGTH) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (pos_ != VolumeSize()) {
+    ssize_t index = FindBlock(pos_);
+
+    if (index < 0 || blocks_[index].offset != pos_) {
+      errno = EINVAL;
+      return -1;
+    }
+    DropBlocksFrom(index);
+  }
+
+  /*
+   * The payloads going to the store continue the payload after the last
+   * chunk boundary of the previous block.
+   */
+  entry_buf_.resize(DEDUP_ENTRY_HEADER_LENGTH);
+  data_buf_.assign(tail_.begin(), tail_.end());
+  WalkBlock(block, count, [&](const Segment& segment) {
+    std::vector<char>& dest = segment.in_store ? data_buf_ : entry_buf_;
+
+    dest.insert(dest.end(), block + segment.pos,
+                block + segment.pos + segment.len);
+  });
+
+  entry.offset = pos_;
+  entry.pos = end_;
+  entry.len = count;
+  entry.meta_len = entry_buf_.size() - DEDUP_ENTRY_HEADER_LENGTH;
+  entry.nrefs = 0;
+
+  /*
+   * Cut the payloads into chunks, store them and add a reference for
+   * each chunk to the entry. The first chunk always ends in this block as
+   * the previous block ended without finding a chunk boundary.
+   */
+  data_len = data_buf_.size();
+  for (pos = 0; pos < data_len;) {
+    bool cut;
+    uint32_t chunk_len =
+        chunker_.NextChunk(data_buf_.data() + pos, data_len - pos, &cut);
+    uint8_t hash[CRYPTO_DIGEST_MAX_SIZE];
+    uint32_t hash_len = sizeof(hash);
+    char ref[DEDUP_REF_LENGTH];
+    DIGEST* digest;
+    bool ok;
+
+    if (!cut) { break; }
+
+    if (!(digest = crypto_digest_new(NULL, CRYPTO_DIGEST_SHA256))) {
+      errno = ENOTSUP;
+      return -1;
+    }
+    ok = CryptoDigestUpdate(digest, (const uint8_t*)data_buf_.data() + pos,
+                            chunk_len) &&
+         CryptoDigestFinalize(digest, hash, &hash_len) &&
+         hash_len == DEDUP_HASH_LENGTH;
+    CryptoDigestFree(digest);
+    if (!ok) {
+      errno = EIO;
+      return -1;
+    }
+
+    if (!store_->Put(hash, data_buf_.data() + pos, chunk_len)) { return -1; }
+
+    memcpy(ref, hash, DEDUP_HASH_LENGTH);
+    SerBegin(ref + DEDUP_HASH_LENGTH, 2 * sizeof(uint32_t));
+    ser_uint32(chunk_len);
+    ser_uint32(pos == 0 ? tail_.size() : 0);
+    entry_buf_.insert(entry_buf_.end(), ref, ref + DEDUP_REF_LENGTH);
+
+    entry.nrefs++;
+    pos += chunk_len;
+  }
+
+  /*
+   * Keep the payload after the last chunk boundary, without any boundary
+   * only the part of this block.
+   */
+  tail_pos = MAX(pos, (uint32_t)tail_.size());
+  entry.tail_len = data_len - tail_pos;
+  entry_buf_.insert(entry_buf_.end(), data_buf_.begin() + tail_pos,
+                    data_buf_.end());
+
+  checksum = crc32_fast(entry_buf_.data() + DEDUP_ENTRY_HEADER_LENGTH,
+                        entry_buf_.size() - DEDUP_ENTRY_HEADER_LENGTH);
+
+  SerBegin(entry_buf_.data(), DEDUP_ENTRY_HEADER_LENGTH);
+  ser_uint32(entry.len);
+  ser_uint32(entry.meta_len);
+  ser_uint32(entry.nrefs);
+  ser_uint32(entry.tail_len);
+  ser_uint32(checksum);
+
+  if (!WriteFully(fd_, entry_buf_.data(), entry_buf_.size(), entry.pos)) {
+    return -1;
+  }
+  tail_.assign(data_buf_.begin() + pos, data_buf_.end());
+
+  blocks_.push_back(entry);
+  end_ += entry_buf_.size();
+  pos_ += count;
+
+  return count;
+}
+
+boffset_t DedupVolume::Seek(boffset_t offset, int whence)
+{
+  boffset_t pos;
+
+  switch (whence) {
+    case SEEK_SET:
+      pos = offset;
+      break;
+    case SEEK_CUR:
+      pos = pos_ + offset;
+      break;
+    case SEEK_END:
+      pos = VolumeSize() + offset;
+      break;
+    default:
+      errno = EINVAL;
+      return -1;
+  }
+
+  if (pos < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  pos_ = pos;
+  return pos;
+}
+
+/**
+ * Empty the volume, with secure erase the file gets erased and recreated.
+ * The chunks stay in the store as other volumes may refer to them.
+ */
+bool DedupVolume::Truncate(JobControlRecord* jcr, bool secure_erase)
+{
+  if (secure_erase) {
+    ::close(fd_);
+    fd_ = -1;
+    SecureErase(jcr, path_.c_str());
+
+    if ((fd_ = ::open(path_.c_str(), O_CREAT | O_RDWR | O_BINARY, mode_)) < 0) {
+      return false;
+    }
+  } else if (ftruncate(fd_, 0) != 0) {
+    return false;
+  }
+
+  pos_ = 0;
+  blocks_.clear();
+  tail_.clear();
+  cached_block_ = -1;
+
+  return CreateHeader();
+}
+
+} /* namespace storagedaemon */
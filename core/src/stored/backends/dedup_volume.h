@@ -0,0 +1,136 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Volumes of the dedup device.
+ *
+ * The payload of all larger records in a block is cut into content defined
+ * chunks which go to a DedupStore. The volume file only keeps the block and
+ * record headers, the payload of small records and the hashes of the
+ * chunks. Reading reassembles the blocks so the rest of the storage daemon
+ * sees the same byte stream as with a plain file volume.
+ */
+
+#ifndef BAREOS_STORED_BACKENDS_DEDUP_VOLUME_H_
+#define BAREOS_STORED_BACKENDS_DEDUP_VOLUME_H_
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace storagedaemon {
+
+class DedupStore;
+
+/*
+ * Content defined chunking using a gear rolling hash, a chunk ends where
+ * the hash has the bits of the mask cleared. Chunks are between a quarter
+ * and eight times the average chunk size.
+ */
+class DedupChunker {
+ public:
+  explicit DedupChunker(uint32_t average_size);
+
+  /*
+   * Returns the length of the next chunk of data, cut is false when the
+   * data ended before a chunk boundary was found.
+   */
+  uint32_t NextChunk(const char* data, uint32_t len, bool* cut) const;
+
+  uint32_t MinSize() const { return min_size_; }
+
+ private:
+  uint64_t mask_;
+  uint32_t min_size_;
+  uint32_t max_size_;
+};
+
+class DedupVolume {
+ public:
+  DedupVolume(DedupStore* store, uint32_t average_chunk_size);
+  ~DedupVolume();
+
+  /*
+   * Returns the file descriptor of the volume file or -1 with errno set.
+   */
+  int Open(const char* pathname, int flags, int mode);
+  int Close();
+  ssize_t Read(void* buffer, size_t count);
+  ssize_t Write(const void* buffer, size_t count);
+  boffset_t Seek(boffset_t offset, int whence);
+  bool Truncate(JobControlRecord* jcr, bool secure_erase);
+
+  int Fd() const { return fd_; }
+
+ private:
+  struct BlockEntry {
+    boffset_t offset;  /* Offset of the block in the volume */
+    uint64_t pos;      /* Offset of the entry in the volume file */
+    uint32_t len;      /* Length of the block */
+    uint32_t meta_len; /* Bytes of the block kept in the volume file */
+    uint32_t nrefs;    /* Number of chunks in the store */
+    uint32_t tail_len; /* Payload bytes after the last chunk boundary */
+  };
+
+  struct Segment {
+    bool in_store; /* Stored as chunks or in the volume file */
+    uint32_t pos;  /* Offset in the block */
+    uint32_t len;  /* Length of the segment */
+  };
+
+  DedupStore* store_;
+  DedupChunker chunker_;
+  std::string path_;
+  int flags_ = 0;
+  int mode_ = 0;
+  int fd_ = -1;
+  boffset_t pos_ = 0;
+  uint64_t end_ = 0;
+  std::vector<BlockEntry> blocks_;
+
+  /*
+   * Payload after the last chunk boundary of the last block written, it
+   * starts the first chunk of the next block.
+   */
+  std::vector<char> tail_;
+
+  /*
+   * Last block reassembled for reading.
+   */
+  ssize_t cached_block_ = -1;
+  std::vector<char> block_buf_;
+  std::vector<char> entry_buf_;
+  std::vector<char> data_buf_;
+  std::vector<char> chunk_buf_;
+
+  bool CreateHeader();
+  bool LoadIndex();
+  boffset_t VolumeSize() const;
+  ssize_t FindBlock(boffset_t offset) const;
+  bool ReadBlock(size_t index);
+  void DropBlocksFrom(size_t index);
+  void WalkBlock(char* block,
+                 uint32_t len,
+                 const std::function<void(const Segment&)>& fill) const;
+};
+
+} /* namespace storagedaemon */
+
+#endif /* BAREOS_STORED_BACKENDS_DEDUP_VOLUME_H_ */
@@ -65,7 +65,8 @@ enum device_option_type
   argument_iothreads,
   argument_ioslots,
   argument_retries,
-  argument_mmap
+  argument_mmap,
+  argument_prefetch
 };
 
 struct device_option {
@@ -85,6 +86,7 @@ static device_option device_options[] = {
     {"ioslots=", argument_ioslots, 8},
     {"retries=", argument_retries, 8},
     {"mmap", argument_mmap, 4},
+    {"prefetch=", argument_prefetch, 9},
     {NULL, argument_none}};
 
 static int droplet_reference_count = 0;
@@ -759,6 +761,11 @@ bool droplet_device::initialize()
               use_mmap_ = true;
               done = true;
               break;
+            case argument_prefetch:
+              size_to_uint64(bp + device_options[i].compare_size, &value);
+              prefetch_chunks_ = value & 0xFF;
+              done = true;
+              break;
             default:
               break;
           }
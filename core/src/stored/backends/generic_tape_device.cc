@@ -368,6 +368,7 @@ bool generic_tape_device::weof(int num)
 {
   struct mtop mt_com;
   int status;
+  btime_t start;
   Dmsg1(129, "=== weof_dev=%s\n", prt_name);
 
   if (!IsOpen()) {
@@ -388,7 +389,9 @@ bool generic_tape_device::weof(int num)
   ClearEot();
   mt_com.mt_op = MTWEOF;
   mt_com.mt_count = num;
+  start = GetCurrentBtime();
   status = d_ioctl(fd_, MTIOCTOP, (char*)&mt_com);
+  latencies.Record(DeviceLatencyKind::kWeof, GetCurrentBtime() - start);
   if (status == 0) {
     block_num = 0;
     file += num;
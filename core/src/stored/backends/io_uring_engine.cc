@@ -0,0 +1,506 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * io_uring based I/O engine used by the UNIX file device.
+ *
+ * The rings are set up using the raw system calls so we don't depend on
+ * liburing. There is only one submitter and one reaper (the thread doing
+ * the I/O on the device) so the only synchronization needed is with the
+ * kernel on the ring head and tail indexes.
+ */
+
+#include "include/bareos.h"
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+#include "stored/backends/io_uring_engine.h"
+#include "lib/berrno.h"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+namespace storagedaemon {
+
+const size_t IoUringEngine::kDirectIoAlignment;
+static const uint64_t kSyncTag = ~(uint64_t)0;
+static const uint64_t kReadTag = ~(uint64_t)1;
+
+static inline int sys_io_uring_setup(unsigned int entries,
+                                     struct io_uring_params* p)
+{
+  return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int sys_io_uring_enter(int ring_fd,
+                                     unsigned int to_submit,
+                                     unsigned int min_complete,
+                                     unsigned int flags)
+{
+  return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags,
+                 NULL, 0);
+}
+
+static inline int sys_io_uring_register(int ring_fd,
+                                        unsigned int opcode,
+                                        void* arg,
+                                        unsigned int nr_args)
+{
+  return syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+IoUringEngine::~IoUringEngine()
+{
+  if (ring_fd_ >= 0) { Drain(); }
+  Cleanup();
+}
+
+void IoUringEngine::Cleanup()
+{
+  if (sqes_) { munmap(sqes_, sqes_size_); }
+  if (cq_ring_ && cq_ring_ != sq_ring_) { munmap(cq_ring_, cq_ring_size_); }
+  if (sq_ring_) { munmap(sq_ring_, sq_ring_size_); }
+  if (ring_fd_ >= 0) { close(ring_fd_); }
+  for (auto buffer : buffers_) { free(buffer); }
+
+  sqes_ = nullptr;
+  cq_ring_ = nullptr;
+  sq_ring_ = nullptr;
+  ring_fd_ = -1;
+  buffers_.clear();
+  lengths_.clear();
+  free_buffers_.clear();
+  in_flight_ = 0;
+}
+
+/**
+ * Setup the rings and allocate io_depth buffers of buffer_size bytes.
+ */
+bool IoUringEngine::Init(unsigned int io_depth,
+                         size_t buffer_size,
+                         bool direct_io)
+{
+  struct io_uring_params p;
+  std::vector<struct iovec> iovecs;
+
+  direct_io_ = direct_io;
+  buffer_size_ = (buffer_size + kDirectIoAlignment - 1) &
+                 ~(kDirectIoAlignment - 1);
+
+  /*
+   * One extra entry for the fsync or read submitted while all buffers are
+   * in flight.
+   */
+  memset(&p, 0, sizeof(p));
+  ring_fd_ = sys_io_uring_setup(io_depth + 1, &p);
+  if (ring_fd_ < 0) { return false; }
+
+  sq_entries_ = p.sq_entries;
+  sq_ring_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+  cq_ring_size_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    sq_ring_size_ = MAX(sq_ring_size_, cq_ring_size_);
+    cq_ring_size_ = sq_ring_size_;
+  }
+
+  sq_ring_ = mmap(NULL, sq_ring_size_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) {
+    sq_ring_ = nullptr;
+    goto bail_out;
+  }
+
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    cq_ring_ = sq_ring_;
+  } else {
+    cq_ring_ = mmap(NULL, cq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      cq_ring_ = nullptr;
+      goto bail_out;
+    }
+  }
+
+  sqes_size_ = p.sq_entries * sizeof(struct io_uring_sqe);
+  sqes_ = (struct io_uring_sqe*)mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE,
+                                     MAP_SHARED | MAP_POPULATE, ring_fd_,
+                                     IORING_OFF_SQES);
+  if (sqes_ == MAP_FAILED) {
+    sqes_ = nullptr;
+    goto bail_out;
+  }
+
+  sq_head_ = (unsigned int*)((char*)sq_ring_ + p.sq_off.head);
+  sq_tail_ = (unsigned int*)((char*)sq_ring_ + p.sq_off.tail);
+  sq_mask_ = (unsigned int*)((char*)sq_ring_ + p.sq_off.ring_mask);
+  sq_array_ = (unsigned int*)((char*)sq_ring_ + p.sq_off.array);
+  cq_head_ = (unsigned int*)((char*)cq_ring_ + p.cq_off.head);
+  cq_tail_ = (unsigned int*)((char*)cq_ring_ + p.cq_off.tail);
+  cq_mask_ = (unsigned int*)((char*)cq_ring_ + p.cq_off.ring_mask);
+  cqes_ = (struct io_uring_cqe*)((char*)cq_ring_ + p.cq_off.cqes);
+  sqe_tail_ = *sq_tail_;
+
+  for (unsigned int i = 0; i < io_depth; i++) {
+    void* buffer;
+
+    if (posix_memalign(&buffer, kDirectIoAlignment, buffer_size_) != 0) {
+      goto bail_out;
+    }
+    buffers_.push_back((char*)buffer);
+    lengths_.push_back(0);
+    free_buffers_.push_back(i);
+    iovecs.push_back({buffer, buffer_size_});
+  }
+
+  /*
+   * Registering the buffers saves pinning the pages on every I/O, when this
+   * fails (e.g. because of RLIMIT_MEMLOCK) we use them unregistered.
+   */
+  registered_ = sys_io_uring_register(ring_fd_, IORING_REGISTER_BUFFERS,
+                                      iovecs.data(), iovecs.size()) == 0;
+  if (!registered_) {
+    BErrNo be;
+
+    Dmsg1(100, "io_uring: unable to register buffers, ERR=%s\n",
+          be.bstrerror());
+  }
+
+  Dmsg4(100, "io_uring: setup ring with %u entries, %d buffers of %d bytes%s\n",
+        sq_entries_, (int)buffers_.size(), (int)buffer_size_,
+        direct_io_ ? " using O_DIRECT" : "");
+
+  return true;
+
+bail_out:
+  BErrNo be;
+  int saved_errno = errno;
+
+  Dmsg1(100, "io_uring: setup failed, ERR=%s\n", be.bstrerror());
+  Cleanup();
+  errno = saved_errno;
+
+  return false;
+}
+
+bool IoUringEngine::IsAligned(size_t count, boffset_t offset) const
+{
+  return (count % kDirectIoAlignment) == 0 &&
+         (offset % kDirectIoAlignment) == 0;
+}
+
+struct io_uring_sqe* IoUringEngine::GetSqe()
+{
+  unsigned int index = sqe_tail_ & *sq_mask_;
+  struct io_uring_sqe* sqe = &sqes_[index];
+
+  memset(sqe, 0, sizeof(*sqe));
+  sq_array_[index] = index;
+  sqe_tail_++;
+  to_submit_++;
+
+  return sqe;
+}
+
+/**
+ * Publish the prepared submission queue entries to the kernel and
+ * optionally wait for wait_nr completions.
+ */
+bool IoUringEngine::Submit(unsigned int wait_nr)
+{
+  int status;
+
+  __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+
+  while (to_submit_ > 0 || wait_nr > 0) {
+    status = sys_io_uring_enter(ring_fd_, to_submit_, wait_nr,
+                                wait_nr ? IORING_ENTER_GETEVENTS : 0);
+    if (status < 0) {
+      if (errno == EINTR) { continue; }
+      if (errno == EAGAIN || errno == EBUSY) {
+        ReapCompletions();
+        continue;
+      }
+      return false;
+    }
+
+    to_submit_ -= status;
+    if (to_submit_ == 0) { break; }
+  }
+
+  return true;
+}
+
+void IoUringEngine::ReapCompletions()
+{
+  unsigned int head = *cq_head_;
+  unsigned int tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+
+  while (head != tail) {
+    struct io_uring_cqe* cqe = &cqes_[head & *cq_mask_];
+
+    if (cqe->user_data == kSyncTag || cqe->user_data == kReadTag) {
+      if (cqe->res < 0 && cqe->user_data == kSyncTag && !error_) {
+        error_ = -cqe->res;
+      }
+      last_result_ = cqe->res;
+    } else {
+      int index = (int)cqe->user_data;
+
+      if (!error_) {
+        if (cqe->res < 0) {
+          error_ = -cqe->res;
+        } else if ((size_t)cqe->res != lengths_[index]) {
+          Dmsg2(100, "io_uring: short write of %d bytes instead of %d\n",
+                cqe->res, (int)lengths_[index]);
+          error_ = ENOSPC;
+        }
+      }
+      free_buffers_.push_back(index);
+    }
+
+    in_flight_--;
+    head++;
+  }
+
+  __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+}
+
+bool IoUringEngine::WaitForCompletions(unsigned int wait_nr)
+{
+  if (!Submit(wait_nr)) { return false; }
+  ReapCompletions();
+
+  return true;
+}
+
+/**
+ * Wait for all I/O in flight to complete.
+ */
+bool IoUringEngine::Drain()
+{
+  while (in_flight_ > 0) {
+    if (!WaitForCompletions(1)) { return false; }
+  }
+
+  return error_ == 0;
+}
+
+/**
+ * Take over the error of a write or fsync which completed after we
+ * already returned success for it.
+ */
+int IoUringEngine::TakeError()
+{
+  int error = error_;
+
+  error_ = 0;
+  return error;
+}
+
+/**
+ * I/O that is not properly aligned cannot be done with O_DIRECT. Once the
+ * first such request shows up (e.g. after the short last block of a job)
+ * all following offsets on the volume are unaligned too, so we clear
+ * O_DIRECT for the rest of the time the file is open instead of toggling
+ * it for every request.
+ */
+void IoUringEngine::LeaveDirectIo(int fd)
+{
+  int flags = fcntl(fd, F_GETFL);
+
+  if (flags < 0 || !(flags & O_DIRECT)) { return; }
+
+  Drain();
+  if (fcntl(fd, F_SETFL, flags & ~O_DIRECT) == 0) {
+    Dmsg1(100, "io_uring: unaligned I/O, fd %d continues without O_DIRECT\n",
+          fd);
+  }
+}
+
+/**
+ * Do I/O the engine cannot handle with its buffers synchronously after all
+ * outstanding I/O is finished. The caller's buffer is not aligned, so this
+ * is done without O_DIRECT.
+ */
+ssize_t IoUringEngine::SynchronousIo(int fd,
+                                     const struct iovec* iov,
+                                     int iovcnt,
+                                     boffset_t offset,
+                                     bool write)
+{
+  ssize_t status;
+
+  if (direct_io_) { LeaveDirectIo(fd); }
+
+  Drain();
+  if (in_flight_ > 0) { return -1; }
+
+  if (write) {
+    status = pwritev(fd, iov, iovcnt, offset);
+    if (status > 0) { dirty_ = true; }
+  } else {
+    status = preadv(fd, iov, iovcnt, offset);
+  }
+
+  return status;
+}
+
+ssize_t IoUringEngine::Write(int fd,
+                             const void* buffer,
+                             size_t count,
+                             boffset_t offset)
+{
+  struct iovec iov = {(void*)buffer, count};
+
+  return WriteV(fd, &iov, 1, offset);
+}
+
+/**
+ * Queue a write of the data described by iov at offset. The data is
+ * gathered into one of our buffers so the caller can reuse its buffers as
+ * soon as we return.
+ */
+ssize_t IoUringEngine::WriteV(int fd,
+                              const struct iovec* iov,
+                              int iovcnt,
+                              boffset_t offset)
+{
+  int index;
+  size_t count = 0;
+  char* bp;
+  struct io_uring_sqe* sqe;
+
+  for (int i = 0; i < iovcnt; i++) { count += iov[i].iov_len; }
+
+  if (direct_io_ && !IsAligned(count, offset)) { LeaveDirectIo(fd); }
+
+  if (count > buffer_size_) {
+    return SynchronousIo(fd, iov, iovcnt, offset, true);
+  }
+
+  while (free_buffers_.empty()) {
+    if (!WaitForCompletions(1)) { return -1; }
+  }
+
+  index = free_buffers_.back();
+  free_buffers_.pop_back();
+  bp = buffers_[index];
+  for (int i = 0; i < iovcnt; i++) {
+    memcpy(bp, iov[i].iov_base, iov[i].iov_len);
+    bp += iov[i].iov_len;
+  }
+  lengths_[index] = count;
+
+  sqe = GetSqe();
+  sqe->opcode = registered_ ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)(uintptr_t)buffers_[index];
+  sqe->len = count;
+  sqe->off = offset;
+  sqe->buf_index = index;
+  sqe->user_data = index;
+  in_flight_++;
+  dirty_ = true;
+
+  if (!Submit(0)) { return -1; }
+
+  return count;
+}
+
+/**
+ * Read count bytes at offset after all writes in flight have finished.
+ */
+ssize_t IoUringEngine::Read(int fd, void* buffer, size_t count, boffset_t offset)
+{
+  size_t len;
+  struct io_uring_sqe* sqe;
+
+  if (direct_io_ && !IsAligned(0, offset)) { LeaveDirectIo(fd); }
+
+  if (count > buffer_size_) {
+    struct iovec iov = {buffer, count};
+
+    return SynchronousIo(fd, &iov, 1, offset, false);
+  }
+
+  Drain();
+  if (in_flight_ > 0) { return -1; }
+
+  /*
+   * For O_DIRECT read up to the next aligned size, we return at most count
+   * bytes anyway.
+   */
+  len = count;
+  if (direct_io_) {
+    len = (count + kDirectIoAlignment - 1) & ~(kDirectIoAlignment - 1);
+  }
+
+  sqe = GetSqe();
+  sqe->opcode = registered_ ? IORING_OP_READ_FIXED : IORING_OP_READ;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)(uintptr_t)buffers_[0];
+  sqe->len = len;
+  sqe->off = offset;
+  sqe->buf_index = 0;
+  sqe->user_data = kReadTag;
+  in_flight_++;
+
+  if (!WaitForCompletions(1)) { return -1; }
+
+  if (last_result_ < 0) {
+    errno = -last_result_;
+    return -1;
+  }
+
+  len = MIN((size_t)last_result_, count);
+  memcpy(buffer, buffers_[0], len);
+
+  return len;
+}
+
+/**
+ * Flush the file to stable storage. The fsync is flagged IOSQE_IO_DRAIN so
+ * the kernel only starts it after all writes submitted before it completed.
+ */
+bool IoUringEngine::Sync(int fd)
+{
+  struct io_uring_sqe* sqe;
+
+  if (!dirty_) { return Drain(); }
+
+  sqe = GetSqe();
+  sqe->opcode = IORING_OP_FSYNC;
+  sqe->flags = IOSQE_IO_DRAIN;
+  sqe->fd = fd;
+  sqe->user_data = kSyncTag;
+  in_flight_++;
+
+  if (!Submit(0)) { return false; }
+  dirty_ = false;
+
+  return Drain();
+}
+
+} /* namespace storagedaemon */
+
+#endif /* HAVE_LINUX_IO_URING_H */
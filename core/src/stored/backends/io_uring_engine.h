@@ -0,0 +1,109 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * io_uring based I/O engine used by the UNIX file device.
+ */
+
+#ifndef BAREOS_STORED_BACKENDS_IO_URING_ENGINE_H_
+#define BAREOS_STORED_BACKENDS_IO_URING_ENGINE_H_
+
+#include <vector>
+
+struct iovec;
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace storagedaemon {
+
+/*
+ * Writes are copied into one of the registered buffers and submitted at an
+ * explicit file offset, so up to io_depth writes are in flight while the
+ * caller continues. An error of a write in flight is reported by the next
+ * call into the engine, it is always returned as EIO as the caller already
+ * moved on to the next block.
+ */
+class IoUringEngine {
+ public:
+  static const size_t kDirectIoAlignment = 4096;
+
+  IoUringEngine() = default;
+  ~IoUringEngine();
+
+  bool Init(unsigned int io_depth, size_t buffer_size, bool direct_io);
+  ssize_t Write(int fd, const void* buffer, size_t count, boffset_t offset);
+  ssize_t WriteV(int fd, const struct iovec* iov, int iovcnt, boffset_t offset);
+  ssize_t Read(int fd, void* buffer, size_t count, boffset_t offset);
+  bool Drain();
+  bool Sync(int fd);
+  int TakeError();
+
+ private:
+  int ring_fd_ = -1;
+  bool direct_io_ = false;
+  bool registered_ = false; /**< Buffers are registered with the kernel */
+  size_t buffer_size_ = 0;
+  int error_ = 0;         /**< Errno of the first failed I/O in flight */
+  bool dirty_ = false;    /**< Writes done since the last Sync() */
+  int last_result_ = 0;   /**< Result of the last read or fsync */
+  unsigned int in_flight_ = 0;
+  unsigned int sqe_tail_ = 0;  /**< Tail including unpublished entries */
+  unsigned int to_submit_ = 0; /**< Entries not yet consumed by the kernel */
+  unsigned int sq_entries_ = 0;
+
+  /*
+   * Submission and completion ring as mapped from the kernel.
+   */
+  void* sq_ring_ = nullptr;
+  size_t sq_ring_size_ = 0;
+  void* cq_ring_ = nullptr;
+  size_t cq_ring_size_ = 0;
+  io_uring_sqe* sqes_ = nullptr;
+  size_t sqes_size_ = 0;
+  unsigned int* sq_head_ = nullptr;
+  unsigned int* sq_tail_ = nullptr;
+  unsigned int* sq_mask_ = nullptr;
+  unsigned int* sq_array_ = nullptr;
+  unsigned int* cq_head_ = nullptr;
+  unsigned int* cq_tail_ = nullptr;
+  unsigned int* cq_mask_ = nullptr;
+  io_uring_cqe* cqes_ = nullptr;
+
+  std::vector<char*> buffers_;    /**< Registered buffers */
+  std::vector<size_t> lengths_;   /**< Length of the write using a buffer */
+  std::vector<int> free_buffers_; /**< Indexes of unused buffers */
+
+  void Cleanup();
+  bool IsAligned(size_t count, boffset_t offset) const;
+  void LeaveDirectIo(int fd);
+  io_uring_sqe* GetSqe();
+  bool Submit(unsigned int wait_nr);
+  bool WaitForCompletions(unsigned int wait_nr);
+  void ReapCompletions();
+  ssize_t SynchronousIo(int fd,
+                        const struct iovec* iov,
+                        int iovcnt,
+                        boffset_t offset,
+                        bool write);
+};
+
+} /* namespace storagedaemon */
+
+#endif /* BAREOS_STORED_BACKENDS_IO_URING_ENGINE_H_ */
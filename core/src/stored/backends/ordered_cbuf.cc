@@ -26,39 +26,122 @@
  * Ordered Circular buffer used for producer/consumer problem with pthreads.
  */
 #include "include/bareos.h"
-#include "lib/dlist.h"
 #include "ordered_cbuf.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
 namespace storagedaemon {
 
+/*
+ * The low bits of a slot state word hold the state of the slot, the
+ * remaining bits the generation of the slot.
+ *
+ * SLOT_FREE   - slot is unused
+ * SLOT_BUSY   - slot is being filled by a producer or emptied by a consumer
+ * SLOT_READY  - slot holds an item which can be dequeued
+ * SLOT_PINNED - slot holds an item which is being updated or peeked at
+ */
+#define SLOT_FREE 0
+#define SLOT_BUSY 1
+#define SLOT_READY 2
+#define SLOT_PINNED 3
+#define SLOT_STATE_MASK 3
+#define SLOT_GENERATION_SHIFT 2
+
+static inline uint64_t SlotState(uint64_t state)
+{
+  return state & SLOT_STATE_MASK;
+}
+
+static inline uint64_t SlotGeneration(uint64_t state)
+{
+  return state >> SLOT_GENERATION_SHIFT;
+}
+
+static inline uint64_t MakeSlotState(uint64_t generation, uint64_t state)
+{
+  return (generation << SLOT_GENERATION_SHIFT) | state;
+}
+
+/*
+ * Compare two keys, as a word of a name is never zero a longer name sorts
+ * after a shorter name with the same leading words.
+ */
+static inline int CompareKeys(const ocbuf_key& key1, const ocbuf_key& key2)
+{
+  uint32_t name_words = std::min(key1.length, key2.length) - 1;
+
+  for (uint32_t i = 0; i < name_words; i++) {
+    if (key1.word[i] != key2.word[i]) {
+      return (key1.word[i] < key2.word[i]) ? -1 : 1;
+    }
+  }
+
+  if (key1.length != key2.length) {
+    return (key1.length < key2.length) ? -1 : 1;
+  }
+
+  if (key1.word[name_words] != key2.word[name_words]) {
+    return (key1.word[name_words] < key2.word[name_words]) ? -1 : 1;
+  }
+
+  return 0;
+}
+
+/*
+ * Build a key which orders on name first and on number second. The name is
+ * stored big endian so comparing the words gives the same ordering as
+ * strcmp(). Names longer than 128 bytes are truncated.
+ */
+void MakeOcbufKey(ocbuf_key& key, const char* name, uint64_t number)
+{
+  uint32_t i = 0;
+
+  while (i < OCBUF_KEY_WORDS - 1 && *name) {
+    key.word[i] = 0;
+    for (int j = 0; j < 8; j++) {
+      key.word[i] <<= 8;
+      if (*name) { key.word[i] |= (uint8_t)*name++; }
+    }
+    i++;
+  }
+  key.word[i] = number;
+  key.length = i + 1;
+}
 
 /*
  * Initialize a new ordered circular buffer.
  */
 int ordered_circbuf::init(int capacity)
 {
-  struct ocbuf_item* item = NULL;
+  if (pthread_mutex_init(&producer_lock_, NULL) != 0) { return -1; }
 
-  if (pthread_mutex_init(&lock_, NULL) != 0) { return -1; }
+  if (pthread_mutex_init(&lock_, NULL) != 0) {
+    pthread_mutex_destroy(&producer_lock_);
+    return -1;
+  }
 
   if (pthread_cond_init(&notfull_, NULL) != 0) {
     pthread_mutex_destroy(&lock_);
+    pthread_mutex_destroy(&producer_lock_);
     return -1;
   }
 
   if (pthread_cond_init(&notempty_, NULL) != 0) {
     pthread_cond_destroy(&notfull_);
     pthread_mutex_destroy(&lock_);
+    pthread_mutex_destroy(&producer_lock_);
     return -1;
   }
 
   size_ = 0;
-  capacity_ = capacity;
+  occupied_ = 0;
   reserved_ = 0;
-  if (data_) {
-    data_->destroy();
-    delete data_;
-  }
-  data_ = new dlist(item, &item->link);
+  capacity_ = capacity;
+  if (slots_) { delete[] slots_; }
+  slots_ = new ocbuf_slot[capacity];
 
   return 0;
 }
@@ -71,95 +154,343 @@ void ordered_circbuf::destroy()
   pthread_cond_destroy(&notempty_);
   pthread_cond_destroy(&notfull_);
   pthread_mutex_destroy(&lock_);
-  if (data_) {
-    data_->destroy();
-    delete data_;
+  pthread_mutex_destroy(&producer_lock_);
+  if (slots_) {
+    delete[] slots_;
+    slots_ = nullptr;
+  }
+}
+
+/*
+ * Account for a new item, either by using a slot reserved by dequeue()
+ * or by waiting until there is room on the buffer.
+ */
+void ordered_circbuf::AcquireSlot(bool use_reserved_slot)
+{
+  int value;
+
+  if (use_reserved_slot) {
+    value = reserved_.load();
+    while (value > 0) {
+      if (reserved_.compare_exchange_weak(value, value - 1)) { return; }
+    }
+  }
+
+  while (1) {
+    value = occupied_.load();
+    if (value < capacity_) {
+      if (occupied_.compare_exchange_weak(value, value + 1)) { return; }
+      continue;
+    }
+
+    /*
+     * Wait while the buffer is full. The counter is raised under the lock
+     * so ReleaseSlot() either sees us waiting or we see its update.
+     */
+    pthread_mutex_lock(&lock_);
+    waiting_producers_++;
+    while (occupied_.load() >= capacity_) {
+      pthread_cond_wait(&notfull_, &lock_);
+    }
+    waiting_producers_--;
+    pthread_mutex_unlock(&lock_);
+  }
+}
+
+/*
+ * Give back a slot and let all waiting producers know there is room.
+ */
+void ordered_circbuf::ReleaseSlot()
+{
+  occupied_--;
+  if (waiting_producers_.load() > 0) {
+    pthread_mutex_lock(&lock_);
+    pthread_cond_broadcast(&notfull_);
+    pthread_mutex_unlock(&lock_);
   }
 }
 
+/*
+ * Let a waiting consumer know there is data, one is enough for one item.
+ */
+void ordered_circbuf::WakeConsumers()
+{
+  if (waiting_consumers_.load() > 0) {
+    pthread_mutex_lock(&lock_);
+    pthread_cond_signal(&notempty_);
+    pthread_mutex_unlock(&lock_);
+  }
+}
+
+/*
+ * Find a free slot and mark it busy. As the number of items is limited by
+ * AcquireSlot() there is always a free slot, we only have to wait for
+ * consumers that are still releasing their slot.
+ */
+int ordered_circbuf::ClaimFreeSlot()
+{
+  int start = next_slot_.load(std::memory_order_relaxed);
+  uint64_t state;
+
+  while (1) {
+    for (int n = 0; n < capacity_; n++) {
+      int i = (start + n) % capacity_;
+
+      state = slots_[i].state.load();
+      if (SlotState(state) != SLOT_FREE) { continue; }
+
+      if (slots_[i].state.compare_exchange_strong(
+              state, MakeSlotState(SlotGeneration(state), SLOT_BUSY))) {
+        next_slot_.store((i + 1) % capacity_, std::memory_order_relaxed);
+        return i;
+      }
+    }
+    std::this_thread::yield();
+  }
+}
+
+/*
+ * Read the key of a slot without claiming it. The key is only valid when
+ * the slot still holds the same item afterwards, see SameItem().
+ */
+void ordered_circbuf::LoadKey(int slot, ocbuf_key& key)
+{
+  key.length = slots_[slot].key_length.load(std::memory_order_relaxed);
+  if (key.length < 1 || key.length > OCBUF_KEY_WORDS) { key.length = 1; }
+  for (uint32_t i = 0; i < key.length; i++) {
+    key.word[i] = slots_[slot].key[i].load(std::memory_order_relaxed);
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+}
+
+/*
+ * Compare the key of a slot against a key, only reading as many words of
+ * the slot as needed. Like LoadKey() the result is only valid when the slot
+ * still holds the same item afterwards.
+ */
+int ordered_circbuf::CompareSlotKey(int slot, const ocbuf_key& key)
+{
+  ocbuf_slot& s = slots_[slot];
+  uint32_t length, name_words;
+  uint64_t word;
+  int retval = 0;
+
+  length = s.key_length.load(std::memory_order_relaxed);
+  if (length < 1 || length > OCBUF_KEY_WORDS) { length = 1; }
+  name_words = std::min(length, key.length) - 1;
+
+  for (uint32_t i = 0; i < name_words && retval == 0; i++) {
+    word = s.key[i].load(std::memory_order_relaxed);
+    if (word != key.word[i]) { retval = (word < key.word[i]) ? -1 : 1; }
+  }
+
+  if (retval == 0 && length != key.length) {
+    retval = (length < key.length) ? -1 : 1;
+  }
+
+  if (retval == 0) {
+    word = s.key[name_words].load(std::memory_order_relaxed);
+    if (word != key.word[name_words]) {
+      retval = (word < key.word[name_words]) ? -1 : 1;
+    }
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+
+  return retval;
+}
+
+/*
+ * See if a slot still holds the item it held when state was read.
+ */
+bool ordered_circbuf::SameItem(int slot, uint64_t state)
+{
+  uint64_t current = slots_[slot].state.load(std::memory_order_relaxed);
+
+  if (SlotGeneration(current) != SlotGeneration(state)) { return false; }
+
+  return SlotState(current) == SLOT_READY || SlotState(current) == SLOT_PINNED;
+}
+
+/*
+ * Pin the item in a slot so it can be looked at or updated, waits for
+ * anyone else having it pinned. Returns false when the item was dequeued.
+ */
+bool ordered_circbuf::PinSlot(int slot, uint64_t generation)
+{
+  uint64_t state;
+
+  while (1) {
+    state = slots_[slot].state.load();
+    if (SlotGeneration(state) != generation) { return false; }
+
+    switch (SlotState(state)) {
+      case SLOT_READY:
+        if (slots_[slot].state.compare_exchange_weak(
+                state, MakeSlotState(generation, SLOT_PINNED))) {
+          return true;
+        }
+        break;
+      case SLOT_PINNED:
+        std::this_thread::yield();
+        break;
+      default:
+        return false;
+    }
+  }
+}
+
+void ordered_circbuf::UnpinSlot(int slot)
+{
+  uint64_t state = slots_[slot].state.load(std::memory_order_relaxed);
+
+  slots_[slot].state.store(MakeSlotState(SlotGeneration(state), SLOT_READY),
+                           std::memory_order_release);
+}
+
 /*
  * Enqueue a new item into the ordered circular buffer.
  */
 void* ordered_circbuf::enqueue(void* data,
                                uint32_t data_size,
-                               int compare(void* item1, void* item2),
+                               const ocbuf_key& key,
                                void update(void* item1, void* item2),
                                bool use_reserved_slot,
                                bool no_signal)
 {
-  struct ocbuf_item *new_item, *item;
-
-  if (pthread_mutex_lock(&lock_) != 0) { return NULL; }
+  int i, slot;
+  uint64_t state;
 
   /*
-   * See if we should use a reserved slot and there are actually slots reserved.
+   * Account for the new item before taking the producer lock, a consumer
+   * requeueing into its reserved slot should never wait for a producer
+   * waiting for room on the buffer.
    */
-  if (!use_reserved_slot || !reserved_) {
-    /*
-     * Wait while the buffer is full.
-     */
-    while (full()) { pthread_cond_wait(&notfull_, &lock_); }
+  AcquireSlot(use_reserved_slot);
+
+  if (pthread_mutex_lock(&producer_lock_) != 0) {
+    ReleaseSlot();
+    return NULL;
   }
 
   /*
-   * Decrease the number of reserved slots if we should use a reserved slot.
-   * We do this even when we don't really add a new item to the ordered
-   * circular list to keep the reserved slot counting consistent.
+   * See if there is already an entry with the same key on the ordered
+   * circular buffer. We then just call the update function callback which
+   * should perform the right actions to update the already existing item
+   * with the new data. As only producers fill slots the keys we look at
+   * cannot change under us, PinSlot() tells if the item is still there.
    */
-  if (use_reserved_slot) { reserved_--; }
+  for (i = 0; i < capacity_; i++) {
+    state = slots_[i].state.load();
+    if (SlotState(state) != SLOT_READY && SlotState(state) != SLOT_PINNED) {
+      continue;
+    }
 
-  /*
-   * Binary insert the data into the ordered circular buffer. If the
-   * item returned is not our new_item it means there is already an
-   * entry with the same keys on the ordered circular list. We then
-   * just call the update function callback which should perform the
-   * right actions to update the already existing item with the new
-   * data in the new item. The compare function callback is used to binary
-   * insert the item at the right location in the ordered circular list.
-   */
-  new_item = (struct ocbuf_item*)malloc(sizeof(struct ocbuf_item));
-  new_item->data = data;
-  new_item->data_size = data_size;
-
-  item = (struct ocbuf_item*)data_->binary_insert(new_item, compare);
-  if (item == new_item) {
-    size_++;
-  } else {
-    /*
-     * Update the data on the ordered circular list with the new data.
-     * e.g. replace the old with the new data but don't allocate a new
-     * item on the ordered circular list.
-     */
-    update(item->data, new_item->data);
+    if (CompareSlotKey(i, key) != 0) { continue; }
+
+    if (!PinSlot(i, SlotGeneration(state))) {
+      /*
+       * Dequeued while we were looking, so this is a new item.
+       */
+      continue;
+    }
+
+    update(slots_[i].data, data);
+    data = slots_[i].data;
+    UnpinSlot(i);
+    pthread_mutex_unlock(&producer_lock_);
 
     /*
-     * Release the unused ocbuf_item.
+     * The update didn't use a new slot.
      */
-    free(new_item);
+    ReleaseSlot();
+    if (!no_signal) { WakeConsumers(); }
 
     /*
-     * Update data to point to the data that was attached to the original
-     * ocbuf_item.
+     * Return the data that was already on the ordered circular buffer.
      */
-    data = item->data;
+    return data;
   }
 
+  slot = ClaimFreeSlot();
+  slots_[slot].data = data;
+  slots_[slot].data_size = data_size;
+
+  /*
+   * Make sure a consumer reading the key sees the slot changed before
+   * it sees any of the new key.
+   */
+  std::atomic_thread_fence(std::memory_order_release);
+  slots_[slot].key_length.store(key.length, std::memory_order_relaxed);
+  for (i = 0; i < (int)key.length; i++) {
+    slots_[slot].key[i].store(key.word[i], std::memory_order_relaxed);
+  }
+  size_++;
+  state = slots_[slot].state.load(std::memory_order_relaxed);
+  slots_[slot].state.store(MakeSlotState(SlotGeneration(state), SLOT_READY),
+                           std::memory_order_release);
+
+  pthread_mutex_unlock(&producer_lock_);
+
   /*
    * See if we need to signal any workers that work is available or not.
    */
-  if (!no_signal) {
+  if (!no_signal) { WakeConsumers(); }
+
+  return data;
+}
+
+/*
+ * Take the item with the lowest key from the buffer. Returns NULL when
+ * there is no item ready to be taken.
+ */
+void* ordered_circbuf::TakeFirst()
+{
+  int i, first;
+  uint64_t state, first_state = 0;
+  ocbuf_key key, first_key;
+  void* data;
+
+  while (1) {
+    first = -1;
+    for (i = 0; i < capacity_; i++) {
+      state = slots_[i].state.load(std::memory_order_acquire);
+      if (SlotState(state) != SLOT_READY) { continue; }
+
+      /*
+       * Only read the whole key of a slot holding a new lowest key.
+       */
+      if (first >= 0) {
+        if (CompareSlotKey(i, first_key) >= 0) { continue; }
+        if (!SameItem(i, state)) { continue; }
+      }
+
+      LoadKey(i, key);
+      if (!SameItem(i, state)) { continue; }
+
+      first = i;
+      first_state = state;
+      first_key = key;
+    }
+
+    if (first < 0) { return NULL; }
+
     /*
-     * Let any waiting consumer know there is data.
+     * Claim the slot, when someone else was faster look again.
      */
-    pthread_cond_broadcast(&notempty_);
+    if (slots_[first].state.compare_exchange_strong(
+            first_state,
+            MakeSlotState(SlotGeneration(first_state), SLOT_BUSY))) {
+      break;
+    }
   }
 
-  pthread_mutex_unlock(&lock_);
+  size_--;
+  data = slots_[first].data;
+  slots_[first].data = nullptr;
+  slots_[first].state.store(
+      MakeSlotState(SlotGeneration(first_state) + 1, SLOT_FREE),
+      std::memory_order_release);
 
-  /*
-   * Return the data that is current e.g. either the new data passed in or
-   * the already existing data on the ordered circular list.
-   */
   return data;
 }
 
@@ -171,101 +502,81 @@ void* ordered_circbuf::dequeue(bool reserve_slot,
                                struct timespec* ts,
                                int timeout)
 {
-  void* data = NULL;
-  struct ocbuf_item* item;
-
-  if (pthread_mutex_lock(&lock_) != 0) { return NULL; }
+  void* data;
 
-  /*
-   * Wait while there is nothing in the buffer
-   */
-  while ((requeued || empty()) && !flush_) {
-    /*
-     * The requeued state is only valid one time so clear it.
-     */
-    requeued = false;
+  while (1) {
+    if (!requeued || flush_) {
+      data = TakeFirst();
+      if (data) {
+        /*
+         * Keep the slot accounted for when we are asked to reserve it.
+         */
+        if (reserve_slot) {
+          reserved_++;
+        } else {
+          ReleaseSlot();
+        }
 
-    /*
-     * See if we should block indefinitely or wake up
-     * after the given timer has expired and calculate
-     * the next time we need to wakeup. This way we check
-     * after the timer expired if there is work to be done
-     * this is something we need if the worker threads can
-     * put work back onto the circular queue and uses
-     * enqueue with the no_signal flag set.
-     */
-    if (ts) {
-      pthread_cond_timedwait(&notempty_, &lock_, ts);
+        return data;
+      }
 
       /*
-       * See if there is really work to be done.
-       * We could be woken by the broadcast but some other iothread
-       * could take the work as we have to wait to reacquire the lock_.
-       * Only one thread will be in the critical section and be able to
-       * hold the lock.
+       * When we are requested to flush and there is no data left return NULL.
        */
-      if (empty() && !flush_) {
-        struct timeval tv;
-        struct timezone tz;
-
-        /*
-         * Calculate the next absolute timeout if we find
-         * out there is no work to be done.
-         */
-        gettimeofday(&tv, &tz);
-        ts->tv_nsec = tv.tv_usec * 1000;
-        ts->tv_sec = tv.tv_sec + timeout;
+      if (flush_ && empty()) { return NULL; }
 
+      /*
+       * Items are on the buffer but pinned by someone, try again soon.
+       */
+      if (!empty()) {
+        std::this_thread::yield();
         continue;
       }
-    } else {
-      pthread_cond_wait(&notempty_, &lock_);
+    }
 
+    /*
+     * Wait while there is nothing in the buffer. The counter is raised
+     * under the lock so a producer either sees us waiting or we see its item.
+     */
+    pthread_mutex_lock(&lock_);
+    waiting_consumers_++;
+    if ((requeued || empty()) && !flush_) {
       /*
-       * See if there is really work to be done.
-       * We could be woken by the broadcast but some other iothread
-       * could take the work as we have to wait to reacquire the lock_.
-       * Only one thread will be in the critical section and be able to
-       * hold the lock.
+       * See if we should block indefinitely or wake up
+       * after the given timer has expired and calculate
+       * the next time we need to wakeup. This way we check
+       * after the timer expired if there is work to be done
+       * this is something we need if the worker threads can
+       * put work back onto the circular queue and uses
+       * enqueue with the no_signal flag set.
        */
-      if (empty() && !flush_) { continue; }
+      if (ts) {
+        pthread_cond_timedwait(&notempty_, &lock_, ts);
+      } else {
+        pthread_cond_wait(&notempty_, &lock_);
+      }
     }
-  }
-
-  /*
-   * When we are requested to flush and there is no data left return NULL.
-   */
-  if (empty() && flush_) { goto bail_out; }
-
-  /*
-   * Get the first item from the dlist and remove it.
-   */
-  item = (struct ocbuf_item*)data_->first();
-  if (!item) { goto bail_out; }
-
-  data_->remove(item);
-  size_--;
-
-  /*
-   * Let all waiting producers know there is room.
-   */
-  pthread_cond_broadcast(&notfull_);
-
-  /*
-   * Extract the payload and drop the placeholder.
-   */
-  data = item->data;
-  free(item);
+    waiting_consumers_--;
+    pthread_mutex_unlock(&lock_);
 
-  /*
-   * Increase the reserved slot count when we are asked to reserve the slot.
-   */
-  if (reserve_slot) { reserved_++; }
+    /*
+     * The requeued state is only valid one time so clear it.
+     */
+    requeued = false;
 
-bail_out:
-  pthread_mutex_unlock(&lock_);
+    /*
+     * Calculate the next absolute timeout if we find
+     * out there is no work to be done.
+     */
+    if (ts && empty() && !flush_) {
+      struct timeval tv;
+      struct timezone tz;
 
-  return data;
+      gettimeofday(&tv, &tz);
+      ts->tv_nsec = tv.tv_usec * 1000;
+      ts->tv_sec = tv.tv_sec + timeout;
+    }
+  }
 }
 
 /*
@@ -278,68 +589,75 @@ void* ordered_circbuf::peek(enum oc_peek_types type,
                             void* data,
                             int callback(void* item1, void* item2))
 {
+  struct peek_item {
+    ocbuf_key key;
+    int slot;
+    uint64_t generation;
+  };
+  std::vector<peek_item> items;
   void* retval = NULL;
-  struct ocbuf_item* item;
-
-  if (pthread_mutex_lock(&lock_) != 0) { return NULL; }
+  uint64_t state;
 
   /*
    * There is nothing to be seen on an empty ordered circular buffer.
    */
-  if (empty()) { goto bail_out; }
+  if (empty()) { return NULL; }
 
   /*
-   * Depending on the peek type start somewhere on the ordered list and
-   * walk forward or back.
+   * Take a snapshot of the items on the buffer and sort it on key.
    */
-  switch (type) {
-    case PEEK_FIRST:
-      item = (struct ocbuf_item*)data_->first();
-      while (item) {
-        if (callback(item->data, data) == 0) {
-          retval = malloc(item->data_size);
-          memcpy(retval, item->data, item->data_size);
-          goto bail_out;
-        }
+  items.reserve(capacity_);
+  for (int i = 0; i < capacity_; i++) {
+    peek_item item;
 
-        item = (struct ocbuf_item*)data_->next(item);
-      }
-      break;
-    case PEEK_LAST:
-      item = (struct ocbuf_item*)data_->last();
-      while (item) {
-        if (callback(item->data, data) == 0) {
-          retval = malloc(item->data_size);
-          memcpy(retval, item->data, item->data_size);
-          goto bail_out;
-        }
+    state = slots_[i].state.load(std::memory_order_acquire);
+    if (SlotState(state) != SLOT_READY && SlotState(state) != SLOT_PINNED) {
+      continue;
+    }
+    LoadKey(i, item.key);
+    if (!SameItem(i, state)) { continue; }
 
-        item = (struct ocbuf_item*)data_->prev(item);
-      }
-      break;
-    case PEEK_LIST:
-      item = (struct ocbuf_item*)data_->first();
-      while (item) {
-        callback(item->data, data);
-        item = (struct ocbuf_item*)data_->next(item);
-      }
-      break;
-    case PEEK_CLONE:
-      item = (struct ocbuf_item*)data_->first();
-      while (item) {
-        if (callback(item->data, data) == 0) {
-          retval = data;
-          break;
-        }
-        item = (struct ocbuf_item*)data_->next(item);
-      }
-      break;
-    default:
-      goto bail_out;
+    item.slot = i;
+    item.generation = SlotGeneration(state);
+    items.push_back(item);
   }
+  std::sort(items.begin(), items.end(),
+            [](const peek_item& item1, const peek_item& item2) {
+              return CompareKeys(item1.key, item2.key) < 0;
+            });
 
-bail_out:
-  pthread_mutex_unlock(&lock_);
+  /*
+   * Depending on the peek type walk the snapshot forward or back, items
+   * dequeued in the meantime are skipped.
+   */
+  if (type == PEEK_LAST) { std::reverse(items.begin(), items.end()); }
+
+  for (const peek_item& item : items) {
+    ocbuf_slot& slot = slots_[item.slot];
+
+    if (!PinSlot(item.slot, item.generation)) { continue; }
+
+    switch (type) {
+      case PEEK_FIRST:
+      case PEEK_LAST:
+        if (callback(slot.data, data) == 0) {
+          retval = malloc(slot.data_size);
+          memcpy(retval, slot.data, slot.data_size);
+        }
+        break;
+      case PEEK_LIST:
+        callback(slot.data, data);
+        break;
+      case PEEK_CLONE:
+        if (callback(slot.data, data) == 0) { retval = data; }
+        break;
+      default:
+        break;
+    }
+
+    UnpinSlot(item.slot);
+    if (retval) { break; }
+  }
 
   return retval;
 }
@@ -349,28 +667,20 @@ bail_out:
  */
 int ordered_circbuf::unreserve_slot()
 {
-  int retval = -1;
-
-  if (pthread_mutex_lock(&lock_) != 0) { goto bail_out; }
+  int value = reserved_.load();
 
   /*
    * Make sure any slots are still reserved. Otherwise people
    * are playing games and should pay the price for doing so.
    */
-  if (reserved_) {
-    reserved_--;
-
-    /*
-     * Let all waiting producers know there is room.
-     */
-    pthread_cond_broadcast(&notfull_);
-
-    retval = 0;
+  while (value > 0) {
+    if (reserved_.compare_exchange_weak(value, value - 1)) {
+      ReleaseSlot();
+      return 0;
+    }
   }
-  pthread_mutex_unlock(&lock_);
 
-bail_out:
-  return retval;
+  return -1;
 }
 
 /*
@@ -24,12 +24,30 @@
 
 /*
  * Ordered Circular buffer used for producer/consumer problem with pthread.
+ *
+ * The buffer is a fixed array of slots, each guarded by an atomic state word
+ * holding the slot state and a generation number which is bumped every time
+ * the slot is released. Consumers take items without any lock by scanning
+ * for the lowest key and claiming that slot with a compare-and-swap.
+ * Producers are serialized among themselves so an item with a key that is
+ * already queued is reliably merged into the existing item. The mutex and
+ * condition variables are only used to sleep when the buffer is full or
+ * empty.
  */
 
-class dlist;
+#ifndef BAREOS_STORED_BACKENDS_ORDERED_CBUF_H_
+#define BAREOS_STORED_BACKENDS_ORDERED_CBUF_H_
+
+#include <atomic>
 
 #define OQSIZE 10 /* # of pointers in the queue */
 
+/*
+ * Maximum size of the ordering key in 64 bits words, room for a name of up
+ * to 128 bytes followed by a number.
+ */
+#define OCBUF_KEY_WORDS 17
+
 namespace storagedaemon {
 
 enum oc_peek_types
@@ -40,24 +58,54 @@ enum oc_peek_types
   PEEK_CLONE
 };
 
-struct ocbuf_item {
-  dlink link;
+/*
+ * Items are ordered on their key, the words holding the name are followed
+ * by a word holding the number. Only length words are used.
+ */
+struct ocbuf_key {
+  uint32_t length;
+  uint64_t word[OCBUF_KEY_WORDS];
+};
+
+void MakeOcbufKey(ocbuf_key& key, const char* name, uint64_t number);
+
+struct ocbuf_slot {
+  std::atomic<uint64_t> state{0};
+  std::atomic<uint32_t> key_length{0};
+  std::atomic<uint64_t> key[OCBUF_KEY_WORDS]{};
   uint32_t data_size = 0;
   void* data = nullptr;
 };
 
 class ordered_circbuf {
  private:
-  int size_ = 0;
   int capacity_ = 0;
-  int reserved_ = 0;
-  bool flush_ = false;
-  pthread_mutex_t lock_ = PTHREAD_MUTEX_INITIALIZER; /* Lock the structure */
+  ocbuf_slot* slots_ = nullptr;
+  std::atomic<int> size_{0};     /* Items on the buffer */
+  std::atomic<int> occupied_{0}; /* Items + reserved slots + pending enqueues */
+  std::atomic<int> reserved_{0};
+  std::atomic<int> next_slot_{0}; /* Where to start looking for a free slot */
+  std::atomic<bool> flush_{false};
+  std::atomic<int> waiting_consumers_{0};
+  std::atomic<int> waiting_producers_{0};
+  pthread_mutex_t producer_lock_ =
+      PTHREAD_MUTEX_INITIALIZER; /* Serializes enqueue() */
+  pthread_mutex_t lock_ = PTHREAD_MUTEX_INITIALIZER; /* Only used to sleep */
   pthread_cond_t notfull_ =
       PTHREAD_COND_INITIALIZER; /* Full -> not full condition */
   pthread_cond_t notempty_ =
       PTHREAD_COND_INITIALIZER; /* Empty -> not empty condition */
-  dlist* data_ = nullptr;       /* Circular buffer of pointers */
+
+  void AcquireSlot(bool use_reserved_slot);
+  void ReleaseSlot();
+  void WakeConsumers();
+  int ClaimFreeSlot();
+  void LoadKey(int slot, ocbuf_key& key);
+  int CompareSlotKey(int slot, const ocbuf_key& key);
+  bool SameItem(int slot, uint64_t state);
+  bool PinSlot(int slot, uint64_t generation);
+  void UnpinSlot(int slot);
+  void* TakeFirst();
 
  public:
   ordered_circbuf(int capacity = OQSIZE);
@@ -66,7 +114,7 @@ class ordered_circbuf {
   void destroy();
   void* enqueue(void* data,
                 uint32_t data_size,
-                int compare(void* item1, void* item2),
+                const ocbuf_key& key,
                 void update(void* item1, void* item2),
                 bool use_reserved_slot = false,
                 bool no_signal = false);
@@ -79,9 +127,9 @@ class ordered_circbuf {
              int callback(void* item1, void* item2));
   int unreserve_slot();
   int flush();
-  bool full() { return size_ == (capacity_ - reserved_); }
-  bool empty() { return size_ == 0; }
-  bool IsFlushing() { return flush_; }
+  bool full() { return occupied_.load() >= capacity_; }
+  bool empty() { return size_.load() == 0; }
+  bool IsFlushing() { return flush_.load(); }
   int capacity() const { return capacity_; }
 };
 
@@ -95,3 +143,5 @@ inline ordered_circbuf::ordered_circbuf(int capacity) { init(capacity); }
  */
 inline ordered_circbuf::~ordered_circbuf() { destroy(); }
 }  // namespace storagedaemon
+
+#endif /* BAREOS_STORED_BACKENDS_ORDERED_CBUF_H_ */
@@ -33,11 +33,40 @@
 #include "stored/stored.h"
 #include "stored/stored_globals.h"
 #include "unix_file_device.h"
+#include "io_uring_engine.h"
+#include "aligned_volume.h"
 #include "lib/berrno.h"
+#include "lib/edit.h"
 #include "lib/util.h"
 
+#include <sys/uio.h>
+
 namespace storagedaemon {
 
+/**
+ * Options that can be specified for this device type.
+ */
+enum device_option_type
+{
+  argument_none = 0,
+  argument_iouring,
+  argument_iodepth,
+  argument_direct,
+  argument_aligned
+};
+
+struct device_option {
+  const char* name;
+  enum device_option_type type;
+  int compare_size;
+};
+
+static device_option device_options[] = {{"iouring", argument_iouring, 7},
+                                         {"iodepth=", argument_iodepth, 8},
+                                         {"direct", argument_direct, 6},
+                                         {"aligned=", argument_aligned, 8},
+                                         {NULL, argument_none}};
+
 /**
  * (Un)mount the device (For a FILE device)
  */
@@ -206,22 +235,307 @@ bool unix_file_device::UnmountBackend(DeviceControlRecord* dcr, int timeout)
   return retval;
 }
 
+/**
+ * Parse the device options, e.g. "iouring,iodepth=16,direct" selects the
+ * io_uring I/O engine with 16 writes in flight and O_DIRECT, "aligned=64k"
+ * creates new volumes in the dedup friendly aligned layout.
+ */
+bool unix_file_device::ParseDeviceOptions()
+{
+  char *bp, *next_option, *options;
+  bool done, retval = true;
+
+  options_parsed_ = true;
+  if (!dev_options) { return true; }
+
+  options = strdup(dev_options);
+  bp = options;
+  while (bp) {
+    next_option = strchr(bp, ',');
+    if (next_option) { *next_option++ = '\0'; }
+
+    done = false;
+    for (int i = 0; !done && device_options[i].name; i++) {
+      /*
+       * Try to find a matching device option.
+       */
+      if (bstrncasecmp(bp, device_options[i].name,
+                       device_options[i].compare_size)) {
+        switch (device_options[i].type) {
+          case argument_iouring:
+            use_io_uring_ = true;
+            done = true;
+            break;
+          case argument_iodepth:
+            io_depth_ = strtoul(bp + device_options[i].compare_size, NULL, 10);
+            done = io_depth_ > 0;
+            break;
+          case argument_direct:
+            direct_io_ = true;
+            done = true;
+            break;
+          case argument_aligned: {
+            uint64_t alignment;
+
+            /*
+             * The alignment must be a power of two of at least 512 bytes.
+             */
+            if (size_to_uint64(bp + device_options[i].compare_size,
+                               &alignment) &&
+                alignment >= 512 && alignment <= MAX_BLOCK_LENGTH &&
+                (alignment & (alignment - 1)) == 0) {
+              alignment_ = alignment;
+              done = true;
+            }
+            break;
+          }
+          default:
+            break;
+        }
+      }
+    }
+
+    if (!done) {
+      Mmsg1(errmsg, _("Unable to parse device option: %s\n"), bp);
+      Emsg0(M_FATAL, 0, errmsg);
+      retval = false;
+      break;
+    }
+
+    bp = next_option;
+  }
+  free(options);
+
+#ifndef HAVE_LINUX_IO_URING_H
+  if (use_io_uring_) {
+    Emsg1(M_WARNING, 0,
+          _("io_uring is not supported on this platform, device %s uses "
+            "blocking I/O.\n"),
+          prt_name);
+    use_io_uring_ = false;
+  }
+#endif
+
+  if (alignment_ && use_io_uring_) {
+    Emsg1(M_WARNING, 0,
+          _("Device option iouring is not supported with aligned volumes, "
+            "ignored for device %s.\n"),
+          prt_name);
+    use_io_uring_ = false;
+  }
+
+  if (direct_io_ && !use_io_uring_) {
+    Emsg1(M_WARNING, 0,
+          _("Device option direct is only supported with iouring, ignored "
+            "for device %s.\n"),
+          prt_name);
+    direct_io_ = false;
+  }
+
+  return retval;
+}
+
+#ifdef HAVE_LINUX_IO_URING_H
+/**
+ * Setup the io_uring engine, each buffer must be able to hold the largest
+ * block we write.
+ */
+bool unix_file_device::SetupIoUring()
+{
+  size_t buffer_size = DEFAULT_BLOCK_SIZE;
+  uint32_t max_block_size =
+      device->max_block_size ? device->max_block_size : DEFAULT_BLOCK_SIZE;
+
+  buffer_size = MAX(buffer_size, device->max_block_size);
+  buffer_size = MAX(buffer_size, device->label_block_size);
+
+  /*
+   * With O_DIRECT every block must be a multiple of the alignment, otherwise
+   * the first block already ends O_DIRECT for the volume.
+   */
+  if (direct_io_ &&
+      (max_block_size % IoUringEngine::kDirectIoAlignment != 0 ||
+       device->label_block_size % IoUringEngine::kDirectIoAlignment != 0)) {
+    Emsg4(M_WARNING, 0,
+          _("Device option direct needs a Maximum Block Size and Label Block "
+            "Size that are a multiple of %d (have %u and %u), device %s uses "
+            "buffered I/O.\n"),
+          (int)IoUringEngine::kDirectIoAlignment, max_block_size,
+          device->label_block_size, prt_name);
+    direct_io_ = false;
+  }
+
+  io_uring_.reset(new IoUringEngine);
+  if (!io_uring_->Init(io_depth_, buffer_size, direct_io_)) {
+    BErrNo be;
+
+    Emsg2(M_WARNING, 0,
+          _("Unable to setup io_uring for device %s, using blocking I/O. "
+            "ERR=%s\n"),
+          prt_name, be.bstrerror());
+    io_uring_.reset();
+    use_io_uring_ = false;
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * Report an error of a write that completed after we returned success for
+ * it. As the data is lost and the block already accounted for we return EIO
+ * so the job fails instead of continuing on a new volume.
+ */
+bool unix_file_device::CheckDeferredError()
+{
+  int error = io_uring_->TakeError();
+
+  if (error) {
+    BErrNo be;
+
+    Emsg2(M_ERROR, 0, _("Deferred I/O error on device %s. ERR=%s\n"),
+          prt_name, be.bstrerror(error));
+    errno = EIO;
+    return false;
+  }
+
+  return true;
+}
+#endif
+
 int unix_file_device::d_open(const char* pathname, int flags, int mode)
 {
+  if (!options_parsed_ && !ParseDeviceOptions()) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /*
+   * Existing aligned volumes are always read in their own layout, new
+   * volumes are only created aligned when configured.
+   */
+  if (AlignedVolume::IsAlignedVolume(pathname) ||
+      (alignment_ && (flags & O_CREAT) && access(pathname, F_OK) != 0)) {
+    aligned_volume_.reset(new AlignedVolume);
+    return aligned_volume_->Open(pathname, flags, mode, alignment_);
+  }
+
+#ifdef HAVE_LINUX_IO_URING_H
+  if (use_io_uring_ && !io_uring_) { SetupIoUring(); }
+
+  if (io_uring_) {
+    int fd;
+
+    offset_ = 0;
+    if (direct_io_) {
+      fd = ::open(pathname, flags | O_DIRECT, mode);
+      if (fd >= 0 || errno != EINVAL) { return fd; }
+
+      Dmsg1(100, "O_DIRECT not supported for %s, opening without it\n",
+            pathname);
+    }
+  }
+#endif
+
   return ::open(pathname, flags, mode);
 }
 
 ssize_t unix_file_device::d_read(int fd, void* buffer, size_t count)
 {
+  if (aligned_volume_) { return aligned_volume_->Read(buffer, count); }
+
+#ifdef HAVE_LINUX_IO_URING_H
+  if (io_uring_) {
+    ssize_t status;
+
+    if (!CheckDeferredError()) { return -1; }
+    status = io_uring_->Read(fd, buffer, count, offset_);
+    if (status > 0) { offset_ += status; }
+
+    return status;
+  }
+#endif
+
   return ::read(fd, buffer, count);
 }
 
 ssize_t unix_file_device::d_write(int fd, const void* buffer, size_t count)
 {
+  if (aligned_volume_) { return aligned_volume_->Write(buffer, count); }
+
+#ifdef HAVE_LINUX_IO_URING_H
+  if (io_uring_) {
+    ssize_t status;
+
+    if (!CheckDeferredError()) { return -1; }
+    status = io_uring_->Write(fd, buffer, count, offset_);
+    if (status > 0) { offset_ += status; }
+
+    return status;
+  }
+#endif
+
   return ::write(fd, buffer, count);
 }
 
-int unix_file_device::d_close(int fd) { return ::close(fd); }
+ssize_t unix_file_device::d_writev(int fd, const struct iovec* iov, int iovcnt)
+{
+  /*
+   * An aligned volume splits the block itself so it needs it in one piece.
+   */
+  if (aligned_volume_) {
+    std::vector<char> block;
+
+    for (int i = 0; i < iovcnt; i++) {
+      block.insert(block.end(), (char*)iov[i].iov_base,
+                   (char*)iov[i].iov_base + iov[i].iov_len);
+    }
+
+    return aligned_volume_->Write(block.data(), block.size());
+  }
+
+#ifdef HAVE_LINUX_IO_URING_H
+  if (io_uring_) {
+    ssize_t status;
+
+    if (!CheckDeferredError()) { return -1; }
+    status = io_uring_->WriteV(fd, iov, iovcnt, offset_);
+    if (status > 0) { offset_ += status; }
+
+    return status;
+  }
+#endif
+
+  return ::writev(fd, iov, iovcnt);
+}
+
+int unix_file_device::d_close(int fd)
+{
+  if (aligned_volume_) {
+    int status = aligned_volume_->Close();
+
+    aligned_volume_.reset();
+    return status;
+  }
+
+#ifdef HAVE_LINUX_IO_URING_H
+  if (io_uring_) {
+    bool ok;
+
+    ok = io_uring_->Sync(fd);
+    if (!CheckDeferredError()) { ok = false; }
+    if (!ok) {
+      int saved_errno = errno;
+
+      ::close(fd);
+      errno = saved_errno;
+      return -1;
+    }
+  }
+#endif
+
+  return ::close(fd);
+}
 
 int unix_file_device::d_ioctl(int fd, ioctl_req_t request, char* op)
 {
@@ -232,14 +546,104 @@ boffset_t unix_file_device::d_lseek(DeviceControlRecord* dcr,
                                     boffset_t offset,
                                     int whence)
 {
+  if (aligned_volume_) { return aligned_volume_->Seek(offset, whence); }
+
+#ifdef HAVE_LINUX_IO_URING_H
+  /*
+   * All I/O is done at an explicit offset so we keep track of the file
+   * offset ourself.
+   */
+  if (io_uring_) {
+    boffset_t pos;
+    struct stat st;
+
+    switch (whence) {
+      case SEEK_SET:
+        pos = offset;
+        break;
+      case SEEK_CUR:
+        pos = offset_ + offset;
+        break;
+      case SEEK_END:
+        io_uring_->Drain();
+        if (fstat(fd_, &st) != 0) { return -1; }
+        pos = st.st_size + offset;
+        break;
+      default:
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (pos < 0) {
+      errno = EINVAL;
+      return -1;
+    }
+
+    offset_ = pos;
+    return pos;
+  }
+#endif
+
   return ::lseek(fd_, offset, whence);
 }
 
+/**
+ * Make sure all data written is on stable storage, called after writing
+ * the volume label and at the end of a job.
+ */
+bool unix_file_device::weof(int num)
+{
+#ifdef HAVE_LINUX_IO_URING_H
+  if (io_uring_ && fd_ >= 0) {
+    bool ok;
+    btime_t start = GetCurrentBtime();
+
+    ok = io_uring_->Sync(fd_);
+
+    /*
+     * A flush is accounted by Device::flush() already.
+     */
+    if (num > 0) {
+      latencies.Record(DeviceLatencyKind::kWeof, GetCurrentBtime() - start);
+    }
+    if (!CheckDeferredError()) { ok = false; }
+    if (!ok) {
+      BErrNo be;
+
+      dev_errno = errno;
+      Mmsg2(errmsg, _("Unable to sync device %s. ERR=%s\n"), prt_name,
+            be.bstrerror());
+      return false;
+    }
+  }
+#endif
+
+  return true;
+}
+
+bool unix_file_device::d_flush(DeviceControlRecord* dcr) { return weof(0); }
+
 bool unix_file_device::d_truncate(DeviceControlRecord* dcr)
 {
   struct stat st;
   PoolMem archive_name(PM_FNAME);
 
+#ifdef HAVE_LINUX_IO_URING_H
+  if (io_uring_) { io_uring_->Drain(); }
+#endif
+
+  if (aligned_volume_) {
+    if (!aligned_volume_->Truncate(dcr->jcr, me->secure_erase_cmdline != NULL)) {
+      BErrNo be;
+
+      Mmsg2(errmsg, _("Unable to truncate device %s. ERR=%s\n"), prt_name,
+            be.bstrerror());
+      return false;
+    }
+    fd_ = aligned_volume_->Fd();
+    return true;
+  }
+
   /*
    * When secure erase is configured never truncate the file.
    */
@@ -312,6 +716,7 @@ bool unix_file_device::d_truncate(DeviceControlRecord* dcr)
 
     return false;
   }
+  offset_ = 0;
 
   /*
    * Reset proper owner
@@ -324,6 +729,9 @@ bail_out:
 
 unix_file_device::~unix_file_device() {}
 
-unix_file_device::unix_file_device() {}
+unix_file_device::unix_file_device()
+{
+  SetCap(CAP_WRITEV); /* Can write a block from an iovec */
+}
 
 } /* namespace storagedaemon  */
@@ -28,8 +28,13 @@
 #ifndef BAREOS_STORED_BACKENDS_UNIX_FILE_DEVICE_H_
 #define BAREOS_STORED_BACKENDS_UNIX_FILE_DEVICE_H_
 
+#include <memory>
+
 namespace storagedaemon {
 
+class IoUringEngine;
+class AlignedVolume;
+
 class unix_file_device : public Device {
  public:
   unix_file_device();
@@ -48,7 +53,24 @@ class unix_file_device : public Device {
                     int whence) override;
   ssize_t d_read(int fd, void* buffer, size_t count) override;
   ssize_t d_write(int fd, const void* buffer, size_t count) override;
+  ssize_t d_writev(int fd, const struct iovec* iov, int iovcnt) override;
   bool d_truncate(DeviceControlRecord* dcr) override;
+  bool d_flush(DeviceControlRecord* dcr) override;
+  bool weof(int num) override;
+
+ private:
+  bool options_parsed_ = false;
+  bool use_io_uring_ = false;
+  bool direct_io_ = false;
+  uint32_t io_depth_ = 8;
+  boffset_t offset_ = 0; /**< File offset when using io_uring */
+  std::unique_ptr<IoUringEngine> io_uring_;
+  uint32_t alignment_ = 0; /**< Payload alignment of new volumes */
+  std::unique_ptr<AlignedVolume> aligned_volume_;
+
+  bool ParseDeviceOptions();
+  bool SetupIoUring();
+  bool CheckDeferredError();
 };
 
 } /* namespace storagedaemon */
@@ -51,6 +51,13 @@
 #include "lib/parse_conf.h"
 #include "include/jcr.h"
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
 namespace storagedaemon {
 extern bool ParseSdConfig(const char* configfile, int exit_code);
 }
@@ -60,6 +67,64 @@ using namespace storagedaemon;
 static void DoExtract(char* devname);
 static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec);
 
+/*
+ * A record on its way from the reader to the writer. Records of compressed
+ * streams of selected files are inflated by one of the decompression workers
+ * into data before the writer gets them.
+ */
+struct ExtractItem {
+  DeviceRecord* rec = nullptr;
+  std::string fname;       /* file the record belongs to, for messages */
+  POOLMEM* data = nullptr; /* inflated data */
+  uint32_t data_len = 0;
+  bool inflate = false; /* needs to be inflated by a worker */
+  bool done = false;    /* ready to be written */
+  bool ok = true;       /* inflated without errors */
+};
+
+/*
+ * Extract pipeline.
+ *
+ * The thread reading the volume hands every record to a single writer thread
+ * in the order it was read. Records of compressed streams are also queued for
+ * a pool of decompression workers which inflate them in parallel, each with
+ * its own decompression buffers. The writer waits for the oldest record to be
+ * inflated before it writes it, so the records of a file are always written
+ * in order. The number of records in flight is bounded so the reader blocks
+ * when the writer cannot keep up.
+ */
+class ExtractPipeline {
+ public:
+  ExtractPipeline(JobControlRecord* jcr, int nr_workers);
+  ~ExtractPipeline();
+
+  void Start();
+  bool Submit(DeviceRecord* rec, bool inflate, const char* fname);
+  bool Finish();
+
+ private:
+  static const int kItemsPerWorker = 16;
+
+  JobControlRecord* jcr_;
+  int nr_workers_;
+  size_t max_items_;
+  std::mutex mutex_;
+  std::condition_variable not_full_; /* reader waits for room */
+  std::condition_variable work_;     /* workers wait for records to inflate */
+  std::condition_variable done_;     /* writer waits for the oldest record */
+  std::deque<ExtractItem*> items_;      /* all records in volume order */
+  std::deque<ExtractItem*> to_inflate_; /* records waiting for a worker */
+  bool finishing_ = false;
+  bool failed_ = false;
+  std::vector<std::thread> workers_;
+  std::thread writer_;
+
+  void Worker();
+  void Writer();
+  static bool Inflate(JobControlRecord* wjcr, ExtractItem* item);
+  static void FreeItem(ExtractItem* item);
+};
+
 static Device* dev = NULL;
 static DeviceControlRecord* dcr;
 static BareosWinFilePacket bfd;
@@ -86,6 +151,11 @@ static char* wbuf;            /* write buffer address */
 static uint32_t wsize;        /* write size */
 static uint64_t fileAddr = 0; /* file write address */
 
+static int extract_threads = -1;            /* decompression threads */
+static ExtractPipeline* pipeline = nullptr; /* nullptr when extracting inline */
+static Attributes* reader_attr = nullptr;   /* attributes seen by the reader */
+static bool reader_selected = false;        /* reader is in a selected file */
+
 static void usage()
 {
   fprintf(stderr,
@@ -105,6 +175,9 @@ static void usage()
             "       -e <file>       exclude list\n"
             "       -i <file>       include list\n"
             "       -p              proceed inspite of I/O errors\n"
+            "       -T <threads>    number of decompression threads (default: "
+            "number of CPUs,\n"
+            "                       0 decompresses and writes inline)\n"
             "       -v              verbose\n"
             "       -V <volumes>    specify Volume names (separated by |)\n"
             "       -?              print this message\n\n"),
@@ -133,7 +206,7 @@ int main(int argc, char* argv[])
   ff = init_find_files();
   binit(&bfd);
 
-  while ((ch = getopt(argc, argv, "b:c:D:d:e:i:pvV:?")) != -1) {
+  while ((ch = getopt(argc, argv, "b:c:D:d:e:i:pT:vV:?")) != -1) {
     switch (ch) {
       case 'b': /* bootstrap file */
         bsr = libbareos::parse_bsr(NULL, optarg);
@@ -194,6 +267,11 @@ int main(int argc, char* argv[])
         forge_on = true;
         break;
 
+      case 'T':
+        extract_threads = atoi(optarg);
+        if (extract_threads < 0) { extract_threads = 0; }
+        break;
+
       case 'v':
         verbose++;
         break;
@@ -435,8 +513,26 @@ static void DoExtract(char* devname)
   acl_data.last_fname = GetPoolMemory(PM_FNAME);
   xattr_data.last_fname = GetPoolMemory(PM_FNAME);
 
+  if (extract_threads < 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    extract_threads = cpus > 0 ? cpus : 1;
+  }
+  if (extract_threads > 0) {
+    Dmsg1(100, "Using %d decompression threads\n", extract_threads);
+    reader_attr = new_attr(jcr);
+    pipeline = new ExtractPipeline(jcr, extract_threads);
+    pipeline->Start();
+  }
+
   ReadRecords(dcr, RecordCb, MountNextReadVolume);
 
+  if (pipeline) {
+    pipeline->Finish();
+    delete pipeline;
+    pipeline = nullptr;
+    FreeAttr(reader_attr);
+  }
+
   /*
    * If output file is still open, it was the last one in the
    * archive since we just hit an end of file, so close the file.
@@ -487,14 +583,14 @@ static bool StoreData(BareosWinFilePacket* bfd,
 }
 
 /*
- * Called here for each record from ReadRecords()
+ * Handle one record, either inline from ReadRecords() or on the writer thread
+ * of the extract pipeline in which case item holds the inflated data.
  */
-static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
+static bool ExtractRecord(JobControlRecord* jcr,
+                          DeviceRecord* rec,
+                          ExtractItem* item)
 {
   int status;
-  JobControlRecord* jcr = dcr->jcr;
-
-  if (rec->FileIndex < 0) { return true; /* we don't want labels */ }
 
   /* File Attributes stream */
 
@@ -635,8 +731,18 @@ static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
           wsize = rec->data_len;
         }
 
-        if (DecompressData(jcr, attr->ofname, rec->maskedStream, &wbuf, &wsize,
-                           false)) {
+        bool inflated;
+
+        if (item && item->inflate) {
+          inflated = item->ok;
+          wbuf = item->data;
+          wsize = item->data_len;
+        } else {
+          inflated = DecompressData(jcr, attr->ofname, rec->maskedStream, &wbuf,
+                                    &wsize, false);
+        }
+
+        if (inflated) {
           Dmsg2(100, "Write uncompressed %d bytes, total before write=%d\n",
                 wsize, total);
           StoreData(&bfd, wbuf, wsize);
@@ -739,3 +845,246 @@ static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
   } /* end switch */
   return true;
 }
+
+static inline bool IsCompressedStream(int32_t stream)
+{
+  switch (stream) {
+    case STREAM_GZIP_DATA:
+    case STREAM_SPARSE_GZIP_DATA:
+    case STREAM_COMPRESSED_DATA:
+    case STREAM_SPARSE_COMPRESSED_DATA:
+    case STREAM_WIN32_COMPRESSED_DATA:
+      return true;
+    default:
+      return false;
+  }
+}
+
+ExtractPipeline::ExtractPipeline(JobControlRecord* jcr, int nr_workers)
+    : jcr_(jcr)
+    , nr_workers_(nr_workers)
+    , max_items_(kItemsPerWorker * (nr_workers + 1))
+{
+}
+
+ExtractPipeline::~ExtractPipeline()
+{
+  for (ExtractItem* item : items_) { FreeItem(item); }
+}
+
+void ExtractPipeline::Start()
+{
+  for (int i = 0; i < nr_workers_; i++) {
+    workers_.emplace_back(&ExtractPipeline::Worker, this);
+  }
+  writer_ = std::thread(&ExtractPipeline::Writer, this);
+}
+
+/*
+ * Called by the reader, the record is copied as ReadRecords() reuses it.
+ */
+bool ExtractPipeline::Submit(DeviceRecord* rec, bool inflate, const char* fname)
+{
+  ExtractItem* item = new ExtractItem;
+
+  item->rec = new_record();
+  item->rec->FileIndex = rec->FileIndex;
+  item->rec->Stream = rec->Stream;
+  item->rec->maskedStream = rec->maskedStream;
+  item->rec->data = CheckPoolMemorySize(item->rec->data, rec->data_len);
+  memcpy(item->rec->data, rec->data, rec->data_len);
+  item->rec->data_len = rec->data_len;
+  item->inflate = inflate;
+  item->done = !inflate;
+  if (inflate) { item->fname = fname; }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  not_full_.wait(lock, [this] { return items_.size() < max_items_ || failed_; });
+  if (failed_) {
+    lock.unlock();
+    FreeItem(item);
+    return false;
+  }
+
+  items_.push_back(item);
+  if (inflate) {
+    to_inflate_.push_back(item);
+    work_.notify_one();
+  } else if (items_.size() == 1) {
+    done_.notify_one();
+  }
+
+  return true;
+}
+
+/*
+ * Wait for all submitted records to be written, returns false when the
+ * writer stopped on an error.
+ */
+bool ExtractPipeline::Finish()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    finishing_ = true;
+  }
+  work_.notify_all();
+  done_.notify_all();
+
+  for (auto& worker : workers_) { worker.join(); }
+  workers_.clear();
+  if (writer_.joinable()) { writer_.join(); }
+
+  return !failed_;
+}
+
+bool ExtractPipeline::Inflate(JobControlRecord* wjcr, ExtractItem* item)
+{
+  DeviceRecord* rec = item->rec;
+  char* buf = rec->data;
+  uint32_t len = rec->data_len;
+
+  if (rec->maskedStream == STREAM_SPARSE_GZIP_DATA ||
+      rec->maskedStream == STREAM_SPARSE_COMPRESSED_DATA) {
+    buf += OFFSET_FADDR_SIZE;
+    len -= OFFSET_FADDR_SIZE;
+  }
+
+  if (!DecompressData(wjcr, item->fname.c_str(), rec->maskedStream, &buf, &len,
+                      false)) {
+    return false;
+  }
+
+  /*
+   * The data points into the decompression buffer of this worker
+   * which gets reused for the next record.
+   */
+  item->data = CheckPoolMemorySize(item->data, len);
+  memcpy(item->data, buf, len);
+  item->data_len = len;
+
+  return true;
+}
+
+void ExtractPipeline::FreeItem(ExtractItem* item)
+{
+  FreeRecord(item->rec);
+  if (item->data) { FreePoolMemory(item->data); }
+  delete item;
+}
+
+void ExtractPipeline::Worker()
+{
+  uint32_t decompress_buf_size;
+  JobControlRecord* wjcr = new_jcr(nullptr);
+
+  wjcr->buf_size = jcr_->buf_size;
+  SetupDecompressionBuffers(wjcr, &decompress_buf_size);
+  if (decompress_buf_size > 0) {
+    wjcr->compress = CompressionContext{};
+    wjcr->compress.inflate_buffer = GetMemory(decompress_buf_size);
+    wjcr->compress.inflate_buffer_size = decompress_buf_size;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (1) {
+    work_.wait(lock, [this] { return !to_inflate_.empty() || finishing_; });
+    if (to_inflate_.empty()) { break; }
+
+    ExtractItem* item = to_inflate_.front();
+    to_inflate_.pop_front();
+    bool failed = failed_;
+
+    lock.unlock();
+    bool ok = failed || Inflate(wjcr, item);
+    lock.lock();
+
+    item->ok = ok;
+    item->done = true;
+    if (item == items_.front()) { done_.notify_one(); }
+  }
+  lock.unlock();
+
+  CleanupCompression(wjcr);
+  FreeJcr(wjcr);
+}
+
+void ExtractPipeline::Writer()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (1) {
+    done_.wait(lock, [this] {
+      return (!items_.empty() && items_.front()->done) ||
+             (items_.empty() && finishing_);
+    });
+    if (items_.empty()) { break; }
+
+    ExtractItem* item = items_.front();
+    items_.pop_front();
+    bool failed = failed_;
+    not_full_.notify_one();
+
+    /*
+     * After an error we only drain the queue.
+     */
+    lock.unlock();
+    bool ok = failed || ExtractRecord(jcr_, item->rec, item);
+    FreeItem(item);
+    lock.lock();
+
+    if (!ok) {
+      failed_ = true;
+      not_full_.notify_all();
+    }
+  }
+}
+
+/*
+ * Called by the reader to decide whether the data of the file that starts
+ * with this attributes record needs to be inflated. This mirrors the checks
+ * done on the attributes by ExtractRecord(), when the two disagree the writer
+ * just inflates the record itself.
+ */
+static bool FileIsSelected(JobControlRecord* jcr, DeviceRecord* rec)
+{
+  if (!UnpackAttributesRecord(jcr, rec->Stream, rec->data, rec->data_len,
+                              reader_attr)) {
+    return false;
+  }
+
+  if (!FileIsIncluded(ff, reader_attr->fname) ||
+      FileIsExcluded(ff, reader_attr->fname)) {
+    return false;
+  }
+
+  reader_attr->data_stream =
+      DecodeStat(reader_attr->attr, &reader_attr->statp,
+                 sizeof(reader_attr->statp), &reader_attr->LinkFI);
+
+  return IsRestoreStreamSupported(reader_attr->data_stream) &&
+         reader_attr->type != FT_DELETED;
+}
+
+/*
+ * Called here for each record from ReadRecords()
+ */
+static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
+{
+  JobControlRecord* jcr = dcr->jcr;
+
+  if (rec->FileIndex < 0) { return true; /* we don't want labels */ }
+
+  if (!pipeline) { return ExtractRecord(jcr, rec, nullptr); }
+
+  switch (rec->maskedStream) {
+    case STREAM_UNIX_ATTRIBUTES:
+    case STREAM_UNIX_ATTRIBUTES_EX:
+      reader_selected = FileIsSelected(jcr, rec);
+      break;
+    default:
+      break;
+  }
+
+  return pipeline->Submit(
+      rec, reader_selected && IsCompressedStream(rec->maskedStream),
+      reader_attr->fname);
+}
@@ -41,6 +41,10 @@
 #include "lib/edit.h"
 #include "include/jcr.h"
 
+#include <climits>
+#include <vector>
+#include <sys/uio.h>
+
 namespace storagedaemon {
 
 static bool TerminateWritingVolume(DeviceControlRecord* dcr);
@@ -67,6 +71,7 @@ void DumpBlock(DeviceBlock* b, const char* msg)
   int bhl, rhl;
   char buf1[100], buf2[100];
 
+  FlattenBlock(b);
   UnserBegin(b->buf, BLKHDR1_LENGTH);
   unser_uint32(CheckSum);
   unser_uint32(block_len);
@@ -152,12 +157,125 @@ DeviceBlock* dup_block(DeviceBlock* eblock)
   DeviceBlock* block = (DeviceBlock*)GetMemory(sizeof(DeviceBlock));
   int buf_len = SizeofPoolMemory(eblock->buf);
 
+  FlattenBlock(eblock);
   memcpy(block, eblock, sizeof(DeviceBlock));
   block->buf = GetMemory(buf_len);
   memcpy(block->buf, eblock->buf, buf_len);
+  block->slices = NULL;
+  block->max_slices = 0;
   return block;
 }
 
+/**
+ * Wrap a record data buffer so blocks can reference it, the caller holds
+ * the first reference.
+ */
+SharedPayload* NewSharedPayload(POOLMEM* buf)
+{
+  SharedPayload* payload = new SharedPayload;
+
+  payload->buf = buf;
+  payload->refs = 1;
+  return payload;
+}
+
+static inline void UnrefSharedPayload(SharedPayload* payload)
+{
+  if (--payload->refs == 0) {
+    FreePoolMemory(payload->buf);
+    delete payload;
+  }
+}
+
+/**
+ * Drop the reference of the creator of the payload.
+ *
+ * Returns: true when blocks still reference the buffer, it then no longer
+ *          belongs to the caller and is freed with the last block reference.
+ *          false when the buffer is not referenced and still belongs to the
+ *          caller.
+ */
+bool ReleaseSharedPayload(SharedPayload* payload)
+{
+  if (--payload->refs == 0) {
+    delete payload;
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * Add len bytes of record data to the block by reference.
+ */
+void AddBlockSlice(DeviceBlock* block,
+                   SharedPayload* payload,
+                   const char* data,
+                   uint32_t len)
+{
+  BlockSlice* slice;
+
+  if (block->nr_slices == block->max_slices) {
+    block->max_slices = block->max_slices ? block->max_slices * 2 : 16;
+    block->slices = (BlockSlice*)realloc(
+        block->slices, block->max_slices * sizeof(BlockSlice));
+  }
+
+  payload->refs++;
+  slice = &block->slices[block->nr_slices++];
+  slice->offset = block->binbuf;
+  slice->len = len;
+  slice->data = data;
+  slice->payload = payload;
+
+  block->bufp += len;
+  block->binbuf += len;
+}
+
+static void ReleaseBlockSlices(DeviceBlock* block)
+{
+  for (uint32_t i = 0; i < block->nr_slices; i++) {
+    UnrefSharedPayload(block->slices[i].payload);
+  }
+  block->nr_slices = 0;
+}
+
+/**
+ * Copy all referenced record data into the block buffer, for the code
+ * which needs the block in one piece.
+ */
+void FlattenBlock(DeviceBlock* block)
+{
+  for (uint32_t i = 0; i < block->nr_slices; i++) {
+    BlockSlice* slice = &block->slices[i];
+
+    memcpy(block->buf + slice->offset, slice->data, slice->len);
+  }
+  ReleaseBlockSlices(block);
+}
+
+/**
+ * Describe the first len bytes of a block with slices as an iovec.
+ */
+static void BlockToIovec(DeviceBlock* block,
+                         uint32_t len,
+                         std::vector<struct iovec>& iov)
+{
+  uint32_t pos = 0;
+
+  iov.clear();
+  for (uint32_t i = 0; i < block->nr_slices; i++) {
+    BlockSlice* slice = &block->slices[i];
+
+    if (slice->offset > pos) {
+      iov.push_back({block->buf + pos, slice->offset - pos});
+    }
+    iov.push_back({(void*)slice->data, slice->len});
+    pos = slice->offset + slice->len;
+  }
+  if (len > pos) { iov.push_back({block->buf + pos, len - pos}); }
+}
+
 /**
  * Only the first block checksum error was reported.
  *   If there are more, report it now.
@@ -177,6 +295,8 @@ void FreeBlock(DeviceBlock* block)
 {
   if (block) {
     Dmsg1(999, "FreeBlock buffer %x\n", block->buf);
+    ReleaseBlockSlices(block);
+    if (block->slices) { free(block->slices); }
     FreeMemory(block->buf);
     Dmsg1(999, "FreeBlock block %x\n", block);
     FreeMemory((POOLMEM*)block);
@@ -188,6 +308,7 @@ void FreeBlock(DeviceBlock* block)
  */
 void EmptyBlock(DeviceBlock* block)
 {
+  ReleaseBlockSlices(block);
   block->binbuf = WRITE_BLKHDR_LENGTH;
   block->bufp = block->buf + block->binbuf;
   block->read_len = 0;
@@ -222,8 +343,18 @@ static uint32_t SerBlockHeader(DeviceBlock* block, bool DoChecksum)
    * Checksum whole block except for the checksum
    */
   if (DoChecksum) {
-    CheckSum = crc32_fast((uint8_t*)block->buf + BLKHDR_CS_LENGTH,
-                      block_len - BLKHDR_CS_LENGTH);
+    uint32_t pos = BLKHDR_CS_LENGTH;
+
+    for (uint32_t i = 0; i < block->nr_slices; i++) {
+      BlockSlice* slice = &block->slices[i];
+
+      CheckSum = crc32_fast((uint8_t*)block->buf + pos, slice->offset - pos,
+                            CheckSum);
+      CheckSum = crc32_fast(slice->data, slice->len, CheckSum);
+      pos = slice->offset + slice->len;
+    }
+    CheckSum =
+        crc32_fast((uint8_t*)block->buf + pos, block_len - pos, CheckSum);
   }
   Dmsg1(1390, "ser_bloc_header: checksum=%x\n", CheckSum);
   SerBegin(block->buf, BLKHDR2_LENGTH);
@@ -750,6 +881,20 @@ bool DeviceControlRecord::WriteBlockToDev()
   }
 #endif
 
+  /*
+   * Record data referenced by the block is written directly from the
+   * record buffers when the device can write an iovec.
+   */
+  std::vector<struct iovec> iov;
+
+  if (block->nr_slices > 0) {
+    if (dev->HasCap(CAP_WRITEV) && 2 * block->nr_slices + 1 <= IOV_MAX) {
+      BlockToIovec(block, wlen, iov);
+    } else {
+      FlattenBlock(block);
+    }
+  }
+
   /*
    * Do write here,
    * make a somewhat feeble attempt to recover
@@ -766,7 +911,11 @@ bool DeviceControlRecord::WriteBlockToDev()
       Bmicrosleep(5, 0); /* pause a bit if busy or lots of errors */
       dev->clrerror(-1);
     }
-    status = dev->write(block->buf, (size_t)wlen);
+    if (iov.empty()) {
+      status = dev->write(block->buf, (size_t)wlen);
+    } else {
+      status = dev->writev(iov.data(), iov.size());
+    }
   } while (status == -1 && (errno == EBUSY) && retry++ < 3);
 
   if (debug_block_checksum) {
@@ -880,6 +1029,7 @@ bool DeviceControlRecord::WriteBlockToDev()
   }
   if (block->LastIndex > 0) { dcr->VolLastIndex = block->LastIndex; }
   dcr->WroteVol = true;
+  if (!dev->IsTape()) { BlockIndexAddBlock(dcr, block, dev->file_addr, wlen); }
   dev->file_addr += wlen; /* update file address */
   dev->file_size += wlen;
 
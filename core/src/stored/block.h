@@ -29,6 +29,8 @@
 #ifndef BAREOS_STORED_BLOCK_H_
 #define BAREOS_STORED_BLOCK_H_ 1
 
+#include <atomic>
+
 namespace storagedaemon {
 
 class Device; /* for forward reference */
@@ -80,6 +82,30 @@ class Device; /* for forward reference */
    uint32_t VolSessionTime;
  */
 
+/**
+ * Record payload which is referenced by blocks instead of being copied into
+ * them. The buffer is freed when the last reference is dropped.
+ */
+struct SharedPayload {
+  POOLMEM* buf;
+  std::atomic<int32_t> refs;
+};
+
+/**
+ * Part of a block being written which is not in the block buffer but in the
+ * buffer of a SharedPayload. The block buffer has a hole of len bytes at
+ * offset which only gets filled when the block is flattened.
+ */
+struct BlockSlice {
+  uint32_t offset;        /* offset of the slice in the block */
+  uint32_t len;           /* length of the slice */
+  const char* data;       /* start of the slice in the payload buffer */
+  SharedPayload* payload; /* reference held on the payload */
+};
+
+/* Minimum length of record data worth referencing instead of copying */
+#define MIN_BLOCK_SLICE_LENGTH 2048
+
 /**
  * DeviceBlock for reading and writing blocks.
  * This is the basic unit that is written to the device, and
@@ -111,6 +137,9 @@ struct DeviceBlock {
   int32_t LastIndex;       /* last index this block */
   char* bufp;              /* pointer into buffer */
   POOLMEM* buf;            /* actual data buffer */
+  BlockSlice* slices;      /* record data referenced instead of copied */
+  uint32_t nr_slices;      /* slices in use */
+  uint32_t max_slices;     /* slices allocated */
 };
 
 inline uint32_t BlockWriteNavail(DeviceBlock* block)
@@ -131,6 +160,13 @@ void EmptyBlock(DeviceBlock* block);
 void FreeBlock(DeviceBlock* block);
 void PrintBlockReadErrors(JobControlRecord* jcr, DeviceBlock* block);
 void SerBlockHeader(DeviceBlock* block);
+SharedPayload* NewSharedPayload(POOLMEM* buf);
+bool ReleaseSharedPayload(SharedPayload* payload);
+void AddBlockSlice(DeviceBlock* block,
+                   SharedPayload* payload,
+                   const char* data,
+                   uint32_t len);
+void FlattenBlock(DeviceBlock* block);
 
 } /* namespace storagedaemon */
 
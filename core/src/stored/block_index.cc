@@ -0,0 +1,523 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Block index of disk volumes.
+ *
+ * The index file is named like the volume with ".bix" appended. It starts
+ * with a header identifying the volume by name and label time followed by
+ * fixed size entries, each describing one run of blocks of a session.
+ *
+ * Runs of a session are written in address order, a run is closed when it
+ * spans more than BLOCK_INDEX_RUN_SPAN bytes of the volume or the session
+ * ends. Reading never needs more than the blocks of one run to find a
+ * record, while the index of a volume written by many concurrent jobs stays
+ * small.
+ */
+
+#include "include/bareos.h"
+#include "stored/stored.h"
+#include "stored/block_index.h"
+#include "lib/berrno.h"
+#include "lib/serial.h"
+
+#include <algorithm>
+
+namespace storagedaemon {
+
+static const int debuglevel = 150;
+
+#define BLOCK_INDEX_MAGIC "BareosBlockIndex"
+#define BLOCK_INDEX_VERSION 1
+#define BLOCK_INDEX_SUFFIX ".bix"
+#define BLOCK_INDEX_RUN_SPAN (64 * 1024 * 1024)
+
+static const uint32_t header_length = 16 + 4 + 8 + MAX_NAME_LENGTH;
+static const uint32_t entry_length = 4 + 4 + 4 + 4 + 8 + 8;
+
+static bool SameSessionBefore(const BlockIndexEntry& a,
+                              const BlockIndexEntry& b)
+{
+  if (a.VolSessionTime != b.VolSessionTime) {
+    return a.VolSessionTime < b.VolSessionTime;
+  }
+  if (a.VolSessionId != b.VolSessionId) {
+    return a.VolSessionId < b.VolSessionId;
+  }
+  return a.StartAddr < b.StartAddr;
+}
+
+VolumeBlockIndex::VolumeBlockIndex() { pthread_mutex_init(&mutex_, NULL); }
+
+VolumeBlockIndex::~VolumeBlockIndex()
+{
+  CloseVolume();
+  pthread_mutex_destroy(&mutex_);
+}
+
+void VolumeBlockIndex::SetVolume(const char* path,
+                                 const char* VolumeName,
+                                 btime_t label_btime)
+{
+  P(mutex_);
+  if (path_ != path || volume_name_ != VolumeName ||
+      label_btime_ != label_btime) {
+    CloseVolume();
+    path_ = path;
+    volume_name_ = VolumeName;
+    label_btime_ = label_btime;
+  }
+  V(mutex_);
+}
+
+void VolumeBlockIndex::SetPath(const char* path)
+{
+  P(mutex_);
+  if (path_ != path) {
+    CloseVolume();
+    path_ = path;
+    volume_name_.clear();
+    label_btime_ = 0;
+  }
+  V(mutex_);
+}
+
+void VolumeBlockIndex::SetLabel(const char* VolumeName, btime_t label_btime)
+{
+  P(mutex_);
+  if (volume_name_ != VolumeName || label_btime_ != label_btime) {
+    CloseVolume();
+    volume_name_ = VolumeName;
+    label_btime_ = label_btime;
+  }
+  V(mutex_);
+}
+
+/*
+ * The index tells where the data of each job is on the volume, so it is
+ * removed the same way as the spool files.
+ */
+void VolumeBlockIndex::EraseFile(JobControlRecord* jcr)
+{
+  if (path_.empty() || access(path_.c_str(), F_OK) != 0) { return; }
+
+  Dmsg1(debuglevel, "Removing block index %s\n", path_.c_str());
+  SecureErase(jcr, path_.c_str());
+}
+
+/*
+ * Open the index file for writing, an index of another volume or of an
+ * earlier labeling of this volume is thrown away.
+ */
+bool VolumeBlockIndex::OpenForAppend()
+{
+  char header[header_length], expected[header_length];
+  char name[MAX_NAME_LENGTH];
+  struct stat st;
+  ser_declare;
+
+  if (fd_ >= 0) { return true; }
+  if (write_failed_ || path_.empty()) { return false; }
+
+  memset(name, 0, sizeof(name));
+  bstrncpy(name, volume_name_.c_str(), sizeof(name));
+  SerBegin(expected, header_length);
+  SerBytes(BLOCK_INDEX_MAGIC, 16);
+  ser_uint32(BLOCK_INDEX_VERSION);
+  SerBtime(label_btime_);
+  SerBytes(name, MAX_NAME_LENGTH);
+
+  if ((fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT, 0640)) < 0 ||
+      fstat(fd_, &st) != 0) {
+    goto bail_out;
+  }
+
+  if (st.st_size >= header_length &&
+      pread(fd_, header, header_length, 0) == header_length &&
+      memcmp(header, expected, header_length) == 0) {
+    /*
+     * Drop an entry only partly written before a crash.
+     */
+    off_t end = header_length +
+                (st.st_size - header_length) / entry_length * entry_length;
+
+    if (end != st.st_size && ftruncate(fd_, end) != 0) { goto bail_out; }
+    if (lseek(fd_, end, SEEK_SET) < 0) { goto bail_out; }
+  } else {
+    Dmsg1(debuglevel, "Creating block index %s\n", path_.c_str());
+    if (ftruncate(fd_, 0) != 0 ||
+        write(fd_, expected, header_length) != header_length) {
+      goto bail_out;
+    }
+  }
+
+  return true;
+
+bail_out:
+  BErrNo be;
+
+  Dmsg2(debuglevel, "Cannot write block index %s: ERR=%s\n", path_.c_str(),
+        be.bstrerror());
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+    EraseFile(NULL);
+  }
+  write_failed_ = true;
+  return false;
+}
+
+/*
+ * An index missing some runs in the middle would make reading skip
+ * records, so once writing failed the index file is removed.
+ */
+void VolumeBlockIndex::WriteEntry(const BlockIndexEntry& entry)
+{
+  char buf[entry_length];
+  ser_declare;
+
+  if (!OpenForAppend()) { return; }
+
+  SerBegin(buf, entry_length);
+  ser_uint32(entry.VolSessionId);
+  ser_uint32(entry.VolSessionTime);
+  ser_int32(entry.FirstIndex);
+  ser_int32(entry.LastIndex);
+  ser_uint64(entry.StartAddr);
+  ser_uint64(entry.EndAddr);
+
+  if (write(fd_, buf, entry_length) != entry_length) {
+    BErrNo be;
+
+    Dmsg2(debuglevel, "Cannot write block index %s: ERR=%s\n", path_.c_str(),
+          be.bstrerror());
+    ::close(fd_);
+    fd_ = -1;
+    EraseFile(NULL);
+    write_failed_ = true;
+  }
+
+  loaded_ = false;
+  entries_.clear();
+}
+
+void VolumeBlockIndex::AddBlock(uint32_t VolSessionId,
+                                uint32_t VolSessionTime,
+                                int32_t FirstIndex,
+                                int32_t LastIndex,
+                                uint64_t addr,
+                                uint32_t len)
+{
+  SessionKey key(VolSessionTime, VolSessionId);
+
+  P(mutex_);
+  auto run = runs_.find(key);
+  if (run != runs_.end()) {
+    BlockIndexEntry& entry = run->second;
+
+    if (addr >= entry.EndAddr && FirstIndex >= entry.LastIndex &&
+        addr + len - entry.StartAddr <= BLOCK_INDEX_RUN_SPAN) {
+      entry.LastIndex = LastIndex;
+      entry.EndAddr = addr + len;
+      V(mutex_);
+      return;
+    }
+
+    WriteEntry(entry);
+    runs_.erase(run);
+  }
+
+  runs_[key] = BlockIndexEntry{VolSessionId, VolSessionTime, FirstIndex,
+                               LastIndex,    addr,          addr + len};
+  V(mutex_);
+}
+
+/*
+ * The runs of a finished session go to stable storage, so a later crash
+ * can only lose runs of sessions that did not finish.
+ */
+void VolumeBlockIndex::EndSession(uint32_t VolSessionId,
+                                  uint32_t VolSessionTime)
+{
+  P(mutex_);
+  auto run = runs_.find(SessionKey(VolSessionTime, VolSessionId));
+  if (run != runs_.end()) {
+    WriteEntry(run->second);
+    runs_.erase(run);
+    if (fd_ >= 0) { fdatasync(fd_); }
+  }
+  V(mutex_);
+}
+
+bool VolumeBlockIndex::Load()
+{
+  char header[header_length];
+  char name[MAX_NAME_LENGTH];
+  uint32_t version;
+  btime_t label_btime;
+  struct stat st;
+  std::vector<char> buf;
+  int fd;
+  unser_declare;
+
+  if (loaded_) { return !entries_.empty(); }
+  loaded_ = true;
+  entries_.clear();
+
+  if (path_.empty() ||
+      (fd = ::open(path_.c_str(), O_RDONLY)) < 0) {
+    return false;
+  }
+
+  if (fstat(fd, &st) != 0 || st.st_size < header_length ||
+      read(fd, header, header_length) != header_length) {
+    ::close(fd);
+    return false;
+  }
+
+  UnserBegin(header, header_length);
+  if (memcmp(ser_ptr, BLOCK_INDEX_MAGIC, 16) != 0) {
+    ::close(fd);
+    return false;
+  }
+  ser_ptr += 16;
+  unser_uint32(version);
+  UnserBtime(label_btime);
+  UnserBytes(name, MAX_NAME_LENGTH);
+  name[MAX_NAME_LENGTH - 1] = 0;
+
+  if (version != BLOCK_INDEX_VERSION || label_btime != label_btime_ ||
+      volume_name_ != name) {
+    Dmsg1(debuglevel, "Block index %s belongs to another volume\n",
+          path_.c_str());
+    ::close(fd);
+    return false;
+  }
+
+  buf.resize((st.st_size - header_length) / entry_length * entry_length);
+  if (!buf.empty() && read(fd, buf.data(), buf.size()) != (ssize_t)buf.size()) {
+    ::close(fd);
+    return false;
+  }
+  ::close(fd);
+
+  entries_.reserve(buf.size() / entry_length);
+  UnserBegin(buf.data(), buf.size());
+  for (size_t i = 0; i < buf.size() / entry_length; i++) {
+    BlockIndexEntry entry;
+
+    unser_uint32(entry.VolSessionId);
+    unser_uint32(entry.VolSessionTime);
+    unser_int32(entry.FirstIndex);
+    unser_int32(entry.LastIndex);
+    unser_uint64(entry.StartAddr);
+    unser_uint64(entry.EndAddr);
+    entries_.push_back(entry);
+  }
+  std::sort(entries_.begin(), entries_.end(), SameSessionBefore);
+
+  Dmsg2(debuglevel, "Loaded %d runs from block index %s\n",
+        (int)entries_.size(), path_.c_str());
+
+  return !entries_.empty();
+}
+
+bool VolumeBlockIndex::Lookup(uint32_t VolSessionId,
+                              uint32_t VolSessionTime,
+                              int32_t FileIndex,
+                              uint64_t* addr)
+{
+  BlockIndexEntry key{VolSessionId, VolSessionTime, 0, 0, 0, 0};
+  bool found = false;
+
+  P(mutex_);
+  if (Load()) {
+    int32_t LastIndex = 0;
+
+    for (auto entry = std::lower_bound(entries_.begin(), entries_.end(), key,
+                                       SameSessionBefore);
+         entry != entries_.end() && entry->VolSessionId == VolSessionId &&
+         entry->VolSessionTime == VolSessionTime;
+         ++entry) {
+      /*
+       * FileIndexes of a session are consecutive, a gap between two runs
+       * means a run got lost and the index cannot be trusted.
+       */
+      if (LastIndex > 0 && entry->FirstIndex > LastIndex + 1) { break; }
+      if (entry->LastIndex >= FileIndex) {
+        *addr = entry->StartAddr;
+        found = true;
+        break;
+      }
+      LastIndex = entry->LastIndex;
+    }
+  }
+  V(mutex_);
+
+  return found;
+}
+
+void VolumeBlockIndex::CloseVolume()
+{
+  for (auto& run : runs_) { WriteEntry(run.second); }
+  runs_.clear();
+
+  if (fd_ >= 0) {
+    fdatasync(fd_);
+    ::close(fd_);
+    fd_ = -1;
+  }
+  write_failed_ = false;
+  loaded_ = false;
+  entries_.clear();
+}
+
+void VolumeBlockIndex::Close()
+{
+  P(mutex_);
+  CloseVolume();
+  path_.clear();
+  volume_name_.clear();
+  label_btime_ = 0;
+  V(mutex_);
+}
+
+void VolumeBlockIndex::Remove(JobControlRecord* jcr)
+{
+  P(mutex_);
+  runs_.clear();
+  CloseVolume();
+  EraseFile(jcr);
+  V(mutex_);
+}
+
+/*
+ * Only devices keeping their volumes as files or directories in a local
+ * directory get an index file next to the volume.
+ */
+static bool DeviceHasBlockIndex(Device* dev)
+{
+  switch (dev->dev_type) {
+    case B_FILE_DEV:
+    case B_CHUNKDIR_DEV:
+    case B_DEDUP_DEV:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/*
+ * Build the index file name like Device::OpenDevice() builds the name of
+ * the volume.
+ */
+static void BlockIndexPath(Device* dev, const char* VolumeName, PoolMem& path)
+{
+  PmStrcpy(path, dev->dev_name);
+  if (!dev->device->changer_res || dev->device->changer_command[0] == 0) {
+    if (!IsPathSeparator(path.c_str()[strlen(path.c_str()) - 1])) {
+      PmStrcat(path, "/");
+    }
+    PmStrcat(path, VolumeName);
+  }
+  PmStrcat(path, BLOCK_INDEX_SUFFIX);
+}
+
+/**
+ * Set the index file of the volume just opened in dev, called by
+ * Device::open().
+ */
+void BlockIndexOpenVolume(Device* dev)
+{
+  PoolMem path(PM_FNAME);
+
+  if (!DeviceHasBlockIndex(dev) || !dev->getVolCatName()[0]) { return; }
+
+  BlockIndexPath(dev, dev->getVolCatName(), path);
+  dev->block_index.SetPath(path.c_str());
+}
+
+static inline void SelectVolume(Device* dev)
+{
+  dev->block_index.SetLabel(dev->VolHdr.VolumeName, dev->VolHdr.label_btime);
+}
+
+/**
+ * Account a block just written at addr, called by WriteBlockToDev().
+ */
+void BlockIndexAddBlock(DeviceControlRecord* dcr,
+                        DeviceBlock* block,
+                        uint64_t addr,
+                        uint32_t len)
+{
+  Device* dev = dcr->dev;
+
+  if (!dev->device->block_index || !DeviceHasBlockIndex(dev) ||
+      block->LastIndex <= 0 || !dev->VolHdr.VolumeName[0]) {
+    return;
+  }
+
+  SelectVolume(dev);
+  dev->block_index.AddBlock(block->VolSessionId, block->VolSessionTime,
+                            block->FirstIndex, block->LastIndex, addr, len);
+}
+
+void BlockIndexEndSession(DeviceControlRecord* dcr)
+{
+  Device* dev = dcr->dev;
+
+  if (!dev->device->block_index || !DeviceHasBlockIndex(dev)) { return; }
+
+  dev->block_index.EndSession(dcr->jcr->VolSessionId,
+                              dcr->jcr->VolSessionTime);
+}
+
+/**
+ * Find where to start reading the records of a session from FileIndex on
+ * in the volume mounted in dev. An existing index is used even when the
+ * device does not write one (anymore).
+ */
+bool BlockIndexLookup(Device* dev,
+                      uint32_t VolSessionId,
+                      uint32_t VolSessionTime,
+                      int32_t FileIndex,
+                      uint64_t* addr)
+{
+  if (!DeviceHasBlockIndex(dev) || !dev->VolHdr.VolumeName[0]) {
+    return false;
+  }
+
+  SelectVolume(dev);
+  return dev->block_index.Lookup(VolSessionId, VolSessionTime, FileIndex,
+                                 addr);
+}
+
+/**
+ * Remove the index of the volume to be relabeled or truncated.
+ */
+void BlockIndexRemove(Device* dev, JobControlRecord* jcr)
+{
+  if (!DeviceHasBlockIndex(dev)) { return; }
+
+  dev->block_index.Remove(jcr);
+}
+
+} /* namespace storagedaemon */
@@ -0,0 +1,149 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Block index of disk volumes.
+ *
+ * While a volume is appended to, the blocks of every session are collected
+ * into runs of consecutive FileIndexes which are written to an index file
+ * next to the volume. On reading, a run tells where the first block holding
+ * a wanted FileIndex of a session is, so the device can seek there instead
+ * of reading all blocks from the start address of the JobMedia record.
+ */
+
+#ifndef BAREOS_STORED_BLOCK_INDEX_H_
+#define BAREOS_STORED_BLOCK_INDEX_H_
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+class JobControlRecord;
+
+namespace storagedaemon {
+
+class Device;
+class DeviceControlRecord;
+struct DeviceBlock;
+
+/*
+ * Blocks of one session between StartAddr and EndAddr holding the records
+ * from FirstIndex to LastIndex. Blocks of other sessions may lie in between.
+ */
+struct BlockIndexEntry {
+  uint32_t VolSessionId;
+  uint32_t VolSessionTime;
+  int32_t FirstIndex;
+  int32_t LastIndex;
+  uint64_t StartAddr; /* Address of the first block */
+  uint64_t EndAddr;   /* Address after the last block */
+};
+
+class VolumeBlockIndex {
+ public:
+  VolumeBlockIndex();
+  ~VolumeBlockIndex();
+
+  /*
+   * Select the index file and the volume it belongs to, an index file
+   * written for another volume or another labeling of the volume is
+   * ignored on reading and replaced on writing.
+   */
+  void SetVolume(const char* path, const char* VolumeName, btime_t label_btime);
+
+  /*
+   * Same as SetVolume() in two steps: the path is set when the volume is
+   * opened, the label of the volume is checked for every block.
+   */
+  void SetPath(const char* path);
+  void SetLabel(const char* VolumeName, btime_t label_btime);
+
+  void AddBlock(uint32_t VolSessionId,
+                uint32_t VolSessionTime,
+                int32_t FirstIndex,
+                int32_t LastIndex,
+                uint64_t addr,
+                uint32_t len);
+  void EndSession(uint32_t VolSessionId, uint32_t VolSessionTime);
+
+  /*
+   * Find the address of the first block of a session that may contain a
+   * record with the given FileIndex.
+   */
+  bool Lookup(uint32_t VolSessionId,
+              uint32_t VolSessionTime,
+              int32_t FileIndex,
+              uint64_t* addr);
+
+  /*
+   * Write all open runs and forget about the volume.
+   */
+  void Close();
+
+  /*
+   * Delete the index file, the volume gets rewritten.
+   */
+  void Remove(JobControlRecord* jcr);
+
+ private:
+  typedef std::pair<uint32_t, uint32_t> SessionKey;
+
+  pthread_mutex_t mutex_;
+  std::string path_;
+  std::string volume_name_;
+  btime_t label_btime_ = 0;
+  int fd_ = -1;
+  bool write_failed_ = false;
+
+  /*
+   * Runs still growing, by VolSessionTime and VolSessionId.
+   */
+  std::map<SessionKey, BlockIndexEntry> runs_;
+
+  /*
+   * Entries of the index file sorted by session and address, for reading.
+   */
+  bool loaded_ = false;
+  std::vector<BlockIndexEntry> entries_;
+
+  bool OpenForAppend();
+  bool Load();
+  void WriteEntry(const BlockIndexEntry& entry);
+  void CloseVolume();
+  void EraseFile(JobControlRecord* jcr);
+};
+
+void BlockIndexAddBlock(DeviceControlRecord* dcr,
+                        DeviceBlock* block,
+                        uint64_t addr,
+                        uint32_t len);
+void BlockIndexEndSession(DeviceControlRecord* dcr);
+bool BlockIndexLookup(Device* dev,
+                      uint32_t VolSessionId,
+                      uint32_t VolSessionTime,
+                      int32_t FileIndex,
+                      uint64_t* addr);
+void BlockIndexOpenVolume(Device* dev);
+void BlockIndexRemove(Device* dev, JobControlRecord* jcr);
+
+} /* namespace storagedaemon */
+
+#endif /* BAREOS_STORED_BLOCK_INDEX_H_ */
@@ -52,6 +52,16 @@
 #include "lib/bsock.h"
 #include "lib/parse_conf.h"
 #include "lib/util.h"
+#include "lib/thread_specific_data.h"
+#include "include/make_unique.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 /* Dummy functions */
 namespace storagedaemon {
@@ -93,25 +103,64 @@ static bool UpdateDigestRecord(BareosDb* db,
                                char* digest,
                                DeviceRecord* rec,
                                int type);
+static bool FlushCachedAttributes(JobControlRecord* mjcr);
+static void FlushAllCachedAttributes();
+
+/*
+ * File attributes are only inserted into the catalog once the digest that
+ * follows them on the volume was seen, so the digest goes into the same
+ * (batch) insert instead of a separate update of the File record.
+ */
+struct CachedAttributes {
+  AttributesDbRecord ar;
+  int type = 0;
+  std::string fname;
+  std::string lname;
+  std::string attr;
+  char digest[BASE64_SIZE(CRYPTO_DIGEST_MAX_SIZE)]{};
+};
+
+/*
+ * The volumes scanned on one device.
+ */
+struct BscanDevice {
+  char* device_name = nullptr;
+  const char* VolumeName = nullptr;
+  JobControlRecord* jcr = nullptr;
+  BareosDb* db = nullptr;
+};
 
 /* Local variables */
-static Device* dev = NULL;
-static BareosDb* db;
-static JobControlRecord* bjcr; /* jcr for bscan */
 static BootStrapRecord* bsr = NULL;
-static MediaDbRecord mr;
-static PoolDbRecord pr;
-static JobDbRecord jr;
-static ClientDbRecord cr;
-static FileSetDbRecord fsr;
-static RestoreObjectDbRecord rop;
-static AttributesDbRecord ar;
-static FileDbRecord fr;
-static Session_Label label;
-static Session_Label elabel;
-static Attributes* attr;
-
-static time_t lasttime = 0;
+
+/*
+ * Each device is scanned by its own thread, so everything that describes
+ * the volume being scanned is kept per thread.
+ */
+static thread_local Device* dev = NULL;
+static thread_local BareosDb* db;
+static thread_local JobControlRecord* bjcr; /* jcr for bscan */
+static thread_local MediaDbRecord mr;
+static thread_local PoolDbRecord pr;
+static thread_local JobDbRecord jr;
+static thread_local ClientDbRecord cr;
+static thread_local FileSetDbRecord fsr;
+static thread_local RestoreObjectDbRecord rop;
+static thread_local FileDbRecord fr;
+static thread_local Session_Label label;
+static thread_local Session_Label elabel;
+static thread_local Attributes* attr;
+static thread_local std::unordered_map<JobControlRecord*,
+                                       std::unique_ptr<CachedAttributes>>
+    cached_attributes;
+
+static thread_local time_t lasttime = 0;
+
+/*
+ * Pool, Media, Client, FileSet and Job records are shared by the volumes,
+ * the labels that create them are processed by one thread at a time.
+ */
+static std::mutex catalog_mutex;
 
 static const char* backend_directory = _PATH_BAREOS_BACKENDDIR;
 static const char* db_driver = "NULL";
@@ -121,19 +170,30 @@ static const char* db_password = "";
 static const char* db_host = NULL;
 static int db_port = 0;
 static const char* wd = NULL;
-static bool update_db = false;
+static bool update_catalog = false;
+static thread_local bool update_db = false;
 static bool update_vol_info = false;
 static bool list_records = false;
-static int ignored_msgs = 0;
+static thread_local int ignored_msgs = 0;
 
-static uint64_t currentVolumeSize;
-static int last_pct = -1;
+static thread_local uint64_t currentVolumeSize;
+static thread_local int last_pct = -1;
 static bool showProgress = false;
-static int num_jobs = 0;
-static int num_pools = 0;
-static int num_media = 0;
-static int num_files = 0;
-static int num_restoreobjects = 0;
+static std::atomic<int> num_jobs{0};
+static std::atomic<int> num_pools{0};
+static std::atomic<int> num_media{0};
+static std::atomic<int> num_files{0};
+static std::atomic<int> num_restoreobjects{0};
+static std::atomic<uint64_t> num_bytes{0};
+
+/*
+ * Progress of the scan done by this thread.
+ */
+static const int kProgressInterval = 30; /* seconds */
+static thread_local time_t scan_start = 0;
+static thread_local time_t last_progress = 0;
+static thread_local uint64_t scanned_bytes = 0;
+static thread_local uint64_t scanned_files = 0;
 
 static void usage()
 {
@@ -141,7 +201,7 @@ static void usage()
       stderr,
       _(PROG_COPYRIGHT
         "\nVersion: %s (%s)\n\n"
-        "Usage: bscan [ options ] <device-name>\n"
+        "Usage: bscan [ options ] <device-name> [<device-name> ...]\n"
         "       -B <drivername>   specify the database driver name (default "
         "NULL) <postgresql|mysql|sqlite3>\n"
         "       -b <bootstrap>    specify a bootstrap file\n"
@@ -166,24 +226,123 @@ static void usage()
         "       -s                synchronize or store in database\n"
         "       -S                show scan progress periodically\n"
         "       -v                verbose\n"
-        "       -V <Volumes>      specify Volume names (separated by |)\n"
+        "       -V <Volumes>      specify Volume names (separated by |), given "
+        "once per\n"
+        "                         device when scanning several devices in "
+        "parallel\n"
         "       -w <directory>    specify working directory (default from "
         "configuration file)\n"
         "       -?                print this message\n\n"
         "example:\n"
-        "bscan -B postgresql -V Full-0001 FileStorage\n"),
+        "bscan -B postgresql -V Full-0001 FileStorage\n"
+        "bscan -B postgresql -V \"Full-0001|Full-0002\" -V Full-0003 "
+        "FileStorage1 FileStorage2\n"),
       2001, VERSION, BDATE, backend_directory);
   exit(1);
 }
 
+/*
+ * Open a catalog connection for scanning one device.
+ */
+static BareosDb* OpenCatalog(bool need_private)
+{
+  BareosDb* mdb;
+
+  mdb = db_init_database(NULL, db_driver, db_name, db_user, db_password,
+                         db_host, db_port, NULL, false, false, false, false,
+                         need_private);
+  if (mdb == NULL) {
+    Emsg0(M_ERROR_TERM, 0, _("Could not init Bareos database\n"));
+  }
+  if (!mdb->OpenDatabase(NULL)) { Emsg0(M_ERROR_TERM, 0, mdb->strerror()); }
+  Dmsg0(200, "Database opened\n");
+
+  return mdb;
+}
+
+static void ShowVolumeSize()
+{
+  char ed1[50];
+  struct stat sb;
+
+  fstat(dev->fd(), &sb);
+  currentVolumeSize = sb.st_size;
+  Pmsg1(000, _("First Volume Size = %s\n"), edit_uint64(currentVolumeSize, ed1));
+}
+
+/*
+ * Report how far the scan of the current volume got, in percent when the
+ * size of the volume is known and periodically with the throughput.
+ */
+static void ShowProgress()
+{
+  time_t now, elapsed;
+
+  if (currentVolumeSize > 0) {
+    int pct = (mr.VolBytes * 100) / currentVolumeSize;
+    if (pct != last_pct) {
+      fprintf(stdout, _("done: %d%%\n"), pct);
+      fflush(stdout);
+      last_pct = pct;
+    }
+  }
+
+  now = time(NULL);
+  if (now - last_progress >= kProgressInterval) {
+    char ed1[50], ed2[50], ed3[50];
+
+    elapsed = now - scan_start;
+    if (elapsed <= 0) { elapsed = 1; }
+    fprintf(stdout, _("%s: scanned %s bytes, %s files (%s bytes/sec)\n"),
+            dev->print_name(), edit_uint64_with_suffix(scanned_bytes, ed1),
+            edit_uint64_with_commas(scanned_files, ed2),
+            edit_uint64_with_suffix(scanned_bytes / elapsed, ed3));
+    fflush(stdout);
+    last_progress = now;
+  }
+}
+
+/*
+ * Scan all volumes of one device, called by a separate thread for each
+ * device when several devices are scanned.
+ */
+static void ScanDevice(BscanDevice* device)
+{
+  char ed1[50], ed2[50], ed3[50];
+  time_t elapsed;
+
+  bjcr = device->jcr;
+  db = device->db;
+  dev = bjcr->impl->read_dcr->dev;
+  update_db = update_catalog;
+  SetJcrInThreadSpecificData(bjcr);
+
+  scan_start = last_progress = time(NULL);
+  if (showProgress) { ShowVolumeSize(); }
+
+  do_scan();
+
+  elapsed = time(NULL) - scan_start;
+  if (elapsed <= 0) { elapsed = 1; }
+  Pmsg5(000,
+        _("Scanned %s bytes and %s files on device %s in %d secs (%s "
+          "bytes/sec)\n"),
+        edit_uint64_with_suffix(scanned_bytes, ed1),
+        edit_uint64_with_commas(scanned_files, ed2), dev->print_name(),
+        (int)elapsed, edit_uint64_with_suffix(scanned_bytes / elapsed, ed3));
+}
+
 int main(int argc, char* argv[])
 {
   int ch;
   struct stat stat_buf;
-  char* VolumeName = NULL;
+  std::vector<const char*> VolumeNames;
+  std::vector<BscanDevice> devices;
   char* DirectorName = NULL;
   DirectorResource* director = NULL;
   DeviceControlRecord* dcr;
+  time_t start, elapsed;
+  char ed1[50], ed2[50];
 #if defined(HAVE_DYNAMIC_CATS_BACKENDS)
   alist* backend_directories = NULL;
 #endif
@@ -265,7 +424,7 @@ int main(int argc, char* argv[])
         break;
 
       case 's':
-        update_db = true;
+        update_catalog = true;
         break;
 
       case 'u':
@@ -273,7 +432,7 @@ int main(int argc, char* argv[])
         break;
 
       case 'V': /* Volume name */
-        VolumeName = optarg;
+        VolumeNames.push_back(optarg);
         break;
 
       case 'v':
@@ -292,11 +451,37 @@ int main(int argc, char* argv[])
   argc -= optind;
   argv += optind;
 
-  if (argc != 1) {
+  if (argc < 1) {
     Pmsg0(0, _("Wrong number of arguments: \n"));
     usage();
   }
 
+  /*
+   * Every device scans its own list of volumes, a job that spans volumes
+   * must have all of them in the list of one device.
+   */
+  if (argc > 1) {
+    if (bsr) {
+      Pmsg0(0, _("A bootstrap file can only be used with a single device.\n"));
+      usage();
+    }
+    if ((int)VolumeNames.size() != argc) {
+      Pmsg0(0, _("Give the Volume names with -V once for every device.\n"));
+      usage();
+    }
+  } else if (VolumeNames.size() > 1) {
+    Pmsg0(0, _("Volume names given more than once for a single device.\n"));
+    usage();
+  }
+
+  for (int i = 0; i < argc; i++) {
+    BscanDevice device;
+
+    device.device_name = argv[i];
+    if (i < (int)VolumeNames.size()) { device.VolumeName = VolumeNames[i]; }
+    devices.push_back(device);
+  }
+
   my_config = InitSdConfig(configfile, M_ERROR_TERM);
   ParseSdConfig(configfile, M_ERROR_TERM);
 
@@ -340,18 +525,11 @@ int main(int argc, char* argv[])
           working_directory);
   }
 
-  dcr = new DeviceControlRecord;
-  bjcr = SetupJcr("bscan", argv[0], bsr, director, dcr, VolumeName, true);
-  if (!bjcr) { exit(1); }
-  dev = bjcr->impl->read_dcr->dev;
-
-  if (showProgress) {
-    char ed1[50];
-    struct stat sb;
-    fstat(dev->fd(), &sb);
-    currentVolumeSize = sb.st_size;
-    Pmsg1(000, _("First Volume Size = %s\n"),
-          edit_uint64(currentVolumeSize, ed1));
+  for (auto& device : devices) {
+    dcr = new DeviceControlRecord;
+    device.jcr = SetupJcr("bscan", device.device_name, bsr, director, dcr,
+                          device.VolumeName, true);
+    if (!device.jcr) { exit(1); }
   }
 
 #if defined(HAVE_DYNAMIC_CATS_BACKENDS)
@@ -361,35 +539,55 @@ int main(int argc, char* argv[])
   DbSetBackendDirs(backend_directories);
 #endif
 
-  db = db_init_database(NULL, db_driver, db_name, db_user, db_password, db_host,
-                        db_port, NULL, false, false, false, false);
-  if (db == NULL) {
-    Emsg0(M_ERROR_TERM, 0, _("Could not init Bareos database\n"));
-  }
-  if (!db->OpenDatabase(NULL)) { Emsg0(M_ERROR_TERM, 0, db->strerror()); }
-  Dmsg0(200, "Database opened\n");
+  /*
+   * Every device gets its own catalog connection so the file records of
+   * the volumes are inserted in parallel.
+   */
+  for (auto& device : devices) { device.db = OpenCatalog(devices.size() > 1); }
   if (verbose) {
     Pmsg2(000, _("Using Database: %s, User: %s\n"), db_name, db_user);
   }
 
-  do_scan();
-  if (update_db) {
+  start = time(NULL);
+  if (devices.size() == 1) {
+    ScanDevice(&devices[0]);
+  } else {
+    std::vector<std::thread> threads;
+
+    for (auto& device : devices) {
+      threads.emplace_back(ScanDevice, &device);
+    }
+    for (auto& thread : threads) { thread.join(); }
+  }
+  elapsed = time(NULL) - start;
+  if (elapsed <= 0) { elapsed = 1; }
+
+  if (update_catalog) {
     printf(
         "Records added or updated in the catalog:\n%7d Media\n"
         "%7d Pool\n%7d Job\n%7d File\n%7d RestoreObject\n",
-        num_media, num_pools, num_jobs, num_files, num_restoreobjects);
+        num_media.load(), num_pools.load(), num_jobs.load(), num_files.load(),
+        num_restoreobjects.load());
   } else {
     printf(
         "Records would have been added or updated in the catalog:\n"
         "%7d Media\n%7d Pool\n%7d Job\n%7d File\n%7d RestoreObject\n",
-        num_media, num_pools, num_jobs, num_files, num_restoreobjects);
+        num_media.load(), num_pools.load(), num_jobs.load(), num_files.load(),
+        num_restoreobjects.load());
   }
+  printf("Scanned %s bytes in %d secs (%s bytes/sec)\n",
+         edit_uint64_with_suffix(num_bytes, ed1), (int)elapsed,
+         edit_uint64_with_suffix(num_bytes / elapsed, ed2));
   DbFlushBackends();
 
-  CleanDevice(bjcr->impl->dcr);
-  dev->term();
-  FreeDeviceControlRecord(bjcr->impl->dcr);
-  FreeJcr(bjcr);
+  for (auto& device : devices) {
+    bjcr = device.jcr;
+    dev = bjcr->impl->read_dcr->dev;
+    CleanDevice(bjcr->impl->dcr);
+    dev->term();
+    FreeDeviceControlRecord(bjcr->impl->dcr);
+    FreeJcr(bjcr);
+  }
 
   return 0;
 }
@@ -432,14 +630,7 @@ static bool BscanMountNextReadVolume(DeviceControlRecord* dcr)
    * have the Volume list, but we get attached.
    */
   status = MountNextReadVolume(dcr);
-  if (showProgress) {
-    char ed1[50];
-    struct stat sb;
-    fstat(dev->fd(), &sb);
-    currentVolumeSize = sb.st_size;
-    Pmsg1(000, _("First Volume Size = %s\n"),
-          edit_uint64(currentVolumeSize, ed1));
-  }
+  if (showProgress) { ShowVolumeSize(); }
   return status;
 }
 
@@ -447,14 +638,12 @@ static void do_scan()
 {
   attr = new_attr(bjcr);
 
-  AttributesDbRecord ar_emtpy;
   PoolDbRecord pr_empty;
   JobDbRecord jr_empty;
   ClientDbRecord cr_empty;
   FileSetDbRecord fsr_empty;
   FileDbRecord fr_empty;
 
-  ar = ar_emtpy;
   pr = pr_empty;
   jr = jr_empty;
   cr = cr_empty;
@@ -466,8 +655,9 @@ static void do_scan()
    */
   ReadRecords(bjcr->impl->read_dcr, RecordCb, BscanMountNextReadVolume);
 
-  if (update_db) {
-    db->WriteBatchFileRecords(bjcr); /* used by bulk batch file insert */
+  FlushAllCachedAttributes();
+  if (update_db && bjcr->db_batch) {
+    bjcr->db_batch->WriteBatchFileRecords(bjcr); /* bulk batch file insert */
   }
 
   FreeAttr(attr);
@@ -530,14 +720,9 @@ static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
   if (rec->data_len > 0) {
     mr.VolBytes +=
         rec->data_len + WRITE_RECHDR_LENGTH; /* Accumulate Volume bytes */
-    if (showProgress && currentVolumeSize > 0) {
-      int pct = (mr.VolBytes * 100) / currentVolumeSize;
-      if (pct != last_pct) {
-        fprintf(stdout, _("done: %d%%\n"), pct);
-        fflush(stdout);
-        last_pct = pct;
-      }
-    }
+    scanned_bytes += rec->data_len + WRITE_RECHDR_LENGTH;
+    num_bytes += rec->data_len + WRITE_RECHDR_LENGTH;
+    if (showProgress) { ShowProgress(); }
   }
 
   if (list_records) {
@@ -552,6 +737,7 @@ static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
    */
   if (rec->FileIndex < 0) {
     bool save_update_db = update_db;
+    std::lock_guard<std::mutex> guard(catalog_mutex);
 
     if (verbose > 1) { DumpLabelRecord(dev, rec, true); }
     switch (rec->FileIndex) {
@@ -768,6 +954,8 @@ static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
           mjcr->end_time = jr.EndTime;
           mjcr->setJobStatus(JS_Terminated);
 
+          FlushCachedAttributes(mjcr);
+
           /*
            * Create JobMedia record
            */
@@ -784,6 +972,8 @@ static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
         break;
 
       case EOT_LABEL: /* end of all tapes */
+        FlushAllCachedAttributes();
+
         /*
          * Wiffle through all jobs still open and close them.
          */
@@ -854,11 +1044,12 @@ static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
       }
       fr.JobId = mjcr->JobId;
       fr.FileId = 0;
+      scanned_files++;
       num_files++;
-      if (verbose && (num_files & 0x7FFF) == 0) {
+      if (verbose && (scanned_files & 0x7FFF) == 0) {
         char ed1[30], ed2[30], ed3[30], ed4[30];
         Pmsg4(000, _("%s file records. At file:blk=%s:%s bytes=%s\n"),
-              edit_uint64_with_commas(num_files, ed1),
+              edit_uint64_with_commas(scanned_files, ed1),
               edit_uint64_with_commas(rec->File, ed2),
               edit_uint64_with_commas(rec->Block, ed3),
               edit_uint64_with_commas(mr.VolBytes, ed4));
@@ -873,7 +1064,7 @@ static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
                                &rop)) {
         Emsg0(M_ERROR_TERM, 0, _("Cannot continue.\n"));
       }
-      rop.FileIndex = mjcr->FileId;
+      rop.FileIndex = rec->FileIndex;
       rop.JobId = mjcr->JobId;
 
 
@@ -1090,8 +1281,8 @@ static void BscanFreeJcr(JobControlRecord* jcr)
 }
 
 /**
- * We got a File Attributes record on the tape.  Now, lookup the Job
- * record, and then create the attributes record.
+ * We got a File Attributes record on the tape. The record is cached until
+ * its digest or the next File Attributes record of the same Job is seen.
  */
 static bool CreateFileAttributesRecord(BareosDb* db,
                                        JobControlRecord* mjcr,
@@ -1102,35 +1293,83 @@ static bool CreateFileAttributesRecord(BareosDb* db,
                                        DeviceRecord* rec)
 {
   DeviceControlRecord* dcr = mjcr->impl->read_dcr;
-  ar.fname = fname;
-  ar.link = lname;
-  ar.ClientId = mjcr->ClientId;
-  ar.JobId = mjcr->JobId;
-  ar.Stream = rec->Stream;
-  if (type == FT_DELETED) {
-    ar.FileIndex = 0;
-  } else {
-    ar.FileIndex = rec->FileIndex;
-  }
-  ar.attr = ap;
+  std::unique_ptr<CachedAttributes> cached;
+  bool retval;
+
   if (dcr->VolFirstIndex == 0) { dcr->VolFirstIndex = rec->FileIndex; }
   dcr->FileIndex = rec->FileIndex;
   mjcr->JobFiles++;
 
   if (!update_db) { return true; }
 
-  if (!db->CreateFileAttributesRecord(bjcr, &ar)) {
+  retval = FlushCachedAttributes(mjcr);
+
+  cached = std::make_unique<CachedAttributes>();
+  cached->fname = fname;
+  cached->lname = lname;
+  cached->attr = ap;
+  cached->type = type;
+  cached->ar.ClientId = mjcr->ClientId;
+  cached->ar.JobId = mjcr->JobId;
+  cached->ar.Stream = rec->Stream;
+  cached->ar.FileType = type;
+  if (type == FT_DELETED) {
+    cached->ar.FileIndex = 0;
+  } else {
+    cached->ar.FileIndex = rec->FileIndex;
+  }
+  cached_attributes[mjcr] = std::move(cached);
+
+  return retval;
+}
+
+/**
+ * Insert the cached File Attributes record of a Job into the catalog,
+ * CreateAttributesRecord() uses the batch insert when the catalog backend
+ * supports it.
+ */
+static bool FlushCachedAttributes(JobControlRecord* mjcr)
+{
+  auto it = cached_attributes.find(mjcr);
+  bool retval;
+
+  if (it == cached_attributes.end()) { return true; }
+
+  std::unique_ptr<CachedAttributes> cached = std::move(it->second);
+  AttributesDbRecord* ar = &cached->ar;
+
+  cached_attributes.erase(it);
+
+  ar->fname = (char*)cached->fname.c_str();
+  ar->link = (char*)cached->lname.c_str();
+  ar->attr = (char*)cached->attr.c_str();
+  if (cached->digest[0]) { ar->Digest = cached->digest; }
+
+  if (cached->type != FT_BASE) {
+    retval = db->CreateAttributesRecord(bjcr, ar);
+  } else {
+    retval = db->CreateFileAttributesRecord(bjcr, ar);
+  }
+  mjcr->FileId = ar->FileId; /* not known after a batch insert */
+
+  if (!retval) {
     Pmsg1(0, _("Could not create File Attributes record. ERR=%s\n"),
           db->strerror());
     return false;
   }
-  mjcr->FileId = ar.FileId;
 
-  if (verbose > 1) { Pmsg1(000, _("Created File record: %s\n"), fname); }
+  if (verbose > 1) { Pmsg1(000, _("Created File record: %s\n"), ar->fname); }
 
   return true;
 }
 
+static void FlushAllCachedAttributes()
+{
+  while (!cached_attributes.empty()) {
+    FlushCachedAttributes(cached_attributes.begin()->first);
+  }
+}
+
 /**
  * For each Volume we see, we create a Medium record
  */
@@ -1519,7 +1758,24 @@ static bool UpdateDigestRecord(BareosDb* db,
     return false;
   }
 
-  if (!update_db || mjcr->FileId == 0) {
+  if (!update_db) {
+    FreeJcr(mjcr);
+    return true;
+  }
+
+  /*
+   * The digest of a cached File Attributes record is inserted with it.
+   */
+  auto it = cached_attributes.find(mjcr);
+  if (it != cached_attributes.end()) {
+    bstrncpy(it->second->digest, digest, sizeof(it->second->digest));
+    it->second->ar.DigestType = type;
+    FlushCachedAttributes(mjcr);
+    FreeJcr(mjcr);
+    return true;
+  }
+
+  if (mjcr->FileId == 0) {
     FreeJcr(mjcr);
     return true;
   }
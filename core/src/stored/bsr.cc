@@ -43,6 +43,10 @@
 #include "stored/jcr_private.h"
 #include "stored/stored.h"
 #include "include/jcr.h"
+#include "lib/edit.h"
+
+#include <map>
+#include <string>
 
 namespace storagedaemon {
 
@@ -57,9 +61,7 @@ static int MatchSesstime(BootStrapRecord* bsr,
                          BsrSessionTime* sesstime,
                          DeviceRecord* rec,
                          bool done);
-static int MatchSessid(BootStrapRecord* bsr,
-                       BsrSessionId* sessid,
-                       DeviceRecord* rec);
+static int MatchSessid(BootStrapRecord* bsr, DeviceRecord* rec);
 static int MatchClient(BootStrapRecord* bsr,
                        BsrClient* client,
                        Session_Label* sessrec,
@@ -80,18 +82,12 @@ static int MatchJobid(BootStrapRecord* bsr,
                       BsrJobid* jobid,
                       Session_Label* sessrec,
                       bool done);
-static int MatchFindex(BootStrapRecord* bsr,
-                       BsrFileIndex* findex,
-                       DeviceRecord* rec,
-                       bool done);
+static int MatchFindex(BootStrapRecord* bsr, DeviceRecord* rec);
 static int MatchVolfile(BootStrapRecord* bsr,
                         BsrVolumeFile* volfile,
                         DeviceRecord* rec,
                         bool done);
-static int MatchVoladdr(BootStrapRecord* bsr,
-                        BsrVolumeAddress* voladdr,
-                        DeviceRecord* rec,
-                        bool done);
+static int MatchVoladdr(BootStrapRecord* bsr, DeviceRecord* rec);
 static int MatchStream(BootStrapRecord* bsr,
                        BsrStream* stream,
                        DeviceRecord* rec,
@@ -105,12 +101,41 @@ static int MatchAll(BootStrapRecord* bsr,
 static int MatchBlockSesstime(BootStrapRecord* bsr,
                               BsrSessionTime* sesstime,
                               DeviceBlock* block);
-static int MatchBlockSessid(BootStrapRecord* bsr,
-                            BsrSessionId* sessid,
-                            DeviceBlock* block);
+static int MatchBlockSessid(BootStrapRecord* bsr, DeviceBlock* block);
 static BootStrapRecord* find_smallest_volfile(BootStrapRecord* fbsr,
                                               BootStrapRecord* bsr);
 
+/**
+ * Compile the FileIndex, session id and volume address lists of a bsr
+ *   into sorted ranges. Done once, when the bsr is first matched.
+ */
+static BsrCompiled* CompileBsr(BootStrapRecord* bsr)
+{
+  if (bsr->compiled) { return bsr->compiled; }
+
+  BsrCompiled* compiled = new BsrCompiled;
+  for (BsrFileIndex* fi = bsr->FileIndex; fi; fi = fi->next) {
+    compiled->FileIndex.Add(fi->findex, fi->findex2);
+  }
+  for (BsrSessionId* sid = bsr->sessid; sid; sid = sid->next) {
+    compiled->sessid.Add(sid->sessid, sid->sessid2);
+  }
+  for (BsrVolumeAddress* va = bsr->voladdr; va; va = va->next) {
+    compiled->voladdr.Add(va->saddr, va->eaddr);
+  }
+  compiled->FileIndex.Merge();
+  compiled->sessid.Merge();
+  compiled->voladdr.Merge();
+
+  Dmsg3(dbglevel, "Compiled bsr: %d FileIndex, %d sessid, %d voladdr ranges\n",
+        (int)compiled->FileIndex.ranges.size(),
+        (int)compiled->sessid.ranges.size(),
+        (int)compiled->voladdr.ranges.size());
+
+  bsr->compiled = compiled;
+  return compiled;
+}
+
 /**
  *
  *  If possible, position the archive device (tape) to read the
@@ -141,7 +166,7 @@ int MatchBsrBlock(BootStrapRecord* bsr, DeviceBlock* block)
 
   for (; bsr; bsr = bsr->next) {
     if (!MatchBlockSesstime(bsr, bsr->sesstime, block)) { continue; }
-    if (!MatchBlockSessid(bsr, bsr->sessid, block)) { continue; }
+    if (!MatchBlockSessid(bsr, block)) { continue; }
     return 1;
   }
   return 0;
@@ -157,17 +182,10 @@ static int MatchBlockSesstime(BootStrapRecord* bsr,
   return 0;
 }
 
-static int MatchBlockSessid(BootStrapRecord* bsr,
-                            BsrSessionId* sessid,
-                            DeviceBlock* block)
+static int MatchBlockSessid(BootStrapRecord* bsr, DeviceBlock* block)
 {
-  if (!sessid) { return 1; /* no specification matches all */ }
-  if (sessid->sessid <= block->VolSessionId &&
-      sessid->sessid2 >= block->VolSessionId) {
-    return 1;
-  }
-  if (sessid->next) { return MatchBlockSessid(bsr, sessid->next, block); }
-  return 0;
+  if (!bsr->sessid) { return 1; /* no specification matches all */ }
+  return CompileBsr(bsr)->sessid.Contains(block->VolSessionId);
 }
 
 static int MatchFileregex(BootStrapRecord* bsr,
@@ -283,23 +301,15 @@ BootStrapRecord* find_next_bsr(BootStrapRecord* root_bsr, Device* dev)
  * Get the smallest address from this voladdr part
  * Don't use "done" elements
  */
-static bool GetSmallestVoladdr(BsrVolumeAddress* va, uint64_t* ret)
+static bool GetSmallestVoladdr(BootStrapRecord* bsr, uint64_t* ret)
 {
-  bool ok = false;
-  uint64_t min_val = 0;
+  if (!bsr->voladdr) { return false; }
 
-  for (; va; va = va->next) {
-    if (!va->done) {
-      if (ok) {
-        min_val = MIN(min_val, va->saddr);
-      } else {
-        min_val = va->saddr;
-        ok = true;
-      }
-    }
-  }
-  *ret = min_val;
-  return ok;
+  BsrRanges<uint64_t>& voladdr = CompileBsr(bsr)->voladdr;
+  if (voladdr.Done()) { return false; }
+
+  *ret = voladdr.ranges[voladdr.cursor].first;
+  return true;
 }
 
 /* FIXME
@@ -324,8 +334,8 @@ static BootStrapRecord* find_smallest_volfile(BootStrapRecord* found_bsr,
   uint64_t found_bsr_saddr, bsr_saddr;
 
   /* if we have VolAddr, use it, else try with File and Block */
-  if (GetSmallestVoladdr(found_bsr->voladdr, &found_bsr_saddr)) {
-    if (GetSmallestVoladdr(bsr->voladdr, &bsr_saddr)) {
+  if (GetSmallestVoladdr(found_bsr, &found_bsr_saddr)) {
+    if (GetSmallestVoladdr(bsr, &bsr_saddr)) {
       if (found_bsr_saddr > bsr_saddr) {
         return bsr;
       } else {
@@ -434,7 +444,7 @@ static int MatchAll(BootStrapRecord* bsr,
     goto no_match;
   }
 
-  if (!MatchVoladdr(bsr, bsr->voladdr, rec, 1)) {
+  if (!MatchVoladdr(bsr, rec)) {
     if (bsr->voladdr) {
       Dmsg3(dbglevel, "Fail on Addr=%llu. bsr=%llu,%llu\n",
             GetRecordAddress(rec), bsr->voladdr->saddr, bsr->voladdr->eaddr);
@@ -449,14 +459,14 @@ static int MatchAll(BootStrapRecord* bsr,
   }
 
   /* NOTE!! This test MUST come after the sesstime test */
-  if (!MatchSessid(bsr, bsr->sessid, rec)) {
+  if (!MatchSessid(bsr, rec)) {
     Dmsg2(dbglevel, "Fail on sessid. bsr=%u rec=%u\n", bsr->sessid->sessid,
           rec->VolSessionId);
     goto no_match;
   }
 
   /* NOTE!! This test MUST come after sesstime and sessid tests */
-  if (!MatchFindex(bsr, bsr->FileIndex, rec, 1)) {
+  if (!MatchFindex(bsr, rec)) {
     if (bsr->FileIndex) {
       Dmsg3(dbglevel, "Fail on findex=%d. bsr=%d,%d\n", rec->FileIndex,
             bsr->FileIndex->findex, bsr->FileIndex->findex2);
@@ -637,33 +647,28 @@ static int MatchVolfile(BootStrapRecord* bsr,
   return 0;
 }
 
-static int MatchVoladdr(BootStrapRecord* bsr,
-                        BsrVolumeAddress* voladdr,
-                        DeviceRecord* rec,
-                        bool done)
+/**
+ * Addresses only grow while reading a volume, so all ranges ending before
+ *   the record address are done. A record in a done range still matches.
+ */
+static int MatchVoladdr(BootStrapRecord* bsr, DeviceRecord* rec)
 {
-  if (!voladdr) { return 1; /* no specification matches all */ }
+  if (!bsr->voladdr) { return 1; /* no specification matches all */ }
 
+  BsrRanges<uint64_t>& voladdr = CompileBsr(bsr)->voladdr;
   uint64_t addr = GetRecordAddress(rec);
-  Dmsg6(dbglevel,
-        "MatchVoladdr: saddr=%llu eaddr=%llu recaddr=%llu sfile=%u efile=%u "
-        "recfile=%u\n",
-        voladdr->saddr, voladdr->eaddr, addr, voladdr->saddr >> 32,
-        voladdr->eaddr >> 32, addr >> 32);
+  Dmsg2(dbglevel, "MatchVoladdr: recaddr=%llu recfile=%u\n", addr, addr >> 32);
 
-  if (voladdr->saddr <= addr && voladdr->eaddr >= addr) { return 1; }
+  if (voladdr.Contains(addr)) { return 1; }
   /* Once we get past last eblock, we are done */
-  if (addr > voladdr->eaddr) { voladdr->done = true; /* set local done */ }
-  if (voladdr->next) {
-    return MatchVoladdr(bsr, voladdr->next, rec, voladdr->done && done);
-  }
+  voladdr.SkipTo(addr);
 
-  /* If we are done and all prior matches are done, this bsr is finished */
-  if (voladdr->done && done) {
+  /* If all ranges are done, this bsr is finished */
+  if (voladdr.Done()) {
     bsr->done = true;
     bsr->root->Reposition = true;
     Dmsg2(dbglevel, "bsr done from voladdr rec=%llu voleaddr=%llu\n", addr,
-          voladdr->eaddr);
+          voladdr.ranges.empty() ? 0 : voladdr.ranges.back().last);
   }
   return 0;
 }
@@ -704,44 +709,31 @@ static int MatchSesstime(BootStrapRecord* bsr,
  *  have interleaved records, and there may be more of what we want
  *  later.
  */
-static int MatchSessid(BootStrapRecord* bsr,
-                       BsrSessionId* sessid,
-                       DeviceRecord* rec)
+static int MatchSessid(BootStrapRecord* bsr, DeviceRecord* rec)
 {
-  if (!sessid) { return 1; /* no specification matches all */ }
-  if (sessid->sessid <= rec->VolSessionId &&
-      sessid->sessid2 >= rec->VolSessionId) {
-    return 1;
-  }
-  if (sessid->next) { return MatchSessid(bsr, sessid->next, rec); }
-  return 0;
+  if (!bsr->sessid) { return 1; /* no specification matches all */ }
+  return CompileBsr(bsr)->sessid.Contains(rec->VolSessionId);
 }
 
 /**
  * When reading the Volume, the Volume Findex (rec->FileIndex) always
- *   are found in sequential order. Thus we can make optimizations.
- *
- *  ***FIXME*** optimizations
- * We could optimize by removing the recursion.
+ *   are found in sequential order. Thus all ranges ending before the
+ *   FileIndex of the record are done, and only the first range that
+ *   is not done can match.
  */
-static int MatchFindex(BootStrapRecord* bsr,
-                       BsrFileIndex* findex,
-                       DeviceRecord* rec,
-                       bool done)
+static int MatchFindex(BootStrapRecord* bsr, DeviceRecord* rec)
 {
-  if (!findex) { return 1; /* no specification matches all */ }
-  if (!findex->done) {
-    if (findex->findex <= rec->FileIndex && findex->findex2 >= rec->FileIndex) {
-      Dmsg3(dbglevel, "Match on findex=%d. bsrFIs=%d,%d\n", rec->FileIndex,
-            findex->findex, findex->findex2);
-      return 1;
-    }
-    if (rec->FileIndex > findex->findex2) { findex->done = true; }
-  }
-  if (findex->next) {
-    return MatchFindex(bsr, findex->next, rec, findex->done && done);
+  if (!bsr->FileIndex) { return 1; /* no specification matches all */ }
+
+  BsrRanges<int32_t>& findex = CompileBsr(bsr)->FileIndex;
+  findex.SkipTo(rec->FileIndex);
+  if (!findex.Done() && findex.ranges[findex.cursor].first <= rec->FileIndex) {
+    Dmsg3(dbglevel, "Match on findex=%d. bsrFIs=%d,%d\n", rec->FileIndex,
+          findex.ranges[findex.cursor].first,
+          findex.ranges[findex.cursor].last);
+    return 1;
   }
-  if (findex->done && done) {
+  if (findex.Done()) {
     bsr->done = true;
     bsr->root->Reposition = true;
     Dmsg1(dbglevel, "bsr done from findex %d\n", rec->FileIndex);
@@ -756,7 +748,9 @@ uint64_t GetBsrStartAddr(BootStrapRecord* bsr, uint32_t* file, uint32_t* block)
 
   if (bsr) {
     if (bsr->voladdr) {
-      bsr_addr = bsr->voladdr->saddr;
+      if (!GetSmallestVoladdr(bsr, &bsr_addr)) {
+        bsr_addr = bsr->voladdr->saddr;
+      }
       sfile = bsr_addr >> 32;
       sblock = (uint32_t)bsr_addr;
 
@@ -776,6 +770,87 @@ uint64_t GetBsrStartAddr(BootStrapRecord* bsr, uint32_t* file, uint32_t* block)
   return bsr_addr;
 }
 
+/**
+ * Get the start address of a bsr selecting files of a single session, using
+ * the block index of the volume mounted in dev to skip the blocks before the
+ * first wanted file. Falls back to the start address of the bsr when there
+ * is no usable index entry.
+ */
+uint64_t GetBsrIndexedStartAddr(BootStrapRecord* bsr,
+                                Device* dev,
+                                uint32_t* file,
+                                uint32_t* block)
+{
+  uint64_t bsr_addr = GetBsrStartAddr(bsr, file, block);
+  uint64_t index_addr;
+  int32_t findex;
+  char ed1[50], ed2[50];
+
+  if (!bsr || !bsr->voladdr || !bsr->sessid || !bsr->sesstime ||
+      bsr->sessid->next || bsr->sesstime->next ||
+      bsr->sessid->sessid != bsr->sessid->sessid2) {
+    return bsr_addr;
+  }
+
+  BsrCompiled* compiled = CompileBsr(bsr);
+  if (!bsr->FileIndex || compiled->FileIndex.Done() ||
+      compiled->voladdr.Done()) {
+    return bsr_addr;
+  }
+
+  findex = compiled->FileIndex.ranges[compiled->FileIndex.cursor].first;
+  uint64_t end_addr = compiled->voladdr.ranges.back().last;
+  if (findex <= 0 ||
+      !BlockIndexLookup(dev, bsr->sessid->sessid, bsr->sesstime->sesstime,
+                        findex, &index_addr) ||
+      index_addr <= bsr_addr || index_addr > end_addr) {
+    return bsr_addr;
+  }
+
+  Dmsg3(dbglevel, "block index moves start of FileIndex %d from %s to %s\n",
+        findex, edit_uint64(bsr_addr, ed1), edit_uint64(index_addr, ed2));
+  if (file && block) {
+    *file = (uint32_t)(index_addr >> 32);
+    *block = (uint32_t)index_addr;
+  }
+
+  return index_addr;
+}
+
+/**
+ * Get the highest address on the volume mounted in dev that any bsr
+ * wants to read, everything after it can be skipped.
+ *
+ * Returns: end address or 0 when not known
+ */
+uint64_t GetBsrEndAddr(BootStrapRecord* root_bsr, Device* dev)
+{
+  uint64_t end_addr = 0;
+
+  for (BootStrapRecord* bsr = root_bsr; bsr; bsr = bsr->next) {
+    if (!MatchVolume(bsr, bsr->volume, &dev->VolHdr, 1)) { continue; }
+
+    if (bsr->voladdr) {
+      for (BsrVolumeAddress* va = bsr->voladdr; va; va = va->next) {
+        end_addr = MAX(end_addr, va->eaddr);
+      }
+    } else if (bsr->volfile && bsr->volblock) {
+      for (BsrVolumeFile* vf = bsr->volfile; vf; vf = vf->next) {
+        for (BsrVolumeBlock* vb = bsr->volblock; vb; vb = vb->next) {
+          end_addr = MAX(end_addr, (((uint64_t)vf->efile) << 32) | vb->eblock);
+        }
+      }
+    } else {
+      /*
+       * This bsr wants the whole volume.
+       */
+      return 0;
+    }
+  }
+
+  return end_addr;
+}
+
 /* ****************************************************************
  * Routines for handling volumes
  */
@@ -890,6 +965,82 @@ void CreateRestoreVolumeList(JobControlRecord* jcr)
   }
 }
 
+static int FindLane(std::vector<int>& lane, int i)
+{
+  while (lane[i] != i) {
+    lane[i] = lane[lane[i]];
+    i = lane[i];
+  }
+  return i;
+}
+
+static void JoinLanes(std::vector<int>& lane, int i, int j)
+{
+  i = FindLane(lane, i);
+  j = FindLane(lane, j);
+  if (i < j) {
+    lane[j] = i;
+  } else {
+    lane[i] = j;
+  }
+}
+
+/**
+ * Split a bsr into lanes that can each be read on a device of their own.
+ *  The entries of one job session and the entries sharing a Volume end up
+ *  in the same lane, so every Volume is read by one device only. Lanes and
+ *  the entries in them keep the order of the bsr.
+ *
+ *  Returns an empty list when an entry does not select exactly one session.
+ */
+std::vector<std::vector<BootStrapRecord*>> SplitBsrIntoLanes(
+    BootStrapRecord* root)
+{
+  std::vector<std::vector<BootStrapRecord*>> lanes;
+  std::vector<BootStrapRecord*> entries;
+  std::vector<int> lane;
+  std::map<std::pair<uint32_t, uint32_t>, int> sessions;
+  std::map<std::string, int> volumes;
+
+  for (BootStrapRecord* bsr = root; bsr; bsr = bsr->next) {
+    if (!bsr->volume || !bsr->sessid || bsr->sessid->next ||
+        bsr->sessid->sessid != bsr->sessid->sessid2 || !bsr->sesstime ||
+        bsr->sesstime->next) {
+      Dmsg0(dbglevel, "bsr entry without a single session, no lanes\n");
+      return lanes;
+    }
+
+    int i = entries.size();
+    entries.push_back(bsr);
+    lane.push_back(i);
+
+    auto session = sessions.emplace(
+        std::make_pair(bsr->sessid->sessid, bsr->sesstime->sesstime), i);
+    if (!session.second) { JoinLanes(lane, i, session.first->second); }
+
+    for (BsrVolume* vol = bsr->volume; vol; vol = vol->next) {
+      auto volume = volumes.emplace(vol->VolumeName, i);
+      if (!volume.second) { JoinLanes(lane, i, volume.first->second); }
+    }
+  }
+
+  /*
+   * A lane is identified by its first entry so the lanes are created in
+   * the order of the bsr.
+   */
+  std::map<int, size_t> lane_index;
+  for (size_t i = 0; i < entries.size(); i++) {
+    auto index = lane_index.emplace(FindLane(lane, i), lanes.size());
+    if (index.second) { lanes.emplace_back(); }
+    lanes[index.first->second].push_back(entries[i]);
+  }
+
+  Dmsg2(dbglevel, "Split %d bsr entries into %d lanes\n", (int)entries.size(),
+        (int)lanes.size());
+
+  return lanes;
+}
+
 void FreeRestoreVolumeList(JobControlRecord* jcr)
 {
   VolumeList* vol = jcr->impl->VolList;
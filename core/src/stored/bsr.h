@@ -36,6 +36,9 @@
 #include <regex.h>
 #endif
 
+#include <algorithm>
+#include <vector>
+
 namespace storagedaemon {
 
 /**
@@ -103,14 +106,12 @@ struct BsrVolumeAddress {
   BsrVolumeAddress* next;
   uint64_t saddr; /* start address */
   uint64_t eaddr; /* end address */
-  bool done;      /* local done */
 };
 
 struct BsrFileIndex {
   BsrFileIndex* next;
   int32_t findex;  /* start file index */
   int32_t findex2; /* end file index */
-  bool done;       /* local done */
 };
 
 struct BsrJobid {
@@ -140,6 +141,73 @@ struct BsrStream {
   int32_t stream; /* stream desired */
 };
 
+/**
+ * Sorted and merged ranges compiled from one of the lists above, so
+ *   matching a record is a binary search instead of a list walk.
+ *   The ranges before cursor are done, as records are read in
+ *   increasing order of FileIndex and address.
+ */
+template <typename T>
+struct BsrRanges {
+  struct Range {
+    T first;
+    T last;
+  };
+
+  std::vector<Range> ranges;
+  size_t cursor = 0;
+
+  void Add(T first, T last)
+  {
+    if (first <= last) { ranges.push_back(Range{first, last}); }
+  }
+
+  /* Sort and merge overlapping and adjacent ranges */
+  void Merge()
+  {
+    size_t n = 0;
+
+    std::sort(ranges.begin(), ranges.end(),
+              [](const Range& a, const Range& b) { return a.first < b.first; });
+    for (const Range& range : ranges) {
+      if (n > 0 && (range.first <= ranges[n - 1].last ||
+                    range.first - 1 == ranges[n - 1].last)) {
+        ranges[n - 1].last = std::max(ranges[n - 1].last, range.last);
+      } else {
+        ranges[n++] = range;
+      }
+    }
+    ranges.resize(n);
+  }
+
+  /* First range ending at or after value, searching from from on */
+  size_t Find(T value, size_t from) const
+  {
+    return std::lower_bound(ranges.begin() + from, ranges.end(), value,
+                            [](const Range& range, T v) {
+                              return range.last < v;
+                            }) -
+           ranges.begin();
+  }
+
+  bool Contains(T value) const
+  {
+    size_t i = Find(value, 0);
+    return i < ranges.size() && ranges[i].first <= value;
+  }
+
+  /* Mark all ranges ending before value done */
+  void SkipTo(T value) { cursor = Find(value, cursor); }
+
+  bool Done() const { return cursor >= ranges.size(); }
+};
+
+struct BsrCompiled {
+  BsrRanges<int32_t> FileIndex;
+  BsrRanges<uint32_t> sessid;
+  BsrRanges<uint64_t> voladdr;
+};
+
 struct BootStrapRecord {
   /* NOTE!!! next must be the first item */
   BootStrapRecord* next;   /* pointer to next one */
@@ -169,11 +237,14 @@ struct BootStrapRecord {
   char* fileregex; /* set if restore is filtered on filename */
   regex_t* fileregex_re;
   Attributes* attr; /* scratch space for unpacking */
+  BsrCompiled* compiled; /* ranges compiled on first use */
 };
 
 
 void CreateRestoreVolumeList(JobControlRecord* jcr);
 void FreeRestoreVolumeList(JobControlRecord* jcr);
+std::vector<std::vector<BootStrapRecord*>> SplitBsrIntoLanes(
+    BootStrapRecord* root);
 
 } /* namespace storagedaemon */
 
@@ -0,0 +1,508 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Storage daemon wide cache of chunks read from chunked volumes.
+ *
+ * Restore, copy and verify jobs reading the same chunked volume on
+ * different devices would otherwise each download the same chunks from
+ * the backing store. The cache keeps copies of the chunks read in an LRU
+ * list limited by ChunkCacheSize, chunks pushed out of memory are written
+ * to the ChunkCacheDirectory (limited by ChunkCacheDirectorySize) and read
+ * back from there instead of from the backing store.
+ */
+
+#include "include/bareos.h"
+#include "stored/stored.h"
+#include "stored/stored_globals.h"
+#include "stored/chunk_cache.h"
+#include "lib/berrno.h"
+
+namespace storagedaemon {
+
+enum ChunkCacheState
+{
+  CHUNK_IN_MEMORY, /* Data in buffer, on the memory LRU */
+  CHUNK_SPILLING,  /* Data in buffer, being written to the cache directory */
+  CHUNK_ON_DISK    /* Data in the cache directory, on the disk LRU */
+};
+
+struct ChunkCacheEntry {
+  std::string volname;
+  uint16_t chunk = 0;
+  uint32_t buflen = 0;
+  char* buffer = nullptr;
+  ChunkCacheState state = CHUNK_IN_MEMORY;
+  int refs = 0;         /* Threads using the buffer without holding the lock */
+  bool removed = false; /* Entry is no longer in the cache */
+  std::list<ChunkCacheEntry*>::iterator lru;
+};
+
+static pthread_mutex_t chunk_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static ChunkCache* chunk_cache = nullptr;
+
+static bool WriteCacheFile(const char* fname, const char* buffer, uint32_t len)
+{
+  int fd;
+  ssize_t status;
+
+  fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0600);
+  if (fd < 0) { return false; }
+
+  while (len > 0) {
+    status = write(fd, buffer, len);
+    if (status < 0 && errno == EINTR) { continue; }
+    if (status <= 0) {
+      close(fd);
+      return false;
+    }
+    buffer += status;
+    len -= status;
+  }
+
+  return close(fd) == 0;
+}
+
+static bool ReadCacheFile(int fd, char* buffer, uint32_t len)
+{
+  ssize_t status;
+
+  while (len > 0) {
+    status = read(fd, buffer, len);
+    if (status < 0 && errno == EINTR) { continue; }
+    if (status <= 0) { return false; }
+    buffer += status;
+    len -= status;
+  }
+
+  return true;
+}
+
+ChunkCache::ChunkCache(uint64_t memory_size,
+                       const char* directory,
+                       uint64_t directory_size)
+    : memory_size_(memory_size)
+    , directory_(nullptr)
+    , directory_size_(directory_size)
+{
+  pthread_mutex_init(&lock_, NULL);
+
+  if (directory && directory_size > 0) {
+    directory_ = strdup(directory);
+    RemoveStaleFiles();
+  }
+}
+
+ChunkCache::~ChunkCache()
+{
+  P(lock_);
+  while (!entries_.empty()) { Remove(entries_.begin()->second); }
+  V(lock_);
+
+  if (directory_) { free(directory_); }
+  pthread_mutex_destroy(&lock_);
+}
+
+void ChunkCache::CacheFileName(ChunkCacheEntry* entry, POOLMEM*& fname)
+{
+  Mmsg(fname, "%s/%s.%s@%04d.chunk", directory_, my_name,
+       entry->volname.c_str(), entry->chunk);
+}
+
+/*
+ * Remove the files of an earlier run of the daemon from the cache
+ * directory, we don't know whether they are still valid.
+ */
+void ChunkCache::RemoveStaleFiles()
+{
+  DIR* dp;
+  struct dirent* result;
+  int my_name_len = strlen(my_name);
+  PoolMem fname(PM_FNAME);
+
+  if (!(dp = opendir(directory_))) {
+    BErrNo be;
+
+    Jmsg2(NULL, M_WARNING, 0, _("Cannot open chunk cache directory %s: ERR=%s\n"),
+          directory_, be.bstrerror());
+    return;
+  }
+
+  while ((result = readdir(dp))) {
+    int len = strlen(result->d_name);
+
+    if (strncmp(result->d_name, my_name, my_name_len) != 0 || len < 6 ||
+        !bstrcmp(result->d_name + len - 6, ".chunk")) {
+      continue;
+    }
+    Mmsg(fname, "%s/%s", directory_, result->d_name);
+    Dmsg1(100, "Removing stale chunk cache file %s\n", fname.c_str());
+    unlink(fname.c_str());
+  }
+  closedir(dp);
+}
+
+/*
+ * Take an entry out of the cache, its buffer is released once the last
+ * thread copying from it is done. Called with the lock held.
+ */
+void ChunkCache::Remove(ChunkCacheEntry* entry)
+{
+  PoolMem fname(PM_FNAME);
+
+  entries_.erase(ChunkCacheKey(entry->volname, entry->chunk));
+  switch (entry->state) {
+    case CHUNK_IN_MEMORY:
+      memory_lru_.erase(entry->lru);
+      statistics_.memory_chunks--;
+      statistics_.memory_bytes -= entry->buflen;
+      break;
+    case CHUNK_ON_DISK:
+      disk_lru_.erase(entry->lru);
+      statistics_.disk_chunks--;
+      statistics_.disk_bytes -= entry->buflen;
+      CacheFileName(entry, fname.addr());
+      unlink(fname.c_str());
+      break;
+    case CHUNK_SPILLING:
+      /*
+       * Spill() removes the file when it sees the entry was removed.
+       */
+      break;
+  }
+  entry->removed = true;
+
+  if (entry->refs == 0) {
+    if (entry->buffer) { free(entry->buffer); }
+    delete entry;
+  }
+}
+
+/*
+ * Drop a reference to the buffer of an entry. Called with the lock held.
+ */
+void ChunkCache::Unref(ChunkCacheEntry* entry)
+{
+  if (--entry->refs > 0) { return; }
+
+  if (entry->removed) {
+    if (entry->buffer) { free(entry->buffer); }
+    delete entry;
+  } else if (entry->state == CHUNK_ON_DISK && entry->buffer) {
+    free(entry->buffer);
+    entry->buffer = nullptr;
+  }
+}
+
+void ChunkCache::EvictFromDisk()
+{
+  while (statistics_.disk_bytes > directory_size_ && !disk_lru_.empty()) {
+    statistics_.evictions++;
+    Remove(disk_lru_.back());
+  }
+}
+
+/*
+ * Push the least recently used chunks out of memory until the cache is
+ * within its budget again. Chunks that should go to the cache directory
+ * are returned in spill, the caller writes them without holding the lock.
+ * Called with the lock held.
+ */
+void ChunkCache::EvictFromMemory(std::list<ChunkCacheEntry*>& spill)
+{
+  auto it = memory_lru_.end();
+
+  while (statistics_.memory_bytes > memory_size_ &&
+         it != memory_lru_.begin()) {
+    ChunkCacheEntry* entry = *--it;
+
+    /*
+     * Somebody is copying the data, try the next one.
+     */
+    if (entry->refs > 0) { continue; }
+
+    ++it;
+    if (directory_ && entry->buflen <= directory_size_) {
+      memory_lru_.erase(entry->lru);
+      statistics_.memory_chunks--;
+      statistics_.memory_bytes -= entry->buflen;
+      entry->state = CHUNK_SPILLING;
+      entry->refs++;
+      spill.push_back(entry);
+    } else {
+      statistics_.evictions++;
+      Remove(entry);
+    }
+  }
+}
+
+/*
+ * Write a chunk pushed out of memory to the cache directory.
+ */
+void ChunkCache::Spill(ChunkCacheEntry* entry)
+{
+  bool ok;
+  PoolMem fname(PM_FNAME);
+
+  CacheFileName(entry, fname.addr());
+  ok = WriteCacheFile(fname.c_str(), entry->buffer, entry->buflen);
+  if (!ok) {
+    BErrNo be;
+
+    Dmsg2(100, "Failed to write chunk cache file %s: ERR=%s\n", fname.c_str(),
+          be.bstrerror());
+  }
+
+  P(lock_);
+  if (entry->removed || !ok) {
+    unlink(fname.c_str());
+    if (!entry->removed) {
+      statistics_.evictions++;
+      Remove(entry);
+    }
+  } else {
+    entry->state = CHUNK_ON_DISK;
+    disk_lru_.push_front(entry);
+    entry->lru = disk_lru_.begin();
+    statistics_.disk_chunks++;
+    statistics_.disk_bytes += entry->buflen;
+    EvictFromDisk();
+  }
+  Unref(entry);
+  V(lock_);
+}
+
+/*
+ * Return a token to hand to Put() for data read from the backing store
+ * after calling this.
+ */
+uint64_t ChunkCache::Generation()
+{
+  uint64_t generation;
+
+  P(lock_);
+  generation = generation_;
+  V(lock_);
+
+  return generation;
+}
+
+/*
+ * Copy a chunk from the cache into buffer.
+ */
+bool ChunkCache::Get(const char* volname,
+                     uint16_t chunk,
+                     char* buffer,
+                     uint32_t buffer_size,
+                     uint32_t* buflen)
+{
+  int fd;
+  bool ok;
+  uint32_t len;
+  uint64_t generation;
+  ChunkCacheEntry* entry;
+  PoolMem fname(PM_FNAME);
+
+  P(lock_);
+  auto it = entries_.find(ChunkCacheKey(volname, chunk));
+  if (it == entries_.end() || it->second->buflen > buffer_size) {
+    statistics_.misses++;
+    V(lock_);
+    return false;
+  }
+
+  entry = it->second;
+  len = entry->buflen;
+  switch (entry->state) {
+    case CHUNK_IN_MEMORY:
+      memory_lru_.splice(memory_lru_.begin(), memory_lru_, entry->lru);
+      /* FALLTHROUGH */
+    case CHUNK_SPILLING:
+      entry->refs++;
+      V(lock_);
+
+      memcpy(buffer, entry->buffer, len);
+
+      P(lock_);
+      statistics_.hits++;
+      Unref(entry);
+      V(lock_);
+      break;
+    case CHUNK_ON_DISK:
+      /*
+       * The open file stays readable when the entry gets evicted
+       * meanwhile.
+       */
+      CacheFileName(entry, fname.addr());
+      fd = open(fname.c_str(), O_RDONLY | O_BINARY);
+      if (fd < 0) {
+        statistics_.misses++;
+        Remove(entry);
+        V(lock_);
+        return false;
+      }
+      generation = generation_;
+      V(lock_);
+
+      ok = ReadCacheFile(fd, buffer, len);
+      close(fd);
+
+      P(lock_);
+      if (ok) {
+        statistics_.disk_hits++;
+      } else {
+        statistics_.misses++;
+      }
+      V(lock_);
+
+      if (!ok) { return false; }
+
+      /*
+       * Move the chunk back into memory.
+       */
+      Put(volname, chunk, buffer, len, generation);
+      break;
+  }
+
+  *buflen = len;
+  Dmsg2(200, "Chunk cache hit for chunk %d of volume %s\n", chunk, volname);
+
+  return true;
+}
+
+/*
+ * Add a chunk read from the backing store to the cache. Nothing is added
+ * when the cache was invalidated since generation was taken.
+ */
+void ChunkCache::Put(const char* volname,
+                     uint16_t chunk,
+                     const char* buffer,
+                     uint32_t buflen,
+                     uint64_t generation)
+{
+  char* data;
+  ChunkCacheEntry* entry;
+  std::list<ChunkCacheEntry*> spill;
+
+  if (buflen == 0 || buflen > memory_size_) { return; }
+
+  data = (char*)malloc(buflen);
+  memcpy(data, buffer, buflen);
+
+  P(lock_);
+  if (generation != generation_) {
+    V(lock_);
+    free(data);
+    return;
+  }
+
+  auto it = entries_.find(ChunkCacheKey(volname, chunk));
+  if (it != entries_.end()) {
+    if (it->second->state != CHUNK_ON_DISK) {
+      V(lock_);
+      free(data);
+      return;
+    }
+    Remove(it->second);
+  }
+
+  entry = new ChunkCacheEntry;
+  entry->volname = volname;
+  entry->chunk = chunk;
+  entry->buflen = buflen;
+  entry->buffer = data;
+  memory_lru_.push_front(entry);
+  entry->lru = memory_lru_.begin();
+  entries_[ChunkCacheKey(volname, chunk)] = entry;
+  statistics_.memory_chunks++;
+  statistics_.memory_bytes += buflen;
+
+  EvictFromMemory(spill);
+  V(lock_);
+
+  for (ChunkCacheEntry* spilled : spill) { Spill(spilled); }
+}
+
+/*
+ * Forget about a chunk, called when it gets written.
+ */
+void ChunkCache::Invalidate(const char* volname, uint16_t chunk)
+{
+  P(lock_);
+  generation_++;
+  auto it = entries_.find(ChunkCacheKey(volname, chunk));
+  if (it != entries_.end()) { Remove(it->second); }
+  V(lock_);
+}
+
+/*
+ * Forget about all chunks of a volume, called when it gets truncated.
+ */
+void ChunkCache::InvalidateVolume(const char* volname)
+{
+  P(lock_);
+  generation_++;
+  auto it = entries_.lower_bound(ChunkCacheKey(volname, 0));
+  while (it != entries_.end() && it->first.first == volname) {
+    ChunkCacheEntry* entry = it->second;
+
+    ++it;
+    Remove(entry);
+  }
+  V(lock_);
+}
+
+void ChunkCache::GetStatistics(ChunkCacheStatistics& statistics)
+{
+  P(lock_);
+  statistics = statistics_;
+  V(lock_);
+}
+
+/*
+ * Get the chunk cache of the daemon, NULL when none is configured.
+ */
+ChunkCache* GetChunkCache()
+{
+  if (!me || me->chunk_cache_size == 0) { return nullptr; }
+
+  P(chunk_cache_lock);
+  if (!chunk_cache) {
+    chunk_cache =
+        new ChunkCache(me->chunk_cache_size, me->chunk_cache_directory,
+                       me->chunk_cache_directory_size);
+  }
+  V(chunk_cache_lock);
+
+  return chunk_cache;
+}
+
+void FreeChunkCache()
+{
+  P(chunk_cache_lock);
+  if (chunk_cache) {
+    delete chunk_cache;
+    chunk_cache = nullptr;
+  }
+  V(chunk_cache_lock);
+}
+
+} /* namespace storagedaemon */
@@ -0,0 +1,106 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Storage daemon wide cache of chunks read from chunked volumes.
+ */
+
+#ifndef BAREOS_STORED_CHUNK_CACHE_H_
+#define BAREOS_STORED_CHUNK_CACHE_H_
+
+#include <list>
+#include <map>
+#include <string>
+
+namespace storagedaemon {
+
+struct ChunkCacheEntry;
+
+struct ChunkCacheStatistics {
+  uint64_t hits = 0;          /**< Chunks served from memory */
+  uint64_t disk_hits = 0;     /**< Chunks served from the cache directory */
+  uint64_t misses = 0;        /**< Chunks not in the cache */
+  uint64_t evictions = 0;     /**< Chunks dropped from the cache */
+  uint64_t memory_chunks = 0; /**< Chunks currently held in memory */
+  uint64_t memory_bytes = 0;  /**< Bytes currently held in memory */
+  uint64_t disk_chunks = 0;   /**< Chunks currently in the cache directory */
+  uint64_t disk_bytes = 0;    /**< Bytes currently in the cache directory */
+};
+
+/*
+ * LRU cache of chunks keyed by volume name and chunk number, shared by all
+ * chunked devices of the storage daemon. Chunks pushed out of memory are
+ * kept in the cache directory when one is configured.
+ *
+ * A reader takes a Generation() before reading a chunk from the backing
+ * store and hands it to Put(), so data read while the chunk got invalidated
+ * by a writer never ends up in the cache.
+ */
+class ChunkCache {
+ public:
+  ChunkCache(uint64_t memory_size,
+             const char* directory = nullptr,
+             uint64_t directory_size = 0);
+  ~ChunkCache();
+
+  uint64_t Generation();
+  bool Get(const char* volname,
+           uint16_t chunk,
+           char* buffer,
+           uint32_t buffer_size,
+           uint32_t* buflen);
+  void Put(const char* volname,
+           uint16_t chunk,
+           const char* buffer,
+           uint32_t buflen,
+           uint64_t generation);
+  void Invalidate(const char* volname, uint16_t chunk);
+  void InvalidateVolume(const char* volname);
+  void GetStatistics(ChunkCacheStatistics& statistics);
+
+ private:
+  typedef std::pair<std::string, uint16_t> ChunkCacheKey;
+
+  void CacheFileName(ChunkCacheEntry* entry, POOLMEM*& fname);
+  void Remove(ChunkCacheEntry* entry);
+  void Unref(ChunkCacheEntry* entry);
+  void EvictFromDisk();
+  void EvictFromMemory(std::list<ChunkCacheEntry*>& spill);
+  void Spill(ChunkCacheEntry* entry);
+  void RemoveStaleFiles();
+
+  uint64_t memory_size_;
+  char* directory_;
+  uint64_t directory_size_;
+  uint64_t generation_ = 0;
+  std::map<ChunkCacheKey, ChunkCacheEntry*> entries_;
+  std::list<ChunkCacheEntry*> memory_lru_; /**< Most recently used first */
+  std::list<ChunkCacheEntry*> disk_lru_;   /**< Most recently used first */
+  ChunkCacheStatistics statistics_;
+  pthread_mutex_t lock_;
+};
+
+ChunkCache* GetChunkCache();
+void FreeChunkCache();
+
+} /* namespace storagedaemon */
+
+#endif /* BAREOS_STORED_CHUNK_CACHE_H_ */
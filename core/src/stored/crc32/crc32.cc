@@ -512,9 +512,52 @@ uint32_t crc32_16bytes_prefetch(const void* data, size_t length, uint32_t previo
 #endif
 
 
+typedef uint32_t (*Crc32Function)(const void* data, size_t length, uint32_t previousCrc32);
+
+/// select a hardware accelerated algorithm (if any) by looking at the CPU features
+static Crc32Function crc32_accelerated()
+{
+#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
+  // the accelerated kernels use crc32_16bytes for short buffers and tails
+  if (crc32_vpclmul_supported())
+    return crc32_vpclmul;
+  if (crc32_pclmul_supported())
+    return crc32_pclmul;
+#endif
+  return NULL;
+}
+
+/// CPU features are only checked once at startup
+static const Crc32Function Crc32Accelerated = crc32_accelerated();
+
+
+/// name of the algorithm crc32_fast uses on this CPU
+const char* crc32_fast_name()
+{
+  if (Crc32Accelerated == crc32_vpclmul)
+    return "vpclmulqdq";
+  if (Crc32Accelerated == crc32_pclmul)
+    return "pclmulqdq";
+#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
+  return "slicing-by-16";
+#elif defined(CRC32_USE_LOOKUP_TABLE_SLICING_BY_8)
+  return "slicing-by-8";
+#elif defined(CRC32_USE_LOOKUP_TABLE_SLICING_BY_4)
+  return "slicing-by-4";
+#elif defined(CRC32_USE_LOOKUP_TABLE_BYTE)
+  return "1byte";
+#else
+  return "halfbyte";
+#endif
+}
+
+
 /// compute CRC32 using the fastest algorithm for large datasets on modern CPUs
 uint32_t crc32_fast(const void* data, size_t length, uint32_t previousCrc32)
 {
+  if (Crc32Accelerated)
+    return Crc32Accelerated(data, length, previousCrc32);
+
 #ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
   return crc32_16bytes (data, length, previousCrc32);
 #elif defined(CRC32_USE_LOOKUP_TABLE_SLICING_BY_8)
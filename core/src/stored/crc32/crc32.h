@@ -64,3 +64,15 @@ uint32_t crc32_16bytes (const void* data, size_t length, uint32_t previousCrc32
 /// compute CRC32 (Slicing-by-16 algorithm, prefetch upcoming data blocks)
 uint32_t crc32_16bytes_prefetch(const void* data, size_t length, uint32_t previousCrc32 = 0, size_t prefetchAhead = 256);
 #endif
+
+/// name of the algorithm crc32_fast uses on this CPU
+const char* crc32_fast_name();
+
+/// true if crc32_pclmul can be used on this CPU (x86-64 with PCLMULQDQ and SSE4.1)
+bool crc32_pclmul_supported();
+/// true if crc32_vpclmul can be used on this CPU (x86-64 with AVX-512 VPCLMULQDQ)
+bool crc32_vpclmul_supported();
+/// compute CRC32 (carry-less multiplication folding, 4x128 bit lanes)
+uint32_t crc32_pclmul  (const void* data, size_t length, uint32_t previousCrc32 = 0);
+/// compute CRC32 (carry-less multiplication folding, 4x512 bit lanes)
+uint32_t crc32_vpclmul (const void* data, size_t length, uint32_t previousCrc32 = 0);
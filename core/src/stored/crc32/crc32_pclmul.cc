@@ -0,0 +1,321 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * CRC32 (zlib polynomial) using carry-less multiplication.
+ *
+ * The folding approach is described in "Fast CRC Computation for Generic
+ * Polynomials Using PCLMULQDQ Instruction" (Intel, 2009). The data is folded
+ * in 4 parallel 128 bit lanes (PCLMULQDQ) or 4 parallel 512 bit lanes
+ * (AVX-512 VPCLMULQDQ), reduced to 64 bits and finally Barrett reduced to
+ * the 32 bit CRC. Tails that are not a multiple of 16 bytes are handled by
+ * the table driven algorithm crc32_fast() falls back to, so all variants
+ * return exactly what crc32_bitwise() returns.
+ *
+ * The kernels are compiled with function specific target attributes so no
+ * special compiler flags are needed, crc32_fast() selects the kernel at
+ * runtime based on CPUID.
+ */
+
+#include "crc32.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CRC32_HAVE_PCLMUL
+#if defined(__clang__) || __GNUC__ >= 8
+#define CRC32_HAVE_VPCLMUL
+#endif
+#endif
+
+#ifdef CRC32_HAVE_PCLMUL
+#include <cpuid.h>
+#include <immintrin.h>
+
+/*
+ * Fold constants in the bit-reflected domain, x^(D+32) mod P and
+ * x^(D-32) mod P for a fold distance of D bits.
+ */
+static const uint64_t k1k2[2] __attribute__((aligned(16))) = {
+    0x0154442bd4, 0x01c6e41596}; /* D = 512 */
+static const uint64_t k3k4[2] __attribute__((aligned(16))) = {
+    0x01751997d0, 0x00ccaa009e}; /* D = 128 */
+static const uint64_t k5k0[2] __attribute__((aligned(16))) = {
+    0x0163cd6124, 0x0000000000}; /* x^64 mod P */
+static const uint64_t poly[2] __attribute__((aligned(16))) = {
+    0x01db710641, 0x01f7011641}; /* P' and Barrett constant u */
+#ifdef CRC32_HAVE_VPCLMUL
+static const uint64_t k2048[2] __attribute__((aligned(16))) = {
+    0x011542778a, 0x01322d1430}; /* D = 2048 */
+#endif
+
+#define CRC32_PCLMUL_TARGET __attribute__((target("pclmul,sse4.1")))
+#define CRC32_VPCLMUL_TARGET \
+  __attribute__((target("avx512f,avx512vl,vpclmulqdq,pclmul,sse4.1")))
+
+/*
+ * Fold 128 bits of state x forward by the distance encoded in k and add
+ * the data in y.
+ */
+CRC32_PCLMUL_TARGET static inline __m128i fold_128(__m128i x,
+                                                   __m128i k,
+                                                   __m128i y)
+{
+  __m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+  __m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+
+  return _mm_xor_si128(_mm_xor_si128(hi, lo), y);
+}
+
+/*
+ * Process length bytes (length >= 64 and a multiple of 16) using 4 lanes
+ * of 128 bit state (x1 .. x4) which already contain the first 64 bytes.
+ * Returns the raw (not inverted) CRC.
+ */
+CRC32_PCLMUL_TARGET static uint32_t crc32_pclmul_lanes(const uint8_t* buf,
+                                                       size_t length,
+                                                       __m128i x1,
+                                                       __m128i x2,
+                                                       __m128i x3,
+                                                       __m128i x4)
+{
+  __m128i x0, mask;
+
+  /*
+   * Parallel fold blocks of 64, if any.
+   */
+  x0 = _mm_load_si128((const __m128i*)k1k2);
+  while (length >= 64) {
+    x1 = fold_128(x1, x0, _mm_loadu_si128((const __m128i*)(buf + 0x00)));
+    x2 = fold_128(x2, x0, _mm_loadu_si128((const __m128i*)(buf + 0x10)));
+    x3 = fold_128(x3, x0, _mm_loadu_si128((const __m128i*)(buf + 0x20)));
+    x4 = fold_128(x4, x0, _mm_loadu_si128((const __m128i*)(buf + 0x30)));
+    buf += 64;
+    length -= 64;
+  }
+
+  /*
+   * Fold into 128 bits.
+   */
+  x0 = _mm_load_si128((const __m128i*)k3k4);
+  x1 = fold_128(x1, x0, x2);
+  x1 = fold_128(x1, x0, x3);
+  x1 = fold_128(x1, x0, x4);
+
+  /*
+   * Single fold blocks of 16, if any.
+   */
+  while (length >= 16) {
+    x1 = fold_128(x1, x0, _mm_loadu_si128((const __m128i*)buf));
+    buf += 16;
+    length -= 16;
+  }
+
+  /*
+   * Fold 128 bits to 64 bits.
+   */
+  x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+  mask = _mm_setr_epi32(~0, 0, ~0, 0);
+  x1 = _mm_srli_si128(x1, 8);
+  x1 = _mm_xor_si128(x1, x2);
+
+  x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, mask);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  /*
+   * Barrett reduce to 32 bits.
+   */
+  x0 = _mm_load_si128((const __m128i*)poly);
+  x2 = _mm_and_si128(x1, mask);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+  x2 = _mm_and_si128(x2, mask);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  return _mm_extract_epi32(x1, 1);
+}
+
+CRC32_PCLMUL_TARGET static uint32_t crc32_pclmul_kernel(const uint8_t* buf,
+                                                        size_t length,
+                                                        uint32_t crc)
+{
+  __m128i x1, x2, x3, x4;
+
+  x1 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+  x2 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+  x3 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+  x4 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+
+  return crc32_pclmul_lanes(buf + 64, length - 64, x1, x2, x3, x4);
+}
+
+#ifdef CRC32_HAVE_VPCLMUL
+CRC32_VPCLMUL_TARGET static inline __m512i fold_512(__m512i x,
+                                                    __m512i k,
+                                                    __m512i y)
+{
+  __m512i lo = _mm512_clmulepi64_epi128(x, k, 0x00);
+  __m512i hi = _mm512_clmulepi64_epi128(x, k, 0x11);
+
+  /*
+   * 0x96 is a three way xor: hi ^ lo ^ y
+   */
+  return _mm512_ternarylogic_epi64(hi, lo, y, 0x96);
+}
+
+CRC32_VPCLMUL_TARGET static uint32_t crc32_vpclmul_kernel(const uint8_t* buf,
+                                                          size_t length,
+                                                          uint32_t crc)
+{
+  __m512i z0, z1, z2, z3, z4;
+
+  z1 = _mm512_loadu_si512((const void*)(buf + 0x00));
+  z2 = _mm512_loadu_si512((const void*)(buf + 0x40));
+  z3 = _mm512_loadu_si512((const void*)(buf + 0x80));
+  z4 = _mm512_loadu_si512((const void*)(buf + 0xc0));
+  z1 = _mm512_xor_si512(
+      z1, _mm512_inserti32x4(_mm512_setzero_si512(), _mm_cvtsi32_si128(crc),
+                             0));
+  buf += 256;
+  length -= 256;
+
+  /*
+   * Parallel fold blocks of 256, if any.
+   */
+  z0 = _mm512_broadcast_i32x4(_mm_load_si128((const __m128i*)k2048));
+  while (length >= 256) {
+    z1 = fold_512(z1, z0, _mm512_loadu_si512((const void*)(buf + 0x00)));
+    z2 = fold_512(z2, z0, _mm512_loadu_si512((const void*)(buf + 0x40)));
+    z3 = fold_512(z3, z0, _mm512_loadu_si512((const void*)(buf + 0x80)));
+    z4 = fold_512(z4, z0, _mm512_loadu_si512((const void*)(buf + 0xc0)));
+    buf += 256;
+    length -= 256;
+  }
+
+  /*
+   * Fold into 512 bits, which are exactly the 4 lanes of 128 bits
+   * the PCLMULQDQ kernel works with.
+   */
+  z0 = _mm512_broadcast_i32x4(_mm_load_si128((const __m128i*)k1k2));
+  z1 = fold_512(z1, z0, z2);
+  z1 = fold_512(z1, z0, z3);
+  z1 = fold_512(z1, z0, z4);
+
+  return crc32_pclmul_lanes(buf, length, _mm512_extracti32x4_epi32(z1, 0),
+                            _mm512_extracti32x4_epi32(z1, 1),
+                            _mm512_extracti32x4_epi32(z1, 2),
+                            _mm512_extracti32x4_epi32(z1, 3));
+}
+#endif /* CRC32_HAVE_VPCLMUL */
+#endif /* CRC32_HAVE_PCLMUL */
+
+/// true if the CPU supports PCLMULQDQ and SSE4.1
+bool crc32_pclmul_supported()
+{
+#ifdef CRC32_HAVE_PCLMUL
+  unsigned int eax, ebx, ecx, edx;
+
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) { return false; }
+  return (ecx & bit_PCLMUL) && (ecx & bit_SSE4_1);
+#else
+  return false;
+#endif
+}
+
+/// true if the CPU and the OS support AVX-512 VPCLMULQDQ
+bool crc32_vpclmul_supported()
+{
+#ifdef CRC32_HAVE_VPCLMUL
+  unsigned int eax, ebx, ecx, edx;
+  unsigned int xcr0_lo, xcr0_hi;
+
+  if (!crc32_pclmul_supported()) { return false; }
+
+  /*
+   * The OS must save the opmask and the full zmm registers (XCR0 bits
+   * 1, 2, 5, 6 and 7) on a context switch.
+   */
+  __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+  if (!(ecx & bit_OSXSAVE)) { return false; }
+  __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+  if ((xcr0_lo & 0xe6) != 0xe6) { return false; }
+
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) { return false; }
+  return (ebx & bit_AVX512F) && (ebx & bit_AVX512VL) && (ecx & (1 << 10));
+#else
+  return false;
+#endif
+}
+
+/*
+ * The table driven algorithm used for data the kernels do not fold.
+ * crc32_fast() itself may dispatch to the kernels, so it is not used here.
+ */
+static uint32_t crc32_table(const void* data,
+                            size_t length,
+                            uint32_t previousCrc32)
+{
+#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
+  return crc32_16bytes(data, length, previousCrc32);
+#elif defined(CRC32_USE_LOOKUP_TABLE_SLICING_BY_8)
+  return crc32_8bytes(data, length, previousCrc32);
+#elif defined(CRC32_USE_LOOKUP_TABLE_SLICING_BY_4)
+  return crc32_4bytes(data, length, previousCrc32);
+#elif defined(CRC32_USE_LOOKUP_TABLE_BYTE)
+  return crc32_1byte(data, length, previousCrc32);
+#else
+  return crc32_halfbyte(data, length, previousCrc32);
+#endif
+}
+
+/// compute CRC32 using PCLMULQDQ, requires crc32_pclmul_supported()
+uint32_t crc32_pclmul(const void* data, size_t length, uint32_t previousCrc32)
+{
+#ifdef CRC32_HAVE_PCLMUL
+  const uint8_t* buf = (const uint8_t*)data;
+  size_t folded = length & ~(size_t)15;
+
+  if (length < 64) { return crc32_table(data, length, previousCrc32); }
+
+  uint32_t crc = crc32_pclmul_kernel(buf, folded, ~previousCrc32);
+  return crc32_table(buf + folded, length - folded, ~crc);
+#else
+  return crc32_table(data, length, previousCrc32);
+#endif
+}
+
+/// compute CRC32 using VPCLMULQDQ, requires crc32_vpclmul_supported()
+uint32_t crc32_vpclmul(const void* data, size_t length, uint32_t previousCrc32)
+{
+#ifdef CRC32_HAVE_VPCLMUL
+  const uint8_t* buf = (const uint8_t*)data;
+  size_t folded = length & ~(size_t)15;
+
+  if (length < 256) { return crc32_pclmul(data, length, previousCrc32); }
+
+  uint32_t crc = crc32_vpclmul_kernel(buf, folded, ~previousCrc32);
+  return crc32_table(buf + folded, length - folded, ~crc);
+#else
+  return crc32_pclmul(data, length, previousCrc32);
+#endif
+}
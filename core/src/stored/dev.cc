@@ -107,6 +107,11 @@
 #else
 #include "backends/unix_tape_device.h"
 #include "backends/unix_fifo_device.h"
+#include "backends/chunked_device.h"
+#include "backends/chunkdir_device.h"
+#ifdef HAVE_LMDB
+#include "backends/dedup_device.h"
+#endif
 #endif
 #endif /* HAVE_DYNAMIC_SD_BACKENDS */
 
@@ -225,6 +230,14 @@ static inline Device* init_dev(JobControlRecord* jcr,
     case B_FIFO_DEV:
       dev = new unix_fifo_device;
       break;
+    case B_CHUNKDIR_DEV:
+      dev = new chunkdir_device;
+      break;
+#ifdef HAVE_LMDB
+    case B_DEDUP_DEV:
+      dev = new dedup_device;
+      break;
+#endif
 #endif
 #endif /* HAVE_DYNAMIC_SD_BACKENDS */
 #ifdef HAVE_WIN32
@@ -672,6 +685,8 @@ bool Device::open(DeviceControlRecord* dcr, int omode)
 
   Dmsg2(100, "preserve=%08o fd=%d\n", preserve, fd_);
 
+  if (fd_ >= 0) { BlockIndexOpenVolume(this); }
+
   return fd_ >= 0;
 }
 
@@ -1010,6 +1025,29 @@ void Device::ClearVolhdr()
   setVolCatInfo(false);
 }
 
+/**
+ * Truncate the volume, its block index describes blocks that are gone.
+ */
+bool Device::truncate(DeviceControlRecord* dcr)
+{
+  BlockIndexRemove(this, dcr ? dcr->jcr : NULL);
+  return d_truncate(dcr);
+}
+
+/**
+ * Flush the data written to stable storage.
+ */
+bool Device::flush(DeviceControlRecord* dcr)
+{
+  bool retval;
+  btime_t start = GetCurrentBtime();
+
+  retval = d_flush(dcr);
+  latencies.Record(DeviceLatencyKind::kSync, GetCurrentBtime() - start);
+
+  return retval;
+}
+
 /**
  * Close the device.
  */
@@ -1070,6 +1108,7 @@ bool Device::close(DeviceControlRecord* dcr)
   file_addr = 0;
   EndFile = EndBlock = 0;
   open_mode = 0;
+  block_index.Close();
   ClearVolhdr();
   VolCatInfo = VolumeCatalogInfo{};
   if (tid) {
@@ -1232,6 +1271,7 @@ ssize_t Device::read(void* buf, size_t len)
 
   DevReadTime += last_tick;
   VolCatInfo.VolReadTime += last_tick;
+  latencies.Record(DeviceLatencyKind::kBlockRead, last_tick);
 
   if (read_len > 0) { /* skip error */
     DevReadBytes += read_len;
@@ -1255,6 +1295,31 @@ ssize_t Device::write(const void* buf, size_t len)
 
   DevWriteTime += last_tick;
   VolCatInfo.VolWriteTime += last_tick;
+  latencies.Record(DeviceLatencyKind::kBlockWrite, last_tick);
+
+  if (write_len > 0) { /* skip error */
+    DevWriteBytes += write_len;
+  }
+
+  return write_len;
+}
+
+/**
+ * Write a block described by an iovec, only used on devices with CAP_WRITEV.
+ */
+ssize_t Device::writev(const struct iovec* iov, int iovcnt)
+{
+  ssize_t write_len;
+
+  GetTimerCount();
+
+  write_len = d_writev(fd_, iov, iovcnt);
+
+  last_tick = GetTimerCount();
+
+  DevWriteTime += last_tick;
+  VolCatInfo.VolWriteTime += last_tick;
+  latencies.Record(DeviceLatencyKind::kBlockWrite, last_tick);
 
   if (write_len > 0) { /* skip error */
     DevWriteBytes += write_len;
@@ -65,9 +65,15 @@
 #include "stored/record.h"
 #include "stored/lock.h"
 #include "stored/block.h"
+#include "stored/block_index.h"
+#include "stored/latency_histogram.h"
 #include "lib/bsys.h"
 
+#include <atomic>
+#include <vector>
+
 class dlist;
+struct iovec;
 
 namespace storagedaemon {
 
@@ -109,7 +115,9 @@ enum
   B_DROPLET_DEV,
   B_RADOS_DEV,
   B_CEPHFS_DEV,
-  B_ELASTO_DEV
+  B_ELASTO_DEV,
+  B_CHUNKDIR_DEV,
+  B_DEDUP_DEV
 };
 
 /**
@@ -181,13 +189,14 @@ enum
   CAP_BLOCKCHECKSUM = 23,  /**< Create/test block checksum */
   CAP_IOERRATEOM = 24,     /**< IOError at EOM */
   CAP_IBMLINTAPE = 25,     /**< Using IBM lin_tape driver */
-  CAP_ADJWRITESIZE = 26    /**< Adjust write size to min/max */
+  CAP_ADJWRITESIZE = 26,   /**< Adjust write size to min/max */
+  CAP_WRITEV = 27          /**< Can write a block from an iovec */
 };
 
 /**
  * Keep this set to the last entry in the enum.
  */
-constexpr int CAP_MAX = CAP_ADJWRITESIZE;
+constexpr int CAP_MAX = CAP_WRITEV;
 
 /**
  * Make sure you have enough bits to store all above bit fields.
@@ -275,6 +284,7 @@ class DeviceResource;        /* Forward reference Device resource defined in
                                 stored_conf.h */
 class DeviceControlRecord;   /* Forward reference */
 class VolumeReservationItem; /* Forward reference */
+class AppendWriter;          /* Forward reference */
 
 /**
  * Device specific status information either returned via Device::DeviceStatus()
@@ -347,6 +357,8 @@ class Device {
   uint32_t file = 0;           /**< Current file number base 0 */
   uint64_t file_addr = 0;      /**< Current file read/write address */
   uint64_t file_size = 0;      /**< Current file size */
+  uint64_t read_end_addr = 0;  /**< Last address a read wants, 0 if unknown */
+  VolumeBlockIndex block_index; /**< Block index of the mounted volume */
   uint32_t EndBlock = 0;       /**< Last block written */
   uint32_t EndFile = 0;        /**< Last file written */
   uint32_t min_block_size = 0; /**< Min block size currently set */
@@ -389,6 +401,8 @@ class Device {
   btime_t DevWriteTime = 0;
   uint64_t DevWriteBytes = 0;
   uint64_t DevReadBytes = 0;
+  DeviceLatencies latencies; /**< Latency histograms of the I/O */
+  std::atomic<uint32_t> streaming_underruns{0}; /**< Streaming buffer ran dry */
 
   /* Methods */
   btime_t GetTimerCount(); /**< Return the last timer interval (ms) */
@@ -405,7 +419,8 @@ class Device {
   {
     return (dev_type == B_FILE_DEV || dev_type == B_GFAPI_DEV ||
             dev_type == B_DROPLET_DEV || dev_type == B_RADOS_DEV ||
-            dev_type == B_CEPHFS_DEV || dev_type == B_ELASTO_DEV);
+            dev_type == B_CEPHFS_DEV || dev_type == B_ELASTO_DEV ||
+            dev_type == B_CHUNKDIR_DEV || dev_type == B_DEDUP_DEV);
   }
   bool IsFifo() const { return dev_type == B_FIFO_DEV; }
   bool IsVtl() const { return dev_type == B_VTL_DEV; }
@@ -511,6 +526,7 @@ class Device {
   void term();
   ssize_t read(void* buf, size_t len);
   ssize_t write(const void* buf, size_t len);
+  ssize_t writev(const struct iovec* iov, int iovcnt);
   bool mount(DeviceControlRecord* dcr, int timeout);
   bool unmount(DeviceControlRecord* dcr, int timeout);
   void EditMountCodes(PoolMem& omsg, const char* imsg);
@@ -568,8 +584,8 @@ class Device {
   {
     return d_lseek(dcr, offset, whence);
   }
-  bool truncate(DeviceControlRecord* dcr) { return d_truncate(dcr); }
-  bool flush(DeviceControlRecord* dcr) { return d_flush(dcr); };
+  bool truncate(DeviceControlRecord* dcr);
+  bool flush(DeviceControlRecord* dcr);
 
   /*
    * Low level operations
@@ -579,6 +595,11 @@ class Device {
   virtual int d_close(int fd) = 0;
   virtual ssize_t d_read(int fd, void* buffer, size_t count) = 0;
   virtual ssize_t d_write(int fd, const void* buffer, size_t count) = 0;
+  virtual ssize_t d_writev(int fd, const struct iovec* iov, int iovcnt)
+  {
+    errno = ENOSYS;
+    return -1;
+  };
   virtual boffset_t d_lseek(DeviceControlRecord* dcr,
                             boffset_t offset,
                             int whence) = 0;
@@ -674,8 +695,16 @@ class DeviceControlRecord {
   DeviceRecord* before_rec =
       nullptr; /**< Pointer to record before translation */
   DeviceRecord* after_rec = nullptr; /**< Pointer to record after translation */
+  AppendWriter* append_writer =
+      nullptr;                       /**< Asynchronous block writer if any */
+  bool (*deferred_record_written)(JobControlRecord* jcr, DeviceRecord* rec) =
+      nullptr; /**< Set to allow deferred write translation, see record.cc */
+  bool record_deferred = false;      /**< Set by a plugin that queued a record */
+  bool drain_deferred = false;       /**< Flush waits for all queued records */
   pthread_t tid = 0;                 /**< Thread running this dcr */
   int spool_fd = 0;                  /**< Fd if spooling */
+  std::vector<int> spool_fds;        /**< Fds of all spool stripes */
+  int spool_stripe = 0;              /**< Stripe spool_fd belongs to */
   bool spool_data = false;           /**< Set to spool data */
   bool spooling = false;             /**< Set when actually spooling */
   bool despooling = false;           /**< Set when despooling */
@@ -774,6 +803,13 @@ class DeviceControlRecord {
    * Methods in record.c
    */
   bool WriteRecord();
+  bool WriteDeferredRecords(bool drain);
+  bool WriteRecordFragment(FragmentPacker* packer, RecordFragment* frag);
+
+ private:
+  bool WriteTranslatedRecord(DeviceRecord* trec);
+
+ public:
 
   /*
    * Methods in reserve.c
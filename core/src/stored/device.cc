@@ -313,10 +313,11 @@ BootStrapRecord* PositionDeviceToFirstFile(JobControlRecord* jcr,
    * Now find and position to first file and block
    *   on this tape.
    */
+  dev->read_end_addr = GetBsrEndAddr(jcr->impl->read_session.bsr, dev);
   if (jcr->impl->read_session.bsr) {
     jcr->impl->read_session.bsr->Reposition = true;
     bsr = find_next_bsr(jcr->impl->read_session.bsr, dev);
-    if (GetBsrStartAddr(bsr, &file, &block) > 0) {
+    if (GetBsrIndexedStartAddr(bsr, dev, &file, &block) > 0) {
       Jmsg(jcr, M_INFO, 0,
            _("Forward spacing Volume \"%s\" to file:block %u:%u.\n"),
            dev->VolHdr.VolumeName, file, block);
@@ -362,7 +363,7 @@ bool TryDeviceRepositioning(JobControlRecord* jcr,
     uint32_t block, file;
     /* TODO: use dev->file_addr ? */
     uint64_t dev_addr = (((uint64_t)dev->file) << 32) | dev->block_num;
-    uint64_t bsr_addr = GetBsrStartAddr(bsr, &file, &block);
+    uint64_t bsr_addr = GetBsrIndexedStartAddr(bsr, dev, &file, &block);
 
     if (dev_addr > bsr_addr) { return false; }
     Dmsg4(500, "Try_Reposition from (file:block) %u:%u to %u:%u\n", dev->file,
@@ -23,6 +23,7 @@
 
 #include "stored/device_resource.h"
 #include "stored/stored_globals.h"
+#include "lib/alist.h"
 
 namespace storagedaemon {
 
@@ -35,7 +36,7 @@ DeviceResource::DeviceResource()
     , changer_name(nullptr)
     , changer_command(nullptr)
     , alert_command(nullptr)
-    , spool_directory(nullptr)
+    , spool_directories(nullptr)
     , dev_type(B_UNKNOWN_DEV)
     , label_type(B_BAREOS_LABEL)
     , autoselect(true)
@@ -45,6 +46,7 @@ DeviceResource::DeviceResource()
     , query_crypto_status(false)
     , collectstats(false)
     , eof_on_error_is_eot(false)
+    , block_index(false)
     , drive(-1)
     , drive_index(-1)
     , cap_bits{0}
@@ -57,16 +59,23 @@ DeviceResource::DeviceResource()
     , max_block_size(0)
     , max_network_buffer_size(0)
     , max_concurrent_jobs(0)
+    , append_buffers(0)
+    , despool_buffers(0)
+    , streaming_buffer_size(0)
+    , streaming_buffer_high_watermark(80)
+    , streaming_buffer_low_watermark(20)
     , autodeflate_algorithm(0)
     , autodeflate_level(6)
     , autodeflate(0)
     , autoinflate(0)
+    , autoxflate_workers(0)
     , vol_poll_interval(300)
     , max_volume_size(0)
     , max_file_size(1000000000)
     , volume_capacity(0)
     , max_spool_size(0)
     , max_job_spool_size(0)
+    , attr_spool_commit_size(0)
 
     , max_part_size(0)
     , mount_point(nullptr)
@@ -95,7 +104,7 @@ DeviceResource::DeviceResource(const DeviceResource& other)
     , changer_name(nullptr)
     , changer_command(nullptr)
     , alert_command(nullptr)
-    , spool_directory(nullptr)
+    , spool_directories(nullptr)
     , mount_point(nullptr)
     , mount_command(nullptr)
     , unmount_command(nullptr)
@@ -114,8 +123,13 @@ DeviceResource::DeviceResource(const DeviceResource& other)
     changer_command = strdup(other.changer_command);
   }
   if (other.alert_command) { alert_command = strdup(other.alert_command); }
-  if (other.spool_directory) {
-    spool_directory = strdup(other.spool_directory);
+  if (other.spool_directories) {
+    const char* spool_directory = nullptr;
+
+    spool_directories = new alist(10, owned_by_alist);
+    foreach_alist (spool_directory, other.spool_directories) {
+      spool_directories->append(strdup(spool_directory));
+    }
   }
   dev_type = other.dev_type;
   label_type = other.label_type;
@@ -126,6 +140,7 @@ DeviceResource::DeviceResource(const DeviceResource& other)
   query_crypto_status = other.query_crypto_status;
   collectstats = other.collectstats;
   eof_on_error_is_eot = other.eof_on_error_is_eot;
+  block_index = other.block_index;
   drive = other.drive;
   drive_index = other.drive_index;
   memcpy(cap_bits, other.cap_bits, CAP_BYTES);
@@ -138,16 +153,23 @@ DeviceResource::DeviceResource(const DeviceResource& other)
   max_block_size = other.max_block_size;
   max_network_buffer_size = other.max_network_buffer_size;
   max_concurrent_jobs = other.max_concurrent_jobs;
+  append_buffers = other.append_buffers;
+  despool_buffers = other.despool_buffers;
+  streaming_buffer_size = other.streaming_buffer_size;
+  streaming_buffer_high_watermark = other.streaming_buffer_high_watermark;
+  streaming_buffer_low_watermark = other.streaming_buffer_low_watermark;
   autodeflate_algorithm = other.autodeflate_algorithm;
   autodeflate_level = other.autodeflate_level;
   autodeflate = other.autodeflate;
   autoinflate = other.autoinflate;
+  autoxflate_workers = other.autoxflate_workers;
   vol_poll_interval = other.vol_poll_interval;
   max_volume_size = other.max_volume_size;
   max_file_size = other.max_file_size;
   volume_capacity = other.volume_capacity;
   max_spool_size = other.max_spool_size;
   max_job_spool_size = other.max_job_spool_size;
+  attr_spool_commit_size = other.attr_spool_commit_size;
 
   max_part_size = other.max_part_size;
   if (other.mount_point) { mount_point = strdup(other.mount_point); }
@@ -179,7 +201,7 @@ DeviceResource& DeviceResource::operator=(const DeviceResource& rhs)
   changer_name = rhs.changer_name;
   changer_command = rhs.changer_command;
   alert_command = rhs.alert_command;
-  spool_directory = rhs.spool_directory;
+  spool_directories = rhs.spool_directories;
   dev_type = rhs.dev_type;
   label_type = rhs.label_type;
   autoselect = rhs.autoselect;
@@ -189,6 +211,7 @@ DeviceResource& DeviceResource::operator=(const DeviceResource& rhs)
   query_crypto_status = rhs.query_crypto_status;
   collectstats = rhs.collectstats;
   eof_on_error_is_eot = rhs.eof_on_error_is_eot;
+  block_index = rhs.block_index;
   drive = rhs.drive;
   drive_index = rhs.drive_index;
   memcpy(cap_bits, rhs.cap_bits, CAP_BYTES);
@@ -201,16 +224,23 @@ DeviceResource& DeviceResource::operator=(const DeviceResource& rhs)
   max_block_size = rhs.max_block_size;
   max_network_buffer_size = rhs.max_network_buffer_size;
   max_concurrent_jobs = rhs.max_concurrent_jobs;
+  append_buffers = rhs.append_buffers;
+  despool_buffers = rhs.despool_buffers;
+  streaming_buffer_size = rhs.streaming_buffer_size;
+  streaming_buffer_high_watermark = rhs.streaming_buffer_high_watermark;
+  streaming_buffer_low_watermark = rhs.streaming_buffer_low_watermark;
   autodeflate_algorithm = rhs.autodeflate_algorithm;
   autodeflate_level = rhs.autodeflate_level;
   autodeflate = rhs.autodeflate;
   autoinflate = rhs.autoinflate;
+  autoxflate_workers = rhs.autoxflate_workers;
   vol_poll_interval = rhs.vol_poll_interval;
   max_volume_size = rhs.max_volume_size;
   max_file_size = rhs.max_file_size;
   volume_capacity = rhs.volume_capacity;
   max_spool_size = rhs.max_spool_size;
   max_job_spool_size = rhs.max_job_spool_size;
+  attr_spool_commit_size = rhs.attr_spool_commit_size;
 
   max_part_size = rhs.max_part_size;
   mount_point = rhs.mount_point;
@@ -41,7 +41,7 @@ class DeviceResource : public BareosResource {
   char* changer_name;           /**< Changer device name */
   char* changer_command;        /**< Changer command  -- external program */
   char* alert_command;          /**< Alert command -- external program */
-  char* spool_directory;        /**< Spool file directory */
+  alist* spool_directories;     /**< Spool file directories (striped) */
   uint32_t dev_type;            /**< device type */
   uint32_t label_type;          /**< label type */
   bool autoselect;              /**< Automatically select from AutoChanger */
@@ -51,6 +51,7 @@ class DeviceResource : public BareosResource {
   bool query_crypto_status;     /**< Query device for crypto status */
   bool collectstats;            /**< Set if statistics should be collected */
   bool eof_on_error_is_eot;     /**< Interpret EOF during read error as EOT */
+  bool block_index;             /**< Write a block index next to volumes */
   drive_number_t drive;         /**< Autochanger logical drive number */
   drive_number_t drive_index;   /**< Autochanger physical drive index */
   char cap_bits[CAP_BYTES];     /**< Capabilities of this device */
@@ -63,12 +64,18 @@ class DeviceResource : public BareosResource {
   uint32_t max_block_size;      /**< Current Maximum block size */
   uint32_t max_network_buffer_size; /**< Max network buf size */
   uint32_t max_concurrent_jobs;     /**< Maximum concurrent jobs this drive */
+  uint32_t append_buffers; /**< Blocks buffered by the async append writer */
+  uint32_t despool_buffers; /**< Blocks read ahead while despooling */
+  uint64_t streaming_buffer_size; /**< Memory buffered in front of device */
+  uint32_t streaming_buffer_high_watermark; /**< Percent full to start writing */
+  uint32_t streaming_buffer_low_watermark;  /**< Percent full to stop writing */
   uint32_t autodeflate_algorithm;   /**< Compression algorithm to use for
                                        compression */
   uint16_t autodeflate_level; /**< Compression level to use for compression
                                  algorithm which uses levels */
   uint16_t autodeflate; /**< Perform auto deflation in this IO direction */
   uint16_t autoinflate; /**< Perform auto inflation in this IO direction */
+  uint32_t autoxflate_workers; /**< Threads per job translating records */
   utime_t
       vol_poll_interval;   /**< Interval between polling volume during mount */
   int64_t max_volume_size; /**< Max bytes to put on one volume */
@@ -76,6 +83,7 @@ class DeviceResource : public BareosResource {
   int64_t volume_capacity; /**< Advisory capacity */
   int64_t max_spool_size;  /**< Max spool size for all jobs */
   int64_t max_job_spool_size; /**< Max spool size for any single job */
+  int64_t attr_spool_commit_size; /**< Attributes spooled before commit */
 
   int64_t max_part_size;    /**< Max part size */
   char* mount_point;        /**< Mount point for require mount devices */
@@ -26,9 +26,14 @@
 
 #include "stored/read_ctx.h"
 
+#include <memory>
+#include <mutex>
+
 #define SD_APPEND 1
 #define SD_READ 0
 
+class AttributeSpoolWriter;
+
 namespace storagedaemon {
 
 struct VolumeList;
@@ -79,12 +84,14 @@ struct JobControlRecordPrivate {
   int32_t label_errors{};         /**< Count of label errors */
   bool session_opened{};
   bool remote_replicate{};        /**< Replicate data to remote SD */
+  bool replicate_blocks{};        /**< Replication sends whole blocks */
   int32_t Ticket{};               /**< Ticket for this job */
   bool ignore_label_errors{};     /**< Ignore Volume label errors */
   bool spool_attributes{};        /**< Set if spooling attributes */
   bool no_attributes{};           /**< Set if no attributes wanted */
   int64_t spool_size{};           /**< Spool size for this job */
   bool spool_data{};              /**< Set to spool data */
+  AttributeSpoolWriter* attr_spool{}; /**< Writer of the attribute spool file */
   storagedaemon::DirectorResource* director{}; /**< Director resource */
   alist* plugin_options{};        /**< Specific Plugin Options sent by DIR */
   alist* write_store{};           /**< List of write storage devices sent by DIR */
@@ -94,6 +101,7 @@ struct JobControlRecordPrivate {
   bool PreferMountedVols{};       /**< Prefer mounted vols rather than new */
   bool insert_jobmedia_records{}; /**< Need to insert job media records */
   uint64_t RemainingQuota{};      /**< Available bytes to use as quota */
+  std::shared_ptr<std::mutex> dir_mutex{std::make_shared<std::mutex>()}; /**< Held from a request to the Director until its reply is read, shared with the readers of the job */
 
   storagedaemon::ReadSession read_session;
   storagedaemon::DeviceWaitTimes device_wait_times;
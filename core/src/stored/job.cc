@@ -37,6 +37,7 @@
 #include "stored/ndmp_tape.h"
 #include "stored/read_record.h"
 #include "stored/stored_globals.h"
+#include "lib/attribute_spool.h"
 #include "lib/bsock.h"
 #include "lib/edit.h"
 #include "lib/parse_bsr.h"
@@ -430,6 +431,11 @@ void StoredFreeJcr(JobControlRecord* jcr)
 
   if (jcr->impl->backup_format) { FreeMemory(jcr->impl->backup_format); }
 
+  if (jcr->impl->attr_spool) {
+    delete jcr->impl->attr_spool;
+    jcr->impl->attr_spool = NULL;
+  }
+
   if (jcr->impl->read_session.bsr) {
     libbareos::FreeBsr(jcr->impl->read_session.bsr);
     jcr->impl->read_session.bsr = NULL;
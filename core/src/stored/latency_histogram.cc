@@ -0,0 +1,149 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Latency histograms of the I/O done on a device.
+ */
+
+#include "include/bareos.h"
+#include "stored/latency_histogram.h"
+#include "lib/output_formatter.h"
+
+namespace storagedaemon {
+
+LatencyHistogram::LatencyHistogram()
+{
+  for (auto& bucket : buckets_) { bucket.store(0, std::memory_order_relaxed); }
+}
+
+int LatencyHistogram::BucketOf(btime_t usec)
+{
+  int bucket;
+
+  if (usec < 1) { return 0; }
+  bucket = 64 - __builtin_clzll((uint64_t)usec);
+
+  return (bucket < kBuckets) ? bucket : kBuckets - 1;
+}
+
+void LatencyHistogram::Record(btime_t usec)
+{
+  uint64_t value = (usec > 0) ? (uint64_t)usec : 0;
+  uint64_t max = max_.load(std::memory_order_relaxed);
+
+  buckets_[BucketOf(usec)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+  while (value > max && !max_.compare_exchange_weak(
+                            max, value, std::memory_order_relaxed)) {
+  }
+}
+
+uint64_t LatencyHistogram::Percentile(double percentile) const
+{
+  uint64_t count = Count();
+  uint64_t wanted, seen = 0;
+
+  if (count == 0) { return 0; }
+
+  wanted = (uint64_t)(count * percentile / 100.0);
+  if (wanted < 1) { wanted = 1; }
+
+  for (int i = 0; i < kBuckets; i++) {
+    seen += Bucket(i);
+    if (seen >= wanted) {
+      return (i == kBuckets - 1) ? Max() : (uint64_t)1 << i;
+    }
+  }
+
+  return Max();
+}
+
+void LatencyHistogram::Format(OutputFormatter* of) const
+{
+  PoolMem bound(PM_NAME);
+  int last = kBuckets - 1;
+
+  while (last > 0 && Bucket(last) == 0) { last--; }
+
+  of->ObjectKeyValue("count", "%s=", Count(), "%llu");
+  of->ObjectKeyValue("sum_usec", " %s=", Sum(), "%llu");
+  of->ObjectKeyValue("max_usec", " %s=", Max(), "%llu");
+  of->ObjectKeyValue("p50_usec", " %s=", Percentile(50), "%llu");
+  of->ObjectKeyValue("p90_usec", " %s=", Percentile(90), "%llu");
+  of->ObjectKeyValue("p99_usec", " %s=", Percentile(99), "%llu");
+
+  of->ObjectStart("buckets");
+  of->Decoration(" buckets=");
+  for (int i = 0; i <= last; i++) {
+    Mmsg(bound, "%llu", (unsigned long long)1 << i);
+    of->ObjectKeyValue(bound.c_str(), i ? ",%s:" : "%s:", Bucket(i), "%llu");
+  }
+  of->Decoration("\n");
+  of->ObjectEnd("buckets");
+}
+
+const char* DeviceLatencies::Name(DeviceLatencyKind kind)
+{
+  switch (kind) {
+    case DeviceLatencyKind::kBlockWrite:
+      return "block_write";
+    case DeviceLatencyKind::kBlockRead:
+      return "block_read";
+    case DeviceLatencyKind::kSync:
+      return "sync";
+    case DeviceLatencyKind::kWeof:
+      return "weof";
+    case DeviceLatencyKind::kSpoolWrite:
+      return "spool_write";
+    case DeviceLatencyKind::kSpoolRead:
+      return "spool_read";
+    case DeviceLatencyKind::kQueueWait:
+      return "queue_wait";
+    default:
+      return "unknown";
+  }
+}
+
+bool DeviceLatencies::empty() const
+{
+  for (const auto& histogram : histograms_) {
+    if (histogram.Count()) { return false; }
+  }
+
+  return true;
+}
+
+void DeviceLatencies::Format(OutputFormatter* of) const
+{
+  for (int i = 0; i < static_cast<int>(DeviceLatencyKind::kNumKinds); i++) {
+    DeviceLatencyKind kind = static_cast<DeviceLatencyKind>(i);
+
+    if (!Get(kind).Count()) { continue; }
+
+    of->ObjectStart(Name(kind));
+    of->Decoration("  %s: ", Name(kind));
+    Get(kind).Format(of);
+    of->ObjectEnd(Name(kind));
+  }
+}
+
+} /* namespace storagedaemon */
@@ -0,0 +1,120 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Latency histograms of the I/O done on a device.
+ *
+ * Every device keeps a histogram for each kind of operation. Recording a
+ * latency only increments a few relaxed atomic counters, so it is cheap
+ * enough to do for every block and needs no lock, the histograms are read
+ * by the statistics commands while the jobs keep running.
+ */
+
+#ifndef BAREOS_STORED_LATENCY_HISTOGRAM_H_
+#define BAREOS_STORED_LATENCY_HISTOGRAM_H_
+
+#include <atomic>
+
+class OutputFormatter;
+
+namespace storagedaemon {
+
+/*
+ * Bucket 0 counts latencies below 1 usec, bucket i > 0 the latencies from
+ * 2^(i-1) up to below 2^i usec. The last bucket also takes all larger ones.
+ */
+class LatencyHistogram {
+ public:
+  static const int kBuckets = 36;
+
+  LatencyHistogram();
+
+  void Record(btime_t usec);
+
+  uint64_t Count() const { return count_.load(std::memory_order_relaxed); }
+  uint64_t Sum() const { return sum_.load(std::memory_order_relaxed); }
+  uint64_t Max() const { return max_.load(std::memory_order_relaxed); }
+  uint64_t Bucket(int i) const
+  {
+    return buckets_[i].load(std::memory_order_relaxed);
+  }
+
+  static int BucketOf(btime_t usec);
+
+  /*
+   * Upper bound of the bucket holding the given percentile (0 - 100).
+   */
+  uint64_t Percentile(double percentile) const;
+
+  /*
+   * The counters and the buckets up to the last one used, each bucket
+   * keyed by its upper bound in usec.
+   */
+  void Format(OutputFormatter* of) const;
+
+ private:
+  std::atomic<uint64_t> buckets_[kBuckets];
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> sum_{0};
+  std::atomic<uint64_t> max_{0};
+};
+
+enum class DeviceLatencyKind
+{
+  kBlockWrite,
+  kBlockRead,
+  kSync,
+  kWeof,
+  kSpoolWrite,
+  kSpoolRead,
+  kQueueWait,
+  kNumKinds
+};
+
+class DeviceLatencies {
+ public:
+  void Record(DeviceLatencyKind kind, btime_t usec)
+  {
+    histograms_[static_cast<int>(kind)].Record(usec);
+  }
+
+  const LatencyHistogram& Get(DeviceLatencyKind kind) const
+  {
+    return histograms_[static_cast<int>(kind)];
+  }
+
+  static const char* Name(DeviceLatencyKind kind);
+
+  bool empty() const;
+
+  /*
+   * An object with a member per kind of operation that has samples.
+   */
+  void Format(OutputFormatter* of) const;
+
+ private:
+  LatencyHistogram
+      histograms_[static_cast<int>(DeviceLatencyKind::kNumKinds)];
+};
+
+} /* namespace storagedaemon */
+
+#endif /* BAREOS_STORED_LATENCY_HISTOGRAM_H_ */
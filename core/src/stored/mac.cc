@@ -39,6 +39,7 @@
 #include "stored/jcr_private.h"
 #include "stored/label.h"
 #include "stored/mount.h"
+#include "stored/parallel_read.h"
 #include "stored/read_record.h"
 #include "stored/sd_stats.h"
 #include "stored/spool.h"
@@ -48,6 +49,8 @@
 #include "lib/edit.h"
 #include "include/jcr.h"
 
+#include <algorithm>
+
 namespace storagedaemon {
 
 /**
@@ -60,6 +63,8 @@ static char Job_end[] =
  * Responses received from Storage Daemon
  */
 static char OK_start_replicate[] = "3000 OK start replicate ticket = %d\n";
+static char OK_start_replicate_blocks[] =
+    "3000 OK start replicate ticket = %d blocks\n";
 static char OK_data[] = "3000 OK data\n";
 static char OK_replicate[] = "3000 OK replicate data\n";
 static char OK_end_replicate[] = "3000 OK end replicate\n";
@@ -68,6 +73,8 @@ static char OK_end_replicate[] = "3000 OK end replicate\n";
  * Commands sent to Storage Daemon
  */
 static char start_replicate[] = "start replicate\n";
+static char start_replicate_blocks[] = "start replicate blocks\n";
+static char ReplicateBlocks[] = "blocks";
 static char ReplicateData[] = "replicate data %d\n";
 static char end_replicate[] = "end replicate\n";
 
@@ -292,6 +299,16 @@ bail_out:
   return retval;
 }
 
+/**
+ * A Virtual Backup consolidates the records of multiple jobs, they get a
+ * new sequential FileIndex. Copies and migrations of a single job keep
+ * the FileIndexes the job was written with.
+ */
+static inline bool RenumbersFileIndexes(JobControlRecord* jcr)
+{
+  return jcr->is_JobType(JT_BACKUP);
+}
+
 /**
  * Called here for each record from ReadRecords()
  * This function is used when we do a external clone of a Job e.g.
@@ -343,8 +360,16 @@ static bool CloneRecordToRemoteSd(DeviceControlRecord* dcr, DeviceRecord* rec)
       /*
        * See if we are changing the FileIndex e.g.
        * start processing the next file in the backup stream.
+       * Records of a consolidation come from multiple jobs, so
+       * just like in CloneRecordInternally() a new session also
+       * starts a new file to keep the output FileIndex sequential.
        */
-      if (rec->FileIndex != rec->last_FileIndex) { jcr->JobFiles++; }
+      if (rec->FileIndex != rec->last_FileIndex ||
+          (RenumbersFileIndexes(jcr) &&
+           (rec->VolSessionId != rec->last_VolSessionId ||
+            rec->VolSessionTime != rec->last_VolSessionTime))) {
+        jcr->JobFiles++;
+      }
 
       /*
        * Keep track of the new state.
@@ -382,7 +407,10 @@ static bool CloneRecordToRemoteSd(DeviceControlRecord* dcr, DeviceRecord* rec)
    * Send a header when needed.
    */
   if (send_header) {
-    if (!sd->fsend("%ld %d 0", rec->FileIndex, rec->Stream)) {
+    int32_t FileIndex =
+        RenumbersFileIndexes(jcr) ? (int32_t)jcr->JobFiles : rec->FileIndex;
+
+    if (!sd->fsend("%d %d 0", FileIndex, rec->Stream)) {
       if (!jcr->IsJobCanceled()) {
         Jmsg1(jcr, M_FATAL, 0, _("Network send error to SD. ERR=%s\n"),
               sd->bstrerror());
@@ -421,6 +449,142 @@ static bool CloneRecordToRemoteSd(DeviceControlRecord* dcr, DeviceRecord* rec)
   return true;
 }
 
+/**
+ * Callback for ReadRecordFragments() to send the record fragments of a
+ * block to the remote SD in one message. The remote SD packs them into
+ * its own blocks as they are.
+ *
+ * Returns: true if OK
+ *           false if error
+ */
+static bool CloneBlockToRemoteSd(DeviceControlRecord* dcr,
+                                 DeviceRecord* rec,
+                                 char* data,
+                                 uint32_t data_len)
+{
+  POOLMEM* msgsave;
+  JobControlRecord* jcr = dcr->jcr;
+  BareosSocket* sd = jcr->store_bsock;
+  RecordFragment frag;
+  const char* buf = data;
+  uint32_t len = data_len;
+
+  /*
+   * Count the files and bytes the same way CloneRecordToRemoteSd() does.
+   */
+  while (ParseRecordFragment(&buf, &len, BLOCK_VER, &frag)) {
+    if (frag.FileIndex != rec->last_FileIndex) {
+      rec->last_FileIndex = frag.FileIndex;
+      jcr->JobFiles++;
+    }
+    jcr->JobBytes += frag.data_len;
+  }
+
+  /*
+   * Send straight from the block buffer, like the record data above.
+   */
+  msgsave = sd->msg;
+  sd->msg = data;
+  sd->message_length = data_len;
+
+  if (!sd->send()) {
+    sd->msg = msgsave;
+    sd->message_length = 0;
+    if (!jcr->IsJobCanceled()) {
+      Jmsg1(jcr, M_FATAL, 0, _("Network send error to SD. ERR=%s\n"),
+            sd->bstrerror());
+    }
+    return false;
+  }
+
+  sd->msg = msgsave;
+
+  Dmsg2(200, "wrote_block JobId=%d len=%d\n", jcr->JobId, data_len);
+
+  return true;
+}
+
+/**
+ * Replicated blocks keep the FileIndexes they were written with, which for
+ * a consolidation only matches the renumbering of CloneRecordToRemoteSd()
+ * when all files of a single session are read.
+ */
+static bool ReadsSequentialFileIndexes(BootStrapRecord* bsr)
+{
+  uint32_t VolSessionId = 0;
+  uint32_t VolSessionTime = 0;
+  int32_t next_findex = 1;
+
+  if (!bsr) { return false; }
+
+  for (; bsr; bsr = bsr->next) {
+    if (!bsr->sessid || bsr->sessid->next ||
+        bsr->sessid->sessid != bsr->sessid->sessid2 || !bsr->sesstime ||
+        bsr->sesstime->next) {
+      return false;
+    }
+
+    if (!VolSessionId) {
+      VolSessionId = bsr->sessid->sessid;
+      VolSessionTime = bsr->sesstime->sesstime;
+    } else if (bsr->sessid->sessid != VolSessionId ||
+               bsr->sesstime->sesstime != VolSessionTime) {
+      return false;
+    }
+
+    /*
+     * A file spanning volumes is selected in the bsr of both volumes.
+     */
+    for (BsrFileIndex* fi = bsr->FileIndex; fi; fi = fi->next) {
+      if (fi->findex > next_findex) { return false; }
+      next_findex = std::max(next_findex, fi->findex2 + 1);
+    }
+  }
+
+  return true;
+}
+
+/**
+ * Whole blocks can be replicated when no plugin translates the records on
+ * read and their FileIndexes need no renumbering.
+ */
+static inline bool CanReplicateBlocks(JobControlRecord* jcr)
+{
+  if (!me->block_replication) { return false; }
+
+  if (RenumbersFileIndexes(jcr) &&
+      !ReadsSequentialFileIndexes(jcr->impl->read_session.bsr)) {
+    Dmsg0(100, "FileIndexes need renumbering, not replicating blocks\n");
+    return false;
+  }
+
+  return !PluginsTranslateRecords(jcr, jcr->impl->read_dcr, true);
+}
+
+/**
+ * The jobs consolidated by a Virtual Full can be read from more than one
+ * device at the same time. Readers run without the record translation of
+ * the job, so this is only done when the records are not translated.
+ */
+static inline ParallelReader* SetupParallelReader(JobControlRecord* jcr)
+{
+  ParallelReader* parallel_reader;
+
+  if (!jcr->is_JobType(JT_BACKUP) || me->max_parallel_read_devices < 2 ||
+      PluginsTranslateRecords(jcr, jcr->impl->read_dcr, true)) {
+    return nullptr;
+  }
+
+  parallel_reader = new ParallelReader(jcr, me->max_parallel_read_devices,
+                                       me->parallel_read_buffer_size);
+  if (!parallel_reader->Setup()) {
+    delete parallel_reader;
+    return nullptr;
+  }
+
+  return parallel_reader;
+}
+
 /**
  * Check autoinflation/autodeflation settings.
  */
@@ -493,6 +657,8 @@ bool DoMacRun(JobControlRecord* jcr)
   const char* Type;
   bool ok = true;
   bool acquire_fail = false;
+  bool replicate_blocks = false;
+  ParallelReader* parallel_reader = nullptr;
   BareosSocket* dir = jcr->dir_bsock;
   Device* dev = jcr->impl->dcr->dev;
 
@@ -567,9 +733,12 @@ bool DoMacRun(JobControlRecord* jcr)
     }
 
     /*
-     * Let the remote SD know we are about to start the replication.
+     * Let the remote SD know we are about to start the replication. When
+     * possible ask for replicating whole blocks, an older SD just ignores
+     * that and replies as usual.
      */
-    sd->fsend(start_replicate);
+    replicate_blocks = CanReplicateBlocks(jcr);
+    sd->fsend(replicate_blocks ? start_replicate_blocks : start_replicate);
     Dmsg1(110, ">stored: %s", sd->msg);
 
     /*
@@ -583,6 +752,13 @@ bool DoMacRun(JobControlRecord* jcr)
         goto bail_out;
       }
       Dmsg1(110, "Got Ticket=%d\n", jcr->impl->Ticket);
+
+      if (replicate_blocks) {
+        PoolMem ok_blocks(PM_MESSAGE);
+
+        Mmsg(ok_blocks, OK_start_replicate_blocks, jcr->impl->Ticket);
+        replicate_blocks = bstrcmp(sd->msg, ok_blocks.c_str());
+      }
     } else {
       Jmsg(jcr, M_FATAL, 0,
            _("Bad response from stored to start replicate command\n"));
@@ -610,10 +786,23 @@ bool DoMacRun(JobControlRecord* jcr)
     UpdateJobStatistics(jcr, now);
 
     /*
-     * Read all data and send it to remote SD.
+     * Read all data and send it to remote SD. Whole blocks are all sent
+     * after a single header.
      */
-    ok = ReadRecords(jcr->impl->read_dcr, CloneRecordToRemoteSd,
-                     MountNextReadVolume);
+    if (replicate_blocks) {
+      Dmsg0(110, "Replicating whole blocks\n");
+      if (!sd->fsend(ReplicateBlocks)) {
+        Jmsg1(jcr, M_FATAL, 0, _("Network send error to SD. ERR=%s\n"),
+              sd->bstrerror());
+        ok = false;
+        goto bail_out;
+      }
+      ok = ReadRecordFragments(jcr->impl->read_dcr, CloneBlockToRemoteSd,
+                               MountNextReadVolume);
+    } else {
+      ok = ReadRecords(jcr->impl->read_dcr, CloneRecordToRemoteSd,
+                       MountNextReadVolume);
+    }
 
     /*
      * Send the last EOD to close the last data transfer and a next EOD to
@@ -663,9 +852,11 @@ bool DoMacRun(JobControlRecord* jcr)
           jcr->impl->NumReadVolumes, Type, jcr->impl->VolList->VolumeName);
 
     /*
-     * Ready devices for reading and writing.
+     * Ready devices for reading and writing. The readers of a parallel
+     * read acquire their devices themselves.
      */
-    if (!AcquireDeviceForRead(jcr->impl->read_dcr) ||
+    parallel_reader = SetupParallelReader(jcr);
+    if ((!parallel_reader && !AcquireDeviceForRead(jcr->impl->read_dcr)) ||
         !AcquireDeviceForAppend(jcr->impl->dcr)) {
       ok = false;
       acquire_fail = true;
@@ -701,8 +892,12 @@ bool DoMacRun(JobControlRecord* jcr)
     /*
      * Read all data and make a local clone of it.
      */
-    ok = ReadRecords(jcr->impl->read_dcr, CloneRecordInternally,
-                     MountNextReadVolume);
+    if (parallel_reader) {
+      ok = parallel_reader->Run(jcr->impl->dcr, CloneRecordInternally);
+    } else {
+      ok = ReadRecords(jcr->impl->read_dcr, CloneRecordInternally,
+                       MountNextReadVolume);
+    }
   }
 
 bail_out:
@@ -791,6 +986,8 @@ bail_out:
     if (!ReleaseDevice(jcr->impl->read_dcr)) { ok = false; }
   }
 
+  if (parallel_reader) { delete parallel_reader; }
+
   jcr->sendJobStatus(); /* update director */
 
   Dmsg0(30, "Done reading.\n");
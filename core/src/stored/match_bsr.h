@@ -35,6 +35,11 @@ bool IsThisBsrDone(BootStrapRecord* bsr, DeviceRecord* rec);
 uint64_t GetBsrStartAddr(BootStrapRecord* bsr,
                          uint32_t* file = NULL,
                          uint32_t* block = NULL);
+uint64_t GetBsrIndexedStartAddr(BootStrapRecord* bsr,
+                                Device* dev,
+                                uint32_t* file,
+                                uint32_t* block);
+uint64_t GetBsrEndAddr(BootStrapRecord* root_bsr, Device* dev);
 
 } /* namespace storagedaemon */
 
@@ -0,0 +1,629 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Parallel reading of the jobs consolidated by a Virtual Full.
+ */
+
+#include "include/bareos.h"
+#include "stored/stored.h"
+#include "stored/stored_globals.h"
+#include "stored/acquire.h"
+#include "stored/bsr.h"
+#include "stored/jcr_private.h"
+#include "stored/job.h"
+#include "stored/mount.h"
+#include "stored/parallel_read.h"
+#include "stored/read_record.h"
+#include "stored/wait.h"
+#include "include/jcr.h"
+#include "lib/berrno.h"
+#include "lib/bsock.h"
+#include "lib/thread_specific_data.h"
+
+#include <map>
+
+namespace storagedaemon {
+
+static const int debuglevel = 100;
+
+thread_local ParallelReader::Reader* ParallelReader::thread_reader_ = nullptr;
+
+/**
+ * Memory a queued record takes, never zero so a reader can only be held
+ * back by records that are actually queued.
+ */
+static inline uint64_t QueuedSize(DeviceRecord* rec)
+{
+  return sizeof(DeviceRecord) + rec->data_len;
+}
+
+/**
+ * Make a chain out of the given bsr entries, the first one is its root.
+ */
+static void LinkBsrs(std::vector<BootStrapRecord*>& bsrs,
+                     bool use_fast_rejection,
+                     bool use_positioning)
+{
+  BootStrapRecord* prev = nullptr;
+
+  for (BootStrapRecord* bsr : bsrs) {
+    bsr->root = bsrs.front();
+    bsr->prev = prev;
+    bsr->next = nullptr;
+    if (prev) { prev->next = bsr; }
+    prev = bsr;
+  }
+
+  bsrs.front()->use_fast_rejection = use_fast_rejection;
+  bsrs.front()->use_positioning = use_positioning;
+}
+
+ParallelReader::ParallelReader(JobControlRecord* jcr,
+                               int max_readers,
+                               uint64_t buffer_size)
+    : jcr_(jcr), max_readers_(max_readers), buffer_size_(buffer_size)
+{
+}
+
+ParallelReader::~ParallelReader()
+{
+  Stop();
+
+  for (Reader* reader : readers_) {
+    for (DeviceRecord* rec : reader->records) { FreeRecord(rec); }
+    reader->records.clear();
+  }
+
+  /*
+   * Give the job its bsr back in the original order.
+   */
+  if (!bsrs_.empty()) {
+    LinkBsrs(bsrs_, use_fast_rejection_, use_positioning_);
+    jcr_->impl->read_session.bsr = bsrs_.front();
+  }
+
+  for (Reader* reader : readers_) { FreeReader(reader); }
+  readers_.clear();
+
+  pthread_cond_destroy(&space_);
+  pthread_cond_destroy(&records_);
+  pthread_mutex_destroy(&mutex_);
+}
+
+/**
+ * Setup the readers, at least two of them.
+ *
+ * Returns: false when the job should be read on the device reserved by
+ *          the Director the normal way.
+ */
+bool ParallelReader::Setup()
+{
+  DeviceControlRecord* read_dcr = jcr_->impl->read_dcr;
+  BootStrapRecord* root = jcr_->impl->read_session.bsr;
+
+  if (!read_dcr || !root) { return false; }
+
+  std::vector<std::vector<BootStrapRecord*>> lanes = SplitBsrIntoLanes(root);
+  if (lanes.size() < 2) {
+    Dmsg1(debuglevel, "%d lanes, not reading in parallel\n",
+          (int)lanes.size());
+    return false;
+  }
+
+  /*
+   * Readers are reserved for the Media Type of the device the Director
+   * reserved. Switching to a device of another Media Type is left to
+   * reading the normal way.
+   */
+  for (BootStrapRecord* bsr = root; bsr; bsr = bsr->next) {
+    for (BsrVolume* vol = bsr->volume; vol; vol = vol->next) {
+      if (vol->MediaType[0] &&
+          !bstrcmp(vol->MediaType, read_dcr->media_type)) {
+        Dmsg1(debuglevel, "Volume %s has another Media Type\n",
+              vol->VolumeName);
+        return false;
+      }
+    }
+  }
+
+  if (max_readers_ > (int)lanes.size()) { max_readers_ = lanes.size(); }
+
+  if (!ReserveReadDevices()) { return false; }
+  AssignLanes(lanes);
+
+  Dmsg2(debuglevel, "Reading %d lanes with %d readers\n", (int)lanes.size(),
+        (int)readers_.size());
+
+  return true;
+}
+
+/**
+ * Reserve the devices for the readers. The first reader takes over the
+ * device reserved by the Director, the others get any other device the
+ * Director could have chosen for reading.
+ */
+bool ParallelReader::ReserveReadDevices()
+{
+  DeviceControlRecord* read_dcr = jcr_->impl->read_dcr;
+  Device* dev = read_dcr->dev;
+  Reader* reader;
+
+  LockReservations();
+
+  /*
+   * Additional devices first, so none of them is the one we already have.
+   */
+  while ((int)readers_.size() + 1 < max_readers_) {
+    reader = NewReader(read_dcr->dev_name);
+    if (!reader) { break; }
+    readers_.push_back(reader);
+  }
+
+  if (readers_.empty()) {
+    UnlockReservations();
+    Dmsg0(debuglevel, "No additional read device available\n");
+    return false;
+  }
+
+  read_dcr->UnreserveDevice();
+  reader = NewReader(dev->device->resource_name_);
+  if (!reader) {
+    dev->Lock();
+    dev->SetRead();
+    read_dcr->SetReserved();
+    dev->Unlock();
+
+    for (Reader* reader : readers_) { FreeReader(reader); }
+    readers_.clear();
+    UnlockReservations();
+    Dmsg1(debuglevel, "Could not take over read device %s\n",
+          dev->print_name());
+    return false;
+  }
+  readers_.insert(readers_.begin(), reader);
+
+  UnlockReservations();
+
+  /*
+   * The job itself no longer reads.
+   */
+  FreeDeviceControlRecord(read_dcr);
+  jcr_->impl->read_dcr = nullptr;
+
+  return true;
+}
+
+/**
+ * Create a reader with a job record of its own and reserve a read device
+ * for it.
+ *
+ * Returns: nullptr if no device could be reserved
+ *          the reader otherwise
+ */
+ParallelReader::Reader* ParallelReader::NewReader(const char* device_name)
+{
+  DeviceControlRecord* read_dcr = jcr_->impl->read_dcr;
+  char name[MAX_NAME_LENGTH];
+  ReserveContext rctx;
+  DirectorStorage store;
+  JobControlRecord* jcr;
+  Reader* reader;
+  int status;
+
+  reader = new Reader;
+  reader->parallel = this;
+  reader->jcr = jcr = NewStoredJcr();
+  NewPlugins(jcr); /* instantiate plugins */
+
+  /*
+   * Messages of the reader are sent as messages of the job.
+   */
+  jcr->JobId = jcr_->JobId;
+  bstrncpy(jcr->Job, jcr_->Job, sizeof(jcr->Job));
+  jcr->setJobType(jcr_->getJobType());
+  jcr->setJobLevel(jcr_->getJobLevel());
+  jcr->setJobStatus(JS_Running);
+  jcr_->dir_bsock->SetLocking();
+  jcr->dir_bsock = jcr_->dir_bsock->clone();
+  jcr->impl->dir_mutex = jcr_->impl->dir_mutex;
+
+  jcr->impl->read_dcr = new StorageDaemonDeviceControlRecord;
+  jcr->impl->reserve_msgs = new alist(10, not_owned_by_alist);
+
+  bstrncpy(name, device_name, sizeof(name));
+  memset(&rctx, 0, sizeof(ReserveContext));
+  memset(&store, 0, sizeof(DirectorStorage));
+  bstrncpy(store.media_type, read_dcr->media_type, sizeof(store.media_type));
+  bstrncpy(store.pool_name, read_dcr->pool_name, sizeof(store.pool_name));
+  bstrncpy(store.pool_type, read_dcr->pool_type, sizeof(store.pool_type));
+  store.append = false;
+  rctx.jcr = jcr;
+  rctx.device_name = name;
+  rctx.store = &store;
+  rctx.any_drive = true;
+
+  status = SearchResForDevice(rctx);
+  ReleaseReserveMessages(jcr);
+  if (status != 1) {
+    FreeReader(reader);
+    return nullptr;
+  }
+
+  /*
+   * Translate records like the device reserved by the Director would.
+   */
+  reader->dcr = jcr->impl->read_dcr;
+  reader->dcr->autodeflate = read_dcr->autodeflate;
+  reader->dcr->autoinflate = read_dcr->autoinflate;
+  Dmsg1(debuglevel, "Reserved read device %s\n",
+        reader->dcr->dev->print_name());
+
+  return reader;
+}
+
+void ParallelReader::FreeReader(Reader* reader)
+{
+  JobControlRecord* jcr = reader->jcr;
+
+  /*
+   * The bsr entries belong to the job.
+   */
+  jcr->impl->read_session.bsr = nullptr;
+
+  if (jcr->dir_bsock) {
+    jcr->dir_bsock->close();
+    delete jcr->dir_bsock;
+    jcr->dir_bsock = nullptr;
+  }
+
+  FreeJcr(jcr);
+  delete reader;
+}
+
+/**
+ * Hand out the lanes round robin. A reader reads the entries of all its
+ * lanes in the order of the bsr.
+ */
+void ParallelReader::AssignLanes(
+    std::vector<std::vector<BootStrapRecord*>>& lanes)
+{
+  BootStrapRecord* root = jcr_->impl->read_session.bsr;
+  std::map<BootStrapRecord*, Reader*> lane_reader;
+
+  for (size_t i = 0; i < lanes.size(); i++) {
+    for (BootStrapRecord* bsr : lanes[i]) {
+      lane_reader[bsr] = readers_[i % readers_.size()];
+    }
+  }
+
+  use_fast_rejection_ = root->use_fast_rejection;
+  use_positioning_ = root->use_positioning;
+  for (BootStrapRecord* bsr = root; bsr; bsr = bsr->next) {
+    bsrs_.push_back(bsr);
+  }
+  for (BootStrapRecord* bsr : bsrs_) {
+    lane_reader[bsr]->bsrs.push_back(bsr);
+
+    /*
+     * SplitBsrIntoLanes() only creates lanes when every entry selects a
+     * single session.
+     */
+    auto session = session_index_.emplace(
+        std::make_pair(bsr->sessid->sessid, bsr->sesstime->sesstime),
+        sessions_.size());
+    if (session.second) {
+      Session s;
+
+      s.VolSessionId = bsr->sessid->sessid;
+      s.VolSessionTime = bsr->sesstime->sesstime;
+      s.reader = lane_reader[bsr];
+      sessions_.push_back(s);
+    }
+  }
+
+  for (Reader* reader : readers_) {
+    LinkBsrs(reader->bsrs, use_fast_rejection_, use_positioning_);
+    reader->jcr->impl->read_session.bsr = reader->bsrs.front();
+    CreateRestoreVolumeList(reader->jcr);
+  }
+}
+
+/**
+ * Read all records with the readers and hand them to write_record() in
+ * the thread of the job.
+ *
+ * Returns: false on failure
+ *          true on success
+ */
+bool ParallelReader::Run(DeviceControlRecord* dcr, RecordCallback write_record)
+{
+  int status;
+  bool ok;
+
+  /*
+   * The job starts with the first job of the bsr as its Start Of Session
+   * label holds the job information that is taken over.
+   */
+  current_ = sessions_.front().reader;
+
+  for (Reader* reader : readers_) {
+    if ((status = pthread_create(&reader->thread_id, NULL, reader_thread,
+                                 reader)) != 0) {
+      BErrNo be;
+      Jmsg1(jcr_, M_FATAL, 0, _("Cannot create reader thread: ERR=%s\n"),
+            be.bstrerror(status));
+      Stop();
+      return false;
+    }
+    reader->running = true;
+  }
+
+  Jmsg(jcr_, M_INFO, 0, _("Reading from %d devices in parallel.\n"),
+       (int)readers_.size());
+
+  ok = WriteRecords(dcr, write_record);
+  Stop();
+
+  for (Reader* reader : readers_) {
+    if (!reader->ok) { ok = false; }
+  }
+
+  Dmsg2(debuglevel, "Parallel read done writer stall=%lld reader stall=%lld\n",
+        writer_stall_, reader_stall_);
+
+  return ok;
+}
+
+bool ParallelReader::WriteRecords(DeviceControlRecord* dcr,
+                                  RecordCallback write_record)
+{
+  DeviceRecord* rec;
+  uint32_t last_VolSessionId = 0;
+  uint32_t last_VolSessionTime = 0;
+  int32_t last_FileIndex = 0;
+  bool ok;
+
+  while (NextRecord(&rec)) {
+    if (!rec) { return true; }
+
+    /*
+     * Each record is a copy, so carry over what the writer keeps in the
+     * record to number the files.
+     */
+    rec->last_VolSessionId = last_VolSessionId;
+    rec->last_VolSessionTime = last_VolSessionTime;
+    rec->last_FileIndex = last_FileIndex;
+
+    ok = write_record(dcr, rec);
+
+    last_VolSessionId = rec->last_VolSessionId;
+    last_VolSessionTime = rec->last_VolSessionTime;
+    last_FileIndex = rec->last_FileIndex;
+    FreeRecord(rec);
+
+    if (!ok) { return false; }
+  }
+
+  return false;
+}
+
+/**
+ * Take the next record for the writer. The records are taken session by
+ * session in the order of the bsr. A reader hands out the records of the
+ * sessions of its lane in the order it read them, just like a single
+ * device would, so a session is complete when the reader of its lane
+ * comes to a record of a later session or has read everything.
+ *
+ * Returns: false on failure or when the job got canceled
+ *          true with *rec set to nullptr after the last record
+ *          true with the next record in *rec otherwise
+ */
+bool ParallelReader::NextRecord(DeviceRecord** rec)
+{
+  struct timespec timeout;
+  struct timeval tv;
+  btime_t start;
+  bool ok = false;
+
+  *rec = nullptr;
+
+  P(mutex_);
+  while (!stop_) {
+    bool failed = false;
+
+    for (Reader* reader : readers_) {
+      if (reader->done && !reader->ok) { failed = true; }
+    }
+    if (failed || JobCanceled(jcr_)) { break; }
+
+    if (session_ >= sessions_.size()) {
+      ok = true;
+      break;
+    }
+
+    Reader* reader = sessions_[session_].reader;
+    if (current_ != reader) {
+      current_ = reader;
+      pthread_cond_broadcast(&space_);
+    }
+
+    if (!reader->records.empty()) {
+      DeviceRecord* next = reader->records.front();
+      auto index = session_index_.find(
+          std::make_pair(next->VolSessionId, next->VolSessionTime));
+
+      if (index != session_index_.end() && index->second > session_) {
+        Dmsg2(debuglevel, "Session %u/%u complete\n",
+              sessions_[session_].VolSessionId,
+              sessions_[session_].VolSessionTime);
+        session_++;
+        continue;
+      }
+
+      reader->records.pop_front();
+      buffered_ -= QueuedSize(next);
+      pthread_cond_broadcast(&space_);
+      *rec = next;
+      ok = true;
+      break;
+    }
+
+    if (reader->done) {
+      session_++;
+      continue;
+    }
+
+    /*
+     * Wait for records, waking up now and then to see if the job got
+     * canceled.
+     */
+    gettimeofday(&tv, NULL);
+    timeout.tv_sec = tv.tv_sec + 5;
+    timeout.tv_nsec = tv.tv_usec * 1000;
+    start = GetCurrentBtime();
+    pthread_cond_timedwait(&records_, &mutex_, &timeout);
+    writer_stall_ += GetCurrentBtime() - start;
+  }
+
+  if (!ok) { stop_ = true; }
+  V(mutex_);
+
+  return ok;
+}
+
+/**
+ * Stop the readers, also when they did not read everything because
+ * writing failed or the job got canceled.
+ */
+void ParallelReader::Stop()
+{
+  P(mutex_);
+  stop_ = true;
+  for (Reader* reader : readers_) {
+    if (!reader->running || reader->done) { continue; }
+
+    reader->jcr->setJobStatus(JS_Canceled);
+    if (reader->dcr->dev && reader->dcr->dev->waiting_for_mount()) {
+      pthread_cond_broadcast(&reader->dcr->dev->wait_next_vol);
+      ReleaseDeviceCond();
+    }
+  }
+  pthread_cond_broadcast(&space_);
+  pthread_cond_broadcast(&records_);
+  V(mutex_);
+
+  for (Reader* reader : readers_) {
+    if (!reader->running) { continue; }
+
+    pthread_join(reader->thread_id, NULL);
+    reader->running = false;
+  }
+}
+
+void* ParallelReader::reader_thread(void* data)
+{
+  Reader* reader = (Reader*)data;
+
+  SetJcrInThreadSpecificData(reader->jcr);
+  thread_reader_ = reader;
+  reader->parallel->ReadLanes(reader);
+
+  return NULL;
+}
+
+void ParallelReader::ReadLanes(Reader* reader)
+{
+  bool ok;
+
+  Dmsg2(debuglevel, "Reader on %s starts with Volume %s\n",
+        reader->dcr->dev->print_name(), reader->jcr->impl->VolList->VolumeName);
+
+  ok = AcquireDeviceForRead(reader->dcr) &&
+       ReadRecords(reader->dcr, QueueRecord, MountNextReadVolume);
+  if (!ReleaseDevice(reader->dcr)) { ok = false; }
+
+  P(mutex_);
+  reader->ok = ok;
+  reader->done = true;
+  pthread_cond_broadcast(&records_);
+  V(mutex_);
+}
+
+/**
+ * Called by ReadRecords() in a reader thread to queue a copy of each
+ * record for the writer. Blocks while the records queued by all readers
+ * exceed the buffer size.
+ *
+ * The writer only takes records of the reader of the current session, the
+ * buffer may be filled up by the readers of later sessions. So the reader
+ * the writer waits for may always queue a record when it has none queued,
+ * otherwise the job would hang. This exceeds the buffer size by at most
+ * one record.
+ */
+bool ParallelReader::QueueRecord(DeviceControlRecord* dcr, DeviceRecord* rec)
+{
+  Reader* reader = thread_reader_;
+  ParallelReader* parallel = reader->parallel;
+  DeviceRecord* copy;
+  btime_t start;
+  uint64_t size;
+
+  if (JobCanceled(parallel->jcr_)) { return false; }
+
+  copy = new_record();
+  copy->File = rec->File;
+  copy->Block = rec->Block;
+  copy->VolSessionId = rec->VolSessionId;
+  copy->VolSessionTime = rec->VolSessionTime;
+  copy->FileIndex = rec->FileIndex;
+  copy->Stream = rec->Stream;
+  copy->maskedStream = rec->maskedStream;
+  copy->data = CheckPoolMemorySize(copy->data, rec->data_len);
+  memcpy(copy->data, rec->data, rec->data_len);
+  copy->data_len = rec->data_len;
+  size = QueuedSize(copy);
+
+  P(parallel->mutex_);
+  start = GetCurrentBtime();
+  while (!parallel->stop_ &&
+         (parallel->current_ != reader || !reader->records.empty()) &&
+         parallel->buffered_ > 0 &&
+         parallel->buffered_ + size > parallel->buffer_size_) {
+    pthread_cond_wait(&parallel->space_, &parallel->mutex_);
+  }
+  parallel->reader_stall_ += GetCurrentBtime() - start;
+
+  if (parallel->stop_) {
+    V(parallel->mutex_);
+    FreeRecord(copy);
+    return false;
+  }
+
+  reader->records.push_back(copy);
+  parallel->buffered_ += size;
+  pthread_cond_signal(&parallel->records_);
+  V(parallel->mutex_);
+
+  return true;
+}
+
+} /* namespace storagedaemon */
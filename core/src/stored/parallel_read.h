@@ -0,0 +1,117 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Parallel reading of the jobs consolidated by a Virtual Full.
+ *
+ * The bsr of the job is split into lanes (see SplitBsrIntoLanes()) that are
+ * read by reader threads, each with a job record and a device of its own.
+ * The thread writing the new job takes the records of one job session
+ * after the other in the order of the bsr, so the jobs are written in the
+ * same order as when they are read from a single device and later versions
+ * and deltas of a file follow the ones they build on. How much the readers
+ * may read ahead of the writer is limited by the "Parallel Read Buffer
+ * Size" directive of the Storage resource.
+ */
+
+#ifndef BAREOS_STORED_PARALLEL_READ_H_
+#define BAREOS_STORED_PARALLEL_READ_H_
+
+#include <deque>
+#include <map>
+#include <utility>
+#include <vector>
+
+class JobControlRecord;
+
+namespace storagedaemon {
+
+class DeviceControlRecord;
+struct BootStrapRecord;
+struct DeviceRecord;
+
+class ParallelReader {
+ public:
+  using RecordCallback = bool (*)(DeviceControlRecord* dcr, DeviceRecord* rec);
+
+  ParallelReader(JobControlRecord* jcr, int max_readers, uint64_t buffer_size);
+  ~ParallelReader();
+
+  bool Setup();
+  bool Run(DeviceControlRecord* dcr, RecordCallback write_record);
+  int Readers() const { return readers_.size(); }
+
+ private:
+  struct Reader {
+    ParallelReader* parallel = nullptr;
+    JobControlRecord* jcr = nullptr;
+    DeviceControlRecord* dcr = nullptr;
+    std::vector<BootStrapRecord*> bsrs;
+    std::deque<DeviceRecord*> records;
+    pthread_t thread_id;
+    bool running = false;
+    bool done = false;
+    bool ok = true;
+  };
+
+  struct Session {
+    uint32_t VolSessionId = 0;
+    uint32_t VolSessionTime = 0;
+    Reader* reader = nullptr; /**< Reader of the lane of the session */
+  };
+
+  JobControlRecord* jcr_ = nullptr;
+  int max_readers_ = 0;
+  uint64_t buffer_size_ = 0;
+  std::vector<Reader*> readers_;
+  std::vector<BootStrapRecord*> bsrs_; /**< Entries in the order of the bsr */
+  std::vector<Session> sessions_;      /**< Sessions in the order of the bsr */
+  std::map<std::pair<uint32_t, uint32_t>, size_t> session_index_;
+  bool use_fast_rejection_ = false;
+  bool use_positioning_ = false;
+  pthread_mutex_t mutex_ = PTHREAD_MUTEX_INITIALIZER;
+  pthread_cond_t records_ = PTHREAD_COND_INITIALIZER;
+  pthread_cond_t space_ = PTHREAD_COND_INITIALIZER;
+  Reader* current_ = nullptr; /**< Reader the writer takes records from */
+  size_t session_ = 0;        /**< Session the writer takes records of */
+  uint64_t buffered_ = 0;     /**< Bytes queued by all readers */
+  bool stop_ = false;
+  btime_t writer_stall_ = 0; /**< Time the writer waited for records */
+  btime_t reader_stall_ = 0; /**< Time readers waited for buffer space */
+
+  static thread_local Reader* thread_reader_;
+
+  Reader* NewReader(const char* device_name);
+  void FreeReader(Reader* reader);
+  bool ReserveReadDevices();
+  void AssignLanes(std::vector<std::vector<BootStrapRecord*>>& lanes);
+  bool WriteRecords(DeviceControlRecord* dcr, RecordCallback write_record);
+  bool NextRecord(DeviceRecord** rec);
+  void Stop();
+
+  static void* reader_thread(void* data);
+  static bool QueueRecord(DeviceControlRecord* dcr, DeviceRecord* rec);
+  void ReadLanes(Reader* reader);
+};
+
+} /* namespace storagedaemon */
+
+#endif /* BAREOS_STORED_PARALLEL_READ_H_ */
@@ -45,6 +45,8 @@
 #include "stored/read_ctx.h"
 #include "include/jcr.h"
 
+#include <vector>
+
 namespace storagedaemon {
 
 static const int debuglevel = 500;
@@ -519,4 +521,179 @@ bool ReadRecords(DeviceControlRecord* dcr,
   return ok;
 }
 
+/**
+ * Decide which record fragments of the current block are wanted, this
+ * applies the bsr like ReadNextRecordFromBlock() does for records and
+ * handles the session labels which are never wanted.
+ *
+ * Returns: true when all fragments are wanted.
+ */
+static bool SelectRecordFragments(DeviceControlRecord* dcr,
+                                  READ_CTX* rctx,
+                                  std::vector<bool>& wanted,
+                                  bool* done)
+{
+  JobControlRecord* jcr = dcr->jcr;
+  Device* dev = dcr->dev;
+  DeviceBlock* block = dcr->block;
+  DeviceRecord* rec = rctx->rec;
+  RecordFragment frag;
+  const char* buf = block->bufp;
+  uint32_t len = block->binbuf;
+  bool all = true;
+
+  wanted.clear();
+  while (ParseRecordFragment(&buf, &len, block->BlockVer, &frag)) {
+    if (block->BlockVer != 1) {
+      frag.VolSessionId = block->VolSessionId;
+      frag.VolSessionTime = block->VolSessionTime;
+    }
+    rctx->records_processed++;
+    rec->VolSessionId = frag.VolSessionId;
+    rec->VolSessionTime = frag.VolSessionTime;
+    rec->FileIndex = frag.FileIndex;
+    rec->Stream = (frag.Stream < 0) ? -frag.Stream : frag.Stream;
+    rec->maskedStream = rec->Stream & STREAMMASK_TYPE;
+    rec->File = dev->EndFile;
+    rec->Block = dev->EndBlock;
+
+    if (rec->FileIndex == EOM_LABEL) { /* end of tape? */
+      Dmsg0(40, "Get EOM LABEL\n");
+      return false;
+    }
+
+    /*
+     * Some sort of label?
+     */
+    if (rec->FileIndex < 0) {
+      if (frag.Stream >= 0 && !frag.IsPartial()) {
+        rec->data = CheckPoolMemorySize(rec->data, frag.data_len);
+        memcpy(rec->data, frag.data, frag.data_len);
+        rec->data_len = frag.data_len;
+        HandleSessionRecord(dev, rec, &rctx->sessrec);
+      }
+      wanted.push_back(false);
+      all = false;
+      continue;
+    }
+
+    /*
+     * Apply BootStrapRecord filter
+     */
+    if (jcr->impl->read_session.bsr) {
+      rec->match_stat = MatchBsr(jcr->impl->read_session.bsr, rec,
+                                 &dev->VolHdr, &rctx->sessrec, jcr);
+      if (rec->match_stat == -1) { /* no more possible matches */
+        *done = true;              /* all items found, stop */
+        Dmsg2(debuglevel, "All done=(file:block) %u:%u\n", dev->file,
+              dev->block_num);
+        return false;
+      } else if (rec->match_stat == 0) { /* no match */
+        wanted.push_back(false);
+        all = false;
+        if (TryDeviceRepositioning(jcr, rec, dcr)) { return false; }
+        continue; /* we don't want record, read next one */
+      }
+    }
+
+    dcr->VolLastIndex = rec->FileIndex; /* let caller know where we are */
+    wanted.push_back(true);
+  }
+
+  return all;
+}
+
+/**
+ * This subroutine reads all the blocks and passes the records wanted to
+ * your callback routine as the record fragments in a block, so a record
+ * split over several blocks arrives in several pieces. The records are
+ * not put back together and no record translation is done, labels are
+ * never passed.
+ *
+ * When all records of a BB02 block are wanted the callback gets the
+ * records part of the block buffer, otherwise the wanted fragments are
+ * packed into a block of their own first.
+ *
+ * The callback may overwrite the data but must not keep a reference.
+ */
+bool ReadRecordFragments(DeviceControlRecord* dcr,
+                         bool FragmentsCb(DeviceControlRecord* dcr,
+                                          DeviceRecord* rec,
+                                          char* data,
+                                          uint32_t data_len),
+                         bool mount_cb(DeviceControlRecord* dcr))
+{
+  JobControlRecord* jcr = dcr->jcr;
+  READ_CTX* rctx;
+  DeviceBlock* block;
+  DeviceBlock* packed;
+  FragmentPacker packer;
+  RecordFragment frag;
+  std::vector<bool> wanted;
+  const char* buf;
+  uint32_t len;
+  bool ok = true;
+  bool done = false;
+
+  rctx = new_read_context();
+  packed = new_block(dcr->dev);
+  PositionDeviceToFirstFile(jcr, dcr);
+  jcr->impl->read_session.mount_next_volume = false;
+
+  while (ok && !done) {
+    if (JobCanceled(jcr)) {
+      ok = false;
+      break;
+    }
+
+    /*
+     * Read the next block into our buffers.
+     */
+    if (!ReadNextBlockFromDevice(dcr, &rctx->sessrec, NULL, mount_cb, &ok)) {
+      break;
+    }
+    block = dcr->block;
+
+    if (!rctx->rec || rctx->rec->VolSessionId != block->VolSessionId ||
+        rctx->rec->VolSessionTime != block->VolSessionTime) {
+      ReadContextSetRecord(dcr, rctx);
+    }
+    rctx->records_processed = 0;
+
+    if (SelectRecordFragments(dcr, rctx, wanted, &done) &&
+        block->BlockVer == BLOCK_VER) {
+      ok = FragmentsCb(dcr, rctx->rec, block->bufp, block->binbuf);
+      continue;
+    }
+
+    /*
+     * Pack the wanted fragments, a block that is smaller than the one read
+     * may need to be passed on before all are packed.
+     */
+    buf = block->bufp;
+    len = block->binbuf;
+    for (size_t i = 0; ok && i < wanted.size(); i++) {
+      ParseRecordFragment(&buf, &len, block->BlockVer, &frag);
+      if (!wanted[i]) { continue; }
+
+      while (ok && !packer.Pack(packed, &frag)) {
+        ok = FragmentsCb(dcr, rctx->rec, packed->buf + WRITE_BLKHDR_LENGTH,
+                         packed->binbuf - WRITE_BLKHDR_LENGTH);
+        EmptyBlock(packed);
+      }
+    }
+    if (ok && packed->binbuf > WRITE_BLKHDR_LENGTH) {
+      ok = FragmentsCb(dcr, rctx->rec, packed->buf + WRITE_BLKHDR_LENGTH,
+                       packed->binbuf - WRITE_BLKHDR_LENGTH);
+    }
+    EmptyBlock(packed);
+  }
+
+  FreeBlock(packed);
+  FreeReadContext(rctx);
+  PrintBlockReadErrors(jcr, dcr->block);
+
+  return ok;
+}
+
 } /* namespace storagedaemon */
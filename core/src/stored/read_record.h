@@ -40,6 +40,12 @@ bool ReadNextRecordFromBlock(DeviceControlRecord* dcr,
 bool ReadRecords(DeviceControlRecord* dcr,
                  bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec),
                  bool mount_cb(DeviceControlRecord* dcr));
+bool ReadRecordFragments(DeviceControlRecord* dcr,
+                         bool FragmentsCb(DeviceControlRecord* dcr,
+                                          DeviceRecord* rec,
+                                          char* data,
+                                          uint32_t data_len),
+                         bool mount_cb(DeviceControlRecord* dcr));
 
 } /* namespace storagedaemon */
 
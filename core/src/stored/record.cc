@@ -31,6 +31,7 @@
 #include "include/bareos.h"
 #include "stored/jcr_private.h"
 #include "stored/stored.h"
+#include "stored/append_writer.h"
 #include "lib/attribs.h"
 #include "lib/util.h"
 #include "include/jcr.h"
@@ -160,6 +161,10 @@ static const char* record_compression_to_str(PoolMem& resultbuffer,
           compression_to_str(resultbuffer, "FZ4H", comp_len, comp_level,
                              comp_version);
           break;
+        case COMPRESS_ZSTD:
+          compression_to_str(resultbuffer, "ZSTD", comp_len, comp_level,
+                             comp_version);
+          break;
         default:
           tmp.bsprintf(
               _("Compression algorithm 0x%x found, but not supported!\n"),
@@ -555,6 +560,7 @@ void CopyRecordState(DeviceRecord* dst, DeviceRecord* src)
   int32_t Stream, maskedStream;
   uint32_t data_len;
   POOLMEM* data;
+  SharedPayload* payload;
 
   /*
    * Preserve some important fields all other can be overwritten.
@@ -564,6 +570,7 @@ void CopyRecordState(DeviceRecord* dst, DeviceRecord* src)
   data = dst->data;
   data_len = dst->data_len;
   own_mempool = dst->own_mempool;
+  payload = dst->payload;
 
   memcpy(dst, src, sizeof(DeviceRecord));
 
@@ -572,6 +579,7 @@ void CopyRecordState(DeviceRecord* dst, DeviceRecord* src)
   dst->data = data;
   dst->data_len = data_len;
   dst->own_mempool = own_mempool;
+  dst->payload = payload;
 }
 
 /**
@@ -631,15 +639,188 @@ static inline ssize_t WriteDataToBlock(DeviceBlock* block,
                                        const DeviceRecord* rec)
 {
   uint32_t len;
+  const char* data;
 
   len = MIN(rec->remainder, BlockWriteNavail(block));
-  memcpy(block->bufp,
-         ((unsigned char*)rec->data) + (rec->data_len - rec->remainder), len);
+  data = rec->data + (rec->data_len - rec->remainder);
+
+  /*
+   * When the record data buffer is shared, larger pieces are referenced
+   * by the block and written straight from the record buffer.
+   */
+  if (rec->payload && len >= MIN_BLOCK_SLICE_LENGTH) {
+    AddBlockSlice(block, rec->payload, data, len);
+    return len;
+  }
+
+  memcpy(block->bufp, data, len);
   block->bufp += len;
   block->binbuf += len;
   return len;
 }
 
+/**
+ * Pack a record fragment into the block. A fragment that does not fit
+ * is split, the fragment is then updated to describe the continuation
+ * which goes into the next block. The continuation of a record that ended
+ * the block is appended without a header of its own.
+ *
+ * Returns: false when the block must be written before the (rest of the)
+ *          fragment can be packed.
+ *          true when the whole fragment is in the block.
+ */
+bool FragmentPacker::Pack(DeviceBlock* block, RecordFragment* frag)
+{
+  uint32_t len;
+  ser_declare;
+
+  if (block == block_ && block->binbuf == binbuf_ && remainder_ > 0) {
+    /*
+     * Nothing else may follow a partially written record in the block.
+     */
+    if (frag->Stream != -Stream_ || frag->FileIndex != FileIndex_ ||
+        frag->remainder != remainder_) {
+      return false;
+    }
+  } else {
+    /*
+     * Require room for the header and some data, a header with no data at
+     * all is only written for empty records.
+     */
+    if (BlockWriteNavail(block) <
+        WRITE_RECHDR_LENGTH + (frag->data_len ? 1 : 0)) {
+      return false;
+    }
+
+    SerBegin(block->bufp, WRITE_RECHDR_LENGTH);
+    if (BLOCK_VER == 1) {
+      ser_uint32(frag->VolSessionId);
+      ser_uint32(frag->VolSessionTime);
+    } else {
+      block->VolSessionId = frag->VolSessionId;
+      block->VolSessionTime = frag->VolSessionTime;
+    }
+    ser_int32(frag->FileIndex);
+    ser_int32(frag->Stream);
+    ser_uint32(frag->remainder);
+    block->bufp += WRITE_RECHDR_LENGTH;
+    block->binbuf += WRITE_RECHDR_LENGTH;
+
+    if (frag->FileIndex > 0) {
+      if (block->FirstIndex == 0) { block->FirstIndex = frag->FileIndex; }
+      block->LastIndex = frag->FileIndex;
+    }
+
+    FileIndex_ = frag->FileIndex;
+    Stream_ = (frag->Stream < 0) ? -frag->Stream : frag->Stream;
+    remainder_ = frag->remainder;
+  }
+
+  len = MIN(frag->data_len, BlockWriteNavail(block));
+  if (frag->payload && len >= MIN_BLOCK_SLICE_LENGTH) {
+    AddBlockSlice(block, frag->payload, frag->data, len);
+  } else {
+    memcpy(block->bufp, frag->data, len);
+    block->bufp += len;
+    block->binbuf += len;
+  }
+
+  frag->data += len;
+  frag->data_len -= len;
+  remainder_ -= len;
+  block_ = block;
+  binbuf_ = block->binbuf;
+
+  if (frag->data_len > 0) {
+    frag->Stream = -Stream_;
+    frag->remainder = remainder_;
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * Write a translated record to the blocks and account for it.
+ */
+bool DeviceControlRecord::WriteTranslatedRecord(DeviceRecord* trec)
+{
+  char buf1[100], buf2[100];
+
+  if (append_writer) {
+    /*
+     * The writer thread owns the dcr->block, so hand the record over
+     * to the asynchronous writer which fills its own blocks.
+     */
+    if (!append_writer->WriteRecord(trec)) {
+      Dmsg2(90, "Got WriteBlockToDev error on device %s. %s\n",
+            dev->print_name(), dev->bstrerror());
+      return false;
+    }
+  } else {
+    while (!WriteRecordToBlock(this, trec)) {
+      Dmsg2(850, "!WriteRecordToBlock data_len=%d rem=%d\n", trec->data_len,
+            trec->remainder);
+      if (!WriteBlockToDevice()) {
+        Dmsg2(90, "Got WriteBlockToDev error on device %s. %s\n",
+              dev->print_name(), dev->bstrerror());
+        return false;
+      }
+    }
+  }
+
+  jcr->JobBytes += trec->data_len; /* increment bytes this job */
+  if (jcr->impl->RemainingQuota &&
+      jcr->JobBytes > jcr->impl->RemainingQuota) {
+    Jmsg0(jcr, M_FATAL, 0, _("Quota Exceeded. Job Terminated.\n"));
+    return false;
+  }
+
+  Dmsg4(850, "WriteRecord FI=%s SessId=%d Strm=%s len=%d\n",
+        FI_to_ascii(buf1, trec->FileIndex), trec->VolSessionId,
+        stream_to_ascii(buf2, trec->Stream, trec->FileIndex), trec->data_len);
+
+  return true;
+}
+
+/**
+ * Write a record fragment copied from another volume to the blocks and
+ * account for it. No record translation is done, the caller makes sure none
+ * is needed.
+ */
+bool DeviceControlRecord::WriteRecordFragment(FragmentPacker* packer,
+                                              RecordFragment* frag)
+{
+  uint32_t data_len = frag->data_len;
+
+  if (append_writer) {
+    if (!append_writer->WriteRecordFragment(packer, frag)) {
+      Dmsg2(90, "Got WriteBlockToDev error on device %s. %s\n",
+            dev->print_name(), dev->bstrerror());
+      return false;
+    }
+  } else {
+    while (!packer->Pack(block, frag)) {
+      Dmsg2(850, "!Pack data_len=%d rem=%d\n", frag->data_len,
+            frag->remainder);
+      if (!WriteBlockToDevice()) {
+        Dmsg2(90, "Got WriteBlockToDev error on device %s. %s\n",
+              dev->print_name(), dev->bstrerror());
+        return false;
+      }
+    }
+  }
+
+  jcr->JobBytes += data_len; /* increment bytes this job */
+  if (jcr->impl->RemainingQuota &&
+      jcr->JobBytes > jcr->impl->RemainingQuota) {
+    Jmsg0(jcr, M_FATAL, 0, _("Quota Exceeded. Job Terminated.\n"));
+    return false;
+  }
+
+  return true;
+}
+
 /**
  * Write a Record to the block
  *
@@ -650,18 +831,24 @@ bool DeviceControlRecord::WriteRecord()
 {
   bool retval = false;
   bool translated_record = false;
-  char buf1[100], buf2[100];
 
   /*
    * Perform record translations.
    */
   before_rec = rec;
   after_rec = NULL;
+  record_deferred = false;
   if (GeneratePluginEvent(jcr, bsdEventWriteRecordTranslation, this) !=
       bRC_OK) {
     goto bail_out;
   }
 
+  /*
+   * A plugin translating records asynchronously queued a copy of the record,
+   * write the records it finished in the meantime.
+   */
+  if (record_deferred) { return WriteDeferredRecords(false); }
+
   /*
    * The record got translated when we got an after_rec pointer after calling
    * the bsdEventWriteRecordTranslation plugin event. If no translation has
@@ -674,36 +861,48 @@ bool DeviceControlRecord::WriteRecord()
     translated_record = true;
   }
 
-  while (!WriteRecordToBlock(this, after_rec)) {
-    Dmsg2(850, "!WriteRecordToBlock data_len=%d rem=%d\n", after_rec->data_len,
-          after_rec->remainder);
-    if (!WriteBlockToDevice()) {
-      Dmsg2(90, "Got WriteBlockToDev error on device %s. %s\n",
-            dev->print_name(), dev->bstrerror());
-      goto bail_out;
-    }
-  }
+  retval = WriteTranslatedRecord(after_rec);
 
-  jcr->JobBytes += after_rec->data_len; /* increment bytes this job */
-  if (jcr->impl->RemainingQuota &&
-      jcr->JobBytes > jcr->impl->RemainingQuota) {
-    Jmsg0(jcr, M_FATAL, 0, _("Quota Exceeded. Job Terminated.\n"));
-    goto bail_out;
+bail_out:
+  if (translated_record) {
+    CopyRecordState(before_rec, after_rec);
+    FreeRecord(after_rec);
+    after_rec = NULL;
   }
 
-  Dmsg4(850, "WriteRecord FI=%s SessId=%d Strm=%s len=%d\n",
-        FI_to_ascii(buf1, after_rec->FileIndex), after_rec->VolSessionId,
-        stream_to_ascii(buf2, after_rec->Stream, after_rec->FileIndex),
-        after_rec->data_len);
+  return retval;
+}
+
+/**
+ * Write the records a plugin queued for asynchronous write translation in
+ * their original order. The plugin hands back the next finished record on
+ * each bsdEventFlushRecordTranslation event; with drain set it waits for
+ * every queued record to be translated.
+ *
+ * Returns: false when a record could not be written.
+ */
+bool DeviceControlRecord::WriteDeferredRecords(bool drain)
+{
+  bool retval = true;
 
-  retval = true;
+  drain_deferred = drain;
+  while (retval) {
+    after_rec = NULL;
+    if (GeneratePluginEvent(jcr, bsdEventFlushRecordTranslation, this) !=
+        bRC_OK) {
+      retval = false;
+      break;
+    }
+    if (!after_rec) { break; }
 
-bail_out:
-  if (translated_record) {
-    CopyRecordState(before_rec, after_rec);
+    retval = WriteTranslatedRecord(after_rec);
+    if (retval && deferred_record_written) {
+      retval = deferred_record_written(jcr, after_rec);
+    }
     FreeRecord(after_rec);
     after_rec = NULL;
   }
+  drain_deferred = false;
 
   return retval;
 }
@@ -723,11 +922,21 @@ bail_out:
  *  all fit into the block.
  */
 bool WriteRecordToBlock(DeviceControlRecord* dcr, DeviceRecord* rec)
+{
+  return WriteRecordToBlock(dcr->block, rec);
+}
+
+/**
+ * Write a Record to the given block, see above.
+ *
+ * Used by the asynchronous append writer where the receiving
+ * thread fills a block which is not the dcr->block.
+ */
+bool WriteRecordToBlock(DeviceBlock* block, DeviceRecord* rec)
 {
   ssize_t n;
   bool retval = false;
   char buf1[100], buf2[100];
-  DeviceBlock* block = dcr->block;
 
   /*
    * After this point the record is in nrec not rec e.g. its either converted
@@ -1061,4 +1270,42 @@ bool ReadRecordFromBlock(DeviceControlRecord* dcr, DeviceRecord* rec)
   return true; /* transferred full record */
 }
 
+/**
+ * Parse the record fragment at the start of buf which holds len bytes of
+ * the records of a block, and advance buf and len to the next fragment. The
+ * fragment references the data in buf. For BB01 blocks the session is taken
+ * from the record header, otherwise the caller knows it from the block.
+ *
+ * Returns: false when there is no complete record header left.
+ *          true when a fragment was parsed.
+ */
+bool ParseRecordFragment(const char** buf,
+                         uint32_t* len,
+                         int BlockVer,
+                         RecordFragment* frag)
+{
+  unser_declare;
+  uint32_t rhl = (BlockVer == 1) ? RECHDR1_LENGTH : RECHDR2_LENGTH;
+
+  if (*len < rhl) { return false; }
+
+  UnserBegin(*buf, rhl);
+  if (BlockVer == 1) {
+    unser_uint32(frag->VolSessionId);
+    unser_uint32(frag->VolSessionTime);
+  }
+  unser_int32(frag->FileIndex);
+  unser_int32(frag->Stream);
+  unser_uint32(frag->remainder);
+  *buf += rhl;
+  *len -= rhl;
+
+  frag->data = *buf;
+  frag->data_len = MIN(frag->remainder, *len);
+  *buf += frag->data_len;
+  *len -= frag->data_len;
+
+  return true;
+}
+
 } /* namespace storagedaemon */
@@ -114,6 +114,7 @@ enum
  * This is the memory structure for the record header.
  */
 struct BootStrapRecord; /* satisfy forward reference */
+struct SharedPayload;   /* satisfy forward reference */
 struct DeviceRecord {
   dlink link; /**< link for chaining in read_record.c */
   /**<
@@ -138,6 +139,7 @@ struct DeviceRecord {
   int32_t last_FileIndex{0};
   int32_t last_Stream{0};  /**< Used in SD-SD replication */
   bool own_mempool{false}; /**< Do we own the POOLMEM pointed to in data ? */
+  SharedPayload* payload{nullptr}; /**< Set when blocks may reference data */
 };
 
 /*
@@ -261,6 +263,41 @@ struct DelayedDataStream {
 class DeviceControlRecord; /* Forward Reference */
 struct DeviceBlock;        /* Forward Reference */
 
+/*
+ * Record fragment as stored in a block: a record header and the part of the
+ * record data that fits into the block. Used to copy blocks without putting
+ * the records back together.
+ */
+struct RecordFragment {
+  uint32_t VolSessionId{0};   /**< Sequential id within this session */
+  uint32_t VolSessionTime{0}; /**< Session start time */
+  int32_t FileIndex{0};       /**< Sequential file number */
+  int32_t Stream{0};          /**< Stream, negative for a continuation */
+  uint32_t remainder{0};      /**< Record bytes left including this fragment */
+  const char* data{nullptr};  /**< Data of this fragment */
+  uint32_t data_len{0};       /**< Length of the data of this fragment */
+  SharedPayload* payload{nullptr}; /**< Set when blocks may reference data */
+
+  bool IsPartial() const { return remainder > data_len; }
+};
+
+/*
+ * Packs record fragments into blocks. A partially written record must be
+ * the last one in its block, so the packer remembers an open record at the
+ * end of the block and only allows its continuation to be appended to it.
+ */
+class FragmentPacker {
+ public:
+  bool Pack(DeviceBlock* block, RecordFragment* frag);
+
+ private:
+  DeviceBlock* block_{nullptr}; /**< Block written last */
+  uint32_t binbuf_{0};          /**< Fill level of that block after it */
+  int32_t FileIndex_{0};        /**< File index of the open record */
+  int32_t Stream_{0};           /**< Stream of the open record */
+  uint32_t remainder_{0};       /**< Bytes the open record still misses */
+};
+
 const char* FI_to_ascii(char* buf, int fi);
 const char* stream_to_ascii(char* buf, int stream, int fi);
 const char* record_to_str(PoolMem& resultbuffer,
@@ -268,8 +305,13 @@ const char* record_to_str(PoolMem& resultbuffer,
                           const DeviceRecord* rec);
 void DumpRecord(const char* tag, const DeviceRecord* rec);
 bool WriteRecordToBlock(DeviceControlRecord* dcr, DeviceRecord* rec);
+bool WriteRecordToBlock(DeviceBlock* block, DeviceRecord* rec);
 bool CanWriteRecordToBlock(DeviceBlock* block, const DeviceRecord* rec);
 bool ReadRecordFromBlock(DeviceControlRecord* dcr, DeviceRecord* rec);
+bool ParseRecordFragment(const char** buf,
+                         uint32_t* len,
+                         int BlockVer,
+                         RecordFragment* frag);
 DeviceRecord* new_record(bool with_data = true);
 void EmptyRecord(DeviceRecord* rec);
 void CopyRecordState(DeviceRecord* dst, DeviceRecord* src);
@@ -41,6 +41,10 @@
 #include "include/jcr.h"
 #include "lib/parse_conf.h"
 
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 namespace storagedaemon {
 
 const int debuglevel = 150;
@@ -54,8 +58,27 @@ static int reservations_lock_count = 0;
 
 static brwlock_t reservation_lock;
 
+/*
+ * Lookup of the configured autochangers and devices by name and of the
+ * devices by Media Type, so reserving a device for a job does not scan all
+ * resources for every device name the Director sends. Built on first use
+ * while holding the reservations lock.
+ */
+struct ReservationIndex {
+  std::unordered_map<std::string, AutochangerResource*> changers;
+  std::unordered_map<std::string, DeviceResource*> devices;
+  std::unordered_map<std::string, std::vector<DeviceResource*>> media_types;
+};
+
+static ReservationIndex* reservation_index = nullptr;
+
 /* Forward referenced functions */
 static int CanReserveDrive(DeviceControlRecord* dcr, ReserveContext& rctx);
+static bool IsDeviceBusyForJob(ReserveContext& rctx, Device* dev);
+static void ReadDeviceBusy(JobControlRecord* jcr, Device* dev);
+static void WantedFreeDriveBusy(JobControlRecord* jcr,
+                                Device* dev,
+                                ReserveContext& rctx);
 static int ReserveDevice(ReserveContext& rctx);
 static bool ReserveDeviceForRead(DeviceControlRecord* dcr);
 static bool ReserveDeviceForAppend(DeviceControlRecord* dcr,
@@ -109,6 +132,8 @@ void InitReservationsLock()
 
 void TermReservationsLock()
 {
+  delete reservation_index;
+  reservation_index = nullptr;
   RwlDestroy(&reservation_lock);
   TermVolListLock();
 }
@@ -561,6 +586,37 @@ bool FindSuitableDeviceForJob(JobControlRecord* jcr, ReserveContext& rctx)
   return ok;
 }
 
+static ReservationIndex* GetReservationIndex()
+{
+  AutochangerResource* changer;
+  DeviceResource* device;
+
+  if (reservation_index) { return reservation_index; }
+
+  reservation_index = new ReservationIndex;
+  foreach_res (changer, R_AUTOCHANGER) {
+    reservation_index->changers.emplace(changer->resource_name_, changer);
+  }
+  foreach_res (device, R_DEVICE) {
+    reservation_index->devices.emplace(device->resource_name_, device);
+    reservation_index->media_types[device->media_type].push_back(device);
+  }
+
+  return reservation_index;
+}
+
+static void ShowReservedDevice(ReserveContext& rctx)
+{
+  if (rctx.store->append == SD_APPEND) {
+    Dmsg2(debuglevel, "Device %s reserved=%d for append.\n",
+          rctx.device->resource_name_, rctx.jcr->impl->dcr->dev->NumReserved());
+  } else {
+    Dmsg2(debuglevel, "Device %s reserved=%d for read.\n",
+          rctx.device->resource_name_,
+          rctx.jcr->impl->read_dcr->dev->NumReserved());
+  }
+}
+
 /**
  * Search for a particular storage device with particular storage
  * characteristics (MediaType).
@@ -568,48 +624,32 @@ bool FindSuitableDeviceForJob(JobControlRecord* jcr, ReserveContext& rctx)
 int SearchResForDevice(ReserveContext& rctx)
 {
   int status;
-  AutochangerResource* changer;
+  ReservationIndex* index = GetReservationIndex();
 
   /*
    * Look through Autochangers first
    */
-  foreach_res (changer, R_AUTOCHANGER) {
-    Dmsg2(debuglevel, "Try match changer res=%s, wanted %s\n",
-          changer->resource_name_, rctx.device_name);
+  auto changer = index->changers.find(rctx.device_name);
+  if (changer != index->changers.end()) {
+    Dmsg1(debuglevel, "Found changer res=%s\n", rctx.device_name);
+
     /*
-     * Find resource, and make sure we were able to open it
+     * Try each device in this AutoChanger
      */
-    if (bstrcmp(rctx.device_name, changer->resource_name_)) {
-      /*
-       * Try each device in this AutoChanger
-       */
-      foreach_alist (rctx.device, changer->device) {
-        Dmsg1(debuglevel, "Try changer device %s\n",
+    foreach_alist (rctx.device, changer->second->device) {
+      Dmsg1(debuglevel, "Try changer device %s\n", rctx.device->resource_name_);
+      if (!rctx.device->autoselect) {
+        Dmsg1(100, "Device %s not autoselect skipped.\n",
               rctx.device->resource_name_);
-        if (!rctx.device->autoselect) {
-          Dmsg1(100, "Device %s not autoselect skipped.\n",
-                rctx.device->resource_name_);
-          continue; /* Device is not available */
-        }
-        status = ReserveDevice(rctx);
-        if (status != 1) { /* Try another device */
-          continue;
-        }
-
-        /*
-         * Debug code
-         */
-        if (rctx.store->append == SD_APPEND) {
-          Dmsg2(debuglevel, "Device %s reserved=%d for append.\n",
-                rctx.device->resource_name_,
-                rctx.jcr->impl->dcr->dev->NumReserved());
-        } else {
-          Dmsg2(debuglevel, "Device %s reserved=%d for read.\n",
-                rctx.device->resource_name_,
-                rctx.jcr->impl->read_dcr->dev->NumReserved());
-        }
-        return status;
+        continue; /* Device is not available */
+      }
+      status = ReserveDevice(rctx);
+      if (status != 1) { /* Try another device */
+        continue;
       }
+
+      ShowReservedDevice(rctx);
+      return status;
     }
   }
 
@@ -617,30 +657,13 @@ int SearchResForDevice(ReserveContext& rctx)
    * Now if requested look through regular devices
    */
   if (!rctx.autochanger_only) {
-    foreach_res (rctx.device, R_DEVICE) {
-      Dmsg2(debuglevel, "Try match res=%s wanted %s\n",
-            rctx.device->resource_name_, rctx.device_name);
-
-      /*
-       * Find resource, and make sure we were able to open it
-       */
-      if (bstrcmp(rctx.device_name, rctx.device->resource_name_)) {
-        status = ReserveDevice(rctx);
-        if (status != 1) { /* Try another device */
-          continue;
-        }
-        /*
-         * Debug code
-         */
-        if (rctx.store->append == SD_APPEND) {
-          Dmsg2(debuglevel, "Device %s reserved=%d for append.\n",
-                rctx.device->resource_name_,
-                rctx.jcr->impl->dcr->dev->NumReserved());
-        } else {
-          Dmsg2(debuglevel, "Device %s reserved=%d for read.\n",
-                rctx.device->resource_name_,
-                rctx.jcr->impl->read_dcr->dev->NumReserved());
-        }
+    auto device = index->devices.find(rctx.device_name);
+    if (device != index->devices.end()) {
+      rctx.device = device->second;
+      Dmsg1(debuglevel, "Found res=%s\n", rctx.device->resource_name_);
+      status = ReserveDevice(rctx);
+      if (status == 1) {
+        ShowReservedDevice(rctx);
         return status;
       }
     }
@@ -651,30 +674,18 @@ int SearchResForDevice(ReserveContext& rctx)
      * matching mediatype.
      */
     if (me->device_reserve_by_mediatype) {
-      foreach_res (rctx.device, R_DEVICE) {
-        Dmsg3(debuglevel,
-              "Try match res=%s, mediatype=%s wanted mediatype=%s\n",
-              rctx.device->resource_name_, rctx.store->media_type,
-              rctx.store->media_type);
-
-        if (bstrcmp(rctx.store->media_type, rctx.device->media_type)) {
+      auto devices = index->media_types.find(rctx.store->media_type);
+      if (devices != index->media_types.end()) {
+        for (DeviceResource* candidate : devices->second) {
+          rctx.device = candidate;
+          Dmsg2(debuglevel, "Try res=%s with mediatype=%s\n",
+                rctx.device->resource_name_, rctx.store->media_type);
           status = ReserveDevice(rctx);
           if (status != 1) { /* Try another device */
             continue;
           }
 
-          /*
-           * Debug code
-           */
-          if (rctx.store->append == SD_APPEND) {
-            Dmsg2(debuglevel, "Device %s reserved=%d for append.\n",
-                  rctx.device->resource_name_,
-                  rctx.jcr->impl->dcr->dev->NumReserved());
-          } else {
-            Dmsg2(debuglevel, "Device %s reserved=%d for read.\n",
-                  rctx.device->resource_name_,
-                  rctx.jcr->impl->read_dcr->dev->NumReserved());
-          }
+          ShowReservedDevice(rctx);
           return status;
         }
       }
@@ -728,6 +739,12 @@ static int ReserveDevice(ReserveContext& rctx)
   rctx.suitable_device = true;
   Dmsg1(debuglevel, "try reserve %s\n", rctx.device->resource_name_);
 
+  /*
+   * With many drives most of them are busy while jobs look for one,
+   * so skip those before setting up the dcr for the device.
+   */
+  if (IsDeviceBusyForJob(rctx, rctx.device->dev)) { goto bail_out; }
+
   if (rctx.store->append) {
     SetupNewDcrDevice(rctx.jcr, rctx.jcr->impl->dcr, rctx.device->dev, NULL);
     dcr = rctx.jcr->impl->dcr;
@@ -871,14 +888,7 @@ static bool ReserveDeviceForRead(DeviceControlRecord* dcr)
   }
 
   if (dev->IsBusy()) {
-    Dmsg4(debuglevel,
-          "Device %s is busy ST_READREADY=%d num_writers=%d reserved=%d.\n",
-          dev->print_name(), BitIsSet(ST_READREADY, dev->state) ? 1 : 0,
-          dev->num_writers, dev->NumReserved());
-    Mmsg(jcr->errmsg,
-         _("3602 JobId=%u device %s is busy (already reading/writing).\n"),
-         jcr->JobId, dev->print_name());
-    QueueReserveMessage(jcr);
+    ReadDeviceBusy(jcr, dev);
     goto bail_out;
   }
 
@@ -1045,6 +1055,68 @@ static bool IsMaxJobsOk(DeviceControlRecord* dcr)
   return true;
 }
 
+static void ReadDeviceBusy(JobControlRecord* jcr, Device* dev)
+{
+  Dmsg4(debuglevel,
+        "Device %s is busy ST_READREADY=%d num_writers=%d reserved=%d.\n",
+        dev->print_name(), BitIsSet(ST_READREADY, dev->state) ? 1 : 0,
+        dev->num_writers, dev->NumReserved());
+  Mmsg(jcr->errmsg,
+       _("3602 JobId=%u device %s is busy (already reading/writing).\n"),
+       jcr->JobId, dev->print_name());
+  QueueReserveMessage(jcr);
+}
+
+static void WantedFreeDriveBusy(JobControlRecord* jcr,
+                                Device* dev,
+                                ReserveContext& rctx)
+{
+  /*
+   * Save least used drive
+   */
+  if ((dev->num_writers + dev->NumReserved()) < rctx.num_writers) {
+    rctx.num_writers = dev->num_writers + dev->NumReserved();
+    rctx.low_use_drive = dev;
+    Dmsg2(debuglevel, "set low use drive=%s num_writers=%d\n",
+          dev->print_name(), rctx.num_writers);
+  } else {
+    Dmsg1(debuglevel, "not low use num_writers=%d\n",
+          dev->num_writers + dev->NumReserved());
+  }
+  Mmsg(jcr->errmsg,
+       _("3605 JobId=%u wants free drive but device %s is busy.\n"),
+       jcr->JobId, dev->print_name());
+  Dmsg1(debuglevel, "Failed: %s", jcr->errmsg);
+  QueueReserveMessage(jcr);
+}
+
+/**
+ * Check without a dcr if the device is in use in a way that
+ * ReserveDeviceForRead() or ReserveDeviceForAppend() would refuse it
+ * for this job anyway.
+ */
+static bool IsDeviceBusyForJob(ReserveContext& rctx, Device* dev)
+{
+  JobControlRecord* jcr = rctx.jcr;
+  bool busy = false;
+
+  dev->Lock();
+  if (dev->IsDeviceUnmounted() || !dev->IsBusy()) { goto bail_out; }
+
+  if (!rctx.store->append) {
+    ReadDeviceBusy(jcr, dev);
+    busy = true;
+  } else if (!dev->CanRead() && !rctx.any_drive && !rctx.PreferMountedVols &&
+             !(rctx.try_low_use_drive && dev == rctx.low_use_drive)) {
+    WantedFreeDriveBusy(jcr, dev, rctx);
+    busy = true;
+  }
+
+bail_out:
+  dev->Unlock();
+  return busy;
+}
+
 /**
  * Returns: 1 if drive can be reserved
  *          0 if we should wait
@@ -1084,23 +1156,7 @@ static int CanReserveDrive(DeviceControlRecord* dcr, ReserveContext& rctx)
      * If he wants a free drive, but this one is busy, no go
      */
     if (!rctx.PreferMountedVols && dev->IsBusy()) {
-      /*
-       * Save least used drive
-       */
-      if ((dev->num_writers + dev->NumReserved()) < rctx.num_writers) {
-        rctx.num_writers = dev->num_writers + dev->NumReserved();
-        rctx.low_use_drive = dev;
-        Dmsg2(debuglevel, "set low use drive=%s num_writers=%d\n",
-              dev->print_name(), rctx.num_writers);
-      } else {
-        Dmsg1(debuglevel, "not low use num_writers=%d\n",
-              dev->num_writers + dev->NumReserved());
-      }
-      Mmsg(jcr->errmsg,
-           _("3605 JobId=%u wants free drive but device %s is busy.\n"),
-           jcr->JobId, dev->print_name());
-      Dmsg1(debuglevel, "Failed: %s", jcr->errmsg);
-      QueueReserveMessage(jcr);
+      WantedFreeDriveBusy(jcr, dev, rctx);
       return 0;
     }
 
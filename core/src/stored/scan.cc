@@ -29,6 +29,7 @@
 
 #include "include/bareos.h"
 #include "stored/stored.h"
+#include "stored/backends/aligned_volume.h"
 #include "lib/berrno.h"
 
 namespace storagedaemon {
@@ -102,7 +103,9 @@ bool Device::ScanDirForVolume(DeviceControlRecord* dcr)
     PmStrcpy(fname, mount_point);
     if (need_slash) { PmStrcat(fname, "/"); }
     PmStrcat(fname, result->d_name);
-    if (lstat(fname.c_str(), &statp) != 0 || !S_ISREG(statp.st_mode)) {
+    if (lstat(fname.c_str(), &statp) != 0 ||
+        (!S_ISREG(statp.st_mode) &&
+         !AlignedVolume::IsAlignedVolume(fname.c_str()))) {
       continue; /* ignore directories & special files */
     }
 
@@ -52,7 +52,11 @@ static struct backend_interface_mapping_t {
     {B_FIFO_DEV, "fifo"},     {B_TAPE_DEV, "tape"},
     {B_GFAPI_DEV, "gfapi"},   {B_DROPLET_DEV, "droplet"},
     {B_RADOS_DEV, "rados"},   {B_CEPHFS_DEV, "cephfs"},
-    {B_ELASTO_DEV, "elasto"}, {0, NULL}};
+    {B_ELASTO_DEV, "elasto"}, {B_CHUNKDIR_DEV, "chunkdir"},
+#ifdef HAVE_LMDB
+    {B_DEDUP_DEV, "dedup"},
+#endif
+    {0, NULL}};
 
 
 /**
@@ -85,6 +85,13 @@ static char NOT_opened[] = "3902 Error replicate session not opened\n";
 static char ERROR_replicate[] = "3903 Error replicate data\n";
 static char OK_end_replicate[] = "3000 OK end replicate\n";
 static char OK_start_replicate[] = "3000 OK start replicate ticket = %d\n";
+static char OK_start_replicate_blocks[] =
+    "3000 OK start replicate ticket = %d blocks\n";
+
+/**
+ * Commands received from the Remote Storage daemon
+ */
+static char start_replicate_blocks[] = "start replicate blocks";
 
 /**
  * Responses sent to the Director
@@ -292,6 +299,19 @@ cleanup:
   return false;
 }
 
+/**
+ * Whole blocks can be replicated when no plugin translates the records on
+ * write.
+ */
+static bool CanReplicateBlocks(JobControlRecord* jcr)
+{
+  DeviceControlRecord* dcr = jcr->impl->dcr;
+
+  if (!me->block_replication || !dcr || !dcr->device) { return false; }
+
+  return !PluginsTranslateRecords(jcr, dcr, false);
+}
+
 /**
  * Start of replication.
  */
@@ -307,11 +327,17 @@ static bool StartReplicationSession(JobControlRecord* jcr)
   }
 
   jcr->impl->session_opened = true;
+  jcr->impl->replicate_blocks =
+      bstrncmp(sd->msg, start_replicate_blocks,
+               strlen(start_replicate_blocks)) &&
+      CanReplicateBlocks(jcr);
 
   /*
    * Send "Ticket" to Storage Daemon
    */
-  sd->fsend(OK_start_replicate, jcr->VolSessionId);
+  sd->fsend(jcr->impl->replicate_blocks ? OK_start_replicate_blocks
+                                        : OK_start_replicate,
+            jcr->VolSessionId);
   Dmsg1(110, ">stored: %s", sd->msg);
 
   return true;
@@ -370,6 +370,45 @@ bail_out:
   return rc;
 }
 
+/**
+ * See if any plugin of the job translates the records read or written through
+ * the given DeviceControlRecord. Every plugin registered for the record
+ * translation event is asked with psdVarRecordTranslation, a plugin that
+ * doesn't answer is assumed to translate the records.
+ */
+bool PluginsTranslateRecords(JobControlRecord* jcr,
+                             DeviceControlRecord* dcr,
+                             bool reading)
+{
+  int i;
+  bpContext* ctx;
+  bsdEventType eventType = (reading) ? bsdEventReadRecordTranslation
+                                     : bsdEventWriteRecordTranslation;
+
+  if (!sd_plugin_list || !jcr || !jcr->plugin_ctx_list) { return false; }
+
+  foreach_alist_index (i, ctx, jcr->plugin_ctx_list) {
+    psdRecordTranslation query;
+
+    if (!IsEventEnabled(ctx, eventType) || IsPluginDisabled(ctx)) {
+      continue;
+    }
+
+    query.dcr = dcr;
+    query.reading = reading;
+    query.translates = true;
+    SdplugFunc(ctx->plugin)
+        ->getPluginValue(ctx, psdVarRecordTranslation, &query);
+    if (query.translates) {
+      Dmsg2(debuglevel, "Plugin %s translates records on %s\n",
+            ctx->plugin->file, (reading) ? "read" : "write");
+      return true;
+    }
+  }
+
+  return false;
+}
+
 /**
  * Print to file the plugin info.
  */
@@ -119,10 +119,12 @@ typedef enum
   bsdEventDeviceRelease = 21,
   bsdEventNewPluginOptions = 22,
   bsdEventChangerLock = 23,
-  bsdEventChangerUnlock = 24
+  bsdEventChangerUnlock = 24,
+  bsdEventFlushRecordTranslation = 25
 } bsdEventType;
 
-#define SD_NR_EVENTS bsdEventChangerUnlock /**< keep this updated ! */
+#define SD_NR_EVENTS \
+  bsdEventFlushRecordTranslation /**< keep this updated ! */
 
 typedef struct s_bsdEvent {
   uint32_t eventType;
@@ -190,6 +192,9 @@ bRC GeneratePluginEvent(JobControlRecord* jcr,
                         bsdEventType event,
                         void* value = NULL,
                         bool reverse = false);
+bool PluginsTranslateRecords(JobControlRecord* jcr,
+                             DeviceControlRecord* dcr,
+                             bool reading);
 #endif
 
 /*
@@ -199,9 +204,21 @@ bRC GeneratePluginEvent(JobControlRecord* jcr,
 typedef enum
 {
   psdVarName = 1,
-  psdVarDescription = 2
+  psdVarDescription = 2,
+  psdVarRecordTranslation = 3
 } psdVariable;
 
+/*
+ * Value of psdVarRecordTranslation, asked from a plugin registered for the
+ * read or write record translation event. The plugin clears translates when
+ * it leaves the records read or written through dcr untouched.
+ */
+typedef struct s_sdRecordTranslation {
+  DeviceControlRecord* dcr;
+  bool reading;
+  bool translates;
+} psdRecordTranslation;
+
 #define SD_PLUGIN_MAGIC "*SDPluginData*"
 #define SD_PLUGIN_INTERFACE_VERSION 4
 
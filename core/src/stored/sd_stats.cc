@@ -33,6 +33,9 @@
 #include "include/jcr.h"
 #include "lib/parse_conf.h"
 #include "lib/bsock.h"
+#include "lib/output_formatter.h"
+
+#include <vector>
 
 namespace storagedaemon {
 
@@ -45,6 +48,7 @@ static char DevStats[] =
 static char TapeAlerts[] = "Tapealerts [%lld]: Device=%s TapeAlert=%llu\n";
 static char JobStats[] =
     "Jobstats [%lld]: JobId=%ld, JobFiles=%lu, JobBytes=%llu, DevName=%s\n";
+static char StatsJson[] = "stats json";
 
 /* Static globals */
 static bool quit = false;
@@ -93,11 +97,27 @@ struct job_statistic {
   char* DevName{nullptr};
 };
 
+/*
+ * Number of throughput samples kept per job, at the default collect
+ * interval of 150 seconds that is the last two and a half hours.
+ */
+#define JOB_THROUGHPUT_SAMPLES 60
+
+struct job_throughput {
+  utime_t timestamp;
+  uint64_t bytes_per_sec;
+};
+
 struct job_statistics {
   dlink link;
   uint32_t JobId{0};
   struct job_statistic* cached{nullptr};
   dlist* statistics{nullptr};
+  utime_t last_sample_time{0};
+  uint64_t last_sample_bytes{0};
+  int num_throughput{0};  /* Samples in throughput */
+  int next_throughput{0}; /* Index of the next sample to overwrite */
+  struct job_throughput throughput[JOB_THROUGHPUT_SAMPLES]{};
 };
 
 static dlist* device_statistics = NULL;
@@ -250,6 +270,36 @@ static inline void UpdateDeviceStatistics(const char* devname,
         dev_stat->VolCatBlocks);
 }
 
+/*
+ * Add the throughput since the last sample to the series of the job, also
+ * when nothing was written so a stalled job shows up.
+ */
+static inline void RecordJobThroughput(struct job_statistics* job_stats,
+                                       uint64_t JobBytes,
+                                       utime_t now)
+{
+  struct job_throughput* sample;
+
+  if (now <= job_stats->last_sample_time) { return; }
+
+  P(mutex);
+  sample = &job_stats->throughput[job_stats->next_throughput];
+  sample->timestamp = now;
+  sample->bytes_per_sec =
+      JobBytes > job_stats->last_sample_bytes
+          ? (JobBytes - job_stats->last_sample_bytes) /
+                (now - job_stats->last_sample_time)
+          : 0;
+  job_stats->next_throughput =
+      (job_stats->next_throughput + 1) % JOB_THROUGHPUT_SAMPLES;
+  if (job_stats->num_throughput < JOB_THROUGHPUT_SAMPLES) {
+    job_stats->num_throughput++;
+  }
+  job_stats->last_sample_time = now;
+  job_stats->last_sample_bytes = JobBytes;
+  V(mutex);
+}
+
 void UpdateJobStatistics(JobControlRecord* jcr, utime_t now)
 {
   bool found = false;
@@ -273,6 +323,8 @@ void UpdateJobStatistics(JobControlRecord* jcr, utime_t now)
     }
   }
 
+  if (found) { RecordJobThroughput(job_stats, jcr->JobBytes, now); }
+
   /*
    * If we have statistics and the cached entry is filled it points
    * to the latest sampled statistics so we compare them with the current
@@ -291,6 +343,8 @@ void UpdateJobStatistics(JobControlRecord* jcr, utime_t now)
     *job_stats = empty_job_statistics;
 
     job_stats->JobId = jcr->JobId;
+    job_stats->last_sample_time = now;
+    job_stats->last_sample_bytes = jcr->JobBytes;
     P(mutex);
     job_statistics->append(job_stats);
     V(mutex);
@@ -472,12 +526,128 @@ void StopStatisticsThread()
   }
 }
 
+/**
+ * Latency histograms of all devices and the throughput series of the
+ * running jobs as a JSON document.
+ */
+/**
+ * Format the latency histograms of all devices and the throughput series of
+ * the running jobs.
+ */
+void LatencyStatisticsFormat(OutputFormatter* of)
+{
+  DeviceResource* device;
+  struct job_samples {
+    uint32_t JobId;
+    std::vector<job_throughput> throughput;
+  };
+  std::vector<job_samples> jobs;
+
+  of->ArrayStart("devices");
+  foreach_res (device, R_DEVICE) {
+    Device* dev = device->dev;
+
+    if (!dev || dev->latencies.empty()) { continue; }
+
+    of->ObjectStart();
+    of->ObjectKeyValue("name", "%s=", device->resource_name_, "%s");
+    of->ObjectKeyValue("streaming_underruns", " %s=",
+                       (uint64_t)dev->streaming_underruns, "%llu\n");
+    of->ObjectStart("latency");
+    dev->latencies.Format(of);
+    of->ObjectEnd("latency");
+    of->ObjectEnd();
+  }
+  of->ArrayEnd("devices");
+
+  /*
+   * Take a copy of the samples, the formatter may already send while we
+   * go through them.
+   */
+  P(mutex);
+  if (job_statistics) {
+    struct job_statistics* job_stats;
+
+    foreach_dlist (job_stats, job_statistics) {
+      int oldest = job_stats->num_throughput < JOB_THROUGHPUT_SAMPLES
+                       ? 0
+                       : job_stats->next_throughput;
+
+      jobs.push_back(job_samples{job_stats->JobId, {}});
+      for (int i = 0; i < job_stats->num_throughput; i++) {
+        jobs.back().throughput.push_back(
+            job_stats->throughput[(oldest + i) % JOB_THROUGHPUT_SAMPLES]);
+      }
+    }
+  }
+  V(mutex);
+
+  of->ArrayStart("jobs");
+  for (const auto& job : jobs) {
+    of->ObjectStart();
+    of->ObjectKeyValue("jobid", "%s=", (uint64_t)job.JobId, "%llu\n");
+    of->ArrayStart("throughput");
+    for (const auto& sample : job.throughput) {
+      of->ObjectStart();
+      of->ObjectKeyValue("time", "  %s=", (uint64_t)sample.timestamp, "%llu");
+      of->ObjectKeyValue("bytes_per_sec", " %s=", sample.bytes_per_sec,
+                         "%llu\n");
+      of->ObjectEnd();
+    }
+    of->ArrayEnd("throughput");
+    of->ObjectEnd();
+  }
+  of->ArrayEnd("jobs");
+}
+
+/**
+ * Send the latency statistics as JSON, or as plain text when built without
+ * JSON support.
+ */
+void SendLatencyStatistics(bool (*send_func)(void* ctx, const char* msg),
+                           void* send_ctx)
+{
+#if HAVE_JANSSON
+  OutputFormatter of(send_func, send_ctx, NULL, NULL, API_MODE_JSON);
+#else
+  OutputFormatter of(send_func, send_ctx, NULL, NULL, API_MODE_OFF);
+#endif
+
+  of.SetCompact(true);
+  LatencyStatisticsFormat(&of);
+  of.FinalizeResult(true);
+}
+
+/*
+ * The JSON document comes without a trailing newline, the plain text
+ * output with one.
+ */
+static bool SendToDirector(void* ctx, const char* msg)
+{
+  BareosSocket* dir = (BareosSocket*)ctx;
+  size_t len = strlen(msg);
+
+  Dmsg1(100, ">dird: %s\n", msg);
+  return dir->fsend((len && msg[len - 1] == '\n') ? "%s" : "%s\n", msg);
+}
+
 bool StatsCmd(JobControlRecord* jcr)
 {
   BareosSocket* dir = jcr->dir_bsock;
   PoolMem msg(PM_MESSAGE);
   PoolMem dev_tmp(PM_MESSAGE);
 
+  /*
+   * "stats json" only reports the latency histograms and throughput series
+   * and leaves the samples for the Director's statistics collector alone.
+   */
+  if (bstrncmp(dir->msg, StatsJson, strlen(StatsJson))) {
+    SendLatencyStatistics(SendToDirector, dir);
+    dir->fsend(OKstats);
+
+    return false;
+  }
+
   if (device_statistics) {
     struct device_statistics* dev_stats;
 
@@ -21,12 +21,17 @@
 #ifndef BAREOS_STORED_SD_STATS_H_
 #define BAREOS_STORED_SD_STATS_H_
 
+class OutputFormatter;
+
 namespace storagedaemon {
 
 int StartStatisticsThread(void);
 void StopStatisticsThread();
 void UpdateDeviceTapealert(const char* devname, uint64_t flags, utime_t now);
 void UpdateJobStatistics(JobControlRecord* jcr, utime_t now);
+void LatencyStatisticsFormat(OutputFormatter* of);
+void SendLatencyStatistics(bool (*send_func)(void* ctx, const char* msg),
+                           void* send_ctx);
 bool StatsCmd(JobControlRecord* jcr);
 
 } /* namespace storagedaemon */
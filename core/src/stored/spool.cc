@@ -33,23 +33,33 @@
 #include "stored/acquire.h"
 #include "stored/device.h"
 #include "stored/jcr_private.h"
+#include "lib/attribute_spool.h"
 #include "lib/berrno.h"
+#include "lib/cbuf.h"
 #include "lib/bsock.h"
 #include "lib/edit.h"
 #include "lib/util.h"
+#include "lib/thread_specific_data.h"
 #include "include/jcr.h"
+#include "include/make_unique.h"
+
+#include <atomic>
 
 namespace storagedaemon {
 
 /* Forward referenced subroutines */
 static void MakeUniqueDataSpoolFilename(DeviceControlRecord* dcr,
-                                        POOLMEM*& name);
+                                        POOLMEM*& name,
+                                        int stripe);
 static bool OpenDataSpoolFile(DeviceControlRecord* dcr);
 static bool CloseDataSpoolFile(DeviceControlRecord* dcr, bool end_of_spool);
 static bool DespoolData(DeviceControlRecord* dcr, bool commit);
-static int ReadBlockFromSpoolFile(DeviceControlRecord* dcr);
+static int ReadBlockFromSpoolFile(DeviceControlRecord* dcr,
+                                  DeviceBlock* block);
 static bool OpenAttrSpoolFile(JobControlRecord* jcr, BareosSocket* bs);
 static bool CloseAttrSpoolFile(JobControlRecord* jcr, BareosSocket* bs);
+static bool AttributeSpoolCommitDue(JobControlRecord* jcr);
+static bool CommitAttributeSpoolChunk(JobControlRecord* jcr);
 static bool WriteSpoolHeader(DeviceControlRecord* dcr);
 static bool WriteSpoolData(DeviceControlRecord* dcr);
 
@@ -82,6 +92,156 @@ enum
   RB_OK
 };
 
+/**
+ * Reads the spooled blocks ahead of the despooling thread, so the device
+ * gets the next block as soon as the previous one is written instead of
+ * waiting for the spool disk each time. The number of blocks read ahead is
+ * configured with the "Despool Buffers" directive of the Device resource.
+ *
+ * The reader thread fills the blocks of the buffers on the free_buffers_
+ * queue and hands them to the despooling thread via the full_buffers_ queue.
+ * The despooling thread swaps the full block into dcr->block and returns the
+ * buffer (now holding its previous block) via the free_buffers_ queue.
+ */
+class DespoolReader {
+ public:
+  DespoolReader(DeviceControlRecord* rdcr, int nr_buffers);
+  ~DespoolReader();
+
+  bool Start();
+  void Stop();
+  int NextBlock(DeviceControlRecord* dcr);
+  btime_t WriterStallTime() const { return writer_stall_; }
+
+ private:
+  struct DespoolBuffer {
+    DeviceBlock* block = nullptr;
+    int status = RB_OK;
+  };
+
+  DeviceControlRecord* rdcr_ = nullptr;
+  std::vector<DespoolBuffer> buffers_;
+  CircularBuffer free_buffers_;
+  CircularBuffer full_buffers_;
+  pthread_t thread_id_;
+  bool running_ = false;
+  std::atomic<bool> stop_{false};
+  btime_t writer_stall_ = 0; /**< Time the device waited for the spool disk */
+
+  static void* reader_thread(void* data);
+  void ReadBlocks();
+};
+
+DespoolReader::DespoolReader(DeviceControlRecord* rdcr, int nr_buffers)
+    : rdcr_(rdcr)
+    , buffers_(nr_buffers)
+    , free_buffers_(nr_buffers)
+    , full_buffers_(nr_buffers)
+{
+  for (auto& buffer : buffers_) { buffer.block = new_block(rdcr_->dev); }
+}
+
+DespoolReader::~DespoolReader()
+{
+  Stop();
+
+  for (auto& buffer : buffers_) {
+    if (buffer.block) { FreeBlock(buffer.block); }
+  }
+}
+
+bool DespoolReader::Start()
+{
+  int status;
+
+  for (auto& buffer : buffers_) { free_buffers_.enqueue(&buffer); }
+
+  if ((status = pthread_create(&thread_id_, NULL, reader_thread, this)) != 0) {
+    BErrNo be;
+    Jmsg1(rdcr_->jcr, M_WARNING, 0,
+          _("Cannot create despool reader thread: ERR=%s\n"),
+          be.bstrerror(status));
+    return false;
+  }
+
+  running_ = true;
+  Dmsg1(100, "Started despool reader with %d buffers\n",
+        (int)buffers_.size());
+
+  return true;
+}
+
+/**
+ * Stop the reader thread, also when it did not reach the end of the
+ * spool file(s) yet because despooling failed or the job got canceled.
+ */
+void DespoolReader::Stop()
+{
+  if (!running_) { return; }
+
+  stop_ = true;
+  free_buffers_.flush();
+  full_buffers_.flush();
+  pthread_join(thread_id_, NULL);
+  running_ = false;
+
+  Dmsg1(100, "Stopped despool reader writer stall=%lld usec\n",
+        writer_stall_);
+}
+
+/**
+ * Make the next spooled block the dcr->block.
+ *
+ * Returns the status of ReadBlockFromSpoolFile() for that block.
+ */
+int DespoolReader::NextBlock(DeviceControlRecord* dcr)
+{
+  int status;
+  btime_t start;
+  DespoolBuffer* buffer;
+
+  start = GetCurrentBtime();
+  buffer = (DespoolBuffer*)full_buffers_.dequeue();
+  writer_stall_ += GetCurrentBtime() - start;
+  if (!buffer) { return RB_ERROR; }
+
+  status = buffer->status;
+  if (status == RB_OK) {
+    buffer->block->BlockNumber = dcr->block->BlockNumber;
+    std::swap(dcr->block, buffer->block);
+  }
+  free_buffers_.enqueue(buffer);
+
+  return status;
+}
+
+void DespoolReader::ReadBlocks()
+{
+  DespoolBuffer* buffer;
+
+  while (!stop_) {
+    buffer = (DespoolBuffer*)free_buffers_.dequeue();
+    if (!buffer || stop_) { break; }
+
+    /*
+     * The full queue can hold all buffers so this never blocks.
+     */
+    buffer->status = ReadBlockFromSpoolFile(rdcr_, buffer->block);
+    full_buffers_.enqueue(buffer);
+    if (buffer->status != RB_OK) { break; }
+  }
+}
+
+void* DespoolReader::reader_thread(void* data)
+{
+  DespoolReader* reader = (DespoolReader*)data;
+
+  SetJcrInThreadSpecificData(reader->rdcr_->jcr);
+  reader->ReadBlocks();
+
+  return NULL;
+}
+
 void ListSpoolStats(void sendit(const char* msg, int len, void* sarg),
                     void* arg)
 {
@@ -163,58 +323,108 @@ bool CommitDataSpool(DeviceControlRecord* dcr)
   return true;
 }
 
+/**
+ * When more than one Spool Directory is configured the spool area of a
+ * device is striped over all of them, each block goes to the next stripe.
+ */
+static int NumberOfSpoolStripes(DeviceControlRecord* dcr)
+{
+  alist* spool_directories = dcr->dev->device->spool_directories;
+
+  if (!spool_directories || spool_directories->size() < 2) { return 1; }
+
+  return spool_directories->size();
+}
+
 static void MakeUniqueDataSpoolFilename(DeviceControlRecord* dcr,
-                                        POOLMEM*& name)
+                                        POOLMEM*& name,
+                                        int stripe)
 {
   const char* dir;
+  alist* spool_directories = dcr->dev->device->spool_directories;
 
-  if (dcr->dev->device->spool_directory) {
-    dir = dcr->dev->device->spool_directory;
+  if (spool_directories && !spool_directories->empty()) {
+    dir = (const char*)spool_directories->get(stripe);
   } else {
     dir = working_directory;
   }
 
-  Mmsg(name, "%s/%s.data.%u.%s.%s.spool", dir, my_name, dcr->jcr->JobId,
-       dcr->jcr->Job, dcr->device->resource_name_);
+  if (NumberOfSpoolStripes(dcr) > 1) {
+    Mmsg(name, "%s/%s.data.%u.%s.%s.%d.spool", dir, my_name, dcr->jcr->JobId,
+         dcr->jcr->Job, dcr->device->resource_name_, stripe);
+  } else {
+    Mmsg(name, "%s/%s.data.%u.%s.%s.spool", dir, my_name, dcr->jcr->JobId,
+         dcr->jcr->Job, dcr->device->resource_name_);
+  }
+}
+
+/**
+ * Close and delete all spool stripes opened so far.
+ */
+static void RemoveDataSpoolFiles(DeviceControlRecord* dcr)
+{
+  POOLMEM* name = GetPoolMemory(PM_MESSAGE);
+
+  for (size_t stripe = 0; stripe < dcr->spool_fds.size(); stripe++) {
+    close(dcr->spool_fds[stripe]);
+    MakeUniqueDataSpoolFilename(dcr, name, stripe);
+    SecureErase(dcr->jcr, name);
+    Dmsg1(100, "Deleted spool file: %s\n", name);
+  }
+  dcr->spool_fds.clear();
+  dcr->spool_stripe = 0;
+  dcr->spool_fd = -1;
+
+  FreePoolMemory(name);
+}
+
+/**
+ * Continue spooling (or reading the spool) on the next stripe.
+ */
+static void NextSpoolStripe(DeviceControlRecord* dcr)
+{
+  if (dcr->spool_fds.size() > 1) {
+    dcr->spool_stripe = (dcr->spool_stripe + 1) % dcr->spool_fds.size();
+    dcr->spool_fd = dcr->spool_fds[dcr->spool_stripe];
+  }
 }
 
 static bool OpenDataSpoolFile(DeviceControlRecord* dcr)
 {
   int spool_fd;
+  int stripes = NumberOfSpoolStripes(dcr);
   POOLMEM* name = GetPoolMemory(PM_MESSAGE);
 
-  MakeUniqueDataSpoolFilename(dcr, name);
-  if ((spool_fd = open(name, O_CREAT | O_TRUNC | O_RDWR | O_BINARY, 0640)) >=
-      0) {
-    dcr->spool_fd = spool_fd;
-    dcr->jcr->impl->spool_attributes = true;
-  } else {
-    BErrNo be;
+  dcr->spool_fds.clear();
+  for (int stripe = 0; stripe < stripes; stripe++) {
+    MakeUniqueDataSpoolFilename(dcr, name, stripe);
+    if ((spool_fd = open(name, O_CREAT | O_TRUNC | O_RDWR | O_BINARY, 0640)) <
+        0) {
+      BErrNo be;
 
-    Jmsg(dcr->jcr, M_FATAL, 0, _("Open data spool file %s failed: ERR=%s\n"),
-         name, be.bstrerror());
-    FreePoolMemory(name);
-    return false;
+      Jmsg(dcr->jcr, M_FATAL, 0, _("Open data spool file %s failed: ERR=%s\n"),
+           name, be.bstrerror());
+      FreePoolMemory(name);
+      RemoveDataSpoolFiles(dcr);
+      return false;
+    }
+    dcr->spool_fds.push_back(spool_fd);
+    Dmsg1(100, "Created spool file: %s\n", name);
   }
-  Dmsg1(100, "Created spool file: %s\n", name);
   FreePoolMemory(name);
 
+  dcr->spool_stripe = 0;
+  dcr->spool_fd = dcr->spool_fds[0];
+  dcr->jcr->impl->spool_attributes = true;
+
   return true;
 }
 
 static bool CloseDataSpoolFile(DeviceControlRecord* dcr, bool end_of_spool)
 {
-  POOLMEM* name = GetPoolMemory(PM_MESSAGE);
-
-  close(dcr->spool_fd);
-  dcr->spool_fd = -1;
+  RemoveDataSpoolFiles(dcr);
   dcr->spooling = false;
 
-  MakeUniqueDataSpoolFilename(dcr, name);
-  SecureErase(dcr->jcr, name);
-  Dmsg1(100, "Deleted spool file: %s\n", name);
-  FreePoolMemory(name);
-
   P(mutex);
   spool_stats.data_jobs--;
   if (end_of_spool) { spool_stats.total_data_jobs++; }
@@ -249,6 +459,7 @@ static bool DespoolData(DeviceControlRecord* dcr, bool commit)
   int status;
   char ec1[50];
   BareosSocket* dir = jcr->dir_bsock;
+  std::unique_ptr<DespoolReader> reader;
 
   Dmsg0(100, "Despooling data\n");
   if (jcr->impl->dcr->job_spool_size == 0) {
@@ -301,16 +512,30 @@ static bool DespoolData(DeviceControlRecord* dcr, bool commit)
   rdev->device = dcr->dev->device;
   rdcr = dcr->get_new_spooling_dcr();
   SetupNewDcrDevice(jcr, rdcr, rdev, NULL);
-  rdcr->spool_fd = dcr->spool_fd;
+  rdcr->spool_fds = dcr->spool_fds;
+  rdcr->spool_stripe = 0;
+  rdcr->spool_fd = rdcr->spool_fds[0];
   block = dcr->block;       /* save block */
   dcr->block = rdcr->block; /* make read and write block the same */
 
   Dmsg1(800, "read/write block size = %d\n", block->buf_len);
-  lseek(rdcr->spool_fd, 0, SEEK_SET); /* rewind */
+  for (int spool_fd : rdcr->spool_fds) {
+    lseek(spool_fd, 0, SEEK_SET); /* rewind */
 
 #if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED)
-  posix_fadvise(rdcr->spool_fd, 0, 0, POSIX_FADV_WILLNEED);
+    posix_fadvise(spool_fd, 0, 0, POSIX_FADV_WILLNEED);
 #endif
+  }
+
+  /*
+   * See if we should read ahead in a separate thread, if that thread
+   * cannot be started we despool synchronously.
+   */
+  if (dcr->dev->device->despool_buffers > 0) {
+    reader = std::make_unique<DespoolReader>(
+        rdcr, dcr->dev->device->despool_buffers);
+    if (!reader->Start()) { reader.reset(); }
+  }
 
   /* Add run time, to get current wait time */
   int32_t despool_start = time(NULL) - jcr->run_time;
@@ -322,7 +547,11 @@ static bool DespoolData(DeviceControlRecord* dcr, bool commit)
       ok = false;
       break;
     }
-    status = ReadBlockFromSpoolFile(rdcr);
+    if (reader) {
+      status = reader->NextBlock(dcr);
+    } else {
+      status = ReadBlockFromSpoolFile(rdcr, dcr->block);
+    }
     if (status == RB_EOT) {
       break;
     } else if (status == RB_ERROR) {
@@ -342,6 +571,18 @@ static bool DespoolData(DeviceControlRecord* dcr, bool commit)
           block->LastIndex);
   }
 
+  /*
+   * The read ahead buffers now own the block we started with,
+   * so hand the block we ended up with to rdcr to be freed.
+   */
+  if (reader) {
+    reader->Stop();
+    Dmsg1(100, "Despooling waited %lld usec for the spool disk\n",
+          reader->WriterStallTime());
+    reader.reset();
+    rdcr->block = dcr->block;
+  }
+
   /*
    * If this Job is incomplete, we need to backup the FileIndex
    *  to the last correctly saved file so that the JobMedia
@@ -387,16 +628,20 @@ static bool DespoolData(DeviceControlRecord* dcr, bool commit)
     CloseDataSpoolFile(dcr, false);
     BeginDataSpool(dcr);
   } else {
-    lseek(rdcr->spool_fd, 0, SEEK_SET); /* rewind */
-    if (ftruncate(rdcr->spool_fd, 0) != 0) {
-      BErrNo be;
-
-      Jmsg(jcr, M_ERROR, 0, _("Ftruncate spool file failed: ERR=%s\n"),
-           be.bstrerror());
-      /*
-       * Note, try continuing despite ftruncate problem
-       */
+    for (int spool_fd : dcr->spool_fds) {
+      lseek(spool_fd, 0, SEEK_SET); /* rewind */
+      if (ftruncate(spool_fd, 0) != 0) {
+        BErrNo be;
+
+        Jmsg(jcr, M_ERROR, 0, _("Ftruncate spool file failed: ERR=%s\n"),
+             be.bstrerror());
+        /*
+         * Note, try continuing despite ftruncate problem
+         */
+      }
     }
+    dcr->spool_stripe = 0;
+    dcr->spool_fd = dcr->spool_fds[0];
 
     P(mutex);
     if (spool_stats.data_size < dcr->job_spool_size) {
@@ -431,23 +676,36 @@ static bool DespoolData(DeviceControlRecord* dcr, bool commit)
   if (!commit) { dcr->dev->dunblock(); }
   jcr->sendJobStatus(JS_Running);
 
+  /*
+   * The data of all attributes spooled so far is on the Volume now.
+   */
+  if (ok && !commit) {
+    /*
+     * We may run on the append writer thread while the receiving thread
+     * spools attributes.
+     */
+    jcr->impl->dir_mutex->lock();
+    if (AttributeSpoolCommitDue(jcr)) { ok = CommitAttributeSpoolChunk(jcr); }
+    jcr->impl->dir_mutex->unlock();
+  }
+
   return ok;
 }
 
 /**
- * Read a block from the spool file
+ * Read the next block from the spool file (stripes) into block
  *
  *  Returns RB_OK on success
  *          RB_EOT when file done
  *          RB_ERROR on error
  */
-static int ReadBlockFromSpoolFile(DeviceControlRecord* dcr)
+static int ReadBlockFromSpoolFile(DeviceControlRecord* dcr, DeviceBlock* block)
 {
   uint32_t rlen;
   ssize_t status;
   spool_hdr hdr;
-  DeviceBlock* block = dcr->block;
   JobControlRecord* jcr = dcr->jcr;
+  btime_t start = GetCurrentBtime();
 
   rlen = sizeof(hdr);
   status = read(dcr->spool_fd, (char*)&hdr, (size_t)rlen);
@@ -480,6 +738,8 @@ static int ReadBlockFromSpoolFile(DeviceControlRecord* dcr)
     return RB_ERROR;
   }
   status = read(dcr->spool_fd, (char*)block->buf, (size_t)rlen);
+  dcr->dev->latencies.Record(DeviceLatencyKind::kSpoolRead,
+                             GetCurrentBtime() - start);
   if (status != (ssize_t)rlen) {
     Pmsg2(000, _("Spool data read error. Wanted %u bytes, got %d\n"), rlen,
           status);
@@ -496,6 +756,13 @@ static int ReadBlockFromSpoolFile(DeviceControlRecord* dcr)
   block->VolSessionId = dcr->jcr->VolSessionId;
   block->VolSessionTime = dcr->jcr->VolSessionTime;
   Dmsg2(800, "Read block FI=%d LI=%d\n", block->FirstIndex, block->LastIndex);
+
+  /*
+   * Blocks are striped round robin, so the first stripe without
+   * a next block also marks the end of the spooled data.
+   */
+  NextSpoolStripe(dcr);
+
   return RB_OK;
 }
 
@@ -516,6 +783,7 @@ bool WriteBlockToSpoolFile(DeviceControlRecord* dcr)
   if (block->binbuf <= WRITE_BLKHDR_LENGTH) { /* Does block have data in it? */
     return true;
   }
+  FlattenBlock(block);
 
   hlen = sizeof(spool_hdr);
   wlen = block->binbuf;
@@ -566,6 +834,7 @@ bool WriteBlockToSpoolFile(DeviceControlRecord* dcr)
 
   if (!WriteSpoolHeader(dcr)) { return false; }
   if (!WriteSpoolData(dcr)) { return false; }
+  NextSpoolStripe(dcr);
 
   Dmsg2(800, "Wrote block FI=%d LI=%d\n", block->FirstIndex, block->LastIndex);
   EmptyBlock(block);
@@ -638,7 +907,11 @@ static bool WriteSpoolData(DeviceControlRecord* dcr)
    * Write data
    */
   for (int retry = 0; retry <= 1; retry++) {
+    btime_t start = GetCurrentBtime();
+
     status = write(dcr->spool_fd, block->buf, (size_t)block->binbuf);
+    dcr->dev->latencies.Record(DeviceLatencyKind::kSpoolWrite,
+                               GetCurrentBtime() - start);
     if (status == -1) {
       BErrNo be;
 
@@ -734,11 +1007,57 @@ static void MakeUniqueSpoolFilename(JobControlRecord* jcr,
        fd);
 }
 
+static void UpdateMaxAttrSpoolSize(boffset_t size)
+{
+  P(mutex);
+  if (spool_stats.attr_size + size > spool_stats.max_attr_size) {
+    spool_stats.max_attr_size = spool_stats.attr_size + size;
+  }
+  spool_stats.attr_size += size;
+  V(mutex);
+}
+
+/**
+ * Send the spooled attributes record by record over the network.
+ */
+static bool SendAttrSpoolFile(JobControlRecord* jcr, boffset_t size)
+{
+  int status;
+  BareosSocket* dir = jcr->dir_bsock;
+  AttributeSpoolReader reader(dir->spool_fd_);
+
+  if (lseek(dir->spool_fd_, 0, SEEK_SET) == -1) {
+    Qmsg(jcr, M_FATAL, 0, _("attr spool I/O error.\n"));
+    UpdateAttrSpoolSize(size);
+    return false;
+  }
+
+#if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED)
+  posix_fadvise(dir->spool_fd_, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+
+  while ((status = reader.Next(dir->msg, dir->message_length)) > 0) {
+    dir->send();
+    if (JobCanceled(jcr)) { break; }
+  }
+  UpdateAttrSpoolSize(size);
+
+  if (status < 0) {
+    BErrNo be;
+
+    Qmsg1(jcr, M_FATAL, 0, _("read attr spool error. ERR=%s\n"),
+          be.bstrerror());
+    return false;
+  }
+
+  return !JobCanceled(jcr);
+}
+
 /**
  * Tell Director where to find the attributes spool file
  *  Note, if we are not on the same machine, the Director will
  *  return an error, and the higher level routine will transmit
- *  the data record by record -- using bsock->despool().
+ *  the data record by record -- using SendAttrSpoolFile().
  */
 static bool BlastAttrSpoolFile(JobControlRecord* jcr, boffset_t size)
 {
@@ -774,6 +1093,15 @@ bool CommitAttributeSpool(JobControlRecord* jcr)
         bstrftimes(tbuf, sizeof(tbuf), (utime_t)time(NULL)));
   if (AreAttributesSpooled(jcr)) {
     dir = jcr->dir_bsock;
+    if (!jcr->impl->attr_spool->Flush()) {
+      BErrNo be;
+
+      Jmsg(jcr, M_FATAL, 0, _("Attr spool write error. ERR=%s\n"),
+           be.bstrerror());
+      jcr->forceJobStatus(JS_FatalError); /* override any Incomplete */
+      goto bail_out;
+    }
+
     if ((size = lseek(dir->spool_fd_, 0, SEEK_END)) == -1) {
       BErrNo be;
 
@@ -814,12 +1142,7 @@ bool CommitAttributeSpool(JobControlRecord* jcr)
       goto bail_out;
     }
 
-    P(mutex);
-    if (spool_stats.attr_size + size > spool_stats.max_attr_size) {
-      spool_stats.max_attr_size = spool_stats.attr_size + size;
-    }
-    spool_stats.attr_size += size;
-    V(mutex);
+    UpdateMaxAttrSpoolSize(size);
 
     jcr->sendJobStatus(JS_AttrDespooling);
     Jmsg(jcr, M_INFO, 0,
@@ -830,7 +1153,7 @@ bool CommitAttributeSpool(JobControlRecord* jcr)
       /* Can't read spool file from director side,
        * send content over network.
        */
-      dir->despool(UpdateAttrSpoolSize, size);
+      SendAttrSpoolFile(jcr, size);
     }
     return CloseAttrSpoolFile(jcr, dir);
   }
@@ -856,6 +1179,7 @@ static bool OpenAttrSpoolFile(JobControlRecord* jcr, BareosSocket* bs)
     FreePoolMemory(name);
     return false;
   }
+  jcr->impl->attr_spool = new AttributeSpoolWriter(bs->spool_fd_);
 
   P(mutex);
   spool_stats.attr_jobs++;
@@ -890,6 +1214,100 @@ static bool CloseAttrSpoolFile(JobControlRecord* jcr, BareosSocket* bs)
   bs->spool_fd_ = -1;
   bs->ClearSpooling();
 
+  if (jcr->impl->attr_spool) {
+    delete jcr->impl->attr_spool;
+    jcr->impl->attr_spool = NULL;
+  }
+
+  return true;
+}
+
+/**
+ * Write an attribute message to the attribute spool file instead of
+ * sending it to the Director.
+ *
+ * When an Attribute Spool Commit Size is configured the spooled attributes
+ * are sent to the Director as soon as that much was spooled. When data is
+ * spooled too this is done after despooling the data, see DespoolData().
+ */
+bool SpoolAttributes(JobControlRecord* jcr,
+                     const char* msg,
+                     int32_t message_length)
+{
+  if (!jcr->impl->attr_spool->Append(msg, message_length)) {
+    BErrNo be;
+
+    Jmsg(jcr, M_FATAL, 0, _("Attr spool write error. ERR=%s\n"),
+         be.bstrerror());
+    jcr->forceJobStatus(JS_FatalError); /* override any Incomplete */
+    return false;
+  }
+
+  if (!jcr->impl->dcr->spool_data && AttributeSpoolCommitDue(jcr)) {
+    return CommitAttributeSpoolChunk(jcr);
+  }
+
+  return true;
+}
+
+static bool AttributeSpoolCommitDue(JobControlRecord* jcr)
+{
+  DeviceControlRecord* dcr = jcr->impl->dcr;
+  uint64_t commit_size;
+
+  if (!AreAttributesSpooled(jcr) || !dcr || !dcr->device) { return false; }
+
+  commit_size = dcr->device->attr_spool_commit_size;
+
+  return commit_size > 0 && jcr->impl->attr_spool->RawBytes() >= commit_size;
+}
+
+/**
+ * Send the attributes spooled so far to the Director while the job is
+ * still running and start over with an empty spool file.
+ *
+ * The attributes are streamed like unspooled ones and not blasted, so the
+ * Director inserts them while we continue with the job instead of having
+ * to insert everything in one go after all data was transferred.
+ */
+static bool CommitAttributeSpoolChunk(JobControlRecord* jcr)
+{
+  boffset_t size;
+  char ec1[30], ec2[30];
+  BareosSocket* dir = jcr->dir_bsock;
+  AttributeSpoolWriter* attr_spool = jcr->impl->attr_spool;
+
+  if (!attr_spool->Flush() ||
+      (size = lseek(dir->spool_fd_, 0, SEEK_END)) == -1) {
+    BErrNo be;
+
+    Jmsg(jcr, M_FATAL, 0, _("Attr spool write error. ERR=%s\n"),
+         be.bstrerror());
+    jcr->forceJobStatus(JS_FatalError); /* override any Incomplete */
+    return false;
+  }
+
+  Dmsg2(100, "Committing %s bytes of spooled attributes (%s bytes spooled)\n",
+        edit_uint64_with_commas(attr_spool->RawBytes(), ec1),
+        edit_uint64_with_commas(size, ec2));
+
+  UpdateMaxAttrSpoolSize(size);
+  if (!SendAttrSpoolFile(jcr, size)) {
+    jcr->forceJobStatus(JS_FatalError); /* override any Incomplete */
+    return false;
+  }
+
+  if (lseek(dir->spool_fd_, 0, SEEK_SET) == -1 ||
+      ftruncate(dir->spool_fd_, 0) != 0) {
+    BErrNo be;
+
+    Jmsg(jcr, M_FATAL, 0, _("Truncate on attributes file failed: ERR=%s\n"),
+         be.bstrerror());
+    jcr->forceJobStatus(JS_FatalError); /* override any Incomplete */
+    return false;
+  }
+  attr_spool->Reset();
+
   return true;
 }
 
@@ -30,6 +30,9 @@ bool AreAttributesSpooled(JobControlRecord* jcr);
 bool BeginAttributeSpool(JobControlRecord* jcr);
 bool DiscardAttributeSpool(JobControlRecord* jcr);
 bool CommitAttributeSpool(JobControlRecord* jcr);
+bool SpoolAttributes(JobControlRecord* jcr,
+                     const char* msg,
+                     int32_t message_length);
 bool WriteBlockToSpoolFile(DeviceControlRecord* dcr);
 void ListSpoolStats(void sendit(const char* msg, int len, void* sarg),
                     void* arg);
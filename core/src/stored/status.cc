@@ -37,6 +37,7 @@
 #include "lib/edit.h"
 #include "include/jcr.h"
 #include "lib/parse_conf.h"
+#include "stored/sd_stats.h"
 #include "lib/bsock.h"
 #include "lib/recent_job_results_list.h"
 #include "lib/util.h"
@@ -330,6 +331,12 @@ static void ListDevices(JobControlRecord* jcr,
                    edit_uint64_with_commas(dev->VolCatInfo.VolCatBlocks, b2),
                    edit_uint64_with_commas(bpb, b3));
         sendit(msg, len, sp);
+        if (device->streaming_buffer_size > 0) {
+          len = Mmsg(msg, _("    Streaming buffer=%s underruns=%s\n"),
+                     edit_uint64_with_suffix(device->streaming_buffer_size, b1),
+                     edit_uint64_with_commas(dev->streaming_underruns, b2));
+          sendit(msg, len, sp);
+        }
       } else { /* reading */
         bpb = dev->VolCatInfo.VolCatReads;
         if (bpb <= 0) { bpb = 1; }
@@ -993,6 +1000,23 @@ static void sendit(PoolMem& msg, int len, StatusPacket* sp)
   }
 }
 
+/*
+ * Send handler of the output formatter, each message goes out as a line.
+ */
+static bool SendFormatted(void* ctx, const char* msg)
+{
+  StatusPacket* sp = (StatusPacket*)ctx;
+  PoolMem line(msg);
+  int len;
+
+  if (!*msg || msg[strlen(msg) - 1] != '\n') { PmStrcat(line, "\n"); }
+  len = strlen(line.c_str());
+  if (sp->bs) { sp->bs->msg = CheckPoolMemorySize(sp->bs->msg, len + 1); }
+  sendit(line, len, sp);
+
+  return true;
+}
+
 /**
  * Status command from Director
  */
@@ -1082,6 +1106,9 @@ bool DotstatusCmd(JobControlRecord* jcr)
   } else if (Bstrcasecmp(cmd.c_str(), "resources")) {
     sp.api = true;
     ListResources(&sp);
+  } else if (Bstrcasecmp(cmd.c_str(), "latency")) {
+    sp.api = true;
+    SendLatencyStatistics(SendFormatted, &sp);
   } else {
     PmStrcpy(jcr->errmsg, dir->msg);
     dir->fsend(_("3900 Unknown arg in .status command: %s\n"), jcr->errmsg);
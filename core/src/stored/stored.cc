@@ -39,6 +39,7 @@
 #include "stored/acquire.h"
 #include "stored/autochanger.h"
 #include "stored/bsr.h"
+#include "stored/chunk_cache.h"
 #include "stored/device.h"
 #include "stored/jcr_private.h"
 #include "stored/job.h"
@@ -704,6 +705,8 @@ static
     }
   }
 
+  FreeChunkCache();
+
 #if defined(HAVE_DYNAMIC_SD_BACKENDS)
   DevFlushBackends();
 #endif
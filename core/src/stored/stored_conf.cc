@@ -112,15 +112,30 @@ static ResourceItem store_items[] = {
   {"NdmpAddresses", CFG_TYPE_ADDRESSES, ITEM(res_store, NDMPaddrs), 0, CFG_ITEM_DEFAULT, "10000", NULL, NULL},
   {"NdmpPort", CFG_TYPE_ADDRESSES_PORT, ITEM(res_store, NDMPaddrs), 0, CFG_ITEM_DEFAULT, "10000", NULL, NULL},
   {"AutoXFlateOnReplication", CFG_TYPE_BOOL, ITEM(res_store, autoxflateonreplication), 0, CFG_ITEM_DEFAULT, "false", "13.4.0-", NULL},
+  {"BlockReplication", CFG_TYPE_BOOL, ITEM(res_store, block_replication), 0, CFG_ITEM_DEFAULT, "false", "19.2.0-",
+      "Copy and migration jobs between two storage daemons send whole blocks instead of single records "
+      "when no plugin translates the records on either side. Both storage daemons need to enable it."},
   {"AbsoluteJobTimeout", CFG_TYPE_PINT32, ITEM(res_store, jcr_watchdog_time), 0, 0, NULL, NULL, NULL},
   {"CollectDeviceStatistics", CFG_TYPE_BOOL, ITEM(res_store, collect_dev_stats), 0, CFG_ITEM_DEFAULT, "false", NULL, NULL},
   {"CollectJobStatistics", CFG_TYPE_BOOL, ITEM(res_store, collect_job_stats), 0, CFG_ITEM_DEFAULT, "false", NULL, NULL},
   {"StatisticsCollectInterval", CFG_TYPE_PINT32, ITEM(res_store, stats_collect_interval), 0, CFG_ITEM_DEFAULT, "30", NULL, NULL},
   {"DeviceReserveByMediaType", CFG_TYPE_BOOL, ITEM(res_store, device_reserve_by_mediatype), 0, CFG_ITEM_DEFAULT, "false", NULL, NULL},
   {"FileDeviceConcurrentRead", CFG_TYPE_BOOL, ITEM(res_store, filedevice_concurrent_read), 0, CFG_ITEM_DEFAULT, "false", NULL, NULL},
+  {"MaximumParallelReadDevices", CFG_TYPE_PINT32, ITEM(res_store, max_parallel_read_devices), 0, CFG_ITEM_DEFAULT, "1", "19.2.0-",
+      "Number of devices a Virtual Full job may read the consolidated jobs from at the same time. "
+      "With 1 all jobs are read one after the other on the device the Director reserved."},
+  {"ParallelReadBufferSize", CFG_TYPE_SIZE64, ITEM(res_store, parallel_read_buffer_size), 0, CFG_ITEM_DEFAULT, "268435456", "19.2.0-",
+      "Memory a Virtual Full job reading from several devices may use for records that are read ahead of writing them."},
   {"SecureEraseCommand", CFG_TYPE_STR, ITEM(res_store, secure_erase_cmdline), 0, 0, NULL, "15.2.1-",
       "Specify command that will be called when bareos unlinks files."},
   {"LogTimestampFormat", CFG_TYPE_STR, ITEM(res_store, log_timestamp_format), 0, 0, NULL, "15.2.3-", NULL},
+  {"ChunkCacheSize", CFG_TYPE_SIZE64, ITEM(res_store, chunk_cache_size), 0, CFG_ITEM_DEFAULT, "0", "19.2.0-",
+      "Memory used to cache chunks read from chunked volumes, shared by all devices of the storage daemon. "
+      "0 disables the cache."},
+  {"ChunkCacheDirectory", CFG_TYPE_DIR, ITEM(res_store, chunk_cache_directory), 0, 0, NULL, "19.2.0-",
+      "Directory to keep chunks in that no longer fit into the memory of the chunk cache."},
+  {"ChunkCacheDirectorySize", CFG_TYPE_SIZE64, ITEM(res_store, chunk_cache_directory_size), 0, CFG_ITEM_DEFAULT, "0", "19.2.0-",
+      "Disk space the chunk cache may use in the Chunk Cache Directory."},
     TLS_COMMON_CONFIG(res_store),
     TLS_CERT_CONFIG(res_store),
   {nullptr, 0, 0, nullptr, 0, 0, nullptr, nullptr, nullptr}
@@ -199,9 +214,29 @@ static ResourceItem dev_items[] = {
   {"MaximumFileSize", CFG_TYPE_SIZE64, ITEM(res_dev, max_file_size), 0, CFG_ITEM_DEFAULT, "1000000000", NULL, NULL},
   {"VolumeCapacity", CFG_TYPE_SIZE64, ITEM(res_dev, volume_capacity), 0, 0, NULL, NULL, NULL},
   {"MaximumConcurrentJobs", CFG_TYPE_PINT32, ITEM(res_dev, max_concurrent_jobs), 0, 0, NULL, NULL, NULL},
-  {"SpoolDirectory", CFG_TYPE_DIR, ITEM(res_dev, spool_directory), 0, 0, NULL, NULL, NULL},
+  {"AppendBuffers", CFG_TYPE_PINT32, ITEM(res_dev, append_buffers), 0, CFG_ITEM_DEFAULT, "0", "19.2.0-",
+      "Number of blocks the data receiving thread can fill while the previous block is written to the device "
+      "by a separate writer thread (1 = double buffering, 2 = triple buffering). 0 disables the writer thread."},
+  {"StreamingBufferSize", CFG_TYPE_SIZE64, ITEM(res_dev, streaming_buffer_size), 0, CFG_ITEM_DEFAULT, "0", "19.2.0-",
+      "Memory used to buffer the blocks of a job in front of the device. The blocks are only written once the "
+      "buffer is filled up to the high watermark and then until it is drained to the low watermark, so a tape "
+      "drive keeps streaming even when the client sends slower than the drive writes. Implies Append Buffers. "
+      "0 disables the streaming buffer."},
+  {"StreamingBufferHighWatermark", CFG_TYPE_PINT32, ITEM(res_dev, streaming_buffer_high_watermark), 0, CFG_ITEM_DEFAULT, "80", "19.2.0-",
+      "Percentage of the Streaming Buffer Size that must be filled before the buffered blocks are written."},
+  {"StreamingBufferLowWatermark", CFG_TYPE_PINT32, ITEM(res_dev, streaming_buffer_low_watermark), 0, CFG_ITEM_DEFAULT, "20", "19.2.0-",
+      "Percentage of the Streaming Buffer Size at which writing stops until the high watermark is reached again."},
+  {"SpoolDirectory", CFG_TYPE_ALIST_DIR, ITEM(res_dev, spool_directories), 0, 0, NULL, NULL,
+      "Directory to spool data to. When given more than once the spool files are striped across all directories."},
+  {"DespoolBuffers", CFG_TYPE_PINT32, ITEM(res_dev, despool_buffers), 0, CFG_ITEM_DEFAULT, "0", "19.2.0-",
+      "Number of blocks a separate reader thread reads ahead from the spool files while despooling, "
+      "so the device can keep streaming. 0 disables the reader thread."},
   {"MaximumSpoolSize", CFG_TYPE_SIZE64, ITEM(res_dev, max_spool_size), 0, 0, NULL, NULL, NULL},
   {"MaximumJobSpoolSize", CFG_TYPE_SIZE64, ITEM(res_dev, max_job_spool_size), 0, 0, NULL, NULL, NULL},
+  {"AttributeSpoolCommitSize", CFG_TYPE_SIZE64, ITEM(res_dev, attr_spool_commit_size), 0, CFG_ITEM_DEFAULT, "0", "19.2.0-",
+      "Send the spooled attributes to the Director whenever this much was spooled, instead of only at the end "
+      "of the job. When data is spooled too, this is checked after the data was despooled. "
+      "0 sends the attributes at the end of the job."},
   {"DriveIndex", CFG_TYPE_PINT16, ITEM(res_dev, drive_index), 0, 0, NULL, NULL, NULL},
   {"MaximumPartSize", CFG_TYPE_SIZE64, ITEM(res_dev, max_part_size), 0, CFG_ITEM_DEPRECATED, NULL, NULL, NULL},
   {"MountPoint", CFG_TYPE_STRNAME, ITEM(res_dev, mount_point), 0, 0, NULL, NULL, NULL},
@@ -218,10 +253,16 @@ static ResourceItem dev_items[] = {
   {"AutoDeflateAlgorithm", CFG_TYPE_CMPRSALGO, ITEM(res_dev, autodeflate_algorithm), 0, 0, NULL, "13.4.0-", NULL},
   {"AutoDeflateLevel", CFG_TYPE_PINT16, ITEM(res_dev, autodeflate_level), 0, CFG_ITEM_DEFAULT, "6", "13.4.0-",NULL},
   {"AutoInflate", CFG_TYPE_IODIRECTION, ITEM(res_dev, autoinflate), 0, 0, NULL, "13.4.0-", NULL},
+  {"AutoXflateWorkers", CFG_TYPE_PINT32, ITEM(res_dev, autoxflate_workers), 0, CFG_ITEM_DEFAULT, "0", "19.2.0-",
+      "Number of threads per job the autoxflate plugin uses to deflate or inflate the records written to this "
+      "device. The records are written in their original order. 0 translates every record on the job thread."},
   {"CollectStatistics", CFG_TYPE_BOOL, ITEM(res_dev, collectstats), 0, CFG_ITEM_DEFAULT, "true", NULL, NULL},
   {"EofOnErrorIsEot", CFG_TYPE_BOOL, ITEM(res_dev, eof_on_error_is_eot), 0, CFG_ITEM_DEFAULT, NULL, "18.2.4-",
       "If Yes, Bareos will treat any read error at an end-of-file mark as end-of-tape. You should only set "
       "this option if your tape-drive fails to detect end-of-tape while reading."},
+  {"BlockIndex", CFG_TYPE_BOOL, ITEM(res_dev, block_index), 0, CFG_ITEM_DEFAULT, "false", "19.2.0-",
+      "Write an index file next to every disk volume which maps the FileIndex ranges of each job to block "
+      "addresses, so restores of single files can seek directly to the data instead of scanning the volume."},
   {"Count", CFG_TYPE_PINT32, ITEM(res_dev, count), 0, CFG_ITEM_DEFAULT, "1", NULL, "If Count is set to (1 < Count < 10000), "
   "this resource will be multiplied Count times. The names of multiplied resources will have a serial number (0001, 0002, ...) attached. "
   "If set to 1 only this single resource will be used and its name will not be altered."},
@@ -271,6 +312,10 @@ static s_kw device_types[] = {
     {"rados", B_RADOS_DEV},
     {"cephfs", B_CEPHFS_DEV},
     {"elasto", B_ELASTO_DEV},
+    {"chunkdir", B_CHUNKDIR_DEV},
+#ifdef HAVE_LMDB
+    {"dedup", B_DEDUP_DEV},
+#endif
     {NULL, 0}};
 
 static s_kw io_directions[] = {{"in", IO_DIRECTION_IN},
@@ -281,7 +326,8 @@ static s_kw io_directions[] = {{"in", IO_DIRECTION_IN},
 static s_kw compression_algorithms[] = {
     {"gzip", COMPRESS_GZIP},   {"lzo", COMPRESS_LZO1X},
     {"lzfast", COMPRESS_FZFZ}, {"lz4", COMPRESS_FZ4L},
-    {"lz4hc", COMPRESS_FZ4H},  {NULL, 0}};
+    {"lz4hc", COMPRESS_FZ4H},  {"zstd", COMPRESS_ZSTD},
+    {NULL, 0}};
 
 static void StoreAuthenticationType(LEX* lc,
                                     ResourceItem* item,
@@ -718,7 +764,17 @@ static bool SaveResource(int type, ResourceItem* items, int pass)
   // save previously discovered pointers into dynamic memory
   if (pass == 2) {
     switch (type) {
-      case R_DEVICE:
+      case R_DEVICE: {
+        DeviceResource* p = dynamic_cast<DeviceResource*>(
+            my_config->GetResWithName(R_DEVICE, res_dev->resource_name_));
+        if (!p) {
+          Emsg1(M_ERROR_TERM, 0, _("Cannot find Device resource %s\n"),
+                res_dev->resource_name_);
+        } else {
+          p->spool_directories = res_dev->spool_directories;
+        }
+        break;
+      }
       case R_MSGS:
       case R_NDMP:
         // Resources not containing a resource
@@ -897,6 +953,7 @@ static void FreeResource(BareosResource* res, int type)
       if (p->verid) { free(p->verid); }
       if (p->secure_erase_cmdline) { free(p->secure_erase_cmdline); }
       if (p->log_timestamp_format) { free(p->log_timestamp_format); }
+      if (p->chunk_cache_directory) { free(p->chunk_cache_directory); }
       delete p;
       break;
     }
@@ -910,7 +967,7 @@ static void FreeResource(BareosResource* res, int type)
       if (p->changer_name) { free(p->changer_name); }
       if (p->changer_command) { free(p->changer_command); }
       if (p->alert_command) { free(p->alert_command); }
-      if (p->spool_directory) { free(p->spool_directory); }
+      if (p->spool_directories) { delete p->spool_directories; }
       if (p->mount_point) { free(p->mount_point); }
       if (p->mount_command) { free(p->mount_command); }
       if (p->unmount_command) { free(p->unmount_command); }
@@ -122,6 +122,7 @@ class StorageResource
   bool autoxflateonreplication =
       false;               /**< Perform autoxflation when replicating data
                             */
+  bool block_replication = false; /**< Replicate whole blocks to remote SD */
   bool compatible = false; /**< Write compatible format */
   bool allow_bw_bursting = false; /**< Allow bursting with bandwidth limiting */
   bool ndmp_enable = false;       /**< Enable NDMP protocol listener */
@@ -133,11 +134,18 @@ class StorageResource
                                        on a matching mediatype */
   bool filedevice_concurrent_read = false;  /**< Allow filedevices to be read
                                        concurrently */
+  uint32_t max_parallel_read_devices = 1; /**< Devices a Virtual Full may
+                                         read from at the same time */
+  uint64_t parallel_read_buffer_size = 0; /**< Memory for records read ahead
+                                         by parallel readers */
   char* verid = nullptr; /**< Custom Id to print in version command */
   char* secure_erase_cmdline = nullptr; /**< Cmdline to execute to perform
                                  secure erase of file */
   char* log_timestamp_format = nullptr; /**< Timestamp format to use in generic
                                  logging messages */
+  uint64_t chunk_cache_size = 0; /**< Memory of the chunk cache */
+  char* chunk_cache_directory = nullptr; /**< Directory for the chunk cache */
+  uint64_t chunk_cache_directory_size = 0; /**< Disk space of the chunk cache */
   uint64_t max_bandwidth_per_job = 0;   /**< Bandwidth limitation (global) */
 
   StorageResource() = default;
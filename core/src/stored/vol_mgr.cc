@@ -32,6 +32,7 @@
 #include "stored/stored.h"
 #include "stored/stored_globals.h"
 #include "stored/autochanger.h"
+#include "stored/vol_registry.h"
 #include "include/jcr.h"
 #include "lib/berrno.h"
 
@@ -44,6 +45,13 @@ static dlist* vol_list = NULL;
 static dlist* read_vol_list = NULL;
 static pthread_mutex_t read_vol_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * Hash indexes of the volumes in vol_list and read_vol_list. Lookups by name
+ * use these, without taking the locks of the lists.
+ */
+static VolumeRegistry* vol_registry = NULL;
+static VolumeRegistry* read_vol_registry = NULL;
+
 /* Global static variables */
 #ifdef SD_DEBUG_LOCK
 int vol_list_lock_count = 0;
@@ -94,7 +102,7 @@ static int ReadCompare(void* item1, void* item2)
   return 1;
 }
 
-bool IsVolListEmpty() { return vol_list->empty(); }
+bool IsVolListEmpty() { return vol_registry->empty(); }
 
 /**
  *  Initialized the main volume list. Note, we are using a recursive lock.
@@ -171,7 +179,8 @@ void AddReadVolume(JobControlRecord* jcr, const char* VolumeName)
   nvol->SetJobid(jcr->JobId);
   nvol->SetReading();
   LockReadVolumes();
-  vol = (VolumeReservationItem*)read_vol_list->binary_insert(nvol, ReadCompare);
+  vol = read_vol_registry->Insert(nvol);
+  if (vol == nvol) { read_vol_list->binary_insert(nvol, ReadCompare); }
   if (vol != nvol) {
     FreeReadVolItem(nvol);
     Dmsg2(debuglevel, "read_vol=%s JobId=%d already in list.\n", VolumeName,
@@ -187,22 +196,19 @@ void AddReadVolume(JobControlRecord* jcr, const char* VolumeName)
  */
 void RemoveReadVolume(JobControlRecord* jcr, const char* VolumeName)
 {
-  VolumeReservationItem vol, *fvol;
+  VolumeReservationItem* fvol;
 
   LockReadVolumes();
-  vol.vol_name = strdup(VolumeName);
-  vol.SetJobid(jcr->JobId);
-
-  fvol =
-      (VolumeReservationItem*)read_vol_list->binary_search(&vol, ReadCompare);
-  free(vol.vol_name);
+  fvol = read_vol_registry->Acquire(VolumeName, jcr->JobId);
 
   if (fvol) {
     Dmsg3(debuglevel, "remove_read_vol=%s JobId=%d found=%d\n", VolumeName,
           jcr->JobId, fvol != NULL);
   }
   if (fvol) {
+    read_vol_registry->Remove(fvol);
     read_vol_list->remove(fvol);
+    fvol->DecUseCount(); /* our reference, the list still has one */
     FreeReadVolItem(fvol);
   }
   UnlockReadVolumes();
@@ -210,37 +216,21 @@ void RemoveReadVolume(JobControlRecord* jcr, const char* VolumeName)
 }
 
 /**
- * Search for a Volume name in the read Volume list.
+ * Search for a Volume name in the read Volume list, read by any Job.
  *
- * Returns: VolumeReservationItem entry on success
- *          NULL if the Volume is not in the list
+ * Returns: true if the Volume is in the list
  */
-static VolumeReservationItem* find_read_volume(const char* VolumeName)
+static bool IsReadVolume(const char* VolumeName)
 {
-  VolumeReservationItem vol, *fvol;
-
-  if (read_vol_list->empty()) {
-    Dmsg0(debuglevel, "find_read_vol: read_vol_list empty.\n");
-    return NULL;
-  }
+  bool found;
 
   /*
    * Do not lock reservations here
    */
-  LockReadVolumes();
-  vol.vol_name = strdup(VolumeName);
+  found = read_vol_registry->Contains(VolumeName);
+  Dmsg2(debuglevel, "find_read_vol=%s found=%d\n", VolumeName, found);
 
-  /*
-   * Note, we do want a simple CompareByVolumename on volume name only here
-   */
-  fvol = (VolumeReservationItem*)read_vol_list->binary_search(
-      &vol, CompareByVolumename);
-  free(vol.vol_name);
-
-  Dmsg2(debuglevel, "find_read_vol=%s found=%d\n", VolumeName, fvol != NULL);
-  UnlockReadVolumes();
-
-  return fvol;
+  return found;
 }
 
 /**
@@ -299,36 +289,32 @@ static void FreeVolItem(VolumeReservationItem* vol)
 {
   Device* dev = NULL;
 
-  vol->DecUseCount();
-  vol->Lock();
-  if (vol->UseCount() > 0) {
-    vol->Unlock();
-    return;
-  }
-  vol->Unlock();
+  if (vol->DecUseCount() > 0) { return; }
   free(vol->vol_name);
   if (vol->dev) { dev = vol->dev; }
   vol->DestroyMutex();
+
+  /*
+   * The device may have got another volume while this one was still used.
+   */
+  if (dev && dev->vol == vol) { dev->vol = NULL; }
   free(vol);
-  if (dev) { dev->vol = NULL; }
 }
 
 static void FreeReadVolItem(VolumeReservationItem* vol)
 {
   Device* dev = NULL;
 
-  vol->DecUseCount();
-  vol->Lock();
-  if (vol->UseCount() > 0) {
-    vol->Unlock();
-    return;
-  }
-  vol->Unlock();
+  if (vol->DecUseCount() > 0) { return; }
   free(vol->vol_name);
   if (vol->dev) { dev = vol->dev; }
   vol->DestroyMutex();
+
+  /*
+   * The device may have got another volume while this one was still used.
+   */
+  if (dev && dev->vol == vol) { dev->vol = NULL; }
   free(vol);
-  if (dev) { dev->vol = NULL; }
 }
 
 /**
@@ -398,7 +384,7 @@ VolumeReservationItem* reserve_volume(DeviceControlRecord* dcr,
    * If aquiring a volume for writing it may not be on the read volume list.
    */
   if (me->filedevice_concurrent_read && dcr->IsWriting() &&
-      find_read_volume(VolumeName)) {
+      IsReadVolume(VolumeName)) {
     Mmsg(dcr->jcr->errmsg,
          _("Could not reserve volume \"%s\" for append, because it is read by "
            "another Job.\n"),
@@ -480,8 +466,8 @@ VolumeReservationItem* reserve_volume(DeviceControlRecord* dcr,
     /*
      * Now try to insert the new Volume
      */
-    vol = (VolumeReservationItem*)vol_list->binary_insert(nvol,
-                                                          CompareByVolumename);
+    vol = vol_registry->Insert(nvol);
+    if (vol == nvol) { vol_list->binary_insert(nvol, CompareByVolumename); }
   }
 
   if (vol != nvol) {
@@ -708,25 +694,21 @@ void ReadVolWalkEnd(VolumeReservationItem* vol)
 /**
  * Search for a Volume name in the Volume list.
  *
- * Returns: VolumeReservationItem entry on success
+ * Returns: VolumeReservationItem entry on success, to be released
+ *          with FreeVolItem()
  *          NULL if the Volume is not in the list
  */
 static VolumeReservationItem* find_volume(const char* VolumeName)
 {
-  VolumeReservationItem vol, *fvol;
+  VolumeReservationItem* fvol;
 
-  if (vol_list->empty()) { return NULL; }
+  if (vol_registry->empty()) { return NULL; }
   /* Do not lock reservations here */
-  LockVolumes();
-  vol.vol_name = strdup(VolumeName);
-  fvol = (VolumeReservationItem*)vol_list->binary_search(&vol,
-                                                         CompareByVolumename);
-  free(vol.vol_name);
+  fvol = vol_registry->Acquire(VolumeName);
   Dmsg2(debuglevel, "find_vol=%s found=%d\n", VolumeName, fvol != NULL);
 
   if (debug_level >= debuglevel) { DebugListVolumes("find_volume"); }
 
-  UnlockVolumes();
   return fvol;
 }
 
@@ -816,6 +798,7 @@ bool FreeVolume(Device* dev)
      *  - The device is not of type File.
      */
     if (vol->IsWriting() || !me->filedevice_concurrent_read || !dev->IsFile()) {
+      vol_registry->Remove(vol);
       vol_list->remove(vol);
     }
     Dmsg2(debuglevel, "=== remove volume %s dev=%s\n", vol->vol_name,
@@ -838,8 +821,14 @@ bool FreeVolume(Device* dev)
 void CreateVolumeLists()
 {
   VolumeReservationItem* vol = NULL;
-  if (vol_list == NULL) { vol_list = new dlist(vol, &vol->link); }
-  if (read_vol_list == NULL) { read_vol_list = new dlist(vol, &vol->link); }
+  if (vol_list == NULL) {
+    vol_list = new dlist(vol, &vol->link);
+    vol_registry = new VolumeRegistry;
+  }
+  if (read_vol_list == NULL) {
+    read_vol_list = new dlist(vol, &vol->link);
+    read_vol_registry = new VolumeRegistry(true);
+  }
 }
 
 /**
@@ -872,6 +861,8 @@ void FreeVolumeLists()
     FreeVolumeList("vol_list", vol_list);
     delete vol_list;
     vol_list = NULL;
+    delete vol_registry;
+    vol_registry = NULL;
     UnlockVolumes();
   }
 
@@ -880,6 +871,8 @@ void FreeVolumeLists()
     FreeVolumeList("read_vol_list", read_vol_list);
     delete read_vol_list;
     read_vol_list = NULL;
+    delete read_vol_registry;
+    read_vol_registry = NULL;
     UnlockReadVolumes();
   }
 }
@@ -889,10 +882,7 @@ void FreeVolumeLists()
  */
 bool DeviceControlRecord::Can_i_write_volume()
 {
-  VolumeReservationItem* vol;
-
-  vol = find_read_volume(VolumeName);
-  if (vol) {
+  if (IsReadVolume(VolumeName)) {
     Dmsg1(100, "Found in read list; cannot write vol=%s\n", VolumeName);
     return false;
   }
@@ -907,38 +897,44 @@ bool DeviceControlRecord::Can_i_use_volume()
 {
   bool rtn = true;
   VolumeReservationItem* vol;
+  Device* vol_dev;
 
   if (JobCanceled(jcr)) { return false; }
-  LockVolumes();
   vol = find_volume(VolumeName);
   if (!vol) {
     Dmsg1(debuglevel, "Vol=%s not in use.\n", VolumeName);
-    goto get_out; /* vol not in list */
+    return true; /* vol not in list */
   }
-  ASSERT(vol->dev != NULL);
 
-  if (dev == vol->dev) { /* same device OK */
+  /*
+   * The volume may be swapped to another drive meanwhile, so look at the
+   * drive only once.
+   */
+  vol_dev = vol->dev;
+  ASSERT(vol_dev != NULL);
+
+  if (dev == vol_dev) { /* same device OK */
     Dmsg1(debuglevel, "Vol=%s on same dev.\n", VolumeName);
     goto get_out;
   } else {
     Dmsg3(debuglevel, "Vol=%s on %s we have %s\n", VolumeName,
-          vol->dev->print_name(), dev->print_name());
+          vol_dev->print_name(), dev->print_name());
   }
   /* ***FIXME*** check this ... */
-  if (!vol->dev->IsBusy()) {
+  if (!vol_dev->IsBusy()) {
     Dmsg2(debuglevel, "Vol=%s dev=%s not busy.\n", VolumeName,
-          vol->dev->print_name());
+          vol_dev->print_name());
     goto get_out;
   } else {
     Dmsg2(debuglevel, "Vol=%s dev=%s busy.\n", VolumeName,
-          vol->dev->print_name());
+          vol_dev->print_name());
   }
   Dmsg2(debuglevel, "Vol=%s in use by %s.\n", VolumeName,
-        vol->dev->print_name());
+        vol_dev->print_name());
   rtn = false;
 
 get_out:
-  UnlockVolumes();
+  FreeVolItem(vol);
   return rtn;
 }
 
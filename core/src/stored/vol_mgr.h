@@ -84,11 +84,14 @@ class VolumeReservationItem {
     use_count_++;
     V(mutex_);
   }
-  void DecUseCount(void)
+  int32_t DecUseCount(void)
   {
+    int32_t use_count;
+
     P(mutex_);
-    use_count_--;
+    use_count = --use_count_;
     V(mutex_);
+    return use_count;
   }
   int32_t UseCount() const { return use_count_; }
   bool IsSwapping() const { return swapping_; }
@@ -0,0 +1,160 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Hash index of the reserved and read volumes.
+ */
+
+#include "include/bareos.h"
+#include "stored/stored.h"
+#include "stored/vol_registry.h"
+
+namespace storagedaemon {
+
+VolumeRegistry::VolumeRegistry(bool per_job) : per_job_(per_job) {}
+
+VolumeRegistry::~VolumeRegistry()
+{
+  for (Shard& shard : shards_) { pthread_mutex_destroy(&shard.mutex); }
+}
+
+VolumeRegistry::Shard& VolumeRegistry::ShardOf(const std::string& VolumeName)
+{
+  return shards_[std::hash<std::string>()(VolumeName) % kShards];
+}
+
+/*
+ * Must be called with the mutex of the shard locked.
+ */
+VolumeReservationItem* VolumeRegistry::Lookup(Shard& shard,
+                                              const std::string& VolumeName,
+                                              bool any_job,
+                                              uint32_t JobId)
+{
+  auto range = shard.volumes.equal_range(VolumeName);
+
+  for (auto it = range.first; it != range.second; ++it) {
+    if (any_job || !per_job_ || it->second->GetJobid() == JobId) {
+      return it->second;
+    }
+  }
+
+  return NULL;
+}
+
+VolumeReservationItem* VolumeRegistry::Insert(VolumeReservationItem* vol)
+{
+  std::string VolumeName(vol->vol_name);
+  Shard& shard = ShardOf(VolumeName);
+  VolumeReservationItem* found;
+
+  P(shard.mutex);
+  found = Lookup(shard, VolumeName, false, vol->GetJobid());
+  if (!found) {
+    shard.volumes.emplace(VolumeName, vol);
+    size_++;
+    found = vol;
+  }
+  V(shard.mutex);
+
+  return found;
+}
+
+bool VolumeRegistry::Remove(VolumeReservationItem* vol)
+{
+  std::string VolumeName(vol->vol_name);
+  Shard& shard = ShardOf(VolumeName);
+  bool removed = false;
+
+  P(shard.mutex);
+  auto range = shard.volumes.equal_range(VolumeName);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second == vol) {
+      shard.volumes.erase(it);
+      size_--;
+      removed = true;
+      break;
+    }
+  }
+  V(shard.mutex);
+
+  return removed;
+}
+
+VolumeReservationItem* VolumeRegistry::Acquire(const char* VolumeName)
+{
+  std::string name(VolumeName);
+  Shard& shard = ShardOf(name);
+  VolumeReservationItem* vol;
+
+  P(shard.mutex);
+  vol = Lookup(shard, name, true, 0);
+  if (vol) { vol->IncUseCount(); }
+  V(shard.mutex);
+
+  return vol;
+}
+
+VolumeReservationItem* VolumeRegistry::Acquire(const char* VolumeName,
+                                               uint32_t JobId)
+{
+  std::string name(VolumeName);
+  Shard& shard = ShardOf(name);
+  VolumeReservationItem* vol;
+
+  P(shard.mutex);
+  vol = Lookup(shard, name, false, JobId);
+  if (vol) { vol->IncUseCount(); }
+  V(shard.mutex);
+
+  return vol;
+}
+
+bool VolumeRegistry::Contains(const char* VolumeName)
+{
+  std::string name(VolumeName);
+  Shard& shard = ShardOf(name);
+  bool found;
+
+  if (empty()) { return false; }
+
+  P(shard.mutex);
+  found = Lookup(shard, name, true, 0) != NULL;
+  V(shard.mutex);
+
+  return found;
+}
+
+/*
+ * Forget all volumes, the volumes themselves are freed by the owner of the
+ * volume lists.
+ */
+void VolumeRegistry::clear()
+{
+  for (Shard& shard : shards_) {
+    P(shard.mutex);
+    size_ -= shard.volumes.size();
+    shard.volumes.clear();
+    V(shard.mutex);
+  }
+}
+
+} /* namespace storagedaemon */
@@ -0,0 +1,99 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Hash index of the reserved and read volumes.
+ *
+ * The volume lists of vol_mgr.cc are sorted dlists which need a walk through
+ * the list for every lookup while holding the volume list lock. The registry
+ * indexes the same VolumeReservationItems by volume name in a number of
+ * independently locked hash tables, so looking up a volume neither walks the
+ * list nor waits for a thread holding the volume list lock. A volume handed
+ * out by a lookup has its use count incremented and stays valid until the
+ * caller releases it, even if it is removed from the registry meanwhile.
+ */
+
+#ifndef BAREOS_STORED_VOL_REGISTRY_H_
+#define BAREOS_STORED_VOL_REGISTRY_H_
+
+#include <atomic>
+#include <string>
+#include <unordered_map>
+
+namespace storagedaemon {
+
+class VolumeReservationItem;
+
+class VolumeRegistry {
+ public:
+  /*
+   * With per_job set, the same volume may be registered once for every
+   * JobId, as done for the volumes to be read.
+   */
+  explicit VolumeRegistry(bool per_job = false);
+  ~VolumeRegistry();
+
+  /*
+   * Register a volume unless a volume with the same name (and JobId) is
+   * registered already. Returns the registered volume, the use count is
+   * not changed.
+   */
+  VolumeReservationItem* Insert(VolumeReservationItem* vol);
+
+  /*
+   * Remove exactly this volume, returns false if it is not registered.
+   */
+  bool Remove(VolumeReservationItem* vol);
+
+  /*
+   * Find a volume by name, for a per job registry of any JobId. The use
+   * count of a returned volume is incremented.
+   */
+  VolumeReservationItem* Acquire(const char* VolumeName);
+  VolumeReservationItem* Acquire(const char* VolumeName, uint32_t JobId);
+
+  bool Contains(const char* VolumeName);
+  bool empty() const { return size_ == 0; }
+  int size() const { return size_; }
+  void clear();
+
+ private:
+  static const int kShards = 64;
+
+  struct Shard {
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    std::unordered_multimap<std::string, VolumeReservationItem*> volumes;
+  };
+
+  bool per_job_;
+  std::atomic<int> size_{0};
+  Shard shards_[kShards];
+
+  Shard& ShardOf(const std::string& VolumeName);
+  VolumeReservationItem* Lookup(Shard& shard,
+                                const std::string& VolumeName,
+                                bool any_job,
+                                uint32_t JobId);
+};
+
+} /* namespace storagedaemon */
+
+#endif /* BAREOS_STORED_VOL_REGISTRY_H_ */
@@ -0,0 +1,295 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "gtest/gtest.h"
+#include "include/bareos.h"
+#include "stored/stored.h"
+#include "stored/backends/aligned_volume.h"
+
+#include <set>
+#include <string>
+
+using namespace storagedaemon;
+
+static const uint32_t block_size = 64512;
+static const uint32_t alignment = 4096;
+
+/*
+ * Packs records into blocks with the regular record code and writes the
+ * blocks to an aligned volume, keeping a copy of the plain volume.
+ */
+class VolumeWriter {
+ public:
+  VolumeWriter(AlignedVolume& volume) : volume_(volume)
+  {
+    block_ = (DeviceBlock*)GetMemory(sizeof(DeviceBlock));
+    memset(block_, 0, sizeof(DeviceBlock));
+    block_->buf_len = block_size;
+    block_->buf = GetMemory(block_size);
+    EmptyBlock(block_);
+    rec_ = new_record();
+  }
+
+  ~VolumeWriter()
+  {
+    FreeRecord(rec_);
+    FreeBlock(block_);
+  }
+
+  void Append(int32_t FileIndex, int32_t Stream, const std::string& data)
+  {
+    rec_->VolSessionId = 1;
+    rec_->VolSessionTime = 1234;
+    rec_->FileIndex = FileIndex;
+    rec_->Stream = Stream;
+    rec_->data = CheckPoolMemorySize(rec_->data, data.size());
+    memcpy(rec_->data, data.data(), data.size());
+    rec_->data_len = data.size();
+    rec_->state = st_none;
+
+    while (!WriteRecordToBlock(block_, rec_)) { Flush(); }
+  }
+
+  void Flush()
+  {
+    ser_declare;
+
+    if (block_->binbuf <= WRITE_BLKHDR_LENGTH) { return; }
+
+    SerBegin(block_->buf, BLKHDR2_LENGTH);
+    ser_uint32(0);
+    ser_uint32(block_->binbuf);
+    ser_uint32(block_->BlockNumber++);
+    SerBytes(BLKHDR2_ID, BLKHDR_ID_LENGTH);
+    ser_uint32(block_->VolSessionId);
+    ser_uint32(block_->VolSessionTime);
+
+    WriteRaw(std::string(block_->buf, block_->binbuf));
+    EmptyBlock(block_);
+  }
+
+  void WriteRaw(const std::string& data)
+  {
+    ASSERT_EQ((ssize_t)data.size(), volume_.Write(data.data(), data.size()));
+    contents += data;
+  }
+
+  std::string contents;
+
+ private:
+  AlignedVolume& volume_;
+  DeviceBlock* block_;
+  DeviceRecord* rec_;
+};
+
+class AlignedVolumeTest : public ::testing::Test {
+ protected:
+  char directory_[64];
+  std::string path_;
+
+  void SetUp() override
+  {
+    strcpy(directory_, "/tmp/aligned_volume_test.XXXXXX");
+    ASSERT_NE(nullptr, mkdtemp(directory_));
+    path_ = std::string(directory_) + "/Full-0001";
+  }
+
+  void TearDown() override
+  {
+    std::string cmd = "rm -rf ";
+    system((cmd + directory_).c_str());
+  }
+
+  std::string FileData(size_t len, int seed)
+  {
+    std::string data(len, '\0');
+
+    for (size_t i = 0; i < len; i++) { data[i] = (i * 31 + seed + i / 977); }
+
+    return data;
+  }
+
+  std::string ReadFile(const char* name)
+  {
+    std::string fname = path_ + "/" + name;
+    std::string data;
+    char buf[4096];
+    ssize_t n;
+    int fd = open(fname.c_str(), O_RDONLY);
+
+    while ((n = read(fd, buf, sizeof(buf))) > 0) { data.append(buf, n); }
+    close(fd);
+
+    return data;
+  }
+};
+
+TEST_F(AlignedVolumeTest, volume_reads_back_as_written)
+{
+  AlignedVolume volume;
+  std::string contents;
+  std::string buf(100000, '\0');
+  ssize_t n;
+
+  ASSERT_GE(volume.Open(path_.c_str(), O_CREAT | O_RDWR, 0640, alignment), 0);
+  {
+    VolumeWriter writer(volume);
+
+    writer.WriteRaw(FileData(200, 9)); /* anything not a block */
+    writer.Append(1, STREAM_UNIX_ATTRIBUTES, FileData(120, 1));
+    writer.Append(1, STREAM_FILE_DATA, FileData(65536, 2));
+    writer.Append(1, STREAM_FILE_DATA, FileData(70000, 3));
+    writer.Append(2, STREAM_UNIX_ATTRIBUTES, FileData(130, 4));
+    writer.Append(2, STREAM_FILE_DATA, FileData(200000, 5));
+    writer.Append(2, STREAM_MD5_DIGEST, FileData(16, 6));
+    writer.Flush();
+    contents = writer.contents;
+  }
+  EXPECT_EQ(0, volume.Close());
+
+  ASSERT_TRUE(AlignedVolume::IsAlignedVolume(path_.c_str()));
+  ASSERT_GE(volume.Open(path_.c_str(), O_RDONLY, 0640, 0), 0);
+  EXPECT_EQ(alignment, volume.Alignment());
+  EXPECT_EQ((boffset_t)contents.size(), volume.Seek(0, SEEK_END));
+
+  /*
+   * Reads span blocks and start in the middle of blocks.
+   */
+  std::string read_back;
+  volume.Seek(0, SEEK_SET);
+  while ((n = volume.Read(&buf[0], buf.size())) > 0) {
+    read_back.append(buf.data(), n);
+  }
+  EXPECT_EQ(0, n);
+  EXPECT_TRUE(contents == read_back);
+
+  volume.Seek(block_size + 1000, SEEK_SET);
+  ASSERT_EQ(5000, volume.Read(&buf[0], 5000));
+  EXPECT_EQ(contents.substr(block_size + 1000, 5000), buf.substr(0, 5000));
+}
+
+TEST_F(AlignedVolumeTest, file_data_is_aligned)
+{
+  AlignedVolume volume;
+  std::string file = FileData(65536, 7);
+  std::set<std::string> file_chunks;
+  std::string data;
+  int aligned_chunks = 0;
+
+  /*
+   * The same file backed up twice, the records are split over blocks at
+   * different offsets.
+   */
+  ASSERT_GE(volume.Open(path_.c_str(), O_CREAT | O_RDWR, 0640, alignment), 0);
+  {
+    VolumeWriter writer(volume);
+
+    writer.Append(1, STREAM_UNIX_ATTRIBUTES, FileData(120, 1));
+    writer.Append(1, STREAM_FILE_DATA, file);
+    writer.Append(2, STREAM_UNIX_ATTRIBUTES, FileData(4000, 2));
+    writer.Append(2, STREAM_FILE_DATA, file);
+    writer.Flush();
+  }
+  volume.Close();
+
+  for (size_t i = 0; i < file.size(); i += alignment) {
+    file_chunks.insert(file.substr(i, alignment));
+  }
+
+  data = ReadFile("data");
+  for (size_t i = 0; i + alignment <= data.size(); i += alignment) {
+    if (file_chunks.count(data.substr(i, alignment))) { aligned_chunks++; }
+  }
+  EXPECT_EQ(2 * file.size() / alignment, (size_t)aligned_chunks);
+
+  /*
+   * Small records stay in the metadata file.
+   */
+  EXPECT_EQ(2 * file.size(), data.size());
+}
+
+TEST_F(AlignedVolumeTest, blocks_are_overwritten_from_a_block_start)
+{
+  AlignedVolume volume;
+  std::string first;
+
+  ASSERT_GE(volume.Open(path_.c_str(), O_CREAT | O_RDWR, 0640, alignment), 0);
+  {
+    VolumeWriter writer(volume);
+
+    writer.Append(1, STREAM_FILE_DATA, FileData(3 * block_size, 1));
+    writer.Flush();
+    first = writer.contents.substr(0, block_size);
+  }
+
+  /*
+   * Only a block start can be written, everything after it is dropped.
+   */
+  volume.Seek(100, SEEK_SET);
+  EXPECT_EQ(-1, volume.Write(first.data(), first.size()));
+  EXPECT_EQ(EINVAL, errno);
+
+  volume.Seek(block_size, SEEK_SET);
+  EXPECT_EQ((ssize_t)first.size(), volume.Write(first.data(), first.size()));
+  volume.Close();
+
+  ASSERT_GE(volume.Open(path_.c_str(), O_RDWR, 0640, 0), 0);
+  EXPECT_EQ(2 * block_size, volume.Seek(0, SEEK_END));
+
+  EXPECT_TRUE(volume.Truncate(nullptr, false));
+  EXPECT_EQ(0, volume.Seek(0, SEEK_END));
+  volume.Close();
+
+  ASSERT_GE(volume.Open(path_.c_str(), O_RDONLY, 0640, 0), 0);
+  EXPECT_EQ(0, volume.Seek(0, SEEK_END));
+  EXPECT_EQ(alignment, volume.Alignment());
+}
+
+TEST_F(AlignedVolumeTest, incomplete_block_is_dropped)
+{
+  AlignedVolume volume;
+  std::string metadata;
+  boffset_t size;
+  int fd;
+
+  ASSERT_GE(volume.Open(path_.c_str(), O_CREAT | O_RDWR, 0640, alignment), 0);
+  {
+    VolumeWriter writer(volume);
+
+    writer.Append(1, STREAM_FILE_DATA, FileData(2 * block_size, 1));
+    writer.Flush();
+  }
+  size = volume.Seek(0, SEEK_END);
+  volume.Close();
+
+  /*
+   * Simulate a crash while writing the entry of the next block.
+   */
+  metadata = ReadFile("metadata");
+  fd = open((path_ + "/metadata").c_str(), O_WRONLY | O_APPEND);
+  ASSERT_EQ(30, write(fd, metadata.data() + metadata.size() - 30, 30));
+  close(fd);
+
+  ASSERT_GE(volume.Open(path_.c_str(), O_RDWR, 0640, 0), 0);
+  EXPECT_EQ(size, volume.Seek(0, SEEK_END));
+  volume.Close();
+  EXPECT_EQ(metadata, ReadFile("metadata"));
+}
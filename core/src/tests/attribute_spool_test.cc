@@ -0,0 +1,146 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "gtest/gtest.h"
+#include "include/bareos.h"
+#include "lib/attribute_spool.h"
+
+#include <string>
+#include <vector>
+
+static int CreateSpoolFile()
+{
+  char filename[] = "/tmp/attribute_spool_test.XXXXXX";
+  int fd = mkstemp(filename);
+
+  if (fd >= 0) { unlink(filename); }
+
+  return fd;
+}
+
+static std::string MakeMessage(int i)
+{
+  std::string msg = "UpdCat Job=test-job.2019-01-01_00.00.00_01 ";
+
+  msg += std::to_string(i);
+  if (i % 100 == 0) { msg += std::string(300000, 'x'); }
+
+  return msg;
+}
+
+static void ReadAndCompare(int fd, const std::vector<std::string>& expected)
+{
+  AttributeSpoolReader reader(fd);
+  POOLMEM* msg = GetPoolMemory(PM_MESSAGE);
+  int32_t message_length;
+  size_t count = 0;
+
+  ASSERT_EQ(0, lseek(fd, 0, SEEK_SET));
+  while (reader.Next(msg, message_length) > 0) {
+    ASSERT_LT(count, expected.size());
+    ASSERT_EQ((int32_t)expected[count].size(), message_length);
+    EXPECT_EQ(0, memcmp(expected[count].data(), msg, message_length));
+    count++;
+  }
+  EXPECT_EQ(expected.size(), count);
+
+  FreePoolMemory(msg);
+}
+
+TEST(attribute_spool, write_and_read_frames)
+{
+  std::vector<std::string> messages;
+  int fd = CreateSpoolFile();
+
+  ASSERT_GE(fd, 0);
+  {
+    AttributeSpoolWriter writer(fd, 64 * 1024);
+
+    for (int i = 0; i < 10000; i++) {
+      messages.push_back(MakeMessage(i));
+      ASSERT_TRUE(writer.Append(messages.back().data(),
+                                messages.back().size()));
+    }
+    ASSERT_TRUE(writer.Flush());
+  }
+
+  ReadAndCompare(fd, messages);
+
+  close(fd);
+}
+
+/*
+ * Spool files written by older versions hold plain messages.
+ */
+TEST(attribute_spool, read_plain_and_framed_messages)
+{
+  std::vector<std::string> messages;
+  int fd = CreateSpoolFile();
+
+  ASSERT_GE(fd, 0);
+  for (int i = 0; i < 10; i++) {
+    int32_t pktsiz;
+
+    messages.push_back(MakeMessage(i));
+    pktsiz = htonl(messages.back().size());
+    ASSERT_EQ((ssize_t)sizeof(pktsiz), write(fd, &pktsiz, sizeof(pktsiz)));
+    ASSERT_EQ((ssize_t)messages.back().size(),
+              write(fd, messages.back().data(), messages.back().size()));
+  }
+
+  AttributeSpoolWriter writer(fd);
+  for (int i = 10; i < 20; i++) {
+    messages.push_back(MakeMessage(i));
+    ASSERT_TRUE(
+        writer.Append(messages.back().data(), messages.back().size()));
+  }
+  ASSERT_TRUE(writer.Flush());
+
+  ReadAndCompare(fd, messages);
+
+  close(fd);
+}
+
+TEST(attribute_spool, corrupt_frame_is_an_error)
+{
+  int fd = CreateSpoolFile();
+  std::string message = MakeMessage(1);
+  POOLMEM* msg = GetPoolMemory(PM_MESSAGE);
+  int32_t message_length;
+  struct stat st;
+
+  ASSERT_GE(fd, 0);
+  {
+    AttributeSpoolWriter writer(fd);
+
+    ASSERT_TRUE(writer.Append(message.data(), message.size()));
+    ASSERT_TRUE(writer.Flush());
+  }
+  ASSERT_EQ(0, fstat(fd, &st));
+  ASSERT_EQ(0, ftruncate(fd, st.st_size - 1));
+  ASSERT_EQ(0, lseek(fd, 0, SEEK_SET));
+
+  AttributeSpoolReader reader(fd);
+  EXPECT_EQ(-1, reader.Next(msg, message_length));
+
+  FreePoolMemory(msg);
+  close(fd);
+}
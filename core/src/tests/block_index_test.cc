@@ -0,0 +1,187 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "gtest/gtest.h"
+#include "include/bareos.h"
+#include "stored/stored.h"
+#include "stored/block_index.h"
+
+#include <string>
+
+using namespace storagedaemon;
+
+static const uint32_t block_size = 64512;
+static const btime_t label_btime = 1234567;
+
+class BlockIndexTest : public ::testing::Test {
+ protected:
+  char directory_[64];
+  std::string path_;
+
+  void SetUp() override
+  {
+    strcpy(directory_, "/tmp/block_index_test.XXXXXX");
+    ASSERT_NE(nullptr, mkdtemp(directory_));
+    path_ = std::string(directory_) + "/Full-0001.bix";
+  }
+
+  void TearDown() override
+  {
+    std::string cmd = "rm -rf ";
+    system((cmd + directory_).c_str());
+  }
+
+  /*
+   * Two sessions writing blocks in turns, each block holding two files.
+   */
+  void WriteInterleaved(VolumeBlockIndex& index, int blocks)
+  {
+    uint64_t addr = block_size;
+
+    for (int i = 0; i < blocks; i++) {
+      index.AddBlock(1, 100, 2 * i + 1, 2 * i + 2, addr, block_size);
+      addr += block_size;
+      index.AddBlock(2, 100, 2 * i + 1, 2 * i + 2, addr, block_size);
+      addr += block_size;
+    }
+  }
+
+  uint64_t BlockAddr(int block, int session)
+  {
+    return block_size + (2 * block + session - 1) * (uint64_t)block_size;
+  }
+};
+
+TEST_F(BlockIndexTest, lookup_finds_run_of_file)
+{
+  VolumeBlockIndex index;
+  uint64_t addr;
+  int blocks = 2000; /* about 250 MiB of volume */
+
+  index.SetVolume(path_.c_str(), "Full-0001", label_btime);
+  WriteInterleaved(index, blocks);
+  index.EndSession(1, 100);
+  index.EndSession(2, 100);
+
+  /*
+   * A run spans at most 64 MiB of the volume, so the start of the run is
+   * close before the wanted file.
+   */
+  ASSERT_TRUE(index.Lookup(2, 100, 1, &addr));
+  EXPECT_EQ(BlockAddr(0, 2), addr);
+
+  ASSERT_TRUE(index.Lookup(1, 100, 3001, &addr));
+  EXPECT_LE(addr, BlockAddr(1500, 1));
+  EXPECT_GE(addr + 64 * 1024 * 1024, BlockAddr(1500, 1));
+  EXPECT_GT(addr, BlockAddr(1000, 1));
+
+  EXPECT_FALSE(index.Lookup(1, 100, 2 * blocks + 1, &addr));
+  EXPECT_FALSE(index.Lookup(3, 100, 1, &addr));
+  index.Close();
+
+  /*
+   * Reading the index file back gives the same answers.
+   */
+  VolumeBlockIndex reader;
+  uint64_t read_addr;
+
+  reader.SetVolume(path_.c_str(), "Full-0001", label_btime);
+  ASSERT_TRUE(reader.Lookup(1, 100, 3001, &read_addr));
+  EXPECT_EQ(addr, read_addr);
+}
+
+TEST_F(BlockIndexTest, index_of_other_labeling_is_ignored)
+{
+  VolumeBlockIndex index;
+  uint64_t addr;
+
+  index.SetVolume(path_.c_str(), "Full-0001", label_btime);
+  WriteInterleaved(index, 10);
+  index.Close();
+
+  index.SetVolume(path_.c_str(), "Full-0001", label_btime + 1);
+  EXPECT_FALSE(index.Lookup(1, 100, 1, &addr));
+
+  /*
+   * Writing for the new labeling replaces the index.
+   */
+  index.AddBlock(7, 200, 1, 1, block_size, block_size);
+  index.Close();
+
+  index.SetVolume(path_.c_str(), "Full-0001", label_btime + 1);
+  EXPECT_FALSE(index.Lookup(1, 100, 1, &addr));
+  EXPECT_TRUE(index.Lookup(7, 200, 1, &addr));
+
+  index.Remove(NULL);
+  EXPECT_NE(0, access(path_.c_str(), F_OK));
+}
+
+TEST_F(BlockIndexTest, label_set_separately_from_path)
+{
+  VolumeBlockIndex index;
+  uint64_t addr;
+
+  index.SetPath(path_.c_str());
+  index.SetLabel("Full-0001", label_btime);
+  WriteInterleaved(index, 10);
+  index.Close();
+
+  /*
+   * A relabel seen on the next block starts a new index.
+   */
+  index.SetPath(path_.c_str());
+  index.SetLabel("Full-0001", label_btime);
+  EXPECT_TRUE(index.Lookup(1, 100, 1, &addr));
+  index.SetLabel("Full-0001", label_btime + 1);
+  EXPECT_FALSE(index.Lookup(1, 100, 1, &addr));
+
+  index.Remove(NULL);
+  EXPECT_NE(0, access(path_.c_str(), F_OK));
+}
+
+TEST_F(BlockIndexTest, appending_keeps_earlier_runs)
+{
+  VolumeBlockIndex index;
+  uint64_t addr;
+  int fd;
+
+  index.SetVolume(path_.c_str(), "Full-0001", label_btime);
+  index.AddBlock(1, 100, 1, 5, block_size, block_size);
+  index.Close();
+
+  /*
+   * Simulate a crash in the middle of writing an entry.
+   */
+  fd = open(path_.c_str(), O_WRONLY | O_APPEND);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(3, write(fd, "abc", 3));
+  close(fd);
+
+  index.SetVolume(path_.c_str(), "Full-0001", label_btime);
+  index.AddBlock(2, 100, 1, 9, 2 * block_size, block_size);
+  index.Close();
+
+  index.SetVolume(path_.c_str(), "Full-0001", label_btime);
+  ASSERT_TRUE(index.Lookup(1, 100, 5, &addr));
+  EXPECT_EQ(block_size, addr);
+  ASSERT_TRUE(index.Lookup(2, 100, 9, &addr));
+  EXPECT_EQ(2 * block_size, addr);
+}
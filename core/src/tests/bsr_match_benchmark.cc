@@ -0,0 +1,127 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Benchmark of bootstrap record matching for a restore of scattered files.
+ * A bsr selecting every other file of a job is parsed, then the records of
+ * all files of the job are matched against it like ReadRecords() does.
+ *
+ * Usage: bsr_match_benchmark [files to restore] [records per file]
+ */
+
+#include "include/bareos.h"
+#include "stored/stored.h"
+#include "stored/match_bsr.h"
+#include "lib/parse_bsr.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+using namespace storagedaemon;
+
+static double Seconds(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+int main(int argc, char* argv[])
+{
+  int files = (argc > 1) ? atoi(argv[1]) : 1000000;
+  int records = (argc > 2) ? atoi(argv[2]) : 3;
+  char fname[] = "/tmp/bsr_match_benchmark.XXXXXX";
+  DeviceRecord rec;
+  Volume_Label volrec;
+  Session_Label sessrec;
+  BootStrapRecord* bsr;
+  long matched = 0;
+  FILE* fp;
+  int fd;
+
+  if (files <= 0 || records <= 0) {
+    fprintf(stderr, "Usage: %s [files to restore] [records per file]\n",
+            argv[0]);
+    return 1;
+  }
+
+  if ((fd = mkstemp(fname)) < 0 || !(fp = fdopen(fd, "w"))) {
+    perror(fname);
+    return 1;
+  }
+
+  /*
+   * Written like the director writes a bsr, one FileIndex per line.
+   * Every other file is restored, with some longer gaps in between.
+   */
+  fprintf(fp,
+          "Volume=\"Full-0001\"\nMediaType=\"File\"\nVolSessionId=1\n"
+          "VolSessionTime=1234\nVolAddr=0-4294967295\n");
+  int32_t findex = 1;
+  for (int i = 0; i < files; i++) {
+    fprintf(fp, "FileIndex=%d\n", findex);
+    findex += (i % 100 == 99) ? 50 : 2;
+  }
+  fprintf(fp, "Count=%d\n", files);
+  fclose(fp);
+
+  auto start = std::chrono::steady_clock::now();
+  bsr = libbareos::parse_bsr(NULL, fname);
+  double parse_seconds = Seconds(start);
+  unlink(fname);
+
+  if (!bsr) {
+    fprintf(stderr, "Cannot parse bsr\n");
+    return 1;
+  }
+
+  bstrncpy(volrec.VolumeName, "Full-0001", sizeof(volrec.VolumeName));
+  rec.VolSessionId = 1;
+  rec.VolSessionTime = 1234;
+
+  start = std::chrono::steady_clock::now();
+  for (rec.FileIndex = 1; rec.FileIndex <= findex; rec.FileIndex++) {
+    for (int r = 0; r < records; r++) {
+      rec.Block += 100;
+      if (MatchBsr(bsr, &rec, &volrec, &sessrec, NULL) == 1) {
+        matched++;
+        rec.bsr = NULL;
+      }
+    }
+  }
+  double match_seconds = Seconds(start);
+  long total = (long)findex * records;
+
+  printf("%d files: parsed in %.3f s, matched %ld of %ld records in %.3f s, "
+         "%.0f records/s\n",
+         files, parse_seconds, matched, total, match_seconds,
+         total / match_seconds);
+
+  libbareos::FreeBsr(bsr);
+
+  if (matched != (long)files * records) {
+    fprintf(stderr, "Expected %ld matching records\n", (long)files * records);
+    return 1;
+  }
+
+  return 0;
+}
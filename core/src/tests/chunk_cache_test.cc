@@ -0,0 +1,161 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "gtest/gtest.h"
+#include "include/bareos.h"
+#include "stored/chunk_cache.h"
+
+#include <string>
+
+using namespace storagedaemon;
+
+static const uint32_t chunk_size = 1024;
+
+static std::string MakeChunk(const char* volname, uint16_t chunk)
+{
+  std::string data(chunk_size, '\0');
+
+  for (uint32_t i = 0; i < chunk_size; i++) {
+    data[i] = volname[i % strlen(volname)] + chunk + i;
+  }
+
+  return data;
+}
+
+static void Put(ChunkCache& cache, const char* volname, uint16_t chunk)
+{
+  std::string data = MakeChunk(volname, chunk);
+
+  cache.Put(volname, chunk, data.data(), data.size(), cache.Generation());
+}
+
+static bool IsCached(ChunkCache& cache, const char* volname, uint16_t chunk)
+{
+  char buffer[chunk_size];
+  uint32_t buflen = 0;
+
+  if (!cache.Get(volname, chunk, buffer, sizeof(buffer), &buflen)) {
+    return false;
+  }
+  EXPECT_EQ(chunk_size, buflen);
+  EXPECT_EQ(MakeChunk(volname, chunk), std::string(buffer, buflen));
+
+  return true;
+}
+
+TEST(chunk_cache, least_recently_used_chunk_is_evicted)
+{
+  ChunkCache cache(3 * chunk_size);
+  ChunkCacheStatistics statistics;
+
+  Put(cache, "Full-0001", 0);
+  Put(cache, "Full-0001", 1);
+  Put(cache, "Full-0002", 0);
+  EXPECT_TRUE(IsCached(cache, "Full-0001", 0));
+
+  Put(cache, "Full-0002", 1);
+  EXPECT_FALSE(IsCached(cache, "Full-0001", 1));
+  EXPECT_TRUE(IsCached(cache, "Full-0001", 0));
+  EXPECT_TRUE(IsCached(cache, "Full-0002", 0));
+  EXPECT_TRUE(IsCached(cache, "Full-0002", 1));
+
+  cache.GetStatistics(statistics);
+  EXPECT_EQ(4u, statistics.hits);
+  EXPECT_EQ(1u, statistics.misses);
+  EXPECT_EQ(1u, statistics.evictions);
+  EXPECT_EQ(3u, statistics.memory_chunks);
+  EXPECT_EQ(3 * chunk_size, statistics.memory_bytes);
+}
+
+TEST(chunk_cache, chunk_larger_than_buffer_is_a_miss)
+{
+  ChunkCache cache(3 * chunk_size);
+  char buffer[chunk_size / 2];
+  uint32_t buflen;
+
+  Put(cache, "Full-0001", 0);
+  EXPECT_FALSE(cache.Get("Full-0001", 0, buffer, sizeof(buffer), &buflen));
+}
+
+TEST(chunk_cache, invalidated_chunks_are_not_cached)
+{
+  ChunkCache cache(10 * chunk_size);
+  std::string data = MakeChunk("Full-0001", 5);
+  uint64_t generation;
+
+  Put(cache, "Full-0001", 0);
+  Put(cache, "Full-0001", 1);
+  Put(cache, "Full-0002", 0);
+
+  cache.Invalidate("Full-0001", 1);
+  EXPECT_FALSE(IsCached(cache, "Full-0001", 1));
+  EXPECT_TRUE(IsCached(cache, "Full-0001", 0));
+
+  cache.InvalidateVolume("Full-0001");
+  EXPECT_FALSE(IsCached(cache, "Full-0001", 0));
+  EXPECT_TRUE(IsCached(cache, "Full-0002", 0));
+
+  /*
+   * Data read from the backing store before the chunk got written is
+   * outdated.
+   */
+  generation = cache.Generation();
+  cache.Invalidate("Full-0001", 5);
+  cache.Put("Full-0001", 5, data.data(), data.size(), generation);
+  EXPECT_FALSE(IsCached(cache, "Full-0001", 5));
+}
+
+TEST(chunk_cache, evicted_chunks_are_kept_on_disk)
+{
+  char directory[] = "/tmp/chunk_cache_test.XXXXXX";
+  ChunkCacheStatistics statistics;
+
+  ASSERT_NE(nullptr, mkdtemp(directory));
+  {
+    ChunkCache cache(2 * chunk_size, directory, 2 * chunk_size);
+
+    for (uint16_t chunk = 0; chunk < 5; chunk++) {
+      Put(cache, "Full-0001", chunk);
+    }
+
+    /*
+     * Chunk 0 got evicted from disk too, 1 and 2 are on disk.
+     */
+    cache.GetStatistics(statistics);
+    EXPECT_EQ(2u, statistics.memory_chunks);
+    EXPECT_EQ(2u, statistics.disk_chunks);
+    EXPECT_EQ(1u, statistics.evictions);
+
+    EXPECT_FALSE(IsCached(cache, "Full-0001", 0));
+    EXPECT_TRUE(IsCached(cache, "Full-0001", 1));
+    EXPECT_TRUE(IsCached(cache, "Full-0001", 4));
+
+    cache.GetStatistics(statistics);
+    EXPECT_EQ(1u, statistics.disk_hits);
+    EXPECT_EQ(1u, statistics.hits);
+
+    cache.InvalidateVolume("Full-0001");
+    cache.GetStatistics(statistics);
+    EXPECT_EQ(0u, statistics.memory_chunks);
+    EXPECT_EQ(0u, statistics.disk_chunks);
+  }
+  EXPECT_EQ(0, rmdir(directory));
+}
@@ -0,0 +1,212 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "gtest/gtest.h"
+#include "include/bareos.h"
+#include "stored/stored.h"
+#include "stored/stored_globals.h"
+#include "stored/chunk_cache.h"
+#include "stored/backends/chunked_device.h"
+#include "stored/backends/chunkdir_device.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace storagedaemon;
+
+/*
+ * A volume of two full chunks and a partial one.
+ */
+static const size_t volume_size = 2 * DEFAULT_CHUNK_SIZE + 12345;
+static const size_t block_size = 64512;
+
+class ChunkdirDevice : public ::testing::Test {
+ protected:
+  char archive_dir_[64];
+  char working_dir_[64];
+
+  void SetUp() override
+  {
+    strcpy(archive_dir_, "/tmp/chunkdir_archive.XXXXXX");
+    strcpy(working_dir_, "/tmp/chunkdir_working.XXXXXX");
+    ASSERT_NE(nullptr, mkdtemp(archive_dir_));
+    ASSERT_NE(nullptr, mkdtemp(working_dir_));
+
+    /*
+     * The chunked device keeps its inflight files in the working directory.
+     */
+    me = new StorageResource;
+    me->working_directory = working_dir_;
+  }
+
+  void TearDown() override
+  {
+    FreeChunkCache();
+    me->working_directory = nullptr;
+    delete me;
+    me = nullptr;
+
+    std::string cmd = "rm -rf ";
+    system((cmd + archive_dir_ + " " + working_dir_).c_str());
+  }
+
+  chunkdir_device* NewDevice(const char* options)
+  {
+    chunkdir_device* dev = new chunkdir_device;
+
+    dev->dev_name = GetPoolMemory(PM_FNAME);
+    PmStrcpy(dev->dev_name, archive_dir_);
+    dev->prt_name = GetPoolMemory(PM_FNAME);
+    PmStrcpy(dev->prt_name, archive_dir_);
+    if (options) {
+      dev->dev_options = GetPoolMemory(PM_FNAME);
+      PmStrcpy(dev->dev_options, options);
+    }
+    dev->errmsg = GetPoolMemory(PM_EMSG);
+    bstrncpy(dev->VolCatInfo.VolCatName, "Full-0001",
+             sizeof(dev->VolCatInfo.VolCatName));
+
+    return dev;
+  }
+
+  void FreeDevice(chunkdir_device* dev)
+  {
+    FreePoolMemory(dev->dev_name);
+    FreePoolMemory(dev->prt_name);
+    if (dev->dev_options) { FreePoolMemory(dev->dev_options); }
+    FreePoolMemory(dev->errmsg);
+    delete dev;
+  }
+
+  std::vector<char> MakeData()
+  {
+    std::vector<char> data(volume_size);
+
+    for (size_t i = 0; i < volume_size; i++) { data[i] = (i * 7 + i / 4096); }
+
+    return data;
+  }
+
+  void WriteVolume(const char* options, const std::vector<char>& data)
+  {
+    chunkdir_device* dev = NewDevice(options);
+
+    ASSERT_EQ(0, dev->d_open(NULL, O_CREAT | O_RDWR, 0640));
+    for (size_t offset = 0; offset < data.size(); offset += block_size) {
+      size_t len = std::min(block_size, data.size() - offset);
+
+      ASSERT_EQ((ssize_t)len, dev->d_write(0, data.data() + offset, len));
+    }
+    dev->VolCatInfo.VolCatBytes = data.size();
+    EXPECT_TRUE(dev->d_flush(NULL));
+    EXPECT_EQ(0, dev->d_close(0));
+    FreeDevice(dev);
+  }
+
+  void ReadVolume(const char* options, const std::vector<char>& data)
+  {
+    chunkdir_device* dev = NewDevice(options);
+    std::vector<char> read_data(data.size());
+    size_t offset = 0;
+    ssize_t len;
+
+    ASSERT_EQ(0, dev->d_open(NULL, O_RDONLY, 0640));
+    while ((len = dev->d_read(0, read_data.data() + offset,
+                              std::min(block_size, data.size() - offset))) >
+           0) {
+      offset += len;
+      if (offset == data.size()) { break; }
+    }
+    EXPECT_EQ(data.size(), offset);
+    EXPECT_TRUE(data == read_data);
+
+    EXPECT_EQ((boffset_t)data.size(), dev->d_lseek(NULL, 0, SEEK_END));
+    EXPECT_EQ(0, dev->d_close(0));
+    FreeDevice(dev);
+  }
+};
+
+TEST_F(ChunkdirDevice, write_and_read_volume)
+{
+  std::vector<char> data = MakeData();
+  std::string chunk = std::string(archive_dir_) + "/Full-0001/0002";
+  struct stat st;
+
+  WriteVolume(NULL, data);
+  ASSERT_EQ(0, stat(chunk.c_str(), &st));
+  EXPECT_EQ(12345, st.st_size);
+
+  ReadVolume(NULL, data);
+}
+
+TEST_F(ChunkdirDevice, write_and_read_volume_using_io_threads)
+{
+  std::vector<char> data = MakeData();
+
+  me->chunk_cache_size = 3 * DEFAULT_CHUNK_SIZE;
+
+  WriteVolume("iothreads=2,ioslots=2", data);
+  ReadVolume("iothreads=2,prefetch=2,latency=10", data);
+
+  /*
+   * The second read finds the chunks in the cache.
+   */
+  ChunkCacheStatistics statistics;
+  ReadVolume("iothreads=1", data);
+  GetChunkCache()->GetStatistics(statistics);
+  EXPECT_GE(statistics.hits, 3u);
+}
+
+TEST_F(ChunkdirDevice, injected_failure_fails_the_write)
+{
+  std::vector<char> data = MakeData();
+  chunkdir_device* dev = NewDevice("failevery=2");
+  ssize_t status = 0;
+
+  /*
+   * The first flush creates the volume, the second one fails.
+   */
+  ASSERT_EQ(0, dev->d_open(NULL, O_CREAT | O_RDWR, 0640));
+  for (size_t offset = 0; offset < data.size() && status >= 0;
+       offset += block_size) {
+    status = dev->d_write(0, data.data() + offset,
+                          std::min(block_size, data.size() - offset));
+  }
+  EXPECT_EQ(-1, status);
+  dev->d_close(0);
+  FreeDevice(dev);
+}
+
+TEST_F(ChunkdirDevice, truncate_removes_all_chunks)
+{
+  std::vector<char> data = MakeData();
+  chunkdir_device* dev;
+
+  WriteVolume(NULL, data);
+
+  dev = NewDevice(NULL);
+  ASSERT_EQ(0, dev->d_open(NULL, O_RDWR, 0640));
+  EXPECT_TRUE(dev->d_truncate(NULL));
+  EXPECT_EQ(0, dev->d_lseek(NULL, 0, SEEK_END));
+  EXPECT_EQ(0, dev->d_close(0));
+  FreeDevice(dev);
+}
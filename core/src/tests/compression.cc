@@ -0,0 +1,150 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "gtest/gtest.h"
+#include "include/bareos.h"
+#include "include/jcr.h"
+#include "include/ch.h"
+#include "include/streams.h"
+#include "lib/compression.h"
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(HAVE_LIBZ)
+/*
+ * Threads of one job compress and decompress with their own
+ * compression context at the same time.
+ */
+TEST(compression, separate_contexts_per_thread)
+{
+  const int threads = 4;
+  std::shared_ptr<JobControlRecord> jcr(std::make_shared<JobControlRecord>());
+  std::vector<std::thread> workers;
+  std::vector<int> results(threads, 0);
+
+  jcr->buf_size = DEFAULT_NETWORK_BUFFER_SIZE;
+
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back([&jcr, &results, t] {
+      CompressionContext compress;
+      uint32_t compress_buf_size = 0, decompress_buf_size = 0;
+      std::string input;
+      bool ok = true;
+
+      if (!SetupCompressionBuffers(jcr.get(), &compress, false, COMPRESS_GZIP,
+                                   &compress_buf_size) ||
+          !SetupDecompressionBuffers(jcr.get(), &compress,
+                                     &decompress_buf_size)) {
+        return;
+      }
+      compress.deflate_buffer = GetMemory(compress_buf_size);
+      compress.deflate_buffer_size = compress_buf_size;
+      compress.inflate_buffer = GetMemory(decompress_buf_size);
+      compress.inflate_buffer_size = decompress_buf_size;
+
+      for (int i = 0; i < 2000; i++) {
+        input += "thread " + std::to_string(t) + " line " + std::to_string(i);
+      }
+
+      for (int round = 0; ok && round < 50; round++) {
+        uint32_t compress_len = 0;
+        char* data;
+        uint32_t length;
+
+        ok = CompressData(jcr.get(), &compress, COMPRESS_GZIP,
+                          const_cast<char*>(input.data()), input.size(),
+                          (unsigned char*)compress.deflate_buffer,
+                          compress.deflate_buffer_size, &compress_len);
+        data = compress.deflate_buffer;
+        length = compress_len;
+        ok = ok && compress_len < input.size() &&
+             DecompressData(jcr.get(), &compress, "test", STREAM_GZIP_DATA,
+                            &data, &length, false) &&
+             std::string(data, length) == input;
+      }
+
+      CleanupCompression(&compress);
+      results[t] = ok;
+    });
+  }
+  for (auto& worker : workers) { worker.join(); }
+
+  for (int t = 0; t < threads; t++) { EXPECT_TRUE(results[t]) << t; }
+}
+#endif
+
+#if defined(HAVE_ZSTD)
+/*
+ * A record compressed with ZSTD and a compression header decompresses again,
+ * even when it is bigger than the inflate buffer of the reader.
+ */
+TEST(compression, zstd_round_trip_with_header)
+{
+  std::shared_ptr<JobControlRecord> jcr(std::make_shared<JobControlRecord>());
+  CompressionContext compress;
+  uint32_t compress_buf_size = 0, compress_len = 0;
+  std::string input;
+  char* data;
+  uint32_t length;
+
+  jcr->buf_size = 2 * 1024 * 1024;
+  ASSERT_FALSE(SetupCompressionBuffers(jcr.get(), &compress, true,
+                                       COMPRESS_ZSTD, &compress_buf_size));
+  ASSERT_TRUE(SetupCompressionBuffers(jcr.get(), &compress, false,
+                                      COMPRESS_ZSTD, &compress_buf_size));
+  compress.deflate_buffer = GetMemory(compress_buf_size);
+  compress.deflate_buffer_size = compress_buf_size;
+  compress.inflate_buffer = GetMemory(DEFAULT_NETWORK_BUFFER_SIZE);
+  compress.inflate_buffer_size = DEFAULT_NETWORK_BUFFER_SIZE;
+
+  for (int i = 0; input.size() < (size_t)jcr->buf_size - 100; i++) {
+    input += "block " + std::to_string(i % 5000) + " ";
+  }
+
+  ASSERT_TRUE(CompressData(
+      jcr.get(), &compress, COMPRESS_ZSTD, const_cast<char*>(input.data()),
+      input.size(),
+      (unsigned char*)compress.deflate_buffer + sizeof(comp_stream_header),
+      compress.deflate_buffer_size - sizeof(comp_stream_header),
+      &compress_len));
+  EXPECT_LT(compress_len, input.size() / 10);
+
+  ser_declare;
+  SerBegin(compress.deflate_buffer, sizeof(comp_stream_header));
+  ser_uint32(COMPRESS_ZSTD);
+  ser_uint32(compress_len);
+  ser_uint16(3);
+  ser_uint16(COMP_HEAD_VERSION);
+  SerEnd(compress.deflate_buffer, sizeof(comp_stream_header));
+
+  data = compress.deflate_buffer;
+  length = compress_len + sizeof(comp_stream_header);
+  ASSERT_TRUE(DecompressData(jcr.get(), &compress, "test",
+                             STREAM_COMPRESSED_DATA, &data, &length, false));
+  EXPECT_EQ(input.size(), length);
+  EXPECT_TRUE(std::string(data, length) == input);
+
+  CleanupCompression(&compress);
+}
+#endif
@@ -0,0 +1,99 @@
+/**
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Microbenchmark of the CRC32 algorithms used for block checksums.
+ *
+ * Usage: crc32_benchmark [block size in bytes] [total MiB per algorithm]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "stored/crc32/crc32.h"
+
+typedef uint32_t (*Crc32Function)(const void*, size_t, uint32_t);
+
+struct Crc32Algorithm {
+  const char* name;
+  Crc32Function func;
+  bool supported;
+};
+
+static void RunBenchmark(const Crc32Algorithm& algo,
+                         const std::vector<uint8_t>& buf,
+                         size_t total_bytes,
+                         uint32_t expected)
+{
+  size_t iterations = total_bytes / buf.size();
+  uint32_t crc = 0;
+
+  if (iterations == 0) { iterations = 1; }
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; i++) {
+    crc = algo.func(buf.data(), buf.size(), 0);
+  }
+  auto stop = std::chrono::steady_clock::now();
+
+  double seconds = std::chrono::duration<double>(stop - start).count();
+  double mib = (double)iterations * buf.size() / (1024.0 * 1024.0);
+
+  printf("%-16s %10.1f MiB/s  %s\n", algo.name, mib / seconds,
+         crc == expected ? "ok" : "MISMATCH");
+}
+
+int main(int argc, char* argv[])
+{
+  size_t block_size = 1024 * 1024;
+  size_t total_mib = 4096;
+
+  if (argc > 1) { block_size = strtoul(argv[1], NULL, 10); }
+  if (argc > 2) { total_mib = strtoul(argv[2], NULL, 10); }
+  if (block_size == 0) { block_size = 1; }
+
+  std::vector<uint8_t> buf(block_size);
+  for (size_t i = 0; i < buf.size(); i++) { buf[i] = (i * 131 + 17) & 0xff; }
+
+  const Crc32Algorithm algorithms[] = {
+      {"1byte", crc32_1byte, true},
+      {"4x8bytes", crc32_4x8bytes, true},
+      {"16bytes", crc32_16bytes, true},
+      {"pclmulqdq", crc32_pclmul, crc32_pclmul_supported()},
+      {"vpclmulqdq", crc32_vpclmul, crc32_vpclmul_supported()},
+      {"fast", crc32_fast, true},
+  };
+  uint32_t expected = crc32_16bytes(buf.data(), buf.size(), 0);
+
+  printf("block size %zu bytes, %zu MiB per algorithm, crc32_fast uses %s\n",
+         block_size, total_mib, crc32_fast_name());
+  for (const auto& algo : algorithms) {
+    if (!algo.supported) {
+      printf("%-16s not supported on this CPU\n", algo.name);
+      continue;
+    }
+    RunBenchmark(algo, buf, total_mib * 1024 * 1024, expected);
+  }
+
+  return 0;
+}
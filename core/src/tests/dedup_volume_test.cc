@@ -0,0 +1,264 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "gtest/gtest.h"
+#include "include/bareos.h"
+#include "stored/stored.h"
+#include "stored/backends/dedup_store.h"
+#include "stored/backends/dedup_volume.h"
+
+#include <string>
+
+using namespace storagedaemon;
+
+static const uint32_t block_size = 64512;
+static const uint32_t chunk_size = 8192;
+
+/*
+ * Packs records into blocks with the regular record code and writes the
+ * blocks to a dedup volume, keeping a copy of the plain volume.
+ */
+class VolumeWriter {
+ public:
+  VolumeWriter(DedupVolume& volume) : volume_(volume)
+  {
+    block_ = (DeviceBlock*)GetMemory(sizeof(DeviceBlock));
+    memset(block_, 0, sizeof(DeviceBlock));
+    block_->buf_len = block_size;
+    block_->buf = GetMemory(block_size);
+    EmptyBlock(block_);
+    rec_ = new_record();
+  }
+
+  ~VolumeWriter()
+  {
+    FreeRecord(rec_);
+    FreeBlock(block_);
+  }
+
+  void Append(int32_t FileIndex, int32_t Stream, const std::string& data)
+  {
+    rec_->VolSessionId = 1;
+    rec_->VolSessionTime = 1234;
+    rec_->FileIndex = FileIndex;
+    rec_->Stream = Stream;
+    rec_->data = CheckPoolMemorySize(rec_->data, data.size());
+    memcpy(rec_->data, data.data(), data.size());
+    rec_->data_len = data.size();
+    rec_->state = st_none;
+
+    while (!WriteRecordToBlock(block_, rec_)) { Flush(); }
+  }
+
+  void Flush()
+  {
+    ser_declare;
+
+    if (block_->binbuf <= WRITE_BLKHDR_LENGTH) { return; }
+
+    SerBegin(block_->buf, BLKHDR2_LENGTH);
+    ser_uint32(0);
+    ser_uint32(block_->binbuf);
+    ser_uint32(block_->BlockNumber++);
+    SerBytes(BLKHDR2_ID, BLKHDR_ID_LENGTH);
+    ser_uint32(block_->VolSessionId);
+    ser_uint32(block_->VolSessionTime);
+
+    WriteRaw(std::string(block_->buf, block_->binbuf));
+    EmptyBlock(block_);
+  }
+
+  void WriteRaw(const std::string& data)
+  {
+    ASSERT_EQ((ssize_t)data.size(), volume_.Write(data.data(), data.size()));
+    contents += data;
+  }
+
+  std::string contents;
+
+ private:
+  DedupVolume& volume_;
+  DeviceBlock* block_;
+  DeviceRecord* rec_;
+};
+
+class DedupVolumeTest : public ::testing::Test {
+ protected:
+  char directory_[64];
+  std::string path_;
+  std::string store_path_;
+  DedupStore* store_ = nullptr;
+
+  void SetUp() override
+  {
+    strcpy(directory_, "/tmp/dedup_volume_test.XXXXXX");
+    ASSERT_NE(nullptr, mkdtemp(directory_));
+    path_ = std::string(directory_) + "/Full-0001";
+    store_path_ = std::string(directory_) + "/.dedup";
+    store_ = DedupStore::Open(store_path_.c_str());
+    ASSERT_NE(nullptr, store_);
+  }
+
+  void TearDown() override
+  {
+    if (store_) { DedupStore::Release(store_); }
+
+    std::string cmd = "rm -rf ";
+    system((cmd + directory_).c_str());
+  }
+
+  /*
+   * Data that does not repeat itself, so all duplicates come from
+   * writing the same data twice.
+   */
+  std::string FileData(size_t len, uint64_t seed)
+  {
+    std::string data(len, '\0');
+
+    for (size_t i = 0; i < len; i++) {
+      uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      data[i] = (z ^ (z >> 27)) >> 56;
+    }
+
+    return data;
+  }
+
+  std::string ReadVolume(DedupVolume& volume)
+  {
+    std::string data, buf(100000, '\0');
+    ssize_t n;
+
+    volume.Seek(0, SEEK_SET);
+    while ((n = volume.Read(&buf[0], buf.size())) > 0) {
+      data.append(buf.data(), n);
+    }
+    EXPECT_EQ(0, n);
+
+    return data;
+  }
+};
+
+TEST_F(DedupVolumeTest, volume_reads_back_as_written)
+{
+  DedupVolume volume(store_, chunk_size);
+  std::string contents;
+  std::string buf(5000, '\0');
+
+  ASSERT_GE(volume.Open(path_.c_str(), O_CREAT | O_RDWR, 0640), 0);
+  {
+    VolumeWriter writer(volume);
+
+    writer.WriteRaw(FileData(200, 9)); /* anything not a block */
+    writer.Append(1, STREAM_UNIX_ATTRIBUTES, FileData(120, 1));
+    writer.Append(1, STREAM_FILE_DATA, FileData(65536, 2));
+    writer.Append(1, STREAM_FILE_DATA, FileData(70000, 3));
+    writer.Append(2, STREAM_UNIX_ATTRIBUTES, FileData(130, 4));
+    writer.Append(2, STREAM_FILE_DATA, FileData(200000, 5));
+    writer.Append(2, STREAM_MD5_DIGEST, FileData(16, 6));
+    writer.Flush();
+    contents = writer.contents;
+  }
+  EXPECT_TRUE(store_->Sync());
+  EXPECT_EQ(0, volume.Close());
+
+  /*
+   * Reads span blocks and start in the middle of blocks.
+   */
+  ASSERT_GE(volume.Open(path_.c_str(), O_RDONLY, 0640), 0);
+  EXPECT_EQ((boffset_t)contents.size(), volume.Seek(0, SEEK_END));
+  EXPECT_TRUE(contents == ReadVolume(volume));
+
+  volume.Seek(block_size + 1000, SEEK_SET);
+  ASSERT_EQ(5000, volume.Read(&buf[0], 5000));
+  EXPECT_EQ(contents.substr(block_size + 1000, 5000), buf);
+}
+
+TEST_F(DedupVolumeTest, same_file_data_is_stored_once)
+{
+  DedupVolume volume(store_, chunk_size);
+  std::string file = FileData(1024 * 1024, 7);
+  std::string contents;
+  DedupStatistics first, second;
+
+  ASSERT_GE(volume.Open(path_.c_str(), O_CREAT | O_RDWR, 0640), 0);
+  {
+    VolumeWriter writer(volume);
+
+    writer.Append(1, STREAM_UNIX_ATTRIBUTES, FileData(120, 1));
+    writer.Append(1, STREAM_FILE_DATA, file);
+    writer.Flush();
+    store_->GetStatistics(first);
+
+    /*
+     * The second copy starts at another offset in the blocks.
+     */
+    writer.Append(2, STREAM_UNIX_ATTRIBUTES, FileData(4000, 2));
+    writer.Append(2, STREAM_FILE_DATA, file);
+    writer.Flush();
+    store_->GetStatistics(second);
+    contents = writer.contents;
+  }
+
+  /*
+   * Only the payload after the last chunk boundary stays in the volume.
+   */
+  EXPECT_GT(first.bytes, file.size() * 9 / 10);
+  EXPECT_LT(second.bytes - first.bytes, file.size() / 20);
+  EXPECT_GT(second.dedup_bytes, file.size() * 9 / 10);
+
+  EXPECT_TRUE(contents == ReadVolume(volume));
+  volume.Close();
+}
+
+TEST_F(DedupVolumeTest, chunks_survive_reopening_the_store)
+{
+  std::string contents;
+
+  {
+    DedupVolume volume(store_, chunk_size);
+
+    ASSERT_GE(volume.Open(path_.c_str(), O_CREAT | O_RDWR, 0640), 0);
+    VolumeWriter writer(volume);
+
+    writer.Append(1, STREAM_FILE_DATA, FileData(3 * block_size, 1));
+    writer.Flush();
+    contents = writer.contents;
+  }
+
+  /*
+   * Releasing the last reference commits the index.
+   */
+  EXPECT_EQ(store_, DedupStore::Open(store_path_.c_str()));
+  DedupStore::Release(store_);
+  DedupStore::Release(store_);
+  store_ = DedupStore::Open(store_path_.c_str());
+  ASSERT_NE(nullptr, store_);
+
+  DedupVolume volume(store_, chunk_size);
+  ASSERT_GE(volume.Open(path_.c_str(), O_RDWR, 0640), 0);
+  EXPECT_TRUE(contents == ReadVolume(volume));
+
+  EXPECT_TRUE(volume.Truncate(nullptr, false));
+  EXPECT_EQ(0, volume.Seek(0, SEEK_END));
+  volume.Close();
+}
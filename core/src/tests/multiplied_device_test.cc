@@ -342,3 +342,26 @@ TEST(sd, MultipliedDeviceTest_CheckPointerReferenceOfCopiedDevice)
   DeviceResource* multiplied_device = dynamic_cast<DeviceResource*>(p);
   EXPECT_EQ(original_device, multiplied_device->multiplied_device_resource);
 }
+
+TEST(sd, MultipliedDeviceTest_CopiedDeviceHasAllSpoolDirectories)
+{
+  InitGlobals();
+  std::string path_to_config =
+      PROJECT_SOURCE_DIR "/src/tests/configs/stored_multiplied_device/";
+
+  PConfigParser my_config(InitSdConfig(path_to_config.c_str(), M_INFO));
+  storagedaemon::my_config = my_config.get();
+
+  ASSERT_TRUE(my_config->ParseConfig());
+
+  BareosResource* p;
+  p = my_config->GetResWithName(R_DEVICE, "MultipliedDeviceResource0003");
+  ASSERT_TRUE(p);
+  DeviceResource* multiplied_device = dynamic_cast<DeviceResource*>(p);
+  ASSERT_TRUE(multiplied_device->spool_directories);
+  ASSERT_EQ(multiplied_device->spool_directories->size(), 2);
+  EXPECT_STREQ((const char*)multiplied_device->spool_directories->get(0),
+               "/tmp/spool1");
+  EXPECT_STREQ((const char*)multiplied_device->spool_directories->get(1),
+               "/tmp/spool2");
+}
@@ -0,0 +1,127 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Stress benchmark of the ordered circular buffer used by the chunked
+ * device. Producers enqueue chunk requests for a number of volumes, io
+ * threads dequeue them reserving their slot like chunked_device does.
+ *
+ * Usage: ordered_cbuf_benchmark [io threads] [producers] [requests per
+ *        producer] [slots per io thread]
+ */
+
+#include "include/bareos.h"
+#include "stored/backends/ordered_cbuf.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace storagedaemon;
+
+struct bench_request {
+  char volname[32];
+  uint32_t chunk;
+  int merged;
+};
+
+static void UpdateBenchRequest(void* item1, void* item2)
+{
+  ((bench_request*)item1)->merged += 1 + ((bench_request*)item2)->merged;
+}
+
+int main(int argc, char* argv[])
+{
+  int io_threads = (argc > 1) ? atoi(argv[1]) : 16;
+  int producers = (argc > 2) ? atoi(argv[2]) : 4;
+  int per_producer = (argc > 3) ? atoi(argv[3]) : 250000;
+  int io_slots = (argc > 4) ? atoi(argv[4]) : OQSIZE;
+  ordered_circbuf cb(io_threads * io_slots);
+  std::atomic<long> dequeued{0}, accounted{0};
+  std::vector<std::thread> threads;
+
+  if (io_threads <= 0 || producers <= 0 || per_producer <= 0 || io_slots <= 0) {
+    fprintf(stderr,
+            "Usage: %s [io threads] [producers] [requests per producer] "
+            "[slots per io thread]\n",
+            argv[0]);
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (int p = 0; p < producers; p++) {
+    threads.emplace_back([&cb, p, per_producer]() {
+      ocbuf_key key;
+
+      for (int i = 0; i < per_producer; i++) {
+        bench_request* request = new bench_request;
+
+        snprintf(request->volname, sizeof(request->volname), "Full-%04d", p);
+        request->chunk = i / 4;
+        request->merged = 0;
+        MakeOcbufKey(key, request->volname, request->chunk);
+        if (cb.enqueue(request, sizeof(bench_request), key,
+                       UpdateBenchRequest) != request) {
+          delete request;
+        }
+      }
+    });
+  }
+
+  std::vector<std::thread> consumers;
+  for (int c = 0; c < io_threads; c++) {
+    consumers.emplace_back([&cb, &dequeued, &accounted]() {
+      bench_request* request;
+
+      while ((request = (bench_request*)cb.dequeue(true))) {
+        dequeued++;
+        accounted += 1 + request->merged;
+        delete request;
+        cb.unreserve_slot();
+      }
+    });
+  }
+
+  for (std::thread& thread : threads) { thread.join(); }
+  while (!cb.empty()) { std::this_thread::yield(); }
+  cb.flush();
+  for (std::thread& thread : consumers) { thread.join(); }
+
+  auto stop = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(stop - start).count();
+  long total = (long)producers * per_producer;
+
+  printf("%d io threads, %d producers, %d slots: %ld requests (%ld merged) "
+         "in %.3f s, %.0f requests/s\n",
+         io_threads, producers, cb.capacity(), total, total - dequeued.load(),
+         seconds, total / seconds);
+
+  if (accounted.load() != total) {
+    fprintf(stderr, "Lost requests: %ld of %ld accounted for\n",
+            accounted.load(), total);
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,256 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "gtest/gtest.h"
+#include "include/bareos.h"
+#include "stored/backends/ordered_cbuf.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace storagedaemon;
+
+struct test_request {
+  std::string volname;
+  uint32_t chunk;
+  int merged; /* Number of requests merged into this one */
+};
+
+static void UpdateTestRequest(void* item1, void* item2)
+{
+  test_request* request1 = (test_request*)item1;
+  test_request* request2 = (test_request*)item2;
+
+  request1->merged += 1 + request2->merged;
+}
+
+static int CompareVolume(void* item1, void* item2)
+{
+  test_request* request = (test_request*)item1;
+
+  return request->volname.compare((const char*)item2);
+}
+
+static test_request* Enqueue(ordered_circbuf& cb,
+                             test_request* request,
+                             bool use_reserved_slot = false)
+{
+  ocbuf_key key;
+
+  MakeOcbufKey(key, request->volname.c_str(), request->chunk);
+  return (test_request*)cb.enqueue(request, sizeof(test_request), key,
+                                   UpdateTestRequest, use_reserved_slot);
+}
+
+TEST(ordered_cbuf, names_order_like_strcmp)
+{
+  static const char* names[] = {"zz",        "Full-01",   "abcdefgh",
+                                "a",         "z\xff",     "abcdefghi",
+                                "Full-0010", "abc",       "Full-001",
+                                "b",         "abcdefgh0", "ab"};
+  const int nr_names = sizeof(names) / sizeof(names[0]);
+  ordered_circbuf cb(nr_names);
+  std::vector<test_request> requests;
+
+  for (const char* name : names) { requests.push_back({name, 1, 0}); }
+  for (test_request& request : requests) {
+    ASSERT_EQ(&request, Enqueue(cb, &request));
+  }
+
+  test_request* previous = (test_request*)cb.dequeue();
+  for (int i = 1; i < nr_names; i++) {
+    test_request* request = (test_request*)cb.dequeue();
+
+    ASSERT_NE(nullptr, request);
+    EXPECT_LT(strcmp(previous->volname.c_str(), request->volname.c_str()), 0)
+        << previous->volname << " " << request->volname;
+    previous = request;
+  }
+  EXPECT_TRUE(cb.empty());
+}
+
+TEST(ordered_cbuf, dequeue_in_key_order)
+{
+  ordered_circbuf cb(32);
+  std::vector<test_request> requests;
+  static const uint32_t chunks[] = {7, 3, 9, 1, 4};
+
+  for (const char* volname : {"vol2", "vol1"}) {
+    for (uint32_t chunk : chunks) {
+      requests.push_back(test_request{volname, chunk, 0});
+    }
+  }
+  for (test_request& request : requests) {
+    ASSERT_EQ(&request, Enqueue(cb, &request));
+  }
+
+  test_request* last = (test_request*)cb.peek(PEEK_LAST, (void*)"vol1",
+                                               CompareVolume);
+  ASSERT_NE(nullptr, last);
+  EXPECT_EQ(9u, last->chunk);
+  free(last);
+
+  std::string previous_volname;
+  uint32_t previous_chunk = 0;
+  for (size_t i = 0; i < requests.size(); i++) {
+    test_request* request = (test_request*)cb.dequeue();
+
+    ASSERT_NE(nullptr, request);
+    if (request->volname == previous_volname) {
+      EXPECT_GT(request->chunk, previous_chunk);
+    } else {
+      EXPECT_GT(request->volname, previous_volname);
+    }
+    previous_volname = request->volname;
+    previous_chunk = request->chunk;
+  }
+  EXPECT_TRUE(cb.empty());
+}
+
+TEST(ordered_cbuf, same_key_is_merged)
+{
+  ordered_circbuf cb(4);
+  test_request first{"vol1", 1, 0}, second{"vol1", 1, 0}, other{"vol1", 2, 0};
+
+  EXPECT_EQ(&first, Enqueue(cb, &first));
+  EXPECT_EQ(&first, Enqueue(cb, &second));
+  EXPECT_EQ(&other, Enqueue(cb, &other));
+  EXPECT_EQ(1, first.merged);
+  EXPECT_FALSE(cb.full());
+
+  EXPECT_EQ(&first, cb.dequeue());
+  EXPECT_EQ(&other, cb.dequeue());
+  EXPECT_TRUE(cb.empty());
+}
+
+TEST(ordered_cbuf, requeue_uses_reserved_slot)
+{
+  ordered_circbuf cb(2);
+  test_request one{"vol1", 1, 0}, two{"vol1", 2, 0};
+
+  Enqueue(cb, &one);
+  Enqueue(cb, &two);
+  EXPECT_TRUE(cb.full());
+
+  /*
+   * The reserved slot keeps the buffer full but can be used to put the
+   * request back without blocking.
+   */
+  EXPECT_EQ(&one, cb.dequeue(true));
+  EXPECT_TRUE(cb.full());
+  EXPECT_EQ(&one, Enqueue(cb, &one, true));
+  EXPECT_EQ(-1, cb.unreserve_slot());
+
+  EXPECT_EQ(&one, cb.dequeue(true));
+  EXPECT_EQ(0, cb.unreserve_slot());
+  EXPECT_FALSE(cb.full());
+}
+
+TEST(ordered_cbuf, flush_wakes_consumers)
+{
+  ordered_circbuf cb(4);
+  std::atomic<int> done{0};
+  std::vector<std::thread> consumers;
+
+  for (int i = 0; i < 4; i++) {
+    consumers.emplace_back([&cb, &done]() {
+      EXPECT_EQ(nullptr, cb.dequeue());
+      done++;
+    });
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(0, done.load());
+
+  cb.flush();
+  for (std::thread& consumer : consumers) { consumer.join(); }
+  EXPECT_EQ(4, done.load());
+}
+
+/*
+ * Several producers enqueue requests for a small set of chunks while
+ * consumers take them and requeue some of them. Every request has to end
+ * up either dequeued or merged into a request that was dequeued.
+ */
+TEST(ordered_cbuf, concurrent_producers_and_consumers)
+{
+  const int nr_producers = 4, nr_consumers = 8, per_producer = 20000;
+  ordered_circbuf cb(16);
+  std::atomic<int> accounted{0}, producers_done{0};
+  std::vector<std::thread> threads;
+
+  for (int p = 0; p < nr_producers; p++) {
+    threads.emplace_back([&cb, &producers_done, p]() {
+      for (int i = 0; i < per_producer; i++) {
+        test_request* request = new test_request{
+            "vol" + std::to_string(i % 3), (uint32_t)(i % 7), 0};
+
+        if (Enqueue(cb, request) != request) { delete request; }
+      }
+      producers_done++;
+    });
+  }
+
+  for (int c = 0; c < nr_consumers; c++) {
+    threads.emplace_back([&cb, &accounted, c]() {
+      int taken = 0;
+
+      while (1) {
+        test_request* request = (test_request*)cb.dequeue(true);
+        if (!request) { break; }
+
+        /*
+         * Put some requests back like an io thread does after a failure.
+         */
+        if (++taken % 5 == c % 5) {
+          if (Enqueue(cb, request, true) != request) { delete request; }
+          continue;
+        }
+
+        accounted += 1 + request->merged;
+        delete request;
+        EXPECT_EQ(0, cb.unreserve_slot());
+      }
+    });
+  }
+
+  /*
+   * Peek concurrently like the status command does.
+   */
+  threads.emplace_back([&cb, &producers_done]() {
+    while (producers_done.load() < nr_producers) {
+      cb.peek(PEEK_LIST, nullptr, [](void* item1, void* item2) {
+        EXPECT_LT(((test_request*)item1)->chunk, 7u);
+        return 0;
+      });
+    }
+  });
+
+  while (producers_done.load() < nr_producers || !cb.empty()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  cb.flush();
+  for (std::thread& thread : threads) { thread.join(); }
+
+  EXPECT_EQ(nr_producers * per_producer, accounted.load());
+  EXPECT_TRUE(cb.empty());
+}
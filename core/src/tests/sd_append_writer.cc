@@ -0,0 +1,192 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "gtest/gtest.h"
+#include "include/bareos.h"
+#include "stored/stored.h"
+#include "stored/append_writer.h"
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace storagedaemon;
+
+/*
+ * The tests below never fill a block, so the device is never written.
+ */
+class NullDevice : public Device {
+ public:
+  int d_ioctl(int, ioctl_req_t, char*) override { return -1; }
+  int d_open(const char*, int, int) override { return -1; }
+  int d_close(int) override { return 0; }
+  ssize_t d_read(int, void*, size_t) override { return -1; }
+  ssize_t d_write(int, const void*, size_t) override { return -1; }
+  boffset_t d_lseek(DeviceControlRecord*, boffset_t, int) override
+  {
+    return -1;
+  }
+  bool d_truncate(DeviceControlRecord*) override { return true; }
+};
+
+class AppendWriterTest : public ::testing::Test {
+ protected:
+  void SetUp() override
+  {
+    device.streaming_buffer_size = 0;
+    dev.device = &device;
+    dev.max_block_size = DEFAULT_BLOCK_SIZE;
+    dcr.device = &device;
+    dcr.SetDev(&dev);
+    dcr.block = new_block(&dev);
+    rec = new_record();
+  }
+
+  void TearDown() override
+  {
+    FreeRecord(rec);
+    FreeBlock(dcr.block);
+  }
+
+  DeviceRecord* Attributes(int32_t file_index)
+  {
+    PmStrcpy(rec->data, "attributes");
+    rec->data_len = strlen(rec->data) + 1;
+    rec->FileIndex = file_index;
+    rec->Stream = STREAM_UNIX_ATTRIBUTES;
+    rec->maskedStream = STREAM_UNIX_ATTRIBUTES;
+
+    return rec;
+  }
+
+  DeviceResource device;
+  NullDevice dev;
+  DeviceControlRecord dcr;
+  DeviceRecord* rec = nullptr;
+};
+
+TEST_F(AppendWriterTest, sends_attributes_in_order)
+{
+  std::vector<int32_t> sent;
+  AppendWriter writer(&dcr, 4, [&sent](DeviceRecord* attr) {
+    sent.push_back(attr->FileIndex);
+    return true;
+  });
+
+  ASSERT_TRUE(writer.Start());
+  for (int32_t i = 1; i <= 3; i++) {
+    EXPECT_TRUE(writer.QueueAttributes(Attributes(i)));
+  }
+  EXPECT_TRUE(sent.empty());
+  EXPECT_TRUE(writer.Stop());
+
+  EXPECT_EQ(std::vector<int32_t>({1, 2, 3}), sent);
+  EXPECT_FALSE(writer.Failed());
+}
+
+/*
+ * A failed attribute send must fail the job like it does when the
+ * attributes are sent synchronously.
+ */
+TEST_F(AppendWriterTest, failed_attribute_send_fails)
+{
+  int calls = 0;
+  AppendWriter writer(&dcr, 4, [&calls](DeviceRecord*) {
+    calls++;
+    return false;
+  });
+
+  ASSERT_TRUE(writer.Start());
+  EXPECT_TRUE(writer.QueueAttributes(Attributes(1)));
+  EXPECT_TRUE(writer.QueueAttributes(Attributes(2)));
+  EXPECT_FALSE(writer.Stop());
+
+  EXPECT_EQ(1, calls);
+  EXPECT_TRUE(writer.Failed());
+  EXPECT_FALSE(writer.QueueAttributes(Attributes(3)));
+  EXPECT_EQ(1, calls);
+}
+
+TEST(WatermarkGate, clamps_watermarks)
+{
+  WatermarkGate unbuffered(0, 0);
+  WatermarkGate equal(8, 8);
+  WatermarkGate negative(4, -1);
+
+  EXPECT_EQ(1, unbuffered.High());
+  EXPECT_EQ(0, unbuffered.Low());
+  EXPECT_EQ(8, equal.High());
+  EXPECT_EQ(7, equal.Low());
+  EXPECT_EQ(0, negative.Low());
+}
+
+/*
+ * A slow producer and a fast writer, the writer may only write while more
+ * than the low watermark of blocks is queued and must start no earlier than
+ * the high watermark was reached.
+ */
+TEST(WatermarkGate, writes_in_bursts)
+{
+  const int blocks = 20;
+  WatermarkGate gate(4, 1);
+  std::mutex mutex;
+  std::deque<int> queue;
+  std::vector<size_t> queued_at_write;
+  bool finished = false;
+
+  std::thread writer([&] {
+    while (1) {
+      gate.WaitForDrain();
+
+      std::lock_guard<std::mutex> lock(mutex);
+      if (queue.empty()) {
+        if (finished) { break; }
+        continue;
+      }
+      if (!finished) { queued_at_write.push_back(queue.size()); }
+      queue.pop_front();
+      gate.Written();
+    }
+  });
+
+  for (int i = 0; i < blocks; i++) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      queue.push_back(i);
+    }
+    gate.Added();
+    Bmicrosleep(0, 2000);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    finished = true;
+  }
+  gate.Finish();
+  writer.join();
+
+  EXPECT_TRUE(queue.empty());
+  ASSERT_FALSE(queued_at_write.empty());
+  EXPECT_GE(queued_at_write.front(), 4u);
+  for (size_t queued : queued_at_write) { EXPECT_GT(queued, 1u); }
+  EXPECT_GE(gate.Underruns(), 1u);
+  EXPECT_LE(gate.Underruns(), (uint32_t)blocks / 3);
+}
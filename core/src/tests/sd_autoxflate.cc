@@ -0,0 +1,216 @@
+/**
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "gtest/gtest.h"
+#include "include/bareos.h"
+#include "include/jcr.h"
+#include "stored/stored.h"
+#include "stored/stored_globals.h"
+#include "stored/sd_plugins.h"
+#include "stored/jcr_private.h"
+#include "stored/job.h"
+
+#include <utility>
+#include <vector>
+
+using namespace storagedaemon;
+
+/*
+ * FileIndex and stream of every record handed back by
+ * DeviceControlRecord::WriteDeferredRecords().
+ */
+static std::vector<std::pair<int32_t, int32_t>> written;
+
+static bool RecordWritten(JobControlRecord* jcr, DeviceRecord* rec)
+{
+  written.push_back(std::make_pair(rec->FileIndex, rec->maskedStream));
+  return true;
+}
+
+/*
+ * Load the autoxflate plugin and setup a job writing to a device that
+ * deflates the records with a pool of workers.
+ */
+class AutoXflate : public ::testing::Test {
+ protected:
+  void SetUp() override;
+  void TearDown() override;
+  void WriteRecords(int nr_records);
+
+  JobControlRecord* jcr = nullptr;
+  DeviceResource* device = nullptr;
+  DeviceControlRecord* dcr = nullptr;
+  DeviceRecord* rec = nullptr;
+};
+
+void AutoXflate::SetUp()
+{
+  alist plugin_names(1, not_owned_by_alist);
+
+  InitMsg(NULL, NULL);
+  written.clear();
+
+  me = new StorageResource;
+  plugin_names.append((char*)"autoxflate");
+  LoadSdPlugins(AUTOXFLATE_PLUGIN_DIR, &plugin_names);
+
+  jcr = NewStoredJcr();
+  jcr->JobId = 1;
+  NewPlugins(jcr);
+  ASSERT_NE(jcr->plugin_ctx_list, nullptr);
+
+  device = new DeviceResource;
+  device->autodeflate_algorithm = COMPRESS_GZIP;
+  device->autodeflate_level = 6;
+  device->autoxflate_workers = 4;
+
+  dcr = new DeviceControlRecord;
+  dcr->jcr = jcr;
+  dcr->device = device;
+  dcr->autodeflate = IO_DIRECTION_OUT;
+  dcr->deferred_record_written = RecordWritten;
+  dcr->block = (DeviceBlock*)GetMemory(sizeof(DeviceBlock));
+  memset(dcr->block, 0, sizeof(DeviceBlock));
+  dcr->block->buf_len = 8 * 1024 * 1024;
+  dcr->block->block_len = dcr->block->buf_len;
+  dcr->block->buf = GetMemory(dcr->block->buf_len);
+  EmptyBlock(dcr->block);
+
+  rec = new_record();
+  dcr->rec = rec;
+}
+
+void AutoXflate::TearDown()
+{
+  if (jcr) {
+    EXPECT_EQ(GeneratePluginEvent(jcr, bsdEventJobEnd), bRC_OK);
+    FreePlugins(jcr);
+    jcr->JobId = 0;
+    FreeJcr(jcr);
+  }
+  UnloadSdPlugins();
+
+  if (rec) { FreeRecord(rec); }
+  if (dcr) {
+    FreeMemory(dcr->block->buf);
+    FreeMemory((POOLMEM*)dcr->block);
+    delete dcr;
+  }
+  delete device;
+  delete me;
+  me = nullptr;
+
+  TermMsg();
+}
+
+/*
+ * Write records of different sizes so the workers finish them out of order,
+ * every third record is an attribute record which is not translated.
+ */
+void AutoXflate::WriteRecords(int nr_records)
+{
+  for (int i = 1; i <= nr_records; i++) {
+    uint32_t len = (i % 3 == 0) ? 100 : ((i * 7919) % 60000) + 1;
+
+    rec->data = CheckPoolMemorySize(rec->data, len);
+    for (uint32_t j = 0; j < len; j++) { rec->data[j] = (char)(j % 13); }
+    rec->data_len = len;
+    rec->FileIndex = i;
+    rec->Stream = (i % 3 == 0) ? STREAM_UNIX_ATTRIBUTES : STREAM_FILE_DATA;
+    rec->maskedStream = rec->Stream;
+    rec->VolSessionId = 1;
+    rec->VolSessionTime = 2;
+    rec->state = st_none;
+    rec->remainder = 0;
+
+    ASSERT_TRUE(dcr->WriteRecord());
+
+    /*
+     * Same as the append loop, a record not queued by the plugin was
+     * written right away.
+     */
+    if (!dcr->record_deferred) { RecordWritten(jcr, rec); }
+  }
+}
+
+TEST_F(AutoXflate, deferred_records_keep_submission_order)
+{
+  const int nr_records = 200;
+
+  ASSERT_EQ(GeneratePluginEvent(jcr, bsdEventSetupRecordTranslation, dcr),
+            bRC_OK);
+  WriteRecords(nr_records);
+  ASSERT_TRUE(dcr->WriteDeferredRecords(true));
+
+  ASSERT_EQ(written.size(), (size_t)nr_records);
+  for (int i = 1; i <= nr_records; i++) {
+    EXPECT_EQ(written[i - 1].first, i);
+    EXPECT_EQ(written[i - 1].second, (i % 3 == 0) ? STREAM_UNIX_ATTRIBUTES
+                                                  : STREAM_COMPRESSED_DATA);
+  }
+}
+
+TEST_F(AutoXflate, drain_writes_every_queued_record)
+{
+  const int nr_records = 20;
+
+  ASSERT_EQ(GeneratePluginEvent(jcr, bsdEventSetupRecordTranslation, dcr),
+            bRC_OK);
+  WriteRecords(nr_records);
+  EXPECT_LE(written.size(), (size_t)nr_records);
+
+  ASSERT_TRUE(dcr->WriteDeferredRecords(true));
+  EXPECT_EQ(written.size(), (size_t)nr_records);
+
+  /*
+   * Nothing is left to hand back.
+   */
+  ASSERT_TRUE(dcr->WriteDeferredRecords(true));
+  EXPECT_EQ(written.size(), (size_t)nr_records);
+}
+
+TEST_F(AutoXflate, without_workers_records_are_written_directly)
+{
+  device->autoxflate_workers = 0;
+  ASSERT_EQ(GeneratePluginEvent(jcr, bsdEventSetupRecordTranslation, dcr),
+            bRC_OK);
+  WriteRecords(10);
+
+  EXPECT_EQ(written.size(), 10u);
+  ASSERT_TRUE(dcr->WriteDeferredRecords(true));
+  EXPECT_EQ(written.size(), 10u);
+  EXPECT_GT(dcr->block->binbuf, 0u);
+}
+
+TEST_F(AutoXflate, translates_only_in_configured_direction)
+{
+  EXPECT_TRUE(PluginsTranslateRecords(jcr, dcr, false));
+  EXPECT_FALSE(PluginsTranslateRecords(jcr, dcr, true));
+
+  dcr->autodeflate = IO_DIRECTION_NONE;
+  dcr->autoinflate = IO_DIRECTION_IN;
+  EXPECT_FALSE(PluginsTranslateRecords(jcr, dcr, false));
+  EXPECT_TRUE(PluginsTranslateRecords(jcr, dcr, true));
+
+  dcr->autoinflate = IO_DIRECTION_NONE;
+  EXPECT_FALSE(PluginsTranslateRecords(jcr, dcr, false));
+  EXPECT_FALSE(PluginsTranslateRecords(jcr, dcr, true));
+}
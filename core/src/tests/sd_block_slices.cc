@@ -0,0 +1,141 @@
+/**
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "gtest/gtest.h"
+#include "include/bareos.h"
+#include "stored/stored.h"
+
+using namespace storagedaemon;
+
+static DeviceBlock* NewTestBlock(uint32_t buf_len)
+{
+  DeviceBlock* block = (DeviceBlock*)GetMemory(sizeof(DeviceBlock));
+
+  memset(block, 0, sizeof(DeviceBlock));
+  block->buf_len = buf_len;
+  block->block_len = buf_len;
+  block->buf = GetMemory(buf_len);
+  EmptyBlock(block);
+
+  return block;
+}
+
+static void FillRecord(DeviceRecord* rec, uint32_t len, int32_t file_index)
+{
+  rec->data = CheckPoolMemorySize(rec->data, len);
+  for (uint32_t i = 0; i < len; i++) { rec->data[i] = (char)(i * 7 + len); }
+  rec->data_len = len;
+  rec->FileIndex = file_index;
+  rec->Stream = STREAM_FILE_DATA;
+  rec->VolSessionId = 1;
+  rec->VolSessionTime = 2;
+}
+
+/*
+ * Blocks referencing the record data must be identical to blocks holding
+ * a copy of it once they are flattened.
+ */
+TEST(sd_block_slices, same_layout_as_copied_block)
+{
+  static const uint32_t sizes[] = {10,    100,    3000, 65000, 70000,
+                                   2048,  2047,   1,    30000, 140000,
+                                   64500, 123456, 5,    4096};
+  DeviceBlock* copy_block = NewTestBlock(DEFAULT_BLOCK_SIZE);
+  DeviceBlock* slice_block = NewTestBlock(DEFAULT_BLOCK_SIZE);
+  DeviceRecord* copy_rec = new_record();
+  DeviceRecord* slice_rec = new_record(false);
+  int blocks = 0, sliced_blocks = 0;
+
+  for (int i = 0; i < 200; i++) {
+    uint32_t len = sizes[i % (sizeof(sizes) / sizeof(sizes[0]))];
+    POOLMEM* buf = GetPoolMemory(PM_MESSAGE);
+
+    FillRecord(copy_rec, len, i + 1);
+    slice_rec->data = buf;
+    FillRecord(slice_rec, len, i + 1);
+    buf = slice_rec->data;
+    slice_rec->payload = NewSharedPayload(buf);
+
+    while (1) {
+      bool copy_done = WriteRecordToBlock(copy_block, copy_rec);
+      bool slice_done = WriteRecordToBlock(slice_block, slice_rec);
+
+      ASSERT_EQ(copy_done, slice_done);
+      ASSERT_EQ(copy_block->binbuf, slice_block->binbuf);
+      if (copy_done) { break; }
+
+      if (slice_block->nr_slices > 0) { sliced_blocks++; }
+      FlattenBlock(slice_block);
+      ASSERT_EQ(0u, slice_block->nr_slices);
+      ASSERT_EQ(0, memcmp(copy_block->buf + WRITE_BLKHDR_LENGTH,
+                          slice_block->buf + WRITE_BLKHDR_LENGTH,
+                          copy_block->binbuf - WRITE_BLKHDR_LENGTH));
+      EmptyBlock(copy_block);
+      EmptyBlock(slice_block);
+      blocks++;
+    }
+
+    /*
+     * Small records are always copied so the buffer stays ours.
+     */
+    if (!ReleaseSharedPayload(slice_rec->payload)) { FreePoolMemory(buf); }
+    slice_rec->payload = NULL;
+    slice_rec->data = NULL;
+  }
+
+  EXPECT_GT(blocks, 0);
+  EXPECT_GT(sliced_blocks, 0);
+
+  FreeBlock(copy_block);
+  FreeBlock(slice_block);
+  FreeRecord(copy_rec);
+  FreeRecord(slice_rec);
+}
+
+TEST(sd_block_slices, block_keeps_payload_alive)
+{
+  DeviceBlock* block = NewTestBlock(DEFAULT_BLOCK_SIZE);
+  DeviceRecord* rec = new_record(false);
+  POOLMEM* buf = GetPoolMemory(PM_MESSAGE);
+  SharedPayload* payload;
+
+  rec->data = buf;
+  FillRecord(rec, 4 * MIN_BLOCK_SLICE_LENGTH, 1);
+  payload = NewSharedPayload(rec->data);
+  rec->payload = payload;
+
+  ASSERT_TRUE(WriteRecordToBlock(block, rec));
+  ASSERT_EQ(1u, block->nr_slices);
+  EXPECT_EQ(2, payload->refs.load());
+
+  /*
+   * The block now owns the buffer, it is freed when the block is emptied.
+   */
+  EXPECT_TRUE(ReleaseSharedPayload(payload));
+  EXPECT_EQ(rec->data, block->slices[0].data);
+  EmptyBlock(block);
+  EXPECT_EQ(0u, block->nr_slices);
+
+  rec->payload = NULL;
+  rec->data = NULL;
+  FreeRecord(rec);
+  FreeBlock(block);
+}
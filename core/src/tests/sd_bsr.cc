@@ -0,0 +1,255 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "gtest/gtest.h"
+#include "include/bareos.h"
+#include "stored/stored.h"
+#include "stored/backends/unix_file_device.h"
+#include "stored/bsr.h"
+#include "stored/match_bsr.h"
+
+using namespace storagedaemon;
+
+static BootStrapRecord* NewBsr(BootStrapRecord* prev, const char* volume_name)
+{
+  BootStrapRecord* bsr = (BootStrapRecord*)calloc(1, sizeof(BootStrapRecord));
+
+  bsr->volume = (BsrVolume*)calloc(1, sizeof(BsrVolume));
+  bstrncpy(bsr->volume->VolumeName, volume_name,
+           sizeof(bsr->volume->VolumeName));
+  if (prev) {
+    prev->next = bsr;
+    bsr->prev = prev;
+    bsr->root = prev->root;
+  } else {
+    bsr->root = bsr;
+  }
+
+  return bsr;
+}
+
+static void AddVolAddr(BootStrapRecord* bsr, uint64_t saddr, uint64_t eaddr)
+{
+  BsrVolumeAddress* va =
+      (BsrVolumeAddress*)calloc(1, sizeof(BsrVolumeAddress));
+
+  va->saddr = saddr;
+  va->eaddr = eaddr;
+  va->next = bsr->voladdr;
+  bsr->voladdr = va;
+}
+
+static void AddFileIndex(BootStrapRecord* bsr, int32_t findex, int32_t findex2)
+{
+  BsrFileIndex* fi = (BsrFileIndex*)calloc(1, sizeof(BsrFileIndex));
+
+  fi->findex = findex;
+  fi->findex2 = findex2;
+  fi->next = bsr->FileIndex;
+  bsr->FileIndex = fi;
+}
+
+static void AddSession(BootStrapRecord* bsr,
+                       uint32_t sessid,
+                       uint32_t sesstime)
+{
+  bsr->sessid = (BsrSessionId*)calloc(1, sizeof(BsrSessionId));
+  bsr->sessid->sessid = bsr->sessid->sessid2 = sessid;
+  bsr->sesstime = (BsrSessionTime*)calloc(1, sizeof(BsrSessionTime));
+  bsr->sesstime->sesstime = sesstime;
+}
+
+template <typename T>
+static void FreeList(T* item)
+{
+  while (item) {
+    T* next = item->next;
+    free(item);
+    item = next;
+  }
+}
+
+static void FreeBsrs(BootStrapRecord* bsr)
+{
+  while (bsr) {
+    BootStrapRecord* next = bsr->next;
+
+    FreeList(bsr->voladdr);
+    FreeList(bsr->FileIndex);
+    FreeList(bsr->sessid);
+    FreeList(bsr->sesstime);
+    free(bsr->volume);
+    delete bsr->compiled;
+    free(bsr);
+    bsr = next;
+  }
+}
+
+TEST(sd_bsr, end_addr_of_mounted_volume)
+{
+  unix_file_device dev;
+  BootStrapRecord *root, *bsr;
+
+  bstrncpy(dev.VolHdr.VolumeName, "Full-0001", sizeof(dev.VolHdr.VolumeName));
+
+  root = NewBsr(NULL, "Full-0001");
+  AddVolAddr(root, 1000, 50000);
+  AddVolAddr(root, 60000, 70000);
+  bsr = NewBsr(root, "Full-0002");
+  AddVolAddr(bsr, 0, 900000);
+  bsr = NewBsr(bsr, "Full-0001");
+  AddVolAddr(bsr, 80000, 81000);
+
+  EXPECT_EQ(81000u, GetBsrEndAddr(root, &dev));
+
+  /*
+   * A bsr without addresses for the volume wants all of it.
+   */
+  NewBsr(bsr, "Full-0001");
+  EXPECT_EQ(0u, GetBsrEndAddr(root, &dev));
+
+  EXPECT_EQ(0u, GetBsrEndAddr(NULL, &dev));
+
+  FreeBsrs(root);
+}
+
+TEST(sd_bsr, match_unsorted_file_index_ranges)
+{
+  BootStrapRecord* root = NewBsr(NULL, "Full-0001");
+  DeviceRecord rec;
+  Volume_Label volrec;
+  Session_Label sessrec;
+  std::string matched;
+
+  bstrncpy(volrec.VolumeName, "Full-0001", sizeof(volrec.VolumeName));
+  AddSession(root, 5, 100);
+  AddFileIndex(root, 20, 25);
+  AddFileIndex(root, 7, 9);
+  AddFileIndex(root, 1, 3);
+  AddFileIndex(root, 10, 10);
+  AddFileIndex(root, 2, 4);
+
+  rec.VolSessionId = 5;
+  rec.VolSessionTime = 100;
+  for (int32_t fi = 1; fi <= 25; fi++) {
+    rec.FileIndex = fi;
+    if (MatchBsr(root, &rec, &volrec, &sessrec, NULL) == 1) {
+      matched += std::to_string(fi) + " ";
+    }
+
+    /*
+     * Records of other sessions do not match.
+     */
+    rec.VolSessionId = 6;
+    EXPECT_EQ(0, MatchBsr(root, &rec, &volrec, &sessrec, NULL));
+    rec.VolSessionId = 5;
+  }
+  EXPECT_EQ("1 2 3 4 7 8 9 10 20 21 22 23 24 25 ", matched);
+  EXPECT_FALSE(root->done);
+
+  /*
+   * Past the last range nothing more can match.
+   */
+  rec.FileIndex = 26;
+  EXPECT_EQ(-1, MatchBsr(root, &rec, &volrec, &sessrec, NULL));
+  EXPECT_TRUE(root->done);
+
+  FreeBsrs(root);
+}
+
+TEST(sd_bsr, start_addr_skips_done_ranges)
+{
+  BootStrapRecord* root = NewBsr(NULL, "Full-0001");
+  DeviceRecord rec;
+  Volume_Label volrec;
+  Session_Label sessrec;
+
+  bstrncpy(volrec.VolumeName, "Full-0001", sizeof(volrec.VolumeName));
+  AddVolAddr(root, 500000, 600000);
+  AddVolAddr(root, 1000, 50000);
+
+  EXPECT_EQ(1000u, GetBsrStartAddr(root));
+
+  rec.File = 0;
+  rec.Block = 60000;
+  EXPECT_EQ(0, MatchBsr(root, &rec, &volrec, &sessrec, NULL));
+  EXPECT_EQ(500000u, GetBsrStartAddr(root));
+
+  FreeBsrs(root);
+}
+
+TEST(sd_bsr, split_into_lanes_by_session_and_volume)
+{
+  BootStrapRecord *root, *bsr;
+  std::vector<std::vector<BootStrapRecord*>> lanes;
+
+  /*
+   * Job 1 on Full-0001, job 2 continued from AI-0001 onto AI-0002,
+   * job 3 on AI-0003 and job 4 sharing AI-0002 with job 2.
+   */
+  root = NewBsr(NULL, "Full-0001");
+  AddSession(root, 1, 100);
+  bsr = NewBsr(root, "AI-0001");
+  AddSession(bsr, 2, 100);
+  bsr = NewBsr(bsr, "AI-0003");
+  AddSession(bsr, 3, 100);
+  bsr = NewBsr(bsr, "AI-0002");
+  AddSession(bsr, 2, 100);
+  bsr = NewBsr(bsr, "AI-0002");
+  AddSession(bsr, 4, 100);
+
+  lanes = SplitBsrIntoLanes(root);
+  ASSERT_EQ(3u, lanes.size());
+
+  ASSERT_EQ(1u, lanes[0].size());
+  EXPECT_STREQ("Full-0001", lanes[0][0]->volume->VolumeName);
+
+  ASSERT_EQ(3u, lanes[1].size());
+  EXPECT_STREQ("AI-0001", lanes[1][0]->volume->VolumeName);
+  EXPECT_STREQ("AI-0002", lanes[1][1]->volume->VolumeName);
+  EXPECT_EQ(2u, lanes[1][1]->sessid->sessid);
+  EXPECT_EQ(4u, lanes[1][2]->sessid->sessid);
+
+  ASSERT_EQ(1u, lanes[2].size());
+  EXPECT_STREQ("AI-0003", lanes[2][0]->volume->VolumeName);
+
+  FreeBsrs(root);
+}
+
+TEST(sd_bsr, no_lanes_without_single_session)
+{
+  BootStrapRecord *root, *bsr;
+
+  root = NewBsr(NULL, "Full-0001");
+  AddSession(root, 1, 100);
+  bsr = NewBsr(root, "AI-0001");
+
+  EXPECT_TRUE(SplitBsrIntoLanes(root).empty());
+
+  AddSession(bsr, 2, 100);
+  bsr->sessid->sessid2 = 3;
+  EXPECT_TRUE(SplitBsrIntoLanes(root).empty());
+
+  bsr->sessid->sessid2 = 2;
+  EXPECT_EQ(2u, SplitBsrIntoLanes(root).size());
+
+  FreeBsrs(root);
+}
@@ -0,0 +1,137 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "gtest/gtest.h"
+#include "include/bareos.h"
+#include "stored/latency_histogram.h"
+#include "lib/output_formatter.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace storagedaemon;
+
+TEST(LatencyHistogram, buckets_are_powers_of_two)
+{
+  EXPECT_EQ(0, LatencyHistogram::BucketOf(-5));
+  EXPECT_EQ(0, LatencyHistogram::BucketOf(0));
+  EXPECT_EQ(1, LatencyHistogram::BucketOf(1));
+  EXPECT_EQ(2, LatencyHistogram::BucketOf(2));
+  EXPECT_EQ(2, LatencyHistogram::BucketOf(3));
+  EXPECT_EQ(11, LatencyHistogram::BucketOf(1024));
+  EXPECT_EQ(LatencyHistogram::kBuckets - 1,
+            LatencyHistogram::BucketOf((btime_t)1 << 50));
+}
+
+TEST(LatencyHistogram, percentiles)
+{
+  LatencyHistogram histogram;
+
+  EXPECT_EQ(0u, histogram.Percentile(50));
+
+  /*
+   * 98 fast writes of 100 usec and two slow ones of 3 seconds
+   */
+  for (int i = 0; i < 98; i++) { histogram.Record(100); }
+  histogram.Record(3000000);
+  histogram.Record(3000000);
+
+  EXPECT_EQ(100u, histogram.Count());
+  EXPECT_EQ(98u * 100 + 2 * 3000000, histogram.Sum());
+  EXPECT_EQ(3000000u, histogram.Max());
+  EXPECT_EQ(128u, histogram.Percentile(50));
+  EXPECT_EQ(128u, histogram.Percentile(90));
+  EXPECT_EQ(4194304u, histogram.Percentile(99));
+}
+
+static bool CaptureOutput(void* ctx, const char* msg)
+{
+  ((std::string*)ctx)->append(msg);
+  return true;
+}
+
+TEST(LatencyHistogram, format_lists_kinds_with_samples)
+{
+  DeviceLatencies latencies;
+  std::string output;
+#if HAVE_JANSSON
+  OutputFormatter of(CaptureOutput, &output, NULL, NULL, API_MODE_JSON);
+#else
+  OutputFormatter of(CaptureOutput, &output, NULL, NULL, API_MODE_OFF);
+#endif
+
+  EXPECT_TRUE(latencies.empty());
+  latencies.Record(DeviceLatencyKind::kBlockWrite, 3);
+  latencies.Record(DeviceLatencyKind::kQueueWait, 0);
+  EXPECT_FALSE(latencies.empty());
+
+  of.SetCompact(true);
+  of.ObjectKeyValue("name", "%s=", "File \"1\"", "%s\n");
+  of.ObjectStart("latency");
+  latencies.Format(&of);
+  of.ObjectEnd("latency");
+  of.FinalizeResult(true);
+
+#if HAVE_JANSSON
+  EXPECT_NE(std::string::npos, output.find("\"name\":\"File \\\"1\\\"\""));
+  EXPECT_NE(std::string::npos,
+            output.find("\"block_write\":{\"count\":1,\"sum_usec\":3,"
+                        "\"max_usec\":3,\"p50_usec\":4,\"p90_usec\":4,"
+                        "\"p99_usec\":4,\"buckets\":{\"1\":0,\"2\":0,"
+                        "\"4\":1}}"));
+  EXPECT_NE(std::string::npos,
+            output.find("\"queue_wait\":{\"count\":1,\"sum_usec\":0,"
+                        "\"max_usec\":0,\"p50_usec\":1,\"p90_usec\":1,"
+                        "\"p99_usec\":1,\"buckets\":{\"1\":1}}"));
+#else
+  EXPECT_EQ(
+      "name=File \"1\"\n"
+      "  block_write: count=1 sum_usec=3 max_usec=3 p50_usec=4 p90_usec=4 "
+      "p99_usec=4 buckets=1:0,2:0,4:1\n"
+      "  queue_wait: count=1 sum_usec=0 max_usec=0 p50_usec=1 p90_usec=1 "
+      "p99_usec=1 buckets=1:1\n",
+      output);
+#endif
+}
+
+TEST(LatencyHistogram, concurrent_record)
+{
+  const int threads = 4;
+  const int samples = 100000;
+  LatencyHistogram histogram;
+  std::vector<std::thread> workers;
+
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back([&histogram, t] {
+      for (int i = 0; i < samples; i++) { histogram.Record(t * 1000 + i % 7); }
+    });
+  }
+  for (auto& worker : workers) { worker.join(); }
+
+  uint64_t total = 0;
+  for (int i = 0; i < LatencyHistogram::kBuckets; i++) {
+    total += histogram.Bucket(i);
+  }
+  EXPECT_EQ((uint64_t)threads * samples, histogram.Count());
+  EXPECT_EQ(histogram.Count(), total);
+  EXPECT_EQ((uint64_t)(threads - 1) * 1000 + 6, histogram.Max());
+}
@@ -0,0 +1,214 @@
+/**
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "gtest/gtest.h"
+#include "include/bareos.h"
+#include "stored/stored.h"
+
+#include <string>
+#include <vector>
+
+using namespace storagedaemon;
+
+static DeviceBlock* NewTestBlock(uint32_t buf_len)
+{
+  DeviceBlock* block = (DeviceBlock*)GetMemory(sizeof(DeviceBlock));
+
+  memset(block, 0, sizeof(DeviceBlock));
+  block->buf_len = buf_len;
+  block->block_len = buf_len;
+  block->buf = GetMemory(buf_len);
+  EmptyBlock(block);
+
+  return block;
+}
+
+static std::string RecordData(uint32_t len, int32_t file_index)
+{
+  std::string data(len, 0);
+
+  for (uint32_t i = 0; i < len; i++) { data[i] = (char)(i * 7 + file_index); }
+  return data;
+}
+
+static uint32_t RecordSize(int32_t file_index)
+{
+  static const uint32_t sizes[] = {10, 100, 3000, 65000, 70000, 0,
+                                   1,  5,   4096, 30000, 140000};
+
+  return sizes[(file_index - 1) % (sizeof(sizes) / sizeof(sizes[0]))];
+}
+
+/*
+ * Write records the normal way and return the records part of each block.
+ */
+static std::vector<std::string> WriteRecords(int nr_records)
+{
+  std::vector<std::string> payloads;
+  DeviceBlock* block = NewTestBlock(DEFAULT_BLOCK_SIZE);
+  DeviceRecord* rec = new_record();
+
+  for (int i = 0; i < nr_records; i++) {
+    std::string data = RecordData(RecordSize(i + 1), i + 1);
+
+    rec->data = CheckPoolMemorySize(rec->data, data.size() + 1);
+    memcpy(rec->data, data.data(), data.size());
+    rec->data_len = data.size();
+    rec->FileIndex = i + 1;
+    rec->Stream = STREAM_FILE_DATA;
+    rec->VolSessionId = 1;
+    rec->VolSessionTime = 2;
+
+    while (!WriteRecordToBlock(block, rec)) {
+      payloads.emplace_back(block->buf + WRITE_BLKHDR_LENGTH,
+                            block->binbuf - WRITE_BLKHDR_LENGTH);
+      EmptyBlock(block);
+    }
+  }
+  payloads.emplace_back(block->buf + WRITE_BLKHDR_LENGTH,
+                        block->binbuf - WRITE_BLKHDR_LENGTH);
+
+  FreeRecord(rec);
+  FreeBlock(block);
+
+  return payloads;
+}
+
+/*
+ * Pack the fragments of the payloads into blocks of the given size.
+ */
+static std::vector<std::string> Repack(
+    const std::vector<std::string>& payloads,
+    uint32_t block_size)
+{
+  std::vector<std::string> packed;
+  DeviceBlock* block = NewTestBlock(block_size);
+  FragmentPacker packer;
+  RecordFragment frag;
+
+  for (const auto& payload : payloads) {
+    const char* buf = payload.data();
+    uint32_t len = payload.size();
+
+    while (ParseRecordFragment(&buf, &len, BLOCK_VER, &frag)) {
+      while (!packer.Pack(block, &frag)) {
+        packed.emplace_back(block->buf + WRITE_BLKHDR_LENGTH,
+                            block->binbuf - WRITE_BLKHDR_LENGTH);
+        EmptyBlock(block);
+      }
+    }
+  }
+  packed.emplace_back(block->buf + WRITE_BLKHDR_LENGTH,
+                      block->binbuf - WRITE_BLKHDR_LENGTH);
+
+  FreeBlock(block);
+
+  return packed;
+}
+
+/*
+ * Put the records back together checking that a partially written
+ * record always ends its block and is continued in the next one.
+ */
+static void CheckRecords(const std::vector<std::string>& payloads,
+                         int nr_records)
+{
+  std::string data;
+  int32_t file_index = 0;
+  uint32_t remainder = 0;
+  int complete = 0;
+  bool open = false;
+  RecordFragment frag;
+
+  for (const auto& payload : payloads) {
+    const char* buf = payload.data();
+    uint32_t len = payload.size();
+
+    while (ParseRecordFragment(&buf, &len, BLOCK_VER, &frag)) {
+      if (open) {
+        ASSERT_EQ(-STREAM_FILE_DATA, frag.Stream);
+        ASSERT_EQ(file_index, frag.FileIndex);
+        ASSERT_EQ(remainder, frag.remainder);
+      } else {
+        ASSERT_EQ(STREAM_FILE_DATA, frag.Stream);
+        ASSERT_EQ(file_index + 1, frag.FileIndex);
+        file_index = frag.FileIndex;
+        data.clear();
+      }
+      data.append(frag.data, frag.data_len);
+
+      if (frag.IsPartial()) {
+        ASSERT_EQ(0u, len);
+        remainder = frag.remainder - frag.data_len;
+        open = true;
+        continue;
+      }
+
+      open = false;
+      ASSERT_EQ(RecordData(RecordSize(file_index), file_index), data);
+      complete++;
+    }
+  }
+
+  EXPECT_FALSE(open);
+  EXPECT_EQ(nr_records, complete);
+}
+
+TEST(sd_record_fragments, parse_written_blocks)
+{
+  std::vector<std::string> payloads = WriteRecords(100);
+
+  EXPECT_GT(payloads.size(), 1u);
+  CheckRecords(payloads, 100);
+}
+
+TEST(sd_record_fragments, repack_into_same_size_blocks_is_identical)
+{
+  std::vector<std::string> payloads = WriteRecords(100);
+
+  EXPECT_EQ(payloads, Repack(payloads, DEFAULT_BLOCK_SIZE));
+}
+
+TEST(sd_record_fragments, repack_into_smaller_blocks)
+{
+  std::vector<std::string> payloads = WriteRecords(100);
+  std::vector<std::string> packed = Repack(payloads, 5000);
+
+  EXPECT_GT(packed.size(), payloads.size());
+  CheckRecords(packed, 100);
+}
+
+TEST(sd_record_fragments, repack_into_larger_blocks_merges_fragments)
+{
+  std::vector<std::string> payloads = WriteRecords(100);
+  std::vector<std::string> packed = Repack(payloads, 4 * DEFAULT_BLOCK_SIZE);
+  size_t payload_bytes = 0, packed_bytes = 0;
+
+  for (const auto& payload : payloads) { payload_bytes += payload.size(); }
+  for (const auto& payload : packed) { packed_bytes += payload.size(); }
+
+  /*
+   * A continuation appended to its record needs no header of its own.
+   */
+  EXPECT_LT(packed.size(), payloads.size());
+  EXPECT_LT(packed_bytes, payload_bytes);
+  CheckRecords(packed, 100);
+}
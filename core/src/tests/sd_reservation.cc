@@ -23,6 +23,10 @@
 
 #include <chrono>
 #include <future>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
 
 #define STORAGE_DAEMON 1
 #include "gtest/gtest.h"
@@ -305,3 +309,54 @@ TEST_F(ReservationTest, use_cmd_reserve_read_twice_wait)
   ASSERT_EQ(use_cmd(job2->jcr), true);
   ASSERT_STREQ(bsock->msg, "3000 OK use device device=single3\n");
 }
+
+/*
+ * Reserve devices for a job on the autochanger with 500 drives
+ */
+static std::string ReserveBenchDevice(TestJob& job)
+{
+  auto bsock = std::make_unique<BareosSocketMock>();
+  job.jcr->dir_bsock = bsock.get();
+
+  EXPECT_CALL(*bsock, recv())
+      .WillOnce(BSOCK_RECV(bsock.get(),
+                           "use storage=sssss media_type=Bench pool_name=ppppp "
+                           "pool_type=ptptp append=0 copy=0 stripe=0"))
+      .WillOnce(BSOCK_RECV(bsock.get(), "use device=bench"))
+      .WillOnce(Return(BNET_EOD))   // end of device commands
+      .WillOnce(Return(BNET_EOD));  // end of storage command
+
+  EXPECT_CALL(*bsock, send()).WillRepeatedly(Return(true));
+
+  bsock->recv();
+  std::string reply = use_cmd(job.jcr) ? bsock->msg : "";
+  job.jcr->dir_bsock = nullptr;
+  return reply;
+}
+
+/*
+ * Reserve 1000 jobs against 500 devices, in two rounds that each occupy
+ * all devices before they are released again
+ */
+TEST_F(ReservationTest, use_cmd_reserve_many_devices)
+{
+  const int devices = 500;
+  const int jobs = 1000;
+  std::vector<std::unique_ptr<TestJob>> running;
+  std::set<std::string> replies;
+
+  for (int i = 0; i < jobs; i++) {
+    running.emplace_back(std::make_unique<TestJob>(1000u + i));
+
+    std::string reply = ReserveBenchDevice(*running.back());
+    ASSERT_NE("", reply);
+    replies.insert(reply);
+
+    if (running.size() == devices) {
+      ASSERT_EQ(devices, (int)replies.size());
+      for (auto& job : running) { job->jcr->impl->dcr->UnreserveDevice(); }
+      running.clear();
+      replies.clear();
+    }
+  }
+}
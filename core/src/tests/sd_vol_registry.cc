@@ -0,0 +1,170 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "gtest/gtest.h"
+#include "include/bareos.h"
+#include "stored/stored.h"
+#include "stored/vol_registry.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace storagedaemon;
+
+static std::atomic<int> volumes_allocated{0};
+static std::atomic<int> volumes_freed{0};
+
+static VolumeReservationItem* NewVolume(const char* VolumeName,
+                                        uint32_t JobId = 0)
+{
+  VolumeReservationItem* vol = new VolumeReservationItem;
+
+  vol->vol_name = strdup(VolumeName);
+  vol->SetJobid(JobId);
+  vol->IncUseCount();
+  volumes_allocated++;
+
+  return vol;
+}
+
+static void ReleaseVolume(VolumeReservationItem* vol)
+{
+  if (vol->DecUseCount() > 0) { return; }
+  free(vol->vol_name);
+  delete vol;
+  volumes_freed++;
+}
+
+TEST(VolumeRegistry, insert_find_remove)
+{
+  VolumeRegistry registry;
+  VolumeReservationItem* vol = NewVolume("Full-0001");
+  VolumeReservationItem* dup = NewVolume("Full-0001");
+
+  EXPECT_TRUE(registry.empty());
+  EXPECT_EQ(vol, registry.Insert(vol));
+  EXPECT_EQ(vol, registry.Insert(dup));
+  ReleaseVolume(dup);
+  EXPECT_EQ(1, registry.size());
+
+  VolumeReservationItem* found = registry.Acquire("Full-0001");
+  ASSERT_EQ(vol, found);
+  EXPECT_EQ(2, found->UseCount());
+  EXPECT_EQ(nullptr, registry.Acquire("Full-0002"));
+
+  /*
+   * A removed volume stays valid for whoever still uses it.
+   */
+  EXPECT_TRUE(registry.Remove(vol));
+  EXPECT_FALSE(registry.Remove(vol));
+  ReleaseVolume(vol);
+  EXPECT_FALSE(registry.Contains("Full-0001"));
+  EXPECT_STREQ("Full-0001", found->vol_name);
+  ReleaseVolume(found);
+  EXPECT_TRUE(registry.empty());
+}
+
+TEST(VolumeRegistry, per_job_volumes)
+{
+  VolumeRegistry registry(true);
+  VolumeReservationItem* job1 = NewVolume("Full-0001", 1);
+  VolumeReservationItem* job2 = NewVolume("Full-0001", 2);
+  VolumeReservationItem* again = NewVolume("Full-0001", 1);
+
+  EXPECT_EQ(job1, registry.Insert(job1));
+  EXPECT_EQ(job2, registry.Insert(job2));
+  EXPECT_EQ(job1, registry.Insert(again));
+  ReleaseVolume(again);
+  EXPECT_EQ(2, registry.size());
+
+  VolumeReservationItem* found = registry.Acquire("Full-0001", 2);
+  EXPECT_EQ(job2, found);
+  ReleaseVolume(found);
+
+  EXPECT_TRUE(registry.Remove(job1));
+  EXPECT_TRUE(registry.Contains("Full-0001"));
+  EXPECT_EQ(nullptr, registry.Acquire("Full-0001", 1));
+  EXPECT_TRUE(registry.Remove(job2));
+  EXPECT_FALSE(registry.Contains("Full-0001"));
+
+  ReleaseVolume(job1);
+  ReleaseVolume(job2);
+}
+
+/*
+ * Threads reserving and freeing volumes out of a small set of names while
+ * other threads look them up, like jobs do in Can_i_use_volume().
+ */
+TEST(VolumeRegistry, concurrent_reserve_and_free)
+{
+  const int threads = 8;
+  const int iterations = 20000;
+  const int names = 50;
+  VolumeRegistry registry;
+  std::atomic<int> reserved{0};
+  std::atomic<int> errors{0};
+  std::vector<std::thread> workers;
+
+  volumes_allocated = 0;
+  volumes_freed = 0;
+
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back([&, t] {
+      unsigned int seed = t;
+
+      for (int i = 0; i < iterations; i++) {
+        std::string name = "Vol-" + std::to_string(rand_r(&seed) % names);
+        VolumeReservationItem* vol = NewVolume(name.c_str());
+
+        if (registry.Insert(vol) != vol) {
+          ReleaseVolume(vol); /* reserved by another thread */
+          vol = NULL;
+        } else {
+          reserved++;
+        }
+
+        for (int j = 0; j < 4; j++) {
+          std::string other = "Vol-" + std::to_string(rand_r(&seed) % names);
+          VolumeReservationItem* found = registry.Acquire(other.c_str());
+
+          if (found) {
+            if (other != found->vol_name || found->UseCount() < 1) { errors++; }
+            ReleaseVolume(found);
+          }
+        }
+
+        if (vol) {
+          if (!registry.Remove(vol)) { errors++; }
+          ReleaseVolume(vol);
+        }
+      }
+    });
+  }
+  for (auto& worker : workers) { worker.join(); }
+
+  EXPECT_EQ(0, errors);
+  EXPECT_GT(reserved, 0);
+  EXPECT_TRUE(registry.empty());
+  EXPECT_EQ(threads * iterations, (int)volumes_allocated);
+  EXPECT_EQ(volumes_allocated, volumes_freed);
+}
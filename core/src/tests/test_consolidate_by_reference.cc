@@ -0,0 +1,439 @@
+/**
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#define _BDB_PRIV_INTERFACE_
+
+#include "gtest/gtest.h"
+#include "include/bareos.h"
+#include "dird/dird.h"
+#include "dird/bsr.h"
+#include "dird/jcr_private.h"
+#include "dird/job.h"
+#include "dird/vbackup.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace directordaemon;
+
+namespace directordaemon {
+bool DoReloadConfig() { return false; }
+}  // namespace directordaemon
+
+typedef std::vector<std::string> FakeRow;
+
+/*
+ * Catalog answering every query that contains a given text with the rows
+ * registered for it and remembering all queries it was asked.
+ */
+class FakeCatalog : public BareosDb {
+ public:
+  FakeCatalog();
+  ~FakeCatalog();
+
+  void AddRows(const std::string& text, std::vector<FakeRow> rows);
+  std::vector<std::string> QueriesContaining(const std::string& text) const;
+
+  std::vector<std::string> executed;
+
+  bool OpenDatabase(JobControlRecord* jcr) override { return true; }
+  void CloseDatabase(JobControlRecord* jcr) override {}
+  bool ValidateConnection(void) override { return true; }
+  void StartTransaction(JobControlRecord* jcr) override {}
+  void EndTransaction(JobControlRecord* jcr) override {}
+
+ private:
+  std::vector<std::pair<std::string, std::vector<FakeRow>>> results_;
+  const std::vector<FakeRow>* result_ = nullptr;
+  size_t row_number_ = 0;
+  std::vector<char*> row_;
+
+  const std::vector<FakeRow>* Lookup(const char* query);
+  SQL_ROW MakeRow(const FakeRow& row);
+
+  int SqlNumRows(void) override { return result_ ? result_->size() : 0; }
+  void SqlFieldSeek(int field) override {}
+  int SqlNumFields(void) override
+  {
+    return (result_ && !result_->empty()) ? result_->front().size() : 0;
+  }
+  void SqlFreeResult(void) override { result_ = nullptr; }
+  SQL_ROW SqlFetchRow(void) override
+  {
+    if (!result_ || row_number_ >= result_->size()) { return NULL; }
+    return MakeRow((*result_)[row_number_++]);
+  }
+  bool SqlQueryWithoutHandler(const char* query, int flags = 0) override
+  {
+    result_ = Lookup(query);
+    row_number_ = 0;
+    return true;
+  }
+  bool SqlQueryWithHandler(const char* query,
+                           DB_RESULT_HANDLER* ResultHandler,
+                           void* ctx) override
+  {
+    const std::vector<FakeRow>* rows = Lookup(query);
+
+    if (rows && ResultHandler) {
+      for (auto& row : *rows) { ResultHandler(ctx, row.size(), MakeRow(row)); }
+    }
+    return true;
+  }
+  const char* sql_strerror(void) override { return "fake catalog"; }
+  void SqlDataSeek(int row) override { row_number_ = row; }
+  int SqlAffectedRows(void) override { return 1; }
+  uint64_t SqlInsertAutokeyRecord(const char* query,
+                                  const char* table_name) override
+  {
+    executed.push_back(query);
+    return 1;
+  }
+  SQL_FIELD* SqlFetchField(void) override { return NULL; }
+  bool SqlFieldIsNotNull(int field_type) override { return true; }
+  bool SqlFieldIsNumeric(int field_type) override { return false; }
+  bool SqlBatchStart(JobControlRecord* jcr) override { return true; }
+  bool SqlBatchEnd(JobControlRecord* jcr, const char* error) override
+  {
+    return true;
+  }
+  bool SqlBatchInsert(JobControlRecord* jcr, AttributesDbRecord* ar) override
+  {
+    return true;
+  }
+};
+
+/*
+ * The predefined queries are not used to look up the results, an empty
+ * text for each of them is enough.
+ */
+static const char* no_queries[static_cast<int>(
+    BareosDb::SQL_QUERY::SQL_QUERY_NUMBER)];
+
+FakeCatalog::FakeCatalog()
+{
+  RwlInit(&lock_);
+  cmd = GetPoolMemory(PM_EMSG);
+  errmsg = GetPoolMemory(PM_EMSG);
+  *errmsg = 0;
+  for (auto& query : no_queries) { query = ""; }
+  queries = no_queries;
+}
+
+FakeCatalog::~FakeCatalog()
+{
+  RwlDestroy(&lock_);
+  FreePoolMemory(cmd);
+  FreePoolMemory(errmsg);
+}
+
+void FakeCatalog::AddRows(const std::string& text, std::vector<FakeRow> rows)
+{
+  results_.push_back(std::make_pair(text, std::move(rows)));
+}
+
+std::vector<std::string> FakeCatalog::QueriesContaining(
+    const std::string& text) const
+{
+  std::vector<std::string> found;
+
+  for (auto& query : executed) {
+    if (query.find(text) != std::string::npos) { found.push_back(query); }
+  }
+  return found;
+}
+
+const std::vector<FakeRow>* FakeCatalog::Lookup(const char* query)
+{
+  executed.push_back(query);
+  for (auto& result : results_) {
+    if (strstr(query, result.first.c_str())) { return &result.second; }
+  }
+  return nullptr;
+}
+
+SQL_ROW FakeCatalog::MakeRow(const FakeRow& row)
+{
+  row_.clear();
+  for (auto& field : row) { row_.push_back(const_cast<char*>(field.c_str())); }
+  return row_.data();
+}
+
+/*
+ * Rows as returned by the catalog queries used when consolidating,
+ * unused columns are zero.
+ */
+static FakeRow FileRow(int32_t FileIndex, JobId_t JobId)
+{
+  return FakeRow{"/path/", "file" + std::to_string(FileIndex),
+                 std::to_string(FileIndex), std::to_string(JobId), "lstat",
+                 "0"};
+}
+
+static FakeRow JobRow(uint32_t VolSessionId,
+                      uint32_t VolSessionTime,
+                      int JobFiles)
+{
+  FakeRow row(23, "0");
+
+  row[0] = std::to_string(VolSessionId);
+  row[1] = std::to_string(VolSessionTime);
+  row[5] = std::to_string(JobFiles);
+  return row;
+}
+
+static FakeRow JobMediaRow(const std::string& VolumeName,
+                           uint32_t FirstIndex,
+                           uint32_t LastIndex,
+                           uint32_t StartBlock,
+                           uint32_t EndBlock,
+                           uint64_t JobBytes)
+{
+  FakeRow row(15, "0");
+
+  row[0] = VolumeName;
+  row[1] = "File";
+  row[2] = std::to_string(FirstIndex);
+  row[3] = std::to_string(LastIndex);
+  row[6] = std::to_string(StartBlock);
+  row[7] = std::to_string(EndBlock);
+  row[11] = std::to_string(JobBytes);
+  return row;
+}
+
+static FakeRow MediaRow(DBId_t MediaId, const std::string& VolumeName)
+{
+  FakeRow row(40, "0");
+
+  row[0] = std::to_string(MediaId);
+  row[1] = VolumeName;
+  return row;
+}
+
+static size_t CountOf(const std::string& text, const std::string& what)
+{
+  size_t count = 0;
+
+  for (size_t pos = text.find(what); pos != std::string::npos;
+       pos = text.find(what, pos + what.size())) {
+    count++;
+  }
+  return count;
+}
+
+class ConsolidateByReferenceTest : public ::testing::Test {
+ protected:
+  void SetUp() override;
+  void TearDown() override;
+
+  JobControlRecord* jcr = nullptr;
+  FakeCatalog* db = nullptr;
+};
+
+void ConsolidateByReferenceTest::SetUp()
+{
+  InitMsg(NULL, NULL);
+
+  db = new FakeCatalog;
+  jcr = NewDirectorJcr();
+  jcr->JobId = 10;
+  jcr->impl->jr.JobId = 10;
+  jcr->db = db;
+  jcr->db_batch = db;
+}
+
+void ConsolidateByReferenceTest::TearDown()
+{
+  jcr->db = nullptr;
+  jcr->db_batch = nullptr;
+  jcr->JobId = 0;
+  FreeJcr(jcr);
+  delete db;
+
+  TermMsg();
+}
+
+TEST_F(ConsolidateByReferenceTest, references_selected_files_of_each_job)
+{
+  char jobids[] = "1,2";
+
+  /*
+   * FileIndex 4 of JobId 1 was superseded by JobId 2.
+   */
+  db->AddRows("T1.FileIndex", {FileRow(1, 1), FileRow(2, 1), FileRow(3, 1),
+                               FileRow(5, 1), FileRow(1, 2), FileRow(2, 2)});
+  db->AddRows("FROM Job WHERE JobId=1", {JobRow(11, 100, 5)});
+  db->AddRows("FROM Job WHERE JobId=2", {JobRow(12, 200, 3)});
+  db->AddRows("JobMedia.JobId=1",
+              {JobMediaRow("Full-0001", 1, 5, 100, 200, 1000)});
+  db->AddRows("JobMedia.JobId=2",
+              {JobMediaRow("Incr-0002", 1, 3, 300, 400, 500)});
+  db->AddRows("VolumeName='Full-0001'", {MediaRow(7, "Full-0001")});
+  db->AddRows("VolumeName='Incr-0002'", {MediaRow(8, "Incr-0002")});
+  db->AddRows("SELECT COUNT(*) FROM File WHERE JobId=10", {{"6"}});
+
+  ASSERT_TRUE(ConsolidateByReference(jcr, jobids));
+
+  auto files = db->QueriesContaining("INSERT INTO File ");
+  ASSERT_EQ(files.size(), 2u);
+  EXPECT_NE(files[0].find("SELECT FileIndex+0,10,"), std::string::npos);
+  EXPECT_NE(files[0].find("WHERE JobId=1 AND (FileIndex BETWEEN 1 AND 3 OR "
+                          "FileIndex BETWEEN 5 AND 5)"),
+            std::string::npos);
+  EXPECT_NE(files[1].find("SELECT FileIndex+5,10,"), std::string::npos);
+  EXPECT_NE(files[1].find("WHERE JobId=2 AND (FileIndex BETWEEN 1 AND 2)"),
+            std::string::npos);
+
+  auto jobmedia = db->QueriesContaining("INSERT INTO JobMedia ");
+  ASSERT_EQ(jobmedia.size(), 2u);
+  EXPECT_NE(jobmedia[0].find("VALUES (10,7,1,5,0,0,100,200,1000,1,11,100,0)"),
+            std::string::npos);
+  EXPECT_NE(jobmedia[1].find("VALUES (10,8,6,7,0,0,300,400,500,2,12,200,5)"),
+            std::string::npos);
+
+  EXPECT_TRUE(db->QueriesContaining("DELETE FROM").empty());
+  EXPECT_EQ(db->QueriesContaining("COUNT(*) FROM File WHERE JobId=10").size(),
+            1u);
+  EXPECT_EQ(jcr->impl->SDJobFiles, 6u);
+  EXPECT_EQ(jcr->impl->ExpectedFiles, 6u);
+  EXPECT_EQ(jcr->impl->SDJobBytes, 1500u);
+  EXPECT_EQ(jcr->JobStatus, JS_Terminated);
+}
+
+/*
+ * The files of the new job are the File records that were copied, a
+ * record missing in the catalog is not counted.
+ */
+TEST_F(ConsolidateByReferenceTest, counts_copied_file_records)
+{
+  char jobids[] = "1";
+
+  db->AddRows("T1.FileIndex", {FileRow(1, 1), FileRow(2, 1), FileRow(3, 1)});
+  db->AddRows("FROM Job WHERE JobId=1", {JobRow(11, 100, 3)});
+  db->AddRows("JobMedia.JobId=1",
+              {JobMediaRow("Full-0001", 1, 3, 100, 200, 1000)});
+  db->AddRows("VolumeName='Full-0001'", {MediaRow(7, "Full-0001")});
+  db->AddRows("SELECT COUNT(*) FROM File WHERE JobId=10", {{"2"}});
+
+  ASSERT_TRUE(ConsolidateByReference(jcr, jobids));
+
+  EXPECT_EQ(jcr->impl->SDJobFiles, 2u);
+  EXPECT_EQ(jcr->impl->ExpectedFiles, 2u);
+}
+
+TEST_F(ConsolidateByReferenceTest, fails_without_files)
+{
+  char jobids[] = "1,2";
+
+  EXPECT_FALSE(ConsolidateByReference(jcr, jobids));
+  EXPECT_TRUE(db->QueriesContaining("INSERT INTO").empty());
+}
+
+TEST_F(ConsolidateByReferenceTest, removes_partial_job_on_error)
+{
+  char jobids[] = "1";
+
+  db->AddRows("T1.FileIndex", {FileRow(1, 1)});
+  db->AddRows("FROM Job WHERE JobId=1", {JobRow(11, 100, 1)});
+  db->AddRows("JobMedia.JobId=1", {JobMediaRow("Gone-0001", 1, 1, 1, 2, 10)});
+
+  EXPECT_FALSE(ConsolidateByReference(jcr, jobids));
+  EXPECT_EQ(db->QueriesContaining("INSERT INTO File ").size(), 1u);
+  EXPECT_TRUE(db->QueriesContaining("INSERT INTO JobMedia ").empty());
+  EXPECT_EQ(db->QueriesContaining("DELETE FROM File WHERE JobId=10").size(),
+            1u);
+  EXPECT_EQ(db->QueriesContaining("DELETE FROM JobMedia WHERE JobId=10").size(),
+            1u);
+}
+
+TEST_F(ConsolidateByReferenceTest, copies_file_records_in_batches)
+{
+  std::vector<std::pair<int32_t, int32_t>> ranges;
+
+  for (int32_t i = 0; i < 501; i++) {
+    ranges.push_back(std::make_pair(2 * i + 1, 2 * i + 1));
+  }
+
+  ASSERT_TRUE(CopyFileRecords(jcr, 3, ranges, 42));
+
+  auto files = db->QueriesContaining("INSERT INTO File ");
+  ASSERT_EQ(files.size(), 2u);
+  EXPECT_EQ(CountOf(files[0], " BETWEEN "), 500u);
+  EXPECT_EQ(CountOf(files[1], " BETWEEN "), 1u);
+  for (auto& query : files) {
+    EXPECT_NE(query.find("SELECT FileIndex+42,10,"), std::string::npos);
+    EXPECT_NE(query.find("FROM File WHERE JobId=3 AND ("), std::string::npos);
+  }
+  EXPECT_NE(files[0].find("(FileIndex BETWEEN 1 AND 1 OR"), std::string::npos);
+  EXPECT_NE(files[1].find("(FileIndex BETWEEN 1001 AND 1001)"),
+            std::string::npos);
+}
+
+TEST_F(ConsolidateByReferenceTest, references_only_volumes_with_selected_files)
+{
+  RestoreBootstrapRecord bsr(1);
+  std::vector<std::pair<int32_t, int32_t>> ranges{std::make_pair(2, 4),
+                                                  std::make_pair(25, 25)};
+  uint32_t VolIndex = 0;
+
+  bsr.VolSessionId = 11;
+  bsr.VolSessionTime = 100;
+  bsr.VolCount = 3;
+  bsr.VolParams =
+      (VolumeParameters*)malloc(bsr.VolCount * sizeof(VolumeParameters));
+  for (int i = 0; i < bsr.VolCount; i++) {
+    new (&bsr.VolParams[i]) VolumeParameters();
+    bsr.VolParams[i].FirstIndex = 10 * i + 1;
+    bsr.VolParams[i].LastIndex = 10 * i + 10;
+    bsr.VolParams[i].JobBytes = 100 * (i + 1);
+    bsr.VolParams[i].StartAddr = 10 * i;
+    bsr.VolParams[i].EndAddr = 10 * i + 9;
+  }
+  bstrncpy(bsr.VolParams[0].VolumeName, "Full-0001", MAX_NAME_LENGTH);
+  bstrncpy(bsr.VolParams[1].VolumeName, "Full-0002", MAX_NAME_LENGTH);
+  bstrncpy(bsr.VolParams[2].VolumeName, "Full-0003", MAX_NAME_LENGTH);
+
+  /*
+   * The blocks on the last volume were already referenced by the
+   * consolidated job, they keep the session they were written with.
+   */
+  bsr.VolParams[2].VolSessionId = 5;
+  bsr.VolParams[2].VolSessionTime = 6;
+  bsr.VolParams[2].FileIndexOffset = 3;
+
+  db->AddRows("VolumeName='Full-0001'", {MediaRow(7, "Full-0001")});
+  db->AddRows("VolumeName='Full-0002'", {MediaRow(8, "Full-0002")});
+  db->AddRows("VolumeName='Full-0003'", {MediaRow(9, "Full-0003")});
+
+  ASSERT_TRUE(CreateReferenceJobMedia(jcr, &bsr, ranges, 100, VolIndex));
+
+  EXPECT_TRUE(db->QueriesContaining("VolumeName='Full-0002'").empty());
+
+  auto jobmedia = db->QueriesContaining("INSERT INTO JobMedia ");
+  ASSERT_EQ(jobmedia.size(), 2u);
+  EXPECT_NE(jobmedia[0].find("VALUES (10,7,102,104,0,0,0,9,100,1,11,100,100)"),
+            std::string::npos);
+  EXPECT_NE(jobmedia[1].find("VALUES (10,9,125,125,0,0,20,29,300,2,5,6,103)"),
+            std::string::npos);
+  EXPECT_EQ(VolIndex, 2u);
+  EXPECT_EQ(jcr->impl->SDJobBytes, 400u);
+}
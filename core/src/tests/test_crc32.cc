@@ -41,3 +41,60 @@ TEST(crc32, internal_spd)
   }
   free(buf);
 }
+
+/*
+ * All kernels must return exactly what the bitwise reference algorithm
+ * returns for every length and alignment, also when continuing a CRC.
+ */
+static void CompareWithBitwise(uint32_t (*crc32_func)(const void*,
+                                                       size_t,
+                                                       uint32_t))
+{
+  const size_t max_len = 2048;
+  uint8_t* buf = static_cast<uint8_t*>(malloc(max_len + 64));
+
+  for (size_t i = 0; i < max_len + 64; i++) { buf[i] = (i * 31 + 7) & 0xff; }
+
+  for (size_t offset = 0; offset < 64; offset += 7) {
+    for (size_t length = 0; length <= max_len; length++) {
+      ASSERT_EQ(crc32_bitwise(buf + offset, length),
+                crc32_func(buf + offset, length, 0))
+          << "offset=" << offset << " length=" << length;
+      ASSERT_EQ(crc32_bitwise(buf + offset, length, 0x12345678),
+                crc32_func(buf + offset, length, 0x12345678))
+          << "offset=" << offset << " length=" << length;
+    }
+  }
+  free(buf);
+}
+
+TEST(crc32, fast_matches_bitwise) { CompareWithBitwise(crc32_fast); }
+
+TEST(crc32, pclmul_matches_bitwise)
+{
+  if (!crc32_pclmul_supported()) {
+    GTEST_SKIP() << "CPU does not support PCLMULQDQ";
+  }
+  CompareWithBitwise(crc32_pclmul);
+}
+
+TEST(crc32, vpclmul_matches_bitwise)
+{
+  if (!crc32_vpclmul_supported()) {
+    GTEST_SKIP() << "CPU does not support VPCLMULQDQ";
+  }
+  CompareWithBitwise(crc32_vpclmul);
+}
+
+TEST(crc32, vpclmul_large_block)
+{
+  if (!crc32_vpclmul_supported()) {
+    GTEST_SKIP() << "CPU does not support VPCLMULQDQ";
+  }
+  uint8_t* buf = static_cast<uint8_t*>(malloc(len));
+  std::fill(buf, buf + len, 0xbb);
+
+  EXPECT_EQ(0xbc003c2c, crc32_vpclmul(buf, len));
+  EXPECT_EQ(0xbc003c2c, crc32_pclmul(buf, len));
+  free(buf);
+}
@@ -21,7 +21,10 @@
 #include "gtest/gtest.h"
 #include "include/bareos.h"
 
+#include "dird/dird.h"
 #include "dird/bsr.h"
+#include "dird/ua.h"
+#include "include/make_unique.h"
 
 #include <algorithm>
 #include <numeric>
@@ -205,3 +208,86 @@ TEST(fileindex_list, gap_list_duplicates_random_order)
   std::shuffle(fileIds.begin(), fileIds.end(), std::default_random_engine{});
   EXPECT_EQ(ToBsrStringLocal(fileIds), ToBsrStringBareos(fileIds));
 }
+
+TEST(fileindex_list, write_findex_with_offset)
+{
+  RestoreBootstrapRecord bsr;
+  auto buffer = std::string{};
+
+  for (auto fid : {1001, 1002, 1003, 1010, 1020}) {
+    AddFindex(&bsr, kJobId_1, fid);
+  }
+
+  /*
+   * The JobMedia record covers FileIndexes 1002-1010 of the job which are
+   * found as 2-10 on the volume.
+   */
+  EXPECT_EQ(write_findex(bsr.fi.get(), 1002, 1010, buffer, 1000), 3);
+  EXPECT_EQ(buffer, "FileIndex=2-3\nFileIndex=10\n");
+}
+
+/*
+ * A Virtual Full consolidated by reference restores from the blocks of the
+ * consolidated jobs, their session and FileIndexes are selected.
+ */
+TEST(fileindex_list, write_bsr_of_referencing_job)
+{
+  RestoreContext rx;
+  StorageResource store;
+  char jobids[] = "10";
+  auto buffer = std::string{};
+  RestoreBootstrapRecord* bsr;
+
+  rx.JobIds = jobids;
+  rx.store = &store;
+  rx.bsr = std::make_unique<RestoreBootstrapRecord>(10);
+  bsr = rx.bsr.get();
+  bsr->VolSessionId = 20;
+  bsr->VolSessionTime = 300;
+  for (auto fid : {2, 3, 6, 7}) { AddFindex(bsr, 10, fid); }
+
+  bsr->VolCount = 2;
+  bsr->VolParams =
+      (VolumeParameters*)malloc(bsr->VolCount * sizeof(VolumeParameters));
+  for (int i = 0; i < bsr->VolCount; i++) {
+    new (&bsr->VolParams[i]) VolumeParameters();
+    bstrncpy(bsr->VolParams[i].MediaType, "File", MAX_NAME_LENGTH);
+    bsr->VolParams[i].StartAddr = 100 * i;
+    bsr->VolParams[i].EndAddr = 100 * i + 99;
+  }
+
+  /*
+   * FileIndexes 1-5 of the job are 1-5 of the first consolidated job,
+   * 6-7 are 1-2 of the second one.
+   */
+  bstrncpy(bsr->VolParams[0].VolumeName, "Full-0001", MAX_NAME_LENGTH);
+  bsr->VolParams[0].FirstIndex = 1;
+  bsr->VolParams[0].LastIndex = 5;
+  bsr->VolParams[0].VolSessionId = 11;
+  bsr->VolParams[0].VolSessionTime = 100;
+  bstrncpy(bsr->VolParams[1].VolumeName, "Incr-0002", MAX_NAME_LENGTH);
+  bsr->VolParams[1].FirstIndex = 6;
+  bsr->VolParams[1].LastIndex = 7;
+  bsr->VolParams[1].VolSessionId = 12;
+  bsr->VolParams[1].VolSessionTime = 200;
+  bsr->VolParams[1].FileIndexOffset = 5;
+
+  EXPECT_EQ(WriteBsr(nullptr, rx, buffer), 4u);
+  EXPECT_EQ(buffer,
+            "Storage=\"\"\n"
+            "Volume=\"Full-0001\"\n"
+            "MediaType=\"File\"\n"
+            "VolSessionId=11\n"
+            "VolSessionTime=100\n"
+            "VolAddr=0-99\n"
+            "FileIndex=2-3\n"
+            "Count=2\n"
+            "Storage=\"\"\n"
+            "Volume=\"Incr-0002\"\n"
+            "MediaType=\"File\"\n"
+            "VolSessionId=12\n"
+            "VolSessionTime=200\n"
+            "VolAddr=100-199\n"
+            "FileIndex=1-2\n"
+            "Count=2\n");
+}
@@ -0,0 +1,187 @@
+/**
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2019-2019 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "gtest/gtest.h"
+#include "include/bareos.h"
+#include "stored/backends/io_uring_engine.h"
+
+using namespace storagedaemon;
+
+static const size_t kBlockSize = 63 * 1024;
+static const int kBlocks = 256;
+
+/*
+ * Create a temporary file, opened with O_DIRECT when asked for. Returns -1
+ * when the filesystem does not support O_DIRECT.
+ */
+static int OpenTestFile(bool direct_io)
+{
+  char filename[] = "/tmp/test_io_uring_engine.XXXXXX";
+  int fd;
+
+  fd = mkstemp(filename);
+  if (fd < 0) { return -1; }
+
+  if (direct_io) {
+    close(fd);
+    fd = open(filename, O_RDWR | O_DIRECT);
+  }
+  unlink(filename);
+
+  return fd;
+}
+
+/*
+ * Write blocks of different sizes (including one not fitting into the
+ * engine buffers) and read them back.
+ */
+static void WriteAndReadBack(bool direct_io)
+{
+  IoUringEngine engine;
+  std::vector<char> buffer(4 * kBlockSize);
+  boffset_t offset = 0;
+  int fd;
+
+  if (!engine.Init(8, kBlockSize, direct_io)) {
+    std::cout << "io_uring not available, skipping test.\n";
+    return;
+  }
+
+  fd = OpenTestFile(direct_io);
+  if (fd < 0 && errno == EINVAL) {
+    std::cout << "O_DIRECT not supported, skipping test.\n";
+    return;
+  }
+  ASSERT_GE(fd, 0);
+
+  for (int i = 0; i < kBlocks; i++) {
+    size_t len = (i == kBlocks / 2) ? 3 * kBlockSize : kBlockSize - (i % 3);
+
+    memset(buffer.data(), i, len);
+    ASSERT_EQ((ssize_t)len, engine.Write(fd, buffer.data(), len, offset));
+    offset += len;
+  }
+  EXPECT_TRUE(engine.Sync(fd));
+  EXPECT_EQ(0, engine.TakeError());
+
+  offset = 0;
+  for (int i = 0; i < kBlocks; i++) {
+    size_t len = (i == kBlocks / 2) ? 3 * kBlockSize : kBlockSize - (i % 3);
+
+    ASSERT_EQ((ssize_t)len, engine.Read(fd, buffer.data(), len, offset));
+    for (size_t j = 0; j < len; j++) { ASSERT_EQ((char)i, buffer[j]); }
+    offset += len;
+  }
+  EXPECT_EQ(0, engine.Read(fd, buffer.data(), kBlockSize, offset));
+
+  close(fd);
+}
+
+TEST(io_uring_engine, write_read) { WriteAndReadBack(false); }
+
+TEST(io_uring_engine, write_read_unaligned_direct) { WriteAndReadBack(true); }
+
+/*
+ * Aligned writes keep O_DIRECT, the first unaligned one clears it for the
+ * rest of the file.
+ */
+TEST(io_uring_engine, direct_until_unaligned)
+{
+  IoUringEngine engine;
+  const size_t block_size = 64 * 1024;
+  std::vector<char> buffer(block_size);
+  boffset_t offset = 0;
+  int fd;
+
+  if (!engine.Init(8, block_size, true)) {
+    std::cout << "io_uring not available, skipping test.\n";
+    return;
+  }
+
+  fd = OpenTestFile(true);
+  if (fd < 0 && errno == EINVAL) {
+    std::cout << "O_DIRECT not supported, skipping test.\n";
+    return;
+  }
+  ASSERT_GE(fd, 0);
+
+  for (int i = 0; i < 16; i++) {
+    memset(buffer.data(), i, block_size);
+    ASSERT_EQ((ssize_t)block_size,
+              engine.Write(fd, buffer.data(), block_size, offset));
+    offset += block_size;
+  }
+  EXPECT_TRUE(engine.Drain());
+  EXPECT_TRUE(fcntl(fd, F_GETFL) & O_DIRECT);
+
+  memset(buffer.data(), 16, block_size);
+  ASSERT_EQ(1000, engine.Write(fd, buffer.data(), 1000, offset));
+  offset += 1000;
+  EXPECT_FALSE(fcntl(fd, F_GETFL) & O_DIRECT);
+
+  memset(buffer.data(), 17, block_size);
+  ASSERT_EQ((ssize_t)block_size,
+            engine.Write(fd, buffer.data(), block_size, offset));
+  EXPECT_TRUE(engine.Sync(fd));
+  EXPECT_EQ(0, engine.TakeError());
+
+  offset = 0;
+  for (int i = 0; i < 18; i++) {
+    size_t len = (i == 16) ? 1000 : block_size;
+
+    ASSERT_EQ((ssize_t)len, engine.Read(fd, buffer.data(), len, offset));
+    for (size_t j = 0; j < len; j++) { ASSERT_EQ((char)i, buffer[j]); }
+    offset += len;
+  }
+
+  close(fd);
+}
+
+TEST(io_uring_engine, deferred_write_error)
+{
+  IoUringEngine engine;
+  char filename[] = "/tmp/test_io_uring_engine.XXXXXX";
+  char buffer[512] = {0};
+  int fd;
+
+  if (!engine.Init(4, kBlockSize, false)) {
+    std::cout << "io_uring not available, skipping test.\n";
+    return;
+  }
+
+  fd = mkstemp(filename);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  fd = open(filename, O_RDONLY);
+  unlink(filename);
+  ASSERT_GE(fd, 0);
+
+  /*
+   * The write is accepted, the error shows up once it completed.
+   */
+  EXPECT_EQ((ssize_t)sizeof(buffer),
+            engine.Write(fd, buffer, sizeof(buffer), 0));
+  EXPECT_FALSE(engine.Drain());
+  EXPECT_EQ(EBADF, engine.TakeError());
+  EXPECT_EQ(0, engine.TakeError());
+
+  close(fd);
+}
@@ -0,0 +1,3 @@
+<?php
+   $bareos_full_version = "19.1.2";
+?>